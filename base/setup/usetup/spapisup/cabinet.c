@@ -72,6 +72,10 @@ typedef struct _DOSDATE
 #define CAB_FILE_SPLIT       0xFFFE
 #define CAB_FILE_PREV_NEXT   0xFFFF
 
+/* Extracted files that may be written in the background */
+#define CAB_MAX_PENDING_WRITES  16
+#define CAB_MAX_PENDING_SIZE    (8 * 1024 * 1024)
+
 
 /* Cabinet structures */
 
@@ -134,6 +138,20 @@ typedef struct _CFDATA
 } CFDATA, *PCFDATA;
 
 
+/* Extracted file being written */
+typedef struct _CAB_PENDING_WRITE
+{
+    LIST_ENTRY ListEntry;
+    HANDLE FileHandle;
+    HANDLE Event;
+    IO_STATUS_BLOCK IoStatusBlock;
+    NTSTATUS Status;
+    ULONG Size;
+    WCHAR FileName[MAX_PATH];
+    UCHAR Data[ANYSIZE_ARRAY];
+} CAB_PENDING_WRITE, *PCAB_PENDING_WRITE;
+
+
 /* FUNCTIONS ****************************************************************/
 
 /* Needed by zlib, but we don't want the dependency on the CRT */
@@ -491,6 +509,9 @@ CloseCabinet(
         CabinetContext->FileBuffer = NULL;
     }
 
+    /* The next cabinet may be mapped at the same address */
+    CabinetContext->DecodedData = NULL;
+
     return 0;
 }
 
@@ -520,6 +541,7 @@ CabinetInitialize(
     CabinetContext->DataReserved = 0;
     CabinetContext->CabinetReservedArea = NULL;
     CabinetContext->LastFileOffset = 0;
+    InitializeListHead(&CabinetContext->PendingWrites);
 }
 
 /*
@@ -801,6 +823,14 @@ VOID
 CabinetClose(
     IN OUT PCABINET_CONTEXT CabinetContext)
 {
+    CabinetFlushWrites(CabinetContext);
+
+    if (CabinetContext->BlockBuffer)
+    {
+        RtlFreeHeap(ProcessHeap, 0, CabinetContext->BlockBuffer);
+        CabinetContext->BlockBuffer = NULL;
+    }
+
     if (!CabinetContext->FileOpen)
         return;
 
@@ -940,6 +970,37 @@ CabinetFindNextFileSequential(
     return CabinetFindNext(CabinetContext, Search);
 }
 
+/*
+ * FUNCTION: Returns the name and location of the file found by a search
+ * ARGUMENTS:
+ *     Search         = Pointer to search structure
+ *     FileName       = Pointer to buffer to place the file name
+ *     FileNameLength = Size of FileName in characters
+ *     FolderIndex    = Address of buffer to place the folder of the file
+ *     FileOffset     = Address of buffer to place the uncompressed offset of the file
+ */
+VOID
+CabinetGetFileInformation(
+    IN PCAB_SEARCH Search,
+    OUT PWSTR FileName,
+    IN ULONG FileNameLength,
+    OUT PULONG FolderIndex,
+    OUT PULONG FileOffset)
+{
+    ANSI_STRING AnsiString;
+    UNICODE_STRING UnicodeString;
+
+    RtlInitAnsiString(&AnsiString, Search->File->FileName);
+    UnicodeString.Buffer = FileName;
+    UnicodeString.Buffer[0] = 0;
+    UnicodeString.Length = 0;
+    UnicodeString.MaximumLength = (USHORT)min(FileNameLength * sizeof(WCHAR), MAXUSHORT);
+    RtlAnsiStringToUnicodeString(&UnicodeString, &AnsiString, FALSE);
+
+    *FolderIndex = Search->File->FolderIndex;
+    *FileOffset = Search->File->FileOffset;
+}
+
 #if 0
 int
 Validate(VOID)
@@ -948,26 +1009,147 @@ Validate(VOID)
 }
 #endif
 
+/*
+ * FUNCTION: Checks that a data block lies within the cabinet file
+ * ARGUMENTS:
+ *     CFData = Pointer to data block
+ * RETURNS:
+ *     TRUE if the block can be read
+ */
+static BOOL
+IsDataBlockValid(
+    IN PCABINET_CONTEXT CabinetContext,
+    IN PCFDATA CFData)
+{
+    PUCHAR FileEnd = CabinetContext->FileBuffer + CabinetContext->FileSize;
+    PUCHAR Data = (PUCHAR)(CFData + 1) + CabinetContext->DataReserved;
+
+    return (PUCHAR)CFData > CabinetContext->FileBuffer &&
+           Data <= FileEnd &&
+           CFData->CompSize <= (ULONG_PTR)(FileEnd - Data) &&
+           CFData->UncompSize <= CAB_BLOCKSIZE;
+}
+
+/*
+ * FUNCTION: Uncompresses a whole data block
+ * ARGUMENTS:
+ *     CFData = Pointer to data block
+ *     Buffer = Pointer to buffer to place the uncompressed data
+ * RETURNS:
+ *     Status of operation
+ */
+static ULONG
+DecodeDataBlock(
+    IN PCABINET_CONTEXT CabinetContext,
+    IN PCFDATA CFData,
+    OUT PVOID Buffer)
+{
+    LONG InputLength, OutputLength;
+    ULONG Status;
+
+    InputLength = CFData->CompSize;
+    OutputLength = CFData->UncompSize;
+
+    Status = CabinetContext->Codec->Uncompress(CabinetContext->Codec,
+                                               Buffer,
+                                               (PUCHAR)(CFData + 1) + CabinetContext->DataReserved,
+                                               &InputLength,
+                                               &OutputLength);
+    if (Status != CS_SUCCESS)
+    {
+        DPRINT("Cannot uncompress block\n");
+        return (Status == CS_NOMEMORY) ? CAB_STATUS_NOMEMORY : CAB_STATUS_INVALID_CAB;
+    }
+
+    if (OutputLength != CFData->UncompSize)
+    {
+        DPRINT1("Block uncompressed to %d bytes instead of %u\n",
+                OutputLength, CFData->UncompSize);
+        return CAB_STATUS_INVALID_CAB;
+    }
+
+    return CAB_STATUS_SUCCESS;
+}
+
+/*
+ * FUNCTION: Waits for an extracted file to be written and closes it
+ * ARGUMENTS:
+ *     Write = Pointer to pending write
+ */
+static VOID
+CompletePendingWrite(
+    IN PCABINET_CONTEXT CabinetContext,
+    IN PCAB_PENDING_WRITE Write)
+{
+    if (Write->Status == STATUS_PENDING)
+    {
+        NtWaitForSingleObject(Write->Event, FALSE, NULL);
+        Write->Status = Write->IoStatusBlock.Status;
+    }
+
+    if (NT_SUCCESS(Write->Status) && Write->IoStatusBlock.Information != Write->Size)
+        Write->Status = STATUS_DISK_FULL;
+
+    if (!NT_SUCCESS(Write->Status))
+    {
+        DPRINT1("Writing %S failed (%x)\n", Write->FileName, Write->Status);
+        CabinetContext->WriteStatus = CAB_STATUS_CANNOT_WRITE;
+    }
+
+    RemoveEntryList(&Write->ListEntry);
+    CabinetContext->PendingWriteCount--;
+    CabinetContext->PendingWriteSize -= Write->Size;
+
+    NtClose(Write->Event);
+    NtClose(Write->FileHandle);
+    RtlFreeHeap(ProcessHeap, 0, Write);
+}
+
+/*
+ * FUNCTION: Waits until all extracted files are written
+ * RETURNS:
+ *     Status of the writes since the context was initialized
+ */
+ULONG
+CabinetFlushWrites(
+    IN PCABINET_CONTEXT CabinetContext)
+{
+    while (CabinetContext->PendingWriteCount > 0)
+    {
+        CompletePendingWrite(CabinetContext,
+                             CONTAINING_RECORD(CabinetContext->PendingWrites.Flink,
+                                               CAB_PENDING_WRITE,
+                                               ListEntry));
+    }
+
+    return CabinetContext->WriteStatus;
+}
+
 /*
  * FUNCTION: Extracts a file from the cabinet
  * ARGUMENTS:
  *     Search = Pointer to PCAB_SEARCH structure used to locate the file
  * RETURNS
  *     Status of operation
+ * NOTES:
+ *     Every data block is uncompressed once when the files of a folder
+ *     are extracted in order. The last block that ended in the middle of
+ *     a file is kept for the next one. Files are written in the background,
+ *     CabinetFlushWrites waits for them.
  */
 ULONG
 CabinetExtractFile(
     IN PCABINET_CONTEXT CabinetContext,
     IN PCAB_SEARCH Search)
 {
-    ULONG Size;                 // remaining file bytes to decompress
-    ULONG CurrentOffset;        // current uncompressed offset within the folder
-    PUCHAR CurrentBuffer;       // current pointer to compressed data in the block
-    LONG RemainingBlock;        // remaining comp data in the block
-    HANDLE DestFile;
-    HANDLE DestFileSection;
-    PVOID DestFileBuffer;       // mapped view of dest file
-    PVOID CurrentDestBuffer;    // pointer to the current position in the dest view
+    ULONG FileOffset;           // uncompressed offset of the file within the folder
+    ULONG FileEnd;              // uncompressed offset of the end of the file
+    ULONG CurrentOffset;        // uncompressed offset of the current block
+    ULONG BlockEnd;             // uncompressed offset of the end of the current block
+    ULONG Start, End;
+    PUCHAR DestBuffer;          // uncompressed data of the file
+    PCAB_PENDING_WRITE Write = NULL;
+    HANDLE DestFile = NULL;
     PCFDATA CFData;             // current data block
     ULONG Status;
     FILETIME FileTime;
@@ -980,9 +1162,8 @@ CabinetExtractFile(
     FILE_BASIC_INFORMATION FileBasic;
     PCFFOLDER CurrentFolder;
     LARGE_INTEGER MaxDestFileSize;
-    LONG InputLength, OutputLength;
+    LARGE_INTEGER ByteOffset;
     SIZE_T StringLength;
-    char Chunk[512];
 
     if (wcscmp(Search->Cabinet, CabinetContext->CabinetName) != 0)
     {
@@ -992,6 +1173,10 @@ CabinetExtractFile(
         return CAB_STATUS_NOFILE;
     }
 
+    /* A file extracted before could not be written */
+    if (CabinetContext->WriteStatus != CAB_STATUS_SUCCESS)
+        return CabinetContext->WriteStatus;
+
     /* look up the folder that the file specifies */
     if (Search->File->FolderIndex == 0xFFFD ||
         Search->File->FolderIndex == 0xFFFF)
@@ -1029,8 +1214,8 @@ CabinetExtractFile(
     if (CabinetContext->CreateFileHandler)
     {
         /* Call create context */
-        CurrentDestBuffer = CabinetContext->CreateFileHandler(CabinetContext, Search->File->FileSize);
-        if (!CurrentDestBuffer)
+        DestBuffer = CabinetContext->CreateFileHandler(CabinetContext, Search->File->FileSize);
+        if (!DestBuffer)
         {
             DPRINT1("CreateFileHandler() failed\n");
             return CAB_STATUS_CANNOT_CREATE;
@@ -1054,15 +1239,17 @@ CabinetExtractFile(
                                    OBJ_CASE_INSENSITIVE,
                                    NULL, NULL);
 
+        /* The file is written asynchronously, let the file system allocate it at once */
+        MaxDestFileSize.QuadPart = Search->File->FileSize;
         NtStatus = NtCreateFile(&DestFile,
-                                GENERIC_READ | GENERIC_WRITE | SYNCHRONIZE,
+                                GENERIC_READ | GENERIC_WRITE,
                                 &ObjectAttributes,
                                 &IoStatusBlock,
-                                NULL,
+                                &MaxDestFileSize,
                                 FILE_ATTRIBUTE_NORMAL,
                                 0,
                                 FILE_CREATE,
-                                FILE_SYNCHRONOUS_IO_NONALERT,
+                                FILE_NON_DIRECTORY_FILE,
                                 NULL, 0);
 
         if (!NT_SUCCESS(NtStatus))
@@ -1075,14 +1262,14 @@ CabinetExtractFile(
             {
                 /* Create destination file, overwrite if it already exists */
                 NtStatus = NtCreateFile(&DestFile,
-                                        GENERIC_READ | GENERIC_WRITE | SYNCHRONIZE,
+                                        GENERIC_READ | GENERIC_WRITE,
                                         &ObjectAttributes,
                                         &IoStatusBlock,
-                                        NULL,
+                                        &MaxDestFileSize,
                                         FILE_ATTRIBUTE_NORMAL,
                                         0,
                                         FILE_OVERWRITE,
-                                        FILE_SYNCHRONOUS_IO_ALERT,
+                                        FILE_NON_DIRECTORY_FILE,
                                         NULL, 0);
 
                 if (!NT_SUCCESS(NtStatus))
@@ -1098,48 +1285,13 @@ CabinetExtractFile(
             }
         }
 
-        MaxDestFileSize.QuadPart = Search->File->FileSize;
-        NtStatus = NtCreateSection(&DestFileSection,
-                                   SECTION_ALL_ACCESS,
-                                   0,
-                                   &MaxDestFileSize,
-                                   PAGE_READWRITE,
-                                   SEC_COMMIT,
-                                   DestFile);
-
-        if (!NT_SUCCESS(NtStatus))
-        {
-            DPRINT1("NtCreateSection failed for %ls: %x\n", DestName, NtStatus);
-            Status = CAB_STATUS_NOMEMORY;
-            goto CloseDestFile;
-        }
-
-        DestFileBuffer = 0;
-        CabinetContext->DestFileSize = 0;
-        NtStatus = NtMapViewOfSection(DestFileSection,
-                                      NtCurrentProcess(),
-                                      &DestFileBuffer,
-                                      0, 0, 0,
-                                      &CabinetContext->DestFileSize,
-                                      ViewUnmap,
-                                      0,
-                                      PAGE_READWRITE);
-
-        if (!NT_SUCCESS(NtStatus))
-        {
-            DPRINT1("NtMapViewOfSection failed: %x\n", NtStatus);
-            Status = CAB_STATUS_NOMEMORY;
-            goto CloseDestFileSection;
-        }
-
-        CurrentDestBuffer = DestFileBuffer;
         if (!ConvertDosDateTimeToFileTime(Search->File->FileDate,
                                           Search->File->FileTime,
                                           &FileTime))
         {
             DPRINT1("DosDateTimeToFileTime() failed\n");
             Status = CAB_STATUS_CANNOT_WRITE;
-            goto UnmapDestFile;
+            goto CloseDestFile;
         }
 
         NtStatus = NtQueryInformationFile(DestFile,
@@ -1167,120 +1319,196 @@ CabinetExtractFile(
         }
 
         SetAttributesOnFile(Search->File, DestFile);
+
+        /* Make room for this file among the ones being written */
+        while (CabinetContext->PendingWriteCount > 0 &&
+               (CabinetContext->PendingWriteCount >= CAB_MAX_PENDING_WRITES ||
+                CabinetContext->PendingWriteSize + Search->File->FileSize > CAB_MAX_PENDING_SIZE))
+        {
+            CompletePendingWrite(CabinetContext,
+                                 CONTAINING_RECORD(CabinetContext->PendingWrites.Flink,
+                                                   CAB_PENDING_WRITE,
+                                                   ListEntry));
+        }
+
+        if (CabinetContext->WriteStatus != CAB_STATUS_SUCCESS)
+        {
+            Status = CabinetContext->WriteStatus;
+            goto CloseDestFile;
+        }
+
+        Write = RtlAllocateHeap(ProcessHeap,
+                                0,
+                                FIELD_OFFSET(CAB_PENDING_WRITE, Data[Search->File->FileSize]));
+        if (!Write)
+        {
+            DPRINT1("Cannot allocate %u bytes for %S\n", Search->File->FileSize, DestName);
+            Status = CAB_STATUS_NOMEMORY;
+            goto CloseDestFile;
+        }
+
+        Write->FileHandle = DestFile;
+        Write->Size = Search->File->FileSize;
+        RtlStringCchCopyW(Write->FileName, ARRAYSIZE(Write->FileName), DestName);
+        DestBuffer = Write->Data;
     }
 
     /* Call extract event handler */
     if (CabinetContext->ExtractHandler != NULL)
         CabinetContext->ExtractHandler(CabinetContext, Search->File, DestName);
 
-    if (Search->CFData)
-        CFData = Search->CFData;
-    else
-        CFData = (PCFDATA)(CabinetContext->CabinetFolders[Search->File->FolderIndex].DataOffset + CabinetContext->FileBuffer);
+    FileOffset = Search->File->FileOffset;
+    FileEnd = FileOffset + Search->File->FileSize;
 
-    CurrentOffset = Search->Offset;
-    while (CurrentOffset + CFData->UncompSize <= Search->File->FileOffset)
+    if (FileEnd > FileOffset)
     {
+        /* Continue from the last block used if the file does not start before it */
+        if (Search->CFData && Search->Offset <= FileOffset)
+        {
+            CFData = Search->CFData;
+            CurrentOffset = Search->Offset;
+        }
+        else
+        {
+            CFData = (PCFDATA)(CabinetContext->FileBuffer + CurrentFolder->DataOffset);
+            CurrentOffset = 0;
+        }
+
         /* walk the data blocks until we reach
            the one containing the start of the file */
-        CurrentOffset += CFData->UncompSize;
-        CFData = (PCFDATA)((char *)(CFData + 1) + CabinetContext->DataReserved + CFData->CompSize);
-    }
+        while (TRUE)
+        {
+            if (!IsDataBlockValid(CabinetContext, CFData))
+            {
+                DPRINT1("Data block at 0x%p is outside of the cabinet\n", CFData);
+                Status = CAB_STATUS_INVALID_CAB;
+                goto FreeWrite;
+            }
 
-    Search->CFData = CFData;
-    Search->Offset = CurrentOffset;
+            if (CurrentOffset + CFData->UncompSize > FileOffset)
+                break;
 
-    /* now decompress and discard any data in
-       the block before the start of the file */
+            CurrentOffset += CFData->UncompSize;
+            CFData = (PCFDATA)((PUCHAR)(CFData + 1) + CabinetContext->DataReserved + CFData->CompSize);
+        }
 
-    /* start of comp data */
-    CurrentBuffer = ((unsigned char *)(CFData + 1)) + CabinetContext->DataReserved;
-    RemainingBlock = CFData->CompSize;
-    InputLength = RemainingBlock;
+        /* now uncompress the blocks of the file */
+        while (TRUE)
+        {
+            BlockEnd = CurrentOffset + CFData->UncompSize;
 
-    while (CurrentOffset < Search->File->FileOffset)
-    {
-        /* compute remaining uncomp bytes to start
-           of file, bounded by size of chunk */
-        OutputLength = Search->File->FileOffset - CurrentOffset;
-        if (OutputLength > (LONG)sizeof(Chunk))
-            OutputLength = sizeof(Chunk);
-
-        /* negate to signal NOT end of block */
-        OutputLength = -OutputLength;
-
-        CabinetContext->Codec->Uncompress(CabinetContext->Codec,
-                                          Chunk,
-                                          CurrentBuffer,
-                                          &InputLength,
-                                          &OutputLength);
-
-        /* add the uncomp bytes extracted to current folder offset */
-        CurrentOffset += OutputLength;
-        /* add comp bytes consumed to CurrentBuffer */
-        CurrentBuffer += InputLength;
-        /* subtract bytes consumed from bytes remaining in block */
-        RemainingBlock -= InputLength;
-        /* neg for resume decompression of the same block */
-        InputLength = -RemainingBlock;
-    }
+            if (CFData != CabinetContext->DecodedData &&
+                CurrentOffset >= FileOffset && BlockEnd <= FileEnd)
+            {
+                /* the whole block belongs to the file */
+                Status = DecodeDataBlock(CabinetContext, CFData, DestBuffer + (CurrentOffset - FileOffset));
+                if (Status != CAB_STATUS_SUCCESS)
+                    goto FreeWrite;
+            }
+            else
+            {
+                /* the block is shared with other files, keep it for them */
+                if (CFData != CabinetContext->DecodedData)
+                {
+                    if (!CabinetContext->BlockBuffer)
+                    {
+                        CabinetContext->BlockBuffer = RtlAllocateHeap(ProcessHeap, 0, CAB_BLOCKSIZE);
+                        if (!CabinetContext->BlockBuffer)
+                        {
+                            Status = CAB_STATUS_NOMEMORY;
+                            goto FreeWrite;
+                        }
+                    }
+
+                    CabinetContext->DecodedData = NULL;
+                    Status = DecodeDataBlock(CabinetContext, CFData, CabinetContext->BlockBuffer);
+                    if (Status != CAB_STATUS_SUCCESS)
+                        goto FreeWrite;
+                    CabinetContext->DecodedData = CFData;
+                }
 
-    /* now CurrentBuffer points to the first comp byte
-       of the file, so we can begin decompressing */
+                Start = max(CurrentOffset, FileOffset);
+                End = min(BlockEnd, FileEnd);
+                memcpy(DestBuffer + (Start - FileOffset),
+                       CabinetContext->BlockBuffer + (Start - CurrentOffset),
+                       End - Start);
+            }
 
-    /* Size = remaining uncomp bytes of the file to decompress */
-    Size = Search->File->FileSize;
-    while (Size > 0)
-    {
-        OutputLength = Size;
-        DPRINT("Decompressing block at %x with RemainingBlock = %d, Size = %d\n",
-               CurrentBuffer, RemainingBlock, Size);
-
-        Status = CabinetContext->Codec->Uncompress(CabinetContext->Codec,
-                                                   CurrentDestBuffer,
-                                                   CurrentBuffer,
-                                                   &InputLength,
-                                                   &OutputLength);
-        if (Status != CS_SUCCESS)
-        {
-            DPRINT("Cannot uncompress block\n");
-            if (Status == CS_NOMEMORY)
-                Status = CAB_STATUS_NOMEMORY;
-            Status = CAB_STATUS_INVALID_CAB;
-            goto UnmapDestFile;
-        }
+            if (BlockEnd >= FileEnd)
+                break;
 
-        /* advance dest buffer by bytes produced */
-        CurrentDestBuffer = (PVOID)((ULONG_PTR)CurrentDestBuffer + OutputLength);
-        /* advance src buffer by bytes consumed */
-        CurrentBuffer += InputLength;
-        /* reduce remaining file bytes by bytes produced */
-        Size -= OutputLength;
-        /* reduce remaining block size by bytes consumed */
-        RemainingBlock -= InputLength;
-        if (Size > 0 && RemainingBlock == 0)
-        {
             /* used up this block, move on to the next */
-            DPRINT("Out of block data\n");
-            CFData = (PCFDATA)CurrentBuffer;
-            RemainingBlock = CFData->CompSize;
-            CurrentBuffer = (unsigned char *)(CFData + 1) + CabinetContext->DataReserved;
-            InputLength = RemainingBlock;
+            CurrentOffset = BlockEnd;
+            CFData = (PCFDATA)((PUCHAR)(CFData + 1) + CabinetContext->DataReserved + CFData->CompSize);
+            if (!IsDataBlockValid(CabinetContext, CFData))
+            {
+                DPRINT1("Data block at 0x%p is outside of the cabinet\n", CFData);
+                Status = CAB_STATUS_INVALID_CAB;
+                goto FreeWrite;
+            }
         }
+
+        /* the next file starts in this block or after it */
+        Search->CFData = CFData;
+        Search->Offset = CurrentOffset;
     }
 
     Status = CAB_STATUS_SUCCESS;
 
-UnmapDestFile:
-    if (!CabinetContext->CreateFileHandler)
-        NtUnmapViewOfSection(NtCurrentProcess(), DestFileBuffer);
+    if (!Write)
+        return Status;
+
+    if (Write->Size == 0)
+    {
+        /* nothing to write */
+        RtlFreeHeap(ProcessHeap, 0, Write);
+        NtClose(DestFile);
+        return Status;
+    }
+
+    /* Write the file while the next ones are uncompressed */
+    NtStatus = NtCreateEvent(&Write->Event,
+                             EVENT_ALL_ACCESS,
+                             NULL,
+                             NotificationEvent,
+                             FALSE);
+    if (!NT_SUCCESS(NtStatus))
+    {
+        DPRINT1("NtCreateEvent() failed (%x)\n", NtStatus);
+        Status = CAB_STATUS_NOMEMORY;
+        goto FreeWrite;
+    }
+
+    ByteOffset.QuadPart = 0;
+    Write->Status = NtWriteFile(DestFile,
+                                Write->Event,
+                                NULL,
+                                NULL,
+                                &Write->IoStatusBlock,
+                                Write->Data,
+                                Write->Size,
+                                &ByteOffset,
+                                NULL);
+
+    InsertTailList(&CabinetContext->PendingWrites, &Write->ListEntry);
+    CabinetContext->PendingWriteCount++;
+    CabinetContext->PendingWriteSize += Write->Size;
+
+    /* A write that failed at once is reported now */
+    if (Write->Status != STATUS_PENDING && !NT_SUCCESS(Write->Status))
+    {
+        CompletePendingWrite(CabinetContext, Write);
+        return CabinetContext->WriteStatus;
+    }
+
+    return Status;
 
-CloseDestFileSection:
-    if (!CabinetContext->CreateFileHandler)
-        NtClose(DestFileSection);
+FreeWrite:
+    if (Write)
+        RtlFreeHeap(ProcessHeap, 0, Write);
 
 CloseDestFile:
-    if (!CabinetContext->CreateFileHandler)
+    if (DestFile)
         NtClose(DestFile);
 
     return Status;
@@ -106,6 +106,12 @@ typedef struct _CABINET_CONTEXT
     ULONG CodecId;
     BOOL CodecSelected;
     ULONG LastFileOffset;           // Uncompressed offset of last extracted file
+    PUCHAR BlockBuffer;             // Uncompressed data of DecodedData
+    PCFDATA DecodedData;            // Data block held in BlockBuffer
+    LIST_ENTRY PendingWrites;       // Extracted files still being written
+    ULONG PendingWriteCount;
+    SIZE_T PendingWriteSize;
+    ULONG WriteStatus;              // Status of the failed write, if any
     PCABINET_OVERWRITE OverwriteHandler;
     PCABINET_EXTRACT ExtractHandler;
     PCABINET_DISK_CHANGE DiskChangeHandler;
@@ -196,6 +202,20 @@ CabinetExtractFile(
     IN PCABINET_CONTEXT CabinetContext,
     IN PCAB_SEARCH Search);
 
+/* Waits until all extracted files are written */
+ULONG
+CabinetFlushWrites(
+    IN PCABINET_CONTEXT CabinetContext);
+
+/* Returns the name and location of the file found by a search */
+VOID
+CabinetGetFileInformation(
+    IN PCAB_SEARCH Search,
+    OUT PWSTR FileName,
+    IN ULONG FileNameLength,
+    OUT PULONG FolderIndex,
+    OUT PULONG FileOffset);
+
 /* Select codec engine to use */
 VOID
 CabinetSelectCodec(
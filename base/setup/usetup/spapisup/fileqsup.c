@@ -43,6 +43,9 @@ typedef struct _QUEUEENTRY
     PWSTR SourceFileName;
     PWSTR TargetDirectory;
     PWSTR TargetFileName;
+    ULONG Sequence;         /* Position in the queue */
+    ULONG FolderIndex;      /* Location in the cabinet, MAXULONG if unknown */
+    ULONG FileOffset;
 } QUEUEENTRY, *PQUEUEENTRY;
 
 typedef struct _FILEQUEUEHEADER
@@ -65,6 +68,59 @@ typedef struct _FILEQUEUEHEADER
 
 /* SETUP* API COMPATIBILITY FUNCTIONS ****************************************/
 
+static NTSTATUS
+SetupOpenCabinet(
+    IN OUT PFILEQUEUEHEADER QueueHeader,
+    IN PCWSTR CabinetFileName)
+{
+    ULONG CabStatus;
+
+    DPRINT("Using new cabinet\n");
+
+    if (QueueHeader->HasCurrentCabinet)
+    {
+        /* Do not lose the status of the files extracted from the previous one */
+        CabStatus = CabinetFlushWrites(&QueueHeader->CabinetContext);
+
+        QueueHeader->HasCurrentCabinet = FALSE;
+        CabinetCleanup(&QueueHeader->CabinetContext);
+
+        if (CabStatus != CAB_STATUS_SUCCESS)
+        {
+            DPRINT1("Cannot write files extracted from '%S' (%d)\n",
+                    QueueHeader->CurrentCabinetName, CabStatus);
+            return STATUS_UNSUCCESSFUL;
+        }
+    }
+
+    RtlStringCchCopyW(QueueHeader->CurrentCabinetName,
+                      ARRAYSIZE(QueueHeader->CurrentCabinetName),
+                      CabinetFileName);
+
+    CabinetInitialize(&QueueHeader->CabinetContext);
+    CabinetSetEventHandlers(&QueueHeader->CabinetContext,
+                            NULL, NULL, NULL, NULL);
+    CabinetSetCabinetName(&QueueHeader->CabinetContext, CabinetFileName);
+
+    CabStatus = CabinetOpen(&QueueHeader->CabinetContext);
+    if (CabStatus != CAB_STATUS_SUCCESS)
+    {
+        DPRINT("Cannot open cabinet (%d)\n", CabStatus);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    DPRINT("Opened cabinet %S\n", CabinetFileName /*CabinetGetCabinetName(&QueueHeader->CabinetContext)*/);
+    QueueHeader->HasCurrentCabinet = TRUE;
+
+    /* The sequential search starts at the first file */
+    RtlZeroMemory(&QueueHeader->Search, sizeof(QueueHeader->Search));
+    RtlStringCchCopyW(QueueHeader->Search.Cabinet,
+                      ARRAYSIZE(QueueHeader->Search.Cabinet),
+                      CabinetGetCabinetName(&QueueHeader->CabinetContext));
+
+    return STATUS_SUCCESS;
+}
+
 static NTSTATUS
 SetupExtractFile(
     IN OUT PFILEQUEUEHEADER QueueHeader,
@@ -73,6 +129,7 @@ SetupExtractFile(
     IN PCWSTR DestinationPathName)
 {
     ULONG CabStatus;
+    NTSTATUS Status;
 
     DPRINT("SetupExtractFile(CabinetFileName: '%S', SourceFileName: '%S', DestinationPathName: '%S')\n",
            CabinetFileName, SourceFileName, DestinationPathName);
@@ -82,57 +139,23 @@ SetupExtractFile(
         DPRINT("CurrentCabinetName: '%S'\n", QueueHeader->CurrentCabinetName);
     }
 
-    if (QueueHeader->HasCurrentCabinet &&
-        (wcscmp(CabinetFileName, QueueHeader->CurrentCabinetName) == 0))
+    if (!QueueHeader->HasCurrentCabinet ||
+        (wcscmp(CabinetFileName, QueueHeader->CurrentCabinetName) != 0))
     {
-        DPRINT("Using same cabinet as last time\n");
-
-        /* Use our last location because the files should be sequential */
-        CabStatus = CabinetFindNextFileSequential(&QueueHeader->CabinetContext,
-                                                  SourceFileName,
-                                                  &QueueHeader->Search);
-        if (CabStatus != CAB_STATUS_SUCCESS)
-        {
-            DPRINT("Sequential miss on file: %S\n", SourceFileName);
-
-            /* Looks like we got unlucky */
-            CabStatus = CabinetFindFirst(&QueueHeader->CabinetContext,
-                                         SourceFileName,
-                                         &QueueHeader->Search);
-        }
+        Status = SetupOpenCabinet(QueueHeader, CabinetFileName);
+        if (!NT_SUCCESS(Status))
+            return Status;
     }
-    else
-    {
-        DPRINT("Using new cabinet\n");
-
-        if (QueueHeader->HasCurrentCabinet)
-        {
-            QueueHeader->HasCurrentCabinet = FALSE;
-            CabinetCleanup(&QueueHeader->CabinetContext);
-        }
-
-        RtlStringCchCopyW(QueueHeader->CurrentCabinetName,
-                          ARRAYSIZE(QueueHeader->CurrentCabinetName),
-                          CabinetFileName);
-
-        CabinetInitialize(&QueueHeader->CabinetContext);
-        CabinetSetEventHandlers(&QueueHeader->CabinetContext,
-                                NULL, NULL, NULL, NULL);
-        CabinetSetCabinetName(&QueueHeader->CabinetContext, CabinetFileName);
 
-        CabStatus = CabinetOpen(&QueueHeader->CabinetContext);
-        if (CabStatus == CAB_STATUS_SUCCESS)
-        {
-            DPRINT("Opened cabinet %S\n", CabinetFileName /*CabinetGetCabinetName(&QueueHeader->CabinetContext)*/);
-            QueueHeader->HasCurrentCabinet = TRUE;
-        }
-        else
-        {
-            DPRINT("Cannot open cabinet (%d)\n", CabStatus);
-            return STATUS_UNSUCCESSFUL;
-        }
+    /* Use our last location because the files should be sequential */
+    CabStatus = CabinetFindNextFileSequential(&QueueHeader->CabinetContext,
+                                              SourceFileName,
+                                              &QueueHeader->Search);
+    if (CabStatus != CAB_STATUS_SUCCESS)
+    {
+        DPRINT("Sequential miss on file: %S\n", SourceFileName);
 
-        /* We have to start at the beginning here */
+        /* Looks like we got unlucky */
         CabStatus = CabinetFindFirst(&QueueHeader->CabinetContext,
                                      SourceFileName,
                                      &QueueHeader->Search);
@@ -156,6 +179,187 @@ SetupExtractFile(
     return STATUS_SUCCESS;
 }
 
+static int
+CompareStrings(
+    IN PCWSTR String1 OPTIONAL,
+    IN PCWSTR String2 OPTIONAL)
+{
+    if (String1 == NULL || String2 == NULL)
+        return (String1 != NULL) - (String2 != NULL);
+
+    return wcscmp(String1, String2);
+}
+
+static int
+CompareQueueEntrySources(
+    IN PQUEUEENTRY Entry1,
+    IN PQUEUEENTRY Entry2)
+{
+    int Result;
+
+    Result = CompareStrings(Entry1->SourceCabinet, Entry2->SourceCabinet);
+    if (Result == 0)
+        Result = CompareStrings(Entry1->SourceRootPath, Entry2->SourceRootPath);
+    if (Result == 0)
+        Result = CompareStrings(Entry1->SourcePath, Entry2->SourcePath);
+
+    return Result;
+}
+
+/* Orders the queue entries by cabinet and file name */
+static int __cdecl
+CompareQueueEntryNames(
+    IN const void *Element1,
+    IN const void *Element2)
+{
+    PQUEUEENTRY Entry1 = *(PQUEUEENTRY*)Element1;
+    PQUEUEENTRY Entry2 = *(PQUEUEENTRY*)Element2;
+    int Result;
+
+    Result = CompareQueueEntrySources(Entry1, Entry2);
+    if (Result == 0)
+        Result = wcscmp(Entry1->SourceFileName, Entry2->SourceFileName);
+    if (Result == 0)
+        Result = (Entry1->Sequence > Entry2->Sequence) - (Entry1->Sequence < Entry2->Sequence);
+
+    return Result;
+}
+
+/* Orders the queue entries as their files are stored in the cabinets */
+static int __cdecl
+CompareQueueEntryLocations(
+    IN const void *Element1,
+    IN const void *Element2)
+{
+    PQUEUEENTRY Entry1 = *(PQUEUEENTRY*)Element1;
+    PQUEUEENTRY Entry2 = *(PQUEUEENTRY*)Element2;
+    int Result;
+
+    /* Files that are not in a cabinet keep their order and go first */
+    Result = (Entry1->SourceCabinet != NULL) - (Entry2->SourceCabinet != NULL);
+    if (Result == 0 && Entry1->SourceCabinet != NULL)
+    {
+        Result = CompareQueueEntrySources(Entry1, Entry2);
+        if (Result == 0)
+            Result = (Entry1->FolderIndex > Entry2->FolderIndex) - (Entry1->FolderIndex < Entry2->FolderIndex);
+        if (Result == 0)
+            Result = (Entry1->FileOffset > Entry2->FileOffset) - (Entry1->FileOffset < Entry2->FileOffset);
+    }
+    if (Result == 0)
+        Result = (Entry1->Sequence > Entry2->Sequence) - (Entry1->Sequence < Entry2->Sequence);
+
+    return Result;
+}
+
+/*
+ * Sorts the copy queue by cabinet, folder and offset of the files, so
+ * that every cabinet folder is uncompressed in a single pass.
+ */
+static VOID
+SetupSortCopyQueue(
+    IN OUT PFILEQUEUEHEADER QueueHeader)
+{
+    PQUEUEENTRY *Entries;
+    PQUEUEENTRY Entry;
+    PLIST_ENTRY ListEntry;
+    CAB_SEARCH Search;
+    ULONG CabStatus;
+    ULONG Count, First, Last, Low, High, Middle, i;
+    ULONG FolderIndex, FileOffset;
+    WCHAR CabinetPath[MAX_PATH];
+    WCHAR FileName[MAX_PATH];
+
+    Count = QueueHeader->CopyCount;
+    if (Count < 2)
+        return;
+
+    Entries = RtlAllocateHeap(ProcessHeap, 0, Count * sizeof(PQUEUEENTRY));
+    if (Entries == NULL)
+    {
+        /* Just keep the queue order */
+        return;
+    }
+
+    i = 0;
+    for (ListEntry = QueueHeader->CopyQueue.Flink;
+         ListEntry != &QueueHeader->CopyQueue;
+         ListEntry = ListEntry->Flink)
+    {
+        Entry = CONTAINING_RECORD(ListEntry, QUEUEENTRY, ListEntry);
+        Entry->FolderIndex = MAXULONG;
+        Entry->FileOffset = MAXULONG;
+        Entries[i++] = Entry;
+    }
+    ASSERT(i == Count);
+
+    qsort(Entries, Count, sizeof(PQUEUEENTRY), CompareQueueEntryNames);
+
+    /* Look up the files of each cabinet in a single walk of its file table */
+    for (First = 0; First < Count; First = Last)
+    {
+        for (Last = First + 1; Last < Count; Last++)
+        {
+            if (CompareQueueEntrySources(Entries[First], Entries[Last]) != 0)
+                break;
+        }
+
+        Entry = Entries[First];
+        if (Entry->SourceCabinet == NULL)
+            continue;
+
+        CombinePaths(CabinetPath, ARRAYSIZE(CabinetPath), 3,
+                     Entry->SourceRootPath, Entry->SourcePath,
+                     Entry->SourceCabinet);
+
+        if ((!QueueHeader->HasCurrentCabinet ||
+             wcscmp(CabinetPath, QueueHeader->CurrentCabinetName) != 0) &&
+            !NT_SUCCESS(SetupOpenCabinet(QueueHeader, CabinetPath)))
+        {
+            /* Extracting the files will report the error */
+            continue;
+        }
+
+        CabStatus = CabinetFindFirst(&QueueHeader->CabinetContext, L"*", &Search);
+        while (CabStatus == CAB_STATUS_SUCCESS)
+        {
+            CabinetGetFileInformation(&Search, FileName, ARRAYSIZE(FileName),
+                                      &FolderIndex, &FileOffset);
+
+            /* Find the first entry for this file */
+            Low = First;
+            High = Last;
+            while (Low < High)
+            {
+                Middle = Low + (High - Low) / 2;
+                if (wcscmp(Entries[Middle]->SourceFileName, FileName) < 0)
+                    Low = Middle + 1;
+                else
+                    High = Middle;
+            }
+
+            /* The first file with this name is the one that gets extracted */
+            for (; Low < Last && wcscmp(Entries[Low]->SourceFileName, FileName) == 0; Low++)
+            {
+                if (Entries[Low]->FolderIndex == MAXULONG)
+                {
+                    Entries[Low]->FolderIndex = FolderIndex;
+                    Entries[Low]->FileOffset = FileOffset;
+                }
+            }
+
+            CabStatus = CabinetFindNext(&QueueHeader->CabinetContext, &Search);
+        }
+    }
+
+    qsort(Entries, Count, sizeof(PQUEUEENTRY), CompareQueueEntryLocations);
+
+    InitializeListHead(&QueueHeader->CopyQueue);
+    for (i = 0; i < Count; i++)
+        InsertTailList(&QueueHeader->CopyQueue, &Entries[i]->ListEntry);
+
+    RtlFreeHeap(ProcessHeap, 0, Entries);
+}
+
 HSPFILEQ
 WINAPI
 SetupOpenFileQueue(VOID)
@@ -226,6 +430,13 @@ SetupCloseFileQueue(
 
     QueueHeader = (PFILEQUEUEHEADER)QueueHandle;
 
+    /* Close the cabinet, once its last files are written */
+    if (QueueHeader->HasCurrentCabinet)
+    {
+        QueueHeader->HasCurrentCabinet = FALSE;
+        CabinetCleanup(&QueueHeader->CabinetContext);
+    }
+
     /* Delete the delete queue */
     while (!IsListEmpty(&QueueHeader->DeleteQueue))
     {
@@ -422,6 +633,7 @@ SetupQueueCopyWithCab(
     }
 
     /* Append queue entry */
+    Entry->Sequence = QueueHeader->CopyCount;
     InsertTailList(&QueueHeader->CopyQueue, &Entry->ListEntry);
     ++QueueHeader->CopyCount;
 
@@ -629,6 +841,7 @@ SetupCommitFileQueueW(
     FILEPATHS_W FilePathInfo;
     WCHAR FileSrcPath[MAX_PATH];
     WCHAR FileDstPath[MAX_PATH];
+    LARGE_INTEGER Frequency, CopyStart, CopyEnd;
 
     if (QueueHandle == NULL)
         return FALSE;
@@ -836,6 +1049,11 @@ EndRename:
      * Commit the copy queue
      */
 
+    NtQueryPerformanceCounter(&CopyStart, &Frequency);
+
+    /* Extract the files in the order they are stored in the cabinets */
+    SetupSortCopyQueue(QueueHeader);
+
     if (!IsListEmpty(&QueueHeader->CopyQueue))
     {
         Result = MsgHandler(Context,
@@ -973,6 +1191,20 @@ EndCopy:
             goto Quit;
     }
 
+    /* Wait for the files extracted from the cabinet to be written */
+    if (QueueHeader->HasCurrentCabinet &&
+        CabinetFlushWrites(&QueueHeader->CabinetContext) != CAB_STATUS_SUCCESS)
+    {
+        DPRINT1("Cannot write files extracted from '%S'\n", QueueHeader->CurrentCabinetName);
+        Success = FALSE;
+        goto Quit;
+    }
+
+    NtQueryPerformanceCounter(&CopyEnd, NULL);
+    DPRINT("Copied %lu files in %I64u ms\n",
+            QueueHeader->CopyCount,
+            (CopyEnd.QuadPart - CopyStart.QuadPart) * 1000 / Frequency.QuadPart);
+
     if (!IsListEmpty(&QueueHeader->CopyQueue))
     {
         MsgHandler(Context,
@@ -19,6 +19,10 @@ RtlpInitializeKeyedEvent(VOID);
 VOID
 RtlpCloseKeyedEvent(VOID);
 
+VOID
+NTAPI
+RtlpTpInitialize(VOID);
+
 BOOL
 WINAPI
 DllMain(HANDLE hDll,
@@ -29,6 +33,7 @@ DllMain(HANDLE hDll,
     {
         LdrDisableThreadCalloutsForDll(hDll);
         RtlpInitializeKeyedEvent();
+        RtlpTpInitialize();
     }
     else if (dwReason == DLL_PROCESS_DETACH)
     {
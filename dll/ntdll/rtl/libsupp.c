@@ -125,7 +125,8 @@ NTSTATUS
 NTAPI
 RtlInitializeHeapLock(IN OUT PHEAP_LOCK *Lock)
 {
-    return RtlInitializeCriticalSection(&(*Lock)->CriticalSection);
+    /* Heap locks are held briefly, so spin a bit before waiting on them */
+    return RtlInitializeCriticalSectionAndSpinCount(&(*Lock)->CriticalSection, 4000);
 }
 
 NTSTATUS
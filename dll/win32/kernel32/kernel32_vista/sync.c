@@ -146,6 +146,36 @@ WakeConditionVariable(PCONDITION_VARIABLE ConditionVariable)
     RtlWakeConditionVariable((PRTL_CONDITION_VARIABLE)ConditionVariable);
 }
 
+BOOL
+WINAPI
+WaitOnAddress(volatile VOID *Address, PVOID CompareAddress, SIZE_T AddressSize, DWORD Timeout)
+{
+    NTSTATUS Status;
+    LARGE_INTEGER Time;
+
+    Status = RtlWaitOnAddress(Address, CompareAddress, AddressSize, GetNtTimeout(&Time, Timeout));
+    if (!NT_SUCCESS(Status) || Status == STATUS_TIMEOUT)
+    {
+        SetLastError(RtlNtStatusToDosError(Status));
+        return FALSE;
+    }
+    return TRUE;
+}
+
+VOID
+WINAPI
+WakeByAddressAll(PVOID Address)
+{
+    RtlWakeAddressAll(Address);
+}
+
+VOID
+WINAPI
+WakeByAddressSingle(PVOID Address)
+{
+    RtlWakeAddressSingle(Address);
+}
+
 
 /*
 * @implemented
@@ -0,0 +1,454 @@
+#include "k32_vista.h"
+
+#define NDEBUG
+#include <debug.h>
+
+/* The Win32 I/O callback sits in the first field of the ntdll I/O object */
+#define TP_IO_WIN32_CALLBACK(Io) (*(PTP_WIN32_IO_CALLBACK *)(Io))
+
+static
+PLARGE_INTEGER
+GetThreadpoolDueTime(PLARGE_INTEGER Time, PFILETIME FileTime)
+{
+    if (!FileTime) return NULL;
+    Time->u.LowPart = FileTime->dwLowDateTime;
+    Time->u.HighPart = FileTime->dwHighDateTime;
+    return Time;
+}
+
+static
+VOID
+NTAPI
+ThreadpoolIoCallback(PTP_CALLBACK_INSTANCE Instance,
+                     PVOID Context,
+                     PVOID ApcContext,
+                     PIO_STATUS_BLOCK IoStatusBlock,
+                     PTP_IO Io)
+{
+    TP_IO_WIN32_CALLBACK(Io)(Instance,
+                             Context,
+                             ApcContext,
+                             RtlNtStatusToDosError(IoStatusBlock->Status),
+                             IoStatusBlock->Information,
+                             Io);
+}
+
+/*
+ * @implemented
+ */
+PTP_POOL
+WINAPI
+CreateThreadpool(PVOID Reserved)
+{
+    PTP_POOL Pool;
+    NTSTATUS Status;
+
+    Status = TpAllocPool(&Pool, Reserved);
+    if (!NT_SUCCESS(Status))
+    {
+        SetLastError(RtlNtStatusToDosError(Status));
+        return NULL;
+    }
+    return Pool;
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+SetThreadpoolThreadMaximum(PTP_POOL Pool, DWORD Maximum)
+{
+    TpSetPoolMaxThreads(Pool, Maximum);
+}
+
+/*
+ * @implemented
+ */
+BOOL
+WINAPI
+SetThreadpoolThreadMinimum(PTP_POOL Pool, DWORD Minimum)
+{
+    NTSTATUS Status;
+
+    Status = TpSetPoolMinThreads(Pool, Minimum);
+    if (!NT_SUCCESS(Status))
+    {
+        SetLastError(RtlNtStatusToDosError(Status));
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+CloseThreadpool(PTP_POOL Pool)
+{
+    TpReleasePool(Pool);
+}
+
+/*
+ * @implemented
+ */
+PTP_CLEANUP_GROUP
+WINAPI
+CreateThreadpoolCleanupGroup(VOID)
+{
+    PTP_CLEANUP_GROUP CleanupGroup;
+    NTSTATUS Status;
+
+    Status = TpAllocCleanupGroup(&CleanupGroup);
+    if (!NT_SUCCESS(Status))
+    {
+        SetLastError(RtlNtStatusToDosError(Status));
+        return NULL;
+    }
+    return CleanupGroup;
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+CloseThreadpoolCleanupGroupMembers(PTP_CLEANUP_GROUP CleanupGroup, BOOL CancelPendingCallbacks, PVOID CleanupContext)
+{
+    TpReleaseCleanupGroupMembers(CleanupGroup, CancelPendingCallbacks, CleanupContext);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+CloseThreadpoolCleanupGroup(PTP_CLEANUP_GROUP CleanupGroup)
+{
+    TpReleaseCleanupGroup(CleanupGroup);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+SetEventWhenCallbackReturns(PTP_CALLBACK_INSTANCE Instance, HANDLE Event)
+{
+    TpCallbackSetEventOnCompletion(Instance, Event);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+ReleaseSemaphoreWhenCallbackReturns(PTP_CALLBACK_INSTANCE Instance, HANDLE Semaphore, DWORD ReleaseCount)
+{
+    TpCallbackReleaseSemaphoreOnCompletion(Instance, Semaphore, ReleaseCount);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+ReleaseMutexWhenCallbackReturns(PTP_CALLBACK_INSTANCE Instance, HANDLE Mutex)
+{
+    TpCallbackReleaseMutexOnCompletion(Instance, Mutex);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+LeaveCriticalSectionWhenCallbackReturns(PTP_CALLBACK_INSTANCE Instance, PCRITICAL_SECTION CriticalSection)
+{
+    TpCallbackLeaveCriticalSectionOnCompletion(Instance, (PRTL_CRITICAL_SECTION)CriticalSection);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+FreeLibraryWhenCallbackReturns(PTP_CALLBACK_INSTANCE Instance, HMODULE Module)
+{
+    TpCallbackUnloadDllOnCompletion(Instance, Module);
+}
+
+/*
+ * @implemented
+ */
+BOOL
+WINAPI
+CallbackMayRunLong(PTP_CALLBACK_INSTANCE Instance)
+{
+    NTSTATUS Status;
+
+    Status = TpCallbackMayRunLong(Instance);
+    if (!NT_SUCCESS(Status))
+    {
+        SetLastError(RtlNtStatusToDosError(Status));
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+DisassociateCurrentThreadFromCallback(PTP_CALLBACK_INSTANCE Instance)
+{
+    TpDisassociateCallback(Instance);
+}
+
+/*
+ * @implemented
+ */
+BOOL
+WINAPI
+TrySubmitThreadpoolCallback(PTP_SIMPLE_CALLBACK Callback, PVOID Context, PTP_CALLBACK_ENVIRON CallbackEnviron)
+{
+    NTSTATUS Status;
+
+    Status = TpSimpleTryPost(Callback, Context, CallbackEnviron);
+    if (!NT_SUCCESS(Status))
+    {
+        SetLastError(RtlNtStatusToDosError(Status));
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * @implemented
+ */
+PTP_WORK
+WINAPI
+CreateThreadpoolWork(PTP_WORK_CALLBACK Callback, PVOID Context, PTP_CALLBACK_ENVIRON CallbackEnviron)
+{
+    PTP_WORK Work;
+    NTSTATUS Status;
+
+    Status = TpAllocWork(&Work, Callback, Context, CallbackEnviron);
+    if (!NT_SUCCESS(Status))
+    {
+        SetLastError(RtlNtStatusToDosError(Status));
+        return NULL;
+    }
+    return Work;
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+SubmitThreadpoolWork(PTP_WORK Work)
+{
+    TpPostWork(Work);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+WaitForThreadpoolWorkCallbacks(PTP_WORK Work, BOOL CancelPendingCallbacks)
+{
+    TpWaitForWork(Work, CancelPendingCallbacks);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+CloseThreadpoolWork(PTP_WORK Work)
+{
+    TpReleaseWork(Work);
+}
+
+/*
+ * @implemented
+ */
+PTP_TIMER
+WINAPI
+CreateThreadpoolTimer(PTP_TIMER_CALLBACK Callback, PVOID Context, PTP_CALLBACK_ENVIRON CallbackEnviron)
+{
+    PTP_TIMER Timer;
+    NTSTATUS Status;
+
+    Status = TpAllocTimer(&Timer, Callback, Context, CallbackEnviron);
+    if (!NT_SUCCESS(Status))
+    {
+        SetLastError(RtlNtStatusToDosError(Status));
+        return NULL;
+    }
+    return Timer;
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+SetThreadpoolTimer(PTP_TIMER Timer, PFILETIME DueTime, DWORD Period, DWORD WindowLength)
+{
+    LARGE_INTEGER Time;
+
+    TpSetTimer(Timer, GetThreadpoolDueTime(&Time, DueTime), Period, WindowLength);
+}
+
+/*
+ * @implemented
+ */
+BOOL
+WINAPI
+IsThreadpoolTimerSet(PTP_TIMER Timer)
+{
+    return TpIsTimerSet(Timer) ? TRUE : FALSE;
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+WaitForThreadpoolTimerCallbacks(PTP_TIMER Timer, BOOL CancelPendingCallbacks)
+{
+    TpWaitForTimer(Timer, CancelPendingCallbacks);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+CloseThreadpoolTimer(PTP_TIMER Timer)
+{
+    TpReleaseTimer(Timer);
+}
+
+/*
+ * @implemented
+ */
+PTP_WAIT
+WINAPI
+CreateThreadpoolWait(PTP_WAIT_CALLBACK Callback, PVOID Context, PTP_CALLBACK_ENVIRON CallbackEnviron)
+{
+    PTP_WAIT Wait;
+    NTSTATUS Status;
+
+    Status = TpAllocWait(&Wait, Callback, Context, CallbackEnviron);
+    if (!NT_SUCCESS(Status))
+    {
+        SetLastError(RtlNtStatusToDosError(Status));
+        return NULL;
+    }
+    return Wait;
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+SetThreadpoolWait(PTP_WAIT Wait, HANDLE Handle, PFILETIME Timeout)
+{
+    LARGE_INTEGER Time;
+
+    TpSetWait(Wait, Handle, GetThreadpoolDueTime(&Time, Timeout));
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+WaitForThreadpoolWaitCallbacks(PTP_WAIT Wait, BOOL CancelPendingCallbacks)
+{
+    TpWaitForWait(Wait, CancelPendingCallbacks);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+CloseThreadpoolWait(PTP_WAIT Wait)
+{
+    TpReleaseWait(Wait);
+}
+
+/*
+ * @implemented
+ */
+PTP_IO
+WINAPI
+CreateThreadpoolIo(HANDLE File, PTP_WIN32_IO_CALLBACK Callback, PVOID Context, PTP_CALLBACK_ENVIRON CallbackEnviron)
+{
+    PTP_IO Io;
+    NTSTATUS Status;
+
+    if (!Callback)
+    {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return NULL;
+    }
+
+    Status = TpAllocIoCompletion(&Io, File, ThreadpoolIoCallback, Context, CallbackEnviron);
+    if (!NT_SUCCESS(Status))
+    {
+        SetLastError(RtlNtStatusToDosError(Status));
+        return NULL;
+    }
+
+    TP_IO_WIN32_CALLBACK(Io) = Callback;
+    return Io;
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+StartThreadpoolIo(PTP_IO Io)
+{
+    TpStartAsyncIoOperation(Io);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+CancelThreadpoolIo(PTP_IO Io)
+{
+    TpCancelAsyncIoOperation(Io);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+WaitForThreadpoolIoCallbacks(PTP_IO Io, BOOL CancelPendingCallbacks)
+{
+    TpWaitForIoCompletion(Io, CancelPendingCallbacks);
+}
+
+/*
+ * @implemented
+ */
+VOID
+WINAPI
+CloseThreadpoolIo(PTP_IO Io)
+{
+    TpReleaseIoCompletion(Io);
+}
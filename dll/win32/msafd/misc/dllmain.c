@@ -20,7 +20,11 @@ HANDLE GlobalHeap;
 WSPUPCALLTABLE Upcalls;
 DWORD CatalogEntryId; /* CatalogEntryId for upcalls */
 LPWPUCOMPLETEOVERLAPPEDREQUEST lpWPUCompleteOverlappedRequest;
-PSOCKET_INFORMATION SocketListHead = NULL;
+/* Sockets of the process, hashed on their handle so that select can look
+ * up thousands of them without walking a single list */
+#define SOCKET_HASH_SIZE 1024
+#define SOCKET_HASH(Handle) (((ULONG_PTR)(Handle) >> 2) % SOCKET_HASH_SIZE)
+PSOCKET_INFORMATION SocketHashTable[SOCKET_HASH_SIZE];
 CRITICAL_SECTION SocketListLock;
 LIST_ENTRY SockHelpersListHead = { NULL, NULL };
 ULONG SockAsyncThreadRefCount;
@@ -402,8 +406,8 @@ ok:
 
     /* Save in Process Sockets List */
     EnterCriticalSection(&SocketListLock);
-    Socket->NextSocket = SocketListHead;
-    SocketListHead = Socket;
+    Socket->NextSocket = SocketHashTable[SOCKET_HASH(Socket->Handle)];
+    SocketHashTable[SOCKET_HASH(Socket->Handle)] = Socket;
     LeaveCriticalSection(&SocketListLock);
 
     /* Create the Socket Context */
@@ -791,13 +795,13 @@ WSPCloseSocket(IN SOCKET Handle,
     Socket->TdiConnectionHandle = NULL;
 ok:
     EnterCriticalSection(&SocketListLock);
-    if (SocketListHead == Socket)
+    if (SocketHashTable[SOCKET_HASH(Handle)] == Socket)
     {
-        SocketListHead = SocketListHead->NextSocket;
+        SocketHashTable[SOCKET_HASH(Handle)] = Socket->NextSocket;
     }
     else
     {
-        CurrentSocket = SocketListHead;
+        CurrentSocket = SocketHashTable[SOCKET_HASH(Handle)];
         while (CurrentSocket->NextSocket)
         {
             if (CurrentSocket->NextSocket == Socket)
@@ -811,6 +815,9 @@ ok:
     }
     LeaveCriticalSection(&SocketListLock);
 
+    /* The handle value may come back for another socket */
+    InterlockedIncrement(&SockPollSetGeneration);
+
     /* Close the handle */
     NtClose((HANDLE)Handle);
     NtClose(SockEvent);
@@ -1083,6 +1090,39 @@ WSPSelect(IN int nfds,
     ULONG               Events;
     fd_set              selectfds;
 
+    /* Convert Timeout to NT Format */
+    if (timeout == NULL)
+    {
+        Timeout.u.LowPart = -1;
+        Timeout.u.HighPart = 0x7FFFFFFF;
+        TRACE("Infinite timeout\n");
+    }
+    else
+    {
+        Timeout = RtlEnlargedIntegerMultiply
+            ((timeout->tv_sec * 1000) + (timeout->tv_usec / 1000), -10000);
+        /* Negative timeouts are illegal.  Since the kernel represents an
+         * incremental timeout as a negative number, we check for a positive
+         * result.
+         */
+        if (Timeout.QuadPart > 0)
+        {
+            if (lpErrno) *lpErrno = WSAEINVAL;
+            return SOCKET_ERROR;
+        }
+        TRACE("Timeout: Orig %d.%06d kernel %d\n",
+                     timeout->tv_sec, timeout->tv_usec,
+                     Timeout.u.LowPart);
+    }
+
+    /* Sets larger than ours go through a poll set, which also keeps the
+     * sockets registered in AFD between calls */
+    HandleCount = (readfds ? readfds->fd_count : 0) +
+                  (writefds ? writefds->fd_count : 0) +
+                  (exceptfds ? exceptfds->fd_count : 0);
+    if (HandleCount > FD_SETSIZE)
+        return SockSelectPollSet(readfds, writefds, exceptfds, &Timeout, lpErrno);
+
     /* Find out how many sockets we have, and how large the buffer needs
      * to be */
     FD_ZERO(&selectfds);
@@ -1121,31 +1161,6 @@ WSPSelect(IN int nfds,
 
     TRACE("HandleCount: %u BufferSize: %u\n", HandleCount, PollBufferSize);
 
-    /* Convert Timeout to NT Format */
-    if (timeout == NULL)
-    {
-        Timeout.u.LowPart = -1;
-        Timeout.u.HighPart = 0x7FFFFFFF;
-        TRACE("Infinite timeout\n");
-    }
-    else
-    {
-        Timeout = RtlEnlargedIntegerMultiply
-            ((timeout->tv_sec * 1000) + (timeout->tv_usec / 1000), -10000);
-        /* Negative timeouts are illegal.  Since the kernel represents an
-         * incremental timeout as a negative number, we check for a positive
-         * result.
-         */
-        if (Timeout.QuadPart > 0)
-        {
-            if (lpErrno) *lpErrno = WSAEINVAL;
-            return SOCKET_ERROR;
-        }
-        TRACE("Timeout: Orig %d.%06d kernel %d\n",
-                     timeout->tv_sec, timeout->tv_usec,
-                     Timeout.u.LowPart);
-    }
-
     Status = NtCreateEvent(&SockEvent,
                            EVENT_ALL_ACCESS,
                            NULL,
@@ -2486,6 +2501,8 @@ WSPIoctl(IN  SOCKET Handle,
                 GUID ConnectExGUID = WSAID_CONNECTEX;
                 GUID DisconnectExGUID = WSAID_DISCONNECTEX;
                 GUID GetAcceptExSockaddrsGUID = WSAID_GETACCEPTEXSOCKADDRS;
+                GUID TransmitFileGUID = WSAID_TRANSMITFILE;
+                GUID TransmitPacketsGUID = WSAID_TRANSMITPACKETS;
 
                 if (IsEqualGUID(&AcceptExGUID, lpvInBuffer))
                 {
@@ -2515,6 +2532,20 @@ WSPIoctl(IN  SOCKET Handle,
                     Errno = NO_ERROR;
                     Ret = NO_ERROR;
                 }
+                else if (IsEqualGUID(&TransmitFileGUID, lpvInBuffer))
+                {
+                    *((PVOID *)lpvOutBuffer) = WSPTransmitFile;
+                    cbRet = sizeof(PVOID);
+                    Errno = NO_ERROR;
+                    Ret = NO_ERROR;
+                }
+                else if (IsEqualGUID(&TransmitPacketsGUID, lpvInBuffer))
+                {
+                    *((PVOID *)lpvOutBuffer) = WSPTransmitPackets;
+                    cbRet = sizeof(PVOID);
+                    Errno = NO_ERROR;
+                    Ret = NO_ERROR;
+                }
                 else
                 {
                     ERR("Querying unknown extension function: %x\n", ((GUID*)lpvInBuffer)->Data1);
@@ -3514,7 +3545,7 @@ GetSocketStructure(SOCKET Handle)
 
     EnterCriticalSection(&SocketListLock);
 
-    CurrentSocket = SocketListHead;
+    CurrentSocket = SocketHashTable[SOCKET_HASH(Handle)];
     while (CurrentSocket)
     {
         if (CurrentSocket->Handle == Handle)
@@ -4055,6 +4086,9 @@ DllMain(HANDLE hInstDll,
         /* Initialize the lock that protects our socket list */
         InitializeCriticalSection(&SocketListLock);
 
+        /* And the cache of poll sets used by select */
+        SockInitializePollSets();
+
         TRACE("MSAFD.DLL has been loaded\n");
 
         break;
@@ -4070,6 +4104,8 @@ DllMain(HANDLE hInstDll,
         /* Delete the socket list lock */
         DeleteCriticalSection(&SocketListLock);
 
+        SockCleanupPollSets();
+
         break;
     }
 
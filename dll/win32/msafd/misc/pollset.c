@@ -0,0 +1,514 @@
+/*
+ * PROJECT:     ReactOS Ancillary Function Driver DLL
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     select() on large socket sets through AFD poll sets
+ */
+
+#include <msafd.h>
+
+#include <stdlib.h>
+
+/*
+ * Programs that select on thousands of sockets usually pass the same sets
+ * on every call. We keep a few AFD poll sets around together with the
+ * sockets they hold, so that a call only has to send the difference to
+ * AFD instead of all the sockets. Closing any socket bumps the generation,
+ * after which the cached sets are rebuilt because the handle may have
+ * been reused for another socket.
+ */
+
+#define SOCK_POLL_SET_CACHE_SIZE 4
+
+typedef struct _SOCK_POLL_ENTRY {
+    SOCKET Handle;
+    ULONG Events;
+} SOCK_POLL_ENTRY, *PSOCK_POLL_ENTRY;
+
+typedef struct _SOCK_POLL_SET {
+    HANDLE Handle;
+    BOOLEAN InUse;
+    DWORD LastThreadId;
+    LONG Generation;
+    ULONG EntryCount;
+    PSOCK_POLL_ENTRY Entries;
+} SOCK_POLL_SET, *PSOCK_POLL_SET;
+
+static SOCK_POLL_SET SockPollSets[SOCK_POLL_SET_CACHE_SIZE];
+static CRITICAL_SECTION SockPollSetLock;
+LONG SockPollSetGeneration;
+
+#define SOCK_SELECT_READ_EVENTS     (AFD_EVENT_RECEIVE | \
+                                     AFD_EVENT_DISCONNECT | \
+                                     AFD_EVENT_ABORT | \
+                                     AFD_EVENT_CLOSE | \
+                                     AFD_EVENT_ACCEPT)
+
+VOID
+SockInitializePollSets(VOID)
+{
+    InitializeCriticalSection(&SockPollSetLock);
+}
+
+VOID
+SockCleanupPollSets(VOID)
+{
+    ULONG i;
+
+    for (i = 0; i < SOCK_POLL_SET_CACHE_SIZE; i++)
+    {
+        if (SockPollSets[i].Handle)
+            NtClose(SockPollSets[i].Handle);
+        if (SockPollSets[i].Entries)
+            HeapFree(GlobalHeap, 0, SockPollSets[i].Entries);
+    }
+
+    DeleteCriticalSection(&SockPollSetLock);
+}
+
+static
+int
+__cdecl
+CompareEntries(const void *First, const void *Second)
+{
+    SOCKET FirstHandle = ((PSOCK_POLL_ENTRY)First)->Handle;
+    SOCKET SecondHandle = ((PSOCK_POLL_ENTRY)Second)->Handle;
+
+    if (FirstHandle < SecondHandle)
+        return -1;
+    return FirstHandle > SecondHandle;
+}
+
+static
+INT
+AddEntries(PSOCK_POLL_ENTRY Entries, PULONG Count, fd_set *fds, ULONG Events)
+{
+    PSOCKET_INFORMATION Socket;
+    ULONG i;
+
+    if (!fds)
+        return NO_ERROR;
+
+    for (i = 0; i < fds->fd_count; i++)
+    {
+        Socket = GetSocketStructure(fds->fd_array[i]);
+        if (!Socket)
+        {
+            ERR("Invalid socket handle provided %d\n", fds->fd_array[i]);
+            return WSAENOTSOCK;
+        }
+
+        Entries[*Count].Handle = fds->fd_array[i];
+        Entries[*Count].Events = Events;
+
+        /* The write and except sets depend on the socket, no events at
+         * all stands for the except set */
+        if (Events == AFD_EVENT_SEND && Socket->SharedData->NonBlocking != 0)
+            Entries[*Count].Events |= AFD_EVENT_CONNECT;
+        if (!Events)
+        {
+            if (Socket->SharedData->OobInline == 0)
+                Entries[*Count].Events |= AFD_EVENT_OOB_RECEIVE;
+            if (Socket->SharedData->NonBlocking != 0)
+                Entries[*Count].Events |= AFD_EVENT_CONNECT_FAIL;
+        }
+
+        (*Count)++;
+    }
+
+    return NO_ERROR;
+}
+
+static
+PSOCK_POLL_SET
+AcquirePollSet(PSOCK_POLL_SET TempSet)
+{
+    PSOCK_POLL_SET PollSet = NULL;
+    DWORD ThreadId = GetCurrentThreadId();
+    ULONG i;
+
+    EnterCriticalSection(&SockPollSetLock);
+
+    /* The set this thread used last time most likely has the same sockets */
+    for (i = 0; i < SOCK_POLL_SET_CACHE_SIZE; i++)
+    {
+        if (SockPollSets[i].InUse)
+            continue;
+
+        if (!PollSet || SockPollSets[i].LastThreadId == ThreadId)
+            PollSet = &SockPollSets[i];
+
+        if (PollSet->LastThreadId == ThreadId)
+            break;
+    }
+
+    if (PollSet)
+    {
+        PollSet->InUse = TRUE;
+        PollSet->LastThreadId = ThreadId;
+    }
+
+    LeaveCriticalSection(&SockPollSetLock);
+
+    if (!PollSet)
+    {
+        /* All cached sets are busy, use a set for this call only */
+        RtlZeroMemory(TempSet, sizeof(*TempSet));
+        PollSet = TempSet;
+    }
+
+    return PollSet;
+}
+
+static
+VOID
+ReleasePollSet(PSOCK_POLL_SET PollSet, PSOCK_POLL_SET TempSet)
+{
+    if (PollSet == TempSet)
+    {
+        if (PollSet->Handle)
+            NtClose(PollSet->Handle);
+        if (PollSet->Entries)
+            HeapFree(GlobalHeap, 0, PollSet->Entries);
+        return;
+    }
+
+    EnterCriticalSection(&SockPollSetLock);
+    PollSet->InUse = FALSE;
+    LeaveCriticalSection(&SockPollSetLock);
+}
+
+static
+INT
+ResetPollSet(PSOCK_POLL_SET PollSet)
+{
+    UNICODE_STRING DevName = RTL_CONSTANT_STRING(L"\\Device\\Afd");
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK IOSB;
+    NTSTATUS Status;
+
+    /* Closing the handle drops all the sockets of the set in AFD */
+    if (PollSet->Handle)
+    {
+        NtClose(PollSet->Handle);
+        PollSet->Handle = NULL;
+    }
+    PollSet->EntryCount = 0;
+    PollSet->Generation = SockPollSetGeneration;
+
+    InitializeObjectAttributes(&ObjectAttributes,
+                               &DevName,
+                               OBJ_CASE_INSENSITIVE,
+                               NULL,
+                               NULL);
+
+    Status = NtCreateFile(&PollSet->Handle,
+                          GENERIC_READ | GENERIC_WRITE | SYNCHRONIZE,
+                          &ObjectAttributes,
+                          &IOSB,
+                          NULL,
+                          0,
+                          FILE_SHARE_READ | FILE_SHARE_WRITE,
+                          FILE_OPEN_IF,
+                          0,
+                          NULL,
+                          0);
+    if (!NT_SUCCESS(Status))
+    {
+        ERR("Failed to open poll set. Status 0x%08x\n", Status);
+        PollSet->Handle = NULL;
+        return TranslateNtStatusError(Status);
+    }
+
+    return NO_ERROR;
+}
+
+static
+NTSTATUS
+PollSetIoControl(PSOCK_POLL_SET PollSet, HANDLE SockEvent, ULONG IoControlCode,
+                 PVOID Buffer, ULONG InputLength, ULONG OutputLength)
+{
+    IO_STATUS_BLOCK IOSB;
+    NTSTATUS Status;
+
+    Status = NtDeviceIoControlFile(PollSet->Handle,
+                                   SockEvent,
+                                   NULL,
+                                   NULL,
+                                   &IOSB,
+                                   IoControlCode,
+                                   Buffer,
+                                   InputLength,
+                                   Buffer,
+                                   OutputLength);
+    if (Status == STATUS_PENDING)
+    {
+        WaitForSingleObject(SockEvent, INFINITE);
+        Status = IOSB.Status;
+    }
+
+    return Status;
+}
+
+static
+INT
+UpdatePollSet(PSOCK_POLL_SET PollSet, HANDLE SockEvent,
+              PSOCK_POLL_ENTRY Entries, ULONG EntryCount)
+{
+    PAFD_POLL_SET_UPDATE_INFO UpdateInfo;
+    PAFD_POLL_SET_ENTRY Update;
+    ULONG UpdateSize, Count = 0, i = 0, j = 0;
+    NTSTATUS Status;
+    INT Error = NO_ERROR;
+
+    if (!PollSet->Handle || PollSet->Generation != SockPollSetGeneration)
+    {
+        Error = ResetPollSet(PollSet);
+        if (Error != NO_ERROR)
+            return Error;
+    }
+
+    /* At worst every cached socket goes away and every wanted one is new */
+    UpdateSize = FIELD_OFFSET(AFD_POLL_SET_UPDATE_INFO, Entries[PollSet->EntryCount + EntryCount]);
+    UpdateInfo = HeapAlloc(GlobalHeap, 0, UpdateSize);
+    if (!UpdateInfo)
+        return WSAENOBUFS;
+
+    /* Both arrays are sorted, so one pass finds the difference */
+    while (i < PollSet->EntryCount || j < EntryCount)
+    {
+        Update = &UpdateInfo->Entries[Count];
+        Update->Context = 0;
+
+        if (j == EntryCount ||
+            (i < PollSet->EntryCount && PollSet->Entries[i].Handle < Entries[j].Handle))
+        {
+            Update->Handle = PollSet->Entries[i++].Handle;
+            Update->Operation = AFD_POLL_SET_REMOVE;
+            Update->Events = 0;
+            Count++;
+        }
+        else if (i == PollSet->EntryCount || Entries[j].Handle < PollSet->Entries[i].Handle)
+        {
+            Update->Handle = Entries[j].Handle;
+            Update->Operation = AFD_POLL_SET_ADD;
+            Update->Events = Entries[j++].Events;
+            Count++;
+        }
+        else
+        {
+            if (PollSet->Entries[i].Events != Entries[j].Events)
+            {
+                Update->Handle = Entries[j].Handle;
+                Update->Operation = AFD_POLL_SET_MODIFY;
+                Update->Events = Entries[j].Events;
+                Count++;
+            }
+            i++;
+            j++;
+        }
+    }
+
+    if (Count)
+    {
+        UpdateInfo->EntryCount = Count;
+        UpdateSize = FIELD_OFFSET(AFD_POLL_SET_UPDATE_INFO, Entries[Count]);
+
+        Status = PollSetIoControl(PollSet, SockEvent, IOCTL_AFD_POLL_SET_UPDATE,
+                                  UpdateInfo, UpdateSize, UpdateSize);
+        if (!NT_SUCCESS(Status))
+            Error = TranslateNtStatusError(Status);
+
+        for (i = 0; i < Count && Error == NO_ERROR; i++)
+        {
+            if (!NT_SUCCESS(UpdateInfo->Entries[i].Status))
+            {
+                ERR("Failed to update poll set entry %p. Status 0x%08x\n",
+                    UpdateInfo->Entries[i].Handle, UpdateInfo->Entries[i].Status);
+                Error = WSAENOTSOCK;
+            }
+        }
+    }
+
+    HeapFree(GlobalHeap, 0, UpdateInfo);
+
+    if (Error != NO_ERROR)
+    {
+        /* We don't know what AFD holds now, start over next time */
+        PollSet->Generation = SockPollSetGeneration - 1;
+        return Error;
+    }
+
+    /* The caller hands over its array, the old one goes */
+    if (PollSet->Entries)
+        HeapFree(GlobalHeap, 0, PollSet->Entries);
+    PollSet->Entries = Entries;
+    PollSet->EntryCount = EntryCount;
+
+    return NO_ERROR;
+}
+
+static
+VOID
+AddResult(fd_set *fds, SOCKET Handle)
+{
+    /* Each handle is reported once, but the sets may be the same */
+    if (fds->fd_count && fds->fd_array[fds->fd_count - 1] == Handle)
+        return;
+
+    fds->fd_array[fds->fd_count++] = Handle;
+}
+
+INT
+SockSelectPollSet(fd_set *readfds,
+                  fd_set *writefds,
+                  fd_set *exceptfds,
+                  PLARGE_INTEGER Timeout,
+                  LPINT lpErrno)
+{
+    SOCK_POLL_SET TempSet;
+    PSOCK_POLL_SET PollSet;
+    PSOCK_POLL_ENTRY Entries;
+    PAFD_POLL_SET_WAIT_INFO WaitInfo = NULL;
+    PSOCKET_INFORMATION Socket;
+    ULONG EntryCount = 0, WaitSize, i, j;
+    HANDLE SockEvent;
+    SOCKET Handle;
+    ULONG Events;
+    NTSTATUS Status;
+    INT Error;
+
+    EntryCount = (readfds ? readfds->fd_count : 0) +
+                 (writefds ? writefds->fd_count : 0) +
+                 (exceptfds ? exceptfds->fd_count : 0);
+
+    Entries = HeapAlloc(GlobalHeap, 0, EntryCount * sizeof(*Entries));
+    if (!Entries)
+    {
+        if (lpErrno) *lpErrno = WSAENOBUFS;
+        return SOCKET_ERROR;
+    }
+
+    EntryCount = 0;
+    Error = AddEntries(Entries, &EntryCount, readfds, SOCK_SELECT_READ_EVENTS);
+    if (Error == NO_ERROR)
+        Error = AddEntries(Entries, &EntryCount, writefds, AFD_EVENT_SEND);
+    if (Error == NO_ERROR)
+        Error = AddEntries(Entries, &EntryCount, exceptfds, 0);
+    if (Error != NO_ERROR)
+    {
+        HeapFree(GlobalHeap, 0, Entries);
+        if (lpErrno) *lpErrno = Error;
+        return SOCKET_ERROR;
+    }
+
+    /* Sort and merge the sockets that are in more than one set */
+    qsort(Entries, EntryCount, sizeof(*Entries), CompareEntries);
+    for (i = 0, j = 0; i < EntryCount; i++)
+    {
+        if (j && Entries[j - 1].Handle == Entries[i].Handle)
+            Entries[j - 1].Events |= Entries[i].Events;
+        else
+            Entries[j++] = Entries[i];
+    }
+    EntryCount = j;
+
+    Status = NtCreateEvent(&SockEvent,
+                           EVENT_ALL_ACCESS,
+                           NULL,
+                           SynchronizationEvent,
+                           FALSE);
+    if (!NT_SUCCESS(Status))
+    {
+        ERR("NtCreateEvent failed, 0x%08x\n", Status);
+        HeapFree(GlobalHeap, 0, Entries);
+        if (lpErrno) *lpErrno = WSAEFAULT;
+        return SOCKET_ERROR;
+    }
+
+    PollSet = AcquirePollSet(&TempSet);
+
+    Error = UpdatePollSet(PollSet, SockEvent, Entries, EntryCount);
+    if (Error != NO_ERROR)
+    {
+        HeapFree(GlobalHeap, 0, Entries);
+        goto done;
+    }
+
+    WaitSize = FIELD_OFFSET(AFD_POLL_SET_WAIT_INFO, Events[EntryCount]);
+    WaitInfo = HeapAlloc(GlobalHeap, 0, WaitSize);
+    if (!WaitInfo)
+    {
+        Error = WSAENOBUFS;
+        goto done;
+    }
+
+    WaitInfo->Timeout = *Timeout;
+    WaitInfo->EventCount = EntryCount;
+
+    Status = PollSetIoControl(PollSet, SockEvent, IOCTL_AFD_POLL_SET_WAIT,
+                              WaitInfo, FIELD_OFFSET(AFD_POLL_SET_WAIT_INFO, Events), WaitSize);
+    if (Status == STATUS_TIMEOUT)
+    {
+        WaitInfo->EventCount = 0;
+    }
+    else if (!NT_SUCCESS(Status))
+    {
+        Error = WSAEINVAL;
+        goto done;
+    }
+
+    if (readfds)
+        FD_ZERO(readfds);
+    if (writefds)
+        FD_ZERO(writefds);
+    if (exceptfds)
+        FD_ZERO(exceptfds);
+
+    /* Only the ready sockets are looked at, the sets can't grow past
+     * their original size since AFD only reports what each one asked for */
+    for (i = 0; i < WaitInfo->EventCount; i++)
+    {
+        Handle = WaitInfo->Events[i].Handle;
+        Events = WaitInfo->Events[i].Events;
+
+        Socket = GetSocketStructure(Handle);
+        if (!Socket)
+            continue;
+
+        TRACE("Event %x on handle %x\n", Events, Handle);
+
+        if (Events & AFD_EVENT_CLOSE)
+            Socket->SharedData->SocketLastError = WSAECONNRESET;
+        else if (Events & AFD_EVENT_ABORT)
+            Socket->SharedData->SocketLastError = WSAECONNABORTED;
+        else if (Events & AFD_EVENT_DISCONNECT)
+            Socket->SharedData->SocketLastError = WSAECONNRESET;
+
+        if (readfds && (Events & SOCK_SELECT_READ_EVENTS))
+            AddResult(readfds, Handle);
+        if (writefds && ((Events & AFD_EVENT_SEND) ||
+                         ((Events & AFD_EVENT_CONNECT) && Socket->SharedData->NonBlocking != 0)))
+            AddResult(writefds, Handle);
+        if (exceptfds && (((Events & AFD_EVENT_OOB_RECEIVE) && Socket->SharedData->OobInline == 0) ||
+                          ((Events & AFD_EVENT_CONNECT_FAIL) && Socket->SharedData->NonBlocking != 0)))
+            AddResult(exceptfds, Handle);
+    }
+
+done:
+    if (WaitInfo)
+        HeapFree(GlobalHeap, 0, WaitInfo);
+    ReleasePollSet(PollSet, &TempSet);
+    NtClose(SockEvent);
+
+    if (lpErrno) *lpErrno = Error;
+    if (Error != NO_ERROR)
+        return SOCKET_ERROR;
+
+    EntryCount = (readfds ? readfds->fd_count : 0) +
+                 (writefds && writefds != readfds ? writefds->fd_count : 0) +
+                 (exceptfds && exceptfds != readfds && exceptfds != writefds ? exceptfds->fd_count : 0);
+
+    TRACE("%d events\n", EntryCount);
+
+    return EntryCount;
+}
@@ -714,6 +714,185 @@ WSPSend(SOCKET Handle,
     return MsafdReturnWithErrno( Status, lpErrno, IOSB->Information, lpNumberOfBytesSent );
 }
 
+static
+BOOL
+SockTransmit(PSOCKET_INFORMATION Socket,
+             ULONG IoControlCode,
+             PVOID TransmitInfo,
+             ULONG TransmitInfoLength,
+             LPOVERLAPPED lpOverlapped)
+{
+    PIO_STATUS_BLOCK        IOSB;
+    IO_STATUS_BLOCK         DummyIOSB;
+    NTSTATUS                Status;
+    HANDLE                  Event;
+    HANDLE                  SockEvent = NULL;
+    INT                     Errno;
+
+    if (lpOverlapped == NULL)
+    {
+        /* Not using Overlapped structure, so use normal blocking on event */
+        Status = NtCreateEvent(&SockEvent, EVENT_ALL_ACCESS,
+                               NULL, SynchronizationEvent, FALSE);
+        if (!NT_SUCCESS(Status))
+        {
+            SetLastError(TranslateNtStatusError(Status));
+            return FALSE;
+        }
+
+        Event = SockEvent;
+        IOSB = &DummyIOSB;
+    }
+    else
+    {
+        /* The extension functions have no completion routine, a port or the event is signaled */
+        Event = lpOverlapped->hEvent;
+        IOSB = (PIO_STATUS_BLOCK)&lpOverlapped->Internal;
+    }
+
+    IOSB->Status = STATUS_PENDING;
+
+    Status = NtDeviceIoControlFile((HANDLE)Socket->Handle,
+                                   Event,
+                                   NULL,
+                                   lpOverlapped,
+                                   IOSB,
+                                   IoControlCode,
+                                   TransmitInfo,
+                                   TransmitInfoLength,
+                                   NULL,
+                                   0);
+
+    /* Wait for completion of not overlapped */
+    if (Status == STATUS_PENDING && lpOverlapped == NULL)
+    {
+        WaitForSingleObject(SockEvent, INFINITE);
+        Status = IOSB->Status;
+    }
+
+    if (SockEvent)
+        NtClose(SockEvent);
+
+    if (Status == STATUS_PENDING)
+    {
+        TRACE("Leaving (Pending)\n");
+        SetLastError(WSA_IO_PENDING);
+        return FALSE;
+    }
+
+    /* Re-enable Async Event */
+    SockReenableAsyncSelectEvent(Socket, FD_WRITE);
+
+    Errno = TranslateNtStatusError(Status);
+    if (Errno != NO_ERROR)
+    {
+        SetLastError(Errno);
+        return FALSE;
+    }
+
+    TRACE("Leaving (Success, %d)\n", IOSB->Information);
+    return TRUE;
+}
+
+BOOL
+WSPAPI
+WSPTransmitFile(SOCKET Handle,
+                HANDLE hFile,
+                DWORD nNumberOfBytesToWrite,
+                DWORD nNumberOfBytesPerSend,
+                LPOVERLAPPED lpOverlapped,
+                LPTRANSMIT_FILE_BUFFERS lpTransmitBuffers,
+                DWORD dwFlags)
+{
+    AFD_TRANSMIT_FILE_INFO  TransmitInfo;
+    PSOCKET_INFORMATION     Socket;
+
+    /* Get the Socket Structure associate to this Socket */
+    Socket = GetSocketStructure(Handle);
+    if (!Socket)
+    {
+        SetLastError(WSAENOTSOCK);
+        return FALSE;
+    }
+
+    TRACE("Called\n");
+
+    RtlZeroMemory(&TransmitInfo, sizeof(TransmitInfo));
+
+    /* Overlapped handles give the offset, others are sent from their current position */
+    if (lpOverlapped)
+    {
+        TransmitInfo.Offset.LowPart = lpOverlapped->Offset;
+        TransmitInfo.Offset.HighPart = lpOverlapped->OffsetHigh;
+    }
+    else
+    {
+        TransmitInfo.Offset.QuadPart = -1;
+    }
+
+    TransmitInfo.WriteLength = nNumberOfBytesToWrite;
+    TransmitInfo.SendPacketLength = nNumberOfBytesPerSend;
+    TransmitInfo.FileHandle = hFile;
+    TransmitInfo.Flags = dwFlags & (TF_DISCONNECT | TF_REUSE_SOCKET);
+    TransmitInfo.AfdFlags = lpOverlapped ? AFD_OVERLAPPED : 0;
+
+    if (lpTransmitBuffers)
+    {
+        TransmitInfo.Head.buf = lpTransmitBuffers->Head;
+        TransmitInfo.Head.len = lpTransmitBuffers->Head ? lpTransmitBuffers->HeadLength : 0;
+        TransmitInfo.Tail.buf = lpTransmitBuffers->Tail;
+        TransmitInfo.Tail.len = lpTransmitBuffers->Tail ? lpTransmitBuffers->TailLength : 0;
+    }
+
+    return SockTransmit(Socket,
+                        IOCTL_AFD_TRANSMIT_FILE,
+                        &TransmitInfo,
+                        sizeof(TransmitInfo),
+                        lpOverlapped);
+}
+
+BOOL
+WSPAPI
+WSPTransmitPackets(SOCKET Handle,
+                   LPTRANSMIT_PACKETS_ELEMENT lpPacketArray,
+                   DWORD nElementCount,
+                   DWORD nSendSize,
+                   LPOVERLAPPED lpOverlapped,
+                   DWORD dwFlags)
+{
+    AFD_TRANSMIT_PACKETS_INFO TransmitInfo;
+    PSOCKET_INFORMATION     Socket;
+
+    /* Get the Socket Structure associate to this Socket */
+    Socket = GetSocketStructure(Handle);
+    if (!Socket)
+    {
+        SetLastError(WSAENOTSOCK);
+        return FALSE;
+    }
+
+    if (nElementCount && !lpPacketArray)
+    {
+        SetLastError(WSAEINVAL);
+        return FALSE;
+    }
+
+    TRACE("Called\n");
+
+    /* The elements are read by AFD as they are */
+    TransmitInfo.ElementArray = (PAFD_TRANSMIT_PACKETS_ELEMENT)lpPacketArray;
+    TransmitInfo.ElementCount = nElementCount;
+    TransmitInfo.SendSize = nSendSize;
+    TransmitInfo.Flags = dwFlags & (TP_DISCONNECT | TP_REUSE_SOCKET);
+    TransmitInfo.AfdFlags = lpOverlapped ? AFD_OVERLAPPED : 0;
+
+    return SockTransmit(Socket,
+                        IOCTL_AFD_TRANSMIT_PACKETS,
+                        &TransmitInfo,
+                        sizeof(TransmitInfo),
+                        lpOverlapped);
+}
+
 int
 WSPAPI
 WSPSendTo(SOCKET Handle,
@@ -41,6 +41,7 @@ extern LIST_ENTRY SockHelpersListHead;
 extern HANDLE SockEvent;
 extern HANDLE SockAsyncCompletionPort;
 extern BOOLEAN SockAsyncSelectCalled;
+extern LONG SockPollSetGeneration;
 
 typedef enum _SOCKET_STATE {
     SocketOpen,
@@ -469,12 +470,45 @@ WSPGetAcceptExSockaddrs(
     OUT struct sockaddr **RemoteSockaddr,
     OUT LPINT RemoteSockaddrLength);
 
+BOOL
+WSPAPI
+WSPTransmitFile(
+    IN SOCKET Handle,
+    IN HANDLE hFile,
+    IN DWORD nNumberOfBytesToWrite,
+    IN DWORD nNumberOfBytesPerSend,
+    IN OUT LPOVERLAPPED lpOverlapped,
+    IN LPTRANSMIT_FILE_BUFFERS lpTransmitBuffers,
+    IN DWORD dwFlags);
+
+BOOL
+WSPAPI
+WSPTransmitPackets(
+    IN SOCKET Handle,
+    IN LPTRANSMIT_PACKETS_ELEMENT lpPacketArray,
+    IN DWORD nElementCount,
+    IN DWORD nSendSize,
+    IN OUT LPOVERLAPPED lpOverlapped,
+    IN DWORD dwFlags);
+
 PSOCKET_INFORMATION GetSocketStructure(
 	SOCKET Handle
 );
 
 INT TranslateNtStatusError( NTSTATUS Status );
 
+VOID SockInitializePollSets(VOID);
+
+VOID SockCleanupPollSets(VOID);
+
+INT SockSelectPollSet(
+	fd_set *readfds,
+	fd_set *writefds,
+	fd_set *exceptfds,
+	PLARGE_INTEGER Timeout,
+	LPINT lpErrno
+);
+
 VOID DeleteSocketStructure( SOCKET Handle );
 
 int GetSocketInformation(
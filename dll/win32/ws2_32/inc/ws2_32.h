@@ -40,6 +40,25 @@
 #define SO_OPENTYPE                 0x7008
 #define SO_SYNCHRONOUS_NONALERT     0x20
 
+#if (_WIN32_WINNT < 0x0600)
+#define POLLRDNORM                  0x0100
+#define POLLRDBAND                  0x0200
+#define POLLIN                      (POLLRDNORM | POLLRDBAND)
+#define POLLPRI                     0x0400
+#define POLLWRNORM                  0x0010
+#define POLLOUT                     (POLLWRNORM)
+#define POLLWRBAND                  0x0020
+#define POLLERR                     0x0001
+#define POLLHUP                     0x0002
+#define POLLNVAL                    0x0004
+
+typedef struct pollfd {
+    SOCKET fd;
+    SHORT events;
+    SHORT revents;
+} WSAPOLLFD, *PWSAPOLLFD, FAR *LPWSAPOLLFD;
+#endif
+
 /* Internal headers */
 #include "ws2_32p.h"
 
@@ -114,6 +114,186 @@ select(IN INT s,
     return SOCKET_ERROR;
 }
 
+static
+int
+__cdecl
+WsCompareSockets(const void *First,
+                 const void *Second)
+{
+    SOCKET FirstHandle = *(const SOCKET *)First;
+    SOCKET SecondHandle = *(const SOCKET *)Second;
+
+    if (FirstHandle < SecondHandle) return -1;
+    return FirstHandle > SecondHandle;
+}
+
+static
+BOOLEAN
+WsIsInSortedSet(IN LPFD_SET set,
+                IN SOCKET s)
+{
+    return bsearch(&s,
+                   set->fd_array,
+                   set->fd_count,
+                   sizeof(SOCKET),
+                   WsCompareSockets) != NULL;
+}
+
+/*
+ * @implemented
+ */
+INT
+WSAAPI
+WSAPoll(IN OUT LPWSAPOLLFD fdArray,
+        IN ULONG fds,
+        IN INT timeout)
+{
+    PWSSOCKET Socket;
+    PWSSOCKET FirstSocket = NULL;
+    LPFD_SET Sets[3] = { NULL, NULL, NULL };
+    struct timeval Timeout;
+    ULONG SetSize;
+    ULONG i;
+    INT Count = 0;
+    INT Status;
+    INT ErrorCode;
+    LPWSPSELECT WSPSelect;
+
+    DPRINT("WSAPoll: %p %lu %d\n", fdArray, fds, timeout);
+
+    /* Check for WSAStartup */
+    ErrorCode = WsQuickProlog();
+
+    if (ErrorCode != ERROR_SUCCESS)
+    {
+        SetLastError(ErrorCode);
+        return SOCKET_ERROR;
+    }
+
+    if (!fdArray || !fds)
+    {
+        SetLastError(WSAEINVAL);
+        return SOCKET_ERROR;
+    }
+
+    /*
+     * There is no poll in the service provider interface, so we go through
+     * the provider's select with sets large enough for all the sockets.
+     * A provider can handle those through persistent poll sets.
+     */
+    SetSize = FIELD_OFFSET(FD_SET, fd_array[fds]);
+    for (i = 0; i < 3; i++)
+    {
+        Sets[i] = HeapAlloc(WsSockHeap, 0, SetSize);
+        if (!Sets[i])
+        {
+            ErrorCode = WSAENOBUFS;
+            goto Quickie;
+        }
+        Sets[i]->fd_count = 0;
+    }
+
+    for (i = 0; i < fds; i++)
+    {
+        fdArray[i].revents = 0;
+
+        /* Negative handles are ignored */
+        if (fdArray[i].fd == INVALID_SOCKET) continue;
+
+        Socket = WsSockGetSocket(fdArray[i].fd);
+        if (!Socket)
+        {
+            fdArray[i].revents = POLLNVAL;
+            Count++;
+            continue;
+        }
+
+        /* Keep the first socket for the provider call */
+        if (!FirstSocket)
+            FirstSocket = Socket;
+        else
+            WsSockDereference(Socket);
+
+        if (fdArray[i].events & POLLIN)
+            Sets[0]->fd_array[Sets[0]->fd_count++] = fdArray[i].fd;
+        if (fdArray[i].events & POLLOUT)
+            Sets[1]->fd_array[Sets[1]->fd_count++] = fdArray[i].fd;
+
+        /* The except set is how select reports a failed connect */
+        Sets[2]->fd_array[Sets[2]->fd_count++] = fdArray[i].fd;
+    }
+
+    if (!FirstSocket)
+    {
+        /* Nothing to wait for */
+        ErrorCode = NO_ERROR;
+        goto Quickie;
+    }
+
+    /* Don't wait when invalid handles already have something to report */
+    if (Count || timeout >= 0)
+    {
+        Timeout.tv_sec = Count ? 0 : timeout / 1000;
+        Timeout.tv_usec = Count ? 0 : (timeout % 1000) * 1000;
+    }
+
+    /* Make the call */
+    WSPSelect = FirstSocket->Provider->Service.lpWSPSelect;
+    Status = WSPSelect(0,
+                       Sets[0],
+                       Sets[1],
+                       Sets[2],
+                       (Count || timeout >= 0) ? &Timeout : NULL,
+                       &ErrorCode);
+
+    /* Deference the Socket Context */
+    WsSockDereference(FirstSocket);
+
+    if (Status == SOCKET_ERROR)
+    {
+        /* If everything seemed fine, then the WSP call failed itself */
+        if (ErrorCode == NO_ERROR)
+            ErrorCode = WSASYSCALLFAILURE;
+        goto Quickie;
+    }
+
+    /* Sort the results so that looking up each socket is cheap */
+    for (i = 0; i < 3; i++)
+    {
+        qsort(Sets[i]->fd_array, Sets[i]->fd_count, sizeof(SOCKET), WsCompareSockets);
+    }
+
+    for (i = 0; i < fds; i++)
+    {
+        if (fdArray[i].fd == INVALID_SOCKET || fdArray[i].revents) continue;
+
+        if (Sets[0]->fd_count && WsIsInSortedSet(Sets[0], fdArray[i].fd))
+            fdArray[i].revents |= fdArray[i].events & POLLIN;
+        if (Sets[1]->fd_count && WsIsInSortedSet(Sets[1], fdArray[i].fd))
+            fdArray[i].revents |= fdArray[i].events & POLLOUT;
+        if (Sets[2]->fd_count && WsIsInSortedSet(Sets[2], fdArray[i].fd))
+            fdArray[i].revents |= POLLERR;
+
+        if (fdArray[i].revents) Count++;
+    }
+
+    ErrorCode = NO_ERROR;
+
+Quickie:
+    for (i = 0; i < 3; i++)
+    {
+        if (Sets[i]) HeapFree(WsSockHeap, 0, Sets[i]);
+    }
+
+    if (ErrorCode != NO_ERROR)
+    {
+        SetLastError(ErrorCode);
+        return SOCKET_ERROR;
+    }
+
+    return Count;
+}
+
 /*
  * @unimplemented
  */
@@ -447,17 +447,82 @@ VfatMdlRead(
     OUT PIO_STATUS_BLOCK IoStatus,
     IN PDEVICE_OBJECT DeviceObject)
 {
+    PVFATFCB Fcb;
+    LARGE_INTEGER ReadLength, ReadEnd;
+    BOOLEAN Success = FALSE;
+
     DPRINT("VfatMdlRead\n");
 
-    UNREFERENCED_PARAMETER(FileObject);
-    UNREFERENCED_PARAMETER(FileOffset);
-    UNREFERENCED_PARAMETER(Length);
-    UNREFERENCED_PARAMETER(LockKey);
-    UNREFERENCED_PARAMETER(MdlChain);
-    UNREFERENCED_PARAMETER(IoStatus);
     UNREFERENCED_PARAMETER(DeviceObject);
 
-    return FALSE;
+    Fcb = (PVFATFCB)FileObject->FsContext;
+    if (Fcb == NULL || vfatFCBIsDirectory(Fcb) ||
+        BooleanFlagOn(Fcb->Flags, FCB_IS_PAGE_FILE))
+    {
+        return FALSE;
+    }
+
+    /* The cache map is set up by the first cached read, use the IRP path until then */
+    if (FileObject->PrivateCacheMap == NULL)
+    {
+        return FALSE;
+    }
+
+    if (Length == 0)
+    {
+        IoStatus->Status = STATUS_SUCCESS;
+        IoStatus->Information = 0;
+        return TRUE;
+    }
+
+    FsRtlEnterFileSystem();
+
+    if (!ExAcquireResourceSharedLite(&Fcb->MainResource, TRUE))
+    {
+        FsRtlExitFileSystem();
+        return FALSE;
+    }
+
+    ReadLength.QuadPart = Length;
+    if (FsRtlAreThereCurrentFileLocks(&Fcb->FileLock) &&
+        !FsRtlFastCheckLockForRead(&Fcb->FileLock, FileOffset, &ReadLength,
+                                   LockKey, FileObject, PsGetCurrentProcess()))
+    {
+        goto Cleanup;
+    }
+
+    if (FileOffset->QuadPart >= Fcb->RFCB.FileSize.QuadPart)
+    {
+        IoStatus->Status = STATUS_END_OF_FILE;
+        IoStatus->Information = 0;
+        Success = TRUE;
+        goto Cleanup;
+    }
+
+    ReadEnd.QuadPart = FileOffset->QuadPart + Length;
+    if (ReadEnd.QuadPart > Fcb->RFCB.FileSize.QuadPart)
+    {
+        Length = (ULONG)(Fcb->RFCB.FileSize.QuadPart - FileOffset->QuadPart);
+    }
+
+    _SEH2_TRY
+    {
+        CcMdlRead(FileObject, FileOffset, Length, MdlChain, IoStatus);
+        Success = TRUE;
+    }
+    _SEH2_EXCEPT(FsRtlIsNtstatusExpected(_SEH2_GetExceptionCode()) ?
+                                         EXCEPTION_EXECUTE_HANDLER :
+                                         EXCEPTION_CONTINUE_SEARCH)
+    {
+        Success = FALSE;
+    }
+    _SEH2_END;
+
+Cleanup:
+    ExReleaseResourceLite(&Fcb->MainResource);
+    FsRtlExitFileSystem();
+
+    return Success;
 }
 
 static FAST_IO_MDL_READ_COMPLETE VfatMdlReadComplete;
@@ -80,6 +80,10 @@ AfdGetInfo( PDEVICE_OBJECT DeviceObject, PIRP Irp,
          */
         if (FCB->SendIrp.InFlightRequest)
             InfoReq->Information.Ulong++;
+
+        /* So does a transmit that has left the queue */
+        if (FCB->ActiveTransmit)
+            InfoReq->Information.Ulong++;
         break;
 
         default:
@@ -367,6 +367,7 @@ AfdCreateSocket(PDEVICE_OBJECT DeviceObject, PIRP Irp,
 
     InitializeListHead( &FCB->DatagramList );
     InitializeListHead( &FCB->PendingConnections );
+    InitializeListHead( &FCB->PollSetMembers );
 
     AFD_DbgPrint(MID_TRACE,("%p: Checking command channel\n", FCB));
 
@@ -451,7 +452,17 @@ AfdCleanupSocket(PDEVICE_OBJECT DeviceObject, PIRP Irp,
         }
     }
 
+    /* A transmit that is being sent is no longer queued, and it holds
+     * a reference to the socket until its current send is done */
+    if (FCB->ActiveTransmit)
+    {
+        IoCancelIrp(FCB->ActiveTransmit);
+        if (FCB->TransmitIrp.InFlightRequest)
+            IoCancelIrp(FCB->TransmitIrp.InFlightRequest);
+    }
+
     KillSelectsForFCB( FCB->DeviceExt, FileObject, FALSE );
+    CleanupPollSets( FCB->DeviceExt, FCB );
 
     return UnlockAndMaybeComplete(FCB, STATUS_SUCCESS, Irp, 0);
 }
@@ -480,6 +491,7 @@ AfdCloseSocket(PDEVICE_OBJECT DeviceObject, PIRP Irp,
     InFlightRequest[2] = &FCB->SendIrp;
     InFlightRequest[3] = &FCB->ConnectIrp;
     InFlightRequest[4] = &FCB->DisconnectIrp;
+    InFlightRequest[5] = &FCB->TransmitIrp;
 
     /* Cancel our pending requests */
     for( i = 0; i < IN_FLIGHT_REQUESTS; i++ ) {
@@ -704,7 +716,8 @@ RetryDisconnectCompletion(PAFD_FCB FCB)
 {
     ASSERT(FCB->RemoteAddress);
 
-    if (IsListEmpty(&FCB->PendingIrpList[FUNCTION_SEND]) && !FCB->SendIrp.InFlightRequest && FCB->DisconnectPending)
+    if (IsListEmpty(&FCB->PendingIrpList[FUNCTION_SEND]) && !FCB->SendIrp.InFlightRequest &&
+        !FCB->ActiveTransmit && FCB->DisconnectPending)
     {
         /* Sends are done; fire off a TDI_DISCONNECT request */
         DoDisconnect(FCB);
@@ -814,7 +827,8 @@ AfdDisconnect(PDEVICE_OBJECT DeviceObject, PIRP Irp,
         Status = QueueUserModeIrp(FCB, Irp, FUNCTION_DISCONNECT);
         if (Status == STATUS_PENDING)
         {
-            if ((IsListEmpty(&FCB->PendingIrpList[FUNCTION_SEND]) && !FCB->SendIrp.InFlightRequest) ||
+            if ((IsListEmpty(&FCB->PendingIrpList[FUNCTION_SEND]) && !FCB->SendIrp.InFlightRequest &&
+                 !FCB->ActiveTransmit) ||
                 (FCB->DisconnectFlags & TDI_DISCONNECT_ABORT))
             {
                 /* Go ahead and execute the disconnect because we're ready for it */
@@ -981,6 +995,18 @@ AfdDispatch(PDEVICE_OBJECT DeviceObject, PIRP Irp)
         case IOCTL_AFD_SEND_DATAGRAM:
             return AfdPacketSocketWriteData( DeviceObject, Irp, IrpSp );
 
+        case IOCTL_AFD_TRANSMIT_FILE:
+            return AfdTransmitFile( DeviceObject, Irp, IrpSp );
+
+        case IOCTL_AFD_TRANSMIT_PACKETS:
+            return AfdTransmitPackets( DeviceObject, Irp, IrpSp );
+
+        case IOCTL_AFD_POLL_SET_UPDATE:
+            return AfdPollSetUpdate( DeviceObject, Irp, IrpSp );
+
+        case IOCTL_AFD_POLL_SET_WAIT:
+            return AfdPollSetWait( DeviceObject, Irp, IrpSp );
+
         case IOCTL_AFD_GET_INFO:
             return AfdGetInfo( DeviceObject, Irp, IrpSp );
 
@@ -1168,6 +1194,10 @@ CleanupPendingIrp(PAFD_FCB FCB, PIRP Irp, PIO_STACK_LOCATION IrpSp, PAFD_ACTIVE_
             SendReq = GetLockedData(Irp, IrpSp);
             UnlockBuffers(SendReq->BufferArray, SendReq->BufferCount, CheckUnlockExtraBuffers(FCB, IrpSp));
         }
+        else if (IsTransmitIrp(Irp))
+        {
+            CleanupTransmitIrp(Irp);
+        }
         else if (IrpSp->Parameters.DeviceIoControl.IoControlCode == IOCTL_AFD_SELECT)
         {
             ASSERT(Poll);
@@ -1228,6 +1258,8 @@ AfdCancelHandler(PDEVICE_OBJECT DeviceObject,
 
         case IOCTL_AFD_SEND:
         case IOCTL_AFD_SEND_DATAGRAM:
+        case IOCTL_AFD_TRANSMIT_FILE:
+        case IOCTL_AFD_TRANSMIT_PACKETS:
             Function = FUNCTION_SEND;
             break;
 
@@ -1267,6 +1299,11 @@ AfdCancelHandler(PDEVICE_OBJECT DeviceObject,
             DbgPrint("WARNING!!! IRP cancellation race could lead to a process hang! (IOCTL_AFD_SELECT)\n");
             return;
 
+        case IOCTL_AFD_POLL_SET_WAIT:
+            CancelPollSetWait(DeviceExt, FCB, Irp);
+            SocketStateUnlock(FCB);
+            return;
+
         case IOCTL_AFD_DISCONNECT:
             Function = FUNCTION_DISCONNECT;
             break;
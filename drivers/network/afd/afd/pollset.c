@@ -0,0 +1,516 @@
+/*
+ * PROJECT:     ReactOS Ancillary Function Driver
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Persistent poll sets
+ */
+
+#include "afd.h"
+
+/*
+ * Any AFD handle can own a poll set, msafd uses a handle without a
+ * transport for it. Sockets are added once with IOCTL_AFD_POLL_SET_UPDATE
+ * and IOCTL_AFD_POLL_SET_WAIT returns the ones that are ready. A member
+ * stays on the ready list for as long as a wait finds it ready, which
+ * gives the same level triggered behaviour as select.
+ */
+
+static
+PAFD_POLL_SET_MEMBER
+FindMember(PAFD_FCB FCB, PAFD_POLL_SET Set)
+{
+    PLIST_ENTRY CurrentEntry;
+    PAFD_POLL_SET_MEMBER Member;
+
+    for (CurrentEntry = FCB->PollSetMembers.Flink;
+         CurrentEntry != &FCB->PollSetMembers;
+         CurrentEntry = CurrentEntry->Flink)
+    {
+        Member = CONTAINING_RECORD(CurrentEntry, AFD_POLL_SET_MEMBER, SocketEntry);
+        if (Member->Set == Set)
+            return Member;
+    }
+
+    return NULL;
+}
+
+static
+VOID
+RemoveMember(PAFD_POLL_SET_MEMBER Member)
+{
+    RemoveEntryList(&Member->SetEntry);
+    RemoveEntryList(&Member->SocketEntry);
+    if (Member->Ready)
+        RemoveEntryList(&Member->ReadyEntry);
+
+    ExFreePoolWithTag(Member, TAG_AFD_POLL_SET);
+}
+
+static
+ULONG
+HarvestEvents(PAFD_POLL_SET Set, PAFD_POLL_SET_WAIT_INFO WaitInfo, ULONG MaxEvents)
+{
+    LIST_ENTRY Reported;
+    PLIST_ENTRY CurrentEntry;
+    PAFD_POLL_SET_MEMBER Member;
+    PAFD_FCB FCB;
+    ULONG Events, Count = 0;
+
+    InitializeListHead(&Reported);
+
+    while (!IsListEmpty(&Set->ReadyList) && Count < MaxEvents)
+    {
+        CurrentEntry = RemoveHeadList(&Set->ReadyList);
+        Member = CONTAINING_RECORD(CurrentEntry, AFD_POLL_SET_MEMBER, ReadyEntry);
+        FCB = Member->FileObject->FsContext;
+
+        Events = Member->Events & FCB->PollState;
+        if (!Events)
+        {
+            /* Not ready any more, the next state change queues it again */
+            Member->Ready = FALSE;
+            continue;
+        }
+
+        WaitInfo->Events[Count].Handle = Member->Handle;
+        WaitInfo->Events[Count].Events = Events;
+        WaitInfo->Events[Count].Context = Member->Context;
+        Count++;
+
+        InsertTailList(&Reported, CurrentEntry);
+    }
+
+    /* Reported members go behind the others so that every ready socket gets its turn */
+    while (!IsListEmpty(&Reported))
+    {
+        CurrentEntry = RemoveHeadList(&Reported);
+        InsertTailList(&Set->ReadyList, CurrentEntry);
+    }
+
+    return Count;
+}
+
+static
+VOID
+CompleteWait(PAFD_ACTIVE_POLL_SET_WAIT Wait, ULONG Count, NTSTATUS Status)
+{
+    PIRP Irp = Wait->Irp;
+    PAFD_POLL_SET_WAIT_INFO WaitInfo = Irp->AssociatedIrp.SystemBuffer;
+
+    KeCancelTimer(&Wait->Timer);
+    RemoveEntryList(&Wait->ListEntry);
+    ExFreePoolWithTag(Wait, TAG_AFD_POLL_SET);
+
+    WaitInfo->EventCount = Count;
+    Irp->IoStatus.Status = Status;
+    Irp->IoStatus.Information = FIELD_OFFSET(AFD_POLL_SET_WAIT_INFO, Events[Count]);
+    (void)IoSetCancelRoutine(Irp, NULL);
+    IoCompleteRequest(Irp, IO_NETWORK_INCREMENT);
+}
+
+static
+VOID
+SignalPollSet(PAFD_POLL_SET Set)
+{
+    PAFD_ACTIVE_POLL_SET_WAIT Wait;
+    ULONG Count;
+
+    while (!IsListEmpty(&Set->Waits) && !IsListEmpty(&Set->ReadyList))
+    {
+        Wait = CONTAINING_RECORD(Set->Waits.Flink, AFD_ACTIVE_POLL_SET_WAIT, ListEntry);
+
+        Count = HarvestEvents(Set, Wait->Irp->AssociatedIrp.SystemBuffer, Wait->MaxEvents);
+        if (!Count)
+            break;
+
+        CompleteWait(Wait, Count, STATUS_SUCCESS);
+    }
+}
+
+static
+VOID
+QueueMember(PAFD_POLL_SET_MEMBER Member)
+{
+    PAFD_FCB FCB = Member->FileObject->FsContext;
+
+    if (!(Member->Events & FCB->PollState))
+        return;
+
+    if (!Member->Ready)
+    {
+        Member->Ready = TRUE;
+        InsertTailList(&Member->Set->ReadyList, &Member->ReadyEntry);
+    }
+
+    SignalPollSet(Member->Set);
+}
+
+/* * * NOTE ALWAYS CALLED AT DISPATCH_LEVEL * * */
+VOID PollSetReeval( PAFD_FCB FCB ) {
+    PLIST_ENTRY CurrentEntry;
+    PAFD_POLL_SET_MEMBER Member;
+
+    ASSERT( KeGetCurrentIrql() == DISPATCH_LEVEL );
+
+    /* Completing a wait doesn't change the memberships of this socket */
+    for (CurrentEntry = FCB->PollSetMembers.Flink;
+         CurrentEntry != &FCB->PollSetMembers;
+         CurrentEntry = CurrentEntry->Flink)
+    {
+        Member = CONTAINING_RECORD(CurrentEntry, AFD_POLL_SET_MEMBER, SocketEntry);
+        QueueMember(Member);
+    }
+}
+
+static KDEFERRED_ROUTINE PollSetWaitTimeout;
+static VOID NTAPI PollSetWaitTimeout( PKDPC Dpc,
+                                      PVOID DeferredContext,
+                                      PVOID SystemArgument1,
+                                      PVOID SystemArgument2 ) {
+    PAFD_ACTIVE_POLL_SET_WAIT Wait = DeferredContext;
+    PAFD_DEVICE_EXTENSION DeviceExt = Wait->DeviceExt;
+
+    UNREFERENCED_PARAMETER(Dpc);
+    UNREFERENCED_PARAMETER(SystemArgument1);
+    UNREFERENCED_PARAMETER(SystemArgument2);
+
+    KeAcquireSpinLockAtDpcLevel( &DeviceExt->Lock );
+    CompleteWait( Wait, 0, STATUS_TIMEOUT );
+    KeReleaseSpinLockFromDpcLevel( &DeviceExt->Lock );
+}
+
+static
+PAFD_POLL_SET
+ReferencePollSet(PAFD_DEVICE_EXTENSION DeviceExt, PAFD_FCB FCB)
+{
+    PAFD_POLL_SET Set;
+    KIRQL OldIrql;
+
+    if (FCB->PollSet)
+        return FCB->PollSet;
+
+    Set = ExAllocatePoolWithTag(NonPagedPool, sizeof(*Set), TAG_AFD_POLL_SET);
+    if (!Set)
+        return NULL;
+
+    InitializeListHead(&Set->Members);
+    InitializeListHead(&Set->ReadyList);
+    InitializeListHead(&Set->Waits);
+
+    /* Another thread may have been faster */
+    KeAcquireSpinLock(&DeviceExt->Lock, &OldIrql);
+    if (!FCB->PollSet && !FCB->PollSetsClosed)
+    {
+        FCB->PollSet = Set;
+        Set = NULL;
+    }
+    KeReleaseSpinLock(&DeviceExt->Lock, OldIrql);
+
+    if (Set)
+        ExFreePoolWithTag(Set, TAG_AFD_POLL_SET);
+
+    return FCB->PollSet;
+}
+
+static
+NTSTATUS
+UpdateEntry(PDEVICE_OBJECT DeviceObject, PIRP Irp, PFILE_OBJECT SetObject,
+            PAFD_POLL_SET Set, PAFD_POLL_SET_ENTRY Entry)
+{
+    PAFD_DEVICE_EXTENSION DeviceExt = DeviceObject->DeviceExtension;
+    PAFD_POLL_SET_MEMBER Member, NewMember = NULL;
+    PFILE_OBJECT FileObject;
+    PAFD_FCB FCB;
+    KIRQL OldIrql;
+    NTSTATUS Status;
+
+    Status = ObReferenceObjectByHandle((HANDLE)Entry->Handle,
+                                       0,
+                                       *IoFileObjectType,
+                                       Irp->RequestorMode,
+                                       (PVOID*)&FileObject,
+                                       NULL);
+    if (!NT_SUCCESS(Status))
+        return Status;
+
+    /* Only sockets, and not the set itself */
+    if (FileObject->DeviceObject != DeviceObject ||
+        !FileObject->FsContext ||
+        FileObject == SetObject)
+    {
+        ObDereferenceObject(FileObject);
+        return STATUS_INVALID_HANDLE;
+    }
+
+    if (Entry->Operation == AFD_POLL_SET_ADD)
+    {
+        NewMember = ExAllocatePoolWithTag(NonPagedPool, sizeof(*NewMember), TAG_AFD_POLL_SET);
+        if (!NewMember)
+        {
+            ObDereferenceObject(FileObject);
+            return STATUS_NO_MEMORY;
+        }
+    }
+
+    FCB = FileObject->FsContext;
+
+    KeAcquireSpinLock(&DeviceExt->Lock, &OldIrql);
+
+    Member = FindMember(FCB, Set);
+
+    if (FCB->PollSetsClosed)
+    {
+        /* The handle was closed after we looked it up */
+        Status = STATUS_INVALID_HANDLE;
+    }
+    else switch (Entry->Operation)
+    {
+        case AFD_POLL_SET_ADD:
+            if (Member)
+            {
+                Status = STATUS_OBJECT_NAME_COLLISION;
+                break;
+            }
+
+            Member = NewMember;
+            NewMember = NULL;
+
+            Member->Ready = FALSE;
+            Member->Set = Set;
+            Member->FileObject = FileObject;
+            Member->Handle = Entry->Handle;
+            Member->Events = Entry->Events;
+            Member->Context = Entry->Context;
+            InsertTailList(&Set->Members, &Member->SetEntry);
+            InsertTailList(&FCB->PollSetMembers, &Member->SocketEntry);
+
+            QueueMember(Member);
+            break;
+
+        case AFD_POLL_SET_MODIFY:
+            if (!Member)
+            {
+                Status = STATUS_NOT_FOUND;
+                break;
+            }
+
+            Member->Events = Entry->Events;
+            Member->Context = Entry->Context;
+
+            QueueMember(Member);
+            break;
+
+        case AFD_POLL_SET_REMOVE:
+            if (!Member)
+            {
+                Status = STATUS_NOT_FOUND;
+                break;
+            }
+
+            RemoveMember(Member);
+            break;
+
+        default:
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+    }
+
+    KeReleaseSpinLock(&DeviceExt->Lock, OldIrql);
+
+    if (NewMember)
+        ExFreePoolWithTag(NewMember, TAG_AFD_POLL_SET);
+
+    /* The member doesn't keep a reference, the socket removes it on cleanup */
+    ObDereferenceObject(FileObject);
+
+    return Status;
+}
+
+NTSTATUS NTAPI
+AfdPollSetUpdate( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+                  PIO_STACK_LOCATION IrpSp ) {
+    PAFD_POLL_SET_UPDATE_INFO UpdateReq = Irp->AssociatedIrp.SystemBuffer;
+    PAFD_DEVICE_EXTENSION DeviceExt = DeviceObject->DeviceExtension;
+    PFILE_OBJECT FileObject = IrpSp->FileObject;
+    PAFD_FCB FCB = FileObject->FsContext;
+    ULONG InputLength = IrpSp->Parameters.DeviceIoControl.InputBufferLength;
+    ULONG OutputLength = IrpSp->Parameters.DeviceIoControl.OutputBufferLength;
+    PAFD_POLL_SET Set;
+    NTSTATUS Status = STATUS_SUCCESS;
+    ULONG i;
+
+    AFD_DbgPrint(MID_TRACE,("Called (FCB %p)\n", FCB));
+
+    if (InputLength < FIELD_OFFSET(AFD_POLL_SET_UPDATE_INFO, Entries) ||
+        UpdateReq->EntryCount > (InputLength - FIELD_OFFSET(AFD_POLL_SET_UPDATE_INFO, Entries)) /
+                                sizeof(AFD_POLL_SET_ENTRY))
+    {
+        Status = STATUS_INVALID_PARAMETER;
+    }
+    else if (!(Set = ReferencePollSet(DeviceExt, FCB)))
+    {
+        Status = FCB->PollSetsClosed ? STATUS_FILE_CLOSED : STATUS_NO_MEMORY;
+    }
+    else
+    {
+        /* Every entry gets its own status, one bad handle doesn't fail the rest */
+        for (i = 0; i < UpdateReq->EntryCount; i++)
+        {
+            UpdateReq->Entries[i].Status =
+                UpdateEntry(DeviceObject, Irp, FileObject, Set, &UpdateReq->Entries[i]);
+        }
+    }
+
+    AFD_DbgPrint(MID_TRACE,("Returning %x\n", Status));
+
+    Irp->IoStatus.Status = Status;
+    Irp->IoStatus.Information = NT_SUCCESS(Status) ? min(InputLength, OutputLength) : 0;
+    IoCompleteRequest(Irp, IO_NETWORK_INCREMENT);
+
+    return Status;
+}
+
+NTSTATUS NTAPI
+AfdPollSetWait( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+                PIO_STACK_LOCATION IrpSp ) {
+    PAFD_POLL_SET_WAIT_INFO WaitReq = Irp->AssociatedIrp.SystemBuffer;
+    PAFD_DEVICE_EXTENSION DeviceExt = DeviceObject->DeviceExtension;
+    PAFD_FCB FCB = IrpSp->FileObject->FsContext;
+    ULONG InputLength = IrpSp->Parameters.DeviceIoControl.InputBufferLength;
+    ULONG OutputLength = IrpSp->Parameters.DeviceIoControl.OutputBufferLength;
+    PAFD_ACTIVE_POLL_SET_WAIT Wait;
+    PAFD_POLL_SET Set;
+    ULONG MaxEvents, Count;
+    KIRQL OldIrql;
+    NTSTATUS Status;
+
+    if (InputLength < FIELD_OFFSET(AFD_POLL_SET_WAIT_INFO, Events) ||
+        OutputLength < FIELD_OFFSET(AFD_POLL_SET_WAIT_INFO, Events[1]))
+    {
+        Irp->IoStatus.Status = STATUS_INVALID_PARAMETER;
+        Irp->IoStatus.Information = 0;
+        IoCompleteRequest(Irp, IO_NETWORK_INCREMENT);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    MaxEvents = (OutputLength - FIELD_OFFSET(AFD_POLL_SET_WAIT_INFO, Events)) / sizeof(AFD_POLL_SET_EVENT);
+    MaxEvents = min(MaxEvents, WaitReq->EventCount);
+
+    AFD_DbgPrint(MID_TRACE,("Called (FCB %p MaxEvents %u Timeout %d)\n",
+                            FCB, MaxEvents, (INT)(WaitReq->Timeout.QuadPart)));
+
+    Set = ReferencePollSet(DeviceExt, FCB);
+    Wait = ExAllocatePoolWithTag(NonPagedPool, sizeof(*Wait), TAG_AFD_POLL_SET);
+    if (!Set || !Wait || !MaxEvents)
+    {
+        if (Wait)
+            ExFreePoolWithTag(Wait, TAG_AFD_POLL_SET);
+
+        Status = !MaxEvents ? STATUS_INVALID_PARAMETER :
+                 FCB->PollSetsClosed ? STATUS_FILE_CLOSED : STATUS_NO_MEMORY;
+        Irp->IoStatus.Status = Status;
+        Irp->IoStatus.Information = 0;
+        IoCompleteRequest(Irp, IO_NETWORK_INCREMENT);
+        return Status;
+    }
+
+    KeAcquireSpinLock(&DeviceExt->Lock, &OldIrql);
+
+    Count = HarvestEvents(Set, WaitReq, MaxEvents);
+    if (Count || WaitReq->Timeout.QuadPart == 0)
+    {
+        KeReleaseSpinLock(&DeviceExt->Lock, OldIrql);
+        ExFreePoolWithTag(Wait, TAG_AFD_POLL_SET);
+
+        Status = Count ? STATUS_SUCCESS : STATUS_TIMEOUT;
+        WaitReq->EventCount = Count;
+        Irp->IoStatus.Status = Status;
+        Irp->IoStatus.Information = FIELD_OFFSET(AFD_POLL_SET_WAIT_INFO, Events[Count]);
+        IoCompleteRequest(Irp, IO_NETWORK_INCREMENT);
+        return Status;
+    }
+
+    Wait->Irp = Irp;
+    Wait->DeviceExt = DeviceExt;
+    Wait->MaxEvents = MaxEvents;
+    KeInitializeTimerEx(&Wait->Timer, NotificationTimer);
+    KeInitializeDpc(&Wait->TimeoutDpc, PollSetWaitTimeout, Wait);
+
+    InsertTailList(&Set->Waits, &Wait->ListEntry);
+    KeSetTimer(&Wait->Timer, WaitReq->Timeout, &Wait->TimeoutDpc);
+
+    IoMarkIrpPending(Irp);
+    (void)IoSetCancelRoutine(Irp, AfdCancelHandler);
+
+    /* The cancel routine can't run before we release the lock */
+    if (Irp->Cancel && IoSetCancelRoutine(Irp, NULL))
+        CompleteWait(Wait, 0, STATUS_CANCELLED);
+
+    KeReleaseSpinLock(&DeviceExt->Lock, OldIrql);
+
+    return STATUS_PENDING;
+}
+
+VOID CancelPollSetWait( PAFD_DEVICE_EXTENSION DeviceExt, PAFD_FCB FCB, PIRP Irp ) {
+    PLIST_ENTRY CurrentEntry;
+    PAFD_ACTIVE_POLL_SET_WAIT Wait;
+    KIRQL OldIrql;
+
+    KeAcquireSpinLock(&DeviceExt->Lock, &OldIrql);
+
+    if (FCB->PollSet)
+    {
+        for (CurrentEntry = FCB->PollSet->Waits.Flink;
+             CurrentEntry != &FCB->PollSet->Waits;
+             CurrentEntry = CurrentEntry->Flink)
+        {
+            Wait = CONTAINING_RECORD(CurrentEntry, AFD_ACTIVE_POLL_SET_WAIT, ListEntry);
+            if (Wait->Irp == Irp)
+            {
+                CompleteWait(Wait, 0, STATUS_CANCELLED);
+                break;
+            }
+        }
+    }
+
+    KeReleaseSpinLock(&DeviceExt->Lock, OldIrql);
+}
+
+VOID CleanupPollSets( PAFD_DEVICE_EXTENSION DeviceExt, PAFD_FCB FCB ) {
+    PAFD_POLL_SET Set;
+    PAFD_ACTIVE_POLL_SET_WAIT Wait;
+    KIRQL OldIrql;
+
+    KeAcquireSpinLock(&DeviceExt->Lock, &OldIrql);
+
+    /* No set can add this socket any more */
+    FCB->PollSetsClosed = TRUE;
+
+    while (!IsListEmpty(&FCB->PollSetMembers))
+    {
+        RemoveMember(CONTAINING_RECORD(FCB->PollSetMembers.Flink,
+                                       AFD_POLL_SET_MEMBER, SocketEntry));
+    }
+
+    Set = FCB->PollSet;
+    FCB->PollSet = NULL;
+
+    if (Set)
+    {
+        while (!IsListEmpty(&Set->Waits))
+        {
+            Wait = CONTAINING_RECORD(Set->Waits.Flink, AFD_ACTIVE_POLL_SET_WAIT, ListEntry);
+            CompleteWait(Wait, 0, STATUS_CANCELLED);
+        }
+
+        while (!IsListEmpty(&Set->Members))
+        {
+            RemoveMember(CONTAINING_RECORD(Set->Members.Flink,
+                                           AFD_POLL_SET_MEMBER, SetEntry));
+        }
+    }
+
+    KeReleaseSpinLock(&DeviceExt->Lock, OldIrql);
+
+    if (Set)
+        ExFreePoolWithTag(Set, TAG_AFD_POLL_SET);
+}
@@ -440,6 +440,9 @@ VOID PollReeval( PAFD_DEVICE_EXTENSION DeviceExt, PFILE_OBJECT FileObject ) {
             ThePollEnt = ThePollEnt->Flink;
     }
 
+    /* And the poll sets this socket is a member of */
+    PollSetReeval( FCB );
+
     KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
 
     if((FCB->EventSelect) &&
@@ -973,6 +973,57 @@ NTSTATUS TdiSend(
     return STATUS_PENDING;
 }
 
+NTSTATUS TdiSendMdl(
+    PIRP *Irp,
+    PFILE_OBJECT TransportObject,
+    USHORT Flags,
+    PMDL Mdl,
+    UINT BufferLength,
+    PIO_COMPLETION_ROUTINE CompletionRoutine,
+    PVOID CompletionContext)
+/*
+ * FUNCTION: Sends data that is already described by a locked MDL
+ * NOTES:
+ *     The IRP isn't associated with a thread and the MDL stays owned
+ *     by the caller, so the completion routine has to return
+ *     STATUS_MORE_PROCESSING_REQUIRED and the caller frees the IRP
+ */
+{
+    PDEVICE_OBJECT DeviceObject;
+
+    ASSERT(*Irp == NULL);
+
+    if (!TransportObject) {
+        AFD_DbgPrint(MIN_TRACE, ("Bad transport object.\n"));
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    DeviceObject = IoGetRelatedDeviceObject(TransportObject);
+    if (!DeviceObject) {
+        AFD_DbgPrint(MIN_TRACE, ("Bad device object.\n"));
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    *Irp = IoAllocateIrp(DeviceObject->StackSize, FALSE);
+    if (!*Irp) {
+        AFD_DbgPrint(MIN_TRACE, ("Insufficient resources.\n"));
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    TdiBuildSend(*Irp,                   /* I/O Request Packet */
+                 DeviceObject,           /* Device object */
+                 TransportObject,        /* File object */
+                 CompletionRoutine,      /* Completion routine */
+                 CompletionContext,      /* Completion context */
+                 Mdl,                    /* Data buffer */
+                 Flags,                  /* Flags */
+                 BufferLength);          /* Length of data */
+
+    TdiCall(*Irp, DeviceObject, NULL, NULL);
+
+    return STATUS_PENDING;
+}
+
 NTSTATUS TdiReceive(
     PIRP *Irp,
     PFILE_OBJECT TransportObject,
@@ -0,0 +1,733 @@
+/*
+ * PROJECT:     ReactOS Ancillary Function Driver
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     TransmitFile and TransmitPackets
+ */
+
+#include "afd.h"
+
+/*
+ * A transmit request is queued on the send list of the socket like any other
+ * send, so it keeps its place in the stream. Once all data in front of it is
+ * out, it is taken off the list and a work item sends its elements. Sends
+ * that come in meanwhile wait behind it.
+ *
+ * File data is taken from the cache manager as MDLs (fast I/O MdlRead) and
+ * memory elements are locked in place, so the MDLs are given to the
+ * transport as they are instead of being copied into the send window.
+ * Files that don't support MDL reads are read into a nonpaged buffer.
+ */
+
+BOOLEAN
+IsTransmitIrp(PIRP Irp)
+{
+    PIO_STACK_LOCATION IrpSp = IoGetCurrentIrpStackLocation(Irp);
+
+    return IrpSp->MajorFunction == IRP_MJ_DEVICE_CONTROL &&
+           (IrpSp->Parameters.DeviceIoControl.IoControlCode == IOCTL_AFD_TRANSMIT_FILE ||
+            IrpSp->Parameters.DeviceIoControl.IoControlCode == IOCTL_AFD_TRANSMIT_PACKETS);
+}
+
+BOOLEAN
+IsTransmitQueued(PAFD_FCB FCB)
+{
+    PLIST_ENTRY CurrentEntry;
+
+    for (CurrentEntry = FCB->PendingIrpList[FUNCTION_SEND].Flink;
+         CurrentEntry != &FCB->PendingIrpList[FUNCTION_SEND];
+         CurrentEntry = CurrentEntry->Flink)
+    {
+        if (IsTransmitIrp(CONTAINING_RECORD(CurrentEntry, IRP, Tail.Overlay.ListEntry)))
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+static
+VOID
+FreeTransmit(PAFD_TRANSMIT Transmit)
+{
+    PAFD_TRANSMIT_ELEMENT Element;
+    ULONG i;
+
+    for (i = 0; i < Transmit->ElementCount; i++)
+    {
+        Element = &Transmit->Elements[i];
+
+        if (Element->Mdl)
+        {
+            MmUnlockPages(Element->Mdl);
+            IoFreeMdl(Element->Mdl);
+        }
+
+        if (Element->FileObject)
+            ObDereferenceObject(Element->FileObject);
+    }
+
+    if (Transmit->WorkItem)
+        IoFreeWorkItem(Transmit->WorkItem);
+
+    ExFreePoolWithTag(Transmit, TAG_AFD_TRANSMIT);
+}
+
+VOID
+CleanupTransmitIrp(PIRP Irp)
+{
+    PAFD_TRANSMIT Transmit = Irp->Tail.Overlay.DriverContext[0];
+
+    ASSERT(Transmit);
+
+    Irp->Tail.Overlay.DriverContext[0] = NULL;
+    FreeTransmit(Transmit);
+}
+
+static
+PAFD_TRANSMIT
+AllocateTransmit(PDEVICE_OBJECT DeviceObject, ULONG ElementCount, ULONG Flags, ULONG SendSize)
+{
+    PAFD_TRANSMIT Transmit;
+    SIZE_T Size;
+
+    Size = FIELD_OFFSET(AFD_TRANSMIT, Elements[ElementCount]);
+    Transmit = ExAllocatePoolWithTag(NonPagedPool, Size, TAG_AFD_TRANSMIT);
+    if (!Transmit)
+        return NULL;
+
+    RtlZeroMemory(Transmit, Size);
+
+    Transmit->WorkItem = IoAllocateWorkItem(DeviceObject);
+    if (!Transmit->WorkItem)
+    {
+        ExFreePoolWithTag(Transmit, TAG_AFD_TRANSMIT);
+        return NULL;
+    }
+
+    KeInitializeEvent(&Transmit->SendEvent, NotificationEvent, FALSE);
+    Transmit->Flags = Flags;
+    Transmit->SendSize = SendSize;
+
+    return Transmit;
+}
+
+static
+NTSTATUS
+AddMemoryElement(PAFD_TRANSMIT Transmit, PVOID Buffer, ULONG Length, ULONG Flags, KPROCESSOR_MODE LockMode)
+{
+    PAFD_TRANSMIT_ELEMENT Element;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    if (!Length)
+        return STATUS_SUCCESS;
+
+    Element = &Transmit->Elements[Transmit->ElementCount];
+    Element->Mdl = IoAllocateMdl(Buffer, Length, FALSE, FALSE, NULL);
+    if (!Element->Mdl)
+        return STATUS_NO_MEMORY;
+
+    _SEH2_TRY
+    {
+        MmProbeAndLockPages(Element->Mdl, LockMode, IoReadAccess);
+    }
+    _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+    {
+        Status = STATUS_ACCESS_VIOLATION;
+    }
+    _SEH2_END;
+
+    if (!NT_SUCCESS(Status))
+    {
+        IoFreeMdl(Element->Mdl);
+        Element->Mdl = NULL;
+        return Status;
+    }
+
+    Element->Flags = Flags | AFD_TP_ELEMENT_MEMORY;
+    Element->Length = Length;
+    Transmit->ElementCount++;
+
+    return STATUS_SUCCESS;
+}
+
+static
+NTSTATUS
+AddFileElement(PAFD_TRANSMIT Transmit, HANDLE FileHandle, PLARGE_INTEGER FileOffset,
+               ULONG Length, ULONG Flags, KPROCESSOR_MODE LockMode)
+{
+    PAFD_TRANSMIT_ELEMENT Element;
+    NTSTATUS Status;
+
+    /* -1 means the current position of the file */
+    if (FileOffset->QuadPart < -1)
+        return STATUS_INVALID_PARAMETER;
+
+    Element = &Transmit->Elements[Transmit->ElementCount];
+    Status = ObReferenceObjectByHandle(FileHandle,
+                                       FILE_READ_DATA,
+                                       *IoFileObjectType,
+                                       LockMode,
+                                       (PVOID*)&Element->FileObject,
+                                       NULL);
+    if (!NT_SUCCESS(Status))
+    {
+        Element->FileObject = NULL;
+        return Status;
+    }
+
+    Element->Flags = Flags | AFD_TP_ELEMENT_FILE;
+    Element->Length = Length;
+    Element->FileOffset = *FileOffset;
+    if (FileOffset->QuadPart == -1)
+        Element->FileOffset = Element->FileObject->CurrentByteOffset;
+    Transmit->ElementCount++;
+
+    return STATUS_SUCCESS;
+}
+
+static IO_COMPLETION_ROUTINE TransmitSendComplete;
+static
+NTSTATUS
+NTAPI
+TransmitSendComplete(PDEVICE_OBJECT DeviceObject,
+                     PIRP Irp,
+                     PVOID Context)
+{
+    PAFD_TRANSMIT Transmit = Context;
+
+    UNREFERENCED_PARAMETER(DeviceObject);
+    UNREFERENCED_PARAMETER(Irp);
+
+    /* The worker frees the IRP, the MDL belongs to it */
+    KeSetEvent(&Transmit->SendEvent, IO_NETWORK_INCREMENT, FALSE);
+    return STATUS_MORE_PROCESSING_REQUIRED;
+}
+
+static
+NTSTATUS
+CheckTransmitState(PAFD_FCB FCB, PIRP Irp)
+{
+    if (Irp->Cancel)
+        return STATUS_CANCELLED;
+
+    if (FCB->State != SOCKET_STATE_CONNECTED)
+        return STATUS_INVALID_CONNECTION;
+
+    if (FCB->PollState & (AFD_EVENT_CLOSE | AFD_EVENT_ABORT))
+        return FCB->PollStatus[FD_CLOSE_BIT];
+
+    return STATUS_SUCCESS;
+}
+
+static
+NTSTATUS
+TransmitMdl(PAFD_FCB FCB, PIRP Irp, PAFD_TRANSMIT Transmit,
+            PMDL Mdl, ULONG Offset, ULONG Length)
+{
+    PIRP SendIrp;
+    PMDL SendMdl;
+    PCHAR Va;
+    ULONG BytesSent;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    while (Length)
+    {
+        /* Describe what is left with a partial MDL */
+        SendMdl = Mdl;
+        if (Offset != 0 || Length != MmGetMdlByteCount(Mdl))
+        {
+            Va = (PCHAR)MmGetMdlVirtualAddress(Mdl) + Offset;
+            SendMdl = IoAllocateMdl(Va, Length, FALSE, FALSE, NULL);
+            if (!SendMdl)
+                return STATUS_NO_MEMORY;
+
+            IoBuildPartialMdl(Mdl, SendMdl, Va, Length);
+        }
+
+        if (!SocketAcquireStateLock(FCB))
+        {
+            Status = STATUS_FILE_CLOSED;
+        }
+        else
+        {
+            Status = CheckTransmitState(FCB, Irp);
+            if (NT_SUCCESS(Status))
+            {
+                KeClearEvent(&Transmit->SendEvent);
+                Status = TdiSendMdl(&FCB->TransmitIrp.InFlightRequest,
+                                    FCB->Connection.Object,
+                                    0,
+                                    SendMdl,
+                                    Length,
+                                    TransmitSendComplete,
+                                    Transmit);
+            }
+            SocketStateUnlock(FCB);
+        }
+
+        BytesSent = 0;
+        if (Status == STATUS_PENDING)
+        {
+            KeWaitForSingleObject(&Transmit->SendEvent, Executive, KernelMode, FALSE, NULL);
+
+            SocketAcquireStateLock(FCB);
+            SendIrp = FCB->TransmitIrp.InFlightRequest;
+            FCB->TransmitIrp.InFlightRequest = NULL;
+            SocketStateUnlock(FCB);
+
+            Status = SendIrp->IoStatus.Status;
+            BytesSent = (ULONG)SendIrp->IoStatus.Information;
+            SendIrp->MdlAddress = NULL;
+            IoFreeIrp(SendIrp);
+
+            /* Don't loop forever on a transport that takes nothing */
+            if (NT_SUCCESS(Status) && BytesSent == 0)
+                Status = STATUS_CONNECTION_ABORTED;
+        }
+
+        if (SendMdl != Mdl)
+        {
+            MmPrepareMdlForReuse(SendMdl);
+            IoFreeMdl(SendMdl);
+        }
+
+        if (!NT_SUCCESS(Status))
+            break;
+
+        Transmit->BytesSent += BytesSent;
+        Offset += BytesSent;
+        Length -= min(BytesSent, Length);
+    }
+
+    return Status;
+}
+
+static
+NTSTATUS
+TransmitMemoryElement(PAFD_FCB FCB, PIRP Irp, PAFD_TRANSMIT Transmit,
+                      PAFD_TRANSMIT_ELEMENT Element)
+{
+    ULONG Offset, Length;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    /* Without a send size the whole element goes in one request */
+    for (Offset = 0; Offset < Element->Length; Offset += Length)
+    {
+        Length = Element->Length - Offset;
+        if (Transmit->SendSize)
+            Length = min(Length, Transmit->SendSize);
+
+        Status = TransmitMdl(FCB, Irp, Transmit, Element->Mdl, Offset, Length);
+        if (!NT_SUCCESS(Status))
+            break;
+    }
+
+    return Status;
+}
+
+static
+NTSTATUS
+ReadFileChunk(PFILE_OBJECT FileObject, PLARGE_INTEGER FileOffset,
+              PVOID Buffer, ULONG Length, PULONG BytesRead)
+{
+    PDEVICE_OBJECT DeviceObject = IoGetRelatedDeviceObject(FileObject);
+    IO_STATUS_BLOCK IoStatus;
+    KEVENT Event;
+    PIRP Irp;
+    NTSTATUS Status;
+
+    KeInitializeEvent(&Event, NotificationEvent, FALSE);
+
+    Irp = IoBuildSynchronousFsdRequest(IRP_MJ_READ,
+                                       DeviceObject,
+                                       Buffer,
+                                       Length,
+                                       FileOffset,
+                                       &Event,
+                                       &IoStatus);
+    if (!Irp)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    IoGetNextIrpStackLocation(Irp)->FileObject = FileObject;
+
+    Status = IoCallDriver(DeviceObject, Irp);
+    if (Status == STATUS_PENDING)
+    {
+        KeWaitForSingleObject(&Event, Executive, KernelMode, FALSE, NULL);
+        Status = IoStatus.Status;
+    }
+
+    *BytesRead = NT_SUCCESS(Status) ? (ULONG)IoStatus.Information : 0;
+    return Status;
+}
+
+static
+NTSTATUS
+TransmitFileElement(PAFD_FCB FCB, PIRP Irp, PAFD_TRANSMIT Transmit,
+                    PAFD_TRANSMIT_ELEMENT Element)
+{
+    PFILE_OBJECT FileObject = Element->FileObject;
+    PDEVICE_OBJECT DeviceObject = IoGetRelatedDeviceObject(FileObject);
+    PFAST_IO_DISPATCH FastIoDispatch = DeviceObject->DriverObject->FastIoDispatch;
+    LARGE_INTEGER FileOffset = Element->FileOffset;
+    ULONG Remaining = Element->Length, ChunkSize, ReadLength, BytesRead;
+    BOOLEAN ToEnd = (Element->Length == 0);
+    IO_STATUS_BLOCK IoStatus;
+    PMDL MdlChain, Mdl, BufferMdl = NULL;
+    PVOID Buffer = NULL;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    ChunkSize = Transmit->SendSize ? min(Transmit->SendSize, AFD_TRANSMIT_CHUNK_SIZE)
+                                   : AFD_TRANSMIT_CHUNK_SIZE;
+
+    while (ToEnd || Remaining)
+    {
+        ReadLength = ToEnd ? ChunkSize : min(Remaining, ChunkSize);
+        BytesRead = 0;
+
+        MdlChain = NULL;
+        if (FastIoDispatch && FastIoDispatch->MdlRead &&
+            FastIoDispatch->MdlRead(FileObject, &FileOffset, ReadLength, 0,
+                                    &MdlChain, &IoStatus, DeviceObject))
+        {
+            /* The data stays in the cache, hand its pages to the transport */
+            Status = IoStatus.Status;
+            if (NT_SUCCESS(Status))
+            {
+                BytesRead = (ULONG)IoStatus.Information;
+
+                /* The transport only looks at the first MDL of a send */
+                for (Mdl = MdlChain; Mdl && NT_SUCCESS(Status); Mdl = Mdl->Next)
+                {
+                    Status = TransmitMdl(FCB, Irp, Transmit, Mdl, 0, MmGetMdlByteCount(Mdl));
+                }
+            }
+
+            if (MdlChain)
+                CcMdlReadComplete(FileObject, MdlChain);
+        }
+        else
+        {
+            /* A failed MDL read must not leave anything behind, but don't leak it if it did */
+            if (MdlChain)
+                CcMdlReadComplete(FileObject, MdlChain);
+
+            if (!Buffer)
+            {
+                Buffer = ExAllocatePoolWithTag(NonPagedPool, ChunkSize, TAG_AFD_TRANSMIT);
+                if (!Buffer)
+                {
+                    Status = STATUS_NO_MEMORY;
+                    break;
+                }
+
+                BufferMdl = IoAllocateMdl(Buffer, ChunkSize, FALSE, FALSE, NULL);
+                if (!BufferMdl)
+                {
+                    Status = STATUS_NO_MEMORY;
+                    break;
+                }
+
+                MmBuildMdlForNonPagedPool(BufferMdl);
+            }
+
+            Status = ReadFileChunk(FileObject, &FileOffset, Buffer, ReadLength, &BytesRead);
+            if (NT_SUCCESS(Status) && BytesRead)
+                Status = TransmitMdl(FCB, Irp, Transmit, BufferMdl, 0, BytesRead);
+        }
+
+        /* Whatever is left of the file has been sent */
+        if (Status == STATUS_END_OF_FILE)
+        {
+            Status = STATUS_SUCCESS;
+            break;
+        }
+
+        if (!NT_SUCCESS(Status))
+            break;
+
+        FileOffset.QuadPart += BytesRead;
+        if (!ToEnd)
+            Remaining -= BytesRead;
+
+        if (BytesRead < ReadLength)
+            break;
+    }
+
+    if (BufferMdl)
+        IoFreeMdl(BufferMdl);
+
+    if (Buffer)
+        ExFreePoolWithTag(Buffer, TAG_AFD_TRANSMIT);
+
+    return Status;
+}
+
+static IO_WORKITEM_ROUTINE TransmitWorker;
+static
+VOID
+NTAPI
+TransmitWorker(PDEVICE_OBJECT DeviceObject, PVOID Context)
+{
+    PIRP Irp = Context;
+    PIO_STACK_LOCATION IrpSp = IoGetCurrentIrpStackLocation(Irp);
+    PAFD_FCB FCB = IrpSp->FileObject->FsContext;
+    PAFD_TRANSMIT Transmit = Irp->Tail.Overlay.DriverContext[0];
+    PAFD_TRANSMIT_ELEMENT Element;
+    NTSTATUS Status = STATUS_SUCCESS;
+    ULONG i;
+
+    UNREFERENCED_PARAMETER(DeviceObject);
+
+    for (i = 0; i < Transmit->ElementCount && NT_SUCCESS(Status); i++)
+    {
+        Element = &Transmit->Elements[i];
+
+        if (Element->Flags & AFD_TP_ELEMENT_MEMORY)
+            Status = TransmitMemoryElement(FCB, Irp, Transmit, Element);
+        else
+            Status = TransmitFileElement(FCB, Irp, Transmit, Element);
+    }
+
+    AFD_DbgPrint(MID_TRACE,("Transmit of %u elements done, status %x, %u bytes sent\n",
+                            Transmit->ElementCount, Status, Transmit->BytesSent));
+
+    /* The IRP keeps the socket file object referenced, so the FCB is still there */
+    SocketAcquireStateLock(FCB);
+
+    ASSERT(FCB->ActiveTransmit == Irp);
+    FCB->ActiveTransmit = NULL;
+
+    if (NT_SUCCESS(Status) &&
+        (Transmit->Flags & (AFD_TF_DISCONNECT | AFD_TF_REUSE_SOCKET)) &&
+        FCB->ConnectCallInfo && !FCB->DisconnectPending)
+    {
+        /* Close the send direction once everything queued so far is out */
+        FCB->DisconnectFlags = TDI_DISCONNECT_RELEASE;
+        FCB->DisconnectTimeout.QuadPart = -1;
+        FCB->DisconnectPending = TRUE;
+        FCB->SendClosed = TRUE;
+        FCB->PollState &= ~AFD_EVENT_SEND;
+    }
+
+    Irp->IoStatus.Status = Status;
+    Irp->IoStatus.Information = Transmit->BytesSent;
+    CleanupTransmitIrp(Irp);
+
+    /* Let the sends that waited behind us go */
+    ContinuePendingSends(FCB, FALSE);
+
+    SocketStateUnlock(FCB);
+
+    IoCompleteRequest(Irp, IO_NETWORK_INCREMENT);
+}
+
+VOID
+StartTransmit(PAFD_FCB FCB)
+{
+    PLIST_ENTRY NextIrpEntry;
+    PIRP Irp;
+    PAFD_TRANSMIT Transmit;
+
+    ASSERT(!FCB->ActiveTransmit);
+    ASSERT(!FCB->SendIrp.InFlightRequest && !FCB->Send.BytesUsed);
+
+    NextIrpEntry = RemoveHeadList(&FCB->PendingIrpList[FUNCTION_SEND]);
+    Irp = CONTAINING_RECORD(NextIrpEntry, IRP, Tail.Overlay.ListEntry);
+    ASSERT(IsTransmitIrp(Irp));
+
+    /* The worker checks the cancel flag between its sends from now on */
+    (void)IoSetCancelRoutine(Irp, NULL);
+
+    FCB->ActiveTransmit = Irp;
+    Transmit = Irp->Tail.Overlay.DriverContext[0];
+    IoQueueWorkItem(Transmit->WorkItem, TransmitWorker, DelayedWorkQueue, Irp);
+}
+
+static
+NTSTATUS
+QueueTransmit(PAFD_FCB FCB, PIRP Irp, PAFD_TRANSMIT Transmit)
+{
+    NTSTATUS Status;
+
+    Irp->Tail.Overlay.DriverContext[0] = Transmit;
+    Irp->Tail.Overlay.DriverContext[1] = NULL;
+
+    Status = QueueUserModeIrp(FCB, Irp, FUNCTION_SEND);
+    if (Status == STATUS_PENDING &&
+        !FCB->ActiveTransmit &&
+        !FCB->SendIrp.InFlightRequest &&
+        !FCB->Send.BytesUsed &&
+        FCB->PendingIrpList[FUNCTION_SEND].Flink == &Irp->Tail.Overlay.ListEntry)
+    {
+        /* Nothing in front of us */
+        StartTransmit(FCB);
+    }
+
+    SocketStateUnlock(FCB);
+
+    return Status;
+}
+
+static
+NTSTATUS
+CheckTransmitSocket(PAFD_FCB FCB)
+{
+    if (FCB->Flags & AFD_ENDPOINT_CONNECTIONLESS)
+        return STATUS_NOT_SUPPORTED;
+
+    if (FCB->PollState & (AFD_EVENT_CLOSE | AFD_EVENT_ABORT))
+        return FCB->PollStatus[FD_CLOSE_BIT];
+
+    if (FCB->SendClosed)
+        return STATUS_FILE_CLOSED;
+
+    if (FCB->State != SOCKET_STATE_CONNECTED)
+        return STATUS_INVALID_CONNECTION;
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS NTAPI
+AfdTransmitFile(PDEVICE_OBJECT DeviceObject, PIRP Irp,
+                PIO_STACK_LOCATION IrpSp)
+{
+    PFILE_OBJECT FileObject = IrpSp->FileObject;
+    PAFD_FCB FCB = FileObject->FsContext;
+    PAFD_TRANSMIT_FILE_INFO TransmitReq;
+    PAFD_TRANSMIT Transmit;
+    KPROCESSOR_MODE LockMode;
+    NTSTATUS Status;
+
+    AFD_DbgPrint(MID_TRACE,("Called on %p\n", FCB));
+
+    if (!SocketAcquireStateLock(FCB)) return LostSocket(Irp);
+
+    Status = CheckTransmitSocket(FCB);
+    if (!NT_SUCCESS(Status))
+        return UnlockAndMaybeComplete(FCB, Status, Irp, 0);
+
+    if (IrpSp->Parameters.DeviceIoControl.InputBufferLength < sizeof(*TransmitReq))
+        return UnlockAndMaybeComplete(FCB, STATUS_INVALID_PARAMETER, Irp, 0);
+
+    if (!(TransmitReq = LockRequest(Irp, IrpSp, FALSE, &LockMode)))
+        return UnlockAndMaybeComplete(FCB, STATUS_NO_MEMORY, Irp, 0);
+
+    /* Head, file and tail */
+    Transmit = AllocateTransmit(DeviceObject, 3, TransmitReq->Flags, TransmitReq->SendPacketLength);
+    if (!Transmit)
+        return UnlockAndMaybeComplete(FCB, STATUS_NO_MEMORY, Irp, 0);
+
+    Status = AddMemoryElement(Transmit, TransmitReq->Head.buf, TransmitReq->Head.len, 0, LockMode);
+
+    if (NT_SUCCESS(Status) && TransmitReq->FileHandle)
+    {
+        Status = AddFileElement(Transmit, TransmitReq->FileHandle, &TransmitReq->Offset,
+                                TransmitReq->WriteLength, 0, LockMode);
+    }
+
+    if (NT_SUCCESS(Status))
+        Status = AddMemoryElement(Transmit, TransmitReq->Tail.buf, TransmitReq->Tail.len, 0, LockMode);
+
+    UnlockRequest(Irp, IrpSp);
+
+    if (!NT_SUCCESS(Status))
+    {
+        FreeTransmit(Transmit);
+        return UnlockAndMaybeComplete(FCB, Status, Irp, 0);
+    }
+
+    return QueueTransmit(FCB, Irp, Transmit);
+}
+
+NTSTATUS NTAPI
+AfdTransmitPackets(PDEVICE_OBJECT DeviceObject, PIRP Irp,
+                   PIO_STACK_LOCATION IrpSp)
+{
+    PFILE_OBJECT FileObject = IrpSp->FileObject;
+    PAFD_FCB FCB = FileObject->FsContext;
+    PAFD_TRANSMIT_PACKETS_INFO TransmitReq;
+    AFD_TRANSMIT_PACKETS_ELEMENT UserElement;
+    PAFD_TRANSMIT Transmit;
+    KPROCESSOR_MODE LockMode;
+    NTSTATUS Status = STATUS_SUCCESS;
+    ULONG i;
+
+    AFD_DbgPrint(MID_TRACE,("Called on %p\n", FCB));
+
+    if (!SocketAcquireStateLock(FCB)) return LostSocket(Irp);
+
+    Status = CheckTransmitSocket(FCB);
+    if (!NT_SUCCESS(Status))
+        return UnlockAndMaybeComplete(FCB, Status, Irp, 0);
+
+    if (IrpSp->Parameters.DeviceIoControl.InputBufferLength < sizeof(*TransmitReq))
+        return UnlockAndMaybeComplete(FCB, STATUS_INVALID_PARAMETER, Irp, 0);
+
+    if (!(TransmitReq = LockRequest(Irp, IrpSp, FALSE, &LockMode)))
+        return UnlockAndMaybeComplete(FCB, STATUS_NO_MEMORY, Irp, 0);
+
+    if (TransmitReq->ElementCount > AFD_MAX_TRANSMIT_ELEMENTS)
+    {
+        UnlockRequest(Irp, IrpSp);
+        return UnlockAndMaybeComplete(FCB, STATUS_INVALID_PARAMETER, Irp, 0);
+    }
+
+    Transmit = AllocateTransmit(DeviceObject, max(TransmitReq->ElementCount, 1),
+                                TransmitReq->Flags, TransmitReq->SendSize);
+    if (!Transmit)
+    {
+        UnlockRequest(Irp, IrpSp);
+        return UnlockAndMaybeComplete(FCB, STATUS_NO_MEMORY, Irp, 0);
+    }
+
+    for (i = 0; i < TransmitReq->ElementCount && NT_SUCCESS(Status); i++)
+    {
+        /* Capture the element, the array is still in the caller's memory */
+        _SEH2_TRY
+        {
+            if (LockMode != KernelMode)
+            {
+                ProbeForRead(&TransmitReq->ElementArray[i],
+                             sizeof(AFD_TRANSMIT_PACKETS_ELEMENT),
+                             sizeof(ULONG));
+            }
+            UserElement = TransmitReq->ElementArray[i];
+        }
+        _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+        {
+            Status = STATUS_ACCESS_VIOLATION;
+        }
+        _SEH2_END;
+
+        if (!NT_SUCCESS(Status))
+            break;
+
+        switch (UserElement.Flags & (AFD_TP_ELEMENT_MEMORY | AFD_TP_ELEMENT_FILE))
+        {
+            case AFD_TP_ELEMENT_MEMORY:
+                Status = AddMemoryElement(Transmit, UserElement.Buffer, UserElement.Length,
+                                          UserElement.Flags & AFD_TP_ELEMENT_EOP, LockMode);
+                break;
+
+            case AFD_TP_ELEMENT_FILE:
+                Status = AddFileElement(Transmit, UserElement.FileHandle, &UserElement.FileOffset,
+                                        UserElement.Length, UserElement.Flags & AFD_TP_ELEMENT_EOP,
+                                        LockMode);
+                break;
+
+            default:
+                Status = STATUS_INVALID_PARAMETER;
+                break;
+        }
+    }
+
+    UnlockRequest(Irp, IrpSp);
+
+    if (!NT_SUCCESS(Status))
+    {
+        FreeTransmit(Transmit);
+        return UnlockAndMaybeComplete(FCB, Status, Irp, 0);
+    }
+
+    return QueueTransmit(FCB, Irp, Transmit);
+}
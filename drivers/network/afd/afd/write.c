@@ -22,8 +22,8 @@ static NTSTATUS NTAPI SendComplete
     PIO_STACK_LOCATION NextIrpSp;
     PAFD_SEND_INFO SendReq = NULL;
     PAFD_MAPBUF Map;
-    SIZE_T TotalBytesCopied = 0, TotalBytesProcessed = 0, SpaceAvail, i;
-    UINT SendLength, BytesCopied;
+    SIZE_T TotalBytesCopied = 0, TotalBytesProcessed = 0;
+    UINT SendLength;
     BOOLEAN HaltSendQueue;
 
     UNREFERENCED_PARAMETER(DeviceObject);
@@ -54,10 +54,14 @@ static NTSTATUS NTAPI SendComplete
             NextIrpEntry = RemoveHeadList(&FCB->PendingIrpList[FUNCTION_SEND]);
             NextIrp = CONTAINING_RECORD(NextIrpEntry, IRP, Tail.Overlay.ListEntry);
             NextIrpSp = IoGetCurrentIrpStackLocation( NextIrp );
-            SendReq = GetLockedData(NextIrp, NextIrpSp);
             NextIrp->IoStatus.Status = STATUS_FILE_CLOSED;
             NextIrp->IoStatus.Information = 0;
-            UnlockBuffers(SendReq->BufferArray, SendReq->BufferCount, FALSE);
+            if (IsTransmitIrp(NextIrp)) {
+                CleanupTransmitIrp(NextIrp);
+            } else {
+                SendReq = GetLockedData(NextIrp, NextIrpSp);
+                UnlockBuffers(SendReq->BufferArray, SendReq->BufferCount, FALSE);
+            }
             if( NextIrp->MdlAddress ) UnlockRequest( NextIrp, IoGetCurrentIrpStackLocation( NextIrp ) );
             (void)IoSetCancelRoutine(NextIrp, NULL);
             IoCompleteRequest( NextIrp, IO_NETWORK_INCREMENT );
@@ -78,11 +82,16 @@ static NTSTATUS NTAPI SendComplete
             NextIrp =
                 CONTAINING_RECORD(NextIrpEntry, IRP, Tail.Overlay.ListEntry);
             NextIrpSp = IoGetCurrentIrpStackLocation( NextIrp );
-            SendReq = GetLockedData(NextIrp, NextIrpSp);
 
-            UnlockBuffers( SendReq->BufferArray,
-                           SendReq->BufferCount,
-                           FALSE );
+            if (IsTransmitIrp(NextIrp)) {
+                CleanupTransmitIrp(NextIrp);
+            } else {
+                SendReq = GetLockedData(NextIrp, NextIrpSp);
+
+                UnlockBuffers( SendReq->BufferArray,
+                               SendReq->BufferCount,
+                               FALSE );
+            }
 
             NextIrp->IoStatus.Status = Status;
             NextIrp->IoStatus.Information = 0;
@@ -156,7 +165,32 @@ static NTSTATUS NTAPI SendComplete
 
     ASSERT(SendLength == 0);
 
-   if ( !HaltSendQueue && !IsListEmpty( &FCB->PendingIrpList[FUNCTION_SEND] ) ) {
+    ContinuePendingSends(FCB, HaltSendQueue);
+
+    SocketStateUnlock( FCB );
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+ContinuePendingSends(PAFD_FCB FCB, BOOLEAN HaltSendQueue)
+{
+    PLIST_ENTRY NextIrpEntry;
+    PIRP NextIrp;
+    PIO_STACK_LOCATION NextIrpSp;
+    PAFD_SEND_INFO SendReq;
+    PAFD_MAPBUF Map;
+    SIZE_T TotalBytesCopied, SpaceAvail, i;
+    UINT SendLength, BytesCopied;
+    BOOLEAN TransmitNext = FALSE;
+
+    /* A transmit request at the head sends its data itself once the window is empty */
+    if ( !IsListEmpty( &FCB->PendingIrpList[FUNCTION_SEND] ) ) {
+        NextIrp = CONTAINING_RECORD(FCB->PendingIrpList[FUNCTION_SEND].Flink, IRP, Tail.Overlay.ListEntry);
+        TransmitNext = IsTransmitIrp(NextIrp);
+    }
+
+   if ( !HaltSendQueue && !TransmitNext && !IsListEmpty( &FCB->PendingIrpList[FUNCTION_SEND] ) ) {
         NextIrpEntry = FCB->PendingIrpList[FUNCTION_SEND].Flink;
         NextIrp = CONTAINING_RECORD(NextIrpEntry, IRP, Tail.Overlay.ListEntry);
         NextIrpSp = IoGetCurrentIrpStackLocation( NextIrp );
@@ -238,23 +272,24 @@ static NTSTATUS NTAPI SendComplete
     /* Some data is still waiting */
     if( FCB->Send.BytesUsed )
     {
-        Status = TdiSend( &FCB->SendIrp.InFlightRequest,
-                          FCB->Connection.Object,
-                          0,
-                          FCB->Send.Window,
-                          FCB->Send.BytesUsed,
-                          SendComplete,
-                          FCB );
+        TdiSend( &FCB->SendIrp.InFlightRequest,
+                 FCB->Connection.Object,
+                 0,
+                 FCB->Send.Window,
+                 FCB->Send.BytesUsed,
+                 SendComplete,
+                 FCB );
+    }
+    else if( TransmitNext )
+    {
+        /* The data before the transmit request is out */
+        StartTransmit(FCB);
     }
     else
     {
         /* Nothing is waiting so try to complete a pending disconnect */
         RetryDisconnectCompletion(FCB);
     }
-
-    SocketStateUnlock( FCB );
-
-    return STATUS_SUCCESS;
 }
 
 static IO_COMPLETION_ROUTINE PacketSocketSendComplete;
@@ -457,6 +492,12 @@ AfdConnectedSocketWriteData(PDEVICE_OBJECT DeviceObject, PIRP Irp,
         return UnlockAndMaybeComplete( FCB, STATUS_INVALID_CONNECTION, Irp, 0 );
     }
 
+    /* Sends behind a transmit request must not overtake its data */
+    if (FCB->ActiveTransmit || IsTransmitQueued(FCB))
+    {
+        return LeaveIrpUntilLater(FCB, Irp, FUNCTION_SEND);
+    }
+
     AFD_DbgPrint(MID_TRACE,("FCB->Send.BytesUsed = %u\n",
                             FCB->Send.BytesUsed));
 
@@ -52,6 +52,8 @@
 #define TAG_AFD_SNMP_ADDRESS_INFO          'asfA'
 #define TAG_AFD_TDI_CONNECTION_INFORMATION 'cTfA'
 #define TAG_AFD_WSA_BUFFER                 'bWfA'
+#define TAG_AFD_TRANSMIT                   'mTfA'
+#define TAG_AFD_POLL_SET                   'spfA'
 
 typedef struct IPADDR_ENTRY {
 	ULONG  Addr;
@@ -90,7 +92,11 @@ typedef struct IPADDR_ENTRY {
 #define FUNCTION_CLOSE                  6
 #define MAX_FUNCTIONS                   7
 
-#define IN_FLIGHT_REQUESTS              5
+#define IN_FLIGHT_REQUESTS              6
+
+/* File data of a transmit request is read and sent in chunks of this size */
+#define AFD_TRANSMIT_CHUNK_SIZE         0x10000
+#define AFD_MAX_TRANSMIT_ELEMENTS       0x10000
 
 #define EXTRA_LOCK_BUFFERS              2 /* Number of extra buffers needed
 					   * for ancillary data on packet
@@ -123,6 +129,37 @@ typedef struct _AFD_ACTIVE_POLL {
     BOOLEAN Exclusive;
 } AFD_ACTIVE_POLL, *PAFD_ACTIVE_POLL;
 
+/* A poll set keeps its sockets registered between waits. A socket whose
+ * state changes queues its membership on the ready list of the set, so a
+ * wait only looks at the sockets that changed. Everything below is
+ * protected by the device extension lock. */
+typedef struct _AFD_POLL_SET {
+    LIST_ENTRY Members;
+    LIST_ENTRY ReadyList;
+    LIST_ENTRY Waits;
+} AFD_POLL_SET, *PAFD_POLL_SET;
+
+typedef struct _AFD_POLL_SET_MEMBER {
+    LIST_ENTRY SetEntry;
+    LIST_ENTRY SocketEntry;
+    LIST_ENTRY ReadyEntry;
+    BOOLEAN Ready;
+    PAFD_POLL_SET Set;
+    PFILE_OBJECT FileObject;
+    SOCKET Handle;
+    ULONG Events;
+    ULONG_PTR Context;
+} AFD_POLL_SET_MEMBER, *PAFD_POLL_SET_MEMBER;
+
+typedef struct _AFD_ACTIVE_POLL_SET_WAIT {
+    LIST_ENTRY ListEntry;
+    PIRP Irp;
+    PAFD_DEVICE_EXTENSION DeviceExt;
+    ULONG MaxEvents;
+    KDPC TimeoutDpc;
+    KTIMER Timer;
+} AFD_ACTIVE_POLL_SET_WAIT, *PAFD_ACTIVE_POLL_SET_WAIT;
+
 typedef struct _IRP_LIST {
     LIST_ENTRY ListEntry;
     PIRP Irp;
@@ -151,6 +188,24 @@ typedef struct _AFD_DATA_WINDOW {
     UINT BytesUsed, Size, Content;
 } AFD_DATA_WINDOW, *PAFD_DATA_WINDOW;
 
+typedef struct _AFD_TRANSMIT_ELEMENT {
+    ULONG Flags;
+    ULONG Length; /* Zero for a file means up to its end */
+    LARGE_INTEGER FileOffset;
+    PFILE_OBJECT FileObject;
+    PMDL Mdl;
+} AFD_TRANSMIT_ELEMENT, *PAFD_TRANSMIT_ELEMENT;
+
+typedef struct _AFD_TRANSMIT {
+    PIO_WORKITEM WorkItem;
+    KEVENT SendEvent;
+    ULONG Flags;
+    ULONG SendSize;
+    ULONG BytesSent;
+    ULONG ElementCount;
+    AFD_TRANSMIT_ELEMENT Elements[1];
+} AFD_TRANSMIT, *PAFD_TRANSMIT;
+
 typedef struct _AFD_STORED_DATAGRAM {
     LIST_ENTRY ListEntry;
     UINT Len;
@@ -174,7 +229,8 @@ typedef struct _AFD_FCB {
     PTRANSPORT_ADDRESS LocalAddress, RemoteAddress;
     PTDI_CONNECTION_INFORMATION AddressFrom, ConnectCallInfo, ConnectReturnInfo;
     AFD_TDI_OBJECT AddressFile, Connection;
-    AFD_IN_FLIGHT_REQUEST ConnectIrp, ListenIrp, ReceiveIrp, SendIrp, DisconnectIrp;
+    AFD_IN_FLIGHT_REQUEST ConnectIrp, ListenIrp, ReceiveIrp, SendIrp, DisconnectIrp, TransmitIrp;
+    PIRP ActiveTransmit;
     AFD_DATA_WINDOW Send, Recv;
     KMUTEX Mutex;
     PKEVENT EventSelect;
@@ -184,6 +240,9 @@ typedef struct _AFD_FCB {
     PVOID Context;
     DWORD PollState;
     NTSTATUS PollStatus[FD_MAX_EVENTS];
+    PAFD_POLL_SET PollSet;
+    LIST_ENTRY PollSetMembers;
+    BOOLEAN PollSetsClosed;
     NTSTATUS LastReceiveStatus;
     UINT ContextSize;
     PVOID ConnectData;
@@ -305,6 +364,18 @@ DRIVER_CANCEL AfdCancelHandler;
 VOID RetryDisconnectCompletion(PAFD_FCB FCB);
 BOOLEAN CheckUnlockExtraBuffers(PAFD_FCB FCB, PIO_STACK_LOCATION IrpSp);
 
+/* pollset.c */
+
+NTSTATUS NTAPI
+AfdPollSetUpdate( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+                  PIO_STACK_LOCATION IrpSp );
+NTSTATUS NTAPI
+AfdPollSetWait( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+                PIO_STACK_LOCATION IrpSp );
+VOID PollSetReeval( PAFD_FCB FCB );
+VOID CancelPollSetWait( PAFD_DEVICE_EXTENSION DeviceExt, PAFD_FCB FCB, PIRP Irp );
+VOID CleanupPollSets( PAFD_DEVICE_EXTENSION DeviceExt, PAFD_FCB FCB );
+
 /* read.c */
 
 IO_COMPLETION_ROUTINE ReceiveComplete;
@@ -402,6 +473,28 @@ NTSTATUS TdiQueryMaxDatagramLength(
         PFILE_OBJECT FileObject,
         PUINT MaxDatagramLength);
 
+NTSTATUS TdiSendMdl
+( PIRP *Irp,
+  PFILE_OBJECT ConnectionObject,
+  USHORT Flags,
+  PMDL Mdl,
+  UINT BufferLength,
+  PIO_COMPLETION_ROUTINE  CompletionRoutine,
+  PVOID CompletionContext);
+
+/* transmit.c */
+
+NTSTATUS NTAPI
+AfdTransmitFile(PDEVICE_OBJECT DeviceObject, PIRP Irp,
+                PIO_STACK_LOCATION IrpSp);
+NTSTATUS NTAPI
+AfdTransmitPackets(PDEVICE_OBJECT DeviceObject, PIRP Irp,
+                   PIO_STACK_LOCATION IrpSp);
+BOOLEAN IsTransmitIrp(PIRP Irp);
+BOOLEAN IsTransmitQueued(PAFD_FCB FCB);
+VOID StartTransmit(PAFD_FCB FCB);
+VOID CleanupTransmitIrp(PIRP Irp);
+
 /* write.c */
 
 NTSTATUS NTAPI
@@ -410,5 +503,6 @@ AfdConnectedSocketWriteData(PDEVICE_OBJECT DeviceObject, PIRP Irp,
 NTSTATUS NTAPI
 AfdPacketSocketWriteData(PDEVICE_OBJECT DeviceObject, PIRP Irp,
 			 PIO_STACK_LOCATION IrpSp);
+VOID ContinuePendingSends(PAFD_FCB FCB, BOOLEAN HaltSendQueue);
 
 #endif /* _AFD_H */
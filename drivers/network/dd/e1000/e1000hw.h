@@ -57,10 +57,15 @@ typedef enum _E1000_RCVBUF_SIZE
 /* 3.2.3 Receive Descriptor Format */
 
 #define E1000_RDESC_STATUS_PIF          (1 << 7)    /* Passed in-exact filter */
+#define E1000_RDESC_STATUS_IPCS         (1 << 6)    /* IP Checksum Calculated on Packet */
+#define E1000_RDESC_STATUS_TCPCS        (1 << 5)    /* TCP Checksum Calculated on Packet */
 #define E1000_RDESC_STATUS_IXSM         (1 << 2)    /* Ignore Checksum Indication */
 #define E1000_RDESC_STATUS_EOP          (1 << 1)    /* End of Packet */
 #define E1000_RDESC_STATUS_DD           (1 << 0)    /* Descriptor Done */
 
+#define E1000_RDESC_ERROR_IPE           (1 << 6)    /* IP Checksum Error */
+#define E1000_RDESC_ERROR_TCPE          (1 << 5)    /* TCP/UDP Checksum Error */
+
 typedef struct _E1000_RECEIVE_DESCRIPTOR
 {
     UINT64 Address;
@@ -96,11 +101,67 @@ typedef struct _E1000_TRANSMIT_DESCRIPTOR
 
 } E1000_TRANSMIT_DESCRIPTOR, *PE1000_TRANSMIT_DESCRIPTOR;
 
+
+/* 3.3.6 TCP/IP Context Transmit Descriptor Format */
+
+#define E1000_TDESC_LENGTH_MASK         0x000FFFFF
+#define E1000_TDESC_DTYP_CONTEXT        (0 << 20)   /* Descriptor Type: Context */
+#define E1000_TDESC_DTYP_DATA           (1 << 20)   /* Descriptor Type: Data */
+
+#define E1000_TDESC_TUCMD_TCP           (1 << 24)   /* Packet Type is TCP (instead of UDP) */
+#define E1000_TDESC_TUCMD_IP            (1 << 25)   /* Packet Type is IPv4 */
+#define E1000_TDESC_TUCMD_TSE           (1 << 26)   /* TCP Segmentation Enable */
+#define E1000_TDESC_TUCMD_RS            (1 << 27)   /* Report Status */
+#define E1000_TDESC_TUCMD_DEXT          (1 << 29)   /* Descriptor Extension */
+#define E1000_TDESC_TUCMD_IDE           (1 << 31)   /* Interrupt Delay Enable */
+
+typedef struct _E1000_CONTEXT_DESCRIPTOR
+{
+    UCHAR IpChecksumStart;
+    UCHAR IpChecksumOffset;
+    USHORT IpChecksumEnd;
+    UCHAR TcpChecksumStart;
+    UCHAR TcpChecksumOffset;
+    USHORT TcpChecksumEnd;
+
+    ULONG LengthAndCommand;
+    UCHAR Status;
+    UCHAR HeaderLength;
+    USHORT MaximumSegmentSize;
+
+} E1000_CONTEXT_DESCRIPTOR, *PE1000_CONTEXT_DESCRIPTOR;
+
+
+/* 3.3.7 TCP/IP Data Transmit Descriptor Format */
+
+#define E1000_TDESC_DCMD_EOP            (1 << 24)   /* End Of Packet */
+#define E1000_TDESC_DCMD_IFCS           (1 << 25)   /* Insert FCS */
+#define E1000_TDESC_DCMD_TSE            (1 << 26)   /* TCP Segmentation Enable */
+#define E1000_TDESC_DCMD_RS             (1 << 27)   /* Report Status */
+#define E1000_TDESC_DCMD_DEXT           (1 << 29)   /* Descriptor Extension */
+#define E1000_TDESC_DCMD_IDE            (1 << 31)   /* Interrupt Delay Enable */
+
+#define E1000_TDESC_POPTS_IXSM          (1 << 0)    /* Insert IP Checksum */
+#define E1000_TDESC_POPTS_TXSM          (1 << 1)    /* Insert TCP/UDP Checksum */
+
+typedef struct _E1000_DATA_DESCRIPTOR
+{
+    UINT64 Address;
+
+    ULONG LengthAndCommand;
+    UCHAR Status;
+    UCHAR Options;
+    USHORT Special;
+
+} E1000_DATA_DESCRIPTOR, *PE1000_DATA_DESCRIPTOR;
+
 #include <poppack.h>
 
 
 C_ASSERT(sizeof(E1000_RECEIVE_DESCRIPTOR) == 16);
 C_ASSERT(sizeof(E1000_TRANSMIT_DESCRIPTOR) == 16);
+C_ASSERT(sizeof(E1000_CONTEXT_DESCRIPTOR) == 16);
+C_ASSERT(sizeof(E1000_DATA_DESCRIPTOR) == 16);
 
 
 /* Valid Range: 80-256 for 82542 and 82543 gigabit ethernet controllers
@@ -108,6 +169,9 @@ C_ASSERT(sizeof(E1000_TRANSMIT_DESCRIPTOR) == 16);
 #define NUM_TRANSMIT_DESCRIPTORS        128
 #define NUM_RECEIVE_DESCRIPTORS         128
 
+/* Buffers lent to the protocols are replaced from the spare ones */
+#define NUM_RECEIVE_BUFFERS             (NUM_RECEIVE_DESCRIPTORS * 2)
+
 
 
 /* Registers */
@@ -143,6 +207,8 @@ C_ASSERT(sizeof(E1000_TRANSMIT_DESCRIPTOR) == 16);
 #define E1000_REG_TADV              0x382C      /* Transmit Absolute Delay Timer, R/W */
 
 
+#define E1000_REG_RXCSUM            0x5000      /* Receive Checksum Control, R/W */
+
 #define E1000_REG_RAL               0x5400      /* Receive Address Low, R/W */
 #define E1000_REG_RAH               0x5404      /* Receive Address High, R/W */
 
@@ -190,7 +256,7 @@ C_ASSERT(sizeof(E1000_TRANSMIT_DESCRIPTOR) == 16);
 
 /* E1000_REG_ITR */
 #define MAX_INTS_PER_SEC        2000
-#define DEFAULT_ITR             1000000000/(MAX_INTS_PER_SEC * 256)
+#define DEFAULT_ITR             (1000000000 / (MAX_INTS_PER_SEC * 256))
 
 
 /* E1000_REG_RCTL */
@@ -217,6 +283,11 @@ C_ASSERT(sizeof(E1000_TRANSMIT_DESCRIPTOR) == 16);
 #define E1000_TIPG_IPGR2_DEF        (10 << 20)  /* IPG Receive Time 2 */
 
 
+/* E1000_REG_RXCSUM */
+#define E1000_RXCSUM_IPOFL          (1 << 8)    /* IP Checksum Off-load Enable */
+#define E1000_RXCSUM_TUOFL          (1 << 9)    /* TCP/UDP Checksum Off-load Enable */
+
+
 /* E1000_REG_RAH */
 #define E1000_RAH_AV                (1 << 31)   /* Address Valid */
 
@@ -53,6 +53,35 @@ static USHORT SupportedDevices[] =
     0x10B5,     // Intel 82546GB Quad Copper KSP3
 };
 
+static ULONG DeviceIdToCapabilities(USHORT DeviceID)
+{
+    switch (DeviceID)
+    {
+    case 0x1000:    // Intel 82542
+        return 0;
+
+    case 0x1001:    // Intel 82543GC Fiber
+    case 0x1004:    // Intel 82543GC Copper
+        return E1000_CAPABILITY_CHECKSUM_OFFLOAD;
+
+    case 0x1008:    // Intel 82544EI Copper
+    case 0x1009:    // Intel 82544EI Fiber
+    case 0x100C:    // Intel 82544GC Copper
+    case 0x100D:    // Intel 82544GC LOM (LAN on Motherboard)
+        /* No interrupt throttling before the 82540 */
+        return E1000_CAPABILITY_CHECKSUM_OFFLOAD | E1000_CAPABILITY_LARGE_SEND;
+
+    case 0x1019:    // Intel 82547EI
+    case 0x101A:    // Intel 82547EI Mobile
+        /* TCP segmentation is broken on the 82547EI */
+        return E1000_CAPABILITY_CHECKSUM_OFFLOAD | E1000_CAPABILITY_INTERRUPT_THROTTLING;
+
+    default:
+        return E1000_CAPABILITY_CHECKSUM_OFFLOAD | E1000_CAPABILITY_LARGE_SEND |
+               E1000_CAPABILITY_INTERRUPT_THROTTLING;
+    }
+}
+
 static ULONG PacketFilterToMask(ULONG PacketFilter)
 {
     ULONG FilterMask = 0;
@@ -227,6 +256,7 @@ NICRecognizeHardware(
     {
         if (SupportedDevices[n] == Adapter->DeviceID)
         {
+            Adapter->Capabilities = DeviceIdToCapabilities(Adapter->DeviceID);
             return TRUE;
         }
     }
@@ -365,7 +395,7 @@ NICAllocateIoResources(
     Adapter->ReceiveBufferEntrySize = AllocationSize;
 
     NdisMAllocateSharedMemory(Adapter->AdapterHandle,
-                              Adapter->ReceiveBufferEntrySize * NUM_RECEIVE_DESCRIPTORS,
+                              Adapter->ReceiveBufferEntrySize * NUM_RECEIVE_BUFFERS,
                               FALSE,
                               (PVOID*)&Adapter->ReceiveBuffer,
                               &Adapter->ReceiveBufferPa);
@@ -376,6 +406,12 @@ NICAllocateIoResources(
         return NDIS_STATUS_RESOURCES;
     }
 
+    Status = NICAllocateReceivePackets(Adapter);
+    if (Status != NDIS_STATUS_SUCCESS)
+    {
+        return Status;
+    }
+
     for (n = 0; n < NUM_RECEIVE_DESCRIPTORS; ++n)
     {
         PE1000_RECEIVE_DESCRIPTOR Descriptor = Adapter->ReceiveDescriptors + n;
@@ -453,10 +489,12 @@ NICReleaseIoResources(
         Adapter->ReceiveDescriptors = NULL;
     }
 
+    NICFreeReceivePackets(Adapter);
+
     if (Adapter->ReceiveBuffer != NULL)
     {
         NdisMFreeSharedMemory(Adapter->AdapterHandle,
-                              Adapter->ReceiveBufferEntrySize * NUM_RECEIVE_DESCRIPTORS,
+                              Adapter->ReceiveBufferEntrySize * NUM_RECEIVE_BUFFERS,
                               FALSE,
                               Adapter->ReceiveBuffer,
                               Adapter->ReceiveBufferPa);
@@ -593,6 +631,7 @@ NICEnableTxRx(
     E1000WriteUlong(Adapter, E1000_REG_TDH, 0);
     E1000WriteUlong(Adapter, E1000_REG_TDT, 0);
     Adapter->CurrentTxDesc = 0;
+    Adapter->LastTxDesc = 0;
 
     /* Set up interrupt timers */
     E1000WriteUlong(Adapter, E1000_REG_TADV, 96); // value is in 1.024 of usec
@@ -622,6 +661,14 @@ NICEnableTxRx(
     E1000WriteUlong(Adapter, E1000_REG_RADV, 96);
     E1000WriteUlong(Adapter, E1000_REG_RDTR, 16);
 
+    /* Cap the interrupt rate on top of the delay timers */
+    if (Adapter->Capabilities & E1000_CAPABILITY_INTERRUPT_THROTTLING)
+    {
+        E1000WriteUlong(Adapter, E1000_REG_ITR, DEFAULT_ITR);
+    }
+
+    NICApplyChecksumOffload(Adapter);
+
     /* Some defaults */
     Value = E1000_RCTL_SECRC | E1000_RCTL_EN;
 
@@ -733,6 +780,30 @@ NICApplyPacketFilter(
     return NDIS_STATUS_SUCCESS;
 }
 
+NDIS_STATUS
+NTAPI
+NICApplyChecksumOffload(
+    IN PE1000_ADAPTER Adapter)
+{
+    ULONG Value;
+
+    if (!(Adapter->Capabilities & E1000_CAPABILITY_CHECKSUM_OFFLOAD))
+    {
+        return NDIS_STATUS_SUCCESS;
+    }
+
+    E1000ReadUlong(Adapter, E1000_REG_RXCSUM, &Value);
+
+    Value &= ~(E1000_RXCSUM_IPOFL | E1000_RXCSUM_TUOFL);
+    if (Adapter->ChecksumOffload.V4Receive.IpChecksum)
+        Value |= E1000_RXCSUM_IPOFL;
+    if (Adapter->ChecksumOffload.V4Receive.TcpChecksum || Adapter->ChecksumOffload.V4Receive.UdpChecksum)
+        Value |= E1000_RXCSUM_TUOFL;
+    E1000WriteUlong(Adapter, E1000_REG_RXCSUM, Value);
+
+    return NDIS_STATUS_SUCCESS;
+}
+
 VOID
 NTAPI
 NICUpdateLinkStatus(
@@ -46,8 +46,16 @@ static NDIS_OID SupportedOidList[] =
     OID_GEN_RCV_NO_BUFFER,
 
     OID_PNP_CAPABILITIES,
+
+    /* Offload */
+    OID_TCP_TASK_OFFLOAD,
 };
 
+#define TASK_OFFLOAD_BUFFER_SIZE                                \
+    (sizeof(NDIS_TASK_OFFLOAD_HEADER) +                         \
+     FIELD_OFFSET(NDIS_TASK_OFFLOAD, TaskBuffer) + sizeof(NDIS_TASK_TCP_IP_CHECKSUM) + \
+     FIELD_OFFSET(NDIS_TASK_OFFLOAD, TaskBuffer) + sizeof(NDIS_TASK_TCP_LARGE_SEND))
+
 static
 ULONG64
 NICQueryStatisticCounter(
@@ -68,6 +76,159 @@ NICFillPowerManagementCapabilities(
     return NDIS_STATUS_NOT_SUPPORTED;
 }
 
+static
+NDIS_STATUS
+NICFillTaskOffload(
+    _In_ PE1000_ADAPTER Adapter,
+    _In_ PNDIS_TASK_OFFLOAD_HEADER Request,
+    _Out_writes_bytes_(TASK_OFFLOAD_BUFFER_SIZE) PUCHAR Buffer,
+    _Out_ PULONG Length)
+{
+    PNDIS_TASK_OFFLOAD_HEADER Header = (PNDIS_TASK_OFFLOAD_HEADER)Buffer;
+    PNDIS_TASK_OFFLOAD Task;
+    PNDIS_TASK_TCP_IP_CHECKSUM Checksum;
+    PNDIS_TASK_TCP_LARGE_SEND LargeSend;
+
+    if (!(Adapter->Capabilities & E1000_CAPABILITY_CHECKSUM_OFFLOAD))
+    {
+        return NDIS_STATUS_NOT_SUPPORTED;
+    }
+
+    if (Request->Version != NDIS_TASK_OFFLOAD_VERSION ||
+        Request->Size != sizeof(NDIS_TASK_OFFLOAD_HEADER) ||
+        Request->EncapsulationFormat.Encapsulation != IEEE_802_3_Encapsulation)
+    {
+        NDIS_DbgPrint(MIN_TRACE, ("Unsupported task offload request\n"));
+        return NDIS_STATUS_NOT_SUPPORTED;
+    }
+
+    NdisZeroMemory(Buffer, TASK_OFFLOAD_BUFFER_SIZE);
+    *Header = *Request;
+    Header->OffsetFirstTask = sizeof(NDIS_TASK_OFFLOAD_HEADER);
+
+    /* IPv4 checksums both ways, the NIC parses IP and TCP options itself */
+    Task = (PNDIS_TASK_OFFLOAD)(Header + 1);
+    Task->Version = NDIS_TASK_OFFLOAD_VERSION;
+    Task->Size = sizeof(NDIS_TASK_OFFLOAD);
+    Task->Task = TcpIpChecksumNdisTask;
+    Task->TaskBufferLength = sizeof(NDIS_TASK_TCP_IP_CHECKSUM);
+
+    Checksum = (PNDIS_TASK_TCP_IP_CHECKSUM)Task->TaskBuffer;
+    Checksum->V4Transmit.IpOptionsSupported = 1;
+    Checksum->V4Transmit.TcpOptionsSupported = 1;
+    Checksum->V4Transmit.TcpChecksum = 1;
+    Checksum->V4Transmit.UdpChecksum = 1;
+    Checksum->V4Transmit.IpChecksum = 1;
+    Checksum->V4Receive.IpOptionsSupported = 1;
+    Checksum->V4Receive.TcpOptionsSupported = 1;
+    Checksum->V4Receive.TcpChecksum = 1;
+    Checksum->V4Receive.UdpChecksum = 1;
+    Checksum->V4Receive.IpChecksum = 1;
+
+    *Length = sizeof(NDIS_TASK_OFFLOAD_HEADER) + FIELD_OFFSET(NDIS_TASK_OFFLOAD, TaskBuffer) + Task->TaskBufferLength;
+
+    if (Adapter->Capabilities & E1000_CAPABILITY_LARGE_SEND)
+    {
+        Task->OffsetNextTask = FIELD_OFFSET(NDIS_TASK_OFFLOAD, TaskBuffer) + Task->TaskBufferLength;
+
+        Task = (PNDIS_TASK_OFFLOAD)(Buffer + *Length);
+        Task->Version = NDIS_TASK_OFFLOAD_VERSION;
+        Task->Size = sizeof(NDIS_TASK_OFFLOAD);
+        Task->Task = TcpLargeSendNdisTask;
+        Task->TaskBufferLength = sizeof(NDIS_TASK_TCP_LARGE_SEND);
+
+        LargeSend = (PNDIS_TASK_TCP_LARGE_SEND)Task->TaskBuffer;
+        LargeSend->Version = NDIS_TASK_TCP_LARGE_SEND_V0;
+        LargeSend->MaxOffLoadSize = MAXIMUM_LARGE_SEND_SIZE;
+        LargeSend->MinSegmentCount = MINIMUM_LARGE_SEND_SEGMENTS;
+        LargeSend->TcpOptions = TRUE;
+        LargeSend->IpOptions = TRUE;
+
+        *Length += FIELD_OFFSET(NDIS_TASK_OFFLOAD, TaskBuffer) + Task->TaskBufferLength;
+    }
+
+    return NDIS_STATUS_SUCCESS;
+}
+
+static
+NDIS_STATUS
+NICSetTaskOffload(
+    _In_ PE1000_ADAPTER Adapter,
+    _In_reads_bytes_(Length) PNDIS_TASK_OFFLOAD_HEADER Header,
+    _In_ ULONG Length)
+{
+    NDIS_TASK_TCP_IP_CHECKSUM ChecksumOffload;
+    BOOLEAN LargeSendOffload = FALSE;
+    PNDIS_TASK_TCP_IP_CHECKSUM Checksum;
+    PNDIS_TASK_OFFLOAD Task;
+    ULONG Offset;
+
+    if (Header->Version != NDIS_TASK_OFFLOAD_VERSION ||
+        Header->EncapsulationFormat.Encapsulation != IEEE_802_3_Encapsulation)
+    {
+        return NDIS_STATUS_NOT_SUPPORTED;
+    }
+
+    NdisZeroMemory(&ChecksumOffload, sizeof(ChecksumOffload));
+
+    /* No tasks at all turns the offloads off */
+    for (Offset = Header->OffsetFirstTask; Offset != 0; )
+    {
+        if (Offset > Length - FIELD_OFFSET(NDIS_TASK_OFFLOAD, TaskBuffer))
+        {
+            return NDIS_STATUS_INVALID_LENGTH;
+        }
+
+        Task = (PNDIS_TASK_OFFLOAD)((PUCHAR)Header + Offset);
+        if (Task->TaskBufferLength > Length - Offset - FIELD_OFFSET(NDIS_TASK_OFFLOAD, TaskBuffer))
+        {
+            return NDIS_STATUS_INVALID_LENGTH;
+        }
+
+        switch (Task->Task)
+        {
+        case TcpIpChecksumNdisTask:
+            if (!(Adapter->Capabilities & E1000_CAPABILITY_CHECKSUM_OFFLOAD) ||
+                Task->TaskBufferLength < sizeof(NDIS_TASK_TCP_IP_CHECKSUM))
+            {
+                return NDIS_STATUS_NOT_SUPPORTED;
+            }
+
+            Checksum = (PNDIS_TASK_TCP_IP_CHECKSUM)Task->TaskBuffer;
+            if (Checksum->V6Transmit.TcpChecksum || Checksum->V6Transmit.UdpChecksum ||
+                Checksum->V6Receive.TcpChecksum || Checksum->V6Receive.UdpChecksum)
+            {
+                return NDIS_STATUS_NOT_SUPPORTED;
+            }
+
+            ChecksumOffload.V4Transmit = Checksum->V4Transmit;
+            ChecksumOffload.V4Receive = Checksum->V4Receive;
+            break;
+
+        case TcpLargeSendNdisTask:
+            if (!(Adapter->Capabilities & E1000_CAPABILITY_LARGE_SEND) ||
+                Task->TaskBufferLength < sizeof(NDIS_TASK_TCP_LARGE_SEND))
+            {
+                return NDIS_STATUS_NOT_SUPPORTED;
+            }
+
+            LargeSendOffload = TRUE;
+            break;
+
+        default:
+            NDIS_DbgPrint(MIN_TRACE, ("Unsupported offload task %d\n", Task->Task));
+            return NDIS_STATUS_NOT_SUPPORTED;
+        }
+
+        Offset = Task->OffsetNextTask ? Offset + Task->OffsetNextTask : 0;
+    }
+
+    Adapter->ChecksumOffload = ChecksumOffload;
+    Adapter->LargeSendOffload = LargeSendOffload;
+
+    return NICApplyChecksumOffload(Adapter);
+}
+
 NDIS_STATUS
 NTAPI
 MiniportQueryInformation(
@@ -89,6 +250,7 @@ MiniportQueryInformation(
         ULONG64 Ulong64;
         NDIS_MEDIUM Medium;
         NDIS_PNP_CAPABILITIES PmCapabilities;
+        UCHAR TaskOffload[TASK_OFFLOAD_BUFFER_SIZE];
     } GenericInfo;
 
     status = NDIS_STATUS_SUCCESS;
@@ -180,7 +342,7 @@ MiniportQueryInformation(
         break;
 
     case OID_GEN_MAXIMUM_SEND_PACKETS:
-        GenericInfo.Ulong = 1;
+        GenericInfo.Ulong = MAXIMUM_SEND_PACKETS;
         break;
 
     case OID_GEN_MAC_OPTIONS:
@@ -239,6 +401,20 @@ MiniportQueryInformation(
         break;
     }
 
+    case OID_TCP_TASK_OFFLOAD:
+    {
+        /* The protocol tells us which encapsulation it asks about */
+        if (InformationBufferLength < sizeof(NDIS_TASK_OFFLOAD_HEADER))
+        {
+            *BytesNeeded = TASK_OFFLOAD_BUFFER_SIZE;
+            *BytesWritten = 0;
+            return NDIS_STATUS_BUFFER_TOO_SHORT;
+        }
+
+        status = NICFillTaskOffload(Adapter, InformationBuffer, GenericInfo.TaskOffload, &copyLength);
+        break;
+    }
+
     default:
         NDIS_DbgPrint(MIN_TRACE, ("Unknown OID 0x%x(%s)\n", Oid, Oid2Str(Oid)));
         status = NDIS_STATUS_NOT_SUPPORTED;
@@ -376,6 +552,24 @@ MiniportSetInformation(
         NICUpdateMulticastList(Adapter);
         break;
 
+    case OID_TCP_TASK_OFFLOAD:
+        if (InformationBufferLength < sizeof(NDIS_TASK_OFFLOAD_HEADER))
+        {
+            *BytesRead = 0;
+            *BytesNeeded = sizeof(NDIS_TASK_OFFLOAD_HEADER);
+            status = NDIS_STATUS_INVALID_LENGTH;
+            break;
+        }
+
+        status = NICSetTaskOffload(Adapter, InformationBuffer, InformationBufferLength);
+        if (status != NDIS_STATUS_SUCCESS)
+        {
+            NDIS_DbgPrint(MIN_TRACE, ("Failed to apply task offload (0x%x)\n", status));
+            *BytesRead = 0;
+            *BytesNeeded = 0;
+        }
+        break;
+
     default:
         NDIS_DbgPrint(MIN_TRACE, ("Unknown OID 0x%x(%s)\n", Oid, Oid2Str(Oid)));
         status = NDIS_STATUS_NOT_SUPPORTED;
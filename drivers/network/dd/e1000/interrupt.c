@@ -75,8 +75,8 @@ MiniportHandleInterrupt(
     if (InterruptPending & (E1000_IMS_RXDMT0 | E1000_IMS_RXT0))
     {
         volatile PE1000_RECEIVE_DESCRIPTOR ReceiveDescriptor;
-        PETH_HEADER EthHeader;
-        ULONG BufferOffset;
+        PNDIS_PACKET IndicatePackets[MAXIMUM_INDICATE_PACKETS];
+        ULONG NumPackets = 0;
         BOOLEAN bGotAny = FALSE;
         ULONG RxDescHead, RxDescTail, CurrRxDesc;
 
@@ -89,7 +89,6 @@ MiniportHandleInterrupt(
         while (((RxDescTail + 1) % NUM_RECEIVE_DESCRIPTORS) != RxDescHead)
         {
             CurrRxDesc = (RxDescTail + 1) % NUM_RECEIVE_DESCRIPTORS;
-            BufferOffset = CurrRxDesc * Adapter->ReceiveBufferEntrySize;
             ReceiveDescriptor = Adapter->ReceiveDescriptors + CurrRxDesc;
 
             /* Check if the hardware have released this descriptor (DD - Descriptor Done) */
@@ -99,10 +98,10 @@ MiniportHandleInterrupt(
                 break;
             }
 
-            /* Ignoring these flags for now */
-            ReceiveDescriptor->Status &= ~(E1000_RDESC_STATUS_IXSM | E1000_RDESC_STATUS_PIF);
-
-            if (ReceiveDescriptor->Status != (E1000_RDESC_STATUS_EOP | E1000_RDESC_STATUS_DD))
+            /* Checksum results are picked up with the packet */
+            if ((ReceiveDescriptor->Status & ~(E1000_RDESC_STATUS_IXSM | E1000_RDESC_STATUS_PIF |
+                                               E1000_RDESC_STATUS_IPCS | E1000_RDESC_STATUS_TCPCS)) !=
+                (E1000_RDESC_STATUS_EOP | E1000_RDESC_STATUS_DD))
             {
                 NDIS_DbgPrint(MIN_TRACE, ("Unrecognized ReceiveDescriptor status flag: %u\n", ReceiveDescriptor->Status));
             }
@@ -113,18 +112,10 @@ MiniportHandleInterrupt(
                 goto NextReceiveDescriptor;
             }
 
-            if (ReceiveDescriptor->Length != 0 && ReceiveDescriptor->Address != 0)
+            if (ReceiveDescriptor->Length > sizeof(ETH_HEADER) && ReceiveDescriptor->Address != 0)
             {
-                EthHeader = (PETH_HEADER)(Adapter->ReceiveBuffer + BufferOffset);
-
-                NdisMEthIndicateReceive(Adapter->AdapterHandle,
-                                        NULL,
-                                        (PCHAR)EthHeader,
-                                        sizeof(ETH_HEADER),
-                                        (PCHAR)(EthHeader + 1),
-                                        ReceiveDescriptor->Length - sizeof(ETH_HEADER),
-                                        ReceiveDescriptor->Length - sizeof(ETH_HEADER));
-
+                /* The buffer goes up as it is, the descriptor gets a spare one if we have it */
+                IndicatePackets[NumPackets++] = NICPrepareReceivePacket(Adapter, CurrRxDesc);
                 bGotAny = TRUE;
             }
             else
@@ -137,10 +128,22 @@ NextReceiveDescriptor:
             ReceiveDescriptor->Status = 0;
 
             RxDescTail = CurrRxDesc;
+
+            if (NumPackets == ARRAYSIZE(IndicatePackets))
+            {
+                NICIndicateReceivePackets(Adapter, IndicatePackets, NumPackets);
+                NumPackets = 0;
+            }
         }
 
         if (bGotAny)
         {
+            /* Buffers indicated with NDIS_STATUS_RESOURCES are still on the ring until this returns */
+            if (NumPackets)
+            {
+                NICIndicateReceivePackets(Adapter, IndicatePackets, NumPackets);
+            }
+
             /* Write back new tail value */
             E1000WriteUlong(Adapter, E1000_REG_RDT, RxDescTail);
 
@@ -159,38 +162,41 @@ NextReceiveDescriptor:
         /* Clear out these interrupts */
         InterruptPending &= ~(E1000_IMS_TXD_LOW | E1000_IMS_TXDW | E1000_IMS_TXQE);
 
-        while ((Adapter->TxFull || Adapter->LastTxDesc != Adapter->CurrentTxDesc) && NumPackets < ARRAYSIZE(AckPackets))
+        do
         {
-            TransmitDescriptor = Adapter->TransmitDescriptors + Adapter->LastTxDesc;
+            NumPackets = 0;
 
-            if (TransmitDescriptor->Status & E1000_TDESC_STATUS_DD)
+            while (Adapter->LastTxDesc != Adapter->CurrentTxDesc && NumPackets < ARRAYSIZE(AckPackets))
             {
+                TransmitDescriptor = Adapter->TransmitDescriptors + Adapter->LastTxDesc;
+
+                if (!(TransmitDescriptor->Status & E1000_TDESC_STATUS_DD))
+                {
+                    break;
+                }
+
+                /* Only the last descriptor of a packet remembers it */
                 if (Adapter->TransmitPackets[Adapter->LastTxDesc])
                 {
                     AckPackets[NumPackets++] = Adapter->TransmitPackets[Adapter->LastTxDesc];
                     Adapter->TransmitPackets[Adapter->LastTxDesc] = NULL;
-                    TransmitDescriptor->Status = 0;
                 }
+                TransmitDescriptor->Status = 0;
 
                 Adapter->LastTxDesc = (Adapter->LastTxDesc + 1) % NUM_TRANSMIT_DESCRIPTORS;
-                Adapter->TxFull = FALSE;
-            }
-            else
-            {
-                break;
             }
-        }
 
-        if (NumPackets)
-        {
-            NDIS_DbgPrint(MAX_TRACE, ("Tx: (TDH: %u, TDT: %u)\n", Adapter->CurrentTxDesc, Adapter->LastTxDesc));
-            NDIS_DbgPrint(MAX_TRACE, ("Tx Done: %u packets to ack\n", NumPackets));
-
-            for (i = 0; i < NumPackets; ++i)
+            if (NumPackets)
             {
-                NdisMSendComplete(Adapter->AdapterHandle, AckPackets[i], NDIS_STATUS_SUCCESS);
+                NDIS_DbgPrint(MAX_TRACE, ("Tx: (TDH: %u, TDT: %u)\n", Adapter->CurrentTxDesc, Adapter->LastTxDesc));
+                NDIS_DbgPrint(MAX_TRACE, ("Tx Done: %u packets to ack\n", NumPackets));
+
+                for (i = 0; i < NumPackets; ++i)
+                {
+                    NdisMSendComplete(Adapter->AdapterHandle, AckPackets[i], NDIS_STATUS_SUCCESS);
+                }
             }
-        }
+        } while (NumPackets == ARRAYSIZE(AckPackets));
     }
 
     ASSERT(InterruptPending == 0);
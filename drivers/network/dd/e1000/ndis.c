@@ -171,7 +171,8 @@ MiniportInitialize(
     /* Allocate the DMA resources */
     Status = NdisMInitializeScatterGatherDma(MiniportAdapterHandle,
                                              FALSE, // 64bit is supported but can be buggy
-                                             MAXIMUM_FRAME_SIZE);
+                                             (Adapter->Capabilities & E1000_CAPABILITY_LARGE_SEND) ?
+                                             MAXIMUM_LARGE_SEND_SIZE : MAXIMUM_FRAME_SIZE);
     if (Status != NDIS_STATUS_SUCCESS)
     {
         NDIS_DbgPrint(MIN_TRACE, ("Unable to configure DMA\n"));
@@ -271,11 +272,11 @@ DriverEntry(
     Characteristics.QueryInformationHandler = MiniportQueryInformation;
     Characteristics.ReconfigureHandler = NULL;
     Characteristics.ResetHandler = MiniportReset;
-    Characteristics.SendHandler = MiniportSend;
+    Characteristics.SendHandler = NULL;
     Characteristics.SetInformationHandler = MiniportSetInformation;
     Characteristics.TransferDataHandler = NULL;
-    Characteristics.ReturnPacketHandler = NULL;
-    Characteristics.SendPacketsHandler = NULL;
+    Characteristics.ReturnPacketHandler = MiniportReturnPacket;
+    Characteristics.SendPacketsHandler = MiniportSendPackets;
     Characteristics.AllocateCompleteHandler = NULL;
 
     NdisMInitializeWrapper(&WrapperHandle, DriverObject, RegistryPath, NULL);
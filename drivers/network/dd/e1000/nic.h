@@ -19,6 +19,20 @@
 #define MAXIMUM_FRAME_SIZE   1522
 #define RECEIVE_BUFFER_SIZE  2048
 
+#define MAXIMUM_SEND_PACKETS        16
+#define MAXIMUM_INDICATE_PACKETS    16
+#define MAXIMUM_LARGE_SEND_SIZE     0xF000
+#define MINIMUM_LARGE_SEND_SEGMENTS 2
+
+/* Hardware features, not all of the 8254x family has them */
+#define E1000_CAPABILITY_CHECKSUM_OFFLOAD       0x01
+#define E1000_CAPABILITY_LARGE_SEND             0x02
+#define E1000_CAPABILITY_INTERRUPT_THROTTLING   0x04
+
+#define ETH_TYPE_IPV4           0x0800
+#define IP_PROTOCOL_TCP         6
+#define IP_PROTOCOL_UDP         17
+
 #define DRIVER_VERSION 1
 
 #define DEFAULT_INTERRUPT_MASK  (E1000_IMS_LSC | E1000_IMS_TXDW | E1000_IMS_TXQE | E1000_IMS_RXDMT0 | E1000_IMS_RXT0 | E1000_IMS_TXD_LOW)
@@ -38,6 +52,7 @@ typedef struct _E1000_ADAPTER
     USHORT DeviceID;
     USHORT SubsystemID;
     USHORT SubsystemVendorID;
+    ULONG Capabilities;
 
     UCHAR PermanentMacAddress[IEEE_802_ADDR_LENGTH];
 
@@ -50,6 +65,10 @@ typedef struct _E1000_ADAPTER
     ULONG MediaState;
     ULONG PacketFilter;
 
+    /* Offload tasks enabled by the protocol */
+    NDIS_TASK_TCP_IP_CHECKSUM ChecksumOffload;
+    BOOLEAN LargeSendOffload;
+
     /* Io Port */
     ULONG IoPortAddress;
     ULONG IoPortLength;
@@ -78,7 +97,6 @@ typedef struct _E1000_ADAPTER
 
     ULONG CurrentTxDesc;
     ULONG LastTxDesc;
-    BOOLEAN TxFull;
 
 
     /* Receive */
@@ -90,6 +108,15 @@ typedef struct _E1000_ADAPTER
     NDIS_PHYSICAL_ADDRESS ReceiveBufferPa;
     ULONG ReceiveBufferEntrySize;
 
+    NDIS_HANDLE ReceivePacketPool;
+    NDIS_HANDLE ReceiveBufferPool;
+    PNDIS_PACKET ReceivePackets[NUM_RECEIVE_BUFFERS];
+    PNDIS_PACKET ReceiveDescriptorPackets[NUM_RECEIVE_DESCRIPTORS];
+
+    NDIS_SPIN_LOCK ReceiveLock;
+    PNDIS_PACKET FreeReceivePackets[NUM_RECEIVE_BUFFERS];
+    ULONG FreeReceivePacketCount;
+
 } E1000_ADAPTER, *PE1000_ADAPTER;
 
 
@@ -167,10 +194,44 @@ NICUpdateLinkStatus(
 
 NDIS_STATUS
 NTAPI
-MiniportSend(
+NICApplyChecksumOffload(
+    IN PE1000_ADAPTER Adapter);
+
+NDIS_STATUS
+NTAPI
+NICAllocateReceivePackets(
+    IN PE1000_ADAPTER Adapter);
+
+VOID
+NTAPI
+NICFreeReceivePackets(
+    IN PE1000_ADAPTER Adapter);
+
+PNDIS_PACKET
+NTAPI
+NICPrepareReceivePacket(
+    IN PE1000_ADAPTER Adapter,
+    IN ULONG Descriptor);
+
+VOID
+NTAPI
+NICIndicateReceivePackets(
+    IN PE1000_ADAPTER Adapter,
+    IN PNDIS_PACKET *Packets,
+    IN ULONG NumPackets);
+
+VOID
+NTAPI
+MiniportSendPackets(
     _In_ NDIS_HANDLE MiniportAdapterContext,
-    _In_ PNDIS_PACKET Packet,
-    _In_ UINT Flags);
+    _In_ PPNDIS_PACKET PacketArray,
+    _In_ UINT NumberOfPackets);
+
+VOID
+NTAPI
+MiniportReturnPacket(
+    _In_ NDIS_HANDLE MiniportAdapterContext,
+    _In_ PNDIS_PACKET Packet);
 
 NDIS_STATUS
 NTAPI
@@ -238,6 +299,15 @@ E1000WriteIoUlong(
     NdisRawWritePortUlong((PULONG)(Adapter->IoPort + 4), Value);
 }
 
+FORCEINLINE
+ULONG
+NICFreeTransmitDescriptors(
+    _In_ PE1000_ADAPTER Adapter)
+{
+    /* One descriptor always stays unused, a full ring would look empty to the NIC */
+    return (Adapter->LastTxDesc + NUM_TRANSMIT_DESCRIPTORS - Adapter->CurrentTxDesc - 1) % NUM_TRANSMIT_DESCRIPTORS;
+}
+
 FORCEINLINE
 VOID
 NICApplyInterruptMask(
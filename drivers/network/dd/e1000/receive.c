@@ -0,0 +1,281 @@
+/*
+ * PROJECT:     ReactOS Intel PRO/1000 Driver
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later.html)
+ * PURPOSE:     Receiving packets
+ */
+
+#include "nic.h"
+
+#include <debug.h>
+
+/* Every receive packet describes one entry of the shared receive buffer */
+#define RECEIVE_PACKET_INDEX(Packet)    (*(PULONG)(Packet)->MiniportReserved)
+
+static
+NDIS_PHYSICAL_ADDRESS
+NICReceivePacketAddress(
+    _In_ PE1000_ADAPTER Adapter,
+    _In_ PNDIS_PACKET Packet)
+{
+    NDIS_PHYSICAL_ADDRESS Address;
+
+    Address.QuadPart = Adapter->ReceiveBufferPa.QuadPart +
+                       RECEIVE_PACKET_INDEX(Packet) * Adapter->ReceiveBufferEntrySize;
+    return Address;
+}
+
+static
+VOID
+NICSetReceiveChecksumInfo(
+    _In_ PE1000_ADAPTER Adapter,
+    _In_ PNDIS_PACKET Packet,
+    _In_ volatile PE1000_RECEIVE_DESCRIPTOR ReceiveDescriptor)
+{
+    NDIS_TCP_IP_CHECKSUM_PACKET_INFO ChecksumInfo;
+    PETH_HEADER EthHeader;
+    PUCHAR IpHeader;
+    UCHAR Status = ReceiveDescriptor->Status;
+    UCHAR Errors = ReceiveDescriptor->Errors;
+
+    ChecksumInfo.Value = 0;
+
+    if (!(Status & E1000_RDESC_STATUS_IXSM) && ReceiveDescriptor->Length >= sizeof(ETH_HEADER) + 20)
+    {
+        EthHeader = (PETH_HEADER)(Adapter->ReceiveBuffer +
+                                  RECEIVE_PACKET_INDEX(Packet) * Adapter->ReceiveBufferEntrySize);
+        IpHeader = (PUCHAR)(EthHeader + 1);
+
+        if ((Status & E1000_RDESC_STATUS_IPCS) && Adapter->ChecksumOffload.V4Receive.IpChecksum)
+        {
+            if (Errors & E1000_RDESC_ERROR_IPE)
+                ChecksumInfo.Receive.NdisPacketIpChecksumFailed = 1;
+            else
+                ChecksumInfo.Receive.NdisPacketIpChecksumSucceeded = 1;
+        }
+
+        if (Status & E1000_RDESC_STATUS_TCPCS)
+        {
+            /* The NIC does not tell us which one it was */
+            if (IpHeader[9] == IP_PROTOCOL_TCP && Adapter->ChecksumOffload.V4Receive.TcpChecksum)
+            {
+                if (Errors & E1000_RDESC_ERROR_TCPE)
+                    ChecksumInfo.Receive.NdisPacketTcpChecksumFailed = 1;
+                else
+                    ChecksumInfo.Receive.NdisPacketTcpChecksumSucceeded = 1;
+            }
+            else if (IpHeader[9] == IP_PROTOCOL_UDP && Adapter->ChecksumOffload.V4Receive.UdpChecksum)
+            {
+                if (Errors & E1000_RDESC_ERROR_TCPE)
+                    ChecksumInfo.Receive.NdisPacketUdpChecksumFailed = 1;
+                else
+                    ChecksumInfo.Receive.NdisPacketUdpChecksumSucceeded = 1;
+            }
+        }
+    }
+
+    NDIS_PER_PACKET_INFO_FROM_PACKET(Packet, TcpIpChecksumPacketInfo) = UlongToPtr(ChecksumInfo.Value);
+}
+
+NDIS_STATUS
+NTAPI
+NICAllocateReceivePackets(
+    IN PE1000_ADAPTER Adapter)
+{
+    NDIS_STATUS Status;
+    PNDIS_PACKET Packet;
+    PNDIS_BUFFER Buffer;
+    UINT n;
+
+    NDIS_DbgPrint(MAX_TRACE, ("Called.\n"));
+
+    NdisAllocatePacketPool(&Status,
+                           &Adapter->ReceivePacketPool,
+                           NUM_RECEIVE_BUFFERS,
+                           PROTOCOL_RESERVED_SIZE_IN_PACKET);
+    if (Status != NDIS_STATUS_SUCCESS)
+    {
+        NDIS_DbgPrint(MIN_TRACE, ("Unable to allocate receive packet pool (0x%x)\n", Status));
+        return NDIS_STATUS_RESOURCES;
+    }
+
+    NdisAllocateSpinLock(&Adapter->ReceiveLock);
+
+    NdisAllocateBufferPool(&Status, &Adapter->ReceiveBufferPool, NUM_RECEIVE_BUFFERS);
+    if (Status != NDIS_STATUS_SUCCESS)
+    {
+        NDIS_DbgPrint(MIN_TRACE, ("Unable to allocate receive buffer pool (0x%x)\n", Status));
+        return NDIS_STATUS_RESOURCES;
+    }
+
+    for (n = 0; n < NUM_RECEIVE_BUFFERS; ++n)
+    {
+        NdisAllocatePacket(&Status, &Packet, Adapter->ReceivePacketPool);
+        if (Status != NDIS_STATUS_SUCCESS)
+        {
+            NDIS_DbgPrint(MIN_TRACE, ("Unable to allocate receive packet (0x%x)\n", Status));
+            return NDIS_STATUS_RESOURCES;
+        }
+
+        NdisAllocateBuffer(&Status,
+                           &Buffer,
+                           Adapter->ReceiveBufferPool,
+                           Adapter->ReceiveBuffer + n * Adapter->ReceiveBufferEntrySize,
+                           Adapter->ReceiveBufferEntrySize);
+        if (Status != NDIS_STATUS_SUCCESS)
+        {
+            NDIS_DbgPrint(MIN_TRACE, ("Unable to allocate receive buffer (0x%x)\n", Status));
+            NdisFreePacket(Packet);
+            return NDIS_STATUS_RESOURCES;
+        }
+
+        NdisChainBufferAtFront(Packet, Buffer);
+        RECEIVE_PACKET_INDEX(Packet) = n;
+        Adapter->ReceivePackets[n] = Packet;
+
+        /* The first ones go to the ring, the rest wait to replace lent ones */
+        if (n < NUM_RECEIVE_DESCRIPTORS)
+            Adapter->ReceiveDescriptorPackets[n] = Packet;
+        else
+            Adapter->FreeReceivePackets[Adapter->FreeReceivePacketCount++] = Packet;
+    }
+
+    return NDIS_STATUS_SUCCESS;
+}
+
+VOID
+NTAPI
+NICFreeReceivePackets(
+    IN PE1000_ADAPTER Adapter)
+{
+    PNDIS_BUFFER Buffer;
+    UINT n;
+
+    NDIS_DbgPrint(MAX_TRACE, ("Called.\n"));
+
+    for (n = 0; n < NUM_RECEIVE_BUFFERS; ++n)
+    {
+        if (Adapter->ReceivePackets[n] == NULL)
+            continue;
+
+        NdisUnchainBufferAtFront(Adapter->ReceivePackets[n], &Buffer);
+        if (Buffer != NULL)
+        {
+            NdisFreeBuffer(Buffer);
+        }
+        NdisFreePacket(Adapter->ReceivePackets[n]);
+        Adapter->ReceivePackets[n] = NULL;
+    }
+
+    RtlZeroMemory(Adapter->ReceiveDescriptorPackets, sizeof(Adapter->ReceiveDescriptorPackets));
+    Adapter->FreeReceivePacketCount = 0;
+
+    if (Adapter->ReceiveBufferPool != NULL)
+    {
+        NdisFreeBufferPool(Adapter->ReceiveBufferPool);
+        Adapter->ReceiveBufferPool = NULL;
+    }
+
+    if (Adapter->ReceivePacketPool != NULL)
+    {
+        NdisFreePacketPool(Adapter->ReceivePacketPool);
+        Adapter->ReceivePacketPool = NULL;
+
+        NdisFreeSpinLock(&Adapter->ReceiveLock);
+    }
+}
+
+PNDIS_PACKET
+NTAPI
+NICPrepareReceivePacket(
+    IN PE1000_ADAPTER Adapter,
+    IN ULONG Descriptor)
+{
+    volatile PE1000_RECEIVE_DESCRIPTOR ReceiveDescriptor = Adapter->ReceiveDescriptors + Descriptor;
+    PNDIS_PACKET Packet, NewPacket = NULL;
+    PNDIS_BUFFER Buffer;
+
+    Packet = Adapter->ReceiveDescriptorPackets[Descriptor];
+
+    NdisQueryPacket(Packet, NULL, NULL, &Buffer, NULL);
+    NdisAdjustBufferLength(Buffer, ReceiveDescriptor->Length);
+    NdisRecalculatePacketCounts(Packet);
+
+    NDIS_SET_PACKET_HEADER_SIZE(Packet, sizeof(ETH_HEADER));
+    NICSetReceiveChecksumInfo(Adapter, Packet, ReceiveDescriptor);
+
+    /* Lend the buffer to the protocols if there is a spare one to take its place */
+    NdisDprAcquireSpinLock(&Adapter->ReceiveLock);
+    if (Adapter->FreeReceivePacketCount)
+    {
+        NewPacket = Adapter->FreeReceivePackets[--Adapter->FreeReceivePacketCount];
+    }
+    NdisDprReleaseSpinLock(&Adapter->ReceiveLock);
+
+    if (NewPacket)
+    {
+        Adapter->ReceiveDescriptorPackets[Descriptor] = NewPacket;
+        ReceiveDescriptor->Address = NICReceivePacketAddress(Adapter, NewPacket).QuadPart;
+
+        NDIS_SET_PACKET_STATUS(Packet, NDIS_STATUS_SUCCESS);
+    }
+    else
+    {
+        /* Out of spares, the protocols have to copy the data before we reuse the buffer */
+        NDIS_DbgPrint(MID_TRACE, ("No spare receive buffers left\n"));
+        NDIS_SET_PACKET_STATUS(Packet, NDIS_STATUS_RESOURCES);
+    }
+
+    return Packet;
+}
+
+static
+VOID
+NICReleaseReceivePacket(
+    _In_ PE1000_ADAPTER Adapter,
+    _In_ PNDIS_PACKET Packet)
+{
+    PNDIS_BUFFER Buffer;
+
+    NdisQueryPacket(Packet, NULL, NULL, &Buffer, NULL);
+    NdisAdjustBufferLength(Buffer, Adapter->ReceiveBufferEntrySize);
+
+    NdisDprAcquireSpinLock(&Adapter->ReceiveLock);
+    ASSERT(Adapter->FreeReceivePacketCount < NUM_RECEIVE_BUFFERS);
+    Adapter->FreeReceivePackets[Adapter->FreeReceivePacketCount++] = Packet;
+    NdisDprReleaseSpinLock(&Adapter->ReceiveLock);
+}
+
+VOID
+NTAPI
+NICIndicateReceivePackets(
+    IN PE1000_ADAPTER Adapter,
+    IN PNDIS_PACKET *Packets,
+    IN ULONG NumPackets)
+{
+    ULONG n;
+
+    NdisMIndicateReceivePacket(Adapter->AdapterHandle, Packets, NumPackets);
+
+    for (n = 0; n < NumPackets; ++n)
+    {
+        /* Pending ones come back through MiniportReturnPacket,
+           the ones indicated with NDIS_STATUS_RESOURCES never left the ring */
+        if (NDIS_GET_PACKET_STATUS(Packets[n]) == NDIS_STATUS_SUCCESS)
+        {
+            NICReleaseReceivePacket(Adapter, Packets[n]);
+        }
+    }
+}
+
+VOID
+NTAPI
+MiniportReturnPacket(
+    _In_ NDIS_HANDLE MiniportAdapterContext,
+    _In_ PNDIS_PACKET Packet)
+{
+    PE1000_ADAPTER Adapter = (PE1000_ADAPTER)MiniportAdapterContext;
+
+    NDIS_DbgPrint(MAX_TRACE, ("Called.\n"));
+
+    NICReleaseReceivePacket(Adapter, Packet);
+}
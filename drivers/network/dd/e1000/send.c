@@ -10,76 +10,256 @@
 
 #include <debug.h>
 
+/* Ethernet + IPv4 with options + TCP with options */
+#define MAXIMUM_HEADERS_SIZE    (sizeof(ETH_HEADER) + 60 + 60)
+
 static
-NDIS_STATUS
-NICTransmitPacket(
-    _In_ PE1000_ADAPTER Adapter,
-    _In_ PHYSICAL_ADDRESS PhysicalAddress,
+ULONG
+NICCopyPacketHeaders(
+    _In_ PNDIS_PACKET Packet,
+    _Out_writes_bytes_(Length) PUCHAR Headers,
     _In_ ULONG Length)
 {
-    volatile PE1000_TRANSMIT_DESCRIPTOR TransmitDescriptor;
+    PNDIS_BUFFER Buffer;
+    PVOID BufferVa;
+    UINT BufferLength;
+    ULONG Copied = 0;
 
-    NDIS_DbgPrint(MAX_TRACE, ("Called.\n"));
+    NdisQueryPacket(Packet, NULL, NULL, &Buffer, NULL);
+
+    while (Buffer != NULL && Copied < Length)
+    {
+        NdisQueryBufferSafe(Buffer, &BufferVa, &BufferLength, HighPagePriority);
+        if (BufferVa == NULL)
+            break;
 
-    TransmitDescriptor = Adapter->TransmitDescriptors + Adapter->CurrentTxDesc;
-    TransmitDescriptor->Address = PhysicalAddress.QuadPart;
-    TransmitDescriptor->Length = Length;
-    TransmitDescriptor->ChecksumOffset = 0;
-    TransmitDescriptor->Command = E1000_TDESC_CMD_RS | E1000_TDESC_CMD_IFCS |
-                                  E1000_TDESC_CMD_EOP | E1000_TDESC_CMD_IDE;
-    TransmitDescriptor->Status = 0;
-    TransmitDescriptor->ChecksumStartField = 0;
-    TransmitDescriptor->Special = 0;
+        BufferLength = min(BufferLength, Length - Copied);
+        NdisMoveMemory(Headers + Copied, BufferVa, BufferLength);
+        Copied += BufferLength;
+
+        NdisGetNextBuffer(Buffer, &Buffer);
+    }
+
+    return Copied;
+}
+
+/* Fills the context descriptor for the checksum and segmentation offloads,
+   returns FALSE when the packet does not need one */
+static
+BOOLEAN
+NICPrepareOffloadContext(
+    _In_ PE1000_ADAPTER Adapter,
+    _In_ PNDIS_PACKET Packet,
+    _In_ ULONG PacketLength,
+    _Out_ PE1000_CONTEXT_DESCRIPTOR Context,
+    _Out_ PUCHAR Options)
+{
+    NDIS_TCP_IP_CHECKSUM_PACKET_INFO ChecksumInfo;
+    UCHAR Headers[MAXIMUM_HEADERS_SIZE];
+    PETH_HEADER EthHeader = (PETH_HEADER)Headers;
+    PUCHAR IpHeader = Headers + sizeof(ETH_HEADER);
+    PUCHAR TcpHeader;
+    ULONG HeadersLength, IpHeaderLength, TcpHeaderLength = 0, Mss;
+    BOOLEAN IsTcp;
 
-    Adapter->CurrentTxDesc = (Adapter->CurrentTxDesc + 1) % NUM_TRANSMIT_DESCRIPTORS;
+    ChecksumInfo.Value = PtrToUlong(NDIS_PER_PACKET_INFO_FROM_PACKET(Packet, TcpIpChecksumPacketInfo));
+    Mss = PtrToUlong(NDIS_PER_PACKET_INFO_FROM_PACKET(Packet, TcpLargeSendPacketInfo));
 
-    E1000WriteUlong(Adapter, E1000_REG_TDT, Adapter->CurrentTxDesc);
+    if (!Adapter->LargeSendOffload)
+        Mss = 0;
 
-    if (Adapter->CurrentTxDesc == Adapter->LastTxDesc)
+    if (!Mss && !(ChecksumInfo.Transmit.NdisPacketChecksumV4 &&
+                  (ChecksumInfo.Transmit.NdisPacketIpChecksum ||
+                   ChecksumInfo.Transmit.NdisPacketTcpChecksum ||
+                   ChecksumInfo.Transmit.NdisPacketUdpChecksum)))
     {
-        NDIS_DbgPrint(MID_TRACE, ("All TX descriptors are full now\n"));
-        Adapter->TxFull = TRUE;
+        return FALSE;
     }
 
-    return NDIS_STATUS_SUCCESS;
+    HeadersLength = NICCopyPacketHeaders(Packet, Headers, sizeof(Headers));
+    if (HeadersLength < sizeof(ETH_HEADER) + 20 ||
+        EthHeader->PayloadType != RtlUshortByteSwap(ETH_TYPE_IPV4))
+    {
+        NDIS_DbgPrint(MIN_TRACE, ("Offload requested for a non IPv4 packet\n"));
+        return FALSE;
+    }
+
+    IpHeaderLength = (IpHeader[0] & 0x0F) * 4;
+    IsTcp = (IpHeader[9] == IP_PROTOCOL_TCP);
+    TcpHeader = IpHeader + IpHeaderLength;
+
+    if (IsTcp && sizeof(ETH_HEADER) + IpHeaderLength + 20 <= HeadersLength)
+    {
+        TcpHeaderLength = (TcpHeader[12] >> 4) * 4;
+    }
+
+    NdisZeroMemory(Context, sizeof(*Context));
+    *Options = 0;
+
+    Context->IpChecksumStart = sizeof(ETH_HEADER);
+    Context->IpChecksumOffset = sizeof(ETH_HEADER) + 10;
+    Context->IpChecksumEnd = (USHORT)(sizeof(ETH_HEADER) + IpHeaderLength - 1);
+    Context->TcpChecksumStart = (UCHAR)(sizeof(ETH_HEADER) + IpHeaderLength);
+    Context->TcpChecksumOffset = Context->TcpChecksumStart + (IsTcp ? 16 : 6);
+    Context->TcpChecksumEnd = 0;
+    Context->LengthAndCommand = E1000_TDESC_DTYP_CONTEXT | E1000_TDESC_TUCMD_DEXT |
+                                E1000_TDESC_TUCMD_IP | E1000_TDESC_TUCMD_RS;
+    if (IsTcp)
+        Context->LengthAndCommand |= E1000_TDESC_TUCMD_TCP;
+
+    if (Mss && IsTcp && TcpHeaderLength)
+    {
+        /* The NIC fixes up the lengths, checksums and sequence numbers of every segment */
+        HeadersLength = sizeof(ETH_HEADER) + IpHeaderLength + TcpHeaderLength;
+
+        Context->LengthAndCommand |= E1000_TDESC_TUCMD_TSE | (PacketLength - HeadersLength);
+        Context->HeaderLength = (UCHAR)HeadersLength;
+        Context->MaximumSegmentSize = (USHORT)Mss;
+        *Options = E1000_TDESC_POPTS_IXSM | E1000_TDESC_POPTS_TXSM;
+        return TRUE;
+    }
+
+    if (ChecksumInfo.Transmit.NdisPacketIpChecksum)
+        *Options |= E1000_TDESC_POPTS_IXSM;
+    if ((IsTcp && ChecksumInfo.Transmit.NdisPacketTcpChecksum) ||
+        (IpHeader[9] == IP_PROTOCOL_UDP && ChecksumInfo.Transmit.NdisPacketUdpChecksum))
+    {
+        *Options |= E1000_TDESC_POPTS_TXSM;
+    }
+
+    return (*Options != 0);
 }
 
+static
 NDIS_STATUS
-NTAPI
-MiniportSend(
-    _In_ NDIS_HANDLE MiniportAdapterContext,
-    _In_ PNDIS_PACKET Packet,
-    _In_ UINT Flags)
+NICTransmitPacket(
+    _In_ PE1000_ADAPTER Adapter,
+    _In_ PNDIS_PACKET Packet)
 {
-    PE1000_ADAPTER Adapter = (PE1000_ADAPTER)MiniportAdapterContext;
+    volatile PE1000_TRANSMIT_DESCRIPTOR TransmitDescriptor;
+    volatile PE1000_DATA_DESCRIPTOR DataDescriptor;
     PSCATTER_GATHER_LIST sgList;
-    ULONG TransmitLength;
-    PHYSICAL_ADDRESS TransmitBuffer;
-    NDIS_STATUS Status;
+    E1000_CONTEXT_DESCRIPTOR Context;
+    UINT PacketLength;
+    ULONG Command, n;
+    UCHAR Options;
+    BOOLEAN UseContext;
+
+    NDIS_DbgPrint(MAX_TRACE, ("Called.\n"));
 
     sgList = NDIS_PER_PACKET_INFO_FROM_PACKET(Packet, ScatterGatherListPacketInfo);
+    if (sgList == NULL || sgList->NumberOfElements == 0)
+    {
+        NDIS_DbgPrint(MIN_TRACE, ("Packet without a scatter/gather list\n"));
+        return NDIS_STATUS_FAILURE;
+    }
 
-    ASSERT(sgList != NULL);
-    ASSERT(sgList->NumberOfElements == 1);
-    ASSERT((sgList->Elements[0].Address.LowPart & 3) == 0);
-    ASSERT(sgList->Elements[0].Length <= MAXIMUM_FRAME_SIZE);
+    NdisQueryPacketLength(Packet, &PacketLength);
 
-    if (Adapter->TxFull)
+    UseContext = NICPrepareOffloadContext(Adapter, Packet, PacketLength, &Context, &Options);
+
+    if (sgList->NumberOfElements + (UseContext ? 1 : 0) > NICFreeTransmitDescriptors(Adapter))
     {
-        NDIS_DbgPrint(MIN_TRACE, ("All TX descriptors are full\n"));
+        NDIS_DbgPrint(MID_TRACE, ("Not enough TX descriptors left\n"));
         return NDIS_STATUS_RESOURCES;
     }
 
-    TransmitLength = sgList->Elements[0].Length;
-    TransmitBuffer = sgList->Elements[0].Address;
-    Adapter->TransmitPackets[Adapter->CurrentTxDesc] = Packet;
+    if (UseContext)
+    {
+        NdisMoveMemory((PVOID)(Adapter->TransmitDescriptors + Adapter->CurrentTxDesc), &Context, sizeof(Context));
+        Adapter->TransmitPackets[Adapter->CurrentTxDesc] = NULL;
+        Adapter->CurrentTxDesc = (Adapter->CurrentTxDesc + 1) % NUM_TRANSMIT_DESCRIPTORS;
+
+        /* The rest of the packet uses data descriptors referring to this context */
+        Command = E1000_TDESC_DTYP_DATA | E1000_TDESC_DCMD_DEXT | E1000_TDESC_DCMD_IFCS |
+                  E1000_TDESC_DCMD_RS | E1000_TDESC_DCMD_IDE;
+        if (Context.LengthAndCommand & E1000_TDESC_TUCMD_TSE)
+        {
+            Command |= E1000_TDESC_DCMD_TSE;
+
+            /* Tell the protocol how much of the payload went out */
+            NDIS_PER_PACKET_INFO_FROM_PACKET(Packet, TcpLargeSendPacketInfo) =
+                UlongToPtr(Context.LengthAndCommand & E1000_TDESC_LENGTH_MASK);
+        }
 
-    Status = NICTransmitPacket(Adapter, TransmitBuffer, TransmitLength);
-    if (Status != NDIS_STATUS_SUCCESS)
+        for (n = 0; n < sgList->NumberOfElements; ++n)
+        {
+            DataDescriptor = (PE1000_DATA_DESCRIPTOR)(Adapter->TransmitDescriptors + Adapter->CurrentTxDesc);
+            DataDescriptor->Address = sgList->Elements[n].Address.QuadPart;
+            DataDescriptor->LengthAndCommand = Command | (sgList->Elements[n].Length & E1000_TDESC_LENGTH_MASK);
+            if (n == sgList->NumberOfElements - 1)
+                DataDescriptor->LengthAndCommand |= E1000_TDESC_DCMD_EOP;
+            DataDescriptor->Status = 0;
+            DataDescriptor->Options = Options;
+            DataDescriptor->Special = 0;
+
+            Adapter->TransmitPackets[Adapter->CurrentTxDesc] = NULL;
+            Adapter->CurrentTxDesc = (Adapter->CurrentTxDesc + 1) % NUM_TRANSMIT_DESCRIPTORS;
+        }
+    }
+    else
     {
-        NDIS_DbgPrint(MIN_TRACE, ("Transmit packet failed\n"));
-        return Status;
+        for (n = 0; n < sgList->NumberOfElements; ++n)
+        {
+            ASSERT(sgList->Elements[n].Length <= MAXIMUM_FRAME_SIZE);
+
+            TransmitDescriptor = Adapter->TransmitDescriptors + Adapter->CurrentTxDesc;
+            TransmitDescriptor->Address = sgList->Elements[n].Address.QuadPart;
+            TransmitDescriptor->Length = (USHORT)sgList->Elements[n].Length;
+            TransmitDescriptor->ChecksumOffset = 0;
+            TransmitDescriptor->Command = E1000_TDESC_CMD_RS | E1000_TDESC_CMD_IFCS | E1000_TDESC_CMD_IDE;
+            if (n == sgList->NumberOfElements - 1)
+                TransmitDescriptor->Command |= E1000_TDESC_CMD_EOP;
+            TransmitDescriptor->Status = 0;
+            TransmitDescriptor->ChecksumStartField = 0;
+            TransmitDescriptor->Special = 0;
+
+            Adapter->TransmitPackets[Adapter->CurrentTxDesc] = NULL;
+            Adapter->CurrentTxDesc = (Adapter->CurrentTxDesc + 1) % NUM_TRANSMIT_DESCRIPTORS;
+        }
     }
 
+    /* Completion is reported on the last descriptor of the packet */
+    Adapter->TransmitPackets[(Adapter->CurrentTxDesc + NUM_TRANSMIT_DESCRIPTORS - 1) % NUM_TRANSMIT_DESCRIPTORS] = Packet;
+
     return NDIS_STATUS_PENDING;
 }
+
+VOID
+NTAPI
+MiniportSendPackets(
+    _In_ NDIS_HANDLE MiniportAdapterContext,
+    _In_ PPNDIS_PACKET PacketArray,
+    _In_ UINT NumberOfPackets)
+{
+    PE1000_ADAPTER Adapter = (PE1000_ADAPTER)MiniportAdapterContext;
+    NDIS_STATUS Status = NDIS_STATUS_SUCCESS;
+    ULONG NumQueued = 0;
+    UINT n;
+
+    for (n = 0; n < NumberOfPackets; ++n)
+    {
+        /* Keep the order, once we run out of descriptors NDIS retries the rest */
+        if (Status != NDIS_STATUS_RESOURCES)
+        {
+            Status = NICTransmitPacket(Adapter, PacketArray[n]);
+        }
+
+        if (Status == NDIS_STATUS_PENDING)
+        {
+            NumQueued++;
+        }
+        else if (Status != NDIS_STATUS_RESOURCES)
+        {
+            NDIS_DbgPrint(MIN_TRACE, ("Transmit packet failed (0x%x)\n", Status));
+        }
+
+        NDIS_SET_PACKET_STATUS(PacketArray[n], Status);
+    }
+
+    /* One doorbell for the whole batch */
+    if (NumQueued)
+    {
+        E1000WriteUlong(Adapter, E1000_REG_TDT, Adapter->CurrentTxDesc);
+    }
+}
@@ -255,6 +255,8 @@ USBPORT_OpenInterface(IN PURB Urb,
     PUSBPORT_INTERFACE_HANDLE InterfaceHandle = NULL;
     PUSBPORT_PIPE_HANDLE PipeHandle;
     PUSB_ENDPOINT_DESCRIPTOR Descriptor;
+    PUSB_SUPERSPEED_ENDPOINT_COMPANION_DESCRIPTOR Companion;
+    ULONG_PTR ConfigEnd;
     PUSBD_PIPE_INFORMATION PipeInfo;
     BOOLEAN HasAlternates;
     ULONG NumEndpoints;
@@ -277,6 +279,9 @@ USBPORT_OpenInterface(IN PURB Urb,
 
     NumEndpoints = InterfaceDescriptor->bNumEndpoints;
 
+    ConfigEnd = (ULONG_PTR)ConfigHandle->ConfigurationDescriptor +
+                ConfigHandle->ConfigurationDescriptor->wTotalLength;
+
     Length = FIELD_OFFSET(USBD_INTERFACE_INFORMATION, Pipes) +
              NumEndpoints * sizeof(USBD_PIPE_INFORMATION);
 
@@ -378,6 +383,20 @@ USBPORT_OpenInterface(IN PURB Urb,
                       Descriptor,
                       sizeof(USB_ENDPOINT_DESCRIPTOR));
 
+        /* USB 3 endpoints are followed by their SuperSpeed companion */
+        Companion = (PUSB_SUPERSPEED_ENDPOINT_COMPANION_DESCRIPTOR)((ULONG_PTR)Descriptor +
+                                                                    Descriptor->bLength);
+
+        if ((ULONG_PTR)Companion + sizeof(*Companion) <= ConfigEnd &&
+            Companion->bDescriptorType == USB_SUPERSPEED_ENDPOINT_COMPANION_DESCRIPTOR_TYPE)
+        {
+            PipeHandle->MaxBurst = Companion->bMaxBurst;
+        }
+        else
+        {
+            PipeHandle->MaxBurst = 0;
+        }
+
         PipeHandle->Flags = PIPE_HANDLE_FLAG_CLOSED;
         PipeHandle->PipeFlags = InterfaceInfo->Pipes[ix].PipeFlags;
         PipeHandle->Endpoint = NULL;
@@ -1172,7 +1191,9 @@ USBPORT_CreateDevice(IN OUT PUSB_DEVICE_HANDLE *pUsbdDeviceHandle,
         {
             MaxPacketSize = DeviceHandle->DeviceDescriptor.bMaxPacketSize0;
 
+            /* USB 3 devices report 2^9 = 512 bytes */
             if (MaxPacketSize == 8 ||
+                MaxPacketSize == 9 ||
                 MaxPacketSize == 16 ||
                 MaxPacketSize == 32 ||
                 MaxPacketSize == 64)
@@ -1396,6 +1417,7 @@ USBPORT_InitializeDevice(IN PUSBPORT_DEVICE_HANDLE DeviceHandle,
         MaxPacketSize = DeviceHandle->DeviceDescriptor.bMaxPacketSize0;
 
         ASSERT((MaxPacketSize == 8) ||
+               (MaxPacketSize == 9) ||
                (MaxPacketSize == 16) ||
                (MaxPacketSize == 32) ||
                (MaxPacketSize == 64));
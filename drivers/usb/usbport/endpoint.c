@@ -772,6 +772,7 @@ USBPORT_OpenPipe(IN PDEVICE_OBJECT FdoDevice,
     PUSBPORT_ENDPOINT Endpoint;
     PUSBPORT_ENDPOINT_PROPERTIES EndpointProperties;
     PUSB_ENDPOINT_DESCRIPTOR EndpointDescriptor;
+    PUSBPORT_DEVICE_HANDLE HubHandle;
     UCHAR Direction;
     UCHAR Interval;
     UCHAR Period;
@@ -869,6 +870,7 @@ USBPORT_OpenPipe(IN PDEVICE_OBJECT FdoDevice,
     EndpointProperties->MaxPacketSize = MaxPacketSize;
     EndpointProperties->TotalMaxPacketSize = MaxPacketSize *
                                              (AdditionalTransaction + 1);
+    EndpointProperties->MaxBurst = PipeHandle->MaxBurst;
 
     if (Endpoint->TtExtension)
     {
@@ -881,6 +883,27 @@ USBPORT_OpenPipe(IN PDEVICE_OBJECT FdoDevice,
 
     EndpointProperties->PortNumber = DeviceHandle->PortNumber;
 
+    /* xHCI addresses devices by the route through the hubs */
+    for (HubHandle = DeviceHandle;
+         HubHandle->HubDeviceHandle;
+         HubHandle = HubHandle->HubDeviceHandle)
+    {
+        if (Endpoint->TtExtension &&
+            HubHandle->HubDeviceHandle->DeviceAddress == Endpoint->TtExtension->DeviceAddress)
+        {
+            EndpointProperties->TtPortNumber = (UCHAR)HubHandle->PortNumber;
+        }
+
+        if (HubHandle->HubDeviceHandle->IsRootHub)
+        {
+            EndpointProperties->RootPortNumber = (UCHAR)HubHandle->PortNumber;
+            break;
+        }
+
+        EndpointProperties->RouteString = (EndpointProperties->RouteString << 4) |
+                                          min(HubHandle->PortNumber, 15);
+    }
+
     switch (EndpointDescriptor->bmAttributes & USB_ENDPOINT_TYPE_MASK)
     {
         case USB_ENDPOINT_TYPE_CONTROL:
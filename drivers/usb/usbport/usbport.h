@@ -163,7 +163,7 @@ typedef struct _USBPORT_PIPE_HANDLE {
   ULONG Flags;
   ULONG PipeFlags;
   USB_ENDPOINT_DESCRIPTOR EndpointDescriptor;
-  UCHAR Padded;
+  UCHAR MaxBurst; // From the SuperSpeed endpoint companion descriptor
   PUSBPORT_ENDPOINT Endpoint;
   LIST_ENTRY PipeLink;
 } USBPORT_PIPE_HANDLE, *PUSBPORT_PIPE_HANDLE;
@@ -135,48 +135,62 @@ USBSTOR_GetDescriptors(
      return Status;
 }
 
+PUSB_INTERFACE_DESCRIPTOR
+USBSTOR_FindInterfaceDescriptor(
+    IN PUSB_CONFIGURATION_DESCRIPTOR ConfigurationDescriptor,
+    IN UCHAR InterfaceNumber,
+    IN UCHAR InterfaceProtocol)
+{
+    // the transports are alternate settings of the same interface
+    return USBD_ParseConfigurationDescriptorEx(ConfigurationDescriptor,
+                                               ConfigurationDescriptor,
+                                               InterfaceNumber,
+                                               -1,
+                                               -1,
+                                               -1,
+                                               InterfaceProtocol);
+}
+
 NTSTATUS
 NTAPI
 USBSTOR_ScanConfigurationDescriptor(
     IN PUSB_CONFIGURATION_DESCRIPTOR ConfigurationDescriptor,
-    OUT PUSB_INTERFACE_DESCRIPTOR *OutInterfaceDescriptor,
+    IN PUSB_INTERFACE_DESCRIPTOR InterfaceDescriptor,
     OUT PUSB_ENDPOINT_DESCRIPTOR  *InEndpointDescriptor,
     OUT PUSB_ENDPOINT_DESCRIPTOR  *OutEndpointDescriptor)
 {
-    PUSB_CONFIGURATION_DESCRIPTOR CurrentDescriptor;
+    PUSB_COMMON_DESCRIPTOR CurrentDescriptor;
     PUSB_ENDPOINT_DESCRIPTOR EndpointDescriptor;
 
     ASSERT(ConfigurationDescriptor);
-    ASSERT(OutInterfaceDescriptor);
+    ASSERT(InterfaceDescriptor);
     ASSERT(InEndpointDescriptor);
     ASSERT(OutEndpointDescriptor);
 
-    *OutInterfaceDescriptor = NULL;
     *InEndpointDescriptor = NULL;
     *OutEndpointDescriptor = NULL;
 
-    // start scanning
-    CurrentDescriptor = ConfigurationDescriptor;
+    // start scanning after the interface descriptor
+    CurrentDescriptor = (PUSB_COMMON_DESCRIPTOR)((ULONG_PTR)InterfaceDescriptor + InterfaceDescriptor->bLength);
 
-    do
+    while ((ULONG_PTR)CurrentDescriptor < ((ULONG_PTR)ConfigurationDescriptor + ConfigurationDescriptor->wTotalLength))
     {
         if (CurrentDescriptor->bDescriptorType == USB_INTERFACE_DESCRIPTOR_TYPE)
         {
-            if (*OutInterfaceDescriptor)
-            {
-                // we only process the first interface descriptor as ms does -> see documentation
-                break;
-            }
+            // the endpoints of the next interface or alternate setting follow
+            break;
+        }
 
-            // store interface descriptor
-            *OutInterfaceDescriptor = (PUSB_INTERFACE_DESCRIPTOR)CurrentDescriptor;
+        if (CurrentDescriptor->bLength == 0)
+        {
+            // broken descriptor
+            break;
         }
-        else if (CurrentDescriptor->bDescriptorType == USB_ENDPOINT_DESCRIPTOR_TYPE)
+
+        if (CurrentDescriptor->bDescriptorType == USB_ENDPOINT_DESCRIPTOR_TYPE)
         {
             EndpointDescriptor = (PUSB_ENDPOINT_DESCRIPTOR)CurrentDescriptor;
 
-            ASSERT(*OutInterfaceDescriptor);
-
             // get endpoint type
             if ((EndpointDescriptor->bmAttributes & USB_ENDPOINT_TYPE_MASK) == USB_ENDPOINT_TYPE_BULK)
             {
@@ -196,20 +210,13 @@ USBSTOR_ScanConfigurationDescriptor(
         }
 
         // move to next descriptor
-        CurrentDescriptor = (PUSB_CONFIGURATION_DESCRIPTOR)((ULONG_PTR)CurrentDescriptor + CurrentDescriptor->bLength);
-
-        // was it the last descriptor
-        if ((ULONG_PTR)CurrentDescriptor >= ((ULONG_PTR)ConfigurationDescriptor + ConfigurationDescriptor->wTotalLength))
-        {
-            break;
-        }
-
-    } while(TRUE);
+        CurrentDescriptor = (PUSB_COMMON_DESCRIPTOR)((ULONG_PTR)CurrentDescriptor + CurrentDescriptor->bLength);
+    }
 
     // check if everything has been found
-    if (*OutInterfaceDescriptor == NULL || *InEndpointDescriptor == NULL || *OutEndpointDescriptor == NULL)
+    if (*InEndpointDescriptor == NULL || *OutEndpointDescriptor == NULL)
     {
-        DPRINT1("USBSTOR_ScanConfigurationDescriptor: Failed to find InterfaceDescriptor %p InEndpointDescriptor %p OutEndpointDescriptor %p\n", *OutInterfaceDescriptor, *InEndpointDescriptor, *OutEndpointDescriptor);
+        DPRINT1("USBSTOR_ScanConfigurationDescriptor: Failed to find InEndpointDescriptor %p OutEndpointDescriptor %p\n", *InEndpointDescriptor, *OutEndpointDescriptor);
         return STATUS_UNSUCCESSFUL;
     }
 
@@ -233,15 +240,15 @@ DumpConfigurationDescriptor(PUSB_CONFIGURATION_DESCRIPTOR ConfigurationDescripto
 NTSTATUS
 USBSTOR_SelectConfigurationAndInterface(
     IN PDEVICE_OBJECT DeviceObject,
-    IN PFDO_DEVICE_EXTENSION DeviceExtension)
+    IN PFDO_DEVICE_EXTENSION DeviceExtension,
+    IN PUSB_INTERFACE_DESCRIPTOR InterfaceDescriptor)
 {
-    PUSB_INTERFACE_DESCRIPTOR InterfaceDescriptor;
     PUSB_ENDPOINT_DESCRIPTOR InEndpointDescriptor, OutEndpointDescriptor;
     NTSTATUS Status;
     PURB Urb;
     PUSBD_INTERFACE_LIST_ENTRY InterfaceList;
 
-    Status = USBSTOR_ScanConfigurationDescriptor(DeviceExtension->ConfigurationDescriptor, &InterfaceDescriptor, &InEndpointDescriptor, &OutEndpointDescriptor);
+    Status = USBSTOR_ScanConfigurationDescriptor(DeviceExtension->ConfigurationDescriptor, InterfaceDescriptor, &InEndpointDescriptor, &OutEndpointDescriptor);
     if (!NT_SUCCESS(Status))
     {
         return Status;
@@ -85,6 +85,7 @@ USBSTOR_HandleInternalDeviceControl(
     PIO_STACK_LOCATION IoStack;
     PSCSI_REQUEST_BLOCK Request;
     PPDO_DEVICE_EXTENSION PDODeviceExtension;
+    PFDO_DEVICE_EXTENSION FDODeviceExtension;
     NTSTATUS Status;
 
     IoStack = IoGetCurrentIrpStackLocation(Irp);
@@ -116,6 +117,14 @@ USBSTOR_HandleInternalDeviceControl(
             IoMarkIrpPending(Irp);
             Request->SrbStatus = SRB_STATUS_PENDING;
 
+            FDODeviceExtension = (PFDO_DEVICE_EXTENSION)PDODeviceExtension->LowerDeviceObject->DeviceExtension;
+            if (FDODeviceExtension->Protocol == USB_PROTOCOL_UAS)
+            {
+                // tagged commands don't go through StartIo
+                USBSTOR_UasQueueRequest(PDODeviceExtension->LowerDeviceObject, Irp);
+                return STATUS_PENDING;
+            }
+
             // add the request
             if (!USBSTOR_QueueAddIrp(PDODeviceExtension->LowerDeviceObject, Irp))
             {
@@ -160,7 +169,15 @@ USBSTOR_HandleInternalDeviceControl(
         {
             DPRINT1("SRB_FUNCTION_RELEASE_QUEUE\n");
 
-            USBSTOR_QueueRelease(PDODeviceExtension->LowerDeviceObject);
+            FDODeviceExtension = (PFDO_DEVICE_EXTENSION)PDODeviceExtension->LowerDeviceObject->DeviceExtension;
+            if (FDODeviceExtension->Protocol == USB_PROTOCOL_UAS)
+            {
+                USBSTOR_UasQueueRelease(PDODeviceExtension->LowerDeviceObject);
+            }
+            else
+            {
+                USBSTOR_QueueRelease(PDODeviceExtension->LowerDeviceObject);
+            }
 
             Request->SrbStatus = SRB_STATUS_SUCCESS;
             Status = STATUS_SUCCESS;
@@ -321,7 +338,7 @@ USBSTOR_HandleQueryProperty(
         DeviceDescriptor->DeviceType = InquiryData->DeviceType;
         DeviceDescriptor->DeviceTypeModifier = InquiryData->DeviceTypeModifier;
         DeviceDescriptor->RemovableMedia = InquiryData->RemovableMedia;
-        DeviceDescriptor->CommandQueueing = FALSE;
+        DeviceDescriptor->CommandQueueing = (FDODeviceExtension->Protocol == USB_PROTOCOL_UAS);
         DeviceDescriptor->BusType = BusTypeUsb;
         DeviceDescriptor->VendorIdOffset = sizeof(STORAGE_DEVICE_DESCRIPTOR) - sizeof(UCHAR);
         DeviceDescriptor->ProductIdOffset = DeviceDescriptor->VendorIdOffset + FieldLengthVendor + 1;
@@ -384,6 +401,9 @@ USBSTOR_HandleQueryProperty(
             return STATUS_SUCCESS;
         }
 
+        PDODeviceExtension = (PPDO_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
+        FDODeviceExtension = (PFDO_DEVICE_EXTENSION)PDODeviceExtension->LowerDeviceObject->DeviceExtension;
+
         // get adapter descriptor, information is returned in the same buffer
         AdapterDescriptor = Irp->AssociatedIrp.SystemBuffer;
 
@@ -395,6 +415,7 @@ USBSTOR_HandleQueryProperty(
             .Size = sizeof(STORAGE_ADAPTER_DESCRIPTOR_WIN8),
             .MaximumTransferLength = USBSTOR_DEFAULT_MAX_TRANSFER_LENGTH,
             .MaximumPhysicalPages = USBSTOR_DEFAULT_MAX_TRANSFER_LENGTH / PAGE_SIZE + 1, // See CORE-10515 and CORE-10755
+            .CommandQueueing = (FDODeviceExtension->Protocol == USB_PROTOCOL_UAS),
             .BusType = BusTypeUsb,
             .BusMajorVersion = 2, //FIXME verify
             .BusMinorVersion = 0 //FIXME
@@ -464,7 +485,8 @@ USBSTOR_HandleDeviceControl(
                 Capabilities->MaximumPhysicalPages = USBSTOR_DEFAULT_MAX_TRANSFER_LENGTH / PAGE_SIZE + 1; // See CORE-10515 and CORE-10755
                 Capabilities->SupportedAsynchronousEvents = 0;
                 Capabilities->AlignmentMask = 0;
-                Capabilities->TaggedQueuing = FALSE;
+                PDODeviceExtension = (PPDO_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
+                Capabilities->TaggedQueuing = (((PFDO_DEVICE_EXTENSION)PDODeviceExtension->LowerDeviceObject->DeviceExtension)->Protocol == USB_PROTOCOL_UAS);
                 Capabilities->AdapterScansDown = FALSE;
                 Capabilities->AdapterUsesPio = FALSE;
                 Status = STATUS_SUCCESS;
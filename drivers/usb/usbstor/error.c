@@ -70,6 +70,32 @@ USBSTOR_ResetPipeWithHandle(
     return Status;
 }
 
+NTSTATUS
+USBSTOR_AbortPipeWithHandle(
+    IN PDEVICE_OBJECT DeviceObject,
+    IN USBD_PIPE_HANDLE PipeHandle)
+{
+    PURB Urb;
+    NTSTATUS Status;
+
+    Urb = (PURB)AllocateItem(NonPagedPool, sizeof(struct _URB_PIPE_REQUEST));
+    if (!Urb)
+    {
+        DPRINT1("OutofMemory!\n");
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    Urb->UrbPipeRequest.Hdr.Length = sizeof(struct _URB_PIPE_REQUEST);
+    Urb->UrbPipeRequest.Hdr.Function = URB_FUNCTION_ABORT_PIPE;
+    Urb->UrbPipeRequest.PipeHandle = PipeHandle;
+
+    // completes once the transfers queued on the pipe are cancelled
+    Status = USBSTOR_SyncUrbRequest(DeviceObject, Urb);
+
+    FreeItem(Urb);
+    return Status;
+}
+
 VOID
 NTAPI
 USBSTOR_ResetPipeWorkItemRoutine(
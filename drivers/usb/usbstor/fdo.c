@@ -53,7 +53,7 @@ USBSTOR_FdoHandleDeviceRelations(
     if (IoStack->Parameters.QueryDeviceRelations.Type == BusRelations)
     {
         // go through array and count device objects
-        for (Index = 0; Index < max(DeviceExtension->MaxLUN, 1); Index++)
+        for (Index = 0; Index <= DeviceExtension->MaxLUN; Index++)
         {
             if (DeviceExtension->ChildPDO[Index])
             {
@@ -73,7 +73,7 @@ USBSTOR_FdoHandleDeviceRelations(
         DeviceRelations->Count = 0;
 
         // add device objects
-        for (Index = 0; Index < max(DeviceExtension->MaxLUN, 1); Index++)
+        for (Index = 0; Index <= DeviceExtension->MaxLUN; Index++)
         {
             if (DeviceExtension->ChildPDO[Index])
             {
@@ -130,6 +130,11 @@ USBSTOR_FdoHandleRemoveDevice(
     ExFreePoolWithTag(DeviceExtension->InterfaceInformation, USB_STOR_TAG);
     IoFreeWorkItem(DeviceExtension->ResetDeviceWorkItem);
 
+    if (DeviceExtension->Protocol == USB_PROTOCOL_UAS)
+    {
+        USBSTOR_UasUninitialize(DeviceExtension);
+    }
+
     if (DeviceExtension->SerialNumber)
     {
         ExFreePoolWithTag(DeviceExtension->SerialNumber, USB_STOR_TAG);
@@ -154,7 +159,7 @@ USBSTOR_FdoHandleStartDevice(
     IN PFDO_DEVICE_EXTENSION DeviceExtension,
     IN OUT PIRP Irp)
 {
-    PUSB_INTERFACE_DESCRIPTOR InterfaceDesc;
+    PUSB_INTERFACE_DESCRIPTOR InterfaceDesc, TransportDesc;
     NTSTATUS Status;
     UCHAR Index = 0;
     PIO_WORKITEM WorkItem;
@@ -204,21 +209,39 @@ USBSTOR_FdoHandleStartDevice(
     ASSERT(InterfaceDesc->bDescriptorType == USB_INTERFACE_DESCRIPTOR_TYPE);
     ASSERT(InterfaceDesc->bLength == sizeof(USB_INTERFACE_DESCRIPTOR));
 
-    DPRINT("bInterfaceSubClass %x\n", InterfaceDesc->bInterfaceSubClass);
-    if (InterfaceDesc->bInterfaceProtocol != USB_PROTOCOL_BULK)
+    // prefer USB Attached SCSI, it can keep several commands on the device.
+    // At super speed UAS needs bulk streams which we don't have, so those devices
+    // report bcdUSB 3.x and have to use Bulk-Only from another alternate setting
+    TransportDesc = USBSTOR_FindInterfaceDescriptor(DeviceExtension->ConfigurationDescriptor,
+                                                    InterfaceDesc->bInterfaceNumber,
+                                                    USB_PROTOCOL_UAS);
+    if (TransportDesc && DeviceExtension->DeviceDescriptor->bcdUSB < 0x300)
+    {
+        DeviceExtension->Protocol = USB_PROTOCOL_UAS;
+    }
+    else
+    {
+        TransportDesc = USBSTOR_FindInterfaceDescriptor(DeviceExtension->ConfigurationDescriptor,
+                                                        InterfaceDesc->bInterfaceNumber,
+                                                        USB_PROTOCOL_BULK);
+        DeviceExtension->Protocol = USB_PROTOCOL_BULK;
+    }
+
+    if (!TransportDesc)
     {
         DPRINT1("USB Device is not a bulk only device and is not currently supported\n");
         return STATUS_NOT_SUPPORTED;
     }
 
-    if (InterfaceDesc->bInterfaceSubClass == USB_SUBCLASS_UFI)
+    DPRINT("bInterfaceSubClass %x bInterfaceProtocol %x\n", TransportDesc->bInterfaceSubClass, TransportDesc->bInterfaceProtocol);
+    if (TransportDesc->bInterfaceSubClass == USB_SUBCLASS_UFI)
     {
         DPRINT1("USB Floppy devices are not supported\n");
         return STATUS_NOT_SUPPORTED;
     }
 
     // now select an interface
-    Status = USBSTOR_SelectConfigurationAndInterface(DeviceObject, DeviceExtension);
+    Status = USBSTOR_SelectConfigurationAndInterface(DeviceObject, DeviceExtension, TransportDesc);
     if (!NT_SUCCESS(Status))
     {
         // failed to get device descriptor
@@ -226,24 +249,54 @@ USBSTOR_FdoHandleStartDevice(
         return Status;
     }
 
-    // check if we got a bulk in + bulk out endpoint
-    Status = USBSTOR_GetPipeHandles(DeviceExtension);
-    if (!NT_SUCCESS(Status))
+    if (DeviceExtension->Protocol == USB_PROTOCOL_UAS)
     {
-        DPRINT1("USBSTOR_FdoHandleStartDevice no pipe handles %x\n", Status);
-        return Status;
-    }
+        // find the command, status and data pipes
+        Status = USBSTOR_UasGetPipeHandles(DeviceExtension);
+        if (!NT_SUCCESS(Status))
+        {
+            DPRINT1("USBSTOR_FdoHandleStartDevice no UAS pipe handles %x\n", Status);
+            return Status;
+        }
 
-    Status = USBSTOR_GetMaxLUN(DeviceExtension->LowerDeviceObject, DeviceExtension);
-    if (!NT_SUCCESS(Status))
+        Status = USBSTOR_UasInitialize(DeviceObject);
+        if (!NT_SUCCESS(Status))
+        {
+            DPRINT1("USBSTOR_FdoHandleStartDevice failed to initialize UAS %x\n", Status);
+            return Status;
+        }
+
+        Status = USBSTOR_UasGetMaxLUN(DeviceExtension);
+        if (!NT_SUCCESS(Status))
+        {
+            DPRINT1("USBSTOR_FdoHandleStartDevice failed to get max lun %x\n", Status);
+            return Status;
+        }
+    }
+    else
     {
-        DPRINT1("USBSTOR_FdoHandleStartDevice failed to get max lun %x\n", Status);
-        return Status;
+        // check if we got a bulk in + bulk out endpoint
+        Status = USBSTOR_GetPipeHandles(DeviceExtension);
+        if (!NT_SUCCESS(Status))
+        {
+            DPRINT1("USBSTOR_FdoHandleStartDevice no pipe handles %x\n", Status);
+            return Status;
+        }
+
+        Status = USBSTOR_GetMaxLUN(DeviceExtension->LowerDeviceObject, DeviceExtension);
+        if (!NT_SUCCESS(Status))
+        {
+            DPRINT1("USBSTOR_FdoHandleStartDevice failed to get max lun %x\n", Status);
+            return Status;
+        }
     }
 
-    // now create for each LUN a device object, 1 minimum
-    do
+    // now create a device object for each LUN the device has, 1 minimum
+    for (Index = 0; Index <= DeviceExtension->MaxLUN; Index++)
     {
+        if (!(DeviceExtension->LunMask & (1 << Index)))
+            continue;
+
         Status = USBSTOR_CreatePDO(DeviceObject, Index);
 
         if (!NT_SUCCESS(Status))
@@ -252,10 +305,8 @@ USBSTOR_FdoHandleStartDevice(
             return Status;
         }
 
-        Index++;
         DeviceExtension->InstanceCount++;
-
-    } while(Index < DeviceExtension->MaxLUN);
+    }
 
 #if 0
     //
@@ -204,8 +204,9 @@ USBSTOR_GetMaxLUN(
         }
         else
         {
-            // store maxlun
+            // store maxlun, Bulk-Only LUNs are numbered without gaps
             DeviceExtension->MaxLUN = *Buffer;
+            DeviceExtension->LunMask = USBSTOR_ALL_LUNS(*Buffer);
         }
     }
     else
@@ -216,6 +217,7 @@ USBSTOR_GetMaxLUN(
         USBSTOR_ResetDevice(DeviceExtension->LowerDeviceObject, DeviceExtension);
 
         DeviceExtension->MaxLUN = 0;
+        DeviceExtension->LunMask = USBSTOR_ALL_LUNS(0);
         Status = STATUS_SUCCESS;
     }
 
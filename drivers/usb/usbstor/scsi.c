@@ -15,7 +15,6 @@
 #include <debug.h>
 
 
-static
 NTSTATUS
 USBSTOR_SrbStatusToNtStatus(
     IN PSCSI_REQUEST_BLOCK Srb)
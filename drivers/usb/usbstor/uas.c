@@ -0,0 +1,1311 @@
+/*
+ * PROJECT:     ReactOS Universal Serial Bus Bulk Storage Driver
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     USB Attached SCSI transport
+ */
+
+#include "usbstor.h"
+
+#define NDEBUG
+#include <debug.h>
+
+/*
+ * Without bulk streams the four UAS pipes are shared by all tags. The device
+ * asks for the data phase of a tag with a Read Ready or Write Ready IU on the
+ * status pipe and finishes the tag with a Sense IU, so one status read stays
+ * pending for as long as commands are outstanding.
+ */
+
+#define UAS_ALL_TAGS_FREE  ((1 << UAS_MAX_COMMANDS) - 1)
+
+C_ASSERT(UAS_MAX_COMMANDS < 32);
+
+typedef enum _UAS_ACTION
+{
+    UasActionNone,
+    UasActionStartData,
+    UasActionComplete
+} UAS_ACTION;
+
+static
+VOID
+USBSTOR_UasSubmitUrb(
+    IN PFDO_DEVICE_EXTENSION FDODeviceExtension,
+    IN PIRP Irp,
+    IN PURB Urb,
+    IN UCHAR PipeIndex,
+    IN ULONG TransferFlags,
+    IN ULONG TransferBufferLength,
+    IN PVOID TransferBuffer,
+    IN PMDL TransferBufferMDL,
+    IN PIO_COMPLETION_ROUTINE CompletionRoutine,
+    IN PVOID Context)
+{
+    PIO_STACK_LOCATION NextStack;
+
+    IoReuseIrp(Irp, STATUS_NOT_SUPPORTED);
+
+    UsbBuildInterruptOrBulkTransferRequest(Urb,
+                                           sizeof(struct _URB_BULK_OR_INTERRUPT_TRANSFER),
+                                           FDODeviceExtension->InterfaceInformation->Pipes[PipeIndex].PipeHandle,
+                                           TransferBuffer,
+                                           TransferBufferMDL,
+                                           TransferBufferLength,
+                                           TransferFlags,
+                                           NULL);
+
+    NextStack = IoGetNextIrpStackLocation(Irp);
+    NextStack->MajorFunction = IRP_MJ_INTERNAL_DEVICE_CONTROL;
+    NextStack->Parameters.DeviceIoControl.IoControlCode = IOCTL_INTERNAL_USB_SUBMIT_URB;
+    NextStack->Parameters.Others.Argument1 = Urb;
+
+    IoSetCompletionRoutine(Irp, CompletionRoutine, Context, TRUE, TRUE, TRUE);
+
+    IoCallDriver(FDODeviceExtension->LowerDeviceObject, Irp);
+}
+
+static
+NTSTATUS
+USBSTOR_UasSyncTransfer(
+    IN PFDO_DEVICE_EXTENSION FDODeviceExtension,
+    IN PURB Urb,
+    IN UCHAR PipeIndex,
+    IN ULONG TransferFlags,
+    IN ULONG TransferBufferLength,
+    IN PVOID TransferBuffer)
+{
+    UsbBuildInterruptOrBulkTransferRequest(Urb,
+                                           sizeof(struct _URB_BULK_OR_INTERRUPT_TRANSFER),
+                                           FDODeviceExtension->InterfaceInformation->Pipes[PipeIndex].PipeHandle,
+                                           TransferBuffer,
+                                           NULL,
+                                           TransferBufferLength,
+                                           TransferFlags,
+                                           NULL);
+
+    return USBSTOR_SyncUrbRequest(FDODeviceExtension->LowerDeviceObject, Urb);
+}
+
+// must be called with the IrpListLock held
+static
+PUAS_COMMAND
+USBSTOR_UasAllocateCommand(
+    IN PFDO_DEVICE_EXTENSION FDODeviceExtension,
+    IN PIRP Irp)
+{
+    PUAS_COMMAND Command;
+    ULONG Index;
+
+    for (Index = 0; Index < UAS_MAX_COMMANDS; Index++)
+    {
+        if (FDODeviceExtension->UasFreeTags & (1 << Index))
+        {
+            FDODeviceExtension->UasFreeTags &= ~(1 << Index);
+
+            Command = &FDODeviceExtension->UasCommands[Index];
+            ASSERT(Command->Irp == NULL);
+
+            Command->Irp = Irp;
+            Command->Flags = UAS_COMMAND_BUSY;
+            Command->SrbStatus = SRB_STATUS_PENDING;
+            Command->ScsiStatus = SCSISTAT_GOOD;
+            return Command;
+        }
+    }
+
+    return NULL;
+}
+
+// must be called with the IrpListLock held, returns the request to complete
+static
+PIRP
+USBSTOR_UasReleaseCommand(
+    IN PFDO_DEVICE_EXTENSION FDODeviceExtension,
+    IN PUAS_COMMAND Command)
+{
+    PSCSI_REQUEST_BLOCK Request;
+    PIRP Irp;
+
+    Irp = Command->Irp;
+    Request = IoGetCurrentIrpStackLocation(Irp)->Parameters.Scsi.Srb;
+
+    if (Command->Flags & UAS_COMMAND_ERROR)
+    {
+        Request->SrbStatus = SRB_STATUS_BUS_RESET;
+        Request->DataTransferLength = 0;
+    }
+    else
+    {
+        Request->SrbStatus = Command->SrbStatus;
+        Request->ScsiStatus = Command->ScsiStatus;
+
+        if (SRB_STATUS(Request->SrbStatus) != SRB_STATUS_SUCCESS)
+        {
+            Request->DataTransferLength = 0;
+        }
+        else if (Command->Flags & UAS_COMMAND_UNDERRUN)
+        {
+            Request->SrbStatus = SRB_STATUS_DATA_OVERRUN;
+        }
+    }
+
+    Command->Irp = NULL;
+    FDODeviceExtension->UasFreeTags |= 1 << (Command->Tag - 1);
+
+    return Irp;
+}
+
+// must be called with the IrpListLock held
+static
+UAS_ACTION
+USBSTOR_UasCheckCommand(
+    IN PUAS_COMMAND Command)
+{
+    // the lower driver still has our irp
+    if (Command->Flags & UAS_COMMAND_BUSY)
+    {
+        return UasActionNone;
+    }
+
+    if (Command->Flags & (UAS_COMMAND_STATUS | UAS_COMMAND_ERROR))
+    {
+        return UasActionComplete;
+    }
+
+    // the ready IU can be seen before the command IU completion
+    if ((Command->Flags & (UAS_COMMAND_SENT | UAS_COMMAND_READY | UAS_COMMAND_DATA)) == (UAS_COMMAND_SENT | UAS_COMMAND_READY))
+    {
+        Command->Flags |= UAS_COMMAND_DATA | UAS_COMMAND_BUSY;
+        return UasActionStartData;
+    }
+
+    return UasActionNone;
+}
+
+IO_WORKITEM_ROUTINE USBSTOR_UasResetWorkItemRoutine;
+
+static
+VOID
+USBSTOR_UasQueueReset(
+    IN PFDO_DEVICE_EXTENSION FDODeviceExtension)
+{
+    KIRQL OldIrql;
+
+    KeAcquireSpinLock(&FDODeviceExtension->CommonLock, &OldIrql);
+
+    if (FDODeviceExtension->Flags & USBSTOR_FDO_FLAGS_DEVICE_RESETTING)
+    {
+        // the reset takes care of everything in flight
+        KeReleaseSpinLock(&FDODeviceExtension->CommonLock, OldIrql);
+        return;
+    }
+
+    FDODeviceExtension->Flags |= USBSTOR_FDO_FLAGS_DEVICE_RESETTING;
+    KeReleaseSpinLock(&FDODeviceExtension->CommonLock, OldIrql);
+
+    DPRINT1("USBSTOR_UasQueueReset\n");
+
+    IoQueueWorkItem(FDODeviceExtension->ResetDeviceWorkItem,
+                    USBSTOR_UasResetWorkItemRoutine,
+                    CriticalWorkQueue,
+                    NULL);
+}
+
+static
+VOID
+USBSTOR_UasCompleteRequest(
+    IN PDEVICE_OBJECT FdoDevice,
+    IN PIRP Irp)
+{
+    PSCSI_REQUEST_BLOCK Request;
+
+    Request = IoGetCurrentIrpStackLocation(Irp)->Parameters.Scsi.Srb;
+
+    DPRINT("USBSTOR_UasCompleteRequest Irp %p SrbStatus %x Length %lu\n", Irp, Request->SrbStatus, Request->DataTransferLength);
+
+    Irp->IoStatus.Status = USBSTOR_SrbStatusToNtStatus(Request);
+    Irp->IoStatus.Information = Request->DataTransferLength;
+
+    USBSTOR_QueueTerminateRequest(FdoDevice, Irp);
+    IoCompleteRequest(Irp, IO_NO_INCREMENT);
+}
+
+static
+VOID
+USBSTOR_UasStartStatusRead(
+    IN PFDO_DEVICE_EXTENSION FDODeviceExtension);
+
+static
+VOID
+USBSTOR_UasStartNextRequest(
+    IN PDEVICE_OBJECT FdoDevice);
+
+IO_COMPLETION_ROUTINE USBSTOR_UasCommandCompletionRoutine;
+
+static
+VOID
+USBSTOR_UasSendData(
+    IN PFDO_DEVICE_EXTENSION FDODeviceExtension,
+    IN PUAS_COMMAND Command)
+{
+    PSCSI_REQUEST_BLOCK Request;
+    PIRP Irp = Command->Irp;
+    ULONG TransferFlags;
+    UCHAR PipeIndex;
+    PMDL Mdl;
+    KIRQL OldIrql;
+    UAS_ACTION Action;
+
+    Request = IoGetCurrentIrpStackLocation(Irp)->Parameters.Scsi.Srb;
+
+    if ((Request->SrbFlags & SRB_FLAGS_UNSPECIFIED_DIRECTION) == SRB_FLAGS_DATA_IN)
+    {
+        PipeIndex = FDODeviceExtension->BulkInPipeIndex;
+        TransferFlags = USBD_TRANSFER_DIRECTION_IN | USBD_SHORT_TRANSFER_OK;
+    }
+    else
+    {
+        PipeIndex = FDODeviceExtension->BulkOutPipeIndex;
+        TransferFlags = USBD_TRANSFER_DIRECTION_OUT;
+    }
+
+    if (MmGetMdlVirtualAddress(Irp->MdlAddress) == Request->DataBuffer)
+    {
+        Mdl = Irp->MdlAddress;
+    }
+    else
+    {
+        Mdl = IoAllocateMdl(Request->DataBuffer,
+                            Request->DataTransferLength,
+                            FALSE,
+                            FALSE,
+                            NULL);
+
+        if (Mdl)
+        {
+            IoBuildPartialMdl(Irp->MdlAddress,
+                              Mdl,
+                              Request->DataBuffer,
+                              Request->DataTransferLength);
+        }
+
+        Command->PartialMdl = Mdl;
+    }
+
+    if (!Mdl)
+    {
+        // the device waits for the data, so the tag can only be dropped with a reset
+        DPRINT1("USBSTOR_UasSendData: no Mdl for tag %u\n", Command->Tag);
+
+        KeAcquireSpinLock(&FDODeviceExtension->IrpListLock, &OldIrql);
+        Command->Flags &= ~UAS_COMMAND_BUSY;
+        Command->Flags |= UAS_COMMAND_ERROR;
+        Action = USBSTOR_UasCheckCommand(Command);
+        ASSERT(Action == UasActionComplete);
+        Irp = USBSTOR_UasReleaseCommand(FDODeviceExtension, Command);
+        KeReleaseSpinLock(&FDODeviceExtension->IrpListLock, OldIrql);
+
+        USBSTOR_UasQueueReset(FDODeviceExtension);
+        USBSTOR_UasCompleteRequest(FDODeviceExtension->FunctionalDeviceObject, Irp);
+        return;
+    }
+
+    USBSTOR_UasSubmitUrb(FDODeviceExtension,
+                         Command->UsbIrp,
+                         &Command->Urb,
+                         PipeIndex,
+                         TransferFlags,
+                         Request->DataTransferLength,
+                         NULL,
+                         Mdl,
+                         USBSTOR_UasCommandCompletionRoutine,
+                         Command);
+}
+
+static
+VOID
+USBSTOR_UasRunAction(
+    IN PFDO_DEVICE_EXTENSION FDODeviceExtension,
+    IN PUAS_COMMAND Command,
+    IN UAS_ACTION Action,
+    IN PIRP CompletedIrp)
+{
+    if (Action == UasActionStartData)
+    {
+        USBSTOR_UasSendData(FDODeviceExtension, Command);
+    }
+    else if (Action == UasActionComplete)
+    {
+        // the tag is free again, Command may already belong to somebody else
+        USBSTOR_UasCompleteRequest(FDODeviceExtension->FunctionalDeviceObject, CompletedIrp);
+        USBSTOR_UasStartNextRequest(FDODeviceExtension->FunctionalDeviceObject);
+    }
+}
+
+NTSTATUS
+NTAPI
+USBSTOR_UasCommandCompletionRoutine(
+    PDEVICE_OBJECT DeviceObject,
+    PIRP Irp,
+    PVOID Ctx)
+{
+    PUAS_COMMAND Command = (PUAS_COMMAND)Ctx;
+    PFDO_DEVICE_EXTENSION FDODeviceExtension;
+    PSCSI_REQUEST_BLOCK Request;
+    PIRP CompletedIrp = NULL;
+    BOOLEAN Reset = FALSE;
+    UAS_ACTION Action;
+    KIRQL OldIrql;
+
+    FDODeviceExtension = (PFDO_DEVICE_EXTENSION)Command->FdoDevice->DeviceExtension;
+    Request = IoGetCurrentIrpStackLocation(Command->Irp)->Parameters.Scsi.Srb;
+
+    DPRINT("USBSTOR_UasCommandCompletionRoutine tag %u Flags %lx Status %x\n", Command->Tag, Command->Flags, Irp->IoStatus.Status);
+
+    if (Command->PartialMdl)
+    {
+        IoFreeMdl(Command->PartialMdl);
+        Command->PartialMdl = NULL;
+    }
+
+    KeAcquireSpinLock(&FDODeviceExtension->IrpListLock, &OldIrql);
+
+    Command->Flags &= ~UAS_COMMAND_BUSY;
+
+    if (!NT_SUCCESS(Irp->IoStatus.Status))
+    {
+        DPRINT1("USBSTOR_UasCommandCompletionRoutine: tag %u Urb.Hdr.Status - %x\n", Command->Tag, Command->Urb.UrbHeader.Status);
+        Command->Flags |= UAS_COMMAND_ERROR;
+        Reset = TRUE;
+    }
+    else if (Command->Flags & UAS_COMMAND_DATA)
+    {
+        // the data phase is over
+        if (Command->Urb.UrbBulkOrInterruptTransfer.TransferBufferLength < Request->DataTransferLength)
+        {
+            Request->DataTransferLength = Command->Urb.UrbBulkOrInterruptTransfer.TransferBufferLength;
+            Command->Flags |= UAS_COMMAND_UNDERRUN;
+        }
+    }
+    else
+    {
+        Command->Flags |= UAS_COMMAND_SENT;
+    }
+
+    Action = USBSTOR_UasCheckCommand(Command);
+    if (Action == UasActionComplete)
+    {
+        CompletedIrp = USBSTOR_UasReleaseCommand(FDODeviceExtension, Command);
+    }
+
+    KeReleaseSpinLock(&FDODeviceExtension->IrpListLock, OldIrql);
+
+    if (Reset)
+    {
+        USBSTOR_UasQueueReset(FDODeviceExtension);
+    }
+
+    USBSTOR_UasRunAction(FDODeviceExtension, Command, Action, CompletedIrp);
+
+    // the irp is ours
+    return STATUS_MORE_PROCESSING_REQUIRED;
+}
+
+// must be called with the IrpListLock held
+static
+VOID
+USBSTOR_UasHandleSense(
+    IN PUAS_COMMAND Command,
+    IN PUAS_SENSE_IU SenseIu,
+    IN ULONG Length)
+{
+    PSCSI_REQUEST_BLOCK Request;
+    ULONG SenseLength;
+
+    Request = IoGetCurrentIrpStackLocation(Command->Irp)->Parameters.Scsi.Srb;
+
+    Command->ScsiStatus = SenseIu->Status;
+
+    if (SenseIu->Status == SCSISTAT_GOOD)
+    {
+        Command->SrbStatus = SRB_STATUS_SUCCESS;
+        return;
+    }
+
+    // additional information should be read by higher-level driver from SenseInfoBuffer
+    Command->SrbStatus = SRB_STATUS_ERROR;
+
+    // UAS always returns the sense data with the status, no REQUEST SENSE round trip
+    SenseLength = RtlUshortByteSwap(SenseIu->SenseLength);
+    SenseLength = min(SenseLength, Length - FIELD_OFFSET(UAS_SENSE_IU, SenseData));
+
+    if (!(Request->SrbFlags & SRB_FLAGS_DISABLE_AUTOSENSE) &&
+        Request->SenseInfoBufferLength &&
+        Request->SenseInfoBuffer &&
+        SenseLength)
+    {
+        SenseLength = min(SenseLength, Request->SenseInfoBufferLength);
+        RtlCopyMemory(Request->SenseInfoBuffer, SenseIu->SenseData, SenseLength);
+
+        Request->SenseInfoBufferLength = (UCHAR)SenseLength;
+        Command->SrbStatus |= SRB_STATUS_AUTOSENSE_VALID;
+    }
+}
+
+IO_COMPLETION_ROUTINE USBSTOR_UasStatusCompletionRoutine;
+
+NTSTATUS
+NTAPI
+USBSTOR_UasStatusCompletionRoutine(
+    PDEVICE_OBJECT DeviceObject,
+    PIRP Irp,
+    PVOID Ctx)
+{
+    PFDO_DEVICE_EXTENSION FDODeviceExtension = (PFDO_DEVICE_EXTENSION)Ctx;
+    PUAS_IU_HEADER Header = (PUAS_IU_HEADER)FDODeviceExtension->UasStatusBuffer;
+    PUAS_COMMAND Command = NULL;
+    UAS_ACTION Action = UasActionNone;
+    PIRP CompletedIrp = NULL;
+    BOOLEAN Reset = FALSE;
+    ULONG Length;
+    USHORT Tag;
+    KIRQL OldIrql;
+
+    Length = FDODeviceExtension->UasStatusUrb.UrbBulkOrInterruptTransfer.TransferBufferLength;
+
+    DPRINT("USBSTOR_UasStatusCompletionRoutine Status %x Length %lu\n", Irp->IoStatus.Status, Length);
+
+    KeAcquireSpinLock(&FDODeviceExtension->IrpListLock, &OldIrql);
+
+    FDODeviceExtension->UasStatusPending = FALSE;
+
+    if (!NT_SUCCESS(Irp->IoStatus.Status))
+    {
+        DPRINT1("USBSTOR_UasStatusCompletionRoutine: Urb.Hdr.Status - %x\n", FDODeviceExtension->UasStatusUrb.UrbHeader.Status);
+        Reset = TRUE;
+    }
+    else if (Length < sizeof(UAS_IU_HEADER))
+    {
+        DPRINT1("USBSTOR_UasStatusCompletionRoutine: short IU %lu\n", Length);
+        Reset = TRUE;
+    }
+    else
+    {
+        Tag = RtlUshortByteSwap(Header->Tag);
+
+        if (Tag >= 1 && Tag <= UAS_MAX_COMMANDS && FDODeviceExtension->UasCommands[Tag - 1].Irp)
+        {
+            Command = &FDODeviceExtension->UasCommands[Tag - 1];
+        }
+
+        if (!Command)
+        {
+            DPRINT1("USBSTOR_UasStatusCompletionRoutine: IU %x for unknown tag %u\n", Header->IuId, Tag);
+            Reset = TRUE;
+        }
+        else if (Header->IuId == UAS_IU_READ_READY || Header->IuId == UAS_IU_WRITE_READY)
+        {
+            Command->Flags |= UAS_COMMAND_READY;
+        }
+        else if (Header->IuId == UAS_IU_SENSE && Length >= FIELD_OFFSET(UAS_SENSE_IU, SenseData))
+        {
+            USBSTOR_UasHandleSense(Command, (PUAS_SENSE_IU)Header, Length);
+            Command->Flags |= UAS_COMMAND_STATUS;
+        }
+        else if (Header->IuId == UAS_IU_RESPONSE && Length >= sizeof(UAS_RESPONSE_IU))
+        {
+            // the device did not take the command IU at all
+            DPRINT1("USBSTOR_UasStatusCompletionRoutine: tag %u response code %x\n", Tag, ((PUAS_RESPONSE_IU)Header)->ResponseCode);
+            Command->SrbStatus = SRB_STATUS_ERROR;
+            Command->Flags |= UAS_COMMAND_STATUS;
+        }
+        else
+        {
+            DPRINT1("USBSTOR_UasStatusCompletionRoutine: unexpected IU %x Length %lu\n", Header->IuId, Length);
+            Reset = TRUE;
+        }
+
+        if (!Reset)
+        {
+            Action = USBSTOR_UasCheckCommand(Command);
+            if (Action == UasActionComplete)
+            {
+                CompletedIrp = USBSTOR_UasReleaseCommand(FDODeviceExtension, Command);
+            }
+        }
+    }
+
+    KeReleaseSpinLock(&FDODeviceExtension->IrpListLock, OldIrql);
+
+    if (Reset)
+    {
+        USBSTOR_UasQueueReset(FDODeviceExtension);
+        return STATUS_MORE_PROCESSING_REQUIRED;
+    }
+
+    USBSTOR_UasRunAction(FDODeviceExtension, Command, Action, CompletedIrp);
+
+    // wait for the next IU if anything is still outstanding
+    USBSTOR_UasStartStatusRead(FDODeviceExtension);
+
+    return STATUS_MORE_PROCESSING_REQUIRED;
+}
+
+static
+VOID
+USBSTOR_UasStartStatusRead(
+    IN PFDO_DEVICE_EXTENSION FDODeviceExtension)
+{
+    KIRQL OldIrql;
+
+    KeAcquireSpinLock(&FDODeviceExtension->IrpListLock, &OldIrql);
+
+    if (FDODeviceExtension->UasStatusPending ||
+        FDODeviceExtension->UasFreeTags == UAS_ALL_TAGS_FREE ||
+        BooleanFlagOn(FDODeviceExtension->Flags, USBSTOR_FDO_FLAGS_DEVICE_RESETTING))
+    {
+        KeReleaseSpinLock(&FDODeviceExtension->IrpListLock, OldIrql);
+        return;
+    }
+
+    FDODeviceExtension->UasStatusPending = TRUE;
+
+    KeReleaseSpinLock(&FDODeviceExtension->IrpListLock, OldIrql);
+
+    USBSTOR_UasSubmitUrb(FDODeviceExtension,
+                         FDODeviceExtension->UasStatusIrp,
+                         &FDODeviceExtension->UasStatusUrb,
+                         FDODeviceExtension->StatusPipeIndex,
+                         USBD_TRANSFER_DIRECTION_IN | USBD_SHORT_TRANSFER_OK,
+                         UAS_STATUS_BUFFER_SIZE,
+                         FDODeviceExtension->UasStatusBuffer,
+                         NULL,
+                         USBSTOR_UasStatusCompletionRoutine,
+                         FDODeviceExtension);
+}
+
+static
+VOID
+USBSTOR_UasSendCommand(
+    IN PFDO_DEVICE_EXTENSION FDODeviceExtension,
+    IN PUAS_COMMAND Command)
+{
+    PIO_STACK_LOCATION IoStack;
+    PPDO_DEVICE_EXTENSION PDODeviceExtension;
+    PSCSI_REQUEST_BLOCK Request;
+    PUAS_COMMAND_IU CommandIu = &Command->CommandIu;
+
+    IoStack = IoGetCurrentIrpStackLocation(Command->Irp);
+    PDODeviceExtension = (PPDO_DEVICE_EXTENSION)IoStack->DeviceObject->DeviceExtension;
+    Request = IoStack->Parameters.Scsi.Srb;
+
+    RtlZeroMemory(CommandIu, sizeof(UAS_COMMAND_IU));
+
+    CommandIu->IuId = UAS_IU_COMMAND;
+    CommandIu->Tag = RtlUshortByteSwap(Command->Tag);
+    CommandIu->TaskAttribute = UAS_TASK_ATTRIBUTE_SIMPLE;
+
+    if (Request->SrbFlags & SRB_FLAGS_QUEUE_ACTION_ENABLE)
+    {
+        if (Request->QueueAction == SRB_HEAD_OF_QUEUE_TAG_REQUEST)
+            CommandIu->TaskAttribute = UAS_TASK_ATTRIBUTE_HEAD_OF_QUEUE;
+        else if (Request->QueueAction == SRB_ORDERED_QUEUE_TAG_REQUEST)
+            CommandIu->TaskAttribute = UAS_TASK_ATTRIBUTE_ORDERED;
+    }
+
+    // single level LUN
+    CommandIu->Lun[1] = PDODeviceExtension->LUN;
+
+    RtlCopyMemory(CommandIu->Cdb, Request->Cdb, min(Request->CdbLength, sizeof(CommandIu->Cdb)));
+
+    DPRINT("USBSTOR_UasSendCommand Irp %p tag %u Operation Code %x, Length %lu\n", Command->Irp, Command->Tag, Request->Cdb[0], Request->DataTransferLength);
+
+    // the device holds the IUs until we read them, so the order does not matter
+    USBSTOR_UasStartStatusRead(FDODeviceExtension);
+
+    USBSTOR_UasSubmitUrb(FDODeviceExtension,
+                         Command->UsbIrp,
+                         &Command->Urb,
+                         FDODeviceExtension->CommandPipeIndex,
+                         USBD_TRANSFER_DIRECTION_OUT,
+                         sizeof(UAS_COMMAND_IU),
+                         CommandIu,
+                         NULL,
+                         USBSTOR_UasCommandCompletionRoutine,
+                         Command);
+}
+
+static
+VOID
+USBSTOR_UasCompleteCancelled(
+    IN PDEVICE_OBJECT FdoDevice,
+    IN PIRP Irp)
+{
+    Irp->IoStatus.Status = STATUS_CANCELLED;
+    Irp->IoStatus.Information = 0;
+
+    USBSTOR_QueueTerminateRequest(FdoDevice, Irp);
+    IoCompleteRequest(Irp, IO_NO_INCREMENT);
+}
+
+DRIVER_CANCEL USBSTOR_UasCancel;
+
+VOID
+NTAPI
+USBSTOR_UasCancel(
+    IN PDEVICE_OBJECT DeviceObject,
+    IN PIRP Irp)
+{
+    PPDO_DEVICE_EXTENSION PDODeviceExtension;
+    PFDO_DEVICE_EXTENSION FDODeviceExtension;
+    KIRQL OldIrql;
+
+    // the request was sent to the PDO
+    PDODeviceExtension = (PPDO_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
+    ASSERT(PDODeviceExtension->Common.IsFDO == FALSE);
+    FDODeviceExtension = (PFDO_DEVICE_EXTENSION)PDODeviceExtension->LowerDeviceObject->DeviceExtension;
+
+    IoReleaseCancelSpinLock(Irp->CancelIrql);
+
+    KeAcquireSpinLock(&FDODeviceExtension->IrpListLock, &OldIrql);
+    RemoveEntryList(&Irp->Tail.Overlay.ListEntry);
+    KeReleaseSpinLock(&FDODeviceExtension->IrpListLock, OldIrql);
+
+    USBSTOR_UasCompleteCancelled(PDODeviceExtension->LowerDeviceObject, Irp);
+}
+
+static
+VOID
+USBSTOR_UasStartNextRequest(
+    IN PDEVICE_OBJECT FdoDevice)
+{
+    PFDO_DEVICE_EXTENSION FDODeviceExtension;
+    PUAS_COMMAND Command;
+    PLIST_ENTRY Entry;
+    PIRP Irp;
+    KIRQL OldIrql;
+
+    FDODeviceExtension = (PFDO_DEVICE_EXTENSION)FdoDevice->DeviceExtension;
+
+    while (TRUE)
+    {
+        KeAcquireSpinLock(&FDODeviceExtension->IrpListLock, &OldIrql);
+
+        if (IsListEmpty(&FDODeviceExtension->IrpListHead) ||
+            !FDODeviceExtension->UasFreeTags ||
+            (FDODeviceExtension->Flags & (USBSTOR_FDO_FLAGS_DEVICE_RESETTING | USBSTOR_FDO_FLAGS_IRP_LIST_FREEZE)))
+        {
+            KeReleaseSpinLock(&FDODeviceExtension->IrpListLock, OldIrql);
+            return;
+        }
+
+        Entry = RemoveHeadList(&FDODeviceExtension->IrpListHead);
+        Irp = CONTAINING_RECORD(Entry, IRP, Tail.Overlay.ListEntry);
+
+        if (!IoSetCancelRoutine(Irp, NULL))
+        {
+            // the cancel routine is about to remove it
+            InitializeListHead(&Irp->Tail.Overlay.ListEntry);
+            KeReleaseSpinLock(&FDODeviceExtension->IrpListLock, OldIrql);
+            continue;
+        }
+
+        Command = USBSTOR_UasAllocateCommand(FDODeviceExtension, Irp);
+        ASSERT(Command);
+
+        KeReleaseSpinLock(&FDODeviceExtension->IrpListLock, OldIrql);
+
+        USBSTOR_UasSendCommand(FDODeviceExtension, Command);
+    }
+}
+
+VOID
+USBSTOR_UasQueueRequest(
+    IN PDEVICE_OBJECT FdoDevice,
+    IN PIRP Irp)
+{
+    PFDO_DEVICE_EXTENSION FDODeviceExtension;
+    PUAS_COMMAND Command = NULL;
+    KIRQL OldIrql;
+
+    FDODeviceExtension = (PFDO_DEVICE_EXTENSION)FdoDevice->DeviceExtension;
+    ASSERT(FDODeviceExtension->Common.IsFDO);
+
+    KeAcquireSpinLock(&FDODeviceExtension->IrpListLock, &OldIrql);
+
+    FDODeviceExtension->IrpPendingCount++;
+    KeClearEvent(&FDODeviceExtension->NoPendingRequests);
+
+    // requests that find no free tag wait in order
+    if (IsListEmpty(&FDODeviceExtension->IrpListHead) &&
+        !(FDODeviceExtension->Flags & (USBSTOR_FDO_FLAGS_DEVICE_RESETTING | USBSTOR_FDO_FLAGS_IRP_LIST_FREEZE)))
+    {
+        Command = USBSTOR_UasAllocateCommand(FDODeviceExtension, Irp);
+    }
+
+    if (!Command)
+    {
+        IoSetCancelRoutine(Irp, USBSTOR_UasCancel);
+
+        // check if the irp has already been cancelled
+        if (Irp->Cancel && IoSetCancelRoutine(Irp, NULL))
+        {
+            KeReleaseSpinLock(&FDODeviceExtension->IrpListLock, OldIrql);
+            USBSTOR_UasCompleteCancelled(FdoDevice, Irp);
+            return;
+        }
+
+        InsertTailList(&FDODeviceExtension->IrpListHead, &Irp->Tail.Overlay.ListEntry);
+        KeReleaseSpinLock(&FDODeviceExtension->IrpListLock, OldIrql);
+        return;
+    }
+
+    KeReleaseSpinLock(&FDODeviceExtension->IrpListLock, OldIrql);
+
+    USBSTOR_UasSendCommand(FDODeviceExtension, Command);
+}
+
+VOID
+USBSTOR_UasQueueRelease(
+    IN PDEVICE_OBJECT FdoDevice)
+{
+    PFDO_DEVICE_EXTENSION FDODeviceExtension;
+    KIRQL OldIrql;
+
+    FDODeviceExtension = (PFDO_DEVICE_EXTENSION)FdoDevice->DeviceExtension;
+    ASSERT(FDODeviceExtension->Common.IsFDO);
+
+    KeAcquireSpinLock(&FDODeviceExtension->IrpListLock, &OldIrql);
+    FDODeviceExtension->Flags &= ~USBSTOR_FDO_FLAGS_IRP_LIST_FREEZE;
+    KeReleaseSpinLock(&FDODeviceExtension->IrpListLock, OldIrql);
+
+    USBSTOR_UasStartNextRequest(FdoDevice);
+}
+
+static
+VOID
+USBSTOR_UasAbortPipes(
+    IN PFDO_DEVICE_EXTENSION FDODeviceExtension)
+{
+    UCHAR PipeIndex[4];
+    ULONG Index;
+    NTSTATUS Status;
+
+    PipeIndex[0] = FDODeviceExtension->CommandPipeIndex;
+    PipeIndex[1] = FDODeviceExtension->StatusPipeIndex;
+    PipeIndex[2] = FDODeviceExtension->BulkInPipeIndex;
+    PipeIndex[3] = FDODeviceExtension->BulkOutPipeIndex;
+
+    // get back all irps the controller still has, then clear the stalls
+    for (Index = 0; Index < RTL_NUMBER_OF(PipeIndex); Index++)
+    {
+        Status = USBSTOR_AbortPipeWithHandle(FDODeviceExtension->LowerDeviceObject,
+                                             FDODeviceExtension->InterfaceInformation->Pipes[PipeIndex[Index]].PipeHandle);
+        DPRINT("USBSTOR_AbortPipeWithHandle Status %x\n", Status);
+    }
+
+    for (Index = 0; Index < RTL_NUMBER_OF(PipeIndex); Index++)
+    {
+        Status = USBSTOR_ResetPipeWithHandle(FDODeviceExtension->LowerDeviceObject,
+                                             FDODeviceExtension->InterfaceInformation->Pipes[PipeIndex[Index]].PipeHandle);
+        DPRINT("USBSTOR_ResetPipeWithHandle Status %x\n", Status);
+    }
+}
+
+static
+NTSTATUS
+USBSTOR_UasResetLogicalUnit(
+    IN PFDO_DEVICE_EXTENSION FDODeviceExtension,
+    IN UCHAR LUN)
+{
+    PUAS_TASK_MANAGEMENT_IU TaskIu;
+    PUAS_RESPONSE_IU ResponseIu;
+    PURB Urb;
+    NTSTATUS Status;
+    ULONG Index;
+
+    Urb = (PURB)AllocateItem(NonPagedPool, sizeof(struct _URB_BULK_OR_INTERRUPT_TRANSFER));
+    if (!Urb)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    TaskIu = (PUAS_TASK_MANAGEMENT_IU)AllocateItem(NonPagedPool, sizeof(UAS_TASK_MANAGEMENT_IU));
+    if (!TaskIu)
+    {
+        FreeItem(Urb);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    // drop every task the device still has for this LUN
+    TaskIu->IuId = UAS_IU_TASK_MANAGEMENT;
+    TaskIu->Tag = RtlUshortByteSwap(UAS_TASK_MANAGEMENT_TAG);
+    TaskIu->Function = UAS_TMF_LOGICAL_UNIT_RESET;
+    TaskIu->Lun[1] = LUN;
+
+    Status = USBSTOR_UasSyncTransfer(FDODeviceExtension,
+                                     Urb,
+                                     FDODeviceExtension->CommandPipeIndex,
+                                     USBD_TRANSFER_DIRECTION_OUT,
+                                     sizeof(UAS_TASK_MANAGEMENT_IU),
+                                     TaskIu);
+
+    // IUs of the aborted commands may still be queued before the response
+    for (Index = 0; NT_SUCCESS(Status); Index++)
+    {
+        if (Index > UAS_MAX_COMMANDS)
+        {
+            Status = STATUS_DEVICE_PROTOCOL_ERROR;
+            break;
+        }
+
+        Status = USBSTOR_UasSyncTransfer(FDODeviceExtension,
+                                         Urb,
+                                         FDODeviceExtension->StatusPipeIndex,
+                                         USBD_TRANSFER_DIRECTION_IN | USBD_SHORT_TRANSFER_OK,
+                                         UAS_STATUS_BUFFER_SIZE,
+                                         FDODeviceExtension->UasStatusBuffer);
+
+        ResponseIu = (PUAS_RESPONSE_IU)FDODeviceExtension->UasStatusBuffer;
+
+        if (NT_SUCCESS(Status) &&
+            Urb->UrbBulkOrInterruptTransfer.TransferBufferLength >= sizeof(UAS_RESPONSE_IU) &&
+            ResponseIu->IuId == UAS_IU_RESPONSE &&
+            RtlUshortByteSwap(ResponseIu->Tag) == UAS_TASK_MANAGEMENT_TAG)
+        {
+            if (ResponseIu->ResponseCode != UAS_RESPONSE_TMF_COMPLETE &&
+                ResponseIu->ResponseCode != UAS_RESPONSE_TMF_SUCCEEDED)
+            {
+                DPRINT1("USBSTOR_UasResetLogicalUnit: response code %x\n", ResponseIu->ResponseCode);
+                Status = STATUS_IO_DEVICE_ERROR;
+            }
+            break;
+        }
+    }
+
+    FreeItem(TaskIu);
+    FreeItem(Urb);
+    return Status;
+}
+
+VOID
+NTAPI
+USBSTOR_UasResetWorkItemRoutine(
+    IN PDEVICE_OBJECT FdoDevice,
+    IN PVOID Context)
+{
+    PFDO_DEVICE_EXTENSION FDODeviceExtension;
+    PIRP CompletedIrps[UAS_MAX_COMMANDS];
+    PUAS_COMMAND Command;
+    ULONG Index, Count = 0;
+    NTSTATUS Status;
+    KIRQL OldIrql;
+
+    DPRINT1("USBSTOR_UasResetWorkItemRoutine\n");
+
+    FDODeviceExtension = (PFDO_DEVICE_EXTENSION)FdoDevice->DeviceExtension;
+
+    USBSTOR_UasAbortPipes(FDODeviceExtension);
+
+    // a logical unit reset only covers its own LUN
+    for (Index = 0; Index <= FDODeviceExtension->MaxLUN; Index++)
+    {
+        if (!(FDODeviceExtension->LunMask & (1 << Index)))
+            continue;
+
+        Status = USBSTOR_UasResetLogicalUnit(FDODeviceExtension, (UCHAR)Index);
+        DPRINT1("USBSTOR_UasResetLogicalUnit LUN %lu Status %x\n", Index, Status);
+    }
+
+    // fail whatever was in flight, busy ones finish in their completion routine
+    KeAcquireSpinLock(&FDODeviceExtension->IrpListLock, &OldIrql);
+
+    FDODeviceExtension->UasStatusPending = FALSE;
+
+    for (Index = 0; Index < UAS_MAX_COMMANDS; Index++)
+    {
+        Command = &FDODeviceExtension->UasCommands[Index];
+        if (!Command->Irp)
+            continue;
+
+        Command->Flags |= UAS_COMMAND_ERROR;
+
+        if (USBSTOR_UasCheckCommand(Command) == UasActionComplete)
+        {
+            CompletedIrps[Count++] = USBSTOR_UasReleaseCommand(FDODeviceExtension, Command);
+        }
+    }
+
+    KeReleaseSpinLock(&FDODeviceExtension->IrpListLock, OldIrql);
+
+    for (Index = 0; Index < Count; Index++)
+    {
+        USBSTOR_UasCompleteRequest(FdoDevice, CompletedIrps[Index]);
+    }
+
+    KeAcquireSpinLock(&FDODeviceExtension->CommonLock, &OldIrql);
+    FDODeviceExtension->Flags &= ~USBSTOR_FDO_FLAGS_DEVICE_RESETTING;
+    KeReleaseSpinLock(&FDODeviceExtension->CommonLock, OldIrql);
+
+    USBSTOR_UasStartNextRequest(FdoDevice);
+}
+
+NTSTATUS
+USBSTOR_UasGetPipeHandles(
+    IN PFDO_DEVICE_EXTENSION FDODeviceExtension)
+{
+    PUSB_CONFIGURATION_DESCRIPTOR ConfigurationDescriptor = FDODeviceExtension->ConfigurationDescriptor;
+    PUSBD_INTERFACE_INFORMATION InterfaceInformation = FDODeviceExtension->InterfaceInformation;
+    PUSB_INTERFACE_DESCRIPTOR InterfaceDescriptor;
+    PUSB_COMMON_DESCRIPTOR CurrentDescriptor;
+    PUAS_PIPE_USAGE_DESCRIPTOR PipeUsage;
+    UCHAR EndpointAddress[UAS_PIPE_ID_DATA_OUT + 1] = { 0 };
+    UCHAR PipeIndex[UAS_PIPE_ID_DATA_OUT + 1];
+    UCHAR LastEndpointAddress = 0;
+    ULONG PipeId, Index;
+
+    InterfaceDescriptor = USBSTOR_FindInterfaceDescriptor(ConfigurationDescriptor,
+                                                          InterfaceInformation->InterfaceNumber,
+                                                          USB_PROTOCOL_UAS);
+    if (!InterfaceDescriptor)
+    {
+        return STATUS_DEVICE_CONFIGURATION_ERROR;
+    }
+
+    // every endpoint descriptor is followed by a pipe usage descriptor telling its role
+    CurrentDescriptor = (PUSB_COMMON_DESCRIPTOR)((ULONG_PTR)InterfaceDescriptor + InterfaceDescriptor->bLength);
+
+    while ((ULONG_PTR)CurrentDescriptor < ((ULONG_PTR)ConfigurationDescriptor + ConfigurationDescriptor->wTotalLength) &&
+           CurrentDescriptor->bLength &&
+           CurrentDescriptor->bDescriptorType != USB_INTERFACE_DESCRIPTOR_TYPE)
+    {
+        if (CurrentDescriptor->bDescriptorType == USB_ENDPOINT_DESCRIPTOR_TYPE)
+        {
+            LastEndpointAddress = ((PUSB_ENDPOINT_DESCRIPTOR)CurrentDescriptor)->bEndpointAddress;
+        }
+        else if (CurrentDescriptor->bDescriptorType == UAS_PIPE_USAGE_DESCRIPTOR_TYPE &&
+                 CurrentDescriptor->bLength >= sizeof(UAS_PIPE_USAGE_DESCRIPTOR))
+        {
+            PipeUsage = (PUAS_PIPE_USAGE_DESCRIPTOR)CurrentDescriptor;
+
+            if (PipeUsage->bPipeID >= UAS_PIPE_ID_COMMAND && PipeUsage->bPipeID <= UAS_PIPE_ID_DATA_OUT)
+            {
+                EndpointAddress[PipeUsage->bPipeID] = LastEndpointAddress;
+            }
+        }
+
+        CurrentDescriptor = (PUSB_COMMON_DESCRIPTOR)((ULONG_PTR)CurrentDescriptor + CurrentDescriptor->bLength);
+    }
+
+    for (PipeId = UAS_PIPE_ID_COMMAND; PipeId <= UAS_PIPE_ID_DATA_OUT; PipeId++)
+    {
+        for (Index = 0; Index < InterfaceInformation->NumberOfPipes; Index++)
+        {
+            if (EndpointAddress[PipeId] &&
+                InterfaceInformation->Pipes[Index].PipeType == UsbdPipeTypeBulk &&
+                InterfaceInformation->Pipes[Index].EndpointAddress == EndpointAddress[PipeId])
+            {
+                break;
+            }
+        }
+
+        if (Index == InterfaceInformation->NumberOfPipes)
+        {
+            DPRINT1("USBSTOR_UasGetPipeHandles: no pipe for pipe id %lu\n", PipeId);
+            return STATUS_DEVICE_CONFIGURATION_ERROR;
+        }
+
+        PipeIndex[PipeId] = (UCHAR)Index;
+    }
+
+    FDODeviceExtension->CommandPipeIndex = PipeIndex[UAS_PIPE_ID_COMMAND];
+    FDODeviceExtension->StatusPipeIndex = PipeIndex[UAS_PIPE_ID_STATUS];
+    FDODeviceExtension->BulkInPipeIndex = PipeIndex[UAS_PIPE_ID_DATA_IN];
+    FDODeviceExtension->BulkOutPipeIndex = PipeIndex[UAS_PIPE_ID_DATA_OUT];
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+USBSTOR_UasInitialize(
+    IN PDEVICE_OBJECT FdoDevice)
+{
+    PFDO_DEVICE_EXTENSION FDODeviceExtension;
+    PUAS_COMMAND Command;
+    ULONG Index;
+
+    FDODeviceExtension = (PFDO_DEVICE_EXTENSION)FdoDevice->DeviceExtension;
+    ASSERT(FDODeviceExtension->Common.IsFDO);
+
+    // keep the irps across restarts
+    if (!FDODeviceExtension->UasCommands)
+    {
+        FDODeviceExtension->UasCommands = AllocateItem(NonPagedPool, sizeof(UAS_COMMAND) * UAS_MAX_COMMANDS);
+        if (!FDODeviceExtension->UasCommands)
+        {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        for (Index = 0; Index < UAS_MAX_COMMANDS; Index++)
+        {
+            Command = &FDODeviceExtension->UasCommands[Index];
+
+            Command->UsbIrp = IoAllocateIrp(FDODeviceExtension->LowerDeviceObject->StackSize, FALSE);
+            if (!Command->UsbIrp)
+            {
+                USBSTOR_UasUninitialize(FDODeviceExtension);
+                return STATUS_INSUFFICIENT_RESOURCES;
+            }
+        }
+
+        FDODeviceExtension->UasStatusIrp = IoAllocateIrp(FDODeviceExtension->LowerDeviceObject->StackSize, FALSE);
+        if (!FDODeviceExtension->UasStatusIrp)
+        {
+            USBSTOR_UasUninitialize(FDODeviceExtension);
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+    }
+
+    for (Index = 0; Index < UAS_MAX_COMMANDS; Index++)
+    {
+        Command = &FDODeviceExtension->UasCommands[Index];
+
+        Command->FdoDevice = FdoDevice;
+        Command->Irp = NULL;
+        Command->Tag = (USHORT)(Index + 1);
+    }
+
+    FDODeviceExtension->UasFreeTags = UAS_ALL_TAGS_FREE;
+    FDODeviceExtension->UasStatusPending = FALSE;
+
+    DPRINT("USBSTOR_UasInitialize: Command %u Status %u DataIn %u DataOut %u\n",
+           FDODeviceExtension->CommandPipeIndex,
+           FDODeviceExtension->StatusPipeIndex,
+           FDODeviceExtension->BulkInPipeIndex,
+           FDODeviceExtension->BulkOutPipeIndex);
+
+    return STATUS_SUCCESS;
+}
+
+static
+NTSTATUS
+USBSTOR_UasReportLuns(
+    IN PFDO_DEVICE_EXTENSION FDODeviceExtension,
+    IN PURB Urb,
+    IN PUAS_COMMAND_IU CommandIu,
+    IN PLUN_LIST LunList,
+    OUT PULONG DataLength,
+    OUT PUCHAR ScsiStatus)
+{
+    PUAS_IU_HEADER Header;
+    PCDB Cdb;
+    ULONG Index, Length;
+    BOOLEAN DataDone = FALSE;
+    NTSTATUS Status;
+
+    // nothing else is outstanding yet, so any tag will do
+    RtlZeroMemory(CommandIu, sizeof(UAS_COMMAND_IU));
+    CommandIu->IuId = UAS_IU_COMMAND;
+    CommandIu->Tag = RtlUshortByteSwap(UAS_REPORT_LUNS_TAG);
+    CommandIu->TaskAttribute = UAS_TASK_ATTRIBUTE_SIMPLE;
+
+    // LUN 0 has to answer for the whole target
+    Cdb = (PCDB)CommandIu->Cdb;
+    Cdb->REPORT_LUNS.OperationCode = SCSIOP_REPORT_LUNS;
+    Cdb->REPORT_LUNS.AllocationLength[2] = (UCHAR)(UAS_REPORT_LUNS_LENGTH >> 8);
+    Cdb->REPORT_LUNS.AllocationLength[3] = (UCHAR)UAS_REPORT_LUNS_LENGTH;
+
+    *DataLength = 0;
+    *ScsiStatus = SCSISTAT_GOOD;
+
+    Status = USBSTOR_UasSyncTransfer(FDODeviceExtension,
+                                     Urb,
+                                     FDODeviceExtension->CommandPipeIndex,
+                                     USBD_TRANSFER_DIRECTION_OUT,
+                                     sizeof(UAS_COMMAND_IU),
+                                     CommandIu);
+
+    // a read ready IU may come first, the sense IU finishes the command
+    for (Index = 0; NT_SUCCESS(Status); Index++)
+    {
+        if (Index > 1)
+        {
+            Status = STATUS_DEVICE_PROTOCOL_ERROR;
+            break;
+        }
+
+        Status = USBSTOR_UasSyncTransfer(FDODeviceExtension,
+                                         Urb,
+                                         FDODeviceExtension->StatusPipeIndex,
+                                         USBD_TRANSFER_DIRECTION_IN | USBD_SHORT_TRANSFER_OK,
+                                         UAS_STATUS_BUFFER_SIZE,
+                                         FDODeviceExtension->UasStatusBuffer);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        Length = Urb->UrbBulkOrInterruptTransfer.TransferBufferLength;
+        Header = (PUAS_IU_HEADER)FDODeviceExtension->UasStatusBuffer;
+
+        if (Length < sizeof(UAS_IU_HEADER) || RtlUshortByteSwap(Header->Tag) != UAS_REPORT_LUNS_TAG)
+        {
+            DPRINT1("USBSTOR_UasReportLuns: unexpected IU Length %lu\n", Length);
+            Status = STATUS_DEVICE_PROTOCOL_ERROR;
+        }
+        else if (Header->IuId == UAS_IU_READ_READY && !DataDone)
+        {
+            Status = USBSTOR_UasSyncTransfer(FDODeviceExtension,
+                                             Urb,
+                                             FDODeviceExtension->BulkInPipeIndex,
+                                             USBD_TRANSFER_DIRECTION_IN | USBD_SHORT_TRANSFER_OK,
+                                             UAS_REPORT_LUNS_LENGTH,
+                                             LunList);
+
+            *DataLength = Urb->UrbBulkOrInterruptTransfer.TransferBufferLength;
+            DataDone = TRUE;
+        }
+        else if (Header->IuId == UAS_IU_SENSE && Length >= FIELD_OFFSET(UAS_SENSE_IU, SenseData))
+        {
+            *ScsiStatus = ((PUAS_SENSE_IU)Header)->Status;
+            break;
+        }
+        else
+        {
+            DPRINT1("USBSTOR_UasReportLuns: unexpected IU %x Length %lu\n", Header->IuId, Length);
+            Status = STATUS_DEVICE_PROTOCOL_ERROR;
+        }
+    }
+
+    return Status;
+}
+
+NTSTATUS
+USBSTOR_UasGetMaxLUN(
+    IN PFDO_DEVICE_EXTENSION FDODeviceExtension)
+{
+    PUAS_COMMAND_IU CommandIu = NULL;
+    PLUN_LIST LunList = NULL;
+    PURB Urb;
+    ULONG Index, Count, DataLength;
+    UCHAR ScsiStatus, LUN, MaxLUN = 0;
+    USHORT LunMask = 0;
+    NTSTATUS Status;
+
+    // UAS has no Get Max LUN request
+    Urb = (PURB)AllocateItem(NonPagedPool, sizeof(struct _URB_BULK_OR_INTERRUPT_TRANSFER));
+    if (Urb)
+    {
+        CommandIu = (PUAS_COMMAND_IU)AllocateItem(NonPagedPool, sizeof(UAS_COMMAND_IU));
+        LunList = (PLUN_LIST)AllocateItem(NonPagedPool, UAS_REPORT_LUNS_LENGTH);
+    }
+
+    if (!Urb || !CommandIu || !LunList)
+    {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto Cleanup;
+    }
+
+    // a unit attention after power on may eat the first attempt
+    for (Index = 0; Index < 2; Index++)
+    {
+        Status = USBSTOR_UasReportLuns(FDODeviceExtension, Urb, CommandIu, LunList, &DataLength, &ScsiStatus);
+        if (!NT_SUCCESS(Status) || ScsiStatus == SCSISTAT_GOOD)
+        {
+            break;
+        }
+    }
+
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("USBSTOR_UasGetMaxLUN: REPORT LUNS failed with %x\n", Status);
+        goto Cleanup;
+    }
+
+    if (ScsiStatus != SCSISTAT_GOOD || DataLength < FIELD_OFFSET(LUN_LIST, Lun))
+    {
+        // it is mandatory, but LUN 0 has to be there anyway
+        DPRINT1("USBSTOR_UasGetMaxLUN: REPORT LUNS status %x, using LUN 0 only\n", ScsiStatus);
+        FDODeviceExtension->MaxLUN = 0;
+        FDODeviceExtension->LunMask = USBSTOR_ALL_LUNS(0);
+        goto Cleanup;
+    }
+
+    Count = ((ULONG)LunList->LunListLength[0] << 24) |
+            ((ULONG)LunList->LunListLength[1] << 16) |
+            ((ULONG)LunList->LunListLength[2] << 8) |
+            LunList->LunListLength[3];
+    Count = min(Count, DataLength - FIELD_OFFSET(LUN_LIST, Lun)) / sizeof(LunList->Lun[0]);
+
+    for (Index = 0; Index < Count; Index++)
+    {
+        // the command IU only carries single level LUNs
+        if (LunList->Lun[Index][0] != 0 || LunList->Lun[Index][1] > MAX_LUN)
+        {
+            DPRINT1("USBSTOR_UasGetMaxLUN: ignoring LUN %02x%02x\n", LunList->Lun[Index][0], LunList->Lun[Index][1]);
+            continue;
+        }
+
+        // the list may have gaps, only the reported LUNs get a PDO
+        LUN = LunList->Lun[Index][1];
+        LunMask |= 1 << LUN;
+        MaxLUN = max(MaxLUN, LUN);
+    }
+
+    if (!LunMask)
+    {
+        DPRINT1("USBSTOR_UasGetMaxLUN: no usable LUN reported, using LUN 0 only\n");
+        LunMask = USBSTOR_ALL_LUNS(0);
+    }
+
+    DPRINT("USBSTOR_UasGetMaxLUN: %lu LUNs reported, MaxLUN %u LunMask %x\n", Count, MaxLUN, LunMask);
+    FDODeviceExtension->MaxLUN = MaxLUN;
+    FDODeviceExtension->LunMask = LunMask;
+
+Cleanup:
+    if (LunList)
+        FreeItem(LunList);
+    if (CommandIu)
+        FreeItem(CommandIu);
+    if (Urb)
+        FreeItem(Urb);
+
+    return Status;
+}
+
+VOID
+USBSTOR_UasUninitialize(
+    IN PFDO_DEVICE_EXTENSION FDODeviceExtension)
+{
+    ULONG Index;
+    KIRQL OldIrql;
+
+    if (!FDODeviceExtension->UasCommands)
+    {
+        return;
+    }
+
+    if (FDODeviceExtension->UasStatusIrp)
+    {
+        // keep the completions from scheduling a reset, then get the irps back
+        KeAcquireSpinLock(&FDODeviceExtension->CommonLock, &OldIrql);
+        FDODeviceExtension->Flags |= USBSTOR_FDO_FLAGS_DEVICE_RESETTING;
+        KeReleaseSpinLock(&FDODeviceExtension->CommonLock, OldIrql);
+
+        USBSTOR_UasAbortPipes(FDODeviceExtension);
+
+        IoFreeIrp(FDODeviceExtension->UasStatusIrp);
+        FDODeviceExtension->UasStatusIrp = NULL;
+    }
+
+    for (Index = 0; Index < UAS_MAX_COMMANDS; Index++)
+    {
+        if (FDODeviceExtension->UasCommands[Index].UsbIrp)
+        {
+            IoFreeIrp(FDODeviceExtension->UasCommands[Index].UsbIrp);
+        }
+    }
+
+    FreeItem(FDODeviceExtension->UasCommands);
+    FDODeviceExtension->UasCommands = NULL;
+}
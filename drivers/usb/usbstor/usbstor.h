@@ -59,6 +59,7 @@
 
 #define USB_MAXCHILDREN 16
 #define MAX_LUN 0xF
+#define USBSTOR_ALL_LUNS(MaxLUN)  ((USHORT)((1 << ((MaxLUN) + 1)) - 1))
 #define USBSTOR_DEFAULT_MAX_TRANSFER_LENGTH 0x10000
 
 #define CBW_SIGNATURE 0x43425355
@@ -91,8 +92,129 @@ typedef struct
     UCHAR Status;                                                    // CSW status
 } CSW, *PCSW;
 
+// USB Attached SCSI
+
+#define UAS_PIPE_USAGE_DESCRIPTOR_TYPE  0x24
+
+#define UAS_PIPE_ID_COMMAND   0x01
+#define UAS_PIPE_ID_STATUS    0x02
+#define UAS_PIPE_ID_DATA_IN   0x03
+#define UAS_PIPE_ID_DATA_OUT  0x04
+
+#define UAS_IU_COMMAND          0x01
+#define UAS_IU_SENSE            0x03
+#define UAS_IU_RESPONSE         0x04
+#define UAS_IU_TASK_MANAGEMENT  0x05
+#define UAS_IU_READ_READY       0x06
+#define UAS_IU_WRITE_READY      0x07
+
+#define UAS_TASK_ATTRIBUTE_SIMPLE         0x00
+#define UAS_TASK_ATTRIBUTE_HEAD_OF_QUEUE  0x01
+#define UAS_TASK_ATTRIBUTE_ORDERED        0x02
+
+#define UAS_TMF_LOGICAL_UNIT_RESET  0x08
+
+#define UAS_RESPONSE_TMF_COMPLETE   0x00
+#define UAS_RESPONSE_TMF_SUCCEEDED  0x08
+
+#define UAS_MAX_COMMANDS         16                       // tags 1 to UAS_MAX_COMMANDS
+#define UAS_TASK_MANAGEMENT_TAG  (UAS_MAX_COMMANDS + 1)
+#define UAS_REPORT_LUNS_TAG      1                        // only used before any other command
+#define UAS_REPORT_LUNS_LENGTH   (FIELD_OFFSET(LUN_LIST, Lun) + (MAX_LUN + 1) * 8)
+#define UAS_STATUS_BUFFER_SIZE   0x200
+
+typedef struct
+{
+    UCHAR bLength;
+    UCHAR bDescriptorType;
+    UCHAR bPipeID;
+    UCHAR Reserved;
+} UAS_PIPE_USAGE_DESCRIPTOR, *PUAS_PIPE_USAGE_DESCRIPTOR;
+
+typedef struct
+{
+    UCHAR IuId;
+    UCHAR Reserved1;
+    USHORT Tag;                                                      // big endian
+    UCHAR TaskAttribute;
+    UCHAR Reserved2;
+    UCHAR AdditionalCdbLength;
+    UCHAR Reserved3;
+    UCHAR Lun[8];
+    UCHAR Cdb[16];
+} UAS_COMMAND_IU, *PUAS_COMMAND_IU;
+
+C_ASSERT(sizeof(UAS_COMMAND_IU) == 32);
+
+typedef struct
+{
+    UCHAR IuId;
+    UCHAR Reserved1;
+    USHORT Tag;                                                      // big endian
+    UCHAR Function;
+    UCHAR Reserved2;
+    USHORT ManagedTag;                                               // big endian
+    UCHAR Lun[8];
+} UAS_TASK_MANAGEMENT_IU, *PUAS_TASK_MANAGEMENT_IU;
+
+C_ASSERT(sizeof(UAS_TASK_MANAGEMENT_IU) == 16);
+
+typedef struct
+{
+    UCHAR IuId;
+    UCHAR Reserved1;
+    USHORT Tag;                                                      // big endian
+} UAS_IU_HEADER, *PUAS_IU_HEADER;                                    // also the whole read / write ready IU
+
+typedef struct
+{
+    UCHAR IuId;
+    UCHAR Reserved1;
+    USHORT Tag;                                                      // big endian
+    USHORT StatusQualifier;
+    UCHAR Status;                                                    // SCSI status
+    UCHAR Reserved2[7];
+    USHORT SenseLength;                                              // big endian
+    UCHAR SenseData[ANYSIZE_ARRAY];
+} UAS_SENSE_IU, *PUAS_SENSE_IU;
+
+C_ASSERT(FIELD_OFFSET(UAS_SENSE_IU, SenseData) == 16);
+
+typedef struct
+{
+    UCHAR IuId;
+    UCHAR Reserved1;
+    USHORT Tag;                                                      // big endian
+    UCHAR AdditionalInformation[3];
+    UCHAR ResponseCode;
+} UAS_RESPONSE_IU, *PUAS_RESPONSE_IU;
+
+C_ASSERT(sizeof(UAS_RESPONSE_IU) == 8);
+
 #include <poppack.h>
 
+#define UAS_COMMAND_SENT    0x00000001                                // command IU is on the device
+#define UAS_COMMAND_READY   0x00000002                                // device asked for the data phase
+#define UAS_COMMAND_DATA    0x00000004                                // data phase was started
+#define UAS_COMMAND_STATUS  0x00000008                                // sense or response IU received
+#define UAS_COMMAND_ERROR   0x00000010                                // transport failed, the device gets reset
+#define UAS_COMMAND_BUSY    0x00000020                                // UsbIrp is with the lower driver
+#define UAS_COMMAND_UNDERRUN 0x00000040                               // data phase was short
+
+typedef struct
+{
+    PDEVICE_OBJECT FdoDevice;
+    PIRP Irp;                                                        // SCSI request using this tag, NULL if free
+    PIRP UsbIrp;                                                     // carries the command IU and then the data
+    PMDL PartialMdl;
+    USHORT Tag;
+    UCHAR SrbStatus;
+    UCHAR ScsiStatus;
+    ULONG Flags;
+    URB Urb;
+    UAS_COMMAND_IU CommandIu;
+} UAS_COMMAND, *PUAS_COMMAND;
+
 typedef struct
 {
     PIRP Irp;
@@ -132,6 +254,7 @@ typedef struct
     UCHAR BulkInPipeIndex;                                                               // bulk in pipe index
     UCHAR BulkOutPipeIndex;                                                              // bulk out pipe index
     UCHAR MaxLUN;                                                                        // max lun for device
+    USHORT LunMask;                                                                      // bit n set if the device has LUN n
     PDEVICE_OBJECT ChildPDO[USB_MAXCHILDREN];                                            // max 16 child pdo devices
     KSPIN_LOCK IrpListLock;                                                              // irp list lock
     LIST_ENTRY IrpListHead;                                                              // irp list head
@@ -146,6 +269,15 @@ typedef struct
     PIO_WORKITEM ResetDeviceWorkItem;
     ULONG Flags;
     IRP_CONTEXT CurrentIrpContext;
+    UCHAR Protocol;                                                                      // USB_PROTOCOL_BULK or USB_PROTOCOL_UAS
+    UCHAR CommandPipeIndex;                                                              // UAS command pipe index
+    UCHAR StatusPipeIndex;                                                               // UAS status pipe index
+    PUAS_COMMAND UasCommands;                                                            // UAS_MAX_COMMANDS tagged commands
+    ULONG UasFreeTags;                                                                   // bit n set if tag n + 1 is free
+    PIRP UasStatusIrp;                                                                   // reads the status pipe
+    BOOLEAN UasStatusPending;                                                            // UasStatusIrp is with the lower driver
+    URB UasStatusUrb;
+    UCHAR UasStatusBuffer[UAS_STATUS_BUFFER_SIZE];
 }FDO_DEVICE_EXTENSION, *PFDO_DEVICE_EXTENSION;
 
 typedef struct
@@ -258,12 +390,19 @@ USBSTOR_GetDescriptors(
 NTSTATUS
 USBSTOR_SelectConfigurationAndInterface(
     IN PDEVICE_OBJECT DeviceObject,
-    IN PFDO_DEVICE_EXTENSION DeviceExtension);
+    IN PFDO_DEVICE_EXTENSION DeviceExtension,
+    IN PUSB_INTERFACE_DESCRIPTOR InterfaceDescriptor);
 
 NTSTATUS
 USBSTOR_GetPipeHandles(
     IN PFDO_DEVICE_EXTENSION DeviceExtension);
 
+PUSB_INTERFACE_DESCRIPTOR
+USBSTOR_FindInterfaceDescriptor(
+    IN PUSB_CONFIGURATION_DESCRIPTOR ConfigurationDescriptor,
+    IN UCHAR InterfaceNumber,
+    IN UCHAR InterfaceProtocol);
+
 //---------------------------------------------------------------------
 //
 // scsi.c routines
@@ -278,6 +417,39 @@ USBSTOR_SendCSWRequest(
     PFDO_DEVICE_EXTENSION FDODeviceExtension,
     PIRP Irp);
 
+NTSTATUS
+USBSTOR_SrbStatusToNtStatus(
+    IN PSCSI_REQUEST_BLOCK Srb);
+
+//---------------------------------------------------------------------
+//
+// uas.c routines
+//
+NTSTATUS
+USBSTOR_UasGetPipeHandles(
+    IN PFDO_DEVICE_EXTENSION FDODeviceExtension);
+
+NTSTATUS
+USBSTOR_UasInitialize(
+    IN PDEVICE_OBJECT FdoDevice);
+
+NTSTATUS
+USBSTOR_UasGetMaxLUN(
+    IN PFDO_DEVICE_EXTENSION FDODeviceExtension);
+
+VOID
+USBSTOR_UasUninitialize(
+    IN PFDO_DEVICE_EXTENSION FDODeviceExtension);
+
+VOID
+USBSTOR_UasQueueRequest(
+    IN PDEVICE_OBJECT FdoDevice,
+    IN PIRP Irp);
+
+VOID
+USBSTOR_UasQueueRelease(
+    IN PDEVICE_OBJECT FdoDevice);
+
 
 //---------------------------------------------------------------------
 //
@@ -350,6 +522,11 @@ USBSTOR_ResetPipeWithHandle(
     IN PDEVICE_OBJECT DeviceObject,
     IN USBD_PIPE_HANDLE PipeHandle);
 
+NTSTATUS
+USBSTOR_AbortPipeWithHandle(
+    IN PDEVICE_OBJECT DeviceObject,
+    IN USBD_PIPE_HANDLE PipeHandle);
+
 VOID
 NTAPI
 USBSTOR_TimerRoutine(
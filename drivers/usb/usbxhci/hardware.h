@@ -0,0 +1,592 @@
+/*
+ * PROJECT:     ReactOS USB XHCI Miniport Driver
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     USBXHCI hardware declarations
+ */
+
+/* eXtensible Host Controller Interface for Universal Serial Bus, Revision 1.1 */
+
+#define XHCI_MAX_PORTS           255
+#define XHCI_MAX_SLOTS           255
+#define XHCI_MAX_ENDPOINTS       32 // Device Context Index 0 (Slot) .. 31
+
+#define XHCI_DEFAULT_CONTEXT_SIZE  32
+#define XHCI_LARGE_CONTEXT_SIZE    64
+
+/* Extended Capabilities. Section 7 */
+#define XHCI_XCAP_ID_LEGACY     1
+#define XHCI_XCAP_ID_PROTOCOL   2
+
+typedef union _XHCI_EXTENDED_CAPABILITY {
+  struct {
+    ULONG CapabilityID            : 8;
+    ULONG NextCapabilityPointer   : 8; // in ULONGs
+    ULONG CapabilitySpecific      : 16;
+  };
+  ULONG AsULONG;
+} XHCI_EXTENDED_CAPABILITY;
+
+C_ASSERT(sizeof(XHCI_EXTENDED_CAPABILITY) == sizeof(ULONG));
+
+typedef union _XHCI_LEGACY_SUPPORT_CAPABILITY {
+  struct {
+    ULONG CapabilityID            : 8;
+    ULONG NextCapabilityPointer   : 8;
+    ULONG BiosOwnedSemaphore      : 1;
+    ULONG Reserved1               : 7;
+    ULONG OsOwnedSemaphore        : 1;
+    ULONG Reserved2               : 7;
+  };
+  ULONG AsULONG;
+} XHCI_LEGACY_SUPPORT_CAPABILITY;
+
+C_ASSERT(sizeof(XHCI_LEGACY_SUPPORT_CAPABILITY) == sizeof(ULONG));
+
+/* USB Legacy Support Control/Status. SMI enables are bits 0, 4, 13-15,
+   SMI events are RW1C at bits 29-31 */
+#define XHCI_LEGACY_SMI_ENABLE_MASK  0x0000E011
+#define XHCI_LEGACY_SMI_EVENT_MASK   0xE0000000
+
+typedef union _XHCI_SUPPORTED_PROTOCOL_CAPABILITY {
+  struct {
+    ULONG CapabilityID            : 8;
+    ULONG NextCapabilityPointer   : 8;
+    ULONG MinorRevision           : 8;
+    ULONG MajorRevision           : 8;
+  };
+  ULONG AsULONG;
+} XHCI_SUPPORTED_PROTOCOL_CAPABILITY;
+
+C_ASSERT(sizeof(XHCI_SUPPORTED_PROTOCOL_CAPABILITY) == sizeof(ULONG));
+
+typedef union _XHCI_SUPPORTED_PROTOCOL_PORTS {
+  struct {
+    ULONG CompatiblePortOffset    : 8; // 1-based
+    ULONG CompatiblePortCount     : 8;
+    ULONG ProtocolDefined         : 12;
+    ULONG ProtocolSpeedIdCount    : 4;
+  };
+  ULONG AsULONG;
+} XHCI_SUPPORTED_PROTOCOL_PORTS;
+
+C_ASSERT(sizeof(XHCI_SUPPORTED_PROTOCOL_PORTS) == sizeof(ULONG));
+
+/* Host Controller Capability Registers. Section 5.3 */
+typedef union _XHCI_HC_STRUCTURAL_PARAMS_1 {
+  struct {
+    ULONG MaxDeviceSlots          : 8;
+    ULONG MaxInterrupters         : 11;
+    ULONG Reserved1               : 5;
+    ULONG MaxPorts                : 8;
+  };
+  ULONG AsULONG;
+} XHCI_HC_STRUCTURAL_PARAMS_1;
+
+C_ASSERT(sizeof(XHCI_HC_STRUCTURAL_PARAMS_1) == sizeof(ULONG));
+
+typedef union _XHCI_HC_STRUCTURAL_PARAMS_2 {
+  struct {
+    ULONG IsochSchedulingThreshold : 4;
+    ULONG EventRingSegmentTableMax : 4;
+    ULONG Reserved1                : 13;
+    ULONG MaxScratchpadBuffersHi   : 5;
+    ULONG ScratchpadRestore        : 1;
+    ULONG MaxScratchpadBuffersLo   : 5;
+  };
+  ULONG AsULONG;
+} XHCI_HC_STRUCTURAL_PARAMS_2;
+
+C_ASSERT(sizeof(XHCI_HC_STRUCTURAL_PARAMS_2) == sizeof(ULONG));
+
+typedef union _XHCI_HC_STRUCTURAL_PARAMS_3 {
+  struct {
+    ULONG U1DeviceExitLatency     : 8;
+    ULONG Reserved1               : 8;
+    ULONG U2DeviceExitLatency     : 16;
+  };
+  ULONG AsULONG;
+} XHCI_HC_STRUCTURAL_PARAMS_3;
+
+C_ASSERT(sizeof(XHCI_HC_STRUCTURAL_PARAMS_3) == sizeof(ULONG));
+
+typedef union _XHCI_HC_CAPABILITY_PARAMS_1 {
+  struct {
+    ULONG Addressing64bitCapability : 1; // AC64
+    ULONG BwNegotiationCapability   : 1; // BNC
+    ULONG ContextSize               : 1; // CSZ. 64 byte contexts
+    ULONG PortPowerControl          : 1; // PPC
+    ULONG PortIndicators            : 1; // PIND
+    ULONG LightHCResetCapability    : 1; // LHRC
+    ULONG LatencyToleranceMessaging : 1; // LTC
+    ULONG NoSecondarySidSupport     : 1; // NSS
+    ULONG ParseAllEventData         : 1; // PAE
+    ULONG StoppedShortPacket        : 1; // SPC
+    ULONG StoppedEdtla              : 1; // SEC
+    ULONG ContiguousFrameId         : 1; // CFC
+    ULONG MaxPrimaryStreamArraySize : 4; // MaxPSASize
+    ULONG ExtCapabilitiesPointer    : 16; // xECP. In ULONGs
+  };
+  ULONG AsULONG;
+} XHCI_HC_CAPABILITY_PARAMS_1;
+
+C_ASSERT(sizeof(XHCI_HC_CAPABILITY_PARAMS_1) == sizeof(ULONG));
+
+typedef struct _XHCI_HC_CAPABILITY_REGISTERS {
+  UCHAR RegistersLength; // RO. CAPLENGTH
+  UCHAR Reserved; // RO
+  USHORT InterfaceVersion; // RO. HCIVERSION
+  XHCI_HC_STRUCTURAL_PARAMS_1 StructParameters1; // RO
+  XHCI_HC_STRUCTURAL_PARAMS_2 StructParameters2; // RO
+  XHCI_HC_STRUCTURAL_PARAMS_3 StructParameters3; // RO
+  XHCI_HC_CAPABILITY_PARAMS_1 CapParameters1; // RO
+  ULONG DoorbellOffset; // RO. DBOFF
+  ULONG RuntimeRegistersOffset; // RO. RTSOFF
+  ULONG CapParameters2; // RO
+} XHCI_HC_CAPABILITY_REGISTERS, *PXHCI_HC_CAPABILITY_REGISTERS;
+
+/* Host Controller Operational Registers. Section 5.4 */
+typedef union _XHCI_USB_COMMAND {
+  struct {
+    ULONG Run                        : 1;
+    ULONG HCReset                    : 1;
+    ULONG InterrupterEnable          : 1;
+    ULONG HostSystemErrorEnable      : 1;
+    ULONG Reserved1                  : 3;
+    ULONG LightHCReset               : 1;
+    ULONG ControllerSaveState        : 1;
+    ULONG ControllerRestoreState     : 1;
+    ULONG EnableWrapEvent            : 1;
+    ULONG EnableU3MfindexStop        : 1;
+    ULONG Reserved2                  : 1;
+    ULONG CemEnable                  : 1;
+    ULONG Reserved3                  : 18;
+  };
+  ULONG AsULONG;
+} XHCI_USB_COMMAND;
+
+C_ASSERT(sizeof(XHCI_USB_COMMAND) == sizeof(ULONG));
+
+typedef union _XHCI_USB_STATUS {
+  struct {
+    ULONG HCHalted                   : 1;
+    ULONG Reserved1                  : 1;
+    ULONG HostSystemError            : 1; // RW1C
+    ULONG EventInterrupt             : 1; // RW1C
+    ULONG PortChangeDetect           : 1; // RW1C
+    ULONG Reserved2                  : 3;
+    ULONG SaveStateStatus            : 1;
+    ULONG RestoreStateStatus         : 1;
+    ULONG SaveRestoreError           : 1; // RW1C
+    ULONG ControllerNotReady         : 1;
+    ULONG HostControllerError        : 1;
+    ULONG Reserved3                  : 19;
+  };
+  ULONG AsULONG;
+} XHCI_USB_STATUS;
+
+C_ASSERT(sizeof(XHCI_USB_STATUS) == sizeof(ULONG));
+
+#define XHCI_USB_STATUS_RW1C_MASK  0x0000041C
+
+#define XHCI_PAGE_SIZE_4K  0x00000001
+
+typedef union _XHCI_COMMAND_RING_CONTROL {
+  struct {
+    ULONG RingCycleState             : 1;
+    ULONG CommandStop                : 1;
+    ULONG CommandAbort               : 1;
+    ULONG CommandRingRunning         : 1;
+    ULONG Reserved1                  : 2;
+    ULONG CommandRingPointerLo       : 26;
+  };
+  ULONG AsULONG;
+} XHCI_COMMAND_RING_CONTROL;
+
+C_ASSERT(sizeof(XHCI_COMMAND_RING_CONTROL) == sizeof(ULONG));
+
+/* Port Status and Control. Section 5.4.8 */
+typedef union _XHCI_PORT_STATUS_CONTROL {
+  struct {
+    ULONG CurrentConnectStatus       : 1;
+    ULONG PortEnabledDisabled        : 1; // RW1C
+    ULONG Reserved1                  : 1;
+    ULONG OverCurrentActive          : 1;
+    ULONG PortReset                  : 1; // RW1S
+    ULONG PortLinkState              : 4;
+    ULONG PortPower                  : 1;
+    ULONG PortSpeed                  : 4;
+    ULONG PortIndicatorControl       : 2;
+    ULONG PortLinkStateWriteStrobe   : 1;
+    ULONG ConnectStatusChange        : 1; // RW1C
+    ULONG PortEnabledDisabledChange  : 1; // RW1C
+    ULONG WarmPortResetChange        : 1; // RW1C
+    ULONG OverCurrentChange          : 1; // RW1C
+    ULONG PortResetChange            : 1; // RW1C
+    ULONG PortLinkStateChange        : 1; // RW1C
+    ULONG PortConfigErrorChange      : 1; // RW1C
+    ULONG ColdAttachStatus           : 1;
+    ULONG WakeOnConnectEnable        : 1;
+    ULONG WakeOnDisconnectEnable     : 1;
+    ULONG WakeOnOverCurrentEnable    : 1;
+    ULONG Reserved2                  : 2;
+    ULONG DeviceRemovable            : 1;
+    ULONG WarmPortReset              : 1; // RW1S
+  };
+  ULONG AsULONG;
+} XHCI_PORT_STATUS_CONTROL;
+
+C_ASSERT(sizeof(XHCI_PORT_STATUS_CONTROL) == sizeof(ULONG));
+
+/* Writing back a PORTSC value must not clear the change bits or the port
+   enable by accident. Only these RW bits are kept, everything else is zero */
+#define XHCI_PORTSC_PRESERVE_MASK  0x0E00C200
+#define XHCI_PORTSC_CHANGE_MASK    0x00FE0000
+
+#define XHCI_PORT_LINK_STATE_U0        0
+#define XHCI_PORT_LINK_STATE_U3        3
+#define XHCI_PORT_LINK_STATE_RESUME    15
+
+/* Default Protocol Speed IDs. Section 7.2.2.1.1 */
+#define XHCI_SPEED_FULL         1
+#define XHCI_SPEED_LOW          2
+#define XHCI_SPEED_HIGH         3
+#define XHCI_SPEED_SUPER        4
+
+typedef struct _XHCI_PORT_REGISTERS {
+  XHCI_PORT_STATUS_CONTROL PortStatusControl; // PORTSC
+  ULONG PortPowerManagement; // PORTPMSC
+  ULONG PortLinkInfo; // PORTLI
+  ULONG PortHardwareLpmControl; // PORTHLPMC
+} XHCI_PORT_REGISTERS, *PXHCI_PORT_REGISTERS;
+
+C_ASSERT(sizeof(XHCI_PORT_REGISTERS) == 0x10);
+
+typedef struct _XHCI_HW_REGISTERS {
+  XHCI_USB_COMMAND HcCommand; // RW. USBCMD
+  XHCI_USB_STATUS HcStatus; // RW. USBSTS
+  ULONG PageSize; // RO
+  ULONG Reserved1[2];
+  ULONG DeviceNotificationControl; // RW. DNCTRL
+  XHCI_COMMAND_RING_CONTROL CommandRingControl; // RW. CRCR
+  ULONG CommandRingControlHi;
+  ULONG Reserved2[4];
+  ULONG DeviceContextBaseArray; // RW. DCBAAP
+  ULONG DeviceContextBaseArrayHi;
+  ULONG Configure; // RW. CONFIG
+  ULONG Reserved3[241];
+  XHCI_PORT_REGISTERS PortRegisters[XHCI_MAX_PORTS];
+} XHCI_HW_REGISTERS, *PXHCI_HW_REGISTERS;
+
+C_ASSERT(FIELD_OFFSET(XHCI_HW_REGISTERS, CommandRingControl) == 0x18);
+C_ASSERT(FIELD_OFFSET(XHCI_HW_REGISTERS, DeviceContextBaseArray) == 0x30);
+C_ASSERT(FIELD_OFFSET(XHCI_HW_REGISTERS, PortRegisters) == 0x400);
+
+/* Host Controller Runtime Registers. Section 5.5 */
+typedef union _XHCI_INTERRUPTER_MANAGEMENT {
+  struct {
+    ULONG InterruptPending           : 1; // RW1C
+    ULONG InterruptEnable            : 1;
+    ULONG Reserved1                  : 30;
+  };
+  ULONG AsULONG;
+} XHCI_INTERRUPTER_MANAGEMENT;
+
+C_ASSERT(sizeof(XHCI_INTERRUPTER_MANAGEMENT) == sizeof(ULONG));
+
+/* Event Handler Busy, RW1C bit in the low part of ERDP */
+#define XHCI_EVENT_HANDLER_BUSY  0x00000008
+
+typedef struct _XHCI_INTERRUPTER_REGISTERS {
+  XHCI_INTERRUPTER_MANAGEMENT Management; // IMAN
+  ULONG Moderation; // IMOD. Interval in 250 ns units
+  ULONG EventRingSegmentTableSize; // ERSTSZ
+  ULONG Reserved1;
+  ULONG EventRingSegmentTableBase; // ERSTBA
+  ULONG EventRingSegmentTableBaseHi;
+  ULONG EventRingDequeuePointer; // ERDP
+  ULONG EventRingDequeuePointerHi;
+} XHCI_INTERRUPTER_REGISTERS, *PXHCI_INTERRUPTER_REGISTERS;
+
+C_ASSERT(sizeof(XHCI_INTERRUPTER_REGISTERS) == 0x20);
+
+typedef struct _XHCI_RUNTIME_REGISTERS {
+  ULONG MicroframeIndex; // MFINDEX
+  ULONG Reserved1[7];
+  XHCI_INTERRUPTER_REGISTERS Interrupter[1024];
+} XHCI_RUNTIME_REGISTERS, *PXHCI_RUNTIME_REGISTERS;
+
+C_ASSERT(FIELD_OFFSET(XHCI_RUNTIME_REGISTERS, Interrupter) == 0x20);
+
+/* Doorbell target for the command ring (Doorbell 0) */
+#define XHCI_DOORBELL_HOST_CONTROLLER  0
+
+/* Transfer Request Block types. Section 6.4.6 */
+#define XHCI_TRB_TYPE_NORMAL                  1
+#define XHCI_TRB_TYPE_SETUP_STAGE             2
+#define XHCI_TRB_TYPE_DATA_STAGE              3
+#define XHCI_TRB_TYPE_STATUS_STAGE            4
+#define XHCI_TRB_TYPE_ISOCH                   5
+#define XHCI_TRB_TYPE_LINK                    6
+#define XHCI_TRB_TYPE_EVENT_DATA              7
+#define XHCI_TRB_TYPE_NO_OP                   8
+#define XHCI_TRB_TYPE_ENABLE_SLOT             9
+#define XHCI_TRB_TYPE_DISABLE_SLOT            10
+#define XHCI_TRB_TYPE_ADDRESS_DEVICE          11
+#define XHCI_TRB_TYPE_CONFIGURE_ENDPOINT      12
+#define XHCI_TRB_TYPE_EVALUATE_CONTEXT        13
+#define XHCI_TRB_TYPE_RESET_ENDPOINT          14
+#define XHCI_TRB_TYPE_STOP_ENDPOINT           15
+#define XHCI_TRB_TYPE_SET_TR_DEQUEUE          16
+#define XHCI_TRB_TYPE_RESET_DEVICE            17
+#define XHCI_TRB_TYPE_NO_OP_COMMAND           23
+#define XHCI_TRB_TYPE_TRANSFER_EVENT          32
+#define XHCI_TRB_TYPE_COMMAND_COMPLETION      33
+#define XHCI_TRB_TYPE_PORT_STATUS_CHANGE      34
+#define XHCI_TRB_TYPE_BANDWIDTH_REQUEST       35
+#define XHCI_TRB_TYPE_DOORBELL                36
+#define XHCI_TRB_TYPE_HOST_CONTROLLER         37
+#define XHCI_TRB_TYPE_DEVICE_NOTIFICATION     38
+#define XHCI_TRB_TYPE_MFINDEX_WRAP            39
+
+/* TRB Completion Codes. Section 6.4.5 */
+#define XHCI_COMPLETION_INVALID               0
+#define XHCI_COMPLETION_SUCCESS               1
+#define XHCI_COMPLETION_DATA_BUFFER_ERROR     2
+#define XHCI_COMPLETION_BABBLE_DETECTED       3
+#define XHCI_COMPLETION_TRANSACTION_ERROR     4
+#define XHCI_COMPLETION_TRB_ERROR             5
+#define XHCI_COMPLETION_STALL                 6
+#define XHCI_COMPLETION_RESOURCE_ERROR        7
+#define XHCI_COMPLETION_BANDWIDTH_ERROR       8
+#define XHCI_COMPLETION_NO_SLOTS_AVAILABLE    9
+#define XHCI_COMPLETION_INVALID_STREAM_TYPE   10
+#define XHCI_COMPLETION_SLOT_NOT_ENABLED      11
+#define XHCI_COMPLETION_ENDPOINT_NOT_ENABLED  12
+#define XHCI_COMPLETION_SHORT_PACKET          13
+#define XHCI_COMPLETION_RING_UNDERRUN         14
+#define XHCI_COMPLETION_RING_OVERRUN          15
+#define XHCI_COMPLETION_PARAMETER_ERROR       17
+#define XHCI_COMPLETION_CONTEXT_STATE_ERROR   19
+#define XHCI_COMPLETION_EVENT_RING_FULL       21
+#define XHCI_COMPLETION_STOPPED               26
+#define XHCI_COMPLETION_STOPPED_LENGTH_INVALID 27
+#define XHCI_COMPLETION_STOPPED_SHORT_PACKET  28
+
+/* Transfer Type of the Setup Stage TRB */
+#define XHCI_TRANSFER_TYPE_NO_DATA   0
+#define XHCI_TRANSFER_TYPE_OUT_DATA  2
+#define XHCI_TRANSFER_TYPE_IN_DATA   3
+
+/* TRB buffers must not cross a 64 KB boundary. Section 6.1 */
+#define XHCI_TRB_MAX_TRANSFER_SIZE   0x10000
+#define XHCI_TRB_MAX_TD_SIZE         31
+
+typedef struct _XHCI_NORMAL_TRB {
+  ULONG BufferPointer;
+  ULONG BufferPointerHi;
+  ULONG TransferLength           : 17;
+  ULONG TdSize                   : 5;
+  ULONG InterrupterTarget        : 10;
+  ULONG Cycle                    : 1;
+  ULONG EvaluateNextTrb          : 1;
+  ULONG InterruptOnShortPacket   : 1;
+  ULONG NoSnoop                  : 1;
+  ULONG Chain                    : 1;
+  ULONG InterruptOnCompletion    : 1;
+  ULONG ImmediateData            : 1;
+  ULONG Reserved1                : 2;
+  ULONG BlockEventInterrupt      : 1;
+  ULONG Type                     : 6;
+  ULONG Direction                : 1; // Data Stage TRB only. 1 - IN
+  ULONG Reserved2                : 15;
+} XHCI_NORMAL_TRB, *PXHCI_NORMAL_TRB;
+
+C_ASSERT(sizeof(XHCI_NORMAL_TRB) == 16);
+
+typedef struct _XHCI_SETUP_TRB {
+  USB_DEFAULT_PIPE_SETUP_PACKET SetupPacket;
+  ULONG TransferLength           : 17; // Always 8
+  ULONG Reserved1                : 5;
+  ULONG InterrupterTarget        : 10;
+  ULONG Cycle                    : 1;
+  ULONG Reserved2                : 4;
+  ULONG InterruptOnCompletion    : 1;
+  ULONG ImmediateData            : 1; // Always 1
+  ULONG Reserved3                : 3;
+  ULONG Type                     : 6;
+  ULONG TransferType             : 2;
+  ULONG Reserved4                : 14;
+} XHCI_SETUP_TRB, *PXHCI_SETUP_TRB;
+
+C_ASSERT(sizeof(XHCI_SETUP_TRB) == 16);
+
+typedef struct _XHCI_STATUS_TRB {
+  ULONG Reserved1;
+  ULONG Reserved2;
+  ULONG Reserved3                : 22;
+  ULONG InterrupterTarget        : 10;
+  ULONG Cycle                    : 1;
+  ULONG EvaluateNextTrb          : 1;
+  ULONG Reserved4                : 2;
+  ULONG Chain                    : 1;
+  ULONG InterruptOnCompletion    : 1;
+  ULONG Reserved5                : 4;
+  ULONG Type                     : 6;
+  ULONG Direction                : 1;
+  ULONG Reserved6                : 15;
+} XHCI_STATUS_TRB, *PXHCI_STATUS_TRB;
+
+C_ASSERT(sizeof(XHCI_STATUS_TRB) == 16);
+
+typedef struct _XHCI_LINK_TRB {
+  ULONG RingSegmentPointer;
+  ULONG RingSegmentPointerHi;
+  ULONG Reserved1                : 22;
+  ULONG InterrupterTarget        : 10;
+  ULONG Cycle                    : 1;
+  ULONG ToggleCycle              : 1;
+  ULONG Reserved2                : 2;
+  ULONG Chain                    : 1;
+  ULONG InterruptOnCompletion    : 1;
+  ULONG Reserved3                : 4;
+  ULONG Type                     : 6;
+  ULONG Reserved4                : 16;
+} XHCI_LINK_TRB, *PXHCI_LINK_TRB;
+
+C_ASSERT(sizeof(XHCI_LINK_TRB) == 16);
+
+/* Common layout of the Command TRBs. Section 6.4.3 */
+typedef struct _XHCI_COMMAND_TRB {
+  ULONG Parameter; // Input Context or TR Dequeue Pointer
+  ULONG ParameterHi;
+  ULONG Reserved1                : 16;
+  ULONG StreamId                 : 16; // Set TR Dequeue Pointer only
+  ULONG Cycle                    : 1;
+  ULONG Reserved2                : 8;
+  ULONG BlockSetAddress          : 1; // BSR, Deconfigure or Transfer State Preserve
+  ULONG Type                     : 6;
+  ULONG EndpointId               : 5; // Or Slot Type for Enable Slot
+  ULONG Reserved3                : 2;
+  ULONG Suspend                  : 1; // Stop Endpoint only
+  ULONG SlotId                   : 8;
+} XHCI_COMMAND_TRB, *PXHCI_COMMAND_TRB;
+
+C_ASSERT(sizeof(XHCI_COMMAND_TRB) == 16);
+
+/* Common layout of the Event TRBs. Section 6.4.2 */
+typedef struct _XHCI_EVENT_TRB {
+  ULONG Parameter; // TRB Pointer, or Port ID in bits 24-31
+  ULONG ParameterHi;
+  ULONG Length                   : 24; // Residual transfer length
+  ULONG CompletionCode           : 8;
+  ULONG Cycle                    : 1;
+  ULONG Reserved1                : 1;
+  ULONG EventData                : 1;
+  ULONG Reserved2                : 7;
+  ULONG Type                     : 6;
+  ULONG EndpointId               : 5;
+  ULONG Reserved3                : 3;
+  ULONG SlotId                   : 8;
+} XHCI_EVENT_TRB, *PXHCI_EVENT_TRB;
+
+C_ASSERT(sizeof(XHCI_EVENT_TRB) == 16);
+
+typedef union _XHCI_TRB {
+  XHCI_NORMAL_TRB Normal; // Normal and Data Stage
+  XHCI_SETUP_TRB Setup;
+  XHCI_STATUS_TRB Status;
+  XHCI_LINK_TRB Link;
+  XHCI_COMMAND_TRB Command;
+  XHCI_EVENT_TRB Event;
+  ULONG AsULONG[4];
+} XHCI_TRB, *PXHCI_TRB;
+
+C_ASSERT(sizeof(XHCI_TRB) == 16);
+
+/* The Cycle bit lives in the last ULONG of every TRB, which is written last */
+#define XHCI_TRB_CYCLE  0x00000001
+#define XHCI_TRB_CHAIN  0x00000010
+
+/* Event Ring Segment Table Entry. Section 6.5 */
+typedef struct _XHCI_EVENT_RING_SEGMENT {
+  ULONG RingSegmentBase;
+  ULONG RingSegmentBaseHi;
+  ULONG RingSegmentSize;
+  ULONG Reserved;
+} XHCI_EVENT_RING_SEGMENT, *PXHCI_EVENT_RING_SEGMENT;
+
+C_ASSERT(sizeof(XHCI_EVENT_RING_SEGMENT) == 16);
+
+/* Contexts. Section 6.2. With CSZ set every context is padded to 64 bytes */
+typedef struct _XHCI_SLOT_CONTEXT {
+  ULONG RouteString              : 20;
+  ULONG Speed                    : 4;
+  ULONG Reserved1                : 1;
+  ULONG MultiTT                  : 1;
+  ULONG Hub                      : 1;
+  ULONG ContextEntries           : 5;
+  ULONG MaxExitLatency           : 16;
+  ULONG RootHubPortNumber        : 8;
+  ULONG NumberOfPorts            : 8;
+  ULONG TtHubSlotId              : 8;
+  ULONG TtPortNumber             : 8;
+  ULONG TtThinkTime              : 2;
+  ULONG Reserved2                : 4;
+  ULONG InterrupterTarget        : 10;
+  ULONG DeviceAddress            : 8;
+  ULONG Reserved3                : 19;
+  ULONG SlotState                : 5;
+  ULONG Reserved4[4];
+} XHCI_SLOT_CONTEXT, *PXHCI_SLOT_CONTEXT;
+
+C_ASSERT(sizeof(XHCI_SLOT_CONTEXT) == XHCI_DEFAULT_CONTEXT_SIZE);
+
+#define XHCI_ENDPOINT_STATE_DISABLED  0
+#define XHCI_ENDPOINT_STATE_RUNNING   1
+#define XHCI_ENDPOINT_STATE_HALTED    2
+#define XHCI_ENDPOINT_STATE_STOPPED   3
+#define XHCI_ENDPOINT_STATE_ERROR     4
+
+#define XHCI_ENDPOINT_TYPE_ISOCH_OUT      1
+#define XHCI_ENDPOINT_TYPE_BULK_OUT       2
+#define XHCI_ENDPOINT_TYPE_INTERRUPT_OUT  3
+#define XHCI_ENDPOINT_TYPE_CONTROL        4
+#define XHCI_ENDPOINT_TYPE_ISOCH_IN       5
+#define XHCI_ENDPOINT_TYPE_BULK_IN        6
+#define XHCI_ENDPOINT_TYPE_INTERRUPT_IN   7
+
+typedef struct _XHCI_ENDPOINT_CONTEXT {
+  ULONG EndpointState            : 3;
+  ULONG Reserved1                : 5;
+  ULONG Mult                     : 2;
+  ULONG MaxPrimaryStreams        : 5;
+  ULONG LinearStreamArray        : 1;
+  ULONG Interval                 : 8;
+  ULONG MaxEsitPayloadHi         : 8;
+  ULONG Reserved2                : 1;
+  ULONG ErrorCount               : 2;
+  ULONG EndpointType             : 3;
+  ULONG Reserved3                : 1;
+  ULONG HostInitiateDisable      : 1;
+  ULONG MaxBurstSize             : 8;
+  ULONG MaxPacketSize            : 16;
+  ULONG DequeuePointer; // Bit 0 - Dequeue Cycle State
+  ULONG DequeuePointerHi;
+  ULONG AverageTrbLength         : 16;
+  ULONG MaxEsitPayloadLo         : 16;
+  ULONG Reserved4[3];
+} XHCI_ENDPOINT_CONTEXT, *PXHCI_ENDPOINT_CONTEXT;
+
+C_ASSERT(sizeof(XHCI_ENDPOINT_CONTEXT) == XHCI_DEFAULT_CONTEXT_SIZE);
+
+typedef struct _XHCI_INPUT_CONTROL_CONTEXT {
+  ULONG DropContextFlags;
+  ULONG AddContextFlags;
+  ULONG Reserved1[5];
+  ULONG ConfigurationValue       : 8;
+  ULONG InterfaceNumber          : 8;
+  ULONG AlternateSetting         : 8;
+  ULONG Reserved2                : 8;
+} XHCI_INPUT_CONTROL_CONTEXT, *PXHCI_INPUT_CONTROL_CONTEXT;
+
+C_ASSERT(sizeof(XHCI_INPUT_CONTROL_CONTEXT) == XHCI_DEFAULT_CONTEXT_SIZE);
@@ -0,0 +1,438 @@
+/*
+ * PROJECT:     ReactOS USB XHCI Miniport Driver
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     USBXHCI root hub functions
+ */
+
+#include "usbxhci.h"
+
+#define NDEBUG
+#include <debug.h>
+
+#define NDEBUG_XHCI_ROOT_HUB
+#include "dbg_xhci.h"
+
+#define XHCI_PORT_BIT(Port)    (1 << (((Port) - 1) % 32))
+#define XHCI_PORT_INDEX(Port)  (((Port) - 1) / 32)
+
+PULONG
+NTAPI
+XHCI_RH_GetPortStatusReg(IN PXHCI_EXTENSION XhciExtension,
+                         IN ULONG Port)
+{
+    ASSERT(Port != 0 && Port <= XhciExtension->NumberOfPorts);
+    return &XhciExtension->OperationalRegs->PortRegisters[Port - 1].PortStatusControl.AsULONG;
+}
+
+VOID
+NTAPI
+XHCI_RH_WritePortStatus(IN PULONG PortStatusReg,
+                        IN XHCI_PORT_STATUS_CONTROL PortSC)
+{
+    XHCI_PORT_STATUS_CONTROL PortValue;
+
+    /* Only the bits being set are written as ones, the read value
+       would disable the port and clear all the change bits */
+    PortValue.AsULONG = READ_REGISTER_ULONG(PortStatusReg) & XHCI_PORTSC_PRESERVE_MASK;
+    PortValue.AsULONG |= PortSC.AsULONG;
+
+    WRITE_REGISTER_ULONG(PortStatusReg, PortValue.AsULONG);
+}
+
+ULONG
+NTAPI
+XHCI_RH_GetPortSpeed(IN PXHCI_EXTENSION XhciExtension,
+                     IN ULONG Port)
+{
+    XHCI_PORT_STATUS_CONTROL PortSC;
+
+    if (Port == 0 || Port > XhciExtension->NumberOfPorts)
+        return XHCI_SPEED_HIGH;
+
+    PortSC.AsULONG = READ_REGISTER_ULONG(XHCI_RH_GetPortStatusReg(XhciExtension, Port));
+
+    return PortSC.PortSpeed;
+}
+
+MPSTATUS
+NTAPI
+XHCI_RH_ChirpRootPort(IN PVOID xhciExtension,
+                      IN USHORT Port)
+{
+    /* No companion controllers, every port stays with the xHC */
+    DPRINT_RH("XHCI_RH_ChirpRootPort: Port - %x\n", Port);
+    return MP_STATUS_SUCCESS;
+}
+
+VOID
+NTAPI
+XHCI_RH_GetRootHubData(IN PVOID xhciExtension,
+                       IN PVOID rootHubData)
+{
+    PXHCI_EXTENSION XhciExtension = xhciExtension;
+    PUSBPORT_ROOT_HUB_DATA RootHubData;
+    USBPORT_HUB_20_CHARACTERISTICS HubCharacteristics;
+
+    DPRINT_RH("XHCI_RH_GetRootHubData: XhciExtension - %p, rootHubData - %p\n",
+              XhciExtension,
+              rootHubData);
+
+    RootHubData = rootHubData;
+
+    /* USB 2 and USB 3 ports of the root hub are all shown as one USB 2 hub */
+    RootHubData->NumberOfPorts = XhciExtension->NumberOfPorts;
+
+    HubCharacteristics.AsUSHORT = 0;
+    HubCharacteristics.PowerControlMode = XhciExtension->PortPowerControl;
+    HubCharacteristics.NoPowerSwitching = 0;
+    HubCharacteristics.PartOfCompoundDevice = 0;
+    HubCharacteristics.OverCurrentProtectionMode = 1;
+
+    RootHubData->HubCharacteristics.Usb20HubCharacteristics = HubCharacteristics;
+
+    RootHubData->PowerOnToPowerGood = 10; // Time (in 2 ms intervals)
+    RootHubData->HubControlCurrent = 0;
+}
+
+MPSTATUS
+NTAPI
+XHCI_RH_GetStatus(IN PVOID xhciExtension,
+                  IN PUSHORT Status)
+{
+    DPRINT_RH("XHCI_RH_GetStatus: ... \n");
+    *Status = USB_GETSTATUS_SELF_POWERED;
+    return MP_STATUS_SUCCESS;
+}
+
+MPSTATUS
+NTAPI
+XHCI_RH_GetPortStatus(IN PVOID xhciExtension,
+                      IN USHORT Port,
+                      IN PUSB_PORT_STATUS_AND_CHANGE PortStatus)
+{
+    PXHCI_EXTENSION XhciExtension = xhciExtension;
+    XHCI_PORT_STATUS_CONTROL PortSC;
+    USB_PORT_STATUS_AND_CHANGE status;
+
+    PortSC.AsULONG = READ_REGISTER_ULONG(XHCI_RH_GetPortStatusReg(XhciExtension, Port));
+
+    if (PortSC.CurrentConnectStatus)
+    {
+        DPRINT_RH("XHCI_RH_GetPortStatus: Port - %x, PortSC.AsULONG - %X\n",
+                  Port,
+                  PortSC.AsULONG);
+    }
+
+    status.AsUlong32 = 0;
+
+    status.PortStatus.Usb20PortStatus.CurrentConnectStatus = PortSC.CurrentConnectStatus;
+    status.PortStatus.Usb20PortStatus.PortEnabledDisabled = PortSC.PortEnabledDisabled;
+    status.PortStatus.Usb20PortStatus.OverCurrent = PortSC.OverCurrentActive;
+    status.PortStatus.Usb20PortStatus.Reset = PortSC.PortReset;
+    status.PortStatus.Usb20PortStatus.PortPower = PortSC.PortPower;
+
+    if (PortSC.PortLinkState == XHCI_PORT_LINK_STATE_U3)
+        status.PortStatus.Usb20PortStatus.Suspend = 1;
+
+    /* usbhub knows no SuperSpeed, those devices are treated as high speed */
+    if (PortSC.CurrentConnectStatus)
+    {
+        if (PortSC.PortSpeed == XHCI_SPEED_LOW)
+            status.PortStatus.Usb20PortStatus.LowSpeedDeviceAttached = 1;
+        else if (PortSC.PortSpeed >= XHCI_SPEED_HIGH)
+            status.PortStatus.Usb20PortStatus.HighSpeedDeviceAttached = 1;
+    }
+
+    status.PortChange.Usb20PortChange.ConnectStatusChange = PortSC.ConnectStatusChange;
+    status.PortChange.Usb20PortChange.PortEnableDisableChange = PortSC.PortEnabledDisabledChange;
+    status.PortChange.Usb20PortChange.OverCurrentIndicatorChange = PortSC.OverCurrentChange;
+    status.PortChange.Usb20PortChange.ResetChange = PortSC.PortResetChange |
+                                                    PortSC.WarmPortResetChange;
+
+    if (XhciExtension->SuspendChangePortBits[XHCI_PORT_INDEX(Port)] & XHCI_PORT_BIT(Port))
+        status.PortChange.Usb20PortChange.SuspendChange = 1;
+
+    *PortStatus = status;
+
+    return MP_STATUS_SUCCESS;
+}
+
+MPSTATUS
+NTAPI
+XHCI_RH_GetHubStatus(IN PVOID xhciExtension,
+                     IN PUSB_HUB_STATUS_AND_CHANGE HubStatus)
+{
+    DPRINT_RH("XHCI_RH_GetHubStatus: ... \n");
+    HubStatus->AsUlong32 = 0;
+    return MP_STATUS_SUCCESS;
+}
+
+MPSTATUS
+NTAPI
+XHCI_RH_SetFeaturePortReset(IN PVOID xhciExtension,
+                            IN USHORT Port)
+{
+    PXHCI_EXTENSION XhciExtension = xhciExtension;
+    XHCI_PORT_STATUS_CONTROL PortSC;
+
+    DPRINT("XHCI_RH_SetFeaturePortReset: Port - %x\n", Port);
+
+    /* Port Reset Change is set when the reset is done */
+    PortSC.AsULONG = 0;
+    PortSC.PortReset = 1;
+    XHCI_RH_WritePortStatus(XHCI_RH_GetPortStatusReg(XhciExtension, Port), PortSC);
+
+    return MP_STATUS_SUCCESS;
+}
+
+MPSTATUS
+NTAPI
+XHCI_RH_SetFeaturePortPower(IN PVOID xhciExtension,
+                            IN USHORT Port)
+{
+    PXHCI_EXTENSION XhciExtension = xhciExtension;
+    XHCI_PORT_STATUS_CONTROL PortSC;
+
+    DPRINT_RH("XHCI_RH_SetFeaturePortPower: Port - %x\n", Port);
+
+    PortSC.AsULONG = 0;
+    PortSC.PortPower = 1;
+    XHCI_RH_WritePortStatus(XHCI_RH_GetPortStatusReg(XhciExtension, Port), PortSC);
+
+    return MP_STATUS_SUCCESS;
+}
+
+MPSTATUS
+NTAPI
+XHCI_RH_SetFeaturePortEnable(IN PVOID xhciExtension,
+                             IN USHORT Port)
+{
+    /* Ports are enabled by the reset, or by the link training for USB 3 */
+    DPRINT_RH("XHCI_RH_SetFeaturePortEnable: Not supported\n");
+    return MP_STATUS_SUCCESS;
+}
+
+MPSTATUS
+NTAPI
+XHCI_RH_SetFeaturePortSuspend(IN PVOID xhciExtension,
+                              IN USHORT Port)
+{
+    PXHCI_EXTENSION XhciExtension = xhciExtension;
+    XHCI_PORT_STATUS_CONTROL PortSC;
+
+    DPRINT("XHCI_RH_SetFeaturePortSuspend: Port - %x\n", Port);
+
+    PortSC.AsULONG = 0;
+    PortSC.PortLinkState = XHCI_PORT_LINK_STATE_U3;
+    PortSC.PortLinkStateWriteStrobe = 1;
+    XHCI_RH_WritePortStatus(XHCI_RH_GetPortStatusReg(XhciExtension, Port), PortSC);
+
+    return MP_STATUS_SUCCESS;
+}
+
+MPSTATUS
+NTAPI
+XHCI_RH_ClearFeaturePortEnable(IN PVOID xhciExtension,
+                               IN USHORT Port)
+{
+    PXHCI_EXTENSION XhciExtension = xhciExtension;
+    XHCI_PORT_STATUS_CONTROL PortSC;
+
+    DPRINT("XHCI_RH_ClearFeaturePortEnable: Port - %x\n", Port);
+
+    /* PED is RW1C */
+    PortSC.AsULONG = 0;
+    PortSC.PortEnabledDisabled = 1;
+    XHCI_RH_WritePortStatus(XHCI_RH_GetPortStatusReg(XhciExtension, Port), PortSC);
+
+    return MP_STATUS_SUCCESS;
+}
+
+MPSTATUS
+NTAPI
+XHCI_RH_ClearFeaturePortPower(IN PVOID xhciExtension,
+                              IN USHORT Port)
+{
+    PXHCI_EXTENSION XhciExtension = xhciExtension;
+    PULONG PortStatusReg;
+    XHCI_PORT_STATUS_CONTROL PortSC;
+
+    DPRINT("XHCI_RH_ClearFeaturePortPower: Port - %x\n", Port);
+
+    PortStatusReg = XHCI_RH_GetPortStatusReg(XhciExtension, Port);
+
+    PortSC.AsULONG = READ_REGISTER_ULONG(PortStatusReg) & XHCI_PORTSC_PRESERVE_MASK;
+    PortSC.PortPower = 0;
+    WRITE_REGISTER_ULONG(PortStatusReg, PortSC.AsULONG);
+
+    return MP_STATUS_SUCCESS;
+}
+
+VOID
+NTAPI
+XHCI_RH_PortResumeComplete(IN PVOID xhciExtension,
+                           IN PVOID Context)
+{
+    PXHCI_EXTENSION XhciExtension = xhciExtension;
+    XHCI_PORT_STATUS_CONTROL PortSC;
+    PUSHORT Port = Context;
+
+    DPRINT("XHCI_RH_PortResumeComplete: *Port - %x\n", *Port);
+
+    /* End the resume signalling */
+    PortSC.AsULONG = 0;
+    PortSC.PortLinkState = XHCI_PORT_LINK_STATE_U0;
+    PortSC.PortLinkStateWriteStrobe = 1;
+    XHCI_RH_WritePortStatus(XHCI_RH_GetPortStatusReg(XhciExtension, *Port), PortSC);
+
+    XhciExtension->SuspendChangePortBits[XHCI_PORT_INDEX(*Port)] |= XHCI_PORT_BIT(*Port);
+
+    RegPacket.UsbPortInvalidateRootHub(XhciExtension);
+}
+
+MPSTATUS
+NTAPI
+XHCI_RH_ClearFeaturePortSuspend(IN PVOID xhciExtension,
+                                IN USHORT Port)
+{
+    PXHCI_EXTENSION XhciExtension = xhciExtension;
+    XHCI_PORT_STATUS_CONTROL PortSC;
+
+    DPRINT("XHCI_RH_ClearFeaturePortSuspend: Port - %x\n", Port);
+
+    PortSC.AsULONG = 0;
+    PortSC.PortLinkStateWriteStrobe = 1;
+
+    if (XhciExtension->PortMajorRevision[Port - 1] >= 3)
+    {
+        /* The controller does the U3 -> U0 transition by itself */
+        PortSC.PortLinkState = XHCI_PORT_LINK_STATE_U0;
+        XHCI_RH_WritePortStatus(XHCI_RH_GetPortStatusReg(XhciExtension, Port), PortSC);
+
+        XhciExtension->SuspendChangePortBits[XHCI_PORT_INDEX(Port)] |= XHCI_PORT_BIT(Port);
+        return MP_STATUS_SUCCESS;
+    }
+
+    /* USB 2 ports signal resume for 20 ms, and then go back to U0. Section 4.15.2 */
+    PortSC.PortLinkState = XHCI_PORT_LINK_STATE_RESUME;
+    XHCI_RH_WritePortStatus(XHCI_RH_GetPortStatusReg(XhciExtension, Port), PortSC);
+
+    RegPacket.UsbPortRequestAsyncCallback(XhciExtension,
+                                          20, // TimerValue
+                                          &Port,
+                                          sizeof(Port),
+                                          XHCI_RH_PortResumeComplete);
+
+    return MP_STATUS_SUCCESS;
+}
+
+MPSTATUS
+NTAPI
+XHCI_RH_ClearFeaturePortEnableChange(IN PVOID xhciExtension,
+                                     IN USHORT Port)
+{
+    PXHCI_EXTENSION XhciExtension = xhciExtension;
+    XHCI_PORT_STATUS_CONTROL PortSC;
+
+    DPRINT_RH("XHCI_RH_ClearFeaturePortEnableChange: Port - %x\n", Port);
+
+    PortSC.AsULONG = 0;
+    PortSC.PortEnabledDisabledChange = 1;
+    XHCI_RH_WritePortStatus(XHCI_RH_GetPortStatusReg(XhciExtension, Port), PortSC);
+
+    return MP_STATUS_SUCCESS;
+}
+
+MPSTATUS
+NTAPI
+XHCI_RH_ClearFeaturePortConnectChange(IN PVOID xhciExtension,
+                                      IN USHORT Port)
+{
+    PXHCI_EXTENSION XhciExtension = xhciExtension;
+    XHCI_PORT_STATUS_CONTROL PortSC;
+
+    DPRINT_RH("XHCI_RH_ClearFeaturePortConnectChange: Port - %x\n", Port);
+
+    PortSC.AsULONG = 0;
+    PortSC.ConnectStatusChange = 1;
+    XHCI_RH_WritePortStatus(XHCI_RH_GetPortStatusReg(XhciExtension, Port), PortSC);
+
+    return MP_STATUS_SUCCESS;
+}
+
+MPSTATUS
+NTAPI
+XHCI_RH_ClearFeaturePortResetChange(IN PVOID xhciExtension,
+                                    IN USHORT Port)
+{
+    PXHCI_EXTENSION XhciExtension = xhciExtension;
+    XHCI_PORT_STATUS_CONTROL PortSC;
+
+    DPRINT_RH("XHCI_RH_ClearFeaturePortResetChange: Port - %x\n", Port);
+
+    PortSC.AsULONG = 0;
+    PortSC.PortResetChange = 1;
+    PortSC.WarmPortResetChange = 1;
+    XHCI_RH_WritePortStatus(XHCI_RH_GetPortStatusReg(XhciExtension, Port), PortSC);
+
+    return MP_STATUS_SUCCESS;
+}
+
+MPSTATUS
+NTAPI
+XHCI_RH_ClearFeaturePortSuspendChange(IN PVOID xhciExtension,
+                                      IN USHORT Port)
+{
+    PXHCI_EXTENSION XhciExtension = xhciExtension;
+    XHCI_PORT_STATUS_CONTROL PortSC;
+
+    DPRINT_RH("XHCI_RH_ClearFeaturePortSuspendChange: Port - %x\n", Port);
+
+    XhciExtension->SuspendChangePortBits[XHCI_PORT_INDEX(Port)] &= ~XHCI_PORT_BIT(Port);
+
+    PortSC.AsULONG = 0;
+    PortSC.PortLinkStateChange = 1;
+    XHCI_RH_WritePortStatus(XHCI_RH_GetPortStatusReg(XhciExtension, Port), PortSC);
+
+    return MP_STATUS_SUCCESS;
+}
+
+MPSTATUS
+NTAPI
+XHCI_RH_ClearFeaturePortOvercurrentChange(IN PVOID xhciExtension,
+                                          IN USHORT Port)
+{
+    PXHCI_EXTENSION XhciExtension = xhciExtension;
+    XHCI_PORT_STATUS_CONTROL PortSC;
+
+    DPRINT_RH("XHCI_RH_ClearFeaturePortOvercurrentChange: Port - %x\n", Port);
+
+    PortSC.AsULONG = 0;
+    PortSC.OverCurrentChange = 1;
+    XHCI_RH_WritePortStatus(XHCI_RH_GetPortStatusReg(XhciExtension, Port), PortSC);
+
+    return MP_STATUS_SUCCESS;
+}
+
+VOID
+NTAPI
+XHCI_RH_DisableIrq(IN PVOID xhciExtension)
+{
+    PXHCI_EXTENSION XhciExtension = xhciExtension;
+
+    DPRINT_RH("XHCI_RH_DisableIrq: ... \n");
+
+    /* Port Status Change Events keep coming, they are just not reported */
+    XhciExtension->PortChangeIrq = FALSE;
+}
+
+VOID
+NTAPI
+XHCI_RH_EnableIrq(IN PVOID xhciExtension)
+{
+    PXHCI_EXTENSION XhciExtension = xhciExtension;
+
+    DPRINT_RH("XHCI_RH_EnableIrq: ... \n");
+
+    XhciExtension->PortChangeIrq = TRUE;
+}
@@ -0,0 +1,2760 @@
+/*
+ * PROJECT:     ReactOS USB XHCI Miniport Driver
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     USBXHCI main driver functions
+ */
+
+#include "usbxhci.h"
+
+#define NDEBUG
+#include <debug.h>
+
+#define NDEBUG_XHCI_TRACE
+#include "dbg_xhci.h"
+
+USBPORT_REGISTRATION_PACKET RegPacket;
+
+/* Rings ******************************************************************/
+
+VOID
+NTAPI
+XHCI_InitializeRing(IN PXHCI_RING Ring,
+                    IN PXHCI_TRB FirstTrb,
+                    IN ULONG FirstTrbPA,
+                    IN ULONG Segments)
+{
+    PXHCI_TRB LinkTrb;
+    ULONG Segment;
+
+    DPRINT_XHCI("XHCI_InitializeRing: FirstTrb - %p, Segments - %x\n",
+                FirstTrb,
+                Segments);
+
+    RtlZeroMemory(FirstTrb, Segments * PAGE_SIZE);
+
+    /* Every segment ends with a Link TRB to the next one,
+       the last one goes back to the start and toggles the cycle state */
+    for (Segment = 0; Segment < Segments; Segment++)
+    {
+        LinkTrb = &FirstTrb[Segment * XHCI_SEGMENT_TRBS + XHCI_SEGMENT_TRBS - 1];
+
+        LinkTrb->Link.RingSegmentPointer = FirstTrbPA +
+                                           ((Segment + 1) % Segments) * PAGE_SIZE;
+        LinkTrb->Link.Type = XHCI_TRB_TYPE_LINK;
+        LinkTrb->Link.ToggleCycle = (Segment == Segments - 1);
+    }
+
+    Ring->FirstTrb = FirstTrb;
+    Ring->FirstTrbPA = FirstTrbPA;
+    Ring->Segments = Segments;
+    Ring->EnqueueIndex = 0;
+    Ring->CycleState = 1;
+}
+
+ULONG
+NTAPI
+XHCI_NextTrbIndex(IN PXHCI_RING Ring,
+                  IN ULONG Index)
+{
+    Index++;
+
+    if ((Index % XHCI_SEGMENT_TRBS) == XHCI_SEGMENT_TRBS - 1)
+        Index++;
+
+    if (Index >= Ring->Segments * XHCI_SEGMENT_TRBS)
+        Index = 0;
+
+    return Index;
+}
+
+ULONG
+NTAPI
+XHCI_QueueTrb(IN PXHCI_RING Ring,
+              IN PXHCI_TRB Trb,
+              IN BOOLEAN IsFirstTrb)
+{
+    PXHCI_TRB RingTrb;
+    PXHCI_TRB LinkTrb;
+    ULONG Index;
+    ULONG Control;
+    ULONG Cycle;
+
+    Index = Ring->EnqueueIndex;
+    RingTrb = &Ring->FirstTrb[Index];
+
+    /* The first TRB of a TD is handed over last, see XHCI_CommitTrbs() */
+    Cycle = Ring->CycleState;
+
+    if (IsFirstTrb)
+        Cycle ^= XHCI_TRB_CYCLE;
+
+    Control = (Trb->AsULONG[3] & ~XHCI_TRB_CYCLE) | Cycle;
+
+    RingTrb->AsULONG[0] = Trb->AsULONG[0];
+    RingTrb->AsULONG[1] = Trb->AsULONG[1];
+    RingTrb->AsULONG[2] = Trb->AsULONG[2];
+    KeMemoryBarrier();
+    RingTrb->AsULONG[3] = Control;
+
+    Ring->EnqueueIndex++;
+
+    if ((Ring->EnqueueIndex % XHCI_SEGMENT_TRBS) != XHCI_SEGMENT_TRBS - 1)
+        return Index;
+
+    /* Pass the Link TRB to the controller. It must keep the TD chained */
+    LinkTrb = &Ring->FirstTrb[Ring->EnqueueIndex];
+
+    Control = LinkTrb->AsULONG[3] & ~(XHCI_TRB_CYCLE | XHCI_TRB_CHAIN);
+    Control |= Trb->AsULONG[3] & XHCI_TRB_CHAIN;
+    Control |= Ring->CycleState;
+
+    KeMemoryBarrier();
+    LinkTrb->AsULONG[3] = Control;
+
+    if (LinkTrb->Link.ToggleCycle)
+    {
+        Ring->EnqueueIndex = 0;
+        Ring->CycleState ^= XHCI_TRB_CYCLE;
+    }
+    else
+    {
+        Ring->EnqueueIndex++;
+    }
+
+    return Index;
+}
+
+VOID
+NTAPI
+XHCI_CommitTrbs(IN PXHCI_RING Ring,
+                IN ULONG FirstTrbIndex,
+                IN ULONG FirstTrbCycle)
+{
+    PXHCI_TRB Trb = &Ring->FirstTrb[FirstTrbIndex];
+
+    KeMemoryBarrier();
+    Trb->AsULONG[3] = (Trb->AsULONG[3] & ~XHCI_TRB_CYCLE) | FirstTrbCycle;
+}
+
+ULONG
+NTAPI
+XHCI_RingTrbPA(IN PXHCI_RING Ring,
+               IN ULONG Index)
+{
+    return Ring->FirstTrbPA + Index * sizeof(XHCI_TRB);
+}
+
+/* Commands and events ****************************************************/
+
+USBD_STATUS
+NTAPI
+XHCI_GetUsbdStatus(IN ULONG CompletionCode)
+{
+    switch (CompletionCode)
+    {
+        case XHCI_COMPLETION_SUCCESS:
+        case XHCI_COMPLETION_SHORT_PACKET:
+            return USBD_STATUS_SUCCESS;
+
+        case XHCI_COMPLETION_STALL:
+            return USBD_STATUS_STALL_PID;
+
+        case XHCI_COMPLETION_BABBLE_DETECTED:
+            return USBD_STATUS_BABBLE_DETECTED;
+
+        case XHCI_COMPLETION_DATA_BUFFER_ERROR:
+            return USBD_STATUS_DATA_BUFFER_ERROR;
+
+        default:
+            return USBD_STATUS_XACT_ERROR;
+    }
+}
+
+ULONG
+NTAPI
+XHCI_GetTransferredLength(IN PXHCI_RING Ring,
+                          IN PXHCI_TRANSFER XhciTransfer,
+                          IN ULONG TrbIndex,
+                          IN ULONG Residual)
+{
+    PXHCI_TRB Trb;
+    ULONG Index;
+    ULONG Length = 0;
+
+    /* Sum up the data TRBs of the TD up to the one the event points to */
+    for (Index = XhciTransfer->FirstTrbIndex; ; Index = XHCI_NextTrbIndex(Ring, Index))
+    {
+        Trb = &Ring->FirstTrb[Index];
+
+        if (Trb->Normal.Type == XHCI_TRB_TYPE_NORMAL ||
+            Trb->Normal.Type == XHCI_TRB_TYPE_DATA_STAGE)
+        {
+            if (Index == TrbIndex)
+                Length += Trb->Normal.TransferLength - min(Residual, Trb->Normal.TransferLength);
+            else
+                Length += Trb->Normal.TransferLength;
+        }
+
+        if (Index == TrbIndex || Index == XhciTransfer->NextTrbIndex)
+            break;
+    }
+
+    return Length;
+}
+
+BOOLEAN
+NTAPI
+XHCI_ProcessTransferEvent(IN PXHCI_EXTENSION XhciExtension,
+                          IN PXHCI_EVENT_TRB Event)
+{
+    PXHCI_ENDPOINT XhciEndpoint;
+    PXHCI_TRANSFER XhciTransfer = NULL;
+    PXHCI_RING Ring;
+    PLIST_ENTRY Entry;
+    ULONG TotalTrbs;
+    ULONG TrbIndex;
+    ULONG Residual;
+
+    if (Event->SlotId == 0 || Event->SlotId > XhciExtension->NumberOfSlots)
+        return FALSE;
+
+    XhciEndpoint = XhciExtension->Slots[Event->SlotId].Endpoints[Event->EndpointId];
+
+    if (!XhciEndpoint)
+    {
+        DPRINT("XHCI_ProcessTransferEvent: No endpoint. Slot - %x, Dci - %x\n",
+               Event->SlotId,
+               Event->EndpointId);
+        return FALSE;
+    }
+
+    Ring = &XhciEndpoint->TransferRing;
+    TotalTrbs = Ring->Segments * XHCI_SEGMENT_TRBS;
+
+    if (Event->ParameterHi ||
+        Event->Parameter < Ring->FirstTrbPA ||
+        Event->Parameter >= XHCI_RingTrbPA(Ring, TotalTrbs))
+    {
+        DPRINT1("XHCI_ProcessTransferEvent: Bad TRB pointer - %08X, Code - %x\n",
+                Event->Parameter,
+                Event->CompletionCode);
+        return FALSE;
+    }
+
+    TrbIndex = (Event->Parameter - Ring->FirstTrbPA) / sizeof(XHCI_TRB);
+
+    for (Entry = XhciEndpoint->TransferList.Flink;
+         Entry != &XhciEndpoint->TransferList;
+         Entry = Entry->Flink)
+    {
+        XhciTransfer = CONTAINING_RECORD(Entry, XHCI_TRANSFER, TransferLink);
+
+        if (!(XhciTransfer->Flags & XHCI_TRANSFER_FLAG_NO_TRBS) &&
+            ((TrbIndex + TotalTrbs - XhciTransfer->FirstTrbIndex) % TotalTrbs) <
+            ((XhciTransfer->NextTrbIndex + TotalTrbs - XhciTransfer->FirstTrbIndex) % TotalTrbs))
+        {
+            break;
+        }
+
+        XhciTransfer = NULL;
+    }
+
+    /* Aborted transfers are gone already */
+    if (!XhciTransfer || (XhciTransfer->Flags & XHCI_TRANSFER_FLAG_DONE))
+        return FALSE;
+
+    Residual = Event->Length;
+
+    switch (Event->CompletionCode)
+    {
+        case XHCI_COMPLETION_SUCCESS:
+            if (!(XhciTransfer->Flags & XHCI_TRANSFER_FLAG_SHORT))
+                XhciTransfer->CompletedLength = XhciTransfer->TransferParameters->TransferBufferLength;
+
+            XhciTransfer->USBDStatus = USBD_STATUS_SUCCESS;
+            XhciTransfer->Flags |= XHCI_TRANSFER_FLAG_DONE;
+            break;
+
+        case XHCI_COMPLETION_SHORT_PACKET:
+            XhciTransfer->CompletedLength = XHCI_GetTransferredLength(Ring,
+                                                                      XhciTransfer,
+                                                                      TrbIndex,
+                                                                      Residual);
+            XhciTransfer->Flags |= XHCI_TRANSFER_FLAG_SHORT;
+
+            /* A control transfer still has its status stage to run */
+            if (XhciEndpoint->EndpointProperties.TransferType != USBPORT_TRANSFER_TYPE_CONTROL)
+            {
+                XhciTransfer->USBDStatus = USBD_STATUS_SUCCESS;
+                XhciTransfer->Flags |= XHCI_TRANSFER_FLAG_DONE;
+            }
+
+            break;
+
+        case XHCI_COMPLETION_STOPPED:
+        case XHCI_COMPLETION_STOPPED_SHORT_PACKET:
+            XhciTransfer->CompletedLength = XHCI_GetTransferredLength(Ring,
+                                                                      XhciTransfer,
+                                                                      TrbIndex,
+                                                                      Residual);
+            break;
+
+        case XHCI_COMPLETION_STOPPED_LENGTH_INVALID:
+            XhciTransfer->CompletedLength = XHCI_GetTransferredLength(Ring,
+                                                                      XhciTransfer,
+                                                                      TrbIndex,
+                                                                      MAXULONG);
+            break;
+
+        default:
+            DPRINT("XHCI_ProcessTransferEvent: XhciTransfer - %p, Code - %x\n",
+                   XhciTransfer,
+                   Event->CompletionCode);
+
+            XhciTransfer->CompletedLength = XHCI_GetTransferredLength(Ring,
+                                                                      XhciTransfer,
+                                                                      TrbIndex,
+                                                                      Residual);
+            XhciTransfer->USBDStatus = XHCI_GetUsbdStatus(Event->CompletionCode);
+            XhciTransfer->Flags |= XHCI_TRANSFER_FLAG_DONE;
+            XhciEndpoint->Flags |= XHCI_ENDPOINT_FLAG_HALTED;
+            break;
+    }
+
+    return (XhciTransfer->Flags & XHCI_TRANSFER_FLAG_DONE) != 0;
+}
+
+ULONG
+NTAPI
+XHCI_ProcessEventRing(IN PXHCI_EXTENSION XhciExtension,
+                      IN ULONG Interrupter)
+{
+    PXHCI_INTERRUPTER_REGISTERS InterrupterRegs;
+    PXHCI_TRB EventRing;
+    PXHCI_EVENT_TRB Event;
+    ULONG Index;
+    ULONG Cycle;
+    ULONG Events = 0;
+    BOOLEAN IsProcessed = FALSE;
+    KIRQL OldIrql;
+
+    KeAcquireSpinLock(&XhciExtension->EventLock, &OldIrql);
+
+    EventRing = XhciExtension->HcResourcesVA->EventRing[Interrupter];
+    Index = XhciExtension->EventDequeueIndex[Interrupter];
+    Cycle = XhciExtension->EventCycleState[Interrupter];
+
+    while ((EventRing[Index].AsULONG[3] & XHCI_TRB_CYCLE) == Cycle)
+    {
+        KeMemoryBarrier();
+
+        Event = &EventRing[Index].Event;
+
+        switch (Event->Type)
+        {
+            case XHCI_TRB_TYPE_TRANSFER_EVENT:
+                if (XHCI_ProcessTransferEvent(XhciExtension, Event))
+                    Events |= XHCI_EVENT_TRANSFER;
+                break;
+
+            case XHCI_TRB_TYPE_COMMAND_COMPLETION:
+                if (Event->Parameter == XhciExtension->CommandTrbPA)
+                {
+                    XhciExtension->CommandCompletionCode = (UCHAR)Event->CompletionCode;
+                    XhciExtension->CommandSlotId = (UCHAR)Event->SlotId;
+                    XhciExtension->CommandDone = TRUE;
+                }
+                break;
+
+            case XHCI_TRB_TYPE_PORT_STATUS_CHANGE:
+                DPRINT_XHCI("XHCI_ProcessEventRing: Port - %x changed\n",
+                            Event->Parameter >> 24);
+                Events |= XHCI_EVENT_PORT;
+                break;
+
+            default:
+                DPRINT("XHCI_ProcessEventRing: Event type - %x\n", Event->Type);
+                break;
+        }
+
+        IsProcessed = TRUE;
+
+        Index++;
+
+        if (Index == XHCI_EVENT_TRBS)
+        {
+            Index = 0;
+            Cycle ^= XHCI_TRB_CYCLE;
+        }
+    }
+
+    if (IsProcessed)
+    {
+        XhciExtension->EventDequeueIndex[Interrupter] = Index;
+        XhciExtension->EventCycleState[Interrupter] = Cycle;
+
+        InterrupterRegs = &XhciExtension->RuntimeRegs->Interrupter[Interrupter];
+
+        WRITE_REGISTER_ULONG(&InterrupterRegs->EventRingDequeuePointer,
+                             XhciExtension->HcResourcesPA +
+                             FIELD_OFFSET(XHCI_HC_RESOURCES, EventRing) +
+                             Interrupter * XHCI_EVENT_TRBS * sizeof(XHCI_TRB) +
+                             Index * sizeof(XHCI_TRB) +
+                             XHCI_EVENT_HANDLER_BUSY);
+
+        WRITE_REGISTER_ULONG(&InterrupterRegs->EventRingDequeuePointerHi, 0);
+    }
+
+    KeReleaseSpinLock(&XhciExtension->EventLock, OldIrql);
+
+    return Events;
+}
+
+ULONG
+NTAPI
+XHCI_ProcessEvents(IN PXHCI_EXTENSION XhciExtension)
+{
+    ULONG Interrupter;
+    ULONG Events = 0;
+
+    for (Interrupter = 0; Interrupter < XhciExtension->NumberOfInterrupters; Interrupter++)
+    {
+        Events |= XHCI_ProcessEventRing(XhciExtension, Interrupter);
+    }
+
+    return Events;
+}
+
+ULONG
+NTAPI
+XHCI_IssueCommand(IN PXHCI_EXTENSION XhciExtension,
+                  IN ULONG Type,
+                  IN ULONG SlotId,
+                  IN ULONG EndpointId,
+                  IN BOOLEAN Flag,
+                  IN ULONG ParameterPA)
+{
+    PXHCI_RING Ring = &XhciExtension->CommandRing;
+    XHCI_COMMAND_RING_CONTROL CommandRingControl;
+    XHCI_TRB Trb;
+    ULONG Events = 0;
+    ULONG ix;
+
+    DPRINT_XHCI("XHCI_IssueCommand: Type - %x, SlotId - %x, EndpointId - %x\n",
+                Type,
+                SlotId,
+                EndpointId);
+
+    /* Commands are issued one at a time under the usbport miniport lock
+       and are waited for. They take a few microseconds on the controller */
+    RtlZeroMemory(&Trb, sizeof(Trb));
+
+    Trb.Command.Parameter = ParameterPA;
+    Trb.Command.Type = Type;
+    Trb.Command.SlotId = SlotId;
+    Trb.Command.EndpointId = EndpointId;
+    Trb.Command.BlockSetAddress = Flag;
+
+    XhciExtension->CommandDone = FALSE;
+    XhciExtension->CommandTrbPA = XHCI_RingTrbPA(Ring, Ring->EnqueueIndex);
+
+    XHCI_QueueTrb(Ring, &Trb, FALSE);
+
+    WRITE_REGISTER_ULONG(&XhciExtension->DoorbellRegs[XHCI_DOORBELL_HOST_CONTROLLER], 0);
+
+    for (ix = 0; ix < XHCI_COMMAND_TIMEOUT * 100; ix++)
+    {
+        Events |= XHCI_ProcessEventRing(XhciExtension, XHCI_COMMAND_INTERRUPTER);
+
+        if (XhciExtension->CommandDone)
+            break;
+
+        KeStallExecutionProcessor(10);
+    }
+
+    if (Events & XHCI_EVENT_TRANSFER)
+        RegPacket.UsbPortInvalidateEndpoint(XhciExtension, NULL);
+
+    if ((Events & XHCI_EVENT_PORT) && XhciExtension->PortChangeIrq)
+        RegPacket.UsbPortInvalidateRootHub(XhciExtension);
+
+    if (!XhciExtension->CommandDone)
+    {
+        DPRINT1("XHCI_IssueCommand: Command %x timed out\n", Type);
+
+        /* The next doorbell restarts the ring after the aborted command */
+        CommandRingControl.AsULONG = 0;
+        CommandRingControl.CommandAbort = 1;
+        WRITE_REGISTER_ULONG(&XhciExtension->OperationalRegs->CommandRingControl.AsULONG,
+                             CommandRingControl.AsULONG);
+        WRITE_REGISTER_ULONG(&XhciExtension->OperationalRegs->CommandRingControlHi, 0);
+
+        return XHCI_COMPLETION_INVALID;
+    }
+
+    if (XhciExtension->CommandCompletionCode != XHCI_COMPLETION_SUCCESS)
+    {
+        DPRINT("XHCI_IssueCommand: Command %x, CompletionCode - %x\n",
+               Type,
+               XhciExtension->CommandCompletionCode);
+    }
+
+    return XhciExtension->CommandCompletionCode;
+}
+
+/* Contexts ***************************************************************/
+
+PVOID
+NTAPI
+XHCI_GetInputContext(IN PXHCI_EXTENSION XhciExtension,
+                     IN ULONG Index)
+{
+    /* Input Control Context, then the Slot and Endpoint contexts (DCI + 1) */
+    return XhciExtension->HcResourcesVA->InputContext + Index * XhciExtension->ContextSize;
+}
+
+PVOID
+NTAPI
+XHCI_GetDeviceContext(IN PXHCI_EXTENSION XhciExtension,
+                      IN ULONG SlotId,
+                      IN ULONG Dci)
+{
+    return XhciExtension->HcResourcesVA->DeviceContext[SlotId - 1] + Dci * XhciExtension->ContextSize;
+}
+
+ULONG
+NTAPI
+XHCI_GetInputContextPA(IN PXHCI_EXTENSION XhciExtension)
+{
+    return XhciExtension->HcResourcesPA + FIELD_OFFSET(XHCI_HC_RESOURCES, InputContext);
+}
+
+PXHCI_INPUT_CONTROL_CONTEXT
+NTAPI
+XHCI_PrepareInputContext(IN PXHCI_EXTENSION XhciExtension,
+                         IN ULONG SlotId,
+                         IN ULONG AddFlags,
+                         IN ULONG DropFlags)
+{
+    PXHCI_INPUT_CONTROL_CONTEXT InputControl;
+    ULONG Dci;
+
+    RtlZeroMemory(XhciExtension->HcResourcesVA->InputContext, PAGE_SIZE);
+
+    InputControl = XHCI_GetInputContext(XhciExtension, 0);
+    InputControl->AddContextFlags = AddFlags;
+    InputControl->DropContextFlags = DropFlags;
+
+    /* Start from what the controller has for the contexts being changed */
+    if (SlotId)
+    {
+        for (Dci = 0; Dci < XHCI_MAX_ENDPOINTS; Dci++)
+        {
+            if (!(AddFlags & (1 << Dci)))
+                continue;
+
+            RtlCopyMemory(XHCI_GetInputContext(XhciExtension, Dci + 1),
+                          XHCI_GetDeviceContext(XhciExtension, SlotId, Dci),
+                          sizeof(XHCI_ENDPOINT_CONTEXT));
+        }
+    }
+
+    return InputControl;
+}
+
+ULONG
+NTAPI
+XHCI_GetLastEndpointId(IN PXHCI_SLOT Slot,
+                       IN PXHCI_ENDPOINT ExceptEndpoint)
+{
+    ULONG Dci;
+
+    for (Dci = XHCI_MAX_ENDPOINTS - 1; Dci > 1; Dci--)
+    {
+        if (Slot->Endpoints[Dci] && Slot->Endpoints[Dci] != ExceptEndpoint)
+            break;
+    }
+
+    return Dci;
+}
+
+VOID
+NTAPI
+XHCI_BindEndpoint(IN PXHCI_EXTENSION XhciExtension,
+                  IN PXHCI_ENDPOINT XhciEndpoint,
+                  IN BOOLEAN IsBind)
+{
+    PXHCI_SLOT Slot = &XhciExtension->Slots[XhciEndpoint->SlotId];
+    KIRQL OldIrql;
+
+    KeAcquireSpinLock(&XhciExtension->EventLock, &OldIrql);
+
+    if (IsBind)
+        Slot->Endpoints[XhciEndpoint->EndpointId] = XhciEndpoint;
+    else if (Slot->Endpoints[XhciEndpoint->EndpointId] == XhciEndpoint)
+        Slot->Endpoints[XhciEndpoint->EndpointId] = NULL;
+
+    KeReleaseSpinLock(&XhciExtension->EventLock, OldIrql);
+}
+
+VOID
+NTAPI
+XHCI_DisableSlot(IN PXHCI_EXTENSION XhciExtension,
+                 IN ULONG SlotId)
+{
+    PXHCI_SLOT Slot = &XhciExtension->Slots[SlotId];
+    KIRQL OldIrql;
+
+    DPRINT("XHCI_DisableSlot: SlotId - %x, DeviceAddress - %x\n",
+           SlotId,
+           Slot->DeviceAddress);
+
+    XHCI_IssueCommand(XhciExtension,
+                      XHCI_TRB_TYPE_DISABLE_SLOT,
+                      SlotId,
+                      0,
+                      FALSE,
+                      0);
+
+    KeAcquireSpinLock(&XhciExtension->EventLock, &OldIrql);
+
+    if ((Slot->Flags & XHCI_SLOT_FLAG_ADDRESSED) &&
+        XhciExtension->AddressToSlot[Slot->DeviceAddress] == SlotId)
+    {
+        XhciExtension->AddressToSlot[Slot->DeviceAddress] = 0;
+    }
+
+    RtlZeroMemory(Slot, sizeof(XHCI_SLOT));
+    XhciExtension->HcResourcesVA->DeviceContextBaseArray[SlotId] = 0;
+
+    KeReleaseSpinLock(&XhciExtension->EventLock, OldIrql);
+}
+
+ULONG
+NTAPI
+XHCI_GetDequeuePointer(IN PXHCI_ENDPOINT XhciEndpoint)
+{
+    PXHCI_RING Ring = &XhciEndpoint->TransferRing;
+    PXHCI_TRANSFER XhciTransfer;
+    PLIST_ENTRY Entry;
+
+    /* The controller goes on with the first TD that is not done yet */
+    for (Entry = XhciEndpoint->TransferList.Flink;
+         Entry != &XhciEndpoint->TransferList;
+         Entry = Entry->Flink)
+    {
+        XhciTransfer = CONTAINING_RECORD(Entry, XHCI_TRANSFER, TransferLink);
+
+        if (!(XhciTransfer->Flags & (XHCI_TRANSFER_FLAG_DONE | XHCI_TRANSFER_FLAG_NO_TRBS)))
+        {
+            return XHCI_RingTrbPA(Ring, XhciTransfer->FirstTrbIndex) |
+                   XhciTransfer->FirstTrbCycle;
+        }
+    }
+
+    return XHCI_RingTrbPA(Ring, Ring->EnqueueIndex) | Ring->CycleState;
+}
+
+BOOLEAN
+NTAPI
+XHCI_HasPendingTransfers(IN PXHCI_ENDPOINT XhciEndpoint)
+{
+    PXHCI_TRANSFER XhciTransfer;
+    PLIST_ENTRY Entry;
+
+    for (Entry = XhciEndpoint->TransferList.Flink;
+         Entry != &XhciEndpoint->TransferList;
+         Entry = Entry->Flink)
+    {
+        XhciTransfer = CONTAINING_RECORD(Entry, XHCI_TRANSFER, TransferLink);
+
+        if (!(XhciTransfer->Flags & (XHCI_TRANSFER_FLAG_DONE | XHCI_TRANSFER_FLAG_NO_TRBS)))
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+VOID
+NTAPI
+XHCI_RingDoorbell(IN PXHCI_EXTENSION XhciExtension,
+                  IN PXHCI_ENDPOINT XhciEndpoint)
+{
+    WRITE_REGISTER_ULONG(&XhciExtension->DoorbellRegs[XhciEndpoint->SlotId],
+                         XhciEndpoint->EndpointId);
+}
+
+VOID
+NTAPI
+XHCI_RestartEndpoint(IN PXHCI_EXTENSION XhciExtension,
+                     IN PXHCI_ENDPOINT XhciEndpoint,
+                     IN BOOLEAN IsResetHalt)
+{
+    ULONG DequeuePointer;
+    BOOLEAN IsPending;
+    KIRQL OldIrql;
+
+    DPRINT_XHCI("XHCI_RestartEndpoint: XhciEndpoint - %p, Flags - %x\n",
+                XhciEndpoint,
+                XhciEndpoint->Flags);
+
+    if (IsResetHalt)
+    {
+        /* Also resets the data toggle or sequence number */
+        XHCI_IssueCommand(XhciExtension,
+                          XHCI_TRB_TYPE_RESET_ENDPOINT,
+                          XhciEndpoint->SlotId,
+                          XhciEndpoint->EndpointId,
+                          FALSE,
+                          0);
+    }
+
+    KeAcquireSpinLock(&XhciExtension->EventLock, &OldIrql);
+    DequeuePointer = XHCI_GetDequeuePointer(XhciEndpoint);
+    IsPending = XHCI_HasPendingTransfers(XhciEndpoint);
+    KeReleaseSpinLock(&XhciExtension->EventLock, OldIrql);
+
+    /* Skip the TRBs of the failed or aborted transfers */
+    if (IsResetHalt || (XhciEndpoint->Flags & XHCI_ENDPOINT_FLAG_DEQUEUE_MOVED))
+    {
+        XHCI_IssueCommand(XhciExtension,
+                          XHCI_TRB_TYPE_SET_TR_DEQUEUE,
+                          XhciEndpoint->SlotId,
+                          XhciEndpoint->EndpointId,
+                          FALSE,
+                          DequeuePointer);
+    }
+
+    XhciEndpoint->Flags &= ~(XHCI_ENDPOINT_FLAG_HALTED | XHCI_ENDPOINT_FLAG_DEQUEUE_MOVED);
+
+    if (IsPending)
+        XHCI_RingDoorbell(XhciExtension, XhciEndpoint);
+}
+
+/* Endpoints **************************************************************/
+
+ULONG
+NTAPI
+XHCI_GetSlotSpeed(IN PXHCI_EXTENSION XhciExtension,
+                  IN PUSBPORT_ENDPOINT_PROPERTIES EndpointProperties)
+{
+    /* Only the port knows about SuperSpeed, usbhub thinks it is high speed */
+    if (EndpointProperties->RouteString == 0)
+        return XHCI_RH_GetPortSpeed(XhciExtension, EndpointProperties->RootPortNumber);
+
+    switch (EndpointProperties->DeviceSpeed)
+    {
+        case UsbLowSpeed:
+            return XHCI_SPEED_LOW;
+
+        case UsbFullSpeed:
+            return XHCI_SPEED_FULL;
+
+        default:
+            return XHCI_SPEED_HIGH;
+    }
+}
+
+VOID
+NTAPI
+XHCI_MarkHubSlot(IN PXHCI_EXTENSION XhciExtension,
+                 IN ULONG HubSlotId,
+                 IN ULONG TtPortNumber)
+{
+    PXHCI_SLOT HubSlot = &XhciExtension->Slots[HubSlotId];
+    PXHCI_SLOT_CONTEXT SlotContext;
+
+    if ((HubSlot->Flags & XHCI_SLOT_FLAG_HUB) && TtPortNumber <= HubSlot->NumberOfPorts)
+        return;
+
+    DPRINT("XHCI_MarkHubSlot: HubSlotId - %x, TtPortNumber - %x\n",
+           HubSlotId,
+           TtPortNumber);
+
+    /* The TT of a high speed hub is only used once the slot says it is a hub */
+    XHCI_PrepareInputContext(XhciExtension, HubSlotId, 1, 0);
+
+    SlotContext = XHCI_GetInputContext(XhciExtension, 1);
+    SlotContext->Hub = 1;
+    SlotContext->NumberOfPorts = max(TtPortNumber, HubSlot->NumberOfPorts);
+
+    if (XHCI_IssueCommand(XhciExtension,
+                          XHCI_TRB_TYPE_CONFIGURE_ENDPOINT,
+                          HubSlotId,
+                          0,
+                          FALSE,
+                          XHCI_GetInputContextPA(XhciExtension)) == XHCI_COMPLETION_SUCCESS)
+    {
+        HubSlot->Flags |= XHCI_SLOT_FLAG_HUB;
+        HubSlot->NumberOfPorts = SlotContext->NumberOfPorts;
+    }
+}
+
+MPSTATUS
+NTAPI
+XHCI_OpenDefaultEndpoint(IN PXHCI_EXTENSION XhciExtension,
+                         IN PXHCI_ENDPOINT XhciEndpoint)
+{
+    PUSBPORT_ENDPOINT_PROPERTIES EndpointProperties;
+    PXHCI_SLOT_CONTEXT SlotContext;
+    PXHCI_ENDPOINT_CONTEXT EndpointContext;
+    PXHCI_RING Ring;
+    PXHCI_SLOT Slot;
+    ULONG SlotId;
+    ULONG HubSlotId;
+    ULONG Code;
+
+    EndpointProperties = &XhciEndpoint->EndpointProperties;
+    Ring = &XhciEndpoint->TransferRing;
+
+    DPRINT("XHCI_OpenDefaultEndpoint: DeviceAddress - %x, Port - %x, Route - %05X\n",
+           EndpointProperties->DeviceAddress,
+           EndpointProperties->RootPortNumber,
+           EndpointProperties->RouteString);
+
+    if (EndpointProperties->DeviceAddress)
+    {
+        /* usbport reopens the pipe after SET_ADDRESS with a new ring
+           and the real bMaxPacketSize0. The slot is already addressed */
+        SlotId = XhciExtension->AddressToSlot[EndpointProperties->DeviceAddress];
+
+        if (!SlotId)
+            return MP_STATUS_ERROR;
+
+        Slot = &XhciExtension->Slots[SlotId];
+
+        XhciEndpoint->SlotId = SlotId;
+        XhciEndpoint->MaxPacketSize = (Slot->Speed == XHCI_SPEED_SUPER) ?
+                                      512 :
+                                      EndpointProperties->TotalMaxPacketSize;
+
+        XHCI_BindEndpoint(XhciExtension, XhciEndpoint, TRUE);
+
+        Code = XHCI_IssueCommand(XhciExtension,
+                                 XHCI_TRB_TYPE_SET_TR_DEQUEUE,
+                                 SlotId,
+                                 XhciEndpoint->EndpointId,
+                                 FALSE,
+                                 Ring->FirstTrbPA | Ring->CycleState);
+
+        if (Code != XHCI_COMPLETION_SUCCESS)
+            return MP_STATUS_ERROR;
+
+        XHCI_PrepareInputContext(XhciExtension, SlotId, 1 << 1, 0);
+
+        EndpointContext = XHCI_GetInputContext(XhciExtension, 2);
+        EndpointContext->MaxPacketSize = XhciEndpoint->MaxPacketSize;
+
+        Code = XHCI_IssueCommand(XhciExtension,
+                                 XHCI_TRB_TYPE_EVALUATE_CONTEXT,
+                                 SlotId,
+                                 0,
+                                 FALSE,
+                                 XHCI_GetInputContextPA(XhciExtension));
+
+        return (Code == XHCI_COMPLETION_SUCCESS) ? MP_STATUS_SUCCESS : MP_STATUS_ERROR;
+    }
+
+    /* A new device in the Default state. It gets a slot here,
+       and its USB address with the SET_ADDRESS request later */
+    Code = XHCI_IssueCommand(XhciExtension,
+                             XHCI_TRB_TYPE_ENABLE_SLOT,
+                             0,
+                             0,
+                             FALSE,
+                             0);
+
+    SlotId = XhciExtension->CommandSlotId;
+
+    if (Code != XHCI_COMPLETION_SUCCESS || SlotId == 0 || SlotId > XhciExtension->NumberOfSlots)
+    {
+        DPRINT1("XHCI_OpenDefaultEndpoint: Enable Slot failed. Code - %x\n", Code);
+        return MP_STATUS_NO_RESOURCES;
+    }
+
+    Slot = &XhciExtension->Slots[SlotId];
+    RtlZeroMemory(Slot, sizeof(XHCI_SLOT));
+
+    Slot->Flags = XHCI_SLOT_FLAG_ENABLED;
+    Slot->Speed = XHCI_GetSlotSpeed(XhciExtension, EndpointProperties);
+
+    RtlZeroMemory(XhciExtension->HcResourcesVA->DeviceContext[SlotId - 1],
+                  sizeof(XhciExtension->HcResourcesVA->DeviceContext[0]));
+
+    XhciExtension->HcResourcesVA->DeviceContextBaseArray[SlotId] =
+        XhciExtension->HcResourcesPA +
+        FIELD_OFFSET(XHCI_HC_RESOURCES, DeviceContext) +
+        (SlotId - 1) * sizeof(XhciExtension->HcResourcesVA->DeviceContext[0]);
+
+    XHCI_PrepareInputContext(XhciExtension, 0, (1 << 0) | (1 << 1), 0);
+
+    SlotContext = XHCI_GetInputContext(XhciExtension, 1);
+    SlotContext->RouteString = EndpointProperties->RouteString;
+    SlotContext->Speed = Slot->Speed;
+    SlotContext->ContextEntries = 1;
+    SlotContext->RootHubPortNumber = EndpointProperties->RootPortNumber;
+
+    /* Low and full speed devices behind a high speed hub go through its TT */
+    if (EndpointProperties->HubAddr != 0xFFFF &&
+        (Slot->Speed == XHCI_SPEED_LOW || Slot->Speed == XHCI_SPEED_FULL))
+    {
+        HubSlotId = XhciExtension->AddressToSlot[EndpointProperties->HubAddr];
+
+        if (HubSlotId)
+        {
+            XHCI_MarkHubSlot(XhciExtension, HubSlotId, EndpointProperties->TtPortNumber);
+
+            /* XHCI_MarkHubSlot() used the input context too */
+            XHCI_PrepareInputContext(XhciExtension, 0, (1 << 0) | (1 << 1), 0);
+
+            SlotContext->RouteString = EndpointProperties->RouteString;
+            SlotContext->Speed = Slot->Speed;
+            SlotContext->ContextEntries = 1;
+            SlotContext->RootHubPortNumber = EndpointProperties->RootPortNumber;
+            SlotContext->TtHubSlotId = HubSlotId;
+            SlotContext->TtPortNumber = EndpointProperties->TtPortNumber;
+        }
+    }
+
+    XhciEndpoint->SlotId = SlotId;
+    XhciEndpoint->MaxPacketSize = (Slot->Speed == XHCI_SPEED_SUPER) ?
+                                  512 :
+                                  EndpointProperties->TotalMaxPacketSize;
+
+    EndpointContext = XHCI_GetInputContext(XhciExtension, 2);
+    EndpointContext->EndpointType = XHCI_ENDPOINT_TYPE_CONTROL;
+    EndpointContext->ErrorCount = 3;
+    EndpointContext->MaxPacketSize = XhciEndpoint->MaxPacketSize;
+    EndpointContext->DequeuePointer = Ring->FirstTrbPA | Ring->CycleState;
+    EndpointContext->AverageTrbLength = 8;
+
+    XHCI_BindEndpoint(XhciExtension, XhciEndpoint, TRUE);
+
+    /* Set up the slot, but don't send SET_ADDRESS to the device yet */
+    Code = XHCI_IssueCommand(XhciExtension,
+                             XHCI_TRB_TYPE_ADDRESS_DEVICE,
+                             SlotId,
+                             0,
+                             TRUE,
+                             XHCI_GetInputContextPA(XhciExtension));
+
+    if (Code != XHCI_COMPLETION_SUCCESS)
+    {
+        DPRINT1("XHCI_OpenDefaultEndpoint: Address Device failed. Code - %x\n", Code);
+        XHCI_DisableSlot(XhciExtension, SlotId);
+        return MP_STATUS_ERROR;
+    }
+
+    return MP_STATUS_SUCCESS;
+}
+
+MPSTATUS
+NTAPI
+XHCI_ConfigureEndpoint(IN PXHCI_EXTENSION XhciExtension,
+                       IN PXHCI_ENDPOINT XhciEndpoint)
+{
+    PUSBPORT_ENDPOINT_PROPERTIES EndpointProperties;
+    PXHCI_INPUT_CONTROL_CONTEXT InputControl;
+    PXHCI_SLOT_CONTEXT SlotContext;
+    PXHCI_ENDPOINT_CONTEXT EndpointContext;
+    PXHCI_RING Ring;
+    PXHCI_SLOT Slot;
+    ULONG Dci;
+    ULONG MaxBurst;
+    ULONG Interval;
+    ULONG Code;
+
+    EndpointProperties = &XhciEndpoint->EndpointProperties;
+    Ring = &XhciEndpoint->TransferRing;
+    Slot = &XhciExtension->Slots[XhciEndpoint->SlotId];
+    Dci = XhciEndpoint->EndpointId;
+
+    if (!(Slot->Flags & XHCI_SLOT_FLAG_ENABLED))
+        return MP_STATUS_ERROR;
+
+    XhciEndpoint->MaxPacketSize = EndpointProperties->MaxPacketSize;
+
+    if (Slot->Speed == XHCI_SPEED_SUPER)
+        MaxBurst = EndpointProperties->MaxBurst;
+    else if (Slot->Speed == XHCI_SPEED_HIGH &&
+             EndpointProperties->TransferType == USBPORT_TRANSFER_TYPE_INTERRUPT)
+        MaxBurst = EndpointProperties->TransactionPerMicroframe - 1;
+    else
+        MaxBurst = 0;
+
+    /* The slot context comes from the controller, the endpoint one is new */
+    InputControl = XHCI_PrepareInputContext(XhciExtension, XhciEndpoint->SlotId, 1 << 0, 0);
+    InputControl->AddContextFlags |= 1 << Dci;
+
+    SlotContext = XHCI_GetInputContext(XhciExtension, 1);
+    SlotContext->ContextEntries = max(SlotContext->ContextEntries, Dci);
+
+    EndpointContext = XHCI_GetInputContext(XhciExtension, Dci + 1);
+    EndpointContext->ErrorCount = 3;
+    EndpointContext->MaxPacketSize = XhciEndpoint->MaxPacketSize;
+    EndpointContext->MaxBurstSize = MaxBurst;
+    EndpointContext->DequeuePointer = Ring->FirstTrbPA | Ring->CycleState;
+
+    switch (EndpointProperties->TransferType)
+    {
+        case USBPORT_TRANSFER_TYPE_CONTROL:
+            EndpointContext->EndpointType = XHCI_ENDPOINT_TYPE_CONTROL;
+            EndpointContext->AverageTrbLength = 8;
+            break;
+
+        case USBPORT_TRANSFER_TYPE_BULK:
+            EndpointContext->EndpointType = (EndpointProperties->EndpointAddress & USB_ENDPOINT_DIRECTION_MASK) ?
+                                            XHCI_ENDPOINT_TYPE_BULK_IN :
+                                            XHCI_ENDPOINT_TYPE_BULK_OUT;
+            EndpointContext->AverageTrbLength = PAGE_SIZE;
+            break;
+
+        case USBPORT_TRANSFER_TYPE_INTERRUPT:
+            EndpointContext->EndpointType = (EndpointProperties->EndpointAddress & USB_ENDPOINT_DIRECTION_MASK) ?
+                                            XHCI_ENDPOINT_TYPE_INTERRUPT_IN :
+                                            XHCI_ENDPOINT_TYPE_INTERRUPT_OUT;
+
+            /* 2^Interval microframes. usbport has the period in frames */
+            for (Interval = 3; (1UL << (Interval - 3)) < EndpointProperties->Period; Interval++);
+
+            EndpointContext->Interval = Interval;
+            EndpointContext->MaxEsitPayloadLo = XhciEndpoint->MaxPacketSize * (MaxBurst + 1);
+            EndpointContext->AverageTrbLength = EndpointContext->MaxEsitPayloadLo;
+            break;
+
+        default:
+            return MP_STATUS_NOT_SUPPORTED;
+    }
+
+    XHCI_BindEndpoint(XhciExtension, XhciEndpoint, TRUE);
+
+    Code = XHCI_IssueCommand(XhciExtension,
+                             XHCI_TRB_TYPE_CONFIGURE_ENDPOINT,
+                             XhciEndpoint->SlotId,
+                             0,
+                             FALSE,
+                             XHCI_GetInputContextPA(XhciExtension));
+
+    if (Code != XHCI_COMPLETION_SUCCESS)
+    {
+        DPRINT1("XHCI_ConfigureEndpoint: Failed. Dci - %x, Code - %x\n", Dci, Code);
+        XHCI_BindEndpoint(XhciExtension, XhciEndpoint, FALSE);
+        return (Code == XHCI_COMPLETION_BANDWIDTH_ERROR) ? MP_STATUS_NO_BANDWIDTH : MP_STATUS_ERROR;
+    }
+
+    XhciEndpoint->Flags |= XHCI_ENDPOINT_FLAG_CONFIGURED;
+
+    return MP_STATUS_SUCCESS;
+}
+
+MPSTATUS
+NTAPI
+XHCI_OpenEndpoint(IN PVOID xhciExtension,
+                  IN PUSBPORT_ENDPOINT_PROPERTIES EndpointProperties,
+                  IN PVOID xhciEndpoint)
+{
+    PXHCI_EXTENSION XhciExtension = xhciExtension;
+    PXHCI_ENDPOINT XhciEndpoint = xhciEndpoint;
+    ULONG EndpointNumber;
+
+    DPRINT("XHCI_OpenEndpoint: DeviceAddress - %x, EndpointAddress - %x\n",
+           EndpointProperties->DeviceAddress,
+           EndpointProperties->EndpointAddress);
+
+    if (EndpointProperties->TransferType == USBPORT_TRANSFER_TYPE_ISOCHRONOUS)
+    {
+        DPRINT1("XHCI_OpenEndpoint: Iso. UNIMPLEMENTED. FIXME\n");
+        return MP_STATUS_NOT_SUPPORTED;
+    }
+
+    RtlCopyMemory(&XhciEndpoint->EndpointProperties,
+                  EndpointProperties,
+                  sizeof(XhciEndpoint->EndpointProperties));
+
+    XhciEndpoint->Flags = 0;
+    InitializeListHead(&XhciEndpoint->TransferList);
+
+    XHCI_InitializeRing(&XhciEndpoint->TransferRing,
+                        (PXHCI_TRB)EndpointProperties->BufferVA,
+                        EndpointProperties->BufferPA,
+                        EndpointProperties->BufferLength / PAGE_SIZE);
+
+    /* Device Context Index. Control endpoints use the IN one */
+    EndpointNumber = EndpointProperties->EndpointAddress & 0x0F;
+
+    if (EndpointProperties->TransferType == USBPORT_TRANSFER_TYPE_CONTROL ||
+        (EndpointProperties->EndpointAddress & USB_ENDPOINT_DIRECTION_MASK))
+    {
+        XhciEndpoint->EndpointId = EndpointNumber * 2 + 1;
+    }
+    else
+    {
+        XhciEndpoint->EndpointId = EndpointNumber * 2;
+    }
+
+    if (XhciEndpoint->EndpointId == 1)
+        return XHCI_OpenDefaultEndpoint(XhciExtension, XhciEndpoint);
+
+    XhciEndpoint->SlotId = XhciExtension->AddressToSlot[EndpointProperties->DeviceAddress];
+
+    if (!XhciEndpoint->SlotId)
+    {
+        DPRINT1("XHCI_OpenEndpoint: No slot for DeviceAddress - %x\n",
+                EndpointProperties->DeviceAddress);
+        return MP_STATUS_ERROR;
+    }
+
+    return XHCI_ConfigureEndpoint(XhciExtension, XhciEndpoint);
+}
+
+MPSTATUS
+NTAPI
+XHCI_ReopenEndpoint(IN PVOID xhciExtension,
+                    IN PUSBPORT_ENDPOINT_PROPERTIES EndpointProperties,
+                    IN PVOID xhciEndpoint)
+{
+    PXHCI_EXTENSION XhciExtension = xhciExtension;
+    PXHCI_ENDPOINT XhciEndpoint = xhciEndpoint;
+
+    DPRINT("XHCI_ReopenEndpoint: XhciEndpoint - %p, DeviceAddress - %x\n",
+           XhciEndpoint,
+           EndpointProperties->DeviceAddress);
+
+    /* The pipe moves over to the slot of the restored device */
+    if (XhciEndpoint->SlotId)
+        XHCI_BindEndpoint(XhciExtension, XhciEndpoint, FALSE);
+
+    return XHCI_OpenEndpoint(XhciExtension, EndpointProperties, XhciEndpoint);
+}
+
+VOID
+NTAPI
+XHCI_QueryEndpointRequirements(IN PVOID xhciExtension,
+                               IN PUSBPORT_ENDPOINT_PROPERTIES EndpointProperties,
+                               IN PUSBPORT_ENDPOINT_REQUIREMENTS EndpointRequirements)
+{
+    ULONG TransferType;
+
+    DPRINT("XHCI_QueryEndpointRequirements: ... \n");
+
+    TransferType = EndpointProperties->TransferType;
+
+    switch (TransferType)
+    {
+        case USBPORT_TRANSFER_TYPE_ISOCHRONOUS:
+            DPRINT1("XHCI_QueryEndpointRequirements: Iso. UNIMPLEMENTED. FIXME\n");
+            EndpointRequirements->HeaderBufferSize = 0;
+            EndpointRequirements->MaxTransferSize = 0;
+            break;
+
+        case USBPORT_TRANSFER_TYPE_CONTROL:
+            EndpointRequirements->HeaderBufferSize = XHCI_CONTROL_RING_SEGMENTS * PAGE_SIZE;
+            EndpointRequirements->MaxTransferSize = XHCI_MAX_CONTROL_TRANSFER_SIZE;
+            break;
+
+        case USBPORT_TRANSFER_TYPE_BULK:
+            EndpointRequirements->HeaderBufferSize = XHCI_BULK_RING_SEGMENTS * PAGE_SIZE;
+            EndpointRequirements->MaxTransferSize = XHCI_MAX_BULK_TRANSFER_SIZE;
+            break;
+
+        case USBPORT_TRANSFER_TYPE_INTERRUPT:
+            EndpointRequirements->HeaderBufferSize = XHCI_INTERRUPT_RING_SEGMENTS * PAGE_SIZE;
+            EndpointRequirements->MaxTransferSize = XHCI_MAX_INTERRUPT_TRANSFER_SIZE;
+            break;
+
+        default:
+            DPRINT1("XHCI_QueryEndpointRequirements: Unknown TransferType - %x\n",
+                    TransferType);
+            DbgBreakPoint();
+            break;
+    }
+}
+
+VOID
+NTAPI
+XHCI_CloseEndpoint(IN PVOID xhciExtension,
+                   IN PVOID xhciEndpoint,
+                   IN BOOLEAN DisablePeriodic)
+{
+    PXHCI_EXTENSION XhciExtension = xhciExtension;
+    PXHCI_ENDPOINT XhciEndpoint = xhciEndpoint;
+    PXHCI_SLOT_CONTEXT SlotContext;
+    PXHCI_SLOT Slot;
+    ULONG Dci;
+
+    DPRINT("XHCI_CloseEndpoint: XhciEndpoint - %p, SlotId - %x, Dci - %x\n",
+           XhciEndpoint,
+           XhciEndpoint->SlotId,
+           XhciEndpoint->EndpointId);
+
+    if (!XhciEndpoint->SlotId)
+        return;
+
+    Slot = &XhciExtension->Slots[XhciEndpoint->SlotId];
+    Dci = XhciEndpoint->EndpointId;
+
+    if (!(Slot->Flags & XHCI_SLOT_FLAG_ENABLED) || Slot->Endpoints[Dci] != XhciEndpoint)
+        return;
+
+    if (Dci == 1)
+    {
+        if (XhciEndpoint->EndpointProperties.DeviceAddress == 0 &&
+            (Slot->Flags & XHCI_SLOT_FLAG_ADDRESSED))
+        {
+            /* The default pipe is being reopened with the new address,
+               the slot stays. The new ring is set in XHCI_OpenDefaultEndpoint() */
+            XHCI_IssueCommand(XhciExtension,
+                              XHCI_TRB_TYPE_STOP_ENDPOINT,
+                              XhciEndpoint->SlotId,
+                              Dci,
+                              FALSE,
+                              0);
+
+            XHCI_BindEndpoint(XhciExtension, XhciEndpoint, FALSE);
+            return;
+        }
+
+        XHCI_DisableSlot(XhciExtension, XhciEndpoint->SlotId);
+        return;
+    }
+
+    XHCI_PrepareInputContext(XhciExtension, XhciEndpoint->SlotId, 1 << 0, 1 << Dci);
+
+    SlotContext = XHCI_GetInputContext(XhciExtension, 1);
+    SlotContext->ContextEntries = XHCI_GetLastEndpointId(Slot, XhciEndpoint);
+
+    XHCI_IssueCommand(XhciExtension,
+                      XHCI_TRB_TYPE_CONFIGURE_ENDPOINT,
+                      XhciEndpoint->SlotId,
+                      0,
+                      FALSE,
+                      XHCI_GetInputContextPA(XhciExtension));
+
+    XHCI_BindEndpoint(XhciExtension, XhciEndpoint, FALSE);
+}
+
+/* Controller *************************************************************/
+
+BOOLEAN
+NTAPI
+XHCI_HardwarePresent(IN PXHCI_EXTENSION XhciExtension,
+                     IN BOOLEAN IsInvalidateController)
+{
+    PXHCI_HW_REGISTERS OperationalRegs = XhciExtension->OperationalRegs;
+
+    if (READ_REGISTER_ULONG(&OperationalRegs->HcCommand.AsULONG) != -1)
+        return TRUE;
+
+    DPRINT1("XHCI_HardwarePresent: IsInvalidateController - %x\n",
+            IsInvalidateController);
+
+    if (!IsInvalidateController)
+        return FALSE;
+
+    RegPacket.UsbPortInvalidateController(XhciExtension,
+                                          USBPORT_INVALIDATE_CONTROLLER_SURPRISE_REMOVE);
+    return FALSE;
+}
+
+MPSTATUS
+NTAPI
+XHCI_TakeControlHC(IN PXHCI_EXTENSION XhciExtension)
+{
+    XHCI_HC_CAPABILITY_PARAMS_1 CapParameters;
+    XHCI_EXTENDED_CAPABILITY Capability;
+    XHCI_LEGACY_SUPPORT_CAPABILITY Legacy;
+    PULONG CapabilityReg;
+    ULONG Offset;
+    ULONG Control;
+    ULONG ix;
+
+    DPRINT("XHCI_TakeControlHC: XhciExtension - %p\n", XhciExtension);
+
+    CapParameters.AsULONG = READ_REGISTER_ULONG(&XhciExtension->CapabilityRegisters->CapParameters1.AsULONG);
+
+    for (Offset = CapParameters.ExtCapabilitiesPointer; Offset; Offset += Capability.NextCapabilityPointer)
+    {
+        CapabilityReg = (PULONG)XhciExtension->CapabilityRegisters + Offset;
+        Capability.AsULONG = READ_REGISTER_ULONG(CapabilityReg);
+
+        if (Capability.CapabilityID == XHCI_XCAP_ID_LEGACY)
+        {
+            Legacy.AsULONG = Capability.AsULONG;
+
+            if (Legacy.BiosOwnedSemaphore)
+            {
+                Legacy.OsOwnedSemaphore = 1;
+                WRITE_REGISTER_ULONG(CapabilityReg, Legacy.AsULONG);
+
+                for (ix = 0; ix < 1000; ix++)
+                {
+                    Legacy.AsULONG = READ_REGISTER_ULONG(CapabilityReg);
+
+                    if (!Legacy.BiosOwnedSemaphore)
+                        break;
+
+                    RegPacket.UsbPortWait(XhciExtension, 1);
+                }
+
+                if (Legacy.BiosOwnedSemaphore)
+                {
+                    DPRINT1("XHCI_TakeControlHC: BIOS did not release the controller\n");
+
+                    Legacy.BiosOwnedSemaphore = 0;
+                    WRITE_REGISTER_ULONG(CapabilityReg, Legacy.AsULONG);
+                }
+            }
+
+            /* No more SMIs, and clear the pending ones */
+            Control = READ_REGISTER_ULONG(CapabilityReg + 1);
+            Control &= ~XHCI_LEGACY_SMI_ENABLE_MASK;
+            Control |= XHCI_LEGACY_SMI_EVENT_MASK;
+            WRITE_REGISTER_ULONG(CapabilityReg + 1, Control);
+        }
+
+        if (!Capability.NextCapabilityPointer)
+            break;
+    }
+
+    return MP_STATUS_SUCCESS;
+}
+
+VOID
+NTAPI
+XHCI_GetPortProtocols(IN PXHCI_EXTENSION XhciExtension)
+{
+    XHCI_HC_CAPABILITY_PARAMS_1 CapParameters;
+    XHCI_SUPPORTED_PROTOCOL_CAPABILITY Protocol;
+    XHCI_SUPPORTED_PROTOCOL_PORTS Ports;
+    PULONG CapabilityReg;
+    ULONG Offset;
+    ULONG Port;
+
+    CapParameters.AsULONG = READ_REGISTER_ULONG(&XhciExtension->CapabilityRegisters->CapParameters1.AsULONG);
+
+    for (Offset = CapParameters.ExtCapabilitiesPointer; Offset; Offset += Protocol.NextCapabilityPointer)
+    {
+        CapabilityReg = (PULONG)XhciExtension->CapabilityRegisters + Offset;
+        Protocol.AsULONG = READ_REGISTER_ULONG(CapabilityReg);
+
+        if (Protocol.CapabilityID == XHCI_XCAP_ID_PROTOCOL)
+        {
+            Ports.AsULONG = READ_REGISTER_ULONG(CapabilityReg + 2);
+
+            DPRINT("XHCI_GetPortProtocols: USB %x.%x, ports %x..%x\n",
+                   Protocol.MajorRevision,
+                   Protocol.MinorRevision,
+                   Ports.CompatiblePortOffset,
+                   Ports.CompatiblePortOffset + Ports.CompatiblePortCount - 1);
+
+            for (Port = Ports.CompatiblePortOffset;
+                 Port && Port < Ports.CompatiblePortOffset + Ports.CompatiblePortCount && Port <= XHCI_MAX_PORTS;
+                 Port++)
+            {
+                XhciExtension->PortMajorRevision[Port - 1] = (UCHAR)Protocol.MajorRevision;
+            }
+        }
+
+        if (!Protocol.NextCapabilityPointer)
+            break;
+    }
+}
+
+MPSTATUS
+NTAPI
+XHCI_InitializeHardware(IN PXHCI_EXTENSION XhciExtension)
+{
+    PXHCI_HC_CAPABILITY_REGISTERS CapabilityRegisters;
+    PXHCI_HW_REGISTERS OperationalRegs;
+    XHCI_HC_STRUCTURAL_PARAMS_1 StructParameters1;
+    XHCI_HC_STRUCTURAL_PARAMS_2 StructParameters2;
+    XHCI_HC_CAPABILITY_PARAMS_1 CapParameters;
+    XHCI_USB_COMMAND Command;
+    XHCI_USB_STATUS Status;
+    ULONG ix;
+
+    DPRINT("XHCI_InitializeHardware: ... \n");
+
+    CapabilityRegisters = XhciExtension->CapabilityRegisters;
+    OperationalRegs = XhciExtension->OperationalRegs;
+
+    for (ix = 0; ix < 1000; ix++)
+    {
+        Status.AsULONG = READ_REGISTER_ULONG(&OperationalRegs->HcStatus.AsULONG);
+
+        if (!Status.ControllerNotReady)
+            break;
+
+        RegPacket.UsbPortWait(XhciExtension, 1);
+    }
+
+    Command.AsULONG = READ_REGISTER_ULONG(&OperationalRegs->HcCommand.AsULONG);
+    Command.Run = 0;
+    Command.InterrupterEnable = 0;
+    WRITE_REGISTER_ULONG(&OperationalRegs->HcCommand.AsULONG, Command.AsULONG);
+
+    for (ix = 0; ix < 20; ix++)
+    {
+        Status.AsULONG = READ_REGISTER_ULONG(&OperationalRegs->HcStatus.AsULONG);
+
+        if (Status.HCHalted)
+            break;
+
+        RegPacket.UsbPortWait(XhciExtension, 1);
+    }
+
+    if (!Status.HCHalted)
+    {
+        DPRINT1("XHCI_InitializeHardware: Controller does not halt\n");
+        return MP_STATUS_HW_ERROR;
+    }
+
+    Command.AsULONG = READ_REGISTER_ULONG(&OperationalRegs->HcCommand.AsULONG);
+    Command.HCReset = 1;
+    WRITE_REGISTER_ULONG(&OperationalRegs->HcCommand.AsULONG, Command.AsULONG);
+
+    for (ix = 0; ix < 1000; ix++)
+    {
+        RegPacket.UsbPortWait(XhciExtension, 1);
+
+        Command.AsULONG = READ_REGISTER_ULONG(&OperationalRegs->HcCommand.AsULONG);
+        Status.AsULONG = READ_REGISTER_ULONG(&OperationalRegs->HcStatus.AsULONG);
+
+        if (!Command.HCReset && !Status.ControllerNotReady)
+            break;
+    }
+
+    if (Command.HCReset || Status.ControllerNotReady)
+    {
+        DPRINT1("XHCI_InitializeHardware: Controller reset failed\n");
+        return MP_STATUS_HW_ERROR;
+    }
+
+    if (!(READ_REGISTER_ULONG(&OperationalRegs->PageSize) & XHCI_PAGE_SIZE_4K))
+    {
+        DPRINT1("XHCI_InitializeHardware: 4K pages are not supported\n");
+        return MP_STATUS_NOT_SUPPORTED;
+    }
+
+    StructParameters1.AsULONG = READ_REGISTER_ULONG(&CapabilityRegisters->StructParameters1.AsULONG);
+    StructParameters2.AsULONG = READ_REGISTER_ULONG(&CapabilityRegisters->StructParameters2.AsULONG);
+    CapParameters.AsULONG = READ_REGISTER_ULONG(&CapabilityRegisters->CapParameters1.AsULONG);
+
+    XhciExtension->NumberOfPorts = StructParameters1.MaxPorts;
+    XhciExtension->NumberOfSlots = min(StructParameters1.MaxDeviceSlots, XHCI_MAX_DEVICE_SLOTS);
+    XhciExtension->NumberOfInterrupters = min(StructParameters1.MaxInterrupters, XHCI_MAX_INTERRUPTERS);
+
+    if (XhciExtension->NumberOfInterrupters > XHCI_TRANSFER_INTERRUPTER)
+        XhciExtension->TransferInterrupter = XHCI_TRANSFER_INTERRUPTER;
+    else
+        XhciExtension->TransferInterrupter = XHCI_COMMAND_INTERRUPTER;
+
+    XhciExtension->NumberOfScratchpads = (StructParameters2.MaxScratchpadBuffersHi << 5) |
+                                         StructParameters2.MaxScratchpadBuffersLo;
+
+    if (XhciExtension->NumberOfScratchpads > XHCI_MAX_SCRATCHPADS)
+    {
+        DPRINT1("XHCI_InitializeHardware: Too many scratchpads - %x\n",
+                XhciExtension->NumberOfScratchpads);
+        return MP_STATUS_NOT_SUPPORTED;
+    }
+
+    XhciExtension->ContextSize = CapParameters.ContextSize ?
+                                 XHCI_LARGE_CONTEXT_SIZE :
+                                 XHCI_DEFAULT_CONTEXT_SIZE;
+
+    XhciExtension->PortPowerControl = (BOOLEAN)CapParameters.PortPowerControl;
+
+    DPRINT("XHCI_InitializeHardware: Ports - %x, Slots - %x, Interrupters - %x, Scratchpads - %x\n",
+           XhciExtension->NumberOfPorts,
+           XhciExtension->NumberOfSlots,
+           XhciExtension->NumberOfInterrupters,
+           XhciExtension->NumberOfScratchpads);
+
+    return MP_STATUS_SUCCESS;
+}
+
+MPSTATUS
+NTAPI
+XHCI_InitializeSchedule(IN PXHCI_EXTENSION XhciExtension,
+                        IN ULONG_PTR StartVA,
+                        IN ULONG StartPA)
+{
+    PXHCI_HW_REGISTERS OperationalRegs;
+    PXHCI_INTERRUPTER_REGISTERS InterrupterRegs;
+    PXHCI_HC_RESOURCES HcResourcesVA;
+    XHCI_INTERRUPTER_MANAGEMENT Management;
+    ULONG EventRingPA;
+    ULONG ix;
+
+    DPRINT("XHCI_InitializeSchedule: StartVA - %p, StartPA - %x\n",
+           StartVA,
+           StartPA);
+
+    OperationalRegs = XhciExtension->OperationalRegs;
+
+    HcResourcesVA = (PXHCI_HC_RESOURCES)StartVA;
+    XhciExtension->HcResourcesVA = HcResourcesVA;
+    XhciExtension->HcResourcesPA = StartPA;
+
+    /* Memory the controller may use for itself */
+    for (ix = 0; ix < XhciExtension->NumberOfScratchpads; ix++)
+    {
+        HcResourcesVA->ScratchpadArray[ix] = StartPA +
+                                             FIELD_OFFSET(XHCI_HC_RESOURCES, Scratchpad) +
+                                             ix * PAGE_SIZE;
+    }
+
+    if (XhciExtension->NumberOfScratchpads)
+    {
+        HcResourcesVA->DeviceContextBaseArray[0] = StartPA +
+                                                   FIELD_OFFSET(XHCI_HC_RESOURCES, ScratchpadArray);
+    }
+
+    WRITE_REGISTER_ULONG(&OperationalRegs->DeviceContextBaseArray,
+                         StartPA + FIELD_OFFSET(XHCI_HC_RESOURCES, DeviceContextBaseArray));
+    WRITE_REGISTER_ULONG(&OperationalRegs->DeviceContextBaseArrayHi, 0);
+
+    WRITE_REGISTER_ULONG(&OperationalRegs->Configure, XhciExtension->NumberOfSlots);
+
+    XHCI_InitializeRing(&XhciExtension->CommandRing,
+                        HcResourcesVA->CommandRing,
+                        StartPA + FIELD_OFFSET(XHCI_HC_RESOURCES, CommandRing),
+                        1);
+
+    WRITE_REGISTER_ULONG(&OperationalRegs->CommandRingControl.AsULONG,
+                         XhciExtension->CommandRing.FirstTrbPA |
+                         XhciExtension->CommandRing.CycleState);
+    WRITE_REGISTER_ULONG(&OperationalRegs->CommandRingControlHi, 0);
+
+    /* One single segment Event Ring per interrupter */
+    for (ix = 0; ix < XhciExtension->NumberOfInterrupters; ix++)
+    {
+        EventRingPA = StartPA +
+                      FIELD_OFFSET(XHCI_HC_RESOURCES, EventRing) +
+                      ix * XHCI_EVENT_TRBS * sizeof(XHCI_TRB);
+
+        HcResourcesVA->EventRingSegmentTable[ix].RingSegmentBase = EventRingPA;
+        HcResourcesVA->EventRingSegmentTable[ix].RingSegmentSize = XHCI_EVENT_TRBS;
+
+        XhciExtension->EventDequeueIndex[ix] = 0;
+        XhciExtension->EventCycleState[ix] = 1;
+
+        InterrupterRegs = &XhciExtension->RuntimeRegs->Interrupter[ix];
+
+        WRITE_REGISTER_ULONG(&InterrupterRegs->EventRingSegmentTableSize, 1);
+        WRITE_REGISTER_ULONG(&InterrupterRegs->EventRingDequeuePointer, EventRingPA);
+        WRITE_REGISTER_ULONG(&InterrupterRegs->EventRingDequeuePointerHi, 0);
+
+        /* Writing the table base enables the ring */
+        WRITE_REGISTER_ULONG(&InterrupterRegs->EventRingSegmentTableBase,
+                             StartPA +
+                             FIELD_OFFSET(XHCI_HC_RESOURCES, EventRingSegmentTable) +
+                             ix * sizeof(XHCI_EVENT_RING_SEGMENT));
+        WRITE_REGISTER_ULONG(&InterrupterRegs->EventRingSegmentTableBaseHi, 0);
+
+        WRITE_REGISTER_ULONG(&InterrupterRegs->Moderation, XHCI_INTERRUPT_MODERATION);
+
+        Management.AsULONG = 0;
+        Management.InterruptPending = 1;
+        Management.InterruptEnable = 1;
+        WRITE_REGISTER_ULONG(&InterrupterRegs->Management.AsULONG, Management.AsULONG);
+    }
+
+    return MP_STATUS_SUCCESS;
+}
+
+MPSTATUS
+NTAPI
+XHCI_StartController(IN PVOID xhciExtension,
+                     IN PUSBPORT_RESOURCES Resources)
+{
+    PXHCI_EXTENSION XhciExtension = xhciExtension;
+    PXHCI_HC_CAPABILITY_REGISTERS CapabilityRegisters;
+    PXHCI_HW_REGISTERS OperationalRegs;
+    MPSTATUS MPStatus;
+    XHCI_USB_COMMAND Command;
+    XHCI_USB_STATUS Status;
+    ULONG CapabilityReg;
+    ULONG Port;
+    ULONG ix;
+
+    DPRINT("XHCI_StartController: ... \n");
+
+    if ((Resources->ResourcesTypes & (USBPORT_RESOURCES_MEMORY | USBPORT_RESOURCES_INTERRUPT)) !=
+                                     (USBPORT_RESOURCES_MEMORY | USBPORT_RESOURCES_INTERRUPT))
+    {
+        DPRINT1("XHCI_StartController: Resources->ResourcesTypes - %x\n",
+                Resources->ResourcesTypes);
+
+        return MP_STATUS_ERROR;
+    }
+
+    CapabilityRegisters = (PXHCI_HC_CAPABILITY_REGISTERS)Resources->ResourceBase;
+    XhciExtension->CapabilityRegisters = CapabilityRegisters;
+
+    /* Some controllers only allow ULONG reads of CAPLENGTH and HCIVERSION */
+    CapabilityReg = READ_REGISTER_ULONG((PULONG)CapabilityRegisters);
+    XhciExtension->HcVersion = (USHORT)(CapabilityReg >> 16);
+
+    OperationalRegs = (PXHCI_HW_REGISTERS)((ULONG_PTR)CapabilityRegisters +
+                                           (CapabilityReg & 0xFF));
+    XhciExtension->OperationalRegs = OperationalRegs;
+
+    XhciExtension->RuntimeRegs = (PXHCI_RUNTIME_REGISTERS)((ULONG_PTR)CapabilityRegisters +
+                                 (READ_REGISTER_ULONG(&CapabilityRegisters->RuntimeRegistersOffset) & ~0x1F));
+
+    XhciExtension->DoorbellRegs = (PULONG)((ULONG_PTR)CapabilityRegisters +
+                                  (READ_REGISTER_ULONG(&CapabilityRegisters->DoorbellOffset) & ~0x3));
+
+    DPRINT("XHCI_StartController: HcVersion - %x, OperationalRegs - %p\n",
+           XhciExtension->HcVersion,
+           OperationalRegs);
+
+    KeInitializeSpinLock(&XhciExtension->EventLock);
+
+    MPStatus = XHCI_TakeControlHC(XhciExtension);
+
+    if (MPStatus)
+    {
+        DPRINT1("XHCI_StartController: Unsuccessful TakeControlHC()\n");
+        return MPStatus;
+    }
+
+    MPStatus = XHCI_InitializeHardware(XhciExtension);
+
+    if (MPStatus)
+    {
+        DPRINT1("XHCI_StartController: Unsuccessful InitializeHardware()\n");
+        return MPStatus;
+    }
+
+    MPStatus = XHCI_InitializeSchedule(XhciExtension,
+                                       Resources->StartVA,
+                                       Resources->StartPA);
+
+    if (MPStatus)
+    {
+        DPRINT1("XHCI_StartController: Unsuccessful InitializeSchedule()\n");
+        return MPStatus;
+    }
+
+    XHCI_GetPortProtocols(XhciExtension);
+
+    Command.AsULONG = READ_REGISTER_ULONG(&OperationalRegs->HcCommand.AsULONG);
+    Command.InterrupterEnable = 1;
+    Command.HostSystemErrorEnable = 1;
+    Command.Run = 1;
+    WRITE_REGISTER_ULONG(&OperationalRegs->HcCommand.AsULONG, Command.AsULONG);
+
+    for (ix = 0; ix < 20; ix++)
+    {
+        Status.AsULONG = READ_REGISTER_ULONG(&OperationalRegs->HcStatus.AsULONG);
+
+        if (!Status.HCHalted)
+            break;
+
+        RegPacket.UsbPortWait(XhciExtension, 1);
+    }
+
+    if (Status.HCHalted)
+    {
+        DPRINT1("XHCI_StartController: Controller does not run\n");
+        return MP_STATUS_HW_ERROR;
+    }
+
+    XhciExtension->IsStarted = TRUE;
+
+    if (XhciExtension->PortPowerControl)
+    {
+        for (Port = 1; Port <= XhciExtension->NumberOfPorts; Port++)
+        {
+            XHCI_RH_SetFeaturePortPower(XhciExtension, Port);
+        }
+    }
+
+    return MP_STATUS_SUCCESS;
+}
+
+VOID
+NTAPI
+XHCI_StopController(IN PVOID xhciExtension,
+                    IN BOOLEAN DisableInterrupts)
+{
+    PXHCI_EXTENSION XhciExtension = xhciExtension;
+
+    DPRINT("XHCI_StopController: DisableInterrupts - %x\n", DisableInterrupts);
+
+    /* Halts it, and forgets about the memory it was given */
+    XHCI_InitializeHardware(XhciExtension);
+
+    XhciExtension->IsStarted = FALSE;
+}
+
+VOID
+NTAPI
+XHCI_SuspendController(IN PVOID xhciExtension)
+{
+    PXHCI_EXTENSION XhciExtension = xhciExtension;
+    PXHCI_HW_REGISTERS OperationalRegs;
+    XHCI_USB_COMMAND Command;
+    XHCI_USB_STATUS Status;
+    ULONG ix;
+
+    DPRINT("XHCI_SuspendController: ... \n");
+
+    OperationalRegs = XhciExtension->OperationalRegs;
+
+    Command.AsULONG = READ_REGISTER_ULONG(&OperationalRegs->HcCommand.AsULONG);
+    Command.Run = 0;
+    WRITE_REGISTER_ULONG(&OperationalRegs->HcCommand.AsULONG, Command.AsULONG);
+
+    for (ix = 0; ix < 20; ix++)
+    {
+        Status.AsULONG = READ_REGISTER_ULONG(&OperationalRegs->HcStatus.AsULONG);
+
+        if (Status.HCHalted)
+            break;
+
+        RegPacket.UsbPortWait(XhciExtension, 1);
+    }
+
+    if (!Status.HCHalted)
+        DbgBreakPoint();
+
+    XhciExtension->Flags |= XHCI_FLAGS_CONTROLLER_SUSPEND;
+}
+
+MPSTATUS
+NTAPI
+XHCI_ResumeController(IN PVOID xhciExtension)
+{
+    PXHCI_EXTENSION XhciExtension = xhciExtension;
+
+    DPRINT("XHCI_ResumeController: ... \n");
+
+    /* The controller state was not saved (CSS/CRS). Let usbport stop
+       and start it over, and the devices be enumerated again */
+    XhciExtension->Flags &= ~XHCI_FLAGS_CONTROLLER_SUSPEND;
+
+    return MP_STATUS_HW_ERROR;
+}
+
+BOOLEAN
+NTAPI
+XHCI_InterruptService(IN PVOID xhciExtension)
+{
+    PXHCI_EXTENSION XhciExtension = xhciExtension;
+    PXHCI_HW_REGISTERS OperationalRegs;
+    PXHCI_INTERRUPTER_REGISTERS InterrupterRegs;
+    XHCI_INTERRUPTER_MANAGEMENT Management;
+    XHCI_USB_STATUS Status;
+    XHCI_USB_STATUS iStatus;
+    BOOLEAN Result = FALSE;
+    ULONG ix;
+
+    OperationalRegs = XhciExtension->OperationalRegs;
+
+    DPRINT_XHCI("XHCI_InterruptService: ... \n");
+
+    if (!XHCI_HardwarePresent(XhciExtension, FALSE))
+        return FALSE;
+
+    Status.AsULONG = READ_REGISTER_ULONG(&OperationalRegs->HcStatus.AsULONG);
+
+    iStatus.AsULONG = 0;
+    iStatus.HostSystemError = Status.HostSystemError;
+    iStatus.EventInterrupt = Status.EventInterrupt;
+    iStatus.PortChangeDetect = Status.PortChangeDetect;
+
+    if (iStatus.AsULONG)
+    {
+        WRITE_REGISTER_ULONG(&OperationalRegs->HcStatus.AsULONG, iStatus.AsULONG);
+        Result = TRUE;
+    }
+
+    if (iStatus.HostSystemError)
+        DPRINT1("XHCI_InterruptService: Host System Error. Status - %X\n", Status.AsULONG);
+
+    /* The line interrupt is shared by all the interrupters */
+    for (ix = 0; ix < XhciExtension->NumberOfInterrupters; ix++)
+    {
+        InterrupterRegs = &XhciExtension->RuntimeRegs->Interrupter[ix];
+        Management.AsULONG = READ_REGISTER_ULONG(&InterrupterRegs->Management.AsULONG);
+
+        if (Management.InterruptPending)
+        {
+            WRITE_REGISTER_ULONG(&InterrupterRegs->Management.AsULONG, Management.AsULONG);
+            Result = TRUE;
+        }
+    }
+
+    return Result;
+}
+
+VOID
+NTAPI
+XHCI_InterruptDpc(IN PVOID xhciExtension,
+                  IN BOOLEAN EnableInterrupts)
+{
+    PXHCI_EXTENSION XhciExtension = xhciExtension;
+    ULONG Events;
+
+    DPRINT_XHCI("XHCI_InterruptDpc: [%p] EnableInterrupts - %x\n",
+                XhciExtension,
+                EnableInterrupts);
+
+    Events = XHCI_ProcessEvents(XhciExtension);
+
+    if (Events & XHCI_EVENT_TRANSFER)
+        RegPacket.UsbPortInvalidateEndpoint(XhciExtension, NULL);
+
+    if ((Events & XHCI_EVENT_PORT) && XhciExtension->PortChangeIrq)
+        RegPacket.UsbPortInvalidateRootHub(XhciExtension);
+}
+
+/* Transfers **************************************************************/
+
+ULONG
+NTAPI
+XHCI_CountDataTrbs(IN PUSBPORT_SCATTER_GATHER_LIST SgList)
+{
+    ULONG BufferPA;
+    ULONG Length;
+    ULONG Chunk;
+    ULONG Count = 0;
+    ULONG ix;
+
+    for (ix = 0; ix < SgList->SgElementCount; ix++)
+    {
+        BufferPA = SgList->SgElement[ix].SgPhysicalAddress.LowPart;
+        Length = SgList->SgElement[ix].SgTransferLength;
+
+        while (Length)
+        {
+            Chunk = min(Length, XHCI_TRB_MAX_TRANSFER_SIZE -
+                                (BufferPA & (XHCI_TRB_MAX_TRANSFER_SIZE - 1)));
+            BufferPA += Chunk;
+            Length -= Chunk;
+            Count++;
+        }
+    }
+
+    return Count;
+}
+
+ULONG
+NTAPI
+XHCI_GetFreeTrbs(IN PXHCI_ENDPOINT XhciEndpoint)
+{
+    PXHCI_RING Ring = &XhciEndpoint->TransferRing;
+    PXHCI_TRANSFER XhciTransfer;
+    PLIST_ENTRY Entry;
+    ULONG TotalTrbs;
+    ULONG UsedTrbs = 0;
+
+    TotalTrbs = Ring->Segments * XHCI_SEGMENT_TRBS;
+
+    /* Everything from the oldest transfer on is in use. Its TRBs may be
+       consumed already, but they are freed only when it is completed */
+    for (Entry = XhciEndpoint->TransferList.Flink;
+         Entry != &XhciEndpoint->TransferList;
+         Entry = Entry->Flink)
+    {
+        XhciTransfer = CONTAINING_RECORD(Entry, XHCI_TRANSFER, TransferLink);
+
+        if (!(XhciTransfer->Flags & XHCI_TRANSFER_FLAG_NO_TRBS))
+        {
+            UsedTrbs = (Ring->EnqueueIndex + TotalTrbs - XhciTransfer->FirstTrbIndex) % TotalTrbs;
+            break;
+        }
+    }
+
+    /* Keep the Link TRBs and one empty slot out of it */
+    return TotalTrbs - UsedTrbs - Ring->Segments - 1;
+}
+
+VOID
+NTAPI
+XHCI_QueueDataTrbs(IN PXHCI_EXTENSION XhciExtension,
+                   IN PXHCI_ENDPOINT XhciEndpoint,
+                   IN PUSBPORT_SCATTER_GATHER_LIST SgList,
+                   IN ULONG TransferLength,
+                   IN BOOLEAN IsDataStage,
+                   IN BOOLEAN IsDirectionIn,
+                   IN BOOLEAN IsFirstTrb)
+{
+    PXHCI_RING Ring = &XhciEndpoint->TransferRing;
+    XHCI_TRB Trb;
+    ULONGLONG BufferPA;
+    ULONG Length;
+    ULONG Chunk;
+    ULONG Queued = 0;
+    ULONG Remaining;
+    ULONG ix;
+
+    for (ix = 0; ix < SgList->SgElementCount; ix++)
+    {
+        BufferPA = SgList->SgElement[ix].SgPhysicalAddress.QuadPart;
+        Length = SgList->SgElement[ix].SgTransferLength;
+
+        /* A TRB buffer must not cross a 64 KB boundary */
+        while (Length)
+        {
+            Chunk = min(Length, XHCI_TRB_MAX_TRANSFER_SIZE -
+                                ((ULONG)BufferPA & (XHCI_TRB_MAX_TRANSFER_SIZE - 1)));
+
+            Queued += Chunk;
+            Remaining = TransferLength - min(Queued, TransferLength);
+
+            RtlZeroMemory(&Trb, sizeof(Trb));
+
+            Trb.Normal.BufferPointer = (ULONG)BufferPA;
+            Trb.Normal.BufferPointerHi = (ULONG)(BufferPA >> 32);
+            Trb.Normal.TransferLength = Chunk;
+            Trb.Normal.TdSize = min((Remaining + XhciEndpoint->MaxPacketSize - 1) /
+                                    XhciEndpoint->MaxPacketSize,
+                                    XHCI_TRB_MAX_TD_SIZE);
+            Trb.Normal.InterrupterTarget = XhciExtension->TransferInterrupter;
+            Trb.Normal.InterruptOnShortPacket = 1;
+
+            if (Remaining)
+                Trb.Normal.Chain = 1;
+            else if (!IsDataStage)
+                Trb.Normal.InterruptOnCompletion = 1;
+
+            if (IsDataStage && Queued == Chunk)
+            {
+                Trb.Normal.Type = XHCI_TRB_TYPE_DATA_STAGE;
+                Trb.Normal.Direction = IsDirectionIn;
+            }
+            else
+            {
+                Trb.Normal.Type = XHCI_TRB_TYPE_NORMAL;
+            }
+
+            XHCI_QueueTrb(Ring, &Trb, IsFirstTrb);
+            IsFirstTrb = FALSE;
+
+            BufferPA += Chunk;
+            Length -= Chunk;
+        }
+    }
+}
+
+VOID
+NTAPI
+XHCI_LinkTransfer(IN PXHCI_EXTENSION XhciExtension,
+                  IN PXHCI_ENDPOINT XhciEndpoint,
+                  IN PXHCI_TRANSFER XhciTransfer)
+{
+    PXHCI_RING Ring = &XhciEndpoint->TransferRing;
+
+    XhciTransfer->NextTrbIndex = Ring->EnqueueIndex;
+    XhciTransfer->NextTrbCycle = Ring->CycleState;
+
+    InsertTailList(&XhciEndpoint->TransferList, &XhciTransfer->TransferLink);
+
+    XHCI_CommitTrbs(Ring, XhciTransfer->FirstTrbIndex, XhciTransfer->FirstTrbCycle);
+}
+
+MPSTATUS
+NTAPI
+XHCI_SetAddress(IN PXHCI_EXTENSION XhciExtension,
+                IN PXHCI_ENDPOINT XhciEndpoint,
+                IN PUSBPORT_TRANSFER_PARAMETERS TransferParameters,
+                IN PXHCI_TRANSFER XhciTransfer)
+{
+    PXHCI_RING Ring = &XhciEndpoint->TransferRing;
+    PXHCI_ENDPOINT_CONTEXT EndpointContext;
+    PXHCI_SLOT Slot;
+    ULONG DeviceAddress;
+    ULONG OldSlotId;
+    ULONG Code;
+    KIRQL OldIrql;
+
+    Slot = &XhciExtension->Slots[XhciEndpoint->SlotId];
+    DeviceAddress = TransferParameters->SetupPacket.wValue.W;
+
+    DPRINT("XHCI_SetAddress: SlotId - %x, DeviceAddress - %x\n",
+           XhciEndpoint->SlotId,
+           DeviceAddress);
+
+    Code = XHCI_COMPLETION_INVALID;
+
+    if (DeviceAddress && DeviceAddress <= USBPORT_MAX_DEVICE_ADDRESS)
+    {
+        /* The address may still be held by a device that went away */
+        OldSlotId = XhciExtension->AddressToSlot[DeviceAddress];
+
+        if (OldSlotId && OldSlotId != XhciEndpoint->SlotId)
+            XHCI_DisableSlot(XhciExtension, OldSlotId);
+
+        XHCI_PrepareInputContext(XhciExtension,
+                                 XhciEndpoint->SlotId,
+                                 (1 << 0) | (1 << 1),
+                                 0);
+
+        EndpointContext = XHCI_GetInputContext(XhciExtension, 2);
+        EndpointContext->EndpointState = 0;
+        EndpointContext->DequeuePointer = XHCI_RingTrbPA(Ring, Ring->EnqueueIndex) |
+                                          Ring->CycleState;
+
+        /* The controller picks the address and sends SET_ADDRESS itself */
+        Code = XHCI_IssueCommand(XhciExtension,
+                                 XHCI_TRB_TYPE_ADDRESS_DEVICE,
+                                 XhciEndpoint->SlotId,
+                                 0,
+                                 FALSE,
+                                 XHCI_GetInputContextPA(XhciExtension));
+    }
+
+    KeAcquireSpinLock(&XhciExtension->EventLock, &OldIrql);
+
+    if (Code == XHCI_COMPLETION_SUCCESS)
+    {
+        Slot->Flags |= XHCI_SLOT_FLAG_ADDRESSED;
+        Slot->DeviceAddress = DeviceAddress;
+        XhciExtension->AddressToSlot[DeviceAddress] = (UCHAR)XhciEndpoint->SlotId;
+
+        XhciTransfer->USBDStatus = USBD_STATUS_SUCCESS;
+    }
+    else
+    {
+        DPRINT1("XHCI_SetAddress: Address Device failed. Code - %x\n", Code);
+        XhciTransfer->USBDStatus = USBD_STATUS_DEV_NOT_RESPONDING;
+    }
+
+    XhciTransfer->Flags = XHCI_TRANSFER_FLAG_NO_TRBS | XHCI_TRANSFER_FLAG_DONE;
+    XhciTransfer->FirstTrbIndex = Ring->EnqueueIndex;
+    XhciTransfer->NextTrbIndex = Ring->EnqueueIndex;
+
+    InsertTailList(&XhciEndpoint->TransferList, &XhciTransfer->TransferLink);
+
+    KeReleaseSpinLock(&XhciExtension->EventLock, OldIrql);
+
+    RegPacket.UsbPortInvalidateEndpoint(XhciExtension, XhciEndpoint);
+    RegPacket.UsbPortInvalidateController(XhciExtension,
+                                          USBPORT_INVALIDATE_CONTROLLER_SOFT_INTERRUPT);
+
+    return MP_STATUS_SUCCESS;
+}
+
+MPSTATUS
+NTAPI
+XHCI_ControlTransfer(IN PXHCI_EXTENSION XhciExtension,
+                     IN PXHCI_ENDPOINT XhciEndpoint,
+                     IN PUSBPORT_TRANSFER_PARAMETERS TransferParameters,
+                     IN PXHCI_TRANSFER XhciTransfer,
+                     IN PUSBPORT_SCATTER_GATHER_LIST SgList)
+{
+    PXHCI_RING Ring = &XhciEndpoint->TransferRing;
+    PUSB_DEFAULT_PIPE_SETUP_PACKET SetupPacket;
+    XHCI_TRB Trb;
+    ULONG DataTrbs = 0;
+    BOOLEAN IsDirectionIn;
+    KIRQL OldIrql;
+
+    SetupPacket = &TransferParameters->SetupPacket;
+
+    DPRINT_XHCI("XHCI_ControlTransfer: XhciTransfer - %p, bRequest - %x, Length - %x\n",
+                XhciTransfer,
+                SetupPacket->bRequest,
+                TransferParameters->TransferBufferLength);
+
+    /* The controller does not let SET_ADDRESS through, it has a command for it */
+    if (XhciEndpoint->EndpointId == 1 &&
+        SetupPacket->bmRequestType.B == 0 &&
+        SetupPacket->bRequest == USB_REQUEST_SET_ADDRESS)
+    {
+        return XHCI_SetAddress(XhciExtension,
+                               XhciEndpoint,
+                               TransferParameters,
+                               XhciTransfer);
+    }
+
+    if (TransferParameters->TransferBufferLength)
+        DataTrbs = XHCI_CountDataTrbs(SgList);
+
+    KeAcquireSpinLock(&XhciExtension->EventLock, &OldIrql);
+
+    if (DataTrbs + 2 > XHCI_GetFreeTrbs(XhciEndpoint))
+    {
+        KeReleaseSpinLock(&XhciExtension->EventLock, OldIrql);
+        return MP_STATUS_FAILURE;
+    }
+
+    IsDirectionIn = (TransferParameters->TransferFlags & USBD_TRANSFER_DIRECTION_IN) != 0;
+
+    XhciTransfer->FirstTrbIndex = Ring->EnqueueIndex;
+    XhciTransfer->FirstTrbCycle = Ring->CycleState;
+
+    /* Setup Stage */
+    RtlZeroMemory(&Trb, sizeof(Trb));
+
+    RtlCopyMemory(&Trb.Setup.SetupPacket,
+                  SetupPacket,
+                  sizeof(USB_DEFAULT_PIPE_SETUP_PACKET));
+
+    Trb.Setup.TransferLength = sizeof(USB_DEFAULT_PIPE_SETUP_PACKET);
+    Trb.Setup.InterrupterTarget = XhciExtension->TransferInterrupter;
+    Trb.Setup.ImmediateData = 1;
+    Trb.Setup.Type = XHCI_TRB_TYPE_SETUP_STAGE;
+
+    if (!DataTrbs)
+        Trb.Setup.TransferType = XHCI_TRANSFER_TYPE_NO_DATA;
+    else if (IsDirectionIn)
+        Trb.Setup.TransferType = XHCI_TRANSFER_TYPE_IN_DATA;
+    else
+        Trb.Setup.TransferType = XHCI_TRANSFER_TYPE_OUT_DATA;
+
+    XHCI_QueueTrb(Ring, &Trb, TRUE);
+
+    /* Data Stage */
+    if (DataTrbs)
+    {
+        XHCI_QueueDataTrbs(XhciExtension,
+                           XhciEndpoint,
+                           SgList,
+                           TransferParameters->TransferBufferLength,
+                           TRUE,
+                           IsDirectionIn,
+                           FALSE);
+    }
+
+    /* Status Stage, in the other direction */
+    RtlZeroMemory(&Trb, sizeof(Trb));
+
+    Trb.Status.InterrupterTarget = XhciExtension->TransferInterrupter;
+    Trb.Status.InterruptOnCompletion = 1;
+    Trb.Status.Type = XHCI_TRB_TYPE_STATUS_STAGE;
+    Trb.Status.Direction = !(DataTrbs && IsDirectionIn);
+
+    XHCI_QueueTrb(Ring, &Trb, FALSE);
+
+    XHCI_LinkTransfer(XhciExtension, XhciEndpoint, XhciTransfer);
+
+    KeReleaseSpinLock(&XhciExtension->EventLock, OldIrql);
+
+    XHCI_RingDoorbell(XhciExtension, XhciEndpoint);
+
+    return MP_STATUS_SUCCESS;
+}
+
+MPSTATUS
+NTAPI
+XHCI_BulkTransfer(IN PXHCI_EXTENSION XhciExtension,
+                  IN PXHCI_ENDPOINT XhciEndpoint,
+                  IN PUSBPORT_TRANSFER_PARAMETERS TransferParameters,
+                  IN PXHCI_TRANSFER XhciTransfer,
+                  IN PUSBPORT_SCATTER_GATHER_LIST SgList)
+{
+    PXHCI_RING Ring = &XhciEndpoint->TransferRing;
+    XHCI_TRB Trb;
+    ULONG DataTrbs = 0;
+    KIRQL OldIrql;
+
+    DPRINT_XHCI("XHCI_BulkTransfer: XhciTransfer - %p, Length - %x\n",
+                XhciTransfer,
+                TransferParameters->TransferBufferLength);
+
+    if (TransferParameters->TransferBufferLength)
+        DataTrbs = XHCI_CountDataTrbs(SgList);
+
+    KeAcquireSpinLock(&XhciExtension->EventLock, &OldIrql);
+
+    if (max(DataTrbs, 1) > XHCI_GetFreeTrbs(XhciEndpoint))
+    {
+        KeReleaseSpinLock(&XhciExtension->EventLock, OldIrql);
+        return MP_STATUS_FAILURE;
+    }
+
+    XhciTransfer->FirstTrbIndex = Ring->EnqueueIndex;
+    XhciTransfer->FirstTrbCycle = Ring->CycleState;
+
+    if (DataTrbs)
+    {
+        XHCI_QueueDataTrbs(XhciExtension,
+                           XhciEndpoint,
+                           SgList,
+                           TransferParameters->TransferBufferLength,
+                           FALSE,
+                           FALSE,
+                           TRUE);
+    }
+    else
+    {
+        /* Zero length packet */
+        RtlZeroMemory(&Trb, sizeof(Trb));
+
+        Trb.Normal.InterrupterTarget = XhciExtension->TransferInterrupter;
+        Trb.Normal.InterruptOnCompletion = 1;
+        Trb.Normal.Type = XHCI_TRB_TYPE_NORMAL;
+
+        XHCI_QueueTrb(Ring, &Trb, TRUE);
+    }
+
+    XHCI_LinkTransfer(XhciExtension, XhciEndpoint, XhciTransfer);
+
+    KeReleaseSpinLock(&XhciExtension->EventLock, OldIrql);
+
+    XHCI_RingDoorbell(XhciExtension, XhciEndpoint);
+
+    return MP_STATUS_SUCCESS;
+}
+
+MPSTATUS
+NTAPI
+XHCI_SubmitTransfer(IN PVOID xhciExtension,
+                    IN PVOID xhciEndpoint,
+                    IN PUSBPORT_TRANSFER_PARAMETERS TransferParameters,
+                    IN PVOID xhciTransfer,
+                    IN PUSBPORT_SCATTER_GATHER_LIST SgList)
+{
+    PXHCI_EXTENSION XhciExtension = xhciExtension;
+    PXHCI_ENDPOINT XhciEndpoint = xhciEndpoint;
+    PXHCI_TRANSFER XhciTransfer = xhciTransfer;
+    MPSTATUS MPStatus;
+
+    DPRINT_XHCI("XHCI_SubmitTransfer: XhciEndpoint - %p, XhciTransfer - %p\n",
+                XhciEndpoint,
+                XhciTransfer);
+
+    RtlZeroMemory(XhciTransfer, sizeof(XHCI_TRANSFER));
+
+    XhciTransfer->TransferParameters = TransferParameters;
+    XhciTransfer->USBDStatus = USBD_STATUS_SUCCESS;
+    XhciTransfer->XhciEndpoint = XhciEndpoint;
+
+    switch (XhciEndpoint->EndpointProperties.TransferType)
+    {
+        case USBPORT_TRANSFER_TYPE_CONTROL:
+            MPStatus = XHCI_ControlTransfer(XhciExtension,
+                                            XhciEndpoint,
+                                            TransferParameters,
+                                            XhciTransfer,
+                                            SgList);
+            break;
+
+        case USBPORT_TRANSFER_TYPE_BULK:
+        case USBPORT_TRANSFER_TYPE_INTERRUPT:
+            MPStatus = XHCI_BulkTransfer(XhciExtension,
+                                         XhciEndpoint,
+                                         TransferParameters,
+                                         XhciTransfer,
+                                         SgList);
+            break;
+
+        default:
+            DbgBreakPoint();
+            MPStatus = MP_STATUS_NOT_SUPPORTED;
+            break;
+    }
+
+    return MPStatus;
+}
+
+MPSTATUS
+NTAPI
+XHCI_SubmitIsoTransfer(IN PVOID xhciExtension,
+                       IN PVOID xhciEndpoint,
+                       IN PUSBPORT_TRANSFER_PARAMETERS TransferParameters,
+                       IN PVOID xhciTransfer,
+                       IN PVOID isoParameters)
+{
+    DPRINT1("XHCI_SubmitIsoTransfer: UNIMPLEMENTED. FIXME\n");
+    return MP_STATUS_NOT_SUPPORTED;
+}
+
+VOID
+NTAPI
+XHCI_AbortTransfer(IN PVOID xhciExtension,
+                   IN PVOID xhciEndpoint,
+                   IN PVOID xhciTransfer,
+                   IN PULONG CompletedLength)
+{
+    PXHCI_EXTENSION XhciExtension = xhciExtension;
+    PXHCI_ENDPOINT XhciEndpoint = xhciEndpoint;
+    PXHCI_TRANSFER XhciTransfer = xhciTransfer;
+    PXHCI_TRANSFER PrevTransfer;
+    PXHCI_RING Ring;
+    PXHCI_TRB Trb;
+    PLIST_ENTRY Entry;
+    BOOLEAN IsCurrent = TRUE;
+    ULONG Index;
+    XHCI_TRB NoOpTrb;
+    KIRQL OldIrql;
+
+    DPRINT("XHCI_AbortTransfer: XhciTransfer - %p, CompletedLength - %x\n",
+           XhciTransfer,
+           CompletedLength);
+
+    Ring = &XhciEndpoint->TransferRing;
+
+    KeAcquireSpinLock(&XhciExtension->EventLock, &OldIrql);
+
+    for (Entry = XhciEndpoint->TransferList.Flink;
+         Entry != &XhciTransfer->TransferLink;
+         Entry = Entry->Flink)
+    {
+        PrevTransfer = CONTAINING_RECORD(Entry, XHCI_TRANSFER, TransferLink);
+
+        if (!(PrevTransfer->Flags & (XHCI_TRANSFER_FLAG_DONE | XHCI_TRANSFER_FLAG_NO_TRBS)))
+        {
+            IsCurrent = FALSE;
+            break;
+        }
+    }
+
+    if (!(XhciTransfer->Flags & (XHCI_TRANSFER_FLAG_DONE | XHCI_TRANSFER_FLAG_NO_TRBS)))
+    {
+        if (IsCurrent)
+        {
+            /* The endpoint is stopped on it. Skip it when it is started again */
+            XhciEndpoint->Flags |= XHCI_ENDPOINT_FLAG_DEQUEUE_MOVED;
+        }
+        else
+        {
+            /* Not reached yet. Turn its TRBs into No Ops */
+            for (Index = XhciTransfer->FirstTrbIndex;
+                 Index != XhciTransfer->NextTrbIndex;
+                 Index = XHCI_NextTrbIndex(Ring, Index))
+            {
+                Trb = &Ring->FirstTrb[Index];
+
+                RtlZeroMemory(&NoOpTrb, sizeof(NoOpTrb));
+                NoOpTrb.AsULONG[3] = Trb->AsULONG[3] & (XHCI_TRB_CYCLE | XHCI_TRB_CHAIN);
+                NoOpTrb.Normal.Type = XHCI_TRB_TYPE_NO_OP;
+
+                Trb->AsULONG[3] = NoOpTrb.AsULONG[3];
+            }
+        }
+    }
+
+    *CompletedLength = XhciTransfer->CompletedLength;
+
+    RemoveEntryList(&XhciTransfer->TransferLink);
+
+    KeReleaseSpinLock(&XhciExtension->EventLock, OldIrql);
+}
+
+ULONG
+NTAPI
+XHCI_GetEndpointState(IN PVOID xhciExtension,
+                      IN PVOID xhciEndpoint)
+{
+    PXHCI_ENDPOINT XhciEndpoint = xhciEndpoint;
+
+    return XhciEndpoint->EndpointState;
+}
+
+VOID
+NTAPI
+XHCI_SetEndpointState(IN PVOID xhciExtension,
+                      IN PVOID xhciEndpoint,
+                      IN ULONG EndpointState)
+{
+    PXHCI_EXTENSION XhciExtension = xhciExtension;
+    PXHCI_ENDPOINT XhciEndpoint = xhciEndpoint;
+
+    DPRINT("XHCI_SetEndpointState: XhciEndpoint - %p, EndpointState - %x\n",
+           XhciEndpoint,
+           EndpointState);
+
+    XhciEndpoint->EndpointState = EndpointState;
+
+    if (!XhciEndpoint->SlotId ||
+        XhciExtension->Slots[XhciEndpoint->SlotId].Endpoints[XhciEndpoint->EndpointId] != XhciEndpoint)
+    {
+        return;
+    }
+
+    switch (EndpointState)
+    {
+        case USBPORT_ENDPOINT_PAUSED:
+            /* Transfers are about to be aborted */
+            XHCI_IssueCommand(XhciExtension,
+                              XHCI_TRB_TYPE_STOP_ENDPOINT,
+                              XhciEndpoint->SlotId,
+                              XhciEndpoint->EndpointId,
+                              FALSE,
+                              0);
+            break;
+
+        case USBPORT_ENDPOINT_ACTIVE:
+            XHCI_RestartEndpoint(XhciExtension, XhciEndpoint, FALSE);
+            break;
+
+        case USBPORT_ENDPOINT_REMOVE:
+            break;
+
+        default:
+            DbgBreakPoint();
+            break;
+    }
+}
+
+VOID
+NTAPI
+XHCI_PollEndpoint(IN PVOID xhciExtension,
+                  IN PVOID xhciEndpoint)
+{
+    PXHCI_EXTENSION XhciExtension = xhciExtension;
+    PXHCI_ENDPOINT XhciEndpoint = xhciEndpoint;
+    PXHCI_TRANSFER XhciTransfer;
+    PLIST_ENTRY Entry;
+    LIST_ENTRY DoneList;
+    KIRQL OldIrql;
+
+    DPRINT_XHCI("XHCI_PollEndpoint: XhciEndpoint - %p\n", XhciEndpoint);
+
+    InitializeListHead(&DoneList);
+
+    KeAcquireSpinLock(&XhciExtension->EventLock, &OldIrql);
+
+    /* TDs on a ring are done in order */
+    while (!IsListEmpty(&XhciEndpoint->TransferList))
+    {
+        Entry = XhciEndpoint->TransferList.Flink;
+        XhciTransfer = CONTAINING_RECORD(Entry, XHCI_TRANSFER, TransferLink);
+
+        if (!(XhciTransfer->Flags & XHCI_TRANSFER_FLAG_DONE))
+            break;
+
+        RemoveEntryList(Entry);
+        InsertTailList(&DoneList, Entry);
+    }
+
+    KeReleaseSpinLock(&XhciExtension->EventLock, OldIrql);
+
+    while (!IsListEmpty(&DoneList))
+    {
+        Entry = RemoveHeadList(&DoneList);
+        XhciTransfer = CONTAINING_RECORD(Entry, XHCI_TRANSFER, TransferLink);
+
+        RegPacket.UsbPortCompleteTransfer(XhciExtension,
+                                          XhciEndpoint,
+                                          XhciTransfer->TransferParameters,
+                                          XhciTransfer->USBDStatus,
+                                          XhciTransfer->CompletedLength);
+    }
+
+    /* A stalled control request does not keep the pipe halted */
+    if (XhciEndpoint->EndpointProperties.TransferType == USBPORT_TRANSFER_TYPE_CONTROL &&
+        (XhciEndpoint->Flags & XHCI_ENDPOINT_FLAG_HALTED))
+    {
+        XHCI_RestartEndpoint(XhciExtension, XhciEndpoint, TRUE);
+    }
+}
+
+VOID
+NTAPI
+XHCI_CheckController(IN PVOID xhciExtension)
+{
+    PXHCI_EXTENSION XhciExtension = xhciExtension;
+
+    if (XhciExtension->IsStarted)
+        XHCI_HardwarePresent(XhciExtension, TRUE);
+}
+
+ULONG
+NTAPI
+XHCI_Get32BitFrameNumber(IN PVOID xhciExtension)
+{
+    /* MFINDEX wraps every 2 seconds, and stops when the controller is idle.
+       usbport only needs a millisecond count that keeps going */
+    return (ULONG)(KeQueryInterruptTime() / 10000);
+}
+
+VOID
+NTAPI
+XHCI_InterruptNextSOF(IN PVOID xhciExtension)
+{
+    PXHCI_EXTENSION XhciExtension = xhciExtension;
+
+    DPRINT_XHCI("XHCI_InterruptNextSOF: ... \n");
+
+    RegPacket.UsbPortInvalidateController(XhciExtension,
+                                          USBPORT_INVALIDATE_CONTROLLER_SOFT_INTERRUPT);
+}
+
+VOID
+NTAPI
+XHCI_EnableInterrupts(IN PVOID xhciExtension)
+{
+    PXHCI_EXTENSION XhciExtension = xhciExtension;
+    PXHCI_HW_REGISTERS OperationalRegs;
+    XHCI_USB_COMMAND Command;
+
+    DPRINT("XHCI_EnableInterrupts: ... \n");
+
+    OperationalRegs = XhciExtension->OperationalRegs;
+
+    Command.AsULONG = READ_REGISTER_ULONG(&OperationalRegs->HcCommand.AsULONG);
+    Command.InterrupterEnable = 1;
+    WRITE_REGISTER_ULONG(&OperationalRegs->HcCommand.AsULONG, Command.AsULONG);
+}
+
+VOID
+NTAPI
+XHCI_DisableInterrupts(IN PVOID xhciExtension)
+{
+    PXHCI_EXTENSION XhciExtension = xhciExtension;
+    PXHCI_HW_REGISTERS OperationalRegs;
+    XHCI_USB_COMMAND Command;
+
+    DPRINT("XHCI_DisableInterrupts: ... \n");
+
+    OperationalRegs = XhciExtension->OperationalRegs;
+
+    Command.AsULONG = READ_REGISTER_ULONG(&OperationalRegs->HcCommand.AsULONG);
+    Command.InterrupterEnable = 0;
+    WRITE_REGISTER_ULONG(&OperationalRegs->HcCommand.AsULONG, Command.AsULONG);
+}
+
+VOID
+NTAPI
+XHCI_PollController(IN PVOID xhciExtension)
+{
+    PXHCI_EXTENSION XhciExtension = xhciExtension;
+    ULONG Events;
+
+    DPRINT_XHCI("XHCI_PollController: ... \n");
+
+    if (XhciExtension->Flags & XHCI_FLAGS_CONTROLLER_SUSPEND)
+        return;
+
+    Events = XHCI_ProcessEvents(XhciExtension);
+
+    if (Events & XHCI_EVENT_TRANSFER)
+        RegPacket.UsbPortInvalidateEndpoint(XhciExtension, NULL);
+
+    RegPacket.UsbPortInvalidateRootHub(XhciExtension);
+}
+
+VOID
+NTAPI
+XHCI_SetEndpointDataToggle(IN PVOID xhciExtension,
+                           IN PVOID xhciEndpoint,
+                           IN ULONG DataToggle)
+{
+    /* The controller keeps the toggle. Reset Endpoint clears it */
+    DPRINT("XHCI_SetEndpointDataToggle: DataToggle - %x\n", DataToggle);
+}
+
+ULONG
+NTAPI
+XHCI_GetEndpointStatus(IN PVOID xhciExtension,
+                       IN PVOID xhciEndpoint)
+{
+    PXHCI_ENDPOINT XhciEndpoint = xhciEndpoint;
+
+    DPRINT("XHCI_GetEndpointStatus: XhciEndpoint - %p\n", XhciEndpoint);
+
+    if (XhciEndpoint->Flags & XHCI_ENDPOINT_FLAG_HALTED)
+        return USBPORT_ENDPOINT_HALT;
+
+    return USBPORT_ENDPOINT_RUN;
+}
+
+VOID
+NTAPI
+XHCI_SetEndpointStatus(IN PVOID xhciExtension,
+                       IN PVOID xhciEndpoint,
+                       IN ULONG EndpointStatus)
+{
+    PXHCI_EXTENSION XhciExtension = xhciExtension;
+    PXHCI_ENDPOINT XhciEndpoint = xhciEndpoint;
+
+    DPRINT("XHCI_SetEndpointStatus: XhciEndpoint - %p, EndpointStatus - %x\n",
+           XhciEndpoint,
+           EndpointStatus);
+
+    if (EndpointStatus == USBPORT_ENDPOINT_RUN)
+    {
+        if (XhciEndpoint->Flags & XHCI_ENDPOINT_FLAG_HALTED)
+            XHCI_RestartEndpoint(XhciExtension, XhciEndpoint, TRUE);
+
+        return;
+    }
+
+    if (EndpointStatus == USBPORT_ENDPOINT_HALT)
+        DbgBreakPoint();
+}
+
+VOID
+NTAPI
+XHCI_ResetController(IN PVOID xhciExtension)
+{
+    DPRINT1("XHCI_ResetController: UNIMPLEMENTED. FIXME\n");
+}
+
+MPSTATUS
+NTAPI
+XHCI_StartSendOnePacket(IN PVOID xhciExtension,
+                        IN PVOID PacketParameters,
+                        IN PVOID Data,
+                        IN PULONG pDataLength,
+                        IN PVOID BufferVA,
+                        IN PVOID BufferPA,
+                        IN ULONG BufferLength,
+                        IN USBD_STATUS * pUSBDStatus)
+{
+    DPRINT1("XHCI_StartSendOnePacket: UNIMPLEMENTED. FIXME\n");
+    return MP_STATUS_SUCCESS;
+}
+
+MPSTATUS
+NTAPI
+XHCI_EndSendOnePacket(IN PVOID xhciExtension,
+                      IN PVOID PacketParameters,
+                      IN PVOID Data,
+                      IN PULONG pDataLength,
+                      IN PVOID BufferVA,
+                      IN PVOID BufferPA,
+                      IN ULONG BufferLength,
+                      IN USBD_STATUS * pUSBDStatus)
+{
+    DPRINT1("XHCI_EndSendOnePacket: UNIMPLEMENTED. FIXME\n");
+    return MP_STATUS_SUCCESS;
+}
+
+MPSTATUS
+NTAPI
+XHCI_PassThru(IN PVOID xhciExtension,
+              IN PVOID passThruParameters,
+              IN ULONG ParameterLength,
+              IN PVOID pParameters)
+{
+    DPRINT1("XHCI_PassThru: UNIMPLEMENTED. FIXME\n");
+    return MP_STATUS_SUCCESS;
+}
+
+VOID
+NTAPI
+XHCI_RebalanceEndpoint(IN PVOID xhciExtension,
+                       IN PUSBPORT_ENDPOINT_PROPERTIES EndpointProperties,
+                       IN PVOID xhciEndpoint)
+{
+    DPRINT1("XHCI_RebalanceEndpoint: UNIMPLEMENTED. FIXME\n");
+}
+
+VOID
+NTAPI
+XHCI_FlushInterrupts(IN PVOID xhciExtension)
+{
+    PXHCI_EXTENSION XhciExtension = xhciExtension;
+    PXHCI_HW_REGISTERS OperationalRegs;
+    XHCI_USB_STATUS Status;
+
+    DPRINT("XHCI_FlushInterrupts: ... \n");
+
+    OperationalRegs = XhciExtension->OperationalRegs;
+
+    Status.AsULONG = READ_REGISTER_ULONG(&OperationalRegs->HcStatus.AsULONG);
+    WRITE_REGISTER_ULONG(&OperationalRegs->HcStatus.AsULONG,
+                         Status.AsULONG & XHCI_USB_STATUS_RW1C_MASK);
+}
+
+VOID
+NTAPI
+XHCI_TakePortControl(IN PVOID xhciExtension)
+{
+    DPRINT1("XHCI_TakePortControl: UNIMPLEMENTED. FIXME\n");
+}
+
+VOID
+NTAPI
+XHCI_Unload(IN PDRIVER_OBJECT DriverObject)
+{
+#if DBG
+    DPRINT1("XHCI_Unload: Not supported\n");
+#endif
+    return;
+}
+
+NTSTATUS
+NTAPI
+DriverEntry(IN PDRIVER_OBJECT DriverObject,
+            IN PUNICODE_STRING RegistryPath)
+{
+    DPRINT("DriverEntry: DriverObject - %p, RegistryPath - %wZ\n",
+           DriverObject,
+           RegistryPath);
+
+    if (USBPORT_GetHciMn() != USBPORT_HCI_MN)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    RtlZeroMemory(&RegPacket, sizeof(USBPORT_REGISTRATION_PACKET));
+
+    RegPacket.MiniPortVersion = USB_MINIPORT_VERSION_XHCI;
+
+    RegPacket.MiniPortFlags = USB_MINIPORT_FLAGS_INTERRUPT |
+                              USB_MINIPORT_FLAGS_MEMORY_IO |
+                              USB_MINIPORT_FLAGS_USB2 |
+                              USB_MINIPORT_FLAGS_POLLING;
+
+    RegPacket.MiniPortBusBandwidth = TOTAL_USB20_BUS_BANDWIDTH;
+
+    RegPacket.MiniPortExtensionSize = sizeof(XHCI_EXTENSION);
+    RegPacket.MiniPortEndpointSize = sizeof(XHCI_ENDPOINT);
+    RegPacket.MiniPortTransferSize = sizeof(XHCI_TRANSFER);
+    RegPacket.MiniPortResourcesSize = sizeof(XHCI_HC_RESOURCES);
+
+    RegPacket.OpenEndpoint = XHCI_OpenEndpoint;
+    RegPacket.ReopenEndpoint = XHCI_ReopenEndpoint;
+    RegPacket.QueryEndpointRequirements = XHCI_QueryEndpointRequirements;
+    RegPacket.CloseEndpoint = XHCI_CloseEndpoint;
+    RegPacket.StartController = XHCI_StartController;
+    RegPacket.StopController = XHCI_StopController;
+    RegPacket.SuspendController = XHCI_SuspendController;
+    RegPacket.ResumeController = XHCI_ResumeController;
+    RegPacket.InterruptService = XHCI_InterruptService;
+    RegPacket.InterruptDpc = XHCI_InterruptDpc;
+    RegPacket.SubmitTransfer = XHCI_SubmitTransfer;
+    RegPacket.SubmitIsoTransfer = XHCI_SubmitIsoTransfer;
+    RegPacket.AbortTransfer = XHCI_AbortTransfer;
+    RegPacket.GetEndpointState = XHCI_GetEndpointState;
+    RegPacket.SetEndpointState = XHCI_SetEndpointState;
+    RegPacket.PollEndpoint = XHCI_PollEndpoint;
+    RegPacket.CheckController = XHCI_CheckController;
+    RegPacket.Get32BitFrameNumber = XHCI_Get32BitFrameNumber;
+    RegPacket.InterruptNextSOF = XHCI_InterruptNextSOF;
+    RegPacket.EnableInterrupts = XHCI_EnableInterrupts;
+    RegPacket.DisableInterrupts = XHCI_DisableInterrupts;
+    RegPacket.PollController = XHCI_PollController;
+    RegPacket.SetEndpointDataToggle = XHCI_SetEndpointDataToggle;
+    RegPacket.GetEndpointStatus = XHCI_GetEndpointStatus;
+    RegPacket.SetEndpointStatus = XHCI_SetEndpointStatus;
+    RegPacket.RH_GetRootHubData = XHCI_RH_GetRootHubData;
+    RegPacket.RH_GetStatus = XHCI_RH_GetStatus;
+    RegPacket.RH_GetPortStatus = XHCI_RH_GetPortStatus;
+    RegPacket.RH_GetHubStatus = XHCI_RH_GetHubStatus;
+    RegPacket.RH_SetFeaturePortReset = XHCI_RH_SetFeaturePortReset;
+    RegPacket.RH_SetFeaturePortPower = XHCI_RH_SetFeaturePortPower;
+    RegPacket.RH_SetFeaturePortEnable = XHCI_RH_SetFeaturePortEnable;
+    RegPacket.RH_SetFeaturePortSuspend = XHCI_RH_SetFeaturePortSuspend;
+    RegPacket.RH_ClearFeaturePortEnable = XHCI_RH_ClearFeaturePortEnable;
+    RegPacket.RH_ClearFeaturePortPower = XHCI_RH_ClearFeaturePortPower;
+    RegPacket.RH_ClearFeaturePortSuspend = XHCI_RH_ClearFeaturePortSuspend;
+    RegPacket.RH_ClearFeaturePortEnableChange = XHCI_RH_ClearFeaturePortEnableChange;
+    RegPacket.RH_ClearFeaturePortConnectChange = XHCI_RH_ClearFeaturePortConnectChange;
+    RegPacket.RH_ClearFeaturePortResetChange = XHCI_RH_ClearFeaturePortResetChange;
+    RegPacket.RH_ClearFeaturePortSuspendChange = XHCI_RH_ClearFeaturePortSuspendChange;
+    RegPacket.RH_ClearFeaturePortOvercurrentChange = XHCI_RH_ClearFeaturePortOvercurrentChange;
+    RegPacket.RH_DisableIrq = XHCI_RH_DisableIrq;
+    RegPacket.RH_EnableIrq = XHCI_RH_EnableIrq;
+    RegPacket.StartSendOnePacket = XHCI_StartSendOnePacket;
+    RegPacket.EndSendOnePacket = XHCI_EndSendOnePacket;
+    RegPacket.PassThru = XHCI_PassThru;
+    RegPacket.RebalanceEndpoint = XHCI_RebalanceEndpoint;
+    RegPacket.FlushInterrupts = XHCI_FlushInterrupts;
+    RegPacket.RH_ChirpRootPort = XHCI_RH_ChirpRootPort;
+    RegPacket.TakePortControl = XHCI_TakePortControl;
+
+    DriverObject->DriverUnload = XHCI_Unload;
+
+    return USBPORT_RegisterUSBPortDriver(DriverObject,
+                                         USB20_MINIPORT_INTERFACE_VERSION,
+                                         &RegPacket);
+}
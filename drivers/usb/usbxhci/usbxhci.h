@@ -0,0 +1,285 @@
+/*
+ * PROJECT:     ReactOS USB XHCI Miniport Driver
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     USBXHCI declarations
+ */
+
+#ifndef USBXHCI_H__
+#define USBXHCI_H__
+
+#include <ntddk.h>
+#include <windef.h>
+#include <stdio.h>
+#include <hubbusif.h>
+#include <usbbusif.h>
+#include <usbdlib.h>
+#include <drivers/usbport/usbmport.h>
+#include "hardware.h"
+
+extern USBPORT_REGISTRATION_PACKET RegPacket;
+
+#define XHCI_MAX_DEVICE_SLOTS    32
+#define XHCI_MAX_INTERRUPTERS    2
+#define XHCI_MAX_SCRATCHPADS     32
+
+/* Interrupter 0 gets command completions and port changes,
+   the transfer events go to the next one if the controller has it */
+#define XHCI_COMMAND_INTERRUPTER   0
+#define XHCI_TRANSFER_INTERRUPTER  1
+
+/* Interrupt moderation interval, 40 us in 250 ns units */
+#define XHCI_INTERRUPT_MODERATION  160
+
+#define XHCI_COMMAND_TIMEOUT  500 // ms
+
+/* Every ring segment is one page, ending with a Link TRB */
+#define XHCI_SEGMENT_TRBS  (PAGE_SIZE / sizeof(XHCI_TRB))
+#define XHCI_EVENT_TRBS    (PAGE_SIZE / sizeof(XHCI_TRB))
+
+#define XHCI_CONTROL_RING_SEGMENTS    1
+#define XHCI_INTERRUPT_RING_SEGMENTS  1
+#define XHCI_BULK_RING_SEGMENTS       4
+
+#define XHCI_MAX_CONTROL_TRANSFER_SIZE    0x10000
+#define XHCI_MAX_INTERRUPT_TRANSFER_SIZE  0x10000
+#define XHCI_MAX_BULK_TRANSFER_SIZE       0x40000
+
+typedef struct _XHCI_RING {
+  PXHCI_TRB FirstTrb;
+  ULONG FirstTrbPA;
+  ULONG Segments;
+  ULONG EnqueueIndex;
+  ULONG CycleState;
+} XHCI_RING, *PXHCI_RING;
+
+/* XHCI Miniport transfer */
+#define XHCI_TRANSFER_FLAG_DONE        0x00000001
+#define XHCI_TRANSFER_FLAG_SHORT       0x00000002
+#define XHCI_TRANSFER_FLAG_NO_TRBS     0x00000004
+
+struct _XHCI_ENDPOINT;
+
+typedef struct _XHCI_TRANSFER {
+  LIST_ENTRY TransferLink;
+  PUSBPORT_TRANSFER_PARAMETERS TransferParameters;
+  struct _XHCI_ENDPOINT * XhciEndpoint;
+  ULONG Flags;
+  ULONG FirstTrbIndex;
+  ULONG FirstTrbCycle;
+  ULONG NextTrbIndex;
+  ULONG NextTrbCycle;
+  ULONG CompletedLength;
+  USBD_STATUS USBDStatus;
+} XHCI_TRANSFER, *PXHCI_TRANSFER;
+
+/* XHCI Miniport endpoint */
+#define XHCI_ENDPOINT_FLAG_HALTED           0x00000001
+#define XHCI_ENDPOINT_FLAG_DEQUEUE_MOVED    0x00000002
+#define XHCI_ENDPOINT_FLAG_CONFIGURED       0x00000004
+
+typedef struct _XHCI_ENDPOINT {
+  USBPORT_ENDPOINT_PROPERTIES EndpointProperties;
+  ULONG SlotId;
+  ULONG EndpointId; // Device Context Index
+  ULONG EndpointState;
+  ULONG Flags;
+  ULONG MaxPacketSize;
+  XHCI_RING TransferRing;
+  LIST_ENTRY TransferList;
+} XHCI_ENDPOINT, *PXHCI_ENDPOINT;
+
+/* Per device slot data */
+#define XHCI_SLOT_FLAG_ENABLED    0x00000001
+#define XHCI_SLOT_FLAG_ADDRESSED  0x00000002
+#define XHCI_SLOT_FLAG_HUB        0x00000004
+
+typedef struct _XHCI_SLOT {
+  ULONG Flags;
+  ULONG DeviceAddress; // usbport address
+  ULONG Speed;
+  ULONG NumberOfPorts; // Highest TT port in use, for hubs
+  PXHCI_ENDPOINT Endpoints[XHCI_MAX_ENDPOINTS];
+} XHCI_SLOT, *PXHCI_SLOT;
+
+/* Static part of the controller memory, from the usbport common buffer */
+typedef struct _XHCI_HC_RESOURCES {
+  ULONGLONG DeviceContextBaseArray[XHCI_MAX_SLOTS + 1];
+  ULONGLONG ScratchpadArray[XHCI_MAX_SCRATCHPADS];
+  UCHAR Padded1[PAGE_SIZE - (XHCI_MAX_SLOTS + 1 + XHCI_MAX_SCRATCHPADS) * sizeof(ULONGLONG)];
+  XHCI_TRB CommandRing[XHCI_SEGMENT_TRBS];
+  XHCI_TRB EventRing[XHCI_MAX_INTERRUPTERS][XHCI_EVENT_TRBS];
+  XHCI_EVENT_RING_SEGMENT EventRingSegmentTable[XHCI_MAX_INTERRUPTERS];
+  UCHAR Padded2[PAGE_SIZE - XHCI_MAX_INTERRUPTERS * sizeof(XHCI_EVENT_RING_SEGMENT)];
+  UCHAR InputContext[PAGE_SIZE];
+  UCHAR DeviceContext[XHCI_MAX_DEVICE_SLOTS][XHCI_MAX_ENDPOINTS * XHCI_LARGE_CONTEXT_SIZE];
+  UCHAR Scratchpad[XHCI_MAX_SCRATCHPADS][PAGE_SIZE];
+} XHCI_HC_RESOURCES, *PXHCI_HC_RESOURCES;
+
+C_ASSERT((FIELD_OFFSET(XHCI_HC_RESOURCES, CommandRing) % PAGE_SIZE) == 0);
+C_ASSERT((FIELD_OFFSET(XHCI_HC_RESOURCES, EventRingSegmentTable) % PAGE_SIZE) == 0);
+C_ASSERT((FIELD_OFFSET(XHCI_HC_RESOURCES, InputContext) % PAGE_SIZE) == 0);
+C_ASSERT((FIELD_OFFSET(XHCI_HC_RESOURCES, Scratchpad) % PAGE_SIZE) == 0);
+
+#define XHCI_FLAGS_CONTROLLER_SUSPEND  0x01
+
+/* What the event rings had for usbport */
+#define XHCI_EVENT_TRANSFER  0x01
+#define XHCI_EVENT_PORT      0x02
+
+typedef struct _XHCI_EXTENSION {
+  PXHCI_HC_CAPABILITY_REGISTERS CapabilityRegisters;
+  PXHCI_HW_REGISTERS OperationalRegs;
+  PXHCI_RUNTIME_REGISTERS RuntimeRegs;
+  PULONG DoorbellRegs;
+  ULONG Flags;
+  BOOLEAN IsStarted;
+  BOOLEAN PortPowerControl;
+  USHORT HcVersion;
+  ULONG NumberOfPorts;
+  ULONG NumberOfSlots;
+  ULONG NumberOfInterrupters;
+  ULONG TransferInterrupter;
+  ULONG NumberOfScratchpads;
+  ULONG ContextSize;
+  PXHCI_HC_RESOURCES HcResourcesVA;
+  ULONG HcResourcesPA;
+  /* Events */
+  KSPIN_LOCK EventLock;
+  ULONG EventDequeueIndex[XHCI_MAX_INTERRUPTERS];
+  ULONG EventCycleState[XHCI_MAX_INTERRUPTERS];
+  BOOLEAN PortChangeIrq;
+  /* Commands */
+  XHCI_RING CommandRing;
+  ULONG CommandTrbPA;
+  BOOLEAN CommandDone;
+  UCHAR CommandCompletionCode;
+  UCHAR CommandSlotId;
+  /* Devices */
+  XHCI_SLOT Slots[XHCI_MAX_DEVICE_SLOTS + 1];
+  UCHAR AddressToSlot[USBPORT_MAX_DEVICE_ADDRESS + 1];
+  /* Root hub */
+  UCHAR PortMajorRevision[XHCI_MAX_PORTS];
+  ULONG SuspendChangePortBits[(XHCI_MAX_PORTS + 31) / 32];
+} XHCI_EXTENSION, *PXHCI_EXTENSION;
+
+/* roothub.c */
+MPSTATUS
+NTAPI
+XHCI_RH_ChirpRootPort(
+  IN PVOID xhciExtension,
+  IN USHORT Port);
+
+VOID
+NTAPI
+XHCI_RH_GetRootHubData(
+  IN PVOID xhciExtension,
+  IN PVOID rootHubData);
+
+MPSTATUS
+NTAPI
+XHCI_RH_GetStatus(
+  IN PVOID xhciExtension,
+  IN PUSHORT Status);
+
+MPSTATUS
+NTAPI
+XHCI_RH_GetPortStatus(
+  IN PVOID xhciExtension,
+  IN USHORT Port,
+  IN PUSB_PORT_STATUS_AND_CHANGE PortStatus);
+
+MPSTATUS
+NTAPI
+XHCI_RH_GetHubStatus(
+  IN PVOID xhciExtension,
+  IN PUSB_HUB_STATUS_AND_CHANGE HubStatus);
+
+MPSTATUS
+NTAPI
+XHCI_RH_SetFeaturePortReset(
+  IN PVOID xhciExtension,
+  IN USHORT Port);
+
+MPSTATUS
+NTAPI
+XHCI_RH_SetFeaturePortPower(
+  IN PVOID xhciExtension,
+  IN USHORT Port);
+
+MPSTATUS
+NTAPI
+XHCI_RH_SetFeaturePortEnable(
+  IN PVOID xhciExtension,
+  IN USHORT Port);
+
+MPSTATUS
+NTAPI
+XHCI_RH_SetFeaturePortSuspend(
+  IN PVOID xhciExtension,
+  IN USHORT Port);
+
+MPSTATUS
+NTAPI
+XHCI_RH_ClearFeaturePortEnable(
+  IN PVOID xhciExtension,
+  IN USHORT Port);
+
+MPSTATUS
+NTAPI
+XHCI_RH_ClearFeaturePortPower(
+  IN PVOID xhciExtension,
+  IN USHORT Port);
+
+MPSTATUS
+NTAPI
+XHCI_RH_ClearFeaturePortSuspend(
+  IN PVOID xhciExtension,
+  IN USHORT Port);
+
+MPSTATUS
+NTAPI
+XHCI_RH_ClearFeaturePortEnableChange(
+  IN PVOID xhciExtension,
+  IN USHORT Port);
+
+MPSTATUS
+NTAPI
+XHCI_RH_ClearFeaturePortConnectChange(
+  IN PVOID xhciExtension,
+  IN USHORT Port);
+
+MPSTATUS
+NTAPI
+XHCI_RH_ClearFeaturePortResetChange(
+  IN PVOID xhciExtension,
+  IN USHORT Port);
+
+MPSTATUS
+NTAPI
+XHCI_RH_ClearFeaturePortSuspendChange(
+  IN PVOID xhciExtension,
+  IN USHORT Port);
+
+MPSTATUS
+NTAPI
+XHCI_RH_ClearFeaturePortOvercurrentChange(
+  IN PVOID xhciExtension,
+  IN USHORT Port);
+
+VOID
+NTAPI
+XHCI_RH_DisableIrq(
+  IN PVOID xhciExtension);
+
+VOID
+NTAPI
+XHCI_RH_EnableIrq(
+  IN PVOID xhciExtension);
+
+ULONG
+NTAPI
+XHCI_RH_GetPortSpeed(
+  IN PXHCI_EXTENSION XhciExtension,
+  IN ULONG Port);
+
+#endif /* USBXHCI_H__ */
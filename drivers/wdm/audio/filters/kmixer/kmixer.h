@@ -3,6 +3,7 @@
 
 #include <portcls.h>
 #include <float_cast.h>
+#include <samplerate.h>
 
 typedef struct
 {
@@ -18,6 +19,23 @@ typedef struct
 
 }SUM_NODE_CONTEXT, *PSUM_NODE_CONTEXT;
 
+typedef struct
+{
+    /* input and output format, indexed by pin id */
+    KSDATAFORMAT_WAVEFORMATEX Formats[2];
+
+    /* kept across buffers, so that they join up without clicks */
+    SRC_STATE * Resampler;
+    ULONG ResamplerChannels;
+
+    /* float scratch buffers, only ever grown */
+    PFLOAT FloatIn;
+    ULONG FloatInLength;
+    PFLOAT FloatOut;
+    ULONG FloatOutLength;
+
+}KMIXER_PIN_CONTEXT, *PKMIXER_PIN_CONTEXT;
+
 
 NTSTATUS
 NTAPI
@@ -28,6 +46,29 @@ NTSTATUS
 CreatePin(
     IN PIRP Irp);
 
+/* mix.c */
+VOID
+KMixConvertToFloat(
+    IN PVOID Buffer,
+    IN ULONG BitsPerSample,
+    IN ULONG Channels,
+    IN ULONG Frames,
+    IN ULONG OutputChannels,
+    OUT PFLOAT Output);
+
+VOID
+KMixConvertFromFloat(
+    IN const FLOAT * Input,
+    IN ULONG Samples,
+    IN ULONG BitsPerSample,
+    OUT PVOID Buffer);
+
+VOID
+KMixAccumulate(
+    IN OUT PFLOAT Destination,
+    IN const FLOAT * Source,
+    IN ULONG Samples);
+
 #ifndef _M_IX86
 #define KeSaveFloatingPointState(x) ((void)(x), STATUS_SUCCESS)
 #define KeRestoreFloatingPointState(x) ((void)0)
@@ -0,0 +1,230 @@
+/*
+ * PROJECT:         ReactOS Kernel Streaming Mixer
+ * LICENSE:         GPL - See COPYING in the top level directory
+ * FILE:            drivers/wdm/audio/filters/kmixer/mix.c
+ * PURPOSE:         Sample conversion and mixing routines
+ *
+ * NOTES:           All streams are converted to interleaved float samples
+ *                  in the range [-1.0, 1.0), mixed and resampled in that
+ *                  form, and only converted back to the hardware format at
+ *                  the very end. The routines below don't allocate and don't
+ *                  touch any kernel state, so that they can be tested and
+ *                  benchmarked outside of the driver. The inner loops are
+ *                  kept simple and unrolled, so that the compiler can turn
+ *                  them into vector code.
+ */
+
+#ifndef UNIT_TEST
+#include "kmixer.h"
+
+#define NDEBUG
+#include <debug.h>
+#endif
+
+#define KMIX_SCALE_8        128.0f
+#define KMIX_SCALE_16       32768.0f
+#define KMIX_SCALE_24       8388608.0f
+#define KMIX_SCALE_32       2147483648.0f
+
+static
+FLOAT
+KMixReadSample(
+    IN const UCHAR * Buffer,
+    IN ULONG BitsPerSample,
+    IN ULONG Index)
+{
+    LONG Value;
+
+    switch (BitsPerSample)
+    {
+        case 8:
+            /* 8 bit samples are unsigned */
+            return ((LONG)Buffer[Index] - 0x80) * (1.0f / KMIX_SCALE_8);
+
+        case 16:
+            return ((const SHORT *)Buffer)[Index] * (1.0f / KMIX_SCALE_16);
+
+        case 24:
+            Buffer += Index * 3;
+            Value = Buffer[0] | (Buffer[1] << 8) | ((LONG)(CHAR)Buffer[2] << 16);
+            return Value * (1.0f / KMIX_SCALE_24);
+
+        default:
+            return ((const LONG *)Buffer)[Index] * (1.0f / KMIX_SCALE_32);
+    }
+}
+
+static
+__inline
+LONG
+KMixScaleSample(
+    IN FLOAT Sample,
+    IN FLOAT Scale,
+    IN LONG Maximum)
+{
+    FLOAT Scaled = Sample * Scale;
+
+    /* clip instead of wrapping around */
+    if (Scaled >= (FLOAT)Maximum)
+        return Maximum;
+    if (Scaled <= -Scale)
+        return -Maximum - 1;
+
+    return (LONG)(Scaled + (Scaled >= 0.0f ? 0.5f : -0.5f));
+}
+
+VOID
+KMixConvertToFloat(
+    IN PVOID Buffer,
+    IN ULONG BitsPerSample,
+    IN ULONG Channels,
+    IN ULONG Frames,
+    IN ULONG OutputChannels,
+    OUT PFLOAT Output)
+{
+    const UCHAR * In = (const UCHAR *)Buffer;
+    ULONG Index, Samples, Frame, Channel, SubChannel, Count;
+    FLOAT Sum;
+
+    ASSERT(BitsPerSample == 8 || BitsPerSample == 16 || BitsPerSample == 24 || BitsPerSample == 32);
+    ASSERT(Channels && OutputChannels);
+
+    if (Channels == OutputChannels)
+    {
+        /* the common case, just a format conversion */
+        Samples = Frames * Channels;
+        Index = 0;
+
+        if (BitsPerSample == 16)
+        {
+            const SHORT * In16 = (const SHORT *)Buffer;
+
+            for (; Index + 4 <= Samples; Index += 4)
+            {
+                Output[Index + 0] = In16[Index + 0] * (1.0f / KMIX_SCALE_16);
+                Output[Index + 1] = In16[Index + 1] * (1.0f / KMIX_SCALE_16);
+                Output[Index + 2] = In16[Index + 2] * (1.0f / KMIX_SCALE_16);
+                Output[Index + 3] = In16[Index + 3] * (1.0f / KMIX_SCALE_16);
+            }
+        }
+        else if (BitsPerSample == 32)
+        {
+            const LONG * In32 = (const LONG *)Buffer;
+
+            for (; Index + 4 <= Samples; Index += 4)
+            {
+                Output[Index + 0] = In32[Index + 0] * (1.0f / KMIX_SCALE_32);
+                Output[Index + 1] = In32[Index + 1] * (1.0f / KMIX_SCALE_32);
+                Output[Index + 2] = In32[Index + 2] * (1.0f / KMIX_SCALE_32);
+                Output[Index + 3] = In32[Index + 3] * (1.0f / KMIX_SCALE_32);
+            }
+        }
+
+        for (; Index < Samples; Index++)
+            Output[Index] = KMixReadSample(In, BitsPerSample, Index);
+
+        return;
+    }
+
+    for (Frame = 0; Frame < Frames; Frame++)
+    {
+        Index = Frame * Channels;
+
+        for (Channel = 0; Channel < OutputChannels; Channel++)
+        {
+            if (OutputChannels > Channels)
+            {
+                /* 2 channels stretched to 4 look like LRLR */
+                Output[Channel] = KMixReadSample(In, BitsPerSample, Index + (Channel % Channels));
+                continue;
+            }
+
+            /* fold the extra channels into the ones we keep */
+            Sum = 0.0f;
+            Count = 0;
+            for (SubChannel = Channel; SubChannel < Channels; SubChannel += OutputChannels)
+            {
+                Sum += KMixReadSample(In, BitsPerSample, Index + SubChannel);
+                Count++;
+            }
+            Output[Channel] = Sum / Count;
+        }
+
+        Output += OutputChannels;
+    }
+}
+
+VOID
+KMixConvertFromFloat(
+    IN const FLOAT * Input,
+    IN ULONG Samples,
+    IN ULONG BitsPerSample,
+    OUT PVOID Buffer)
+{
+    ULONG Index;
+    LONG Value;
+
+    ASSERT(BitsPerSample == 8 || BitsPerSample == 16 || BitsPerSample == 24 || BitsPerSample == 32);
+
+    if (BitsPerSample == 8)
+    {
+        PUCHAR Out = (PUCHAR)Buffer;
+
+        for (Index = 0; Index < Samples; Index++)
+            Out[Index] = (UCHAR)(KMixScaleSample(Input[Index], KMIX_SCALE_8, 0x7F) + 0x80);
+    }
+    else if (BitsPerSample == 16)
+    {
+        PSHORT Out = (PSHORT)Buffer;
+
+        for (Index = 0; Index + 4 <= Samples; Index += 4)
+        {
+            Out[Index + 0] = (SHORT)KMixScaleSample(Input[Index + 0], KMIX_SCALE_16, 0x7FFF);
+            Out[Index + 1] = (SHORT)KMixScaleSample(Input[Index + 1], KMIX_SCALE_16, 0x7FFF);
+            Out[Index + 2] = (SHORT)KMixScaleSample(Input[Index + 2], KMIX_SCALE_16, 0x7FFF);
+            Out[Index + 3] = (SHORT)KMixScaleSample(Input[Index + 3], KMIX_SCALE_16, 0x7FFF);
+        }
+
+        for (; Index < Samples; Index++)
+            Out[Index] = (SHORT)KMixScaleSample(Input[Index], KMIX_SCALE_16, 0x7FFF);
+    }
+    else if (BitsPerSample == 24)
+    {
+        PUCHAR Out = (PUCHAR)Buffer;
+
+        for (Index = 0; Index < Samples; Index++)
+        {
+            Value = KMixScaleSample(Input[Index], KMIX_SCALE_24, 0x7FFFFF);
+            Out[Index * 3 + 0] = (UCHAR)Value;
+            Out[Index * 3 + 1] = (UCHAR)(Value >> 8);
+            Out[Index * 3 + 2] = (UCHAR)(Value >> 16);
+        }
+    }
+    else
+    {
+        PLONG Out = (PLONG)Buffer;
+
+        for (Index = 0; Index < Samples; Index++)
+            Out[Index] = KMixScaleSample(Input[Index], KMIX_SCALE_32, 0x7FFFFFFF);
+    }
+}
+
+VOID
+KMixAccumulate(
+    IN OUT PFLOAT Destination,
+    IN const FLOAT * Source,
+    IN ULONG Samples)
+{
+    ULONG Index;
+
+    for (Index = 0; Index + 4 <= Samples; Index += 4)
+    {
+        Destination[Index + 0] += Source[Index + 0];
+        Destination[Index + 1] += Source[Index + 1];
+        Destination[Index + 2] += Source[Index + 2];
+        Destination[Index + 3] += Source[Index + 3];
+    }
+
+    for (; Index < Samples; Index++)
+        Destination[Index] += Source[Index];
+}
@@ -8,413 +8,196 @@
 
 #include "kmixer.h"
 
-#include <samplerate.h>
-
 #define NDEBUG
 #include <debug.h>
 
 const GUID KSPROPSETID_Connection              = {0x1D58C920L, 0xAC9B, 0x11CF, {0xA5, 0xD6, 0x28, 0xDB, 0x04, 0xC1, 0x00, 0x00}};
 
-NTSTATUS
-PerformSampleRateConversion(
-    PUCHAR Buffer,
-    ULONG BufferLength,
-    ULONG OldRate,
-    ULONG NewRate,
-    ULONG BytesPerSample,
-    ULONG NumChannels,
-    PVOID * Result,
-    PULONG ResultLength)
+static
+PFLOAT
+ReserveFloatBuffer(
+    IN OUT PFLOAT * Buffer,
+    IN OUT PULONG BufferLength,
+    IN ULONG Samples)
 {
-    KFLOATING_SAVE FloatSave;
-    NTSTATUS Status;
-    ULONG Index;
-    SRC_STATE * State;
-    SRC_DATA Data;
-    PUCHAR ResultOut;
-    int error;
-    PFLOAT FloatIn, FloatOut;
-    ULONG NumSamples;
-    ULONG NewSamples;
+    PFLOAT NewBuffer;
 
-    DPRINT("PerformSampleRateConversion OldRate %u NewRate %u BytesPerSample %u NumChannels %u Irql %u\n", OldRate, NewRate, BytesPerSample, NumChannels, KeGetCurrentIrql());
+    if (*BufferLength >= Samples)
+        return *Buffer;
 
-    ASSERT(BytesPerSample == 1 || BytesPerSample == 2 || BytesPerSample == 4);
+    /* leave some room for buffers which are slightly larger than this one */
+    Samples += Samples / 4;
 
-    /* first acquire float save context */
-    Status = KeSaveFloatingPointState(&FloatSave);
-
-    if (!NT_SUCCESS(Status))
-    {
-        DPRINT1("KeSaveFloatingPointState failed with %x\n", Status);
-        return Status;
-    }
+    NewBuffer = ExAllocatePool(NonPagedPool, Samples * sizeof(FLOAT));
+    if (!NewBuffer)
+        return NULL;
 
-    NumSamples = BufferLength / (BytesPerSample * NumChannels);
+    if (*Buffer)
+        ExFreePool(*Buffer);
 
-    FloatIn = ExAllocatePool(NonPagedPool, NumSamples * NumChannels * sizeof(FLOAT));
-    if (!FloatIn)
-    {
-        KeRestoreFloatingPointState(&FloatSave);
-        return STATUS_INSUFFICIENT_RESOURCES;
-    }
+    *Buffer = NewBuffer;
+    *BufferLength = Samples;
+    return NewBuffer;
+}
 
-    NewSamples = ((((ULONG64)NumSamples * NewRate) + (OldRate / 2)) / OldRate) + 2;
+static
+NTSTATUS
+PerformSampleRateConversion(
+    IN PKMIXER_PIN_CONTEXT Context,
+    IN ULONG Frames,
+    IN ULONG OldRate,
+    IN ULONG NewRate,
+    IN ULONG NumChannels,
+    OUT PULONG NewFrames)
+{
+    SRC_DATA Data;
+    ULONG MaxFrames;
+    int error;
 
-    FloatOut = ExAllocatePool(NonPagedPool, NewSamples * NumChannels * sizeof(FLOAT));
-    if (!FloatOut)
-    {
-        ExFreePool(FloatIn);
-        KeRestoreFloatingPointState(&FloatSave);
-        return STATUS_INSUFFICIENT_RESOURCES;
-    }
+    DPRINT("PerformSampleRateConversion OldRate %u NewRate %u NumChannels %u Irql %u\n", OldRate, NewRate, NumChannels, KeGetCurrentIrql());
 
-    ResultOut = ExAllocatePool(NonPagedPool, NewSamples * NumChannels * BytesPerSample);
-    if (!ResultOut)
+    if (Context->Resampler && Context->ResamplerChannels != NumChannels)
     {
-        ExFreePool(FloatIn);
-        ExFreePool(FloatOut);
-        KeRestoreFloatingPointState(&FloatSave);
-        return STATUS_INSUFFICIENT_RESOURCES;
+        src_delete(Context->Resampler);
+        Context->Resampler = NULL;
     }
 
-    State = src_new(SRC_SINC_FASTEST, NumChannels, &error);
-    if (!State)
+    if (!Context->Resampler)
     {
-        DPRINT1("src_new failed with %x\n", error);
-        KeRestoreFloatingPointState(&FloatSave);
-        ExFreePool(FloatIn);
-        ExFreePool(FloatOut);
-        ExFreePool(ResultOut);
-        return STATUS_UNSUCCESSFUL;
+        Context->Resampler = src_new(SRC_SINC_FASTEST, NumChannels, &error);
+        if (!Context->Resampler)
+        {
+            DPRINT1("src_new failed with %x\n", error);
+            return STATUS_UNSUCCESSFUL;
+        }
+        Context->ResamplerChannels = NumChannels;
     }
 
-    /* fixme use asm */
-    if (BytesPerSample == 1)
-    {
-        for(Index = 0; Index < NumSamples * NumChannels; Index++)
-            FloatIn[Index] = (float)(Buffer[Index] / (1.0 * 0x80));
-    }
-    else if (BytesPerSample == 2)
-    {
-        src_short_to_float_array((short*)Buffer, FloatIn, NumSamples * NumChannels);
-    }
-    else if (BytesPerSample == 4)
-    {
-        src_int_to_float_array((int*)Buffer, FloatIn, NumSamples * NumChannels);
-    }
+    /* the resampler may hand out a few frames more than the ratio says */
+    MaxFrames = (ULONG)((((ULONG64)Frames * NewRate) + OldRate - 1) / OldRate) + 16;
+    if (!ReserveFloatBuffer(&Context->FloatOut, &Context->FloatOutLength, MaxFrames * NumChannels))
+        return STATUS_INSUFFICIENT_RESOURCES;
 
-    Data.data_in = FloatIn;
-    Data.data_out = FloatOut;
-    Data.input_frames = NumSamples;
-    Data.output_frames = NewSamples;
+    /* the state carries over from the last buffer, so this is no end of input */
+    RtlZeroMemory(&Data, sizeof(Data));
+    Data.data_in = Context->FloatIn;
+    Data.data_out = Context->FloatOut;
+    Data.input_frames = Frames;
+    Data.output_frames = MaxFrames;
     Data.src_ratio = (double)NewRate / (double)OldRate;
 
-    error = src_process(State, &Data);
+    error = src_process(Context->Resampler, &Data);
     if (error)
     {
         DPRINT1("src_process failed with %x\n", error);
-        KeRestoreFloatingPointState(&FloatSave);
-        ExFreePool(FloatIn);
-        ExFreePool(FloatOut);
-        ExFreePool(ResultOut);
         return STATUS_UNSUCCESSFUL;
     }
 
-    if (BytesPerSample == 1)
-    {
-        /* FIXME perform over/under clipping */
-
-        for(Index = 0; Index < Data.output_frames_gen * NumChannels; Index++)
-            ResultOut[Index] = (lrintf(FloatOut[Index]) >> 24);
-    }
-    else if (BytesPerSample == 2)
-    {
-        PUSHORT Res = (PUSHORT)ResultOut;
-
-        src_float_to_short_array(FloatOut, (short*)Res, Data.output_frames_gen * NumChannels);
-    }
-    else if (BytesPerSample == 4)
+    if (Data.input_frames_used != Data.input_frames)
     {
-        PULONG Res = (PULONG)ResultOut;
-
-        src_float_to_int_array(FloatOut, (int*)Res, Data.output_frames_gen * NumChannels);
+        DPRINT1("Dropped %ld frames\n", Data.input_frames - Data.input_frames_used);
     }
 
-
-    *Result = ResultOut;
-    *ResultLength = Data.output_frames_gen * BytesPerSample * NumChannels;
-    ExFreePool(FloatIn);
-    ExFreePool(FloatOut);
-    src_delete(State);
-    KeRestoreFloatingPointState(&FloatSave);
+    *NewFrames = Data.output_frames_gen;
     return STATUS_SUCCESS;
 }
 
+static
 NTSTATUS
-PerformChannelConversion(
-    PUCHAR Buffer,
-    ULONG BufferLength,
-    ULONG OldChannels,
-    ULONG NewChannels,
-    ULONG BitsPerSample,
-    PVOID * Result,
-    PULONG ResultLength)
+PerformConversion(
+    IN PKMIXER_PIN_CONTEXT Context,
+    IN PKSSTREAM_HEADER StreamHeader)
 {
-    ULONG Samples;
-    ULONG NewIndex, OldIndex;
-
-    Samples = BufferLength / (BitsPerSample / 8) / OldChannels;
-
-    if (NewChannels > OldChannels)
-    {
-        if (BitsPerSample == 8)
-        {
-            PUCHAR BufferOut = ExAllocatePool(NonPagedPool, Samples * NewChannels);
-            if (!BufferOut)
-                return STATUS_INSUFFICIENT_RESOURCES;
+    KFLOATING_SAVE FloatSave;
+    NTSTATUS Status;
+    PWAVEFORMATEX InputFormat, OutputFormat;
+    ULONG Frames, NewFrames, NewLength;
+    PFLOAT Samples;
+    PVOID BufferOut;
 
-            for(NewIndex = 0, OldIndex = 0; OldIndex < Samples * OldChannels; NewIndex += NewChannels, OldIndex += OldChannels)
-            {
-                ULONG SubIndex = 0;
+    InputFormat = &Context->Formats[0].WaveFormatEx;
+    OutputFormat = &Context->Formats[1].WaveFormatEx;
 
-                RtlMoveMemory(&BufferOut[NewIndex], &Buffer[OldIndex], OldChannels * sizeof(UCHAR));
+    Frames = StreamHeader->DataUsed / (InputFormat->wBitsPerSample / 8) / InputFormat->nChannels;
 
-                do
-                {
-                    /* 2 channel stretched to 4 looks like LRLR */
-                     BufferOut[NewIndex+OldChannels + SubIndex] = Buffer[OldIndex + (SubIndex % OldChannels)];
-                }while(SubIndex++ < NewChannels - OldChannels);
-            }
-            *Result = BufferOut;
-            *ResultLength = Samples * NewChannels;
-        }
-        else if (BitsPerSample == 16)
-        {
-            PUSHORT BufferOut = ExAllocatePool(NonPagedPool, Samples * NewChannels);
-            if (!BufferOut)
-                return STATUS_INSUFFICIENT_RESOURCES;
+    /* first acquire float save context */
+    Status = KeSaveFloatingPointState(&FloatSave);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("KeSaveFloatingPointState failed with %x\n", Status);
+        return Status;
+    }
 
-            for(NewIndex = 0, OldIndex = 0; OldIndex < Samples * OldChannels; NewIndex += NewChannels, OldIndex += OldChannels)
-            {
-                ULONG SubIndex = 0;
+    /* convert the sample format and the channels in one go */
+    if (!ReserveFloatBuffer(&Context->FloatIn, &Context->FloatInLength, Frames * OutputFormat->nChannels))
+    {
+        KeRestoreFloatingPointState(&FloatSave);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
 
-                RtlMoveMemory(&BufferOut[NewIndex], &Buffer[OldIndex], OldChannels * sizeof(USHORT));
+    KMixConvertToFloat(StreamHeader->Data,
+                       InputFormat->wBitsPerSample,
+                       InputFormat->nChannels,
+                       Frames,
+                       OutputFormat->nChannels,
+                       Context->FloatIn);
+    Samples = Context->FloatIn;
+    NewFrames = Frames;
 
-                do
-                {
-                     BufferOut[NewIndex+OldChannels + SubIndex] = Buffer[OldIndex + (SubIndex % OldChannels)];
-                }while(SubIndex++ < NewChannels - OldChannels);
-            }
-            *Result = BufferOut;
-            *ResultLength = Samples * NewChannels;
-        }
-        else if (BitsPerSample == 24)
+    if (InputFormat->nSamplesPerSec != OutputFormat->nSamplesPerSec)
+    {
+        Status = PerformSampleRateConversion(Context,
+                                             Frames,
+                                             InputFormat->nSamplesPerSec,
+                                             OutputFormat->nSamplesPerSec,
+                                             OutputFormat->nChannels,
+                                             &NewFrames);
+        if (!NT_SUCCESS(Status))
         {
-            PUCHAR BufferOut = ExAllocatePool(NonPagedPool, Samples * NewChannels);
-            if (!BufferOut)
-                return STATUS_INSUFFICIENT_RESOURCES;
-
-            for(NewIndex = 0, OldIndex = 0; OldIndex < Samples * OldChannels; NewIndex += NewChannels, OldIndex += OldChannels)
-            {
-                ULONG SubIndex = 0;
-
-                RtlMoveMemory(&BufferOut[NewIndex], &Buffer[OldIndex], OldChannels * 3);
-
-                do
-                {
-                     RtlMoveMemory(&BufferOut[(NewIndex+OldChannels + SubIndex) * 3], &Buffer[(OldIndex + (SubIndex % OldChannels)) * 3], 3);
-                }while(SubIndex++ < NewChannels - OldChannels);
-            }
-            *Result = BufferOut;
-            *ResultLength = Samples * NewChannels;
+            KeRestoreFloatingPointState(&FloatSave);
+            return Status;
         }
-        else if (BitsPerSample == 32)
-        {
-            PULONG BufferOut = ExAllocatePool(NonPagedPool, Samples * NewChannels);
-            if (!BufferOut)
-                return STATUS_INSUFFICIENT_RESOURCES;
-
-            for(NewIndex = 0, OldIndex = 0; OldIndex < Samples * OldChannels; NewIndex += NewChannels, OldIndex += OldChannels)
-            {
-                ULONG SubIndex = 0;
-
-                RtlMoveMemory(&BufferOut[NewIndex], &Buffer[OldIndex], OldChannels * sizeof(ULONG));
+        Samples = Context->FloatOut;
+    }
 
-                do
-                {
-                     BufferOut[NewIndex+OldChannels + SubIndex] = Buffer[OldIndex + (SubIndex % OldChannels)];
-                }while(SubIndex++ < NewChannels - OldChannels);
-            }
-            *Result = BufferOut;
-            *ResultLength = Samples * NewChannels;
-        }
+    NewLength = NewFrames * OutputFormat->nChannels * (OutputFormat->wBitsPerSample / 8);
 
-    }
-    else
+    /* the input has been consumed, so reuse its buffer if the result fits */
+    BufferOut = StreamHeader->Data;
+    if (NewLength > max(StreamHeader->FrameExtent, StreamHeader->DataUsed))
     {
-        PUSHORT BufferOut = ExAllocatePool(NonPagedPool, Samples * NewChannels);
+        BufferOut = ExAllocatePool(NonPagedPool, NewLength);
         if (!BufferOut)
-            return STATUS_INSUFFICIENT_RESOURCES;
-
-        for(NewIndex = 0, OldIndex = 0; OldIndex < Samples * OldChannels; NewIndex += NewChannels, OldIndex += OldChannels)
         {
-            /* TODO
-             * mix stream instead of just dumping part of it ;)
-             */
-            RtlMoveMemory(&BufferOut[NewIndex], &Buffer[OldIndex], NewChannels * (BitsPerSample/8));
+            KeRestoreFloatingPointState(&FloatSave);
+            return STATUS_INSUFFICIENT_RESOURCES;
         }
 
-        *Result = BufferOut;
-        *ResultLength = Samples * NewChannels;
+        ExFreePool(StreamHeader->Data);
+        StreamHeader->Data = BufferOut;
+        StreamHeader->FrameExtent = NewLength;
     }
+
+    KMixConvertFromFloat(Samples,
+                         NewFrames * OutputFormat->nChannels,
+                         OutputFormat->wBitsPerSample,
+                         BufferOut);
+    StreamHeader->DataUsed = NewLength;
+
+    KeRestoreFloatingPointState(&FloatSave);
     return STATUS_SUCCESS;
 }
 
-
-NTSTATUS
-PerformQualityConversion(
-    PUCHAR Buffer,
-    ULONG BufferLength,
-    ULONG OldWidth,
-    ULONG NewWidth,
-    PVOID * Result,
-    PULONG ResultLength)
+static
+BOOLEAN
+IsFormatSupported(
+    IN PWAVEFORMATEX WaveFormat)
 {
-    ULONG Samples;
-    ULONG Index;
-
-    ASSERT(OldWidth != NewWidth);
-
-    Samples = BufferLength / (OldWidth / 8);
-    //DPRINT("Samples %u BufferLength %u\n", Samples, BufferLength);
-
-    if (OldWidth == 8 && NewWidth == 16)
-    {
-         USHORT Sample;
-         PUSHORT BufferOut = ExAllocatePool(NonPagedPool, Samples * sizeof(USHORT));
-         if (!BufferOut)
-             return STATUS_INSUFFICIENT_RESOURCES;
-
-          for(Index = 0; Index < Samples; Index++)
-          {
-              Sample = Buffer[Index];
-              Sample *= 2;
-#ifdef _X86_
-              Sample = _byteswap_ushort(Sample);
-#endif
-              BufferOut[Index] = Sample;
-          }
-          *Result = BufferOut;
-          *ResultLength = Samples * sizeof(USHORT);
-    }
-    else if (OldWidth == 8 && NewWidth == 32)
-    {
-         ULONG Sample;
-         PULONG BufferOut = ExAllocatePool(NonPagedPool, Samples * sizeof(ULONG));
-         if (!BufferOut)
-             return STATUS_INSUFFICIENT_RESOURCES;
-
-          for(Index = 0; Index < Samples; Index++)
-          {
-              Sample = Buffer[Index];
-              Sample *= 16777216;
-#ifdef _X86_
-              Sample = _byteswap_ulong(Sample);
-#endif
-              BufferOut[Index] = Sample;
-          }
-          *Result = BufferOut;
-          *ResultLength = Samples * sizeof(ULONG);
-    }
-    else if (OldWidth == 16 && NewWidth == 32)
-    {
-         ULONG Sample;
-         PUSHORT BufferIn = (PUSHORT)Buffer;
-         PULONG BufferOut = ExAllocatePool(NonPagedPool, Samples * sizeof(ULONG));
-         if (!BufferOut)
-             return STATUS_INSUFFICIENT_RESOURCES;
-
-          for(Index = 0; Index < Samples; Index++)
-          {
-              Sample = BufferIn[Index];
-              Sample *= 65536;
-#ifdef _X86_
-              Sample = _byteswap_ulong(Sample);
-#endif
-              BufferOut[Index] = Sample;
-          }
-          *Result = BufferOut;
-          *ResultLength = Samples * sizeof(ULONG);
-    }
-
-    else if (OldWidth == 16 && NewWidth == 8)
-    {
-         USHORT Sample;
-         PUSHORT BufferIn = (PUSHORT)Buffer;
-         PUCHAR BufferOut = ExAllocatePool(NonPagedPool, Samples * sizeof(UCHAR));
-         if (!BufferOut)
-             return STATUS_INSUFFICIENT_RESOURCES;
-
-          for(Index = 0; Index < Samples; Index++)
-          {
-              Sample = BufferIn[Index];
-#ifdef _X86_
-              Sample = _byteswap_ushort(Sample);
-#endif
-              Sample /= 256;
-              BufferOut[Index] = (Sample & 0xFF);
-          }
-          *Result = BufferOut;
-          *ResultLength = Samples * sizeof(UCHAR);
-    }
-    else if (OldWidth == 32 && NewWidth == 8)
-    {
-         ULONG Sample;
-         PULONG BufferIn = (PULONG)Buffer;
-         PUCHAR BufferOut = ExAllocatePool(NonPagedPool, Samples * sizeof(UCHAR));
-         if (!BufferOut)
-             return STATUS_INSUFFICIENT_RESOURCES;
-
-          for(Index = 0; Index < Samples; Index++)
-          {
-              Sample = BufferIn[Index];
-#ifdef _X86_
-              Sample = _byteswap_ulong(Sample);
-#endif
-              Sample /= 16777216;
-              BufferOut[Index] = (Sample & 0xFF);
-          }
-          *Result = BufferOut;
-          *ResultLength = Samples * sizeof(UCHAR);
-    }
-    else if (OldWidth == 32 && NewWidth == 16)
-    {
-         USHORT Sample;
-         PULONG BufferIn = (PULONG)Buffer;
-         PUSHORT BufferOut = ExAllocatePool(NonPagedPool, Samples * sizeof(USHORT));
-         if (!BufferOut)
-             return STATUS_INSUFFICIENT_RESOURCES;
-
-          for(Index = 0; Index < Samples; Index++)
-          {
-              Sample = BufferIn[Index];
-#ifdef _X86_
-              Sample = _byteswap_ulong(Sample);
-#endif
-              Sample /= 65536;
-              BufferOut[Index] = (Sample & 0xFFFF);
-          }
-          *Result = BufferOut;
-          *ResultLength = Samples * sizeof(USHORT);
-    }
-    else
-    {
-        DPRINT1("Not implemented conversion OldWidth %u NewWidth %u\n", OldWidth, NewWidth);
-        return STATUS_NOT_IMPLEMENTED;
-    }
+    if (!WaveFormat->nChannels || !WaveFormat->nSamplesPerSec)
+        return FALSE;
 
-    return STATUS_SUCCESS;
+    return (WaveFormat->wBitsPerSample == 8 || WaveFormat->wBitsPerSample == 16 ||
+            WaveFormat->wBitsPerSample == 24 || WaveFormat->wBitsPerSample == 32);
 }
 
 
@@ -438,20 +221,26 @@ Pin_fnDeviceIoControl(
         {
             if (Property->Property.Id == KSPROPERTY_CONNECTION_DATAFORMAT && Property->Property.Flags == KSPROPERTY_TYPE_SET)
             {
+                PKMIXER_PIN_CONTEXT Context;
                 PKSDATAFORMAT_WAVEFORMATEX Formats;
                 PKSDATAFORMAT_WAVEFORMATEX WaveFormat;
 
-                Formats = (PKSDATAFORMAT_WAVEFORMATEX)IoStack->FileObject->FsContext2;
+                Context = (PKMIXER_PIN_CONTEXT)IoStack->FileObject->FsContext;
                 WaveFormat = (PKSDATAFORMAT_WAVEFORMATEX)Irp->UserBuffer;
 
                 ASSERT(Property->PinId == 0 || Property->PinId == 1);
-                ASSERT(Formats);
+                ASSERT(Context);
                 ASSERT(WaveFormat);
+                Formats = Context->Formats;
 
                 Formats[Property->PinId].WaveFormatEx.nChannels = WaveFormat->WaveFormatEx.nChannels;
                 Formats[Property->PinId].WaveFormatEx.wBitsPerSample = WaveFormat->WaveFormatEx.wBitsPerSample;
                 Formats[Property->PinId].WaveFormatEx.nSamplesPerSec = WaveFormat->WaveFormatEx.nSamplesPerSec;
 
+                /* a new stream starts, forget about the old one */
+                if (Context->Resampler)
+                    src_reset(Context->Resampler);
+
                 Irp->IoStatus.Information = 0;
                 Irp->IoStatus.Status = STATUS_SUCCESS;
                 IoCompleteRequest(Irp, IO_NO_INCREMENT);
@@ -514,7 +303,23 @@ Pin_fnClose(
     PDEVICE_OBJECT DeviceObject,
     PIRP Irp)
 {
-    UNIMPLEMENTED;
+    PIO_STACK_LOCATION IoStack;
+    PKMIXER_PIN_CONTEXT Context;
+
+    IoStack = IoGetCurrentIrpStackLocation(Irp);
+    Context = (PKMIXER_PIN_CONTEXT)IoStack->FileObject->FsContext;
+
+    if (Context)
+    {
+        if (Context->Resampler)
+            src_delete(Context->Resampler);
+        if (Context->FloatIn)
+            ExFreePool(Context->FloatIn);
+        if (Context->FloatOut)
+            ExFreePool(Context->FloatOut);
+        ExFreePool(Context);
+        IoStack->FileObject->FsContext = NULL;
+    }
 
     Irp->IoStatus.Status = STATUS_SUCCESS;
     Irp->IoStatus.Information = 0;
@@ -601,18 +406,16 @@ Pin_fnFastWrite(
     PDEVICE_OBJECT DeviceObject)
 {
     PKSSTREAM_HEADER StreamHeader;
-    PVOID BufferOut;
-    ULONG BufferLength;
     NTSTATUS Status = STATUS_SUCCESS;
-    PKSDATAFORMAT_WAVEFORMATEX Formats;
+    PKMIXER_PIN_CONTEXT Context;
     PKSDATAFORMAT_WAVEFORMATEX InputFormat, OutputFormat;
 
     DPRINT("Pin_fnFastWrite called DeviceObject %p Irp %p\n", DeviceObject);
 
-    Formats = (PKSDATAFORMAT_WAVEFORMATEX)FileObject->FsContext2;
+    Context = (PKMIXER_PIN_CONTEXT)FileObject->FsContext;
 
-    InputFormat = Formats;
-    OutputFormat = (Formats + 1);
+    InputFormat = &Context->Formats[0];
+    OutputFormat = &Context->Formats[1];
     StreamHeader = (PKSSTREAM_HEADER)Buffer;
 
 
@@ -621,55 +424,19 @@ Pin_fnFastWrite(
                InputFormat->WaveFormatEx.nSamplesPerSec, OutputFormat->WaveFormatEx.nSamplesPerSec,
                InputFormat->WaveFormatEx.wBitsPerSample, OutputFormat->WaveFormatEx.wBitsPerSample);
 
-    if (InputFormat->WaveFormatEx.wBitsPerSample != OutputFormat->WaveFormatEx.wBitsPerSample)
-    {
-        Status = PerformQualityConversion(StreamHeader->Data,
-                                          StreamHeader->DataUsed,
-                                          InputFormat->WaveFormatEx.wBitsPerSample,
-                                          OutputFormat->WaveFormatEx.wBitsPerSample,
-                                          &BufferOut,
-                                          &BufferLength);
-        if (NT_SUCCESS(Status))
-        {
-            ExFreePool(StreamHeader->Data);
-            StreamHeader->Data = BufferOut;
-            StreamHeader->DataUsed = BufferLength;
-        }
-    }
-
-    if (InputFormat->WaveFormatEx.nChannels != OutputFormat->WaveFormatEx.nChannels)
+    if (InputFormat->WaveFormatEx.wBitsPerSample != OutputFormat->WaveFormatEx.wBitsPerSample ||
+        InputFormat->WaveFormatEx.nChannels != OutputFormat->WaveFormatEx.nChannels ||
+        InputFormat->WaveFormatEx.nSamplesPerSec != OutputFormat->WaveFormatEx.nSamplesPerSec)
     {
-        Status = PerformChannelConversion(StreamHeader->Data,
-                                          StreamHeader->DataUsed,
-                                          InputFormat->WaveFormatEx.nChannels,
-                                          OutputFormat->WaveFormatEx.nChannels,
-                                          OutputFormat->WaveFormatEx.wBitsPerSample,
-                                          &BufferOut,
-                                          &BufferLength);
-
-        if (NT_SUCCESS(Status))
+        if (!IsFormatSupported(&InputFormat->WaveFormatEx) || !IsFormatSupported(&OutputFormat->WaveFormatEx))
         {
-            ExFreePool(StreamHeader->Data);
-            StreamHeader->Data = BufferOut;
-            StreamHeader->DataUsed = BufferLength;
+            DPRINT1("Not implemented conversion OldWidth %u NewWidth %u\n",
+                    InputFormat->WaveFormatEx.wBitsPerSample, OutputFormat->WaveFormatEx.wBitsPerSample);
+            Status = STATUS_NOT_IMPLEMENTED;
         }
-    }
-
-    if (InputFormat->WaveFormatEx.nSamplesPerSec != OutputFormat->WaveFormatEx.nSamplesPerSec)
-    {
-        Status = PerformSampleRateConversion(StreamHeader->Data,
-                                             StreamHeader->DataUsed,
-                                             InputFormat->WaveFormatEx.nSamplesPerSec,
-                                             OutputFormat->WaveFormatEx.nSamplesPerSec,
-                                             OutputFormat->WaveFormatEx.wBitsPerSample / 8,
-                                             OutputFormat->WaveFormatEx.nChannels,
-                                             &BufferOut,
-                                             &BufferLength);
-        if (NT_SUCCESS(Status))
+        else
         {
-            ExFreePool(StreamHeader->Data);
-            StreamHeader->Data = BufferOut;
-            StreamHeader->DataUsed = BufferLength;
+            Status = PerformConversion(Context, StreamHeader);
         }
     }
 
@@ -701,21 +468,27 @@ CreatePin(
 {
     NTSTATUS Status;
     KSOBJECT_HEADER ObjectHeader;
-    PKSDATAFORMAT DataFormat;
+    PKMIXER_PIN_CONTEXT Context;
     PIO_STACK_LOCATION IoStack;
 
 
-    DataFormat = ExAllocatePool(NonPagedPool, sizeof(KSDATAFORMAT_WAVEFORMATEX) * 2);
-    if (!DataFormat)
+    Context = ExAllocatePool(NonPagedPool, sizeof(KMIXER_PIN_CONTEXT));
+    if (!Context)
         return STATUS_INSUFFICIENT_RESOURCES;
 
-    RtlZeroMemory(DataFormat, sizeof(KSDATAFORMAT_WAVEFORMATEX) * 2);
+    RtlZeroMemory(Context, sizeof(KMIXER_PIN_CONTEXT));
 
+    /* the object header takes FsContext2 */
     IoStack = IoGetCurrentIrpStackLocation(Irp);
-    IoStack->FileObject->FsContext2 = (PVOID)DataFormat;
+    IoStack->FileObject->FsContext = (PVOID)Context;
 
     /* allocate object header */
     Status = KsAllocateObjectHeader(&ObjectHeader, 0, NULL, Irp, &PinTable);
+    if (!NT_SUCCESS(Status))
+    {
+        IoStack->FileObject->FsContext = NULL;
+        ExFreePool(Context);
+    }
     return Status;
 }
 
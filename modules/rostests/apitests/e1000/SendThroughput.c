@@ -0,0 +1,139 @@
+/*
+ * PROJECT:     ReactOS API Tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     UDP send throughput through the network adapter
+ */
+
+#include <apitest.h>
+#include <winsock2.h>
+#include <iphlpapi.h>
+
+/* Run it on qemu with e.g. -nic user,model=e1000
+   The datagrams go to the discard port of the default gateway */
+
+#define TEST_PORT           9
+#define TEST_SEND_TOTAL     (32 * 1024 * 1024)
+
+static
+BOOL
+GetGatewayAddress(PIP_ADAPTER_INFO *AdapterInfo, PIP_ADAPTER_INFO *Adapter)
+{
+    PIP_ADAPTER_INFO Info, Current;
+    ULONG Size = 0;
+
+    if (GetAdaptersInfo(NULL, &Size) != ERROR_BUFFER_OVERFLOW)
+        return FALSE;
+
+    Info = HeapAlloc(GetProcessHeap(), 0, Size);
+    if (!Info)
+        return FALSE;
+
+    if (GetAdaptersInfo(Info, &Size) != NO_ERROR)
+    {
+        HeapFree(GetProcessHeap(), 0, Info);
+        return FALSE;
+    }
+
+    for (Current = Info; Current; Current = Current->Next)
+    {
+        if (Current->Type == MIB_IF_TYPE_ETHERNET &&
+            inet_addr(Current->GatewayList.IpAddress.String) != INADDR_ANY &&
+            inet_addr(Current->GatewayList.IpAddress.String) != INADDR_NONE)
+        {
+            *AdapterInfo = Info;
+            *Adapter = Current;
+            return TRUE;
+        }
+    }
+
+    HeapFree(GetProcessHeap(), 0, Info);
+    return FALSE;
+}
+
+static
+void
+Test_Send(PIP_ADAPTER_INFO Adapter, ULONG DatagramSize)
+{
+    LARGE_INTEGER Frequency, Start, End;
+    ULONGLONG Elapsed, Total = 0;
+    ULONG Datagrams = 0, Failed = 0;
+    struct sockaddr_in Address;
+    SOCKET Socket;
+    PCHAR Buffer;
+
+    Buffer = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, DatagramSize);
+    ok(Buffer != NULL, "HeapAlloc failed\n");
+    if (!Buffer)
+        return;
+
+    Socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    ok(Socket != INVALID_SOCKET, "socket failed with %d\n", WSAGetLastError());
+    if (Socket == INVALID_SOCKET)
+    {
+        HeapFree(GetProcessHeap(), 0, Buffer);
+        return;
+    }
+
+    ZeroMemory(&Address, sizeof(Address));
+    Address.sin_family = AF_INET;
+    Address.sin_port = htons(TEST_PORT);
+    Address.sin_addr.s_addr = inet_addr(Adapter->GatewayList.IpAddress.String);
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    while (Total < TEST_SEND_TOTAL)
+    {
+        if (sendto(Socket, Buffer, DatagramSize, 0, (struct sockaddr *)&Address, sizeof(Address)) != DatagramSize)
+        {
+            Failed++;
+            if (Failed > 100)
+                break;
+            continue;
+        }
+
+        Datagrams++;
+        Total += DatagramSize;
+    }
+    QueryPerformanceCounter(&End);
+
+    closesocket(Socket);
+    HeapFree(GetProcessHeap(), 0, Buffer);
+
+    ok(Failed <= 100, "sendto failed %lu times, last error %d\n", Failed, WSAGetLastError());
+    ok(Datagrams > 0, "Nothing was sent\n");
+    if (!Datagrams)
+        return;
+
+    Elapsed = (End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart;
+    trace("%s, %lu byte datagrams: %lu sent in %I64u us, %I64u datagrams/s, %I64u KB/s\n",
+          Adapter->Description,
+          DatagramSize,
+          Datagrams,
+          Elapsed,
+          Elapsed ? (ULONGLONG)Datagrams * 1000000 / Elapsed : 0,
+          Elapsed ? Total * 1000000 / 1024 / Elapsed : 0);
+}
+
+START_TEST(SendThroughput)
+{
+    /* Minimum sized frames, a bit of everything, and full frames */
+    static const ULONG DatagramSizes[] = { 18, 512, 1472 };
+    PIP_ADAPTER_INFO AdapterInfo, Adapter;
+    WSADATA WsaData;
+    ULONG i;
+
+    ok(WSAStartup(MAKEWORD(2, 2), &WsaData) == 0, "WSAStartup failed\n");
+
+    if (!GetGatewayAddress(&AdapterInfo, &Adapter))
+    {
+        skip("No ethernet adapter with a default gateway found\n");
+        WSACleanup();
+        return;
+    }
+
+    for (i = 0; i < RTL_NUMBER_OF(DatagramSizes); i++)
+        Test_Send(Adapter, DatagramSizes[i]);
+
+    HeapFree(GetProcessHeap(), 0, AdapterInfo);
+    WSACleanup();
+}
@@ -0,0 +1,10 @@
+#define STANDALONE
+#include <apitest.h>
+
+extern void func_SendThroughput(void);
+
+const struct test winetest_testlist[] =
+{
+    { "SendThroughput", func_SendThroughput },
+    { 0, 0 }
+};
@@ -0,0 +1,188 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Throughput and results of batched drawing primitives
+ */
+
+#include "precomp.h"
+
+/* Every primitive is drawn PRIMITIVE_LOOPS times, once with the default
+   batch limit and once with batching disabled by a limit of 1. */
+#define PRIMITIVE_LOOPS 20000
+#define BITMAP_SIZE     256
+
+static LARGE_INTEGER Frequency;
+static HDC hdcTest;
+
+typedef VOID (*PDRAW_FUNC)(ULONG i);
+
+static VOID DrawPixel(ULONG i)
+{
+    SetPixelV(hdcTest, i % BITMAP_SIZE, (i / BITMAP_SIZE) % BITMAP_SIZE, RGB(i, 0, 0));
+}
+
+static VOID DrawPolyline(ULONG i)
+{
+    if ((i % 64) == 0)
+        MoveToEx(hdcTest, 0, 0, NULL);
+    LineTo(hdcTest, (i * 7) % BITMAP_SIZE, (i * 13) % BITMAP_SIZE);
+}
+
+static VOID DrawSegment(ULONG i)
+{
+    MoveToEx(hdcTest, i % BITMAP_SIZE, 0, NULL);
+    LineTo(hdcTest, BITMAP_SIZE - 1 - (i % BITMAP_SIZE), BITMAP_SIZE - 1);
+}
+
+static VOID DrawRectangle(ULONG i)
+{
+    Rectangle(hdcTest, i % 128, i % 64, 128 + (i % 128), 64 + (i % 64));
+}
+
+static VOID DrawFillRect(ULONG i)
+{
+    RECT rc;
+
+    SetRect(&rc, i % 128, i % 64, 128 + (i % 128), 64 + (i % 64));
+    FillRect(hdcTest, &rc, GetStockObject((i & 1) ? BLACK_BRUSH : WHITE_BRUSH));
+}
+
+static VOID DrawBitBlt(ULONG i)
+{
+    BitBlt(hdcTest, i % 128, 128, 64, 64, hdcTest, 0, i % 128, SRCCOPY);
+}
+
+static
+ULONG
+PrimitivesPerSecond(
+    _In_ PDRAW_FUNC pfnDraw)
+{
+    LARGE_INTEGER Start, End;
+    ULONG i;
+
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < PRIMITIVE_LOOPS; i++)
+    {
+        pfnDraw(i);
+    }
+    GdiFlush();
+    QueryPerformanceCounter(&End);
+
+    if (End.QuadPart == Start.QuadPart)
+        return 0;
+    return (ULONG)(PRIMITIVE_LOOPS * Frequency.QuadPart / (End.QuadPart - Start.QuadPart));
+}
+
+static
+VOID
+Test_Throughput(
+    _In_ PDRAW_FUNC pfnDraw,
+    _In_ PCSTR pszName)
+{
+    ULONG ulBatched, ulUnbatched;
+    DWORD dwLimit;
+
+    dwLimit = GdiGetBatchLimit();
+    ulBatched = PrimitivesPerSecond(pfnDraw);
+
+    GdiSetBatchLimit(1);
+    ulUnbatched = PrimitivesPerSecond(pfnDraw);
+    GdiSetBatchLimit(dwLimit);
+
+    trace("%s: %lu per second batched (limit %lu), %lu per second with a limit of 1\n",
+          pszName, ulBatched, dwLimit, ulUnbatched);
+}
+
+static
+VOID
+Test_Results(VOID)
+{
+    POINT pt;
+    HPEN hpen, hpenOld;
+    HBRUSH hbr, hbrOld;
+    ULONG x, cErrors;
+
+    PatBlt(hdcTest, 0, 0, BITMAP_SIZE, BITMAP_SIZE, WHITENESS);
+
+    /* A run of pixels in one batch entry, with changing colors */
+    for (x = 0; x < 64; x++)
+        SetPixelV(hdcTest, x, 0, (x & 1) ? RGB(0, 0, 0) : RGB(255, 0, 0));
+    cErrors = 0;
+    for (x = 0; x < 64; x++)
+    {
+        if (GetPixel(hdcTest, x, 0) != ((x & 1) ? RGB(0, 0, 0) : RGB(255, 0, 0)))
+            cErrors++;
+    }
+    ok(cErrors == 0, "%lu pixels differ\n", cErrors);
+
+    /* A polyline with a pen change in the middle, the position must move */
+    hpen = CreatePen(PS_SOLID, 1, RGB(0, 0, 255));
+    MoveToEx(hdcTest, 0, 10, NULL);
+    LineTo(hdcTest, 20, 10);
+    hpenOld = SelectObject(hdcTest, hpen);
+    LineTo(hdcTest, 40, 10);
+    ok(MoveToEx(hdcTest, 0, 0, &pt), "MoveToEx failed\n");
+    ok(pt.x == 40 && pt.y == 10, "Current position is (%ld, %ld)\n", pt.x, pt.y);
+    SelectObject(hdcTest, hpenOld);
+    ok_long(GetPixel(hdcTest, 10, 10), RGB(0, 0, 0));
+    ok_long(GetPixel(hdcTest, 30, 10), RGB(0, 0, 255));
+    ok_long(GetPixel(hdcTest, 40, 10), RGB(255, 255, 255));
+
+    /* The kernel must not move the position of user mode when flushing */
+    MoveToEx(hdcTest, 0, 12, NULL);
+    LineTo(hdcTest, 10, 12);
+    MoveToEx(hdcTest, 50, 50, NULL);
+    GdiFlush();
+    ok(MoveToEx(hdcTest, 0, 0, &pt), "MoveToEx failed\n");
+    ok(pt.x == 50 && pt.y == 50, "Current position is (%ld, %ld)\n", pt.x, pt.y);
+
+    /* A rectangle with the brush selected at the time of the call */
+    hbr = CreateSolidBrush(RGB(0, 255, 0));
+    hbrOld = SelectObject(hdcTest, hbr);
+    Rectangle(hdcTest, 100, 100, 120, 120);
+    SelectObject(hdcTest, hbrOld);
+    Rectangle(hdcTest, 130, 100, 150, 120);
+    ok_long(GetPixel(hdcTest, 100, 100), RGB(0, 0, 0));
+    ok_long(GetPixel(hdcTest, 110, 110), RGB(0, 255, 0));
+    ok_long(GetPixel(hdcTest, 140, 110), RGB(255, 255, 255));
+
+    /* A blit inside of the DC reads what the batch drew before it */
+    SetPixelV(hdcTest, 200, 200, RGB(0, 0, 255));
+    BitBlt(hdcTest, 210, 200, 1, 1, hdcTest, 200, 200, SRCCOPY);
+    ok_long(GetPixel(hdcTest, 210, 200), RGB(0, 0, 255));
+
+    DeleteObject(hbr);
+    DeleteObject(hpen);
+}
+
+START_TEST(BatchBenchmark)
+{
+    HDC hdcScreen;
+    HBITMAP hbmp, hbmpOld;
+
+    QueryPerformanceFrequency(&Frequency);
+
+    /* Drawing to DIB sections is not batched, use a compatible bitmap */
+    hdcScreen = GetDC(NULL);
+    hdcTest = CreateCompatibleDC(hdcScreen);
+    hbmp = CreateCompatibleBitmap(hdcScreen, BITMAP_SIZE, BITMAP_SIZE);
+    ReleaseDC(NULL, hdcScreen);
+    ok(hdcTest != NULL, "Failed to create a DC\n");
+    ok(hbmp != NULL, "Failed to create a bitmap\n");
+    if (!hdcTest || !hbmp)
+        return;
+    hbmpOld = SelectObject(hdcTest, hbmp);
+
+    Test_Results();
+
+    Test_Throughput(DrawPixel, "SetPixelV");
+    Test_Throughput(DrawPolyline, "LineTo polyline");
+    Test_Throughput(DrawSegment, "MoveToEx/LineTo");
+    Test_Throughput(DrawRectangle, "Rectangle");
+    Test_Throughput(DrawFillRect, "FillRect");
+    Test_Throughput(DrawBitBlt, "BitBlt");
+
+    SelectObject(hdcTest, hbmpOld);
+    DeleteObject(hbmp);
+    DeleteDC(hdcTest);
+}
@@ -0,0 +1,261 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Timing and consistency of region operations on large rect sets
+ */
+
+#include "precomp.h"
+
+/* The regions are grids of GRID_SIZE x GRID_SIZE rects of RECT_SIZE pixels
+   with a distance of CELL_SIZE pixels. The second grid is moved by GRID_SHIFT
+   pixels in both directions, so every rect overlaps 4 rects of the other one. */
+#define GRID_SIZE   64
+#define CELL_SIZE   8
+#define RECT_SIZE   6
+#define GRID_SHIFT  3
+#define GRID_EXTENT (GRID_SIZE * CELL_SIZE + GRID_SHIFT + CELL_SIZE)
+
+#define OPERATION_LOOPS 100
+#define QUERY_LOOPS     100000
+
+static LARGE_INTEGER Frequency;
+
+static
+ULONG
+ElapsedMicroseconds(
+    _In_ PLARGE_INTEGER Start)
+{
+    LARGE_INTEGER End;
+
+    QueryPerformanceCounter(&End);
+    return (ULONG)((End.QuadPart - Start->QuadPart) * 1000000 / Frequency.QuadPart);
+}
+
+static
+BOOL
+IsInGrid(INT x, INT y, INT Shift)
+{
+    x -= Shift;
+    y -= Shift;
+    if ((x < 0) || (y < 0) || (x >= GRID_SIZE * CELL_SIZE) || (y >= GRID_SIZE * CELL_SIZE))
+        return FALSE;
+
+    return ((x % CELL_SIZE) < RECT_SIZE) && ((y % CELL_SIZE) < RECT_SIZE);
+}
+
+static
+BOOL
+IsInResult(INT x, INT y, INT iMode)
+{
+    BOOL InFirst = IsInGrid(x, y, 0);
+    BOOL InSecond = IsInGrid(x, y, GRID_SHIFT);
+
+    switch (iMode)
+    {
+        case RGN_AND: return InFirst && InSecond;
+        case RGN_OR: return InFirst || InSecond;
+        case RGN_DIFF: return InFirst && !InSecond;
+        default: return FALSE;
+    }
+}
+
+static
+HRGN
+CreateGridRgn(INT Shift)
+{
+    PRGNDATA RgnData;
+    PRECT Rects;
+    HRGN hrgn;
+    ULONG x, y, i;
+
+    RgnData = HeapAlloc(GetProcessHeap(), 0,
+                        sizeof(RGNDATAHEADER) + GRID_SIZE * GRID_SIZE * sizeof(RECT));
+    if (RgnData == NULL)
+        return NULL;
+
+    Rects = (PRECT)RgnData->Buffer;
+    for (y = 0, i = 0; y < GRID_SIZE; y++)
+    {
+        for (x = 0; x < GRID_SIZE; x++, i++)
+        {
+            SetRect(&Rects[i],
+                    x * CELL_SIZE + Shift,
+                    y * CELL_SIZE + Shift,
+                    x * CELL_SIZE + Shift + RECT_SIZE,
+                    y * CELL_SIZE + Shift + RECT_SIZE);
+        }
+    }
+
+    RgnData->rdh.dwSize = sizeof(RGNDATAHEADER);
+    RgnData->rdh.iType = RDH_RECTANGLES;
+    RgnData->rdh.nCount = GRID_SIZE * GRID_SIZE;
+    RgnData->rdh.nRgnSize = 0;
+    SetRect(&RgnData->rdh.rcBound,
+            Shift,
+            Shift,
+            (GRID_SIZE - 1) * CELL_SIZE + Shift + RECT_SIZE,
+            (GRID_SIZE - 1) * CELL_SIZE + Shift + RECT_SIZE);
+
+    hrgn = ExtCreateRegion(NULL,
+                           sizeof(RGNDATAHEADER) + GRID_SIZE * GRID_SIZE * sizeof(RECT),
+                           RgnData);
+    HeapFree(GetProcessHeap(), 0, RgnData);
+    return hrgn;
+}
+
+static
+VOID
+Test_IncrementalUnion(VOID)
+{
+    LARGE_INTEGER Start;
+    HRGN hrgn, hrgnRect, hrgnGrid;
+    ULONG x, y;
+
+    hrgn = CreateRectRgn(0, 0, 0, 0);
+    hrgnRect = CreateRectRgn(0, 0, 0, 0);
+
+    QueryPerformanceCounter(&Start);
+    for (y = 0; y < GRID_SIZE; y++)
+    {
+        for (x = 0; x < GRID_SIZE; x++)
+        {
+            SetRectRgn(hrgnRect,
+                       x * CELL_SIZE,
+                       y * CELL_SIZE,
+                       x * CELL_SIZE + RECT_SIZE,
+                       y * CELL_SIZE + RECT_SIZE);
+            CombineRgn(hrgn, hrgn, hrgnRect, RGN_OR);
+        }
+    }
+    trace("Union of %u single rects: %lu us\n",
+          GRID_SIZE * GRID_SIZE, ElapsedMicroseconds(&Start));
+
+    hrgnGrid = CreateGridRgn(0);
+    ok(EqualRgn(hrgn, hrgnGrid), "Incremental union differs from the grid region\n");
+
+    DeleteObject(hrgnGrid);
+    DeleteObject(hrgnRect);
+    DeleteObject(hrgn);
+}
+
+static
+VOID
+Test_Operation(
+    _In_ HRGN hrgn1,
+    _In_ HRGN hrgn2,
+    _In_ INT iMode,
+    _In_ PCSTR pszMode)
+{
+    LARGE_INTEGER Start;
+    HRGN hrgnResult;
+    ULONG i, cErrors, ulMicroseconds, cRects;
+    INT x, y;
+    RECT rc;
+
+    hrgnResult = CreateRectRgn(0, 0, 0, 0);
+
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < OPERATION_LOOPS; i++)
+    {
+        CombineRgn(hrgnResult, hrgn1, hrgn2, iMode);
+    }
+    ulMicroseconds = ElapsedMicroseconds(&Start);
+
+    cRects = (GetRegionData(hrgnResult, 0, NULL) - sizeof(RGNDATAHEADER)) / sizeof(RECT);
+    trace("%s of %u x %u rects: %lu us per operation, %lu rects\n",
+          pszMode, GRID_SIZE * GRID_SIZE, GRID_SIZE * GRID_SIZE,
+          ulMicroseconds / OPERATION_LOOPS, cRects);
+
+    /* Compare every point of the first few rows and columns of cells */
+    cErrors = 0;
+    for (y = -1; y < 4 * CELL_SIZE; y++)
+    {
+        for (x = -1; x < GRID_EXTENT; x++)
+        {
+            if (PtInRegion(hrgnResult, x, y) != IsInResult(x, y, iMode))
+                cErrors++;
+            if (PtInRegion(hrgnResult, y, x) != IsInResult(y, x, iMode))
+                cErrors++;
+        }
+    }
+    ok(cErrors == 0, "%s: %lu points differ\n", pszMode, cErrors);
+
+    /* A 1x1 rect must give the same result as the point */
+    cErrors = 0;
+    for (y = GRID_EXTENT - 4 * CELL_SIZE; y < GRID_EXTENT; y++)
+    {
+        for (x = 0; x < GRID_EXTENT; x++)
+        {
+            SetRect(&rc, x, y, x + 1, y + 1);
+            if (RectInRegion(hrgnResult, &rc) != IsInResult(x, y, iMode))
+                cErrors++;
+        }
+    }
+    ok(cErrors == 0, "%s: %lu rects differ\n", pszMode, cErrors);
+
+    DeleteObject(hrgnResult);
+}
+
+static
+VOID
+Test_Queries(
+    _In_ HRGN hrgn)
+{
+    LARGE_INTEGER Start;
+    ULONG i, cHits;
+    RECT rc;
+
+    cHits = 0;
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < QUERY_LOOPS; i++)
+    {
+        if (PtInRegion(hrgn, (i * 7) % GRID_EXTENT, (i * 13) % GRID_EXTENT))
+            cHits++;
+    }
+    trace("PtInRegion on %u rects: %lu ns per call, %lu hits\n",
+          GRID_SIZE * GRID_SIZE, ElapsedMicroseconds(&Start) / (QUERY_LOOPS / 1000), cHits);
+
+    cHits = 0;
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < QUERY_LOOPS; i++)
+    {
+        SetRect(&rc, (i * 7) % GRID_EXTENT, (i * 13) % GRID_EXTENT, 0, 0);
+        rc.right = rc.left + 2;
+        rc.bottom = rc.top + 2;
+        if (RectInRegion(hrgn, &rc))
+            cHits++;
+    }
+    trace("RectInRegion on %u rects: %lu ns per call, %lu hits\n",
+          GRID_SIZE * GRID_SIZE, ElapsedMicroseconds(&Start) / (QUERY_LOOPS / 1000), cHits);
+
+    /* A rect between the cells doesn't touch the region, a larger one does */
+    SetRect(&rc, RECT_SIZE, RECT_SIZE, CELL_SIZE, CELL_SIZE);
+    ok(!RectInRegion(hrgn, &rc), "Rect in the gap hits the region\n");
+    SetRect(&rc, RECT_SIZE, RECT_SIZE, CELL_SIZE + 1, CELL_SIZE + 1);
+    ok(RectInRegion(hrgn, &rc), "Rect across the gap misses the region\n");
+    SetRect(&rc, CELL_SIZE + 1, CELL_SIZE + 1, RECT_SIZE, RECT_SIZE);
+    ok(RectInRegion(hrgn, &rc), "Unordered rect misses the region\n");
+}
+
+START_TEST(RegionBenchmark)
+{
+    HRGN hrgn1, hrgn2;
+
+    QueryPerformanceFrequency(&Frequency);
+
+    hrgn1 = CreateGridRgn(0);
+    hrgn2 = CreateGridRgn(GRID_SHIFT);
+    ok(hrgn1 != NULL, "Failed to create the first region\n");
+    ok(hrgn2 != NULL, "Failed to create the second region\n");
+    if (!hrgn1 || !hrgn2)
+        return;
+
+    Test_IncrementalUnion();
+    Test_Operation(hrgn1, hrgn2, RGN_OR, "RGN_OR");
+    Test_Operation(hrgn1, hrgn2, RGN_DIFF, "RGN_DIFF");
+    Test_Operation(hrgn1, hrgn2, RGN_AND, "RGN_AND");
+    Test_Queries(hrgn1);
+
+    DeleteObject(hrgn2);
+    DeleteObject(hrgn1);
+}
@@ -6,6 +6,7 @@
 extern void func_AddFontMemResourceEx(void);
 extern void func_AddFontResource(void);
 extern void func_AddFontResourceEx(void);
+extern void func_BatchBenchmark(void);
 extern void func_BeginPath(void);
 extern void func_CombineRgn(void);
 extern void func_CombineTransform(void);
@@ -64,6 +65,7 @@ extern void func_PaintRgn(void);
 extern void func_PatBlt(void);
 extern void func_Rectangle(void);
 extern void func_RealizePalette(void);
+extern void func_RegionBenchmark(void);
 extern void func_SelectObject(void);
 extern void func_SetBoundsRect(void);
 extern void func_SetBrushOrgEx(void);
@@ -84,6 +86,7 @@ const struct test winetest_testlist[] =
     { "AddFontMemResourceEx", func_AddFontMemResourceEx },
     { "AddFontResource", func_AddFontResource },
     { "AddFontResourceEx", func_AddFontResourceEx },
+    { "BatchBenchmark", func_BatchBenchmark },
     { "BeginPath", func_BeginPath },
     { "CombineRgn", func_CombineRgn },
     { "CombineTransform", func_CombineTransform },
@@ -142,6 +145,7 @@ const struct test winetest_testlist[] =
     { "PatBlt", func_PatBlt },
     { "Rectangle", func_Rectangle },
     { "RealizePalette", func_RealizePalette },
+    { "RegionBenchmark", func_RegionBenchmark },
     { "SelectObject", func_SelectObject },
     { "SetBoundsRect", func_SetBoundsRect },
     { "SetBrushOrgEx", func_SetBrushOrgEx },
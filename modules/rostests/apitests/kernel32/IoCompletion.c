@@ -0,0 +1,431 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Tests for GetQueuedCompletionStatusEx and completion notification modes
+ */
+
+#include "precomp.h"
+
+#ifndef FILE_SKIP_COMPLETION_PORT_ON_SUCCESS
+#define FILE_SKIP_COMPLETION_PORT_ON_SUCCESS 0x1
+#define FILE_SKIP_SET_EVENT_ON_HANDLE        0x2
+#endif
+
+/* The echo server serves ECHO_PIPES clients for ECHO_ROUNDS rounds, in every
+   round each client sends a message and reads it back. */
+#define ECHO_PIPES      16
+#define ECHO_ROUNDS     500
+#define MESSAGE_SIZE    64
+#define BATCH_ENTRIES   64
+#define POSTED_PACKETS  100
+
+static BOOL (WINAPI *pGetQueuedCompletionStatusEx)(HANDLE, LPOVERLAPPED_ENTRY, ULONG, PULONG, DWORD, BOOL);
+static BOOL (WINAPI *pSetFileCompletionNotificationModes)(HANDLE, UCHAR);
+
+static LARGE_INTEGER Frequency;
+static ULONG PipeNumber;
+static LONG ApcCount;
+
+typedef struct _ECHO_PIPE
+{
+    HANDLE hServer;
+    HANDLE hClient;
+    OVERLAPPED ReadOverlapped;
+    OVERLAPPED WriteOverlapped;
+    UCHAR Buffer[MESSAGE_SIZE];
+} ECHO_PIPE, *PECHO_PIPE;
+
+static ECHO_PIPE Pipes[ECHO_PIPES];
+
+static
+BOOL
+CreatePipePair(
+    _Out_ PHANDLE phServer,
+    _Out_ PHANDLE phClient)
+{
+    WCHAR PipeName[MAX_PATH];
+
+    StringCbPrintfW(PipeName, sizeof(PipeName), L"\\\\.\\pipe\\iocomp_%lu_%lu",
+                    GetCurrentProcessId(), PipeNumber++);
+
+    *phServer = CreateNamedPipeW(PipeName, PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED,
+                                 PIPE_TYPE_BYTE | PIPE_WAIT, 1, 4096, 4096, 0, NULL);
+    if (*phServer == INVALID_HANDLE_VALUE)
+        return FALSE;
+
+    *phClient = CreateFileW(PipeName, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+    if (*phClient == INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(*phServer);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static
+VOID
+WINAPI
+ApcRoutine(
+    _In_ ULONG_PTR Parameter)
+{
+    InterlockedIncrement(&ApcCount);
+}
+
+static
+VOID
+Test_Batch(VOID)
+{
+    OVERLAPPED_ENTRY Entries[BATCH_ENTRIES];
+    HANDLE hPort;
+    ULONG ulRemoved, ulTotal, ulCalls, i, cErrors;
+    BOOL Result;
+
+    hPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+    ok(hPort != NULL, "CreateIoCompletionPort failed, error %lu\n", GetLastError());
+    if (!hPort)
+        return;
+
+    /* Nothing queued */
+    SetLastError(0xdeadbeef);
+    ulRemoved = 0xdeadbeef;
+    Result = pGetQueuedCompletionStatusEx(hPort, Entries, BATCH_ENTRIES, &ulRemoved, 0, FALSE);
+    ok(!Result, "GetQueuedCompletionStatusEx succeeded\n");
+    ok_err(WAIT_TIMEOUT);
+    ok_long(ulRemoved, 0);
+
+    for (i = 0; i < POSTED_PACKETS; i++)
+    {
+        PostQueuedCompletionStatus(hPort, i * 2, i, (LPOVERLAPPED)(ULONG_PTR)(i + 1));
+    }
+
+    /* The packets must come back in order, several of them per call */
+    ulTotal = 0;
+    ulCalls = 0;
+    cErrors = 0;
+    while (ulTotal < POSTED_PACKETS)
+    {
+        Result = pGetQueuedCompletionStatusEx(hPort, Entries, 40, &ulRemoved, 0, FALSE);
+        ok(Result, "GetQueuedCompletionStatusEx failed, error %lu\n", GetLastError());
+        if (!Result)
+            break;
+        ok(ulRemoved >= 1 && ulRemoved <= 40, "Removed %lu entries\n", ulRemoved);
+
+        for (i = 0; i < ulRemoved; i++, ulTotal++)
+        {
+            if ((Entries[i].lpCompletionKey != ulTotal) ||
+                (Entries[i].lpOverlapped != (LPOVERLAPPED)(ULONG_PTR)(ulTotal + 1)) ||
+                (Entries[i].dwNumberOfBytesTransferred != ulTotal * 2) ||
+                (Entries[i].Internal != 0))
+            {
+                cErrors++;
+            }
+        }
+        ulCalls++;
+    }
+    ok_long(ulTotal, POSTED_PACKETS);
+    ok(cErrors == 0, "%lu entries differ\n", cErrors);
+    ok(ulCalls < POSTED_PACKETS, "%lu calls for %u packets\n", ulCalls, POSTED_PACKETS);
+
+    /* A zero count is invalid */
+    PostQueuedCompletionStatus(hPort, 0, 0, NULL);
+    SetLastError(0xdeadbeef);
+    Result = pGetQueuedCompletionStatusEx(hPort, Entries, 0, &ulRemoved, 0, FALSE);
+    ok(!Result, "GetQueuedCompletionStatusEx succeeded\n");
+    ok_err(ERROR_INVALID_PARAMETER);
+
+    /* The packet is still there */
+    Result = pGetQueuedCompletionStatusEx(hPort, Entries, BATCH_ENTRIES, &ulRemoved, 0, FALSE);
+    ok(Result, "GetQueuedCompletionStatusEx failed, error %lu\n", GetLastError());
+    ok_long(ulRemoved, 1);
+
+    CloseHandle(hPort);
+}
+
+static
+VOID
+Test_Alertable(VOID)
+{
+    OVERLAPPED_ENTRY Entry;
+    HANDLE hPort;
+    ULONG ulRemoved;
+    BOOL Result;
+
+    hPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+    ok(hPort != NULL, "CreateIoCompletionPort failed, error %lu\n", GetLastError());
+    if (!hPort)
+        return;
+
+    ApcCount = 0;
+    ok(QueueUserAPC(ApcRoutine, GetCurrentThread(), 0), "QueueUserAPC failed\n");
+
+    /* A non alertable wait doesn't run the APC */
+    SetLastError(0xdeadbeef);
+    Result = pGetQueuedCompletionStatusEx(hPort, &Entry, 1, &ulRemoved, 10, FALSE);
+    ok(!Result, "GetQueuedCompletionStatusEx succeeded\n");
+    ok_err(WAIT_TIMEOUT);
+    ok_long(ApcCount, 0);
+
+    /* An alertable one returns after running it */
+    SetLastError(0xdeadbeef);
+    Result = pGetQueuedCompletionStatusEx(hPort, &Entry, 1, &ulRemoved, INFINITE, TRUE);
+    ok(!Result, "GetQueuedCompletionStatusEx succeeded\n");
+    ok_err(WAIT_IO_COMPLETION);
+    ok_long(ulRemoved, 0);
+    ok_long(ApcCount, 1);
+
+    CloseHandle(hPort);
+}
+
+static
+VOID
+Test_SkipOnSuccess(
+    _In_ BOOL Skip)
+{
+    OVERLAPPED Overlapped, *pOverlapped;
+    HANDLE hPort, hServer, hClient;
+    UCHAR Buffer[4] = { 1, 2, 3, 4 };
+    DWORD cbTransferred;
+    ULONG_PTR Key;
+    BOOL Result;
+
+    if (!CreatePipePair(&hServer, &hClient))
+    {
+        skip("Failed to create a pipe, error %lu\n", GetLastError());
+        return;
+    }
+
+    hPort = CreateIoCompletionPort(hServer, NULL, 0x1234, 1);
+    ok(hPort != NULL, "CreateIoCompletionPort failed, error %lu\n", GetLastError());
+    if (Skip)
+    {
+        Result = pSetFileCompletionNotificationModes(hServer, FILE_SKIP_COMPLETION_PORT_ON_SUCCESS |
+                                                              FILE_SKIP_SET_EVENT_ON_HANDLE);
+        ok(Result, "SetFileCompletionNotificationModes failed, error %lu\n", GetLastError());
+    }
+
+    /* With data in the pipe the read completes right away */
+    ok(WriteFile(hClient, Buffer, sizeof(Buffer), &cbTransferred, NULL), "WriteFile failed\n");
+    ZeroMemory(&Overlapped, sizeof(Overlapped));
+    Result = ReadFile(hServer, Buffer, sizeof(Buffer), NULL, &Overlapped);
+    ok(Result, "ReadFile failed, error %lu\n", GetLastError());
+
+    /* Only queued if the mode isn't set */
+    SetLastError(0xdeadbeef);
+    pOverlapped = NULL;
+    Result = GetQueuedCompletionStatus(hPort, &cbTransferred, &Key, &pOverlapped, 0);
+    if (Skip)
+    {
+        ok(!Result, "GetQueuedCompletionStatus succeeded\n");
+        ok_err(WAIT_TIMEOUT);
+    }
+    else
+    {
+        ok(Result, "GetQueuedCompletionStatus failed, error %lu\n", GetLastError());
+        ok(pOverlapped == &Overlapped, "Got overlapped %p, expected %p\n", pOverlapped, &Overlapped);
+    }
+
+    /* A read that pends is always queued */
+    ZeroMemory(&Overlapped, sizeof(Overlapped));
+    SetLastError(0xdeadbeef);
+    Result = ReadFile(hServer, Buffer, sizeof(Buffer), NULL, &Overlapped);
+    ok(!Result, "ReadFile succeeded\n");
+    ok_err(ERROR_IO_PENDING);
+    ok(WriteFile(hClient, Buffer, sizeof(Buffer), &cbTransferred, NULL), "WriteFile failed\n");
+
+    pOverlapped = NULL;
+    Result = GetQueuedCompletionStatus(hPort, &cbTransferred, &Key, &pOverlapped, 1000);
+    ok(Result, "GetQueuedCompletionStatus failed, error %lu\n", GetLastError());
+    ok(pOverlapped == &Overlapped, "Got overlapped %p, expected %p\n", pOverlapped, &Overlapped);
+    ok_long(cbTransferred, sizeof(Buffer));
+    ok(Key == 0x1234, "Got key %lx\n", (ULONG)Key);
+
+    CloseHandle(hClient);
+    CloseHandle(hServer);
+    CloseHandle(hPort);
+}
+
+static
+BOOL
+StartRead(
+    _In_ PECHO_PIPE Pipe)
+{
+    ZeroMemory(&Pipe->ReadOverlapped, sizeof(Pipe->ReadOverlapped));
+    return ReadFile(Pipe->hServer, Pipe->Buffer, MESSAGE_SIZE, NULL, &Pipe->ReadOverlapped) ||
+           (GetLastError() == ERROR_IO_PENDING);
+}
+
+static
+BOOL
+HandleCompletion(
+    _In_ ULONG_PTR Key,
+    _In_ LPOVERLAPPED Overlapped,
+    _In_ DWORD cbTransferred)
+{
+    PECHO_PIPE Pipe = &Pipes[Key];
+
+    /* A write completion needs no further work */
+    if (Overlapped == &Pipe->WriteOverlapped)
+        return cbTransferred == MESSAGE_SIZE;
+
+    /* Send the message back */
+    ZeroMemory(&Pipe->WriteOverlapped, sizeof(Pipe->WriteOverlapped));
+    return (cbTransferred == MESSAGE_SIZE) &&
+           (WriteFile(Pipe->hServer, Pipe->Buffer, MESSAGE_SIZE, NULL, &Pipe->WriteOverlapped) ||
+            (GetLastError() == ERROR_IO_PENDING));
+}
+
+static
+VOID
+Test_EchoServer(
+    _In_ HANDLE hPort,
+    _In_ BOOL UseEx)
+{
+    OVERLAPPED_ENTRY Entries[BATCH_ENTRIES];
+    LARGE_INTEGER Start, End;
+    UCHAR Message[MESSAGE_SIZE];
+    LPOVERLAPPED Overlapped;
+    ULONG Round, i, ulRemoved, ulCalls, ulCompletions, ulPending;
+    DWORD cbTransferred;
+    ULONG_PTR Key;
+    BOOL Success = TRUE;
+
+    ulCalls = 0;
+    ulCompletions = 0;
+    QueryPerformanceCounter(&Start);
+    for (Round = 0; Round < ECHO_ROUNDS; Round++)
+    {
+        /* Every client sends its message to a pending read */
+        for (i = 0; i < ECHO_PIPES; i++)
+        {
+            Success &= StartRead(&Pipes[i]);
+            FillMemory(Message, MESSAGE_SIZE, (UCHAR)(Round + i));
+            Success &= WriteFile(Pipes[i].hClient, Message, MESSAGE_SIZE, &cbTransferred, NULL);
+        }
+
+        /* Serve one read and one write completion per client */
+        ulPending = 2 * ECHO_PIPES;
+        while (Success && ulPending)
+        {
+            if (UseEx)
+            {
+                Success &= pGetQueuedCompletionStatusEx(hPort, Entries, BATCH_ENTRIES, &ulRemoved, 1000, FALSE);
+                for (i = 0; Success && (i < ulRemoved); i++)
+                {
+                    Success &= HandleCompletion(Entries[i].lpCompletionKey,
+                                                Entries[i].lpOverlapped,
+                                                Entries[i].dwNumberOfBytesTransferred);
+                }
+            }
+            else
+            {
+                Success &= GetQueuedCompletionStatus(hPort, &cbTransferred, &Key, &Overlapped, 1000);
+                Success &= HandleCompletion(Key, Overlapped, cbTransferred);
+                ulRemoved = 1;
+            }
+            ulCalls++;
+            ulCompletions += ulRemoved;
+            ulPending -= min(ulPending, ulRemoved);
+        }
+
+        /* Every client reads the echo */
+        for (i = 0; Success && (i < ECHO_PIPES); i++)
+        {
+            Success &= ReadFile(Pipes[i].hClient, Message, MESSAGE_SIZE, &cbTransferred, NULL);
+            Success &= (Message[0] == (UCHAR)(Round + i)) && (Message[MESSAGE_SIZE - 1] == (UCHAR)(Round + i));
+        }
+        if (!Success)
+            break;
+    }
+    QueryPerformanceCounter(&End);
+
+    ok(Success, "Echo failed in round %lu, error %lu\n", Round, GetLastError());
+    if (!Success)
+        return;
+
+    ok_long(ulCompletions, 2 * ECHO_PIPES * ECHO_ROUNDS);
+    if (End.QuadPart != Start.QuadPart)
+    {
+        trace("%s: %lu completions in %lu calls, %lu completions per second\n",
+              UseEx ? "GetQueuedCompletionStatusEx" : "GetQueuedCompletionStatus",
+              ulCompletions, ulCalls,
+              (ULONG)(ulCompletions * Frequency.QuadPart / (End.QuadPart - Start.QuadPart)));
+    }
+}
+
+static
+VOID
+Test_Throughput(VOID)
+{
+    HANDLE hPort;
+    ULONG i, cPipes;
+
+    hPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+    ok(hPort != NULL, "CreateIoCompletionPort failed, error %lu\n", GetLastError());
+    if (!hPort)
+        return;
+
+    for (cPipes = 0; cPipes < ECHO_PIPES; cPipes++)
+    {
+        if (!CreatePipePair(&Pipes[cPipes].hServer, &Pipes[cPipes].hClient))
+            break;
+        CreateIoCompletionPort(Pipes[cPipes].hServer, hPort, cPipes, 0);
+    }
+
+    if (cPipes == ECHO_PIPES)
+    {
+        Test_EchoServer(hPort, FALSE);
+        Test_EchoServer(hPort, TRUE);
+    }
+    else
+    {
+        skip("Failed to create pipe %lu, error %lu\n", cPipes, GetLastError());
+    }
+
+    for (i = 0; i < cPipes; i++)
+    {
+        CloseHandle(Pipes[i].hClient);
+        CloseHandle(Pipes[i].hServer);
+    }
+    CloseHandle(hPort);
+}
+
+START_TEST(IoCompletion)
+{
+    HMODULE hKernel32;
+
+    QueryPerformanceFrequency(&Frequency);
+
+    hKernel32 = GetModuleHandleW(L"kernel32.dll");
+    pSetFileCompletionNotificationModes = (PVOID)GetProcAddress(hKernel32, "SetFileCompletionNotificationModes");
+
+    /* ReactOS keeps its Vista APIs in a separate DLL */
+    pGetQueuedCompletionStatusEx = (PVOID)GetProcAddress(hKernel32, "GetQueuedCompletionStatusEx");
+    if (!pGetQueuedCompletionStatusEx)
+    {
+        hKernel32 = LoadLibraryW(L"kernel32_vista.dll");
+        if (hKernel32)
+        {
+            pGetQueuedCompletionStatusEx = (PVOID)GetProcAddress(hKernel32, "GetQueuedCompletionStatusEx");
+        }
+    }
+
+    if (pSetFileCompletionNotificationModes)
+    {
+        Test_SkipOnSuccess(FALSE);
+        Test_SkipOnSuccess(TRUE);
+    }
+    else
+    {
+        skip("SetFileCompletionNotificationModes is not available\n");
+    }
+
+    if (!pGetQueuedCompletionStatusEx)
+    {
+        skip("GetQueuedCompletionStatusEx is not available\n");
+        return;
+    }
+
+    Test_Batch();
+    Test_Alertable();
+    Test_Throughput();
+}
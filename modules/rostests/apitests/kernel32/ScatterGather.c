@@ -0,0 +1,262 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Tests and throughput of ReadFileScatter and WriteFileGather
+ */
+
+#include "precomp.h"
+
+/* The file is FILE_PAGES pages, every transfer covers CHUNK_PAGES of them */
+#define FILE_PAGES      1024
+#define CHUNK_PAGES     64
+#define THROUGHPUT_LOOPS 4
+
+static LARGE_INTEGER Frequency;
+static SYSTEM_INFO SystemInfo;
+static PUCHAR Pages;
+static FILE_SEGMENT_ELEMENT Segments[CHUNK_PAGES + 1];
+
+static
+BOOL
+WaitForTransfer(
+    _In_ HANDLE hFile,
+    _In_ LPOVERLAPPED Overlapped,
+    _In_ BOOL Result,
+    _In_ DWORD Expected)
+{
+    DWORD cbTransferred;
+
+    if (!Result && GetLastError() != ERROR_IO_PENDING)
+        return FALSE;
+    if (!GetOverlappedResult(hFile, Overlapped, &cbTransferred, TRUE))
+        return FALSE;
+    return cbTransferred == Expected;
+}
+
+static
+VOID
+SetSegments(
+    _In_ BOOL Reverse)
+{
+    ULONG i, Page;
+
+    /* Reverse order makes the pages of the transfer not contiguous */
+    for (i = 0; i < CHUNK_PAGES; i++)
+    {
+        Page = Reverse ? CHUNK_PAGES - 1 - i : i;
+        Segments[i].Alignment = (ULONG_PTR)(Pages + Page * SystemInfo.dwPageSize);
+    }
+    Segments[CHUNK_PAGES].Alignment = 0;
+}
+
+static
+VOID
+FillPage(
+    _In_ PUCHAR Page,
+    _In_ ULONG Number)
+{
+    ULONG i;
+
+    for (i = 0; i < SystemInfo.dwPageSize; i++)
+        Page[i] = (UCHAR)(Number + i / 4);
+}
+
+static
+ULONG
+CheckPage(
+    _In_ PUCHAR Page,
+    _In_ ULONG Number)
+{
+    ULONG i;
+
+    for (i = 0; i < SystemInfo.dwPageSize; i++)
+    {
+        if (Page[i] != (UCHAR)(Number + i / 4))
+            return 1;
+    }
+    return 0;
+}
+
+static
+VOID
+Test_Results(
+    _In_ HANDLE hFile)
+{
+    OVERLAPPED Overlapped;
+    ULONG Chunk, i, cErrors;
+    BOOL Result;
+
+    ZeroMemory(&Overlapped, sizeof(Overlapped));
+    Overlapped.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+
+    /* Write the file with the pages in reverse order */
+    for (Chunk = 0; Chunk < FILE_PAGES / CHUNK_PAGES; Chunk++)
+    {
+        for (i = 0; i < CHUNK_PAGES; i++)
+            FillPage(Pages + i * SystemInfo.dwPageSize, Chunk * CHUNK_PAGES + CHUNK_PAGES - 1 - i);
+        SetSegments(TRUE);
+
+        Overlapped.Offset = Chunk * CHUNK_PAGES * SystemInfo.dwPageSize;
+        Result = WriteFileGather(hFile, Segments, CHUNK_PAGES * SystemInfo.dwPageSize, NULL, &Overlapped);
+        ok(WaitForTransfer(hFile, &Overlapped, Result, CHUNK_PAGES * SystemInfo.dwPageSize),
+           "WriteFileGather of chunk %lu failed, error %lu\n", Chunk, GetLastError());
+    }
+
+    /* Read it back in file order, every page must land in its own segment */
+    cErrors = 0;
+    for (Chunk = 0; Chunk < FILE_PAGES / CHUNK_PAGES; Chunk++)
+    {
+        FillMemory(Pages, CHUNK_PAGES * SystemInfo.dwPageSize, 0xCC);
+        SetSegments(FALSE);
+
+        Overlapped.Offset = Chunk * CHUNK_PAGES * SystemInfo.dwPageSize;
+        Result = ReadFileScatter(hFile, Segments, CHUNK_PAGES * SystemInfo.dwPageSize, NULL, &Overlapped);
+        ok(WaitForTransfer(hFile, &Overlapped, Result, CHUNK_PAGES * SystemInfo.dwPageSize),
+           "ReadFileScatter of chunk %lu failed, error %lu\n", Chunk, GetLastError());
+
+        for (i = 0; i < CHUNK_PAGES; i++)
+            cErrors += CheckPage(Pages + i * SystemInfo.dwPageSize, Chunk * CHUNK_PAGES + i);
+    }
+    ok(cErrors == 0, "%lu pages differ\n", cErrors);
+
+    /* A segment that doesn't start on a page is invalid */
+    SetSegments(FALSE);
+    Segments[1].Alignment = (ULONG_PTR)(Pages + SystemInfo.dwPageSize + 512);
+    Overlapped.Offset = 0;
+    SetLastError(0xdeadbeef);
+    Result = ReadFileScatter(hFile, Segments, CHUNK_PAGES * SystemInfo.dwPageSize, NULL, &Overlapped);
+    ok(!Result, "ReadFileScatter succeeded\n");
+    ok_err(ERROR_INVALID_PARAMETER);
+
+    /* So is a length that isn't a multiple of the sector size */
+    SetSegments(FALSE);
+    SetLastError(0xdeadbeef);
+    Result = ReadFileScatter(hFile, Segments, SystemInfo.dwPageSize + 1, NULL, &Overlapped);
+    ok(!Result, "ReadFileScatter succeeded\n");
+    ok_err(ERROR_INVALID_PARAMETER);
+
+    CloseHandle(Overlapped.hEvent);
+}
+
+static
+VOID
+Test_Cached(
+    _In_ PCWSTR FileName)
+{
+    OVERLAPPED Overlapped;
+    HANDLE hFile;
+    BOOL Result;
+
+    /* Without FILE_FLAG_NO_BUFFERING the call must fail */
+    hFile = CreateFileW(FileName, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                        OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL);
+    ok(hFile != INVALID_HANDLE_VALUE, "CreateFileW failed, error %lu\n", GetLastError());
+    if (hFile == INVALID_HANDLE_VALUE)
+        return;
+
+    ZeroMemory(&Overlapped, sizeof(Overlapped));
+    SetSegments(FALSE);
+    SetLastError(0xdeadbeef);
+    Result = ReadFileScatter(hFile, Segments, SystemInfo.dwPageSize, NULL, &Overlapped);
+    ok(!Result, "ReadFileScatter succeeded\n");
+    ok_err(ERROR_INVALID_PARAMETER);
+
+    CloseHandle(hFile);
+}
+
+static
+VOID
+Test_Throughput(
+    _In_ HANDLE hFile)
+{
+    LARGE_INTEGER Start, End;
+    OVERLAPPED Overlapped;
+    ULONG Loop, Chunk, Page;
+    ULONGLONG cbTotal;
+    BOOL Result, Success = TRUE;
+
+    ZeroMemory(&Overlapped, sizeof(Overlapped));
+    Overlapped.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    cbTotal = (ULONGLONG)THROUGHPUT_LOOPS * FILE_PAGES * SystemInfo.dwPageSize;
+
+    /* One request per chunk */
+    QueryPerformanceCounter(&Start);
+    for (Loop = 0; Loop < THROUGHPUT_LOOPS; Loop++)
+    {
+        for (Chunk = 0; Chunk < FILE_PAGES / CHUNK_PAGES; Chunk++)
+        {
+            SetSegments(TRUE);
+            Overlapped.Offset = Chunk * CHUNK_PAGES * SystemInfo.dwPageSize;
+            Result = ReadFileScatter(hFile, Segments, CHUNK_PAGES * SystemInfo.dwPageSize, NULL, &Overlapped);
+            Success &= WaitForTransfer(hFile, &Overlapped, Result, CHUNK_PAGES * SystemInfo.dwPageSize);
+        }
+    }
+    QueryPerformanceCounter(&End);
+    ok(Success, "ReadFileScatter failed\n");
+    if (End.QuadPart != Start.QuadPart)
+    {
+        trace("ReadFileScatter of %u pages: %lu KB/s\n", CHUNK_PAGES,
+              (ULONG)(cbTotal * Frequency.QuadPart / (End.QuadPart - Start.QuadPart) / 1024));
+    }
+
+    /* One request per page, to the same pages */
+    Success = TRUE;
+    QueryPerformanceCounter(&Start);
+    for (Loop = 0; Loop < THROUGHPUT_LOOPS; Loop++)
+    {
+        for (Chunk = 0; Chunk < FILE_PAGES / CHUNK_PAGES; Chunk++)
+        {
+            for (Page = 0; Page < CHUNK_PAGES; Page++)
+            {
+                Overlapped.Offset = (Chunk * CHUNK_PAGES + Page) * SystemInfo.dwPageSize;
+                Result = ReadFile(hFile, Pages + (CHUNK_PAGES - 1 - Page) * SystemInfo.dwPageSize,
+                                  SystemInfo.dwPageSize, NULL, &Overlapped);
+                Success &= WaitForTransfer(hFile, &Overlapped, Result, SystemInfo.dwPageSize);
+            }
+        }
+    }
+    QueryPerformanceCounter(&End);
+    ok(Success, "ReadFile failed\n");
+    if (End.QuadPart != Start.QuadPart)
+    {
+        trace("ReadFile of single pages: %lu KB/s\n",
+              (ULONG)(cbTotal * Frequency.QuadPart / (End.QuadPart - Start.QuadPart) / 1024));
+    }
+
+    CloseHandle(Overlapped.hEvent);
+}
+
+START_TEST(ScatterGather)
+{
+    WCHAR TempPath[MAX_PATH], FileName[MAX_PATH];
+    HANDLE hFile;
+
+    QueryPerformanceFrequency(&Frequency);
+    GetSystemInfo(&SystemInfo);
+
+    GetTempPathW(_countof(TempPath), TempPath);
+    GetTempFileNameW(TempPath, L"sg", 0, FileName);
+
+    Pages = VirtualAlloc(NULL, CHUNK_PAGES * SystemInfo.dwPageSize, MEM_COMMIT, PAGE_READWRITE);
+    ok(Pages != NULL, "VirtualAlloc failed, error %lu\n", GetLastError());
+    if (!Pages)
+        return;
+
+    hFile = CreateFileW(FileName, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                        CREATE_ALWAYS, FILE_FLAG_NO_BUFFERING | FILE_FLAG_OVERLAPPED, NULL);
+    ok(hFile != INVALID_HANDLE_VALUE, "CreateFileW failed, error %lu\n", GetLastError());
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        VirtualFree(Pages, 0, MEM_RELEASE);
+        return;
+    }
+
+    Test_Results(hFile);
+    Test_Throughput(hFile);
+    CloseHandle(hFile);
+
+    Test_Cached(FileName);
+
+    DeleteFileW(FileName);
+    VirtualFree(Pages, 0, MEM_RELEASE);
+}
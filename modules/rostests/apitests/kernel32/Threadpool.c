@@ -0,0 +1,465 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Tests for the Vista thread pool
+ */
+
+#include "precomp.h"
+
+#define THROUGHPUT_ITEMS 100000
+
+typedef VOID (CALLBACK *PTEST_IO_CALLBACK)(PTP_CALLBACK_INSTANCE, PVOID, PVOID, ULONG, ULONG_PTR, PTP_IO);
+
+/* XP does not have these functions */
+static PTP_POOL (WINAPI *pCreateThreadpool)(PVOID);
+static VOID (WINAPI *pCloseThreadpool)(PTP_POOL);
+static VOID (WINAPI *pSetThreadpoolThreadMaximum)(PTP_POOL, DWORD);
+static BOOL (WINAPI *pSetThreadpoolThreadMinimum)(PTP_POOL, DWORD);
+static PTP_CLEANUP_GROUP (WINAPI *pCreateThreadpoolCleanupGroup)(VOID);
+static VOID (WINAPI *pCloseThreadpoolCleanupGroupMembers)(PTP_CLEANUP_GROUP, BOOL, PVOID);
+static VOID (WINAPI *pCloseThreadpoolCleanupGroup)(PTP_CLEANUP_GROUP);
+static BOOL (WINAPI *pTrySubmitThreadpoolCallback)(PTP_SIMPLE_CALLBACK, PVOID, PTP_CALLBACK_ENVIRON);
+static VOID (WINAPI *pSetEventWhenCallbackReturns)(PTP_CALLBACK_INSTANCE, HANDLE);
+static PTP_WORK (WINAPI *pCreateThreadpoolWork)(PTP_WORK_CALLBACK, PVOID, PTP_CALLBACK_ENVIRON);
+static VOID (WINAPI *pSubmitThreadpoolWork)(PTP_WORK);
+static VOID (WINAPI *pWaitForThreadpoolWorkCallbacks)(PTP_WORK, BOOL);
+static VOID (WINAPI *pCloseThreadpoolWork)(PTP_WORK);
+static PTP_TIMER (WINAPI *pCreateThreadpoolTimer)(PTP_TIMER_CALLBACK, PVOID, PTP_CALLBACK_ENVIRON);
+static VOID (WINAPI *pSetThreadpoolTimer)(PTP_TIMER, PFILETIME, DWORD, DWORD);
+static BOOL (WINAPI *pIsThreadpoolTimerSet)(PTP_TIMER);
+static VOID (WINAPI *pWaitForThreadpoolTimerCallbacks)(PTP_TIMER, BOOL);
+static VOID (WINAPI *pCloseThreadpoolTimer)(PTP_TIMER);
+static PTP_WAIT (WINAPI *pCreateThreadpoolWait)(PTP_WAIT_CALLBACK, PVOID, PTP_CALLBACK_ENVIRON);
+static VOID (WINAPI *pSetThreadpoolWait)(PTP_WAIT, HANDLE, PFILETIME);
+static VOID (WINAPI *pWaitForThreadpoolWaitCallbacks)(PTP_WAIT, BOOL);
+static VOID (WINAPI *pCloseThreadpoolWait)(PTP_WAIT);
+static PTP_IO (WINAPI *pCreateThreadpoolIo)(HANDLE, PTEST_IO_CALLBACK, PVOID, PTP_CALLBACK_ENVIRON);
+static VOID (WINAPI *pStartThreadpoolIo)(PTP_IO);
+static VOID (WINAPI *pWaitForThreadpoolIoCallbacks)(PTP_IO, BOOL);
+static VOID (WINAPI *pCloseThreadpoolIo)(PTP_IO);
+
+static volatile LONG WorkCount;
+static HANDLE DoneEvent;
+
+static
+BOOL
+InitFunctionPointers(VOID)
+{
+    HMODULE hKernel32;
+
+    /* ReactOS keeps its Vista APIs in a separate DLL */
+    hKernel32 = GetModuleHandleW(L"kernel32.dll");
+    if (!GetProcAddress(hKernel32, "CreateThreadpoolWork") ||
+        !GetProcAddress(hKernel32, "SubmitThreadpoolWork"))
+    {
+        hKernel32 = LoadLibraryW(L"kernel32_vista.dll");
+        if (!hKernel32) return FALSE;
+    }
+
+#define GET_PROC(Name) \
+    p##Name = (PVOID)GetProcAddress(hKernel32, #Name); \
+    if (!p##Name) return FALSE
+
+    GET_PROC(CreateThreadpool);
+    GET_PROC(CloseThreadpool);
+    GET_PROC(SetThreadpoolThreadMaximum);
+    GET_PROC(SetThreadpoolThreadMinimum);
+    GET_PROC(CreateThreadpoolCleanupGroup);
+    GET_PROC(CloseThreadpoolCleanupGroupMembers);
+    GET_PROC(CloseThreadpoolCleanupGroup);
+    GET_PROC(TrySubmitThreadpoolCallback);
+    GET_PROC(SetEventWhenCallbackReturns);
+    GET_PROC(CreateThreadpoolWork);
+    GET_PROC(SubmitThreadpoolWork);
+    GET_PROC(WaitForThreadpoolWorkCallbacks);
+    GET_PROC(CloseThreadpoolWork);
+    GET_PROC(CreateThreadpoolTimer);
+    GET_PROC(SetThreadpoolTimer);
+    GET_PROC(IsThreadpoolTimerSet);
+    GET_PROC(WaitForThreadpoolTimerCallbacks);
+    GET_PROC(CloseThreadpoolTimer);
+    GET_PROC(CreateThreadpoolWait);
+    GET_PROC(SetThreadpoolWait);
+    GET_PROC(WaitForThreadpoolWaitCallbacks);
+    GET_PROC(CloseThreadpoolWait);
+    GET_PROC(CreateThreadpoolIo);
+    GET_PROC(StartThreadpoolIo);
+    GET_PROC(WaitForThreadpoolIoCallbacks);
+    GET_PROC(CloseThreadpoolIo);
+
+#undef GET_PROC
+
+    return TRUE;
+}
+
+static
+VOID
+InitEnviron(PTP_CALLBACK_ENVIRON Environ, PTP_POOL Pool, PTP_CLEANUP_GROUP CleanupGroup)
+{
+    ZeroMemory(Environ, sizeof(*Environ));
+    Environ->Version = 1;
+    Environ->Pool = Pool;
+    Environ->CleanupGroup = CleanupGroup;
+}
+
+static
+VOID
+RelativeFileTime(PFILETIME FileTime, LONG Milliseconds)
+{
+    LARGE_INTEGER Time;
+
+    Time.QuadPart = (LONGLONG)Milliseconds * -10000;
+    FileTime->dwLowDateTime = Time.u.LowPart;
+    FileTime->dwHighDateTime = Time.u.HighPart;
+}
+
+static
+VOID
+CALLBACK
+SimpleCallback(PTP_CALLBACK_INSTANCE Instance, PVOID Context)
+{
+    InterlockedIncrement(&WorkCount);
+    pSetEventWhenCallbackReturns(Instance, Context);
+}
+
+static
+VOID
+CALLBACK
+WorkCallback(PTP_CALLBACK_INSTANCE Instance, PVOID Context, PTP_WORK Work)
+{
+    if (Context) Sleep(PtrToUlong(Context));
+    InterlockedIncrement(&WorkCount);
+}
+
+static
+VOID
+CALLBACK
+TimerCallback(PTP_CALLBACK_INSTANCE Instance, PVOID Context, PTP_TIMER Timer)
+{
+    if (InterlockedIncrement(&WorkCount) == PtrToUlong(Context)) SetEvent(DoneEvent);
+}
+
+static
+VOID
+CALLBACK
+WaitCallback(PTP_CALLBACK_INSTANCE Instance, PVOID Context, PTP_WAIT Wait, TP_WAIT_RESULT WaitResult)
+{
+    *(TP_WAIT_RESULT *)Context = WaitResult;
+    SetEvent(DoneEvent);
+}
+
+static
+VOID
+CALLBACK
+IoCallback(PTP_CALLBACK_INSTANCE Instance, PVOID Context, PVOID Overlapped, ULONG IoResult, ULONG_PTR Bytes, PTP_IO Io)
+{
+    ok(Overlapped == Context, "Overlapped = %p, expected %p\n", Overlapped, Context);
+    ok(IoResult == ERROR_SUCCESS, "IoResult = %lu\n", IoResult);
+    ok(Bytes == 4, "Bytes = %lu\n", (ULONG)Bytes);
+    SetEvent(DoneEvent);
+}
+
+static
+VOID
+Test_Work(PTP_CALLBACK_ENVIRON Environ)
+{
+    PTP_WORK Work;
+    ULONG i;
+
+    WorkCount = 0;
+    Work = pCreateThreadpoolWork(WorkCallback, NULL, Environ);
+    ok(Work != NULL, "CreateThreadpoolWork failed with %lu\n", GetLastError());
+    if (!Work) return;
+
+    for (i = 0; i < 100; i++) pSubmitThreadpoolWork(Work);
+    pWaitForThreadpoolWorkCallbacks(Work, FALSE);
+    ok(WorkCount == 100, "WorkCount = %ld\n", WorkCount);
+    pCloseThreadpoolWork(Work);
+
+    /* Cancelling drops the callbacks that haven't started yet */
+    WorkCount = 0;
+    Work = pCreateThreadpoolWork(WorkCallback, UlongToPtr(50), Environ);
+    ok(Work != NULL, "CreateThreadpoolWork failed with %lu\n", GetLastError());
+    if (!Work) return;
+
+    for (i = 0; i < 100; i++) pSubmitThreadpoolWork(Work);
+    pWaitForThreadpoolWorkCallbacks(Work, TRUE);
+    ok(WorkCount < 100, "WorkCount = %ld\n", WorkCount);
+    pCloseThreadpoolWork(Work);
+}
+
+static
+VOID
+Test_Simple(PTP_CALLBACK_ENVIRON Environ)
+{
+    BOOL Success;
+
+    WorkCount = 0;
+    Success = pTrySubmitThreadpoolCallback(SimpleCallback, DoneEvent, Environ);
+    ok(Success, "TrySubmitThreadpoolCallback failed with %lu\n", GetLastError());
+    ok(WaitForSingleObject(DoneEvent, 5000) == WAIT_OBJECT_0, "Callback didn't run\n");
+    ok(WorkCount == 1, "WorkCount = %ld\n", WorkCount);
+}
+
+static
+VOID
+Test_Timer(PTP_CALLBACK_ENVIRON Environ)
+{
+    PTP_TIMER Timer;
+    FILETIME DueTime;
+    DWORD Start, Elapsed;
+
+    WorkCount = 0;
+    Timer = pCreateThreadpoolTimer(TimerCallback, UlongToPtr(1), Environ);
+    ok(Timer != NULL, "CreateThreadpoolTimer failed with %lu\n", GetLastError());
+    if (!Timer) return;
+
+    ok(!pIsThreadpoolTimerSet(Timer), "Timer is set\n");
+
+    /* One-shot timer */
+    Start = GetTickCount();
+    RelativeFileTime(&DueTime, 200);
+    pSetThreadpoolTimer(Timer, &DueTime, 0, 0);
+    ok(pIsThreadpoolTimerSet(Timer), "Timer is not set\n");
+    ok(WaitForSingleObject(DoneEvent, 5000) == WAIT_OBJECT_0, "Timer didn't fire\n");
+    Elapsed = GetTickCount() - Start;
+    ok(Elapsed >= 150, "Timer fired after %lu ms\n", Elapsed);
+    pWaitForThreadpoolTimerCallbacks(Timer, FALSE);
+    ok(!pIsThreadpoolTimerSet(Timer), "Timer is still set\n");
+    pCloseThreadpoolTimer(Timer);
+
+    /* Periodic timer, stopped after five expirations */
+    WorkCount = 0;
+    Timer = pCreateThreadpoolTimer(TimerCallback, UlongToPtr(5), Environ);
+    ok(Timer != NULL, "CreateThreadpoolTimer failed with %lu\n", GetLastError());
+    if (!Timer) return;
+
+    RelativeFileTime(&DueTime, 50);
+    pSetThreadpoolTimer(Timer, &DueTime, 50, 0);
+    ok(WaitForSingleObject(DoneEvent, 5000) == WAIT_OBJECT_0, "Timer didn't fire\n");
+    pSetThreadpoolTimer(Timer, NULL, 0, 0);
+    ok(!pIsThreadpoolTimerSet(Timer), "Timer is still set\n");
+    pWaitForThreadpoolTimerCallbacks(Timer, TRUE);
+    ok(WorkCount >= 5, "WorkCount = %ld\n", WorkCount);
+    pCloseThreadpoolTimer(Timer);
+}
+
+static
+VOID
+Test_Wait(PTP_CALLBACK_ENVIRON Environ)
+{
+    TP_WAIT_RESULT Result;
+    PTP_WAIT Wait;
+    FILETIME Timeout;
+    HANDLE Event;
+
+    Event = CreateEventW(NULL, FALSE, FALSE, NULL);
+    Wait = pCreateThreadpoolWait(WaitCallback, &Result, Environ);
+    ok(Wait != NULL, "CreateThreadpoolWait failed with %lu\n", GetLastError());
+    if (!Wait) return;
+
+    /* Signaled handle */
+    Result = 0xdeadbeef;
+    pSetThreadpoolWait(Wait, Event, NULL);
+    ok(WaitForSingleObject(DoneEvent, 100) == WAIT_TIMEOUT, "Wait completed early\n");
+    SetEvent(Event);
+    ok(WaitForSingleObject(DoneEvent, 5000) == WAIT_OBJECT_0, "Wait didn't complete\n");
+    pWaitForThreadpoolWaitCallbacks(Wait, FALSE);
+    ok(Result == WAIT_OBJECT_0, "Result = %lu\n", Result);
+
+    /* Timeout */
+    Result = 0xdeadbeef;
+    RelativeFileTime(&Timeout, 100);
+    pSetThreadpoolWait(Wait, Event, &Timeout);
+    ok(WaitForSingleObject(DoneEvent, 5000) == WAIT_OBJECT_0, "Wait didn't time out\n");
+    pWaitForThreadpoolWaitCallbacks(Wait, FALSE);
+    ok(Result == WAIT_TIMEOUT, "Result = %lu\n", Result);
+
+    /* Cancelled wait */
+    pSetThreadpoolWait(Wait, Event, NULL);
+    pSetThreadpoolWait(Wait, NULL, NULL);
+    SetEvent(Event);
+    ok(WaitForSingleObject(DoneEvent, 200) == WAIT_TIMEOUT, "Cancelled wait completed\n");
+    pWaitForThreadpoolWaitCallbacks(Wait, TRUE);
+
+    pCloseThreadpoolWait(Wait);
+    CloseHandle(Event);
+}
+
+static
+VOID
+Test_ManyWaits(PTP_CALLBACK_ENVIRON Environ)
+{
+    PTP_WAIT Waits[200];
+    TP_WAIT_RESULT Results[200];
+    HANDLE Event;
+    ULONG i, Signaled = 0;
+
+    /* More waits than a single waiter thread can handle */
+    Event = CreateEventW(NULL, TRUE, FALSE, NULL);
+    for (i = 0; i < _countof(Waits); i++)
+    {
+        Results[i] = 0xdeadbeef;
+        Waits[i] = pCreateThreadpoolWait(WaitCallback, &Results[i], Environ);
+        ok(Waits[i] != NULL, "CreateThreadpoolWait failed with %lu\n", GetLastError());
+        if (Waits[i]) pSetThreadpoolWait(Waits[i], Event, NULL);
+    }
+
+    SetEvent(Event);
+    Sleep(1000);
+
+    for (i = 0; i < _countof(Waits); i++)
+    {
+        if (!Waits[i]) continue;
+        pWaitForThreadpoolWaitCallbacks(Waits[i], FALSE);
+        if (Results[i] == WAIT_OBJECT_0) Signaled++;
+        pCloseThreadpoolWait(Waits[i]);
+    }
+    ok(Signaled == _countof(Waits), "%lu waits completed\n", Signaled);
+    CloseHandle(Event);
+    ResetEvent(DoneEvent);
+}
+
+static
+VOID
+Test_Io(PTP_CALLBACK_ENVIRON Environ)
+{
+    WCHAR TempPath[MAX_PATH], FileName[MAX_PATH];
+    OVERLAPPED Overlapped;
+    HANDLE File;
+    PTP_IO Io;
+    DWORD Written;
+    BOOL Success;
+
+    GetTempPathW(_countof(TempPath), TempPath);
+    GetTempFileNameW(TempPath, L"tpi", 0, FileName);
+    File = CreateFileW(FileName,
+                       GENERIC_READ | GENERIC_WRITE,
+                       0,
+                       NULL,
+                       CREATE_ALWAYS,
+                       FILE_FLAG_OVERLAPPED | FILE_FLAG_DELETE_ON_CLOSE,
+                       NULL);
+    ok(File != INVALID_HANDLE_VALUE, "CreateFileW failed with %lu\n", GetLastError());
+    if (File == INVALID_HANDLE_VALUE) return;
+
+    ZeroMemory(&Overlapped, sizeof(Overlapped));
+    Io = pCreateThreadpoolIo(File, IoCallback, &Overlapped, Environ);
+    ok(Io != NULL, "CreateThreadpoolIo failed with %lu\n", GetLastError());
+    if (!Io)
+    {
+        CloseHandle(File);
+        return;
+    }
+
+    pStartThreadpoolIo(Io);
+    Success = WriteFile(File, "test", 4, &Written, &Overlapped);
+    ok(Success || GetLastError() == ERROR_IO_PENDING, "WriteFile failed with %lu\n", GetLastError());
+    ok(WaitForSingleObject(DoneEvent, 5000) == WAIT_OBJECT_0, "I/O callback didn't run\n");
+    pWaitForThreadpoolIoCallbacks(Io, FALSE);
+
+    pCloseThreadpoolIo(Io);
+    CloseHandle(File);
+}
+
+static
+VOID
+Test_CleanupGroup(PTP_POOL Pool)
+{
+    TP_CALLBACK_ENVIRON Environ;
+    PTP_CLEANUP_GROUP CleanupGroup;
+    PTP_WORK Work;
+    PTP_TIMER Timer;
+    FILETIME DueTime;
+    ULONG i;
+
+    CleanupGroup = pCreateThreadpoolCleanupGroup();
+    ok(CleanupGroup != NULL, "CreateThreadpoolCleanupGroup failed with %lu\n", GetLastError());
+    if (!CleanupGroup) return;
+    InitEnviron(&Environ, Pool, CleanupGroup);
+
+    /* Members are waited for and closed along with the group */
+    WorkCount = 0;
+    Work = pCreateThreadpoolWork(WorkCallback, NULL, &Environ);
+    ok(Work != NULL, "CreateThreadpoolWork failed with %lu\n", GetLastError());
+    for (i = 0; i < 10; i++) pSubmitThreadpoolWork(Work);
+
+    Timer = pCreateThreadpoolTimer(TimerCallback, UlongToPtr(0), &Environ);
+    ok(Timer != NULL, "CreateThreadpoolTimer failed with %lu\n", GetLastError());
+    RelativeFileTime(&DueTime, 60000);
+    pSetThreadpoolTimer(Timer, &DueTime, 0, 0);
+
+    pCloseThreadpoolCleanupGroupMembers(CleanupGroup, FALSE, NULL);
+    ok(WorkCount == 10, "WorkCount = %ld\n", WorkCount);
+    pCloseThreadpoolCleanupGroup(CleanupGroup);
+}
+
+static
+VOID
+Test_Throughput(PTP_CALLBACK_ENVIRON Environ)
+{
+    LARGE_INTEGER Frequency, Start, End;
+    PTP_WORK Work;
+    ULONG i;
+
+    /* Short work items should not cost a thread each */
+    WorkCount = 0;
+    Work = pCreateThreadpoolWork(WorkCallback, NULL, Environ);
+    ok(Work != NULL, "CreateThreadpoolWork failed with %lu\n", GetLastError());
+    if (!Work) return;
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < THROUGHPUT_ITEMS; i++) pSubmitThreadpoolWork(Work);
+    pWaitForThreadpoolWorkCallbacks(Work, FALSE);
+    QueryPerformanceCounter(&End);
+    ok(WorkCount == THROUGHPUT_ITEMS, "WorkCount = %ld\n", WorkCount);
+
+    trace("Throughput: %u work items in %I64u us\n",
+          THROUGHPUT_ITEMS,
+          (End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart);
+    pCloseThreadpoolWork(Work);
+}
+
+START_TEST(Threadpool)
+{
+    TP_CALLBACK_ENVIRON Environ;
+    PTP_POOL Pool;
+
+    if (!InitFunctionPointers())
+    {
+        skip("Thread pool API not available\n");
+        return;
+    }
+
+    DoneEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+
+    /* Default pool */
+    Test_Work(NULL);
+    Test_Simple(NULL);
+    Test_Timer(NULL);
+    Test_Wait(NULL);
+    Test_ManyWaits(NULL);
+    Test_Io(NULL);
+    Test_Throughput(NULL);
+
+    /* Private pool */
+    Pool = pCreateThreadpool(NULL);
+    ok(Pool != NULL, "CreateThreadpool failed with %lu\n", GetLastError());
+    if (Pool)
+    {
+        pSetThreadpoolThreadMaximum(Pool, 4);
+        ok(pSetThreadpoolThreadMinimum(Pool, 1), "SetThreadpoolThreadMinimum failed with %lu\n", GetLastError());
+        InitEnviron(&Environ, Pool, NULL);
+
+        Test_Work(&Environ);
+        Test_Simple(&Environ);
+        Test_Timer(&Environ);
+        Test_CleanupGroup(Pool);
+        Test_Throughput(&Environ);
+
+        pCloseThreadpool(Pool);
+    }
+
+    CloseHandle(DoneEvent);
+}
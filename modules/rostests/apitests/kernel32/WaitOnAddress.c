@@ -0,0 +1,332 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Tests for WaitOnAddress and the locks built upon it
+ */
+
+#include "precomp.h"
+
+#define PING_PONG_ROUNDS 20000
+#define LOCK_ITERATIONS 100000
+#define MAX_THREADS 8
+
+/* XP does not have these functions. SRW locks and condition variables
+   are a single pointer, so just treat them as such. */
+static BOOL (WINAPI *pWaitOnAddress)(volatile VOID *, PVOID, SIZE_T, DWORD);
+static VOID (WINAPI *pWakeByAddressSingle)(PVOID);
+static VOID (WINAPI *pWakeByAddressAll)(PVOID);
+static VOID (WINAPI *pAcquireSRWLockExclusive)(PVOID *);
+static VOID (WINAPI *pReleaseSRWLockExclusive)(PVOID *);
+static VOID (WINAPI *pAcquireSRWLockShared)(PVOID *);
+static VOID (WINAPI *pReleaseSRWLockShared)(PVOID *);
+static BOOL (WINAPI *pSleepConditionVariableSRW)(PVOID *, PVOID *, DWORD, ULONG);
+static VOID (WINAPI *pWakeConditionVariable)(PVOID *);
+
+static volatile LONG WaitValue;
+static volatile LONG WokenCount;
+static PVOID TestLock;
+static PVOID TestCondition;
+static volatile ULONG SharedCounter;
+static HANDLE StartEvent;
+
+static
+BOOL
+InitFunctionPointers(VOID)
+{
+    HMODULE hKernel32;
+
+    /* ReactOS keeps its Vista APIs in a separate DLL */
+    hKernel32 = GetModuleHandleW(L"kernel32.dll");
+    if (!GetProcAddress(hKernel32, "WaitOnAddress"))
+    {
+        hKernel32 = LoadLibraryW(L"kernel32_vista.dll");
+        if (!hKernel32)
+        {
+            /* Windows 8 and later have it in kernelbase */
+            hKernel32 = LoadLibraryW(L"kernelbase.dll");
+            if (!hKernel32) return FALSE;
+        }
+    }
+
+#define GET_PROC(Name) \
+    p##Name = (PVOID)GetProcAddress(hKernel32, #Name); \
+    if (!p##Name) return FALSE
+
+    GET_PROC(WaitOnAddress);
+    GET_PROC(WakeByAddressSingle);
+    GET_PROC(WakeByAddressAll);
+    GET_PROC(AcquireSRWLockExclusive);
+    GET_PROC(ReleaseSRWLockExclusive);
+    GET_PROC(AcquireSRWLockShared);
+    GET_PROC(ReleaseSRWLockShared);
+    GET_PROC(SleepConditionVariableSRW);
+    GET_PROC(WakeConditionVariable);
+
+#undef GET_PROC
+
+    return TRUE;
+}
+
+static
+DWORD
+WINAPI
+WaiterThread(LPVOID Parameter)
+{
+    LONG Compare = 0;
+
+    while (WaitValue == 0)
+    {
+        pWaitOnAddress(&WaitValue, &Compare, sizeof(Compare), INFINITE);
+    }
+    InterlockedIncrement(&WokenCount);
+    return 0;
+}
+
+static
+void
+Test_Functional(void)
+{
+    HANDLE Threads[4];
+    LONG Compare;
+    ULONG i;
+    BOOL Ret;
+
+    /* A mismatch returns right away */
+    WaitValue = 1;
+    Compare = 0;
+    Ret = pWaitOnAddress(&WaitValue, &Compare, sizeof(Compare), INFINITE);
+    ok(Ret == TRUE, "WaitOnAddress returned %d\n", Ret);
+
+    /* A match waits until the timeout */
+    Compare = 1;
+    SetLastError(0xdeadbeef);
+    Ret = pWaitOnAddress(&WaitValue, &Compare, sizeof(Compare), 50);
+    ok(Ret == FALSE, "WaitOnAddress returned %d\n", Ret);
+    ok(GetLastError() == ERROR_TIMEOUT, "GetLastError() = %lu\n", GetLastError());
+
+    /* Only sizes of naturally aligned integers are allowed */
+    SetLastError(0xdeadbeef);
+    Ret = pWaitOnAddress(&WaitValue, &Compare, 3, 0);
+    ok(Ret == FALSE, "WaitOnAddress returned %d\n", Ret);
+    ok(GetLastError() == ERROR_INVALID_PARAMETER, "GetLastError() = %lu\n", GetLastError());
+
+    /* Waking an address noone waits on does nothing */
+    pWakeByAddressSingle((PVOID)&WaitValue);
+    pWakeByAddressAll((PVOID)&WaitValue);
+
+    /* Wake all waiters at once */
+    WaitValue = 0;
+    WokenCount = 0;
+    for (i = 0; i < _countof(Threads); i++)
+    {
+        Threads[i] = CreateThread(NULL, 0, WaiterThread, NULL, 0, NULL);
+        ok(Threads[i] != NULL, "CreateThread failed with %lu\n", GetLastError());
+    }
+    Sleep(100);
+    ok(WokenCount == 0, "WokenCount = %ld\n", WokenCount);
+    InterlockedExchange(&WaitValue, 1);
+    pWakeByAddressAll((PVOID)&WaitValue);
+    for (i = 0; i < _countof(Threads); i++)
+    {
+        if (!Threads[i]) continue;
+        ok(WaitForSingleObject(Threads[i], 5000) == WAIT_OBJECT_0, "Waiter %lu did not wake up\n", i);
+        CloseHandle(Threads[i]);
+    }
+    ok(WokenCount == _countof(Threads), "WokenCount = %ld\n", WokenCount);
+
+    /* Wake a single waiter */
+    WaitValue = 0;
+    WokenCount = 0;
+    Threads[0] = CreateThread(NULL, 0, WaiterThread, NULL, 0, NULL);
+    ok(Threads[0] != NULL, "CreateThread failed with %lu\n", GetLastError());
+    if (!Threads[0]) return;
+    Sleep(100);
+    InterlockedExchange(&WaitValue, 1);
+    pWakeByAddressSingle((PVOID)&WaitValue);
+    ok(WaitForSingleObject(Threads[0], 5000) == WAIT_OBJECT_0, "Waiter did not wake up\n");
+    ok(WokenCount == 1, "WokenCount = %ld\n", WokenCount);
+    CloseHandle(Threads[0]);
+}
+
+static
+DWORD
+WINAPI
+PingPongThread(LPVOID Parameter)
+{
+    LONG Turn = (LONG)(ULONG_PTR)Parameter;
+    LONG Current;
+    ULONG i;
+
+    for (i = 0; i < PING_PONG_ROUNDS; i++)
+    {
+        /* Wait for our turn, then hand it over to the other thread */
+        while ((Current = WaitValue) != Turn)
+        {
+            pWaitOnAddress(&WaitValue, &Current, sizeof(Current), INFINITE);
+        }
+        InterlockedExchange(&WaitValue, !Turn);
+        pWakeByAddressSingle((PVOID)&WaitValue);
+    }
+    return 0;
+}
+
+static
+void
+Test_PingPong(void)
+{
+    HANDLE Threads[2];
+    LARGE_INTEGER Frequency, Start, End;
+
+    WaitValue = 0;
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    Threads[0] = CreateThread(NULL, 0, PingPongThread, (PVOID)0, 0, NULL);
+    Threads[1] = CreateThread(NULL, 0, PingPongThread, (PVOID)1, 0, NULL);
+    ok(Threads[0] != NULL && Threads[1] != NULL, "CreateThread failed with %lu\n", GetLastError());
+    if (!Threads[0] || !Threads[1]) return;
+
+    ok(WaitForMultipleObjects(2, Threads, TRUE, 60000) == WAIT_OBJECT_0, "Ping pong did not finish\n");
+    QueryPerformanceCounter(&End);
+    trace("WaitOnAddress ping pong, %u rounds: %I64u us\n",
+          PING_PONG_ROUNDS,
+          (End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart);
+
+    CloseHandle(Threads[0]);
+    CloseHandle(Threads[1]);
+}
+
+static
+DWORD
+WINAPI
+LockThread(LPVOID Parameter)
+{
+    BOOL Shared = (BOOL)(ULONG_PTR)Parameter;
+    ULONG i;
+
+    WaitForSingleObject(StartEvent, INFINITE);
+    for (i = 0; i < LOCK_ITERATIONS; i++)
+    {
+        if (Shared && (i % 8) != 0)
+        {
+            /* Mostly readers, which only look at the counter */
+            pAcquireSRWLockShared(&TestLock);
+            (void)SharedCounter;
+            pReleaseSRWLockShared(&TestLock);
+        }
+        else
+        {
+            pAcquireSRWLockExclusive(&TestLock);
+            SharedCounter++;
+            pReleaseSRWLockExclusive(&TestLock);
+        }
+    }
+    return 0;
+}
+
+static
+void
+Test_SRWContention(ULONG ThreadCount, BOOL Shared)
+{
+    HANDLE Threads[MAX_THREADS];
+    LARGE_INTEGER Frequency, Start, End;
+    ULONG i, Created = 0, Expected;
+
+    TestLock = NULL;
+    SharedCounter = 0;
+    StartEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    for (i = 0; i < ThreadCount; i++)
+    {
+        Threads[Created] = CreateThread(NULL, 0, LockThread, (PVOID)(ULONG_PTR)Shared, 0, NULL);
+        ok(Threads[Created] != NULL, "CreateThread failed with %lu\n", GetLastError());
+        if (Threads[Created]) Created++;
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    SetEvent(StartEvent);
+    WaitForMultipleObjects(Created, Threads, TRUE, INFINITE);
+    QueryPerformanceCounter(&End);
+
+    /* Nobody got in exclusively at the same time as someone else */
+    Expected = Created * (Shared ? LOCK_ITERATIONS / 8 : LOCK_ITERATIONS);
+    ok(SharedCounter == Expected, "SharedCounter = %lu, expected %lu\n", SharedCounter, Expected);
+    ok(TestLock == NULL, "TestLock = %p\n", TestLock);
+    trace("SRW lock %s, %lu threads: %I64u us\n",
+          Shared ? "mostly shared" : "exclusive",
+          Created,
+          (End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart);
+
+    for (i = 0; i < Created; i++) CloseHandle(Threads[i]);
+    CloseHandle(StartEvent);
+}
+
+static
+DWORD
+WINAPI
+ConditionThread(LPVOID Parameter)
+{
+    LONG Turn = (LONG)(ULONG_PTR)Parameter;
+    ULONG i;
+
+    pAcquireSRWLockExclusive(&TestLock);
+    for (i = 0; i < PING_PONG_ROUNDS; i++)
+    {
+        while (WaitValue != Turn)
+        {
+            pSleepConditionVariableSRW(&TestCondition, &TestLock, INFINITE, 0);
+        }
+        WaitValue = !Turn;
+        pWakeConditionVariable(&TestCondition);
+    }
+    pReleaseSRWLockExclusive(&TestLock);
+    return 0;
+}
+
+static
+void
+Test_ConditionPingPong(void)
+{
+    HANDLE Threads[2];
+    LARGE_INTEGER Frequency, Start, End;
+
+    TestLock = NULL;
+    TestCondition = NULL;
+    WaitValue = 0;
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    Threads[0] = CreateThread(NULL, 0, ConditionThread, (PVOID)0, 0, NULL);
+    Threads[1] = CreateThread(NULL, 0, ConditionThread, (PVOID)1, 0, NULL);
+    ok(Threads[0] != NULL && Threads[1] != NULL, "CreateThread failed with %lu\n", GetLastError());
+    if (!Threads[0] || !Threads[1]) return;
+
+    ok(WaitForMultipleObjects(2, Threads, TRUE, 60000) == WAIT_OBJECT_0, "Ping pong did not finish\n");
+    QueryPerformanceCounter(&End);
+    ok(TestLock == NULL, "TestLock = %p\n", TestLock);
+    trace("Condition variable ping pong, %u rounds: %I64u us\n",
+          PING_PONG_ROUNDS,
+          (End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart);
+
+    CloseHandle(Threads[0]);
+    CloseHandle(Threads[1]);
+}
+
+START_TEST(WaitOnAddress)
+{
+    ULONG ThreadCount;
+
+    if (!InitFunctionPointers())
+    {
+        skip("WaitOnAddress is not available\n");
+        return;
+    }
+
+    Test_Functional();
+    Test_PingPong();
+    Test_ConditionPingPong();
+
+    for (ThreadCount = 1; ThreadCount <= MAX_THREADS; ThreadCount *= 2)
+    {
+        Test_SRWContention(ThreadCount, FALSE);
+        Test_SRWContention(ThreadCount, TRUE);
+    }
+}
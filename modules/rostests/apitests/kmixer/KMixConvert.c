@@ -0,0 +1,239 @@
+/*
+ * PROJECT:     ReactOS API Tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Unit Tests and benchmark for the kmixer conversion routines
+ */
+
+#include <apitest.h>
+#include <math.h>
+#include <samplerate.h>
+
+#define UNIT_TEST
+#define ASSERT(x)
+#include "../../../../drivers/wdm/audio/filters/kmixer/mix.c"
+
+#define TEST_INPUT_RATE     44100
+#define TEST_OUTPUT_RATE    48000
+#define TEST_CHANNELS       2
+#define TEST_CHUNK_FRAMES   (TEST_INPUT_RATE / 100)
+#define TEST_SECONDS        10
+#define TEST_MAX_STREAMS    16
+
+static
+void
+Test_SampleFormats(void)
+{
+    SHORT In16[6] = { 0, 1, -1, 0x4000, 0x7FFF, -0x8000 };
+    SHORT Out16[6];
+    UCHAR In8[3] = { 0x80, 0x00, 0xFF };
+    UCHAR Out8[3];
+    UCHAR In24[6] = { 0x00, 0x00, 0x40, 0xFF, 0xFF, 0xFF };
+    UCHAR Out24[6];
+    FLOAT Float[6];
+    FLOAT Loud[4] = { 1.5f, -1.5f, 1.0f, -1.0f };
+    LONG Out32[4];
+    ULONG i;
+
+    /* Everything makes it through the float conversion unchanged */
+    KMixConvertToFloat(In16, 16, 1, 6, 1, Float);
+    ok(Float[0] == 0.0f, "Float[0] = %f\n", Float[0]);
+    ok(Float[3] == 0.5f, "Float[3] = %f\n", Float[3]);
+    ok(Float[5] == -1.0f, "Float[5] = %f\n", Float[5]);
+    KMixConvertFromFloat(Float, 6, 16, Out16);
+    for (i = 0; i < 6; i++)
+        ok(Out16[i] == In16[i], "Out16[%lu] = %d, expected %d\n", i, Out16[i], In16[i]);
+
+    /* 8 bit samples are unsigned */
+    KMixConvertToFloat(In8, 8, 1, 3, 1, Float);
+    ok(Float[0] == 0.0f, "Float[0] = %f\n", Float[0]);
+    ok(Float[1] == -1.0f, "Float[1] = %f\n", Float[1]);
+    KMixConvertFromFloat(Float, 3, 8, Out8);
+    ok(!memcmp(Out8, In8, sizeof(In8)), "8 bit samples differ\n");
+
+    KMixConvertToFloat(In24, 24, 1, 2, 1, Float);
+    ok(Float[0] == 0.5f, "Float[0] = %f\n", Float[0]);
+    ok(Float[1] < 0.0f, "Float[1] = %f\n", Float[1]);
+    KMixConvertFromFloat(Float, 2, 24, Out24);
+    ok(!memcmp(Out24, In24, sizeof(In24)), "24 bit samples differ\n");
+
+    /* Too loud samples are clipped instead of wrapping around */
+    KMixConvertFromFloat(Loud, 4, 16, Out16);
+    ok(Out16[0] == 0x7FFF, "Out16[0] = %d\n", Out16[0]);
+    ok(Out16[1] == -0x8000, "Out16[1] = %d\n", Out16[1]);
+    ok(Out16[2] == 0x7FFF, "Out16[2] = %d\n", Out16[2]);
+    ok(Out16[3] == -0x8000, "Out16[3] = %d\n", Out16[3]);
+    KMixConvertFromFloat(Loud, 4, 32, Out32);
+    ok(Out32[0] == 0x7FFFFFFF, "Out32[0] = %ld\n", Out32[0]);
+    ok(Out32[1] == (LONG)0x80000000, "Out32[1] = %ld\n", Out32[1]);
+}
+
+static
+void
+Test_Channels(void)
+{
+    SHORT Stereo[4] = { 0x1000, 0x2000, 0x3000, 0x4000 };
+    SHORT Quad[4] = { 0x1000, 0x2000, 0x3000, 0x4000 };
+    FLOAT Float[8];
+
+    /* 2 channels stretched to 4 look like LRLR */
+    KMixConvertToFloat(Stereo, 16, 2, 2, 4, Float);
+    ok(Float[0] == Float[2] && Float[1] == Float[3], "Unexpected upmix\n");
+    ok(Float[4] == Float[6] && Float[5] == Float[7], "Unexpected upmix\n");
+    ok(Float[0] == 0x1000 / 32768.0f, "Float[0] = %f\n", Float[0]);
+    ok(Float[5] == 0x4000 / 32768.0f, "Float[5] = %f\n", Float[5]);
+
+    /* And 4 folded into 2 keep all of them */
+    KMixConvertToFloat(Quad, 16, 4, 1, 2, Float);
+    ok(Float[0] == 0x2000 / 32768.0f, "Float[0] = %f\n", Float[0]);
+    ok(Float[1] == 0x3000 / 32768.0f, "Float[1] = %f\n", Float[1]);
+}
+
+static
+void
+Test_Resampler(void)
+{
+    static FLOAT Input[TEST_INPUT_RATE / 10];
+    static FLOAT Whole[TEST_OUTPUT_RATE / 10 + 64];
+    static FLOAT Chunked[TEST_OUTPUT_RATE / 10 + 64];
+    SRC_STATE *State;
+    SRC_DATA Data;
+    LONG WholeFrames, ChunkedFrames = 0, Offset;
+    FLOAT MaxDifference = 0.0f;
+    LONG i;
+    int error;
+
+    for (i = 0; i < RTL_NUMBER_OF(Input); i++)
+        Input[i] = (FLOAT)sin(i * 2 * 3.14159265358979 * 1000 / TEST_INPUT_RATE) * 0.5f;
+
+    /* Convert it all at once */
+    State = src_new(SRC_SINC_FASTEST, 1, &error);
+    ok(State != NULL, "src_new failed with %d\n", error);
+    if (!State)
+        return;
+
+    RtlZeroMemory(&Data, sizeof(Data));
+    Data.data_in = Input;
+    Data.data_out = Whole;
+    Data.input_frames = RTL_NUMBER_OF(Input);
+    Data.output_frames = RTL_NUMBER_OF(Whole);
+    Data.src_ratio = (double)TEST_OUTPUT_RATE / TEST_INPUT_RATE;
+    ok_int(src_process(State, &Data), 0);
+    WholeFrames = Data.output_frames_gen;
+    src_delete(State);
+
+    /* Then in buffer sized chunks, keeping the state like the pins do */
+    State = src_new(SRC_SINC_FASTEST, 1, &error);
+    ok(State != NULL, "src_new failed with %d\n", error);
+    if (!State)
+        return;
+
+    for (Offset = 0; Offset < RTL_NUMBER_OF(Input); Offset += TEST_CHUNK_FRAMES)
+    {
+        RtlZeroMemory(&Data, sizeof(Data));
+        Data.data_in = Input + Offset;
+        Data.data_out = Chunked + ChunkedFrames;
+        Data.input_frames = min(TEST_CHUNK_FRAMES, RTL_NUMBER_OF(Input) - Offset);
+        Data.output_frames = RTL_NUMBER_OF(Chunked) - ChunkedFrames;
+        Data.src_ratio = (double)TEST_OUTPUT_RATE / TEST_INPUT_RATE;
+        ok_int(src_process(State, &Data), 0);
+        ok(Data.input_frames_used == Data.input_frames,
+           "Used %ld of %ld frames\n", Data.input_frames_used, Data.input_frames);
+        ChunkedFrames += Data.output_frames_gen;
+    }
+    src_delete(State);
+
+    /* There must be no seams at the buffer boundaries */
+    ok(labs(ChunkedFrames - WholeFrames) <= 2, "Got %ld frames, expected %ld\n", ChunkedFrames, WholeFrames);
+    for (i = 0; i < min(ChunkedFrames, WholeFrames); i++)
+        MaxDifference = max(MaxDifference, (FLOAT)fabs(Chunked[i] - Whole[i]));
+    ok(MaxDifference < 0.001f, "MaxDifference = %f\n", MaxDifference);
+}
+
+static
+void
+Test_MixBenchmark(ULONG StreamCount)
+{
+    static SHORT Input[TEST_CHUNK_FRAMES * TEST_CHANNELS];
+    static FLOAT FloatIn[TEST_CHUNK_FRAMES * TEST_CHANNELS];
+    static FLOAT FloatOut[(TEST_CHUNK_FRAMES * TEST_OUTPUT_RATE / TEST_INPUT_RATE + 16) * TEST_CHANNELS];
+    static FLOAT Mix[RTL_NUMBER_OF(FloatOut)];
+    static SHORT Output[RTL_NUMBER_OF(FloatOut)];
+    SRC_STATE *States[TEST_MAX_STREAMS];
+    LARGE_INTEGER Frequency, Start, End;
+    SRC_DATA Data;
+    ULONG Stream, Chunk, i;
+    ULONGLONG OutputFrames = 0, Elapsed;
+    LONG MixFrames;
+    int error;
+
+    for (i = 0; i < RTL_NUMBER_OF(Input); i++)
+        Input[i] = (SHORT)(sin(i * 2 * 3.14159265358979 * 440 / TEST_INPUT_RATE) * 0x1000);
+
+    for (Stream = 0; Stream < StreamCount; Stream++)
+    {
+        States[Stream] = src_new(SRC_SINC_FASTEST, TEST_CHANNELS, &error);
+        ok(States[Stream] != NULL, "src_new failed with %d\n", error);
+        if (!States[Stream])
+        {
+            while (Stream--)
+                src_delete(States[Stream]);
+            return;
+        }
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    for (Chunk = 0; Chunk < TEST_SECONDS * 100; Chunk++)
+    {
+        RtlZeroMemory(Mix, sizeof(Mix));
+        MixFrames = 0;
+
+        for (Stream = 0; Stream < StreamCount; Stream++)
+        {
+            KMixConvertToFloat(Input, 16, TEST_CHANNELS, TEST_CHUNK_FRAMES, TEST_CHANNELS, FloatIn);
+
+            RtlZeroMemory(&Data, sizeof(Data));
+            Data.data_in = FloatIn;
+            Data.data_out = FloatOut;
+            Data.input_frames = TEST_CHUNK_FRAMES;
+            Data.output_frames = RTL_NUMBER_OF(FloatOut) / TEST_CHANNELS;
+            Data.src_ratio = (double)TEST_OUTPUT_RATE / TEST_INPUT_RATE;
+            src_process(States[Stream], &Data);
+
+            KMixAccumulate(Mix, FloatOut, Data.output_frames_gen * TEST_CHANNELS);
+            MixFrames = max(MixFrames, Data.output_frames_gen);
+        }
+
+        KMixConvertFromFloat(Mix, MixFrames * TEST_CHANNELS, 16, Output);
+        OutputFrames += MixFrames;
+    }
+    QueryPerformanceCounter(&End);
+
+    for (Stream = 0; Stream < StreamCount; Stream++)
+        src_delete(States[Stream]);
+
+    /* The resampler holds back a few frames, but not more */
+    ok(OutputFrames + 64 >= (ULONGLONG)TEST_SECONDS * TEST_OUTPUT_RATE,
+       "Got %I64u frames\n", OutputFrames);
+
+    Elapsed = (End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart;
+    trace("%lu streams, %u s of %u Hz mixed into %u Hz: %I64u us, %I64u us per second\n",
+          StreamCount,
+          TEST_SECONDS,
+          TEST_INPUT_RATE,
+          TEST_OUTPUT_RATE,
+          Elapsed,
+          Elapsed / TEST_SECONDS);
+}
+
+START_TEST(KMixConvert)
+{
+    ULONG StreamCount;
+
+    Test_SampleFormats();
+    Test_Channels();
+    Test_Resampler();
+
+    for (StreamCount = 1; StreamCount <= TEST_MAX_STREAMS; StreamCount *= 2)
+        Test_MixBenchmark(StreamCount);
+}
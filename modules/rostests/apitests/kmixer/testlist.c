@@ -0,0 +1,10 @@
+#define STANDALONE
+#include <apitest.h>
+
+extern void func_KMixConvert(void);
+
+const struct test winetest_testlist[] =
+{
+    { "KMixConvert", func_KMixConvert },
+    { 0, 0 }
+};
@@ -744,6 +744,142 @@ CheckSomeDefaultAddresses(VOID)
 #endif
 }
 
+#define LARGE_PAGE_COUNT 16
+#define TLB_ITERATIONS (4 * 1024 * 1024)
+
+static
+ULONG
+TouchRandomPages(volatile UCHAR *Buffer, SIZE_T Size)
+{
+    ULONG i, Seed = 1, Sum = 0;
+    SIZE_T PageCount = Size / PAGE_SIZE;
+
+    /* Hit a different page every time, so the TLB can't keep up with small pages */
+    for (i = 0; i < TLB_ITERATIONS; i++)
+    {
+        Seed = Seed * 1103515245 + 12345;
+        Sum += Buffer[(Seed % PageCount) * PAGE_SIZE + (i & (PAGE_SIZE - 1))];
+    }
+    return Sum;
+}
+
+static
+VOID
+CheckLargePages(VOID)
+{
+    NTSTATUS Status;
+    BOOLEAN WasEnabled;
+    SIZE_T LargePageSize, Size;
+    PVOID Mem, SmallMem;
+    MEMORY_BASIC_INFORMATION Info;
+    LARGE_INTEGER Frequency, Start, End;
+    ULONG_PTR i;
+
+    LargePageSize = SharedUserData->LargePageMinimum;
+    if (LargePageSize == 0)
+    {
+        skip("Large pages are not supported\n");
+        return;
+    }
+
+    Status = RtlAdjustPrivilege(SE_LOCK_MEMORY_PRIVILEGE, TRUE, FALSE, &WasEnabled);
+    if (!NT_SUCCESS(Status))
+    {
+        skip("No SeLockMemoryPrivilege\n");
+        return;
+    }
+
+    /* Size must be a multiple of the large page size */
+    Mem = NULL;
+    Size = LargePageSize / 2;
+    Status = NtAllocateVirtualMemory(NtCurrentProcess(), &Mem, 0, &Size,
+                                     MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+    ok_ntstatus(Status, STATUS_INVALID_PARAMETER);
+
+    /* Large pages must be reserved and committed together */
+    Mem = NULL;
+    Size = LargePageSize;
+    Status = NtAllocateVirtualMemory(NtCurrentProcess(), &Mem, 0, &Size,
+                                     MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE);
+    ok_ntstatus(Status, STATUS_INVALID_PARAMETER_5);
+
+    Mem = NULL;
+    Size = LARGE_PAGE_COUNT * LargePageSize;
+    Status = NtAllocateVirtualMemory(NtCurrentProcess(), &Mem, 0, &Size,
+                                     MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+    if (Status == STATUS_INSUFFICIENT_RESOURCES)
+    {
+        skip("Not enough contiguous memory for %u large pages\n", LARGE_PAGE_COUNT);
+        RtlAdjustPrivilege(SE_LOCK_MEMORY_PRIVILEGE, WasEnabled, FALSE, &WasEnabled);
+        return;
+    }
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+    {
+        RtlAdjustPrivilege(SE_LOCK_MEMORY_PRIVILEGE, WasEnabled, FALSE, &WasEnabled);
+        return;
+    }
+    ok(((ULONG_PTR)Mem & (LargePageSize - 1)) == 0, "Mem = %p\n", Mem);
+    ok(Size == LARGE_PAGE_COUNT * LargePageSize, "Size = %Iu\n", Size);
+
+    /* The memory comes in zeroed and committed */
+    for (i = 0; i < Size; i += PAGE_SIZE)
+    {
+        if (((PUCHAR)Mem)[i] != 0) break;
+        ((PUCHAR)Mem)[i] = (UCHAR)(i >> PAGE_SHIFT);
+    }
+    ok(i == Size, "Memory at offset %Iu is not zero\n", i);
+
+    Status = NtQueryVirtualMemory(NtCurrentProcess(), Mem, MemoryBasicInformation,
+                                  &Info, sizeof(Info), NULL);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    ok(Info.AllocationBase == Mem, "AllocationBase = %p\n", Info.AllocationBase);
+    ok(Info.RegionSize == Size, "RegionSize = %Iu\n", Info.RegionSize);
+    ok(Info.State == MEM_COMMIT, "State = %lx\n", Info.State);
+    ok(Info.Protect == PAGE_READWRITE, "Protect = %lx\n", Info.Protect);
+    ok(Info.Type == MEM_PRIVATE, "Type = %lx\n", Info.Type);
+
+    /* Large page allocations can't be partially released */
+    Size = LargePageSize;
+    Status = NtFreeVirtualMemory(NtCurrentProcess(), &Mem, &Size, MEM_RELEASE);
+    ok_ntstatus(Status, STATUS_UNABLE_TO_FREE_VM);
+
+    /* Compare a TLB-bound access pattern against the same amount of small pages */
+    SmallMem = NULL;
+    Size = LARGE_PAGE_COUNT * LargePageSize;
+    Status = NtAllocateVirtualMemory(NtCurrentProcess(), &SmallMem, 0, &Size,
+                                     MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (NT_SUCCESS(Status))
+    {
+        for (i = 0; i < Size; i += PAGE_SIZE)
+            ((PUCHAR)SmallMem)[i] = (UCHAR)(i >> PAGE_SHIFT);
+
+        QueryPerformanceFrequency(&Frequency);
+        QueryPerformanceCounter(&Start);
+        TouchRandomPages(SmallMem, Size);
+        QueryPerformanceCounter(&End);
+        trace("Small pages: %I64u us for %u random accesses\n",
+              (End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart, TLB_ITERATIONS);
+
+        QueryPerformanceCounter(&Start);
+        TouchRandomPages(Mem, Size);
+        QueryPerformanceCounter(&End);
+        trace("Large pages: %I64u us for %u random accesses\n",
+              (End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart, TLB_ITERATIONS);
+
+        Size = 0;
+        Status = NtFreeVirtualMemory(NtCurrentProcess(), &SmallMem, &Size, MEM_RELEASE);
+        ok_ntstatus(Status, STATUS_SUCCESS);
+    }
+
+    Size = 0;
+    Status = NtFreeVirtualMemory(NtCurrentProcess(), &Mem, &Size, MEM_RELEASE);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+
+    RtlAdjustPrivilege(SE_LOCK_MEMORY_PRIVILEGE, WasEnabled, FALSE, &WasEnabled);
+}
+
 #define RUNS 32
 
 START_TEST(NtAllocateVirtualMemory)
@@ -755,6 +891,7 @@ START_TEST(NtAllocateVirtualMemory)
     CheckAlignment();
     CheckAdjacentVADs();
     CheckSomeDefaultAddresses();
+    CheckLargePages();
 
     Size1 = 32;
     Mem1 = Allocate(Size1);
@@ -0,0 +1,222 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Tests and speed of object creation and lookup in large directories
+ */
+
+#include "precomp.h"
+
+/* Enough objects to make the directory grow well past its initial 37 buckets */
+#define OBJECT_COUNT 10000
+#define OPEN_LOOPS   10000
+
+static LARGE_INTEGER Frequency;
+static HANDLE Events[OBJECT_COUNT];
+
+static
+VOID
+InitEventName(
+    _Out_ PUNICODE_STRING Name,
+    _Out_writes_(Length) PWSTR Buffer,
+    _In_ ULONG Length,
+    _In_ ULONG Index)
+{
+    StringCchPrintfW(Buffer, Length, L"Event%lu", Index);
+    RtlInitUnicodeString(Name, Buffer);
+}
+
+static
+VOID
+TraceRate(
+    _In_ PCSTR Operation,
+    _In_ ULONG Count,
+    _In_ PLARGE_INTEGER Start,
+    _In_ PLARGE_INTEGER End)
+{
+    if (End->QuadPart == Start->QuadPart)
+        return;
+
+    trace("%s: %lu/s\n", Operation,
+          (ULONG)((ULONGLONG)Count * Frequency.QuadPart / (End->QuadPart - Start->QuadPart)));
+}
+
+static
+ULONG
+CountDirectoryEntries(
+    _In_ HANDLE DirectoryHandle)
+{
+    UCHAR Buffer[4096];
+    POBJECT_DIRECTORY_INFORMATION Info;
+    BOOLEAN RestartScan = TRUE;
+    ULONG Context = 0, ReturnLength;
+    ULONG Count = 0;
+    NTSTATUS Status;
+
+    for (;;)
+    {
+        Status = NtQueryDirectoryObject(DirectoryHandle,
+                                        Buffer,
+                                        sizeof(Buffer),
+                                        FALSE,
+                                        RestartScan,
+                                        &Context,
+                                        &ReturnLength);
+        if (!NT_SUCCESS(Status))
+            break;
+
+        for (Info = (POBJECT_DIRECTORY_INFORMATION)Buffer; Info->Name.Buffer; Info++)
+            Count++;
+
+        RestartScan = FALSE;
+    }
+
+    ok_ntstatus(Status, STATUS_NO_MORE_ENTRIES);
+    return Count;
+}
+
+static
+VOID
+Test_LargeDirectory(VOID)
+{
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    UNICODE_STRING Name;
+    WCHAR NameBuffer[32];
+    LARGE_INTEGER Start, End;
+    HANDLE DirectoryHandle, Handle;
+    NTSTATUS Status;
+    ULONG Created, i;
+
+    InitializeObjectAttributes(&ObjectAttributes, NULL, 0, NULL, NULL);
+    Status = NtCreateDirectoryObject(&DirectoryHandle, DIRECTORY_ALL_ACCESS, &ObjectAttributes);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        return;
+
+    QueryPerformanceCounter(&Start);
+    for (Created = 0; Created < OBJECT_COUNT; Created++)
+    {
+        InitEventName(&Name, NameBuffer, RTL_NUMBER_OF(NameBuffer), Created);
+        InitializeObjectAttributes(&ObjectAttributes, &Name, 0, DirectoryHandle, NULL);
+        Status = NtCreateEvent(&Events[Created], EVENT_ALL_ACCESS, &ObjectAttributes, NotificationEvent, FALSE);
+        if (!NT_SUCCESS(Status))
+            break;
+    }
+    QueryPerformanceCounter(&End);
+    ok(Created == OBJECT_COUNT, "Created %lu events, status 0x%lx\n", Created, Status);
+    TraceRate("Event creates", Created, &Start, &End);
+
+    /* A second create of the same name must find the existing entry */
+    InitEventName(&Name, NameBuffer, RTL_NUMBER_OF(NameBuffer), 0);
+    InitializeObjectAttributes(&ObjectAttributes, &Name, 0, DirectoryHandle, NULL);
+    Status = NtCreateEvent(&Handle, EVENT_ALL_ACCESS, &ObjectAttributes, NotificationEvent, FALSE);
+    ok_ntstatus(Status, STATUS_OBJECT_NAME_EXISTS);
+    if (NT_SUCCESS(Status))
+        NtClose(Handle);
+
+    /* Every entry survives the table growing */
+    ok(CountDirectoryEntries(DirectoryHandle) == Created, "Wrong number of directory entries\n");
+
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < Created; i++)
+    {
+        InitEventName(&Name, NameBuffer, RTL_NUMBER_OF(NameBuffer), i);
+        InitializeObjectAttributes(&ObjectAttributes, &Name, 0, DirectoryHandle, NULL);
+        Status = NtOpenEvent(&Handle, EVENT_ALL_ACCESS, &ObjectAttributes);
+        if (!NT_SUCCESS(Status))
+            break;
+        NtClose(Handle);
+    }
+    QueryPerformanceCounter(&End);
+    ok(i == Created, "Open of event %lu failed with 0x%lx\n", i, Status);
+    TraceRate("Event opens", i, &Start, &End);
+
+    /* Repeated opens of the same name are served from the lookup cache */
+    InitEventName(&Name, NameBuffer, RTL_NUMBER_OF(NameBuffer), Created / 2);
+    InitializeObjectAttributes(&ObjectAttributes, &Name, 0, DirectoryHandle, NULL);
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < OPEN_LOOPS; i++)
+    {
+        Status = NtOpenEvent(&Handle, EVENT_ALL_ACCESS, &ObjectAttributes);
+        if (!NT_SUCCESS(Status))
+            break;
+        NtClose(Handle);
+    }
+    QueryPerformanceCounter(&End);
+    ok(i == OPEN_LOOPS, "Open %lu failed with 0x%lx\n", i, Status);
+    TraceRate("Repeated event opens", i, &Start, &End);
+
+    /* Deleted names must not be found anymore, cached or not */
+    for (i = 0; i < Created; i += 2)
+        NtClose(Events[i]);
+
+    for (i = 0; i < Created; i++)
+    {
+        InitEventName(&Name, NameBuffer, RTL_NUMBER_OF(NameBuffer), i);
+        InitializeObjectAttributes(&ObjectAttributes, &Name, 0, DirectoryHandle, NULL);
+        Status = NtOpenEvent(&Handle, EVENT_ALL_ACCESS, &ObjectAttributes);
+        if (i % 2)
+        {
+            if (!NT_SUCCESS(Status))
+                break;
+            NtClose(Handle);
+        }
+        else
+        {
+            if (Status != STATUS_OBJECT_NAME_NOT_FOUND)
+            {
+                if (NT_SUCCESS(Status))
+                    NtClose(Handle);
+                break;
+            }
+        }
+    }
+    ok(i == Created, "Open of event %lu returned 0x%lx\n", i, Status);
+    ok(CountDirectoryEntries(DirectoryHandle) == Created / 2, "Wrong number of directory entries\n");
+
+    for (i = 1; i < Created; i += 2)
+        NtClose(Events[i]);
+
+    ok(CountDirectoryEntries(DirectoryHandle) == 0, "Directory is not empty\n");
+    NtClose(DirectoryHandle);
+}
+
+static
+VOID
+Test_DosDeviceLookup(VOID)
+{
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    UNICODE_STRING Name = RTL_CONSTANT_STRING(L"\\??\\C:");
+    LARGE_INTEGER Start, End;
+    HANDLE Handle;
+    NTSTATUS Status;
+    ULONG i;
+
+    InitializeObjectAttributes(&ObjectAttributes, &Name, OBJ_CASE_INSENSITIVE, NULL, NULL);
+    Status = NtOpenSymbolicLinkObject(&Handle, SYMBOLIC_LINK_QUERY, &ObjectAttributes);
+    if (!NT_SUCCESS(Status))
+    {
+        skip("Cannot open %wZ, status 0x%lx\n", &Name, Status);
+        return;
+    }
+    NtClose(Handle);
+
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < OPEN_LOOPS; i++)
+    {
+        Status = NtOpenSymbolicLinkObject(&Handle, SYMBOLIC_LINK_QUERY, &ObjectAttributes);
+        if (!NT_SUCCESS(Status))
+            break;
+        NtClose(Handle);
+    }
+    QueryPerformanceCounter(&End);
+    ok(i == OPEN_LOOPS, "Open %lu failed with 0x%lx\n", i, Status);
+    TraceRate("Opens of \\??\\C:", i, &Start, &End);
+}
+
+START_TEST(NtCreateDirectoryObject)
+{
+    QueryPerformanceFrequency(&Frequency);
+
+    Test_LargeDirectory();
+    Test_DosDeviceLookup();
+}
@@ -1992,6 +1992,87 @@ Test_Truncate(VOID)
     ok(Success == TRUE, "DeleteFileW failed with %lu\n", GetLastError());
 }
 
+static void
+Test_SequentialScan(VOID)
+{
+    WCHAR TempPath[MAX_PATH];
+    WCHAR FileName[MAX_PATH];
+    NTSTATUS Status;
+    SIZE_T ViewSize = 0;
+    HANDLE Handle;
+    HANDLE SectionHandle = NULL;
+    ULONG Page[PAGE_SIZE / sizeof(ULONG)] = { 0 };
+    LARGE_INTEGER Frequency, Start, End;
+
+    SIZE_T Length;
+    BOOL Success;
+    DWORD Written;
+    ULONG i, Mismatches = 0;
+    volatile ULONG* BaseAddress;
+
+    Length = GetTempPathW(MAX_PATH, TempPath);
+    ok(Length != 0, "GetTempPathW failed with %lu\n", GetLastError());
+    Length = GetTempFileNameW(TempPath, L"nta", 0, FileName);
+    ok(Length != 0, "GetTempFileNameW failed with %lu\n", GetLastError());
+    Handle = CreateFileW(FileName, FILE_ALL_ACCESS, 0, NULL, CREATE_ALWAYS, 0, NULL);
+    ok(Handle != INVALID_HANDLE_VALUE, "CreateFileW failed with %lu\n", GetLastError());
+    if (Handle == INVALID_HANDLE_VALUE)
+        return;
+
+    /* Tag every page with its index */
+    for (i = 0; i < 256; i++)
+    {
+        Page[0] = i;
+        Success = WriteFile(Handle, Page, sizeof(Page), &Written, NULL);
+        ok(Success == TRUE, "WriteFile failed with %lu\n", GetLastError());
+    }
+    CloseHandle(Handle);
+
+    /* Reopen it for a sequential scan, so the faults read ahead */
+    Handle = CreateFileW(FileName, GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    ok(Handle != INVALID_HANDLE_VALUE, "CreateFileW failed with %lu\n", GetLastError());
+    if (Handle == INVALID_HANDLE_VALUE)
+    {
+        DeleteFileW(FileName);
+        return;
+    }
+
+    Status = NtCreateSection(&SectionHandle,
+                             STANDARD_RIGHTS_REQUIRED | SECTION_QUERY | SECTION_MAP_READ,
+                             0, 0, PAGE_READONLY, SEC_COMMIT, Handle);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    BaseAddress = NULL;
+    Status = NtMapViewOfSection(SectionHandle, NtCurrentProcess(), (PVOID*)&BaseAddress, 0,
+                                0, 0, &ViewSize, ViewShare, 0, PAGE_READONLY);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+
+    if (NT_SUCCESS(Status))
+    {
+        QueryPerformanceFrequency(&Frequency);
+        QueryPerformanceCounter(&Start);
+        for (i = 0; i < 256; i++)
+        {
+            if (BaseAddress[i * PAGE_SIZE / sizeof(ULONG)] != i)
+                Mismatches++;
+        }
+        QueryPerformanceCounter(&End);
+        ok(Mismatches == 0, "%lu pages have the wrong contents\n", Mismatches);
+        trace("Sequential scan of 1MB took %I64u us\n",
+              (End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart);
+
+        Status = NtUnmapViewOfSection(NtCurrentProcess(), (PVOID)BaseAddress);
+        ok_ntstatus(Status, STATUS_SUCCESS);
+    }
+
+    // CLEANUP
+    if (SectionHandle)
+        CloseHandle(SectionHandle);
+    CloseHandle(Handle);
+
+    Success = DeleteFileW(FileName);
+    ok(Success == TRUE, "DeleteFileW failed with %lu\n", GetLastError());
+}
+
 START_TEST(NtMapViewOfSection)
 {
     Test_PageFileSection();
@@ -2004,4 +2085,5 @@ START_TEST(NtMapViewOfSection)
     Test_RawSize(2);
     Test_EmptyFile();
     Test_Truncate();
+    Test_SequentialScan();
 }
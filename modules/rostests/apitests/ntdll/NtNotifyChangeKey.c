@@ -0,0 +1,233 @@
+/*
+ * PROJECT:         ReactOS API Tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Test for NtNotifyChangeKey
+ */
+
+#include "precomp.h"
+
+#define STORM_ITERATIONS 200
+
+static HANDLE StormKey;
+static volatile LONG StormStop;
+
+static
+NTSTATUS
+CreateRegistryKeyHandle(PHANDLE KeyHandle,
+                        HANDLE RootDirectory,
+                        PWCHAR RegistryPath)
+{
+    UNICODE_STRING KeyName;
+    OBJECT_ATTRIBUTES Attributes;
+
+    RtlInitUnicodeString(&KeyName, RegistryPath);
+    InitializeObjectAttributes(&Attributes,
+                               &KeyName,
+                               OBJ_CASE_INSENSITIVE,
+                               RootDirectory,
+                               NULL);
+
+    return NtCreateKey(KeyHandle, KEY_ALL_ACCESS, &Attributes, 0, NULL, REG_OPTION_VOLATILE, 0);
+}
+
+static
+NTSTATUS
+SetValue(HANDLE KeyHandle,
+         ULONG Data)
+{
+    UNICODE_STRING ValueName = RTL_CONSTANT_STRING(L"Value");
+
+    return NtSetValueKey(KeyHandle, &ValueName, 0, REG_DWORD, &Data, sizeof(Data));
+}
+
+static
+NTSTATUS
+Notify(HANDLE KeyHandle,
+       HANDLE Event,
+       PIO_STATUS_BLOCK IoStatusBlock,
+       ULONG Filter,
+       BOOLEAN WatchTree)
+{
+    IoStatusBlock->Status = 0xdeadbeef;
+    IoStatusBlock->Information = 0xdeadbeef;
+    return NtNotifyChangeKey(KeyHandle,
+                             Event,
+                             NULL,
+                             NULL,
+                             IoStatusBlock,
+                             Filter,
+                             WatchTree,
+                             NULL,
+                             0,
+                             TRUE);
+}
+
+static
+DWORD
+WINAPI
+StormThread(LPVOID Parameter)
+{
+    ULONG Data = 0;
+
+    /* Keep writing until told to stop */
+    while (!StormStop)
+    {
+        SetValue(StormKey, Data++);
+    }
+    return 0;
+}
+
+static
+void
+Test_WriteStorm(HANDLE KeyHandle, HANDLE Event)
+{
+    IO_STATUS_BLOCK IoStatusBlock;
+    LARGE_INTEGER Frequency, Start, End;
+    ULONGLONG Total = 0, Max = 0, Elapsed;
+    HANDLE Thread;
+    NTSTATUS Status;
+    DWORD Wait;
+    ULONG i, Completed = 0;
+
+    QueryPerformanceFrequency(&Frequency);
+
+    /* Start hammering the key from another thread */
+    StormKey = KeyHandle;
+    StormStop = FALSE;
+    Thread = CreateThread(NULL, 0, StormThread, NULL, 0, NULL);
+    ok(Thread != NULL, "CreateThread failed with %lu\n", GetLastError());
+    if (!Thread) return;
+
+    /* Measure how long every request takes to be completed */
+    for (i = 0; i < STORM_ITERATIONS; i++)
+    {
+        QueryPerformanceCounter(&Start);
+        Status = Notify(KeyHandle, Event, &IoStatusBlock, REG_NOTIFY_CHANGE_LAST_SET, FALSE);
+        ok(Status == STATUS_PENDING, "[%lu] Status = 0x%08lx\n", i, Status);
+        Wait = WaitForSingleObject(Event, 5000);
+        QueryPerformanceCounter(&End);
+        ok(Wait == WAIT_OBJECT_0, "[%lu] Wait = %lu\n", i, Wait);
+        if (Wait != WAIT_OBJECT_0) break;
+        ok_ntstatus(IoStatusBlock.Status, STATUS_NOTIFY_ENUM_DIR);
+
+        Elapsed = (End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart;
+        Total += Elapsed;
+        if (Elapsed > Max) Max = Elapsed;
+        Completed++;
+    }
+
+    /* Stop the writer */
+    InterlockedExchange(&StormStop, TRUE);
+    WaitForSingleObject(Thread, INFINITE);
+    CloseHandle(Thread);
+
+    if (Completed)
+    {
+        trace("Write storm: %lu notifications, average latency %I64u us, max %I64u us\n",
+              Completed, Total / Completed, Max);
+    }
+}
+
+START_TEST(NtNotifyChangeKey)
+{
+    NTSTATUS Status;
+    HANDLE ParentKey, ChildKey, WatchKey, Event;
+    IO_STATUS_BLOCK IoStatusBlock;
+    DWORD Wait;
+    ULONG i;
+
+    Status = CreateRegistryKeyHandle(&ParentKey, NULL, L"\\Registry\\Machine\\Software\\RosTestsNotify");
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status)) return;
+
+    Status = CreateRegistryKeyHandle(&ChildKey, ParentKey, L"Child");
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+    {
+        NtDeleteKey(ParentKey);
+        NtClose(ParentKey);
+        return;
+    }
+
+    Event = CreateEventW(NULL, TRUE, FALSE, NULL);
+    ok(Event != NULL, "CreateEventW failed with %lu\n", GetLastError());
+
+    /* Invalid filters are rejected */
+    Status = Notify(ParentKey, Event, &IoStatusBlock, 0x80000000, FALSE);
+    ok_ntstatus(Status, STATUS_INVALID_PARAMETER);
+
+    /* A value change completes the request */
+    Status = CreateRegistryKeyHandle(&WatchKey, NULL, L"\\Registry\\Machine\\Software\\RosTestsNotify");
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    Status = Notify(WatchKey, Event, &IoStatusBlock, REG_NOTIFY_CHANGE_LAST_SET, FALSE);
+    ok_ntstatus(Status, STATUS_PENDING);
+    ok(WaitForSingleObject(Event, 0) == WAIT_TIMEOUT, "Event is signaled\n");
+    Status = SetValue(ParentKey, 1);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    Wait = WaitForSingleObject(Event, 1000);
+    ok(Wait == WAIT_OBJECT_0, "Wait = %lu\n", Wait);
+    ok_ntstatus(IoStatusBlock.Status, STATUS_NOTIFY_ENUM_DIR);
+
+    /* Changes made while nobody is waiting are coalesced into a single one */
+    for (i = 0; i < 100; i++)
+    {
+        SetValue(ParentKey, i);
+    }
+    Status = Notify(WatchKey, Event, &IoStatusBlock, REG_NOTIFY_CHANGE_LAST_SET, FALSE);
+    ok(Status == STATUS_PENDING || Status == STATUS_NOTIFY_ENUM_DIR, "Status = 0x%08lx\n", Status);
+    Wait = WaitForSingleObject(Event, 1000);
+    ok(Wait == WAIT_OBJECT_0, "Wait = %lu\n", Wait);
+    Status = Notify(WatchKey, Event, &IoStatusBlock, REG_NOTIFY_CHANGE_LAST_SET, FALSE);
+    ok_ntstatus(Status, STATUS_PENDING);
+    ok(WaitForSingleObject(Event, 0) == WAIT_TIMEOUT, "Event is signaled\n");
+
+    /* Closing the handle completes the pending request */
+    NtClose(WatchKey);
+    Wait = WaitForSingleObject(Event, 1000);
+    ok(Wait == WAIT_OBJECT_0, "Wait = %lu\n", Wait);
+    ok_ntstatus(IoStatusBlock.Status, STATUS_NOTIFY_CLEANUP);
+
+    /* Changes to a subkey are only seen when watching the tree */
+    Status = CreateRegistryKeyHandle(&WatchKey, NULL, L"\\Registry\\Machine\\Software\\RosTestsNotify");
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    Status = Notify(WatchKey, Event, &IoStatusBlock, REG_NOTIFY_CHANGE_LAST_SET, FALSE);
+    ok_ntstatus(Status, STATUS_PENDING);
+    SetValue(ChildKey, 1);
+    ok(WaitForSingleObject(Event, 100) == WAIT_TIMEOUT, "Event is signaled\n");
+    NtClose(WatchKey);
+    WaitForSingleObject(Event, 1000);
+
+    Status = CreateRegistryKeyHandle(&WatchKey, NULL, L"\\Registry\\Machine\\Software\\RosTestsNotify");
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    Status = Notify(WatchKey, Event, &IoStatusBlock, REG_NOTIFY_CHANGE_LAST_SET, TRUE);
+    ok_ntstatus(Status, STATUS_PENDING);
+    SetValue(ChildKey, 2);
+    Wait = WaitForSingleObject(Event, 1000);
+    ok(Wait == WAIT_OBJECT_0, "Wait = %lu\n", Wait);
+    ok_ntstatus(IoStatusBlock.Status, STATUS_NOTIFY_ENUM_DIR);
+    NtClose(WatchKey);
+
+    /* Deleting a subkey is a name change on its parent */
+    Status = CreateRegistryKeyHandle(&WatchKey, NULL, L"\\Registry\\Machine\\Software\\RosTestsNotify");
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    Status = Notify(WatchKey, Event, &IoStatusBlock, REG_NOTIFY_CHANGE_NAME, FALSE);
+    ok_ntstatus(Status, STATUS_PENDING);
+    Status = NtDeleteKey(ChildKey);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    Wait = WaitForSingleObject(Event, 1000);
+    ok(Wait == WAIT_OBJECT_0, "Wait = %lu\n", Wait);
+    ok_ntstatus(IoStatusBlock.Status, STATUS_NOTIFY_ENUM_DIR);
+    NtClose(WatchKey);
+    NtClose(ChildKey);
+
+    /* Measure the notification latency while the key is being written to */
+    Status = CreateRegistryKeyHandle(&WatchKey, NULL, L"\\Registry\\Machine\\Software\\RosTestsNotify");
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    Test_WriteStorm(WatchKey, Event);
+    NtClose(WatchKey);
+
+    CloseHandle(Event);
+    Status = NtDeleteKey(ParentKey);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    NtClose(ParentKey);
+}
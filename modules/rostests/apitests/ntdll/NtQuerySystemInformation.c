@@ -6,6 +6,70 @@
  */
 
 #include "precomp.h"
+#include <versionhelpers.h>
+
+static
+void
+Test_WorkQueueInformation(void)
+{
+    PSYSTEM_WORK_QUEUE_INFORMATION Information;
+    SYSTEM_BASIC_INFORMATION BasicInfo;
+    ULONG ReturnLength, Count, i;
+    NTSTATUS Status;
+
+    /* This class is ReactOS specific */
+    if (!IsReactOS())
+    {
+        skip("SystemWorkQueueInformation is ReactOS specific\n");
+        return;
+    }
+
+    Status = NtQuerySystemInformation(SystemBasicInformation, &BasicInfo, sizeof(BasicInfo), NULL);
+    ok_hex(Status, STATUS_SUCCESS);
+
+    /* A delayed and critical queue for each processor, and one hypercritical queue */
+    ReturnLength = 0x55555555;
+    Status = NtQuerySystemInformation(SystemWorkQueueInformation, NULL, 0, &ReturnLength);
+    ok_hex(Status, STATUS_INFO_LENGTH_MISMATCH);
+    Count = BasicInfo.NumberOfProcessors * 2 + 1;
+    ok(ReturnLength == Count * sizeof(*Information), "ReturnLength = %lu\n", ReturnLength);
+
+    Information = RtlAllocateHeap(RtlGetProcessHeap(), 0, Count * sizeof(*Information));
+    if (!Information)
+    {
+        skip("Out of memory\n");
+        return;
+    }
+
+    Status = NtQuerySystemInformation(SystemWorkQueueInformation,
+                                      Information,
+                                      Count * sizeof(*Information),
+                                      &ReturnLength);
+    ok_hex(Status, STATUS_SUCCESS);
+    for (i = 0; NT_SUCCESS(Status) && i < Count; i++)
+    {
+        ok(Information[i].Processor < BasicInfo.NumberOfProcessors,
+           "[%lu] Processor = %lu\n", i, Information[i].Processor);
+        ok(Information[i].QueueType <= 2, "[%lu] QueueType = %lu\n", i, Information[i].QueueType);
+        ok(Information[i].WorkerCount != 0, "[%lu] No workers\n", i);
+        ok(Information[i].AverageLatency <= Information[i].MaximumLatency,
+           "[%lu] Average latency %lu above maximum %lu\n",
+           i, Information[i].AverageLatency, Information[i].MaximumLatency);
+        trace("CPU %lu queue %lu: %lu workers (%lu dynamic), %lu queued, %lu processed, "
+              "%lu stolen, %lu us average and %lu us maximum latency\n",
+              Information[i].Processor,
+              Information[i].QueueType,
+              Information[i].WorkerCount,
+              Information[i].DynamicThreadCount,
+              Information[i].WorkItemsQueued,
+              Information[i].WorkItemsProcessed,
+              Information[i].WorkItemsStolen,
+              Information[i].AverageLatency,
+              Information[i].MaximumLatency);
+    }
+
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Information);
+}
 
 START_TEST(NtQuerySystemInformation)
 {
@@ -16,4 +80,6 @@ START_TEST(NtQuerySystemInformation)
 
     Status = NtQuerySystemInformation(0x80000000, NULL, 0, NULL);
     ok_hex(Status, STATUS_INVALID_INFO_CLASS);
+
+    Test_WorkQueueInformation();
 }
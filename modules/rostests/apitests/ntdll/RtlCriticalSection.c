@@ -0,0 +1,125 @@
+/*
+ * PROJECT:         ReactOS API Tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Test for critical section contention
+ */
+
+#include "precomp.h"
+
+#define ITERATIONS_PER_THREAD 200000
+#define MAX_THREADS 8
+
+static RTL_CRITICAL_SECTION TestLock;
+static volatile ULONG SharedCounter;
+static HANDLE StartEvent;
+
+static
+DWORD
+WINAPI
+ContentionThread(LPVOID Parameter)
+{
+    ULONG i;
+
+    WaitForSingleObject(StartEvent, INFINITE);
+    for (i = 0; i < ITERATIONS_PER_THREAD; i++)
+    {
+        RtlEnterCriticalSection(&TestLock);
+
+        /* A short critical section, like most of the ones in the heap */
+        SharedCounter++;
+
+        RtlLeaveCriticalSection(&TestLock);
+    }
+    return 0;
+}
+
+static
+void
+Test_Contention(ULONG SpinCount, ULONG ThreadCount)
+{
+    HANDLE Threads[MAX_THREADS];
+    LARGE_INTEGER Frequency, Start, End;
+    ULONG i, Created = 0;
+    NTSTATUS Status;
+
+    Status = RtlInitializeCriticalSectionAndSpinCount(&TestLock, SpinCount);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status)) return;
+
+    SharedCounter = 0;
+    StartEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    for (i = 0; i < ThreadCount; i++)
+    {
+        Threads[Created] = CreateThread(NULL, 0, ContentionThread, NULL, 0, NULL);
+        ok(Threads[Created] != NULL, "CreateThread failed with %lu\n", GetLastError());
+        if (Threads[Created]) Created++;
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    SetEvent(StartEvent);
+    WaitForMultipleObjects(Created, Threads, TRUE, INFINITE);
+    QueryPerformanceCounter(&End);
+
+    /* Nobody got in at the same time as someone else */
+    ok(SharedCounter == Created * ITERATIONS_PER_THREAD,
+       "SharedCounter = %lu, expected %lu\n", SharedCounter, Created * ITERATIONS_PER_THREAD);
+    ok(TestLock.LockCount == -1, "LockCount = %ld\n", TestLock.LockCount);
+    ok(TestLock.RecursionCount == 0, "RecursionCount = %ld\n", TestLock.RecursionCount);
+    ok(TestLock.OwningThread == NULL, "OwningThread = %p\n", TestLock.OwningThread);
+
+    if (TestLock.DebugInfo)
+    {
+        /* Every wait is a contention, but not every contention is a wait */
+        ok(TestLock.DebugInfo->ContentionCount >= TestLock.DebugInfo->EntryCount,
+           "ContentionCount = %lu, EntryCount = %lu\n",
+           TestLock.DebugInfo->ContentionCount, TestLock.DebugInfo->EntryCount);
+        trace("Spin %lu, %lu threads: %I64u us, %lu contentions, %lu waits\n",
+              SpinCount,
+              Created,
+              (End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart,
+              TestLock.DebugInfo->ContentionCount,
+              TestLock.DebugInfo->EntryCount);
+    }
+
+    for (i = 0; i < Created; i++) CloseHandle(Threads[i]);
+    CloseHandle(StartEvent);
+    RtlDeleteCriticalSection(&TestLock);
+}
+
+static
+void
+Test_Recursion(ULONG SpinCount)
+{
+    NTSTATUS Status;
+
+    Status = RtlInitializeCriticalSectionAndSpinCount(&TestLock, SpinCount);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status)) return;
+
+    RtlEnterCriticalSection(&TestLock);
+    RtlEnterCriticalSection(&TestLock);
+    ok(TestLock.RecursionCount == 2, "RecursionCount = %ld\n", TestLock.RecursionCount);
+    ok(TestLock.LockCount == 1, "LockCount = %ld\n", TestLock.LockCount);
+    RtlLeaveCriticalSection(&TestLock);
+    RtlLeaveCriticalSection(&TestLock);
+    ok(TestLock.LockCount == -1, "LockCount = %ld\n", TestLock.LockCount);
+    ok(TestLock.OwningThread == NULL, "OwningThread = %p\n", TestLock.OwningThread);
+
+    RtlDeleteCriticalSection(&TestLock);
+}
+
+START_TEST(RtlCriticalSection)
+{
+    ULONG ThreadCount;
+
+    Test_Recursion(0);
+    Test_Recursion(4000);
+
+    /* Compare waiting right away with spinning first, for growing contention */
+    for (ThreadCount = 1; ThreadCount <= MAX_THREADS; ThreadCount *= 2)
+    {
+        Test_Contention(0, ThreadCount);
+        Test_Contention(4000, ThreadCount);
+    }
+}
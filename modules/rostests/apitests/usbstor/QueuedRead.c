@@ -0,0 +1,237 @@
+/*
+ * PROJECT:     ReactOS API Tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Random reads with several requests in flight on USB mass storage disks
+ */
+
+#include <apitest.h>
+#include <winioctl.h>
+#include <ntddstor.h>
+
+/* Tagged queuing needs a UAS device, run it on qemu with e.g.
+   -device usb-ehci,id=ehci -device usb-uas,id=uas,bus=ehci.0
+   -drive if=none,id=stick,file=disk.img -device scsi-hd,bus=uas.0,drive=stick */
+
+#define TEST_MAX_DRIVES     16
+#define TEST_MAX_DEPTH      16
+#define TEST_READ_SIZE      4096
+#define TEST_READ_COUNT     2048
+
+static
+HANDLE
+OpenUsbDisk(ULONG DriveNumber, PBOOLEAN CommandQueueing)
+{
+    STORAGE_PROPERTY_QUERY Query;
+    STORAGE_DEVICE_DESCRIPTOR Descriptor;
+    WCHAR Path[MAX_PATH];
+    HANDLE Disk;
+    DWORD Returned;
+
+    swprintf(Path, L"\\\\.\\PhysicalDrive%lu", DriveNumber);
+
+    Disk = CreateFileW(Path,
+                       GENERIC_READ,
+                       FILE_SHARE_READ | FILE_SHARE_WRITE,
+                       NULL,
+                       OPEN_EXISTING,
+                       FILE_FLAG_NO_BUFFERING | FILE_FLAG_OVERLAPPED,
+                       NULL);
+    if (Disk == INVALID_HANDLE_VALUE)
+        return NULL;
+
+    ZeroMemory(&Query, sizeof(Query));
+    Query.PropertyId = StorageDeviceProperty;
+    Query.QueryType = PropertyStandardQuery;
+
+    ZeroMemory(&Descriptor, sizeof(Descriptor));
+    if (!DeviceIoControl(Disk,
+                         IOCTL_STORAGE_QUERY_PROPERTY,
+                         &Query,
+                         sizeof(Query),
+                         &Descriptor,
+                         sizeof(Descriptor),
+                         &Returned,
+                         NULL) ||
+        Descriptor.BusType != BusTypeUsb)
+    {
+        CloseHandle(Disk);
+        return NULL;
+    }
+
+    *CommandQueueing = Descriptor.CommandQueueing;
+    return Disk;
+}
+
+static
+ULONGLONG
+RandomSector(PULONG Seed, ULONGLONG Sectors)
+{
+    ULONGLONG Value;
+
+    /* Same sequence on every run */
+    *Seed = *Seed * 1103515245 + 12345;
+    Value = *Seed;
+    *Seed = *Seed * 1103515245 + 12345;
+    Value = (Value << 32) | *Seed;
+
+    return Value % Sectors;
+}
+
+static
+void
+Test_QueuedRead(HANDLE Disk, ULONG DriveNumber, ULONGLONG DiskLength, ULONG Depth)
+{
+    OVERLAPPED Overlapped[TEST_MAX_DEPTH];
+    HANDLE Events[TEST_MAX_DEPTH];
+    BOOL Pending[TEST_MAX_DEPTH] = { FALSE };
+    LARGE_INTEGER Frequency, Start, End;
+    ULONGLONG Elapsed, Offset, Sectors;
+    ULONG Issued = 0, Completed = 0, Seed = 1, i;
+    PUCHAR Buffer;
+    DWORD Read, Wait;
+
+    Sectors = DiskLength / TEST_READ_SIZE;
+
+    /* Unbuffered I/O needs sector aligned buffers */
+    Buffer = VirtualAlloc(NULL, Depth * TEST_READ_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    ok(Buffer != NULL, "VirtualAlloc failed with %lu\n", GetLastError());
+    if (!Buffer)
+        return;
+
+    for (i = 0; i < Depth; i++)
+    {
+        Events[i] = CreateEventW(NULL, TRUE, FALSE, NULL);
+        ok(Events[i] != NULL, "CreateEventW failed with %lu\n", GetLastError());
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+
+    /* Keep Depth reads in flight until all of them are done */
+    for (i = 0; i < Depth && Issued < TEST_READ_COUNT; i++, Issued++)
+    {
+        Offset = RandomSector(&Seed, Sectors) * TEST_READ_SIZE;
+        ZeroMemory(&Overlapped[i], sizeof(Overlapped[i]));
+        Overlapped[i].Offset = (DWORD)Offset;
+        Overlapped[i].OffsetHigh = (DWORD)(Offset >> 32);
+        Overlapped[i].hEvent = Events[i];
+
+        if (!ReadFile(Disk, Buffer + i * TEST_READ_SIZE, TEST_READ_SIZE, NULL, &Overlapped[i]) &&
+            GetLastError() != ERROR_IO_PENDING)
+        {
+            ok(0, "ReadFile failed with %lu\n", GetLastError());
+            goto Cleanup;
+        }
+        Pending[i] = TRUE;
+    }
+
+    while (Completed < Issued)
+    {
+        Wait = WaitForMultipleObjects(Depth, Events, FALSE, 30000);
+        if (Wait >= WAIT_OBJECT_0 + Depth)
+        {
+            ok(0, "WaitForMultipleObjects returned %lu\n", Wait);
+            goto Cleanup;
+        }
+
+        i = Wait - WAIT_OBJECT_0;
+        Pending[i] = FALSE;
+        if (!GetOverlappedResult(Disk, &Overlapped[i], &Read, FALSE))
+        {
+            ok(0, "Read %lu failed with %lu\n", Completed, GetLastError());
+            goto Cleanup;
+        }
+
+        ok(Read == TEST_READ_SIZE, "Read %lu of %u bytes\n", Read, TEST_READ_SIZE);
+        Completed++;
+        ResetEvent(Events[i]);
+
+        if (Issued < TEST_READ_COUNT)
+        {
+            Offset = RandomSector(&Seed, Sectors) * TEST_READ_SIZE;
+            Overlapped[i].Offset = (DWORD)Offset;
+            Overlapped[i].OffsetHigh = (DWORD)(Offset >> 32);
+
+            if (!ReadFile(Disk, Buffer + i * TEST_READ_SIZE, TEST_READ_SIZE, NULL, &Overlapped[i]) &&
+                GetLastError() != ERROR_IO_PENDING)
+            {
+                ok(0, "ReadFile failed with %lu\n", GetLastError());
+                goto Cleanup;
+            }
+            Pending[i] = TRUE;
+            Issued++;
+        }
+    }
+
+    QueryPerformanceCounter(&End);
+
+    Elapsed = (End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart;
+    trace("PhysicalDrive%lu, depth %lu: %lu random %u byte reads in %I64u us, %I64u reads/s\n",
+          DriveNumber,
+          Depth,
+          Completed,
+          TEST_READ_SIZE,
+          Elapsed,
+          Elapsed ? (ULONGLONG)Completed * 1000000 / Elapsed : 0);
+
+Cleanup:
+    /* Never free what the driver may still write to */
+    CancelIo(Disk);
+    for (i = 0; i < Depth; i++)
+    {
+        if (Pending[i])
+            GetOverlappedResult(Disk, &Overlapped[i], &Read, TRUE);
+    }
+
+    for (i = 0; i < Depth; i++)
+    {
+        if (Events[i])
+            CloseHandle(Events[i]);
+    }
+
+    VirtualFree(Buffer, 0, MEM_RELEASE);
+}
+
+START_TEST(QueuedRead)
+{
+    static const ULONG Depths[] = { 1, 4, TEST_MAX_DEPTH };
+    GET_LENGTH_INFORMATION LengthInfo;
+    ULONG DriveNumber, i;
+    BOOLEAN CommandQueueing;
+    BOOL Found = FALSE;
+    HANDLE Disk;
+    DWORD Returned;
+
+    for (DriveNumber = 0; DriveNumber < TEST_MAX_DRIVES; DriveNumber++)
+    {
+        Disk = OpenUsbDisk(DriveNumber, &CommandQueueing);
+        if (!Disk)
+            continue;
+
+        Found = TRUE;
+        trace("PhysicalDrive%lu: command queueing %s\n", DriveNumber, CommandQueueing ? "yes" : "no");
+
+        if (!DeviceIoControl(Disk,
+                             IOCTL_DISK_GET_LENGTH_INFO,
+                             NULL,
+                             0,
+                             &LengthInfo,
+                             sizeof(LengthInfo),
+                             &Returned,
+                             NULL) ||
+            LengthInfo.Length.QuadPart < TEST_READ_SIZE)
+        {
+            skip("No length for PhysicalDrive%lu, error %lu\n", DriveNumber, GetLastError());
+            CloseHandle(Disk);
+            continue;
+        }
+
+        for (i = 0; i < RTL_NUMBER_OF(Depths); i++)
+            Test_QueuedRead(Disk, DriveNumber, LengthInfo.Length.QuadPart, Depths[i]);
+
+        CloseHandle(Disk);
+    }
+
+    if (!Found)
+        skip("No USB disk found\n");
+}
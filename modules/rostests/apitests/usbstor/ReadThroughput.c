@@ -0,0 +1,135 @@
+/*
+ * PROJECT:     ReactOS API Tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Read throughput of USB mass storage disks
+ */
+
+#include <apitest.h>
+#include <winioctl.h>
+#include <ntddstor.h>
+
+/* Run it on qemu with e.g.
+   -device qemu-xhci -drive if=none,id=stick,file=disk.img -device usb-storage,drive=stick */
+
+#define TEST_MAX_DRIVES     16
+#define TEST_READ_TOTAL     (16 * 1024 * 1024)
+
+static
+HANDLE
+OpenUsbDisk(ULONG DriveNumber)
+{
+    STORAGE_PROPERTY_QUERY Query;
+    STORAGE_DEVICE_DESCRIPTOR Descriptor;
+    WCHAR Path[MAX_PATH];
+    HANDLE Disk;
+    DWORD Returned;
+
+    swprintf(Path, L"\\\\.\\PhysicalDrive%lu", DriveNumber);
+
+    Disk = CreateFileW(Path,
+                       GENERIC_READ,
+                       FILE_SHARE_READ | FILE_SHARE_WRITE,
+                       NULL,
+                       OPEN_EXISTING,
+                       FILE_FLAG_NO_BUFFERING,
+                       NULL);
+    if (Disk == INVALID_HANDLE_VALUE)
+        return NULL;
+
+    ZeroMemory(&Query, sizeof(Query));
+    Query.PropertyId = StorageDeviceProperty;
+    Query.QueryType = PropertyStandardQuery;
+
+    ZeroMemory(&Descriptor, sizeof(Descriptor));
+    if (!DeviceIoControl(Disk,
+                         IOCTL_STORAGE_QUERY_PROPERTY,
+                         &Query,
+                         sizeof(Query),
+                         &Descriptor,
+                         sizeof(Descriptor),
+                         &Returned,
+                         NULL) ||
+        Descriptor.BusType != BusTypeUsb)
+    {
+        CloseHandle(Disk);
+        return NULL;
+    }
+
+    return Disk;
+}
+
+static
+void
+Test_Read(HANDLE Disk, ULONG DriveNumber, ULONG ReadSize)
+{
+    LARGE_INTEGER Frequency, Start, End, Offset;
+    ULONGLONG Elapsed, Total = 0;
+    PVOID Buffer;
+    DWORD Read;
+
+    /* Unbuffered I/O needs sector aligned buffers */
+    Buffer = VirtualAlloc(NULL, ReadSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    ok(Buffer != NULL, "VirtualAlloc failed with %lu\n", GetLastError());
+    if (!Buffer)
+        return;
+
+    Offset.QuadPart = 0;
+    ok(SetFilePointerEx(Disk, Offset, NULL, FILE_BEGIN), "SetFilePointerEx failed with %lu\n", GetLastError());
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    while (Total < TEST_READ_TOTAL)
+    {
+        if (!ReadFile(Disk, Buffer, ReadSize, &Read, NULL))
+        {
+            ok(0, "ReadFile failed with %lu at %I64u\n", GetLastError(), Total);
+            break;
+        }
+
+        /* The disk may be smaller than what we want to read */
+        if (Read == 0)
+            break;
+
+        ok(Read % 512 == 0, "Read %lu of %lu bytes\n", Read, ReadSize);
+        Total += Read;
+    }
+    QueryPerformanceCounter(&End);
+
+    VirtualFree(Buffer, 0, MEM_RELEASE);
+
+    ok(Total > 0, "Nothing was read\n");
+    if (!Total)
+        return;
+
+    Elapsed = (End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart;
+    trace("PhysicalDrive%lu, %lu KB reads: %I64u KB in %I64u us, %I64u KB/s\n",
+          DriveNumber,
+          ReadSize / 1024,
+          Total / 1024,
+          Elapsed,
+          Elapsed ? Total * 1000000 / 1024 / Elapsed : 0);
+}
+
+START_TEST(ReadThroughput)
+{
+    static const ULONG ReadSizes[] = { 64 * 1024, 256 * 1024, 1024 * 1024 };
+    ULONG DriveNumber, i;
+    BOOL Found = FALSE;
+    HANDLE Disk;
+
+    for (DriveNumber = 0; DriveNumber < TEST_MAX_DRIVES; DriveNumber++)
+    {
+        Disk = OpenUsbDisk(DriveNumber);
+        if (!Disk)
+            continue;
+
+        Found = TRUE;
+        for (i = 0; i < RTL_NUMBER_OF(ReadSizes); i++)
+            Test_Read(Disk, DriveNumber, ReadSizes[i]);
+
+        CloseHandle(Disk);
+    }
+
+    if (!Found)
+        skip("No USB disk found\n");
+}
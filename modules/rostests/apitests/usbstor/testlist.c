@@ -0,0 +1,12 @@
+#define STANDALONE
+#include <apitest.h>
+
+extern void func_QueuedRead(void);
+extern void func_ReadThroughput(void);
+
+const struct test winetest_testlist[] =
+{
+    { "QueuedRead", func_QueuedRead },
+    { "ReadThroughput", func_ReadThroughput },
+    { 0, 0 }
+};
@@ -0,0 +1,252 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Tests and speed of select and WSAPoll on large socket sets
+ */
+
+#include <apitest.h>
+
+#define WIN32_NO_STATUS
+#define _INC_WINDOWS
+#define COM_NO_WINDOWS_H
+#include <stdio.h>
+
+#undef _WIN32_WINNT
+#define _WIN32_WINNT 0x0600
+#include <ws2tcpip.h>
+
+/* IDLE_SOCKETS sockets never see any traffic, ACTIVE_SOCKETS always have a datagram queued */
+#define IDLE_SOCKETS   10000
+#define ACTIVE_SOCKETS 4
+#define WAIT_LOOPS     100
+
+static int (WSAAPI *pWSAPoll)(LPWSAPOLLFD, ULONG, INT);
+static LARGE_INTEGER Frequency;
+static SOCKET Sockets[IDLE_SOCKETS + ACTIVE_SOCKETS];
+static ULONG SocketCount;
+
+static
+SOCKET
+CreateBoundSocket(VOID)
+{
+    struct sockaddr_in addr;
+    SOCKET sock;
+
+    sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock == INVALID_SOCKET)
+        return INVALID_SOCKET;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    addr.sin_port = 0;
+
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) == SOCKET_ERROR)
+    {
+        closesocket(sock);
+        return INVALID_SOCKET;
+    }
+
+    return sock;
+}
+
+static
+BOOL
+IsActive(
+    _In_ SOCKET sock)
+{
+    ULONG i;
+
+    for (i = 0; i < ACTIVE_SOCKETS; i++)
+    {
+        if (Sockets[i] == sock)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+static
+BOOL
+CreateSockets(VOID)
+{
+    struct sockaddr_in addr;
+    int addrlen;
+    SOCKET Sender;
+    ULONG i;
+
+    /* The active sockets come first so that they are easy to check */
+    for (SocketCount = 0; SocketCount < IDLE_SOCKETS + ACTIVE_SOCKETS; SocketCount++)
+    {
+        Sockets[SocketCount] = CreateBoundSocket();
+        if (Sockets[SocketCount] == INVALID_SOCKET)
+            break;
+    }
+
+    if (SocketCount < IDLE_SOCKETS + ACTIVE_SOCKETS)
+        trace("Only %lu sockets could be created, error %d\n", SocketCount, WSAGetLastError());
+    if (SocketCount <= FD_SETSIZE + ACTIVE_SOCKETS)
+        return FALSE;
+
+    Sender = CreateBoundSocket();
+    if (Sender == INVALID_SOCKET)
+        return FALSE;
+
+    for (i = 0; i < ACTIVE_SOCKETS; i++)
+    {
+        addrlen = sizeof(addr);
+        ok(getsockname(Sockets[i], (struct sockaddr *)&addr, &addrlen) == 0,
+           "getsockname failed, error %d\n", WSAGetLastError());
+        ok(sendto(Sender, "ping", 4, 0, (struct sockaddr *)&addr, sizeof(addr)) == 4,
+           "sendto failed, error %d\n", WSAGetLastError());
+    }
+
+    closesocket(Sender);
+    return TRUE;
+}
+
+static
+VOID
+CloseSockets(VOID)
+{
+    while (SocketCount)
+        closesocket(Sockets[--SocketCount]);
+}
+
+static
+VOID
+Test_Select(VOID)
+{
+    struct timeval Timeout = { 1, 0 };
+    LARGE_INTEGER Start, End;
+    fd_set *ReadSet, *Result;
+    ULONG SetSize, Loop, i;
+    int ret;
+
+    SetSize = FIELD_OFFSET(fd_set, fd_array[SocketCount]);
+    ReadSet = HeapAlloc(GetProcessHeap(), 0, SetSize);
+    Result = HeapAlloc(GetProcessHeap(), 0, SetSize);
+
+    ReadSet->fd_count = SocketCount;
+    memcpy(ReadSet->fd_array, Sockets, SocketCount * sizeof(SOCKET));
+
+    /* The first call also waits for the datagrams to arrive */
+    memcpy(Result, ReadSet, SetSize);
+    ret = select(0, Result, NULL, NULL, &Timeout);
+    ok(ret == ACTIVE_SOCKETS, "select returned %d, error %d\n", ret, WSAGetLastError());
+    ok(Result->fd_count == ACTIVE_SOCKETS, "fd_count is %u\n", Result->fd_count);
+    for (i = 0; i < Result->fd_count && i < ACTIVE_SOCKETS; i++)
+        ok(IsActive(Result->fd_array[i]), "Idle socket %Iu is reported\n", Result->fd_array[i]);
+
+    /* Nothing was read, so the same sockets are still ready */
+    QueryPerformanceCounter(&Start);
+    for (Loop = 0; Loop < WAIT_LOOPS; Loop++)
+    {
+        memcpy(Result, ReadSet, SetSize);
+        ret = select(0, Result, NULL, NULL, &Timeout);
+        if (ret != ACTIVE_SOCKETS)
+            break;
+    }
+    QueryPerformanceCounter(&End);
+    ok(Loop == WAIT_LOOPS, "select returned %d in loop %lu, error %d\n", ret, Loop, WSAGetLastError());
+    if (Loop == WAIT_LOOPS && End.QuadPart != Start.QuadPart)
+    {
+        trace("select on %lu sockets: %lu calls/s\n", SocketCount,
+              (ULONG)((ULONGLONG)WAIT_LOOPS * Frequency.QuadPart / (End.QuadPart - Start.QuadPart)));
+    }
+
+    /* An idle set times out */
+    Timeout.tv_sec = 0;
+    Timeout.tv_usec = 10000;
+    Result->fd_count = SocketCount - ACTIVE_SOCKETS;
+    memcpy(Result->fd_array, Sockets + ACTIVE_SOCKETS, Result->fd_count * sizeof(SOCKET));
+    ret = select(0, Result, NULL, NULL, &Timeout);
+    ok(ret == 0, "select returned %d, error %d\n", ret, WSAGetLastError());
+    ok(Result->fd_count == 0, "fd_count is %u\n", Result->fd_count);
+
+    HeapFree(GetProcessHeap(), 0, Result);
+    HeapFree(GetProcessHeap(), 0, ReadSet);
+}
+
+static
+VOID
+Test_WSAPoll(VOID)
+{
+    LARGE_INTEGER Start, End;
+    LPWSAPOLLFD PollFds;
+    ULONG Loop, i, Ready;
+    int ret;
+
+    if (!pWSAPoll)
+    {
+        skip("WSAPoll is not available\n");
+        return;
+    }
+
+    PollFds = HeapAlloc(GetProcessHeap(), 0, SocketCount * sizeof(WSAPOLLFD));
+    for (i = 0; i < SocketCount; i++)
+    {
+        PollFds[i].fd = Sockets[i];
+        PollFds[i].events = POLLRDNORM;
+        PollFds[i].revents = -1;
+    }
+
+    ret = pWSAPoll(PollFds, SocketCount, 1000);
+    ok(ret == ACTIVE_SOCKETS, "WSAPoll returned %d, error %d\n", ret, WSAGetLastError());
+    for (i = 0, Ready = 0; i < SocketCount; i++)
+    {
+        if (PollFds[i].revents)
+            Ready++;
+        if (i < ACTIVE_SOCKETS)
+            ok(PollFds[i].revents == POLLRDNORM, "revents of socket %lu is 0x%x\n", i, PollFds[i].revents);
+    }
+    ok(Ready == ACTIVE_SOCKETS, "%lu sockets are ready\n", Ready);
+
+    QueryPerformanceCounter(&Start);
+    for (Loop = 0; Loop < WAIT_LOOPS; Loop++)
+    {
+        ret = pWSAPoll(PollFds, SocketCount, 1000);
+        if (ret != ACTIVE_SOCKETS)
+            break;
+    }
+    QueryPerformanceCounter(&End);
+    ok(Loop == WAIT_LOOPS, "WSAPoll returned %d in loop %lu, error %d\n", ret, Loop, WSAGetLastError());
+    if (Loop == WAIT_LOOPS && End.QuadPart != Start.QuadPart)
+    {
+        trace("WSAPoll on %lu sockets: %lu calls/s\n", SocketCount,
+              (ULONG)((ULONGLONG)WAIT_LOOPS * Frequency.QuadPart / (End.QuadPart - Start.QuadPart)));
+    }
+
+    /* Invalid handles are reported without waiting */
+    PollFds[0].fd = (SOCKET)0xDEADBEEC;
+    PollFds[1].fd = INVALID_SOCKET;
+    ret = pWSAPoll(PollFds, 2, 1000);
+    ok(ret == 1, "WSAPoll returned %d, error %d\n", ret, WSAGetLastError());
+    ok(PollFds[0].revents == POLLNVAL, "revents is 0x%x\n", PollFds[0].revents);
+    ok(PollFds[1].revents == 0, "revents is 0x%x\n", PollFds[1].revents);
+
+    HeapFree(GetProcessHeap(), 0, PollFds);
+}
+
+START_TEST(PollSet)
+{
+    WSADATA wsaData;
+
+    ok(WSAStartup(MAKEWORD(2, 2), &wsaData) == 0, "WSAStartup failed\n");
+    QueryPerformanceFrequency(&Frequency);
+    pWSAPoll = (PVOID)GetProcAddress(GetModuleHandleW(L"ws2_32.dll"), "WSAPoll");
+
+    if (!CreateSockets())
+    {
+        skip("Not enough sockets for a large set\n");
+        CloseSockets();
+        WSACleanup();
+        return;
+    }
+
+    Test_Select();
+    Test_WSAPoll();
+
+    CloseSockets();
+    WSACleanup();
+}
@@ -0,0 +1,418 @@
+/*
+ * PROJECT:     ReactOS api tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Tests and throughput of TransmitFile and TransmitPackets
+ */
+
+#include "ws2_32.h"
+#include <mswsock.h>
+
+/* A static file of FILE_SIZE bytes is served THROUGHPUT_LOOPS times per method */
+#define FILE_SIZE        (1024 * 1024)
+#define SEND_CHUNK_SIZE  (64 * 1024)
+#define THROUGHPUT_LOOPS 8
+
+typedef struct _RECEIVER
+{
+    SOCKET Socket;
+    PUCHAR Buffer;
+    ULONG BufferSize;
+    ULONG Expected;
+    ULONG Received;
+} RECEIVER, *PRECEIVER;
+
+static LARGE_INTEGER Frequency;
+static LPFN_TRANSMITFILE pfnTransmitFile;
+static LPFN_TRANSMITPACKETS pfnTransmitPackets;
+static PUCHAR FileData;
+
+static
+UCHAR
+FileByte(
+    _In_ ULONG Offset)
+{
+    return (UCHAR)(Offset * 7 + Offset / 4096);
+}
+
+static
+DWORD
+WINAPI
+ReceiverThread(
+    _In_ PVOID Parameter)
+{
+    PRECEIVER Receiver = Parameter;
+    CHAR Discard[4096];
+    PCHAR Buffer;
+    INT Length, Result;
+
+    /* Store what fits in the buffer, drop the rest */
+    while (Receiver->Received < Receiver->Expected)
+    {
+        if (Receiver->Received < Receiver->BufferSize)
+        {
+            Buffer = (PCHAR)Receiver->Buffer + Receiver->Received;
+            Length = Receiver->BufferSize - Receiver->Received;
+        }
+        else
+        {
+            Buffer = Discard;
+            Length = sizeof(Discard);
+        }
+
+        Result = recv(Receiver->Socket, Buffer, Length, 0);
+        if (Result <= 0)
+            break;
+        Receiver->Received += Result;
+    }
+
+    return 0;
+}
+
+static
+HANDLE
+StartReceiver(
+    _Inout_ PRECEIVER Receiver,
+    _In_ SOCKET Socket,
+    _In_opt_ PUCHAR Buffer,
+    _In_ ULONG BufferSize,
+    _In_ ULONG Expected)
+{
+    Receiver->Socket = Socket;
+    Receiver->Buffer = Buffer;
+    Receiver->BufferSize = Buffer ? BufferSize : 0;
+    Receiver->Expected = Expected;
+    Receiver->Received = 0;
+
+    return CreateThread(NULL, 0, ReceiverThread, Receiver, 0, NULL);
+}
+
+static
+ULONG
+FinishReceiver(
+    _In_ HANDLE hThread,
+    _In_ PRECEIVER Receiver)
+{
+    ok(WaitForSingleObject(hThread, 30000) == WAIT_OBJECT_0, "Receiver did not finish\n");
+    CloseHandle(hThread);
+    return Receiver->Received;
+}
+
+static
+BOOL
+ConnectPair(
+    _Out_ SOCKET *Server,
+    _Out_ SOCKET *Client)
+{
+    struct sockaddr_in addr;
+    int addrlen = sizeof(addr);
+    SOCKET Listener;
+
+    *Server = *Client = INVALID_SOCKET;
+
+    Listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (Listener == INVALID_SOCKET)
+        return FALSE;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    addr.sin_port = 0;
+
+    if (bind(Listener, (struct sockaddr *)&addr, sizeof(addr)) == SOCKET_ERROR ||
+        getsockname(Listener, (struct sockaddr *)&addr, &addrlen) == SOCKET_ERROR ||
+        listen(Listener, 1) == SOCKET_ERROR)
+    {
+        closesocket(Listener);
+        return FALSE;
+    }
+
+    *Client = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (*Client != INVALID_SOCKET &&
+        connect(*Client, (struct sockaddr *)&addr, sizeof(addr)) != SOCKET_ERROR)
+    {
+        *Server = accept(Listener, NULL, NULL);
+    }
+
+    closesocket(Listener);
+
+    if (*Server == INVALID_SOCKET)
+    {
+        if (*Client != INVALID_SOCKET)
+            closesocket(*Client);
+        *Client = INVALID_SOCKET;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static
+ULONG
+CheckFileData(
+    _In_ PUCHAR Data,
+    _In_ ULONG Offset,
+    _In_ ULONG Length)
+{
+    ULONG i, cErrors = 0;
+
+    for (i = 0; i < Length; i++)
+    {
+        if (Data[i] != FileByte(Offset + i))
+            cErrors++;
+    }
+    return cErrors;
+}
+
+static
+VOID
+Test_Results(
+    _In_ PCWSTR FileName)
+{
+    static CHAR Head[] = "HTTP/1.0 200 OK\r\n\r\n";
+    static CHAR Tail[] = "<!-- tail -->";
+    TRANSMIT_FILE_BUFFERS Buffers;
+    TRANSMIT_PACKETS_ELEMENT Elements[3];
+    RECEIVER Receiver;
+    SOCKET Server, Client;
+    HANDLE hFile, hThread;
+    PUCHAR Data;
+    ULONG Expected, Received;
+    BOOL Result;
+
+    hFile = CreateFileW(FileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+    ok(hFile != INVALID_HANDLE_VALUE, "CreateFileW failed, error %lu\n", GetLastError());
+    if (hFile == INVALID_HANDLE_VALUE)
+        return;
+
+    if (!ConnectPair(&Server, &Client))
+    {
+        skip("Failed to connect over loopback, error %d\n", WSAGetLastError());
+        CloseHandle(hFile);
+        return;
+    }
+
+    Data = HeapAlloc(GetProcessHeap(), 0, FILE_SIZE + 64);
+
+    /* Head, the whole file and tail */
+    Buffers.Head = Head;
+    Buffers.HeadLength = sizeof(Head) - 1;
+    Buffers.Tail = Tail;
+    Buffers.TailLength = sizeof(Tail) - 1;
+    Expected = Buffers.HeadLength + FILE_SIZE + Buffers.TailLength;
+
+    hThread = StartReceiver(&Receiver, Client, Data, FILE_SIZE + 64, Expected);
+    Result = pfnTransmitFile(Server, hFile, 0, 0, NULL, &Buffers, 0);
+    ok(Result, "TransmitFile failed, error %d\n", WSAGetLastError());
+    Received = FinishReceiver(hThread, &Receiver);
+    ok(Received == Expected, "Received %lu bytes, expected %lu\n", Received, Expected);
+    if (Received == Expected)
+    {
+        ok(!memcmp(Data, Head, Buffers.HeadLength), "Head differs\n");
+        ok_long(CheckFileData(Data + Buffers.HeadLength, 0, FILE_SIZE), 0);
+        ok(!memcmp(Data + Buffers.HeadLength + FILE_SIZE, Tail, Buffers.TailLength), "Tail differs\n");
+    }
+
+    /* Without an overlapped structure the current position is used */
+    SetFilePointer(hFile, FILE_SIZE / 2, NULL, FILE_BEGIN);
+    Expected = 10000;
+    hThread = StartReceiver(&Receiver, Client, Data, FILE_SIZE + 64, Expected);
+    Result = pfnTransmitFile(Server, hFile, Expected, 1000, NULL, NULL, 0);
+    ok(Result, "TransmitFile failed, error %d\n", WSAGetLastError());
+    Received = FinishReceiver(hThread, &Receiver);
+    ok(Received == Expected, "Received %lu bytes, expected %lu\n", Received, Expected);
+    if (Received == Expected)
+        ok_long(CheckFileData(Data, FILE_SIZE / 2, Expected), 0);
+
+    /* Memory, a part of the file, and memory again */
+    Elements[0].dwElFlags = TP_ELEMENT_MEMORY;
+    Elements[0].cLength = sizeof(Head) - 1;
+    Elements[0].pBuffer = Head;
+    Elements[1].dwElFlags = TP_ELEMENT_FILE;
+    Elements[1].cLength = 3 * 4096 + 5;
+    Elements[1].nFileOffset.QuadPart = 4096 + 1;
+    Elements[1].hFile = hFile;
+    Elements[2].dwElFlags = TP_ELEMENT_MEMORY | TP_ELEMENT_EOP;
+    Elements[2].cLength = sizeof(Tail) - 1;
+    Elements[2].pBuffer = Tail;
+    Expected = Elements[0].cLength + Elements[1].cLength + Elements[2].cLength;
+
+    hThread = StartReceiver(&Receiver, Client, Data, FILE_SIZE + 64, Expected);
+    Result = pfnTransmitPackets(Server, Elements, 3, 0, NULL, 0);
+    ok(Result, "TransmitPackets failed, error %d\n", WSAGetLastError());
+    Received = FinishReceiver(hThread, &Receiver);
+    ok(Received == Expected, "Received %lu bytes, expected %lu\n", Received, Expected);
+    if (Received == Expected)
+    {
+        ok(!memcmp(Data, Head, Elements[0].cLength), "Head differs\n");
+        ok_long(CheckFileData(Data + Elements[0].cLength, 4096 + 1, Elements[1].cLength), 0);
+        ok(!memcmp(Data + Elements[0].cLength + Elements[1].cLength, Tail, Elements[2].cLength),
+           "Tail differs\n");
+    }
+
+    /* Data sent after the transmit must come after it */
+    hThread = StartReceiver(&Receiver, Client, Data, FILE_SIZE + 64, FILE_SIZE + 1);
+    Result = pfnTransmitFile(Server, hFile, FILE_SIZE, 0, NULL, NULL, 0);
+    ok(Result, "TransmitFile failed, error %d\n", WSAGetLastError());
+    ok_int(send(Server, "!", 1, 0), 1);
+    Received = FinishReceiver(hThread, &Receiver);
+    ok(Received == FILE_SIZE + 1, "Received %lu bytes\n", Received);
+    if (Received == FILE_SIZE + 1)
+        ok(Data[FILE_SIZE] == '!', "Data after the file is 0x%x\n", Data[FILE_SIZE]);
+
+    /* TF_DISCONNECT shuts down the send direction when the file is out */
+    SetFilePointer(hFile, 0, NULL, FILE_BEGIN);
+    hThread = StartReceiver(&Receiver, Client, NULL, 0, MAXULONG);
+    Result = pfnTransmitFile(Server, hFile, 4096, 0, NULL, NULL, TF_DISCONNECT);
+    ok(Result, "TransmitFile failed, error %d\n", WSAGetLastError());
+    Received = FinishReceiver(hThread, &Receiver);
+    ok(Received == 4096, "Received %lu bytes\n", Received);
+
+    HeapFree(GetProcessHeap(), 0, Data);
+    closesocket(Server);
+    closesocket(Client);
+    CloseHandle(hFile);
+}
+
+static
+VOID
+Test_Throughput(
+    _In_ PCWSTR FileName)
+{
+    LARGE_INTEGER Start, End;
+    RECEIVER Receiver;
+    SOCKET Server, Client;
+    HANDLE hFile, hThread;
+    PCHAR Buffer;
+    ULONG Loop, Received, Total;
+    DWORD cbRead;
+    BOOL Success;
+
+    hFile = CreateFileW(FileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+    ok(hFile != INVALID_HANDLE_VALUE, "CreateFileW failed, error %lu\n", GetLastError());
+    if (hFile == INVALID_HANDLE_VALUE)
+        return;
+
+    if (!ConnectPair(&Server, &Client))
+    {
+        skip("Failed to connect over loopback, error %d\n", WSAGetLastError());
+        CloseHandle(hFile);
+        return;
+    }
+
+    Buffer = HeapAlloc(GetProcessHeap(), 0, SEND_CHUNK_SIZE);
+    Total = THROUGHPUT_LOOPS * FILE_SIZE;
+
+    /* Serve the file from the cache */
+    Success = TRUE;
+    hThread = StartReceiver(&Receiver, Client, NULL, 0, Total);
+    QueryPerformanceCounter(&Start);
+    for (Loop = 0; Loop < THROUGHPUT_LOOPS; Loop++)
+    {
+        SetFilePointer(hFile, 0, NULL, FILE_BEGIN);
+        Success &= pfnTransmitFile(Server, hFile, 0, 0, NULL, NULL, 0);
+    }
+    Received = FinishReceiver(hThread, &Receiver);
+    QueryPerformanceCounter(&End);
+    ok(Success, "TransmitFile failed, error %d\n", WSAGetLastError());
+    ok(Received == Total, "Received %lu bytes, expected %lu\n", Received, Total);
+    if (End.QuadPart != Start.QuadPart)
+    {
+        trace("TransmitFile: %lu KB/s\n",
+              (ULONG)((ULONGLONG)Total * Frequency.QuadPart / (End.QuadPart - Start.QuadPart) / 1024));
+    }
+
+    /* The same with a read and a send per chunk */
+    Success = TRUE;
+    hThread = StartReceiver(&Receiver, Client, NULL, 0, Total);
+    QueryPerformanceCounter(&Start);
+    for (Loop = 0; Loop < THROUGHPUT_LOOPS; Loop++)
+    {
+        SetFilePointer(hFile, 0, NULL, FILE_BEGIN);
+        while (ReadFile(hFile, Buffer, SEND_CHUNK_SIZE, &cbRead, NULL) && cbRead)
+            Success &= (send(Server, Buffer, cbRead, 0) == (int)cbRead);
+    }
+    Received = FinishReceiver(hThread, &Receiver);
+    QueryPerformanceCounter(&End);
+    ok(Success, "send failed, error %d\n", WSAGetLastError());
+    ok(Received == Total, "Received %lu bytes, expected %lu\n", Received, Total);
+    if (End.QuadPart != Start.QuadPart)
+    {
+        trace("ReadFile and send of %u bytes: %lu KB/s\n", SEND_CHUNK_SIZE,
+              (ULONG)((ULONGLONG)Total * Frequency.QuadPart / (End.QuadPart - Start.QuadPart) / 1024));
+    }
+
+    HeapFree(GetProcessHeap(), 0, Buffer);
+    closesocket(Server);
+    closesocket(Client);
+    CloseHandle(hFile);
+}
+
+static
+BOOL
+GetExtensions(VOID)
+{
+    GUID TransmitFileGUID = WSAID_TRANSMITFILE;
+    GUID TransmitPacketsGUID = WSAID_TRANSMITPACKETS;
+    SOCKET sock;
+    DWORD cbRet;
+    int ret;
+
+    sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sock == INVALID_SOCKET)
+        return FALSE;
+
+    ret = WSAIoctl(sock, SIO_GET_EXTENSION_FUNCTION_POINTER,
+                   &TransmitFileGUID, sizeof(TransmitFileGUID),
+                   &pfnTransmitFile, sizeof(pfnTransmitFile), &cbRet, NULL, NULL);
+    ok(ret == 0, "WSAIoctl for TransmitFile failed, error %d\n", WSAGetLastError());
+
+    ret = WSAIoctl(sock, SIO_GET_EXTENSION_FUNCTION_POINTER,
+                   &TransmitPacketsGUID, sizeof(TransmitPacketsGUID),
+                   &pfnTransmitPackets, sizeof(pfnTransmitPackets), &cbRet, NULL, NULL);
+    ok(ret == 0, "WSAIoctl for TransmitPackets failed, error %d\n", WSAGetLastError());
+
+    closesocket(sock);
+    return pfnTransmitFile && pfnTransmitPackets;
+}
+
+START_TEST(TransmitFile)
+{
+    WCHAR TempPath[MAX_PATH], FileName[MAX_PATH];
+    WSADATA wsaData;
+    HANDLE hFile;
+    DWORD cbWritten;
+    ULONG i;
+
+    ok(WSAStartup(MAKEWORD(2, 2), &wsaData) == 0, "WSAStartup failed\n");
+    QueryPerformanceFrequency(&Frequency);
+
+    if (!GetExtensions())
+    {
+        skip("TransmitFile or TransmitPackets is not available\n");
+        WSACleanup();
+        return;
+    }
+
+    FileData = HeapAlloc(GetProcessHeap(), 0, FILE_SIZE);
+    for (i = 0; i < FILE_SIZE; i++)
+        FileData[i] = FileByte(i);
+
+    GetTempPathW(_countof(TempPath), TempPath);
+    GetTempFileNameW(TempPath, L"tf", 0, FileName);
+
+    hFile = CreateFileW(FileName, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, NULL);
+    ok(hFile != INVALID_HANDLE_VALUE, "CreateFileW failed, error %lu\n", GetLastError());
+    if (hFile != INVALID_HANDLE_VALUE)
+    {
+        ok(WriteFile(hFile, FileData, FILE_SIZE, &cbWritten, NULL) && cbWritten == FILE_SIZE,
+           "WriteFile failed, error %lu\n", GetLastError());
+        CloseHandle(hFile);
+
+        Test_Results(FileName);
+        Test_Throughput(FileName);
+    }
+
+    DeleteFileW(FileName);
+    HeapFree(GetProcessHeap(), 0, FileData);
+    WSACleanup();
+}
@@ -28,10 +28,113 @@ CcMdlRead (
     OUT PIO_STATUS_BLOCK IoStatus
     )
 {
+    PROS_VACB Vacb;
+    PROS_SHARED_CACHE_MAP SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
+    NTSTATUS Status;
+    LONGLONG CurrentOffset = FileOffset->QuadPart;
+    ULONG ReadLength = 0;
+    PMDL *FirstMdl, *LastMdl;
+    PMDL Mdl;
+
     CCTRACE(CC_API_DEBUG, "FileObject=%p FileOffset=%I64d Length=%lu\n",
         FileObject, FileOffset->QuadPart, Length);
 
-    UNIMPLEMENTED;
+    /* Append to the chain the caller may already have */
+    LastMdl = MdlChain;
+    while (*LastMdl)
+        LastMdl = &(*LastMdl)->Next;
+    FirstMdl = LastMdl;
+
+    while (Length)
+    {
+        ULONG VacbOffset = CurrentOffset % VACB_MAPPING_GRANULARITY;
+        ULONG VacbLength = min(Length, VACB_MAPPING_GRANULARITY - VacbOffset);
+
+        Status = CcRosGetVacb(SharedCacheMap, CurrentOffset, &Vacb);
+        if (!NT_SUCCESS(Status))
+            goto Unwind;
+
+        /* The VACB reference is kept until CcMdlReadComplete, so that the
+         * view stays mapped as long as its pages are handed out */
+        Mdl = NULL;
+        _SEH2_TRY
+        {
+            CcRosEnsureVacbResident(Vacb, TRUE, FALSE, VacbOffset, VacbLength);
+
+            Mdl = IoAllocateMdl((PUCHAR)Vacb->BaseAddress + VacbOffset, VacbLength, FALSE, FALSE, NULL);
+            if (!Mdl)
+                ExRaiseStatus(STATUS_INSUFFICIENT_RESOURCES);
+
+            MmProbeAndLockPages(Mdl, KernelMode, IoReadAccess);
+        }
+        _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+        {
+            Status = _SEH2_GetExceptionCode();
+        }
+        _SEH2_END;
+
+        if (!NT_SUCCESS(Status))
+        {
+            if (Mdl)
+                IoFreeMdl(Mdl);
+            CcRosReleaseVacb(SharedCacheMap, Vacb, FALSE, FALSE);
+            goto Unwind;
+        }
+
+        *LastMdl = Mdl;
+        LastMdl = &Mdl->Next;
+
+        ReadLength += VacbLength;
+        CurrentOffset += VacbLength;
+        Length -= VacbLength;
+    }
+
+    IoStatus->Status = STATUS_SUCCESS;
+    IoStatus->Information = ReadLength;
+    return;
+
+Unwind:
+    /* Unlock and release what this call appended, the caller's chain is left as it was */
+    if (*FirstMdl)
+    {
+        CcMdlReadComplete2(FileObject, *FirstMdl);
+        *FirstMdl = NULL;
+    }
+    ExRaiseStatus(Status);
+}
+
+static
+VOID
+CcpReleaseMdlVacb (
+    IN PROS_SHARED_CACHE_MAP SharedCacheMap,
+    IN PMDL Mdl)
+{
+    PLIST_ENTRY ListEntry;
+    PROS_VACB Vacb, Found = NULL;
+    ULONG_PTR Address = (ULONG_PTR)MmGetMdlVirtualAddress(Mdl);
+    KIRQL OldIrql;
+
+    OldIrql = KeAcquireQueuedSpinLock(LockQueueMasterLock);
+    KeAcquireSpinLockAtDpcLevel(&SharedCacheMap->CacheMapLock);
+
+    for (ListEntry = SharedCacheMap->CacheMapVacbListHead.Flink;
+         ListEntry != &SharedCacheMap->CacheMapVacbListHead;
+         ListEntry = ListEntry->Flink)
+    {
+        Vacb = CONTAINING_RECORD(ListEntry, ROS_VACB, CacheMapVacbListEntry);
+        if (IsPointInRange((ULONG_PTR)Vacb->BaseAddress, VACB_MAPPING_GRANULARITY, Address))
+        {
+            Found = Vacb;
+            break;
+        }
+    }
+
+    KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
+    KeReleaseQueuedSpinLock(LockQueueMasterLock, OldIrql);
+
+    /* Drop the reference CcMdlRead took */
+    if (Found)
+        CcRosReleaseVacb(SharedCacheMap, Found, FALSE, FALSE);
 }
 
 /*
@@ -58,6 +161,7 @@ CcMdlReadComplete2 (
     IN PMDL MemoryDescriptorList
 )
 {
+    PROS_SHARED_CACHE_MAP SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
     PMDL Mdl;
 
     /* Free MDLs */
@@ -65,6 +169,8 @@ CcMdlReadComplete2 (
     {
         MemoryDescriptorList = Mdl->Next;
         MmUnlockPages(Mdl);
+        if (SharedCacheMap)
+            CcpReleaseMdlVacb(SharedCacheMap, Mdl);
         IoFreeMdl(Mdl);
     }
 }
@@ -116,8 +116,8 @@ CmpDoFlushAll(IN BOOLEAN ForceFlush)
             /* Only sync if we are forced to or if it won't cause a hive shrink */
             if ((ForceFlush) || (!HvHiveWillShrink(&Hive->Hive)))
             {
-                /* Do the sync */
-                Status = HvSyncHive(&Hive->Hive);
+                /* Do the sync, shrinking only with the registry locked down */
+                Status = HvSyncHive(&Hive->Hive, CmpTestRegistryLockExclusive());
 
                 /* If something failed - set the flag and continue looping */
                 if (!NT_SUCCESS(Status)) Result = FALSE;
@@ -1941,6 +1941,7 @@ CmFlushKey(IN PCM_KEY_CONTROL_BLOCK Kcb,
     PCMHIVE CmHive;
     NTSTATUS Status = STATUS_SUCCESS;
     PHHIVE Hive;
+    BOOLEAN WillShrink;
 
     /* Ignore flushes until we're ready */
     if (CmpNoWrite) return STATUS_SUCCESS;
@@ -1965,11 +1966,23 @@ CmFlushKey(IN PCM_KEY_CONTROL_BLOCK Kcb,
         CmHive->ViewLockOwner = KeGetCurrentThread();
 
         /* Will the hive shrink? */
-        if (HvHiveWillShrink(Hive))
+        WillShrink = HvHiveWillShrink(Hive);
+        if ((WillShrink) && !(CmpTestRegistryLockExclusive()))
         {
-            /* I don't believe the current Hv does shrinking */
-            ASSERT(FALSE);
-            // CMP_ASSERT_EXCLUSIVE_REGISTRY_LOCK_OR_LOADING(CmHive);
+            /*
+             * Dropping bins needs the registry locked down, and we only hold
+             * it shared. Sync the hive as it is and leave the shrink to a
+             * forced lazy flush.
+             */
+            WillShrink = FALSE;
+            CmpForceForceFlush = TRUE;
+            CmpLazyFlush();
+        }
+
+        if (WillShrink)
+        {
+            /* Dropping bins needs the registry locked down, keep the views locked */
+            CMP_ASSERT_EXCLUSIVE_REGISTRY_LOCK_OR_LOADING(CmHive);
         }
         else
         {
@@ -1985,12 +1998,19 @@ CmFlushKey(IN PCM_KEY_CONTROL_BLOCK Kcb,
         }
 
         /* Flush only this hive */
-        if (!HvSyncHive(Hive))
+        if (!HvSyncHive(Hive, WillShrink))
         {
             /* Fail */
             Status = STATUS_REGISTRY_IO_FAILED;
         }
 
+        /* Release the views if we kept them locked for the shrink */
+        if (WillShrink)
+        {
+            CmHive->ViewLockOwner = NULL;
+            KeReleaseGuardedMutex(CmHive->ViewLock);
+        }
+
         /* Release the flush lock */
         CmpUnlockHiveFlusher(CmHive);
     }
@@ -2112,9 +2132,9 @@ CmLoadKey(IN POBJECT_ATTRIBUTES TargetKey,
         /* Sync the hive if necessary */
         if (Allocate)
         {
-            /* Sync it under the flusher lock */
+            /* Sync it under the flusher lock, a new hive has nothing to shrink */
             CmpLockHiveFlusherExclusive(CmHive);
-            HvSyncHive(&CmHive->Hive);
+            HvSyncHive(&CmHive->Hive, FALSE);
             CmpUnlockHiveFlusher(CmHive);
         }
 
@@ -2440,199 +2460,6 @@ CmpEnumerateOpenSubKeys(
     return SubKeys;
 }
 
-static
-NTSTATUS
-CmpDeepCopyKeyInternal(IN PHHIVE SourceHive,
-                       IN HCELL_INDEX SrcKeyCell,
-                       IN PHHIVE DestinationHive,
-                       IN HCELL_INDEX Parent,
-                       IN HSTORAGE_TYPE StorageType,
-                       OUT PHCELL_INDEX DestKeyCell OPTIONAL)
-{
-    NTSTATUS Status;
-    PCM_KEY_NODE SrcNode;
-    PCM_KEY_NODE DestNode = NULL;
-    HCELL_INDEX NewKeyCell = HCELL_NIL;
-    HCELL_INDEX NewClassCell = HCELL_NIL, NewSecCell = HCELL_NIL;
-    HCELL_INDEX SubKey, NewSubKey;
-    ULONG Index, SubKeyCount;
-
-    PAGED_CODE();
-
-    DPRINT("CmpDeepCopyKeyInternal(0x%08X, 0x%08X, 0x%08X, 0x%08X, 0x%08X, 0x%08X)\n",
-           SourceHive,
-           SrcKeyCell,
-           DestinationHive,
-           Parent,
-           StorageType,
-           DestKeyCell);
-
-    /* Get the source cell node */
-    SrcNode = HvGetCell(SourceHive, SrcKeyCell);
-    ASSERT(SrcNode);
-
-    /* Sanity check */
-    ASSERT(SrcNode->Signature == CM_KEY_NODE_SIGNATURE);
-
-    /* Create a simple copy of the source key */
-    NewKeyCell = CmpCopyCell(SourceHive,
-                             SrcKeyCell,
-                             DestinationHive,
-                             StorageType);
-    if (NewKeyCell == HCELL_NIL)
-    {
-        /* Not enough storage space */
-        Status = STATUS_INSUFFICIENT_RESOURCES;
-        goto Cleanup;
-    }
-
-    /* Get the destination cell node */
-    DestNode = HvGetCell(DestinationHive, NewKeyCell);
-    ASSERT(DestNode);
-
-    /* Set the parent and copy the flags */
-    DestNode->Parent = Parent;
-    DestNode->Flags  = (SrcNode->Flags & KEY_COMP_NAME); // Keep only the single permanent flag
-    if (Parent == HCELL_NIL)
-    {
-        /* This is the new root node */
-        DestNode->Flags |= KEY_HIVE_ENTRY | KEY_NO_DELETE;
-    }
-
-    /* Copy the class cell */
-    if (SrcNode->ClassLength > 0)
-    {
-        NewClassCell = CmpCopyCell(SourceHive,
-                                   SrcNode->Class,
-                                   DestinationHive,
-                                   StorageType);
-        if (NewClassCell == HCELL_NIL)
-        {
-            /* Not enough storage space */
-            Status = STATUS_INSUFFICIENT_RESOURCES;
-            goto Cleanup;
-        }
-
-        DestNode->Class = NewClassCell;
-        DestNode->ClassLength = SrcNode->ClassLength;
-    }
-    else
-    {
-        DestNode->Class = HCELL_NIL;
-        DestNode->ClassLength = 0;
-    }
-
-    /* Copy the security cell (FIXME: HACKish poor-man version) */
-    if (SrcNode->Security != HCELL_NIL)
-    {
-        NewSecCell = CmpCopyCell(SourceHive,
-                                 SrcNode->Security,
-                                 DestinationHive,
-                                 StorageType);
-        if (NewSecCell == HCELL_NIL)
-        {
-            /* Not enough storage space */
-            Status = STATUS_INSUFFICIENT_RESOURCES;
-            goto Cleanup;
-        }
-    }
-    DestNode->Security = NewSecCell;
-
-    /* Copy the value list */
-    Status = CmpCopyKeyValueList(SourceHive,
-                                 &SrcNode->ValueList,
-                                 DestinationHive,
-                                 &DestNode->ValueList,
-                                 StorageType);
-    if (!NT_SUCCESS(Status))
-        goto Cleanup;
-
-    /* Clear the invalid subkey index */
-    DestNode->SubKeyCounts[Stable] = DestNode->SubKeyCounts[Volatile] = 0;
-    DestNode->SubKeyLists[Stable] = DestNode->SubKeyLists[Volatile] = HCELL_NIL;
-
-    /* Calculate the total number of subkeys */
-    SubKeyCount = SrcNode->SubKeyCounts[Stable] + SrcNode->SubKeyCounts[Volatile];
-
-    /* Loop through all the subkeys */
-    for (Index = 0; Index < SubKeyCount; Index++)
-    {
-        /* Get the subkey */
-        SubKey = CmpFindSubKeyByNumber(SourceHive, SrcNode, Index);
-        ASSERT(SubKey != HCELL_NIL);
-
-        /* Call the function recursively for the subkey */
-        //
-        // FIXME: Danger!! Kernel stack exhaustion!!
-        //
-        Status = CmpDeepCopyKeyInternal(SourceHive,
-                                        SubKey,
-                                        DestinationHive,
-                                        NewKeyCell,
-                                        StorageType,
-                                        &NewSubKey);
-        if (!NT_SUCCESS(Status))
-            goto Cleanup;
-
-        /* Add the copy of the subkey to the new key */
-        if (!CmpAddSubKey(DestinationHive,
-                          NewKeyCell,
-                          NewSubKey))
-        {
-            /* Cleanup allocated cell */
-            HvFreeCell(DestinationHive, NewSubKey);
-
-            Status = STATUS_INSUFFICIENT_RESOURCES;
-            goto Cleanup;
-        }
-    }
-
-    /* Set success */
-    Status = STATUS_SUCCESS;
-
-Cleanup:
-
-    /* Release the cells */
-    if (DestNode) HvReleaseCell(DestinationHive, NewKeyCell);
-    if (SrcNode) HvReleaseCell(SourceHive, SrcKeyCell);
-
-    /* Cleanup allocated cells in case of failure */
-    if (!NT_SUCCESS(Status))
-    {
-        if (NewSecCell != HCELL_NIL)
-            HvFreeCell(DestinationHive, NewSecCell);
-
-        if (NewClassCell != HCELL_NIL)
-            HvFreeCell(DestinationHive, NewClassCell);
-
-        if (NewKeyCell != HCELL_NIL)
-            HvFreeCell(DestinationHive, NewKeyCell);
-
-        NewKeyCell = HCELL_NIL;
-    }
-
-    /* Set the cell index if requested and return status */
-    if (DestKeyCell) *DestKeyCell = NewKeyCell;
-    return Status;
-}
-
-NTSTATUS
-NTAPI
-CmpDeepCopyKey(IN PHHIVE SourceHive,
-               IN HCELL_INDEX SrcKeyCell,
-               IN PHHIVE DestinationHive,
-               IN HSTORAGE_TYPE StorageType,
-               OUT PHCELL_INDEX DestKeyCell OPTIONAL)
-{
-    /* Call the internal function */
-    return CmpDeepCopyKeyInternal(SourceHive,
-                                  SrcKeyCell,
-                                  DestinationHive,
-                                  HCELL_NIL,
-                                  StorageType,
-                                  DestKeyCell);
-}
-
 NTSTATUS
 NTAPI
 CmSaveKey(IN PCM_KEY_CONTROL_BLOCK Kcb,
@@ -99,8 +99,6 @@ CmpInitializeHive(OUT PCMHIVE *CmHive,
     Hive->UseCountLog.Next = 0;
     Hive->LockHiveLog.Next = 0;
     Hive->FileObject = NULL;
-    Hive->NotifyList.Flink = NULL;
-    Hive->NotifyList.Blink = NULL;
 
     /* Set the loading flag */
     Hive->HiveIsLoading = TRUE;
@@ -109,6 +107,7 @@ CmpInitializeHive(OUT PCMHIVE *CmHive,
     Hive->CreatorOwner = KeGetCurrentThread();
 
     /* Initialize lists */
+    InitializeListHead(&Hive->NotifyList);
     InitializeListHead(&Hive->KcbConvertListHead);
     InitializeListHead(&Hive->KnodeConvertListHead);
     InitializeListHead(&Hive->TrustClassEntry);
@@ -170,6 +169,14 @@ CmpInitializeHive(OUT PCMHIVE *CmHive,
     Hive->Flags = 0;
     Hive->FlushCount = 0;
 
+    /* Back file hives with a copy-on-write view of their primary file */
+    if ((OperationType == HINIT_FILE) && (Primary))
+    {
+        /* If we can't map it, fall back to reading the whole file in */
+        if (NT_SUCCESS(CmpMapHiveFile(Hive, &HiveData)))
+            OperationType = HINIT_MAPFILE;
+    }
+
     /* Initialize it */
     Status = HvInitialize(&Hive->Hive,
                           OperationType,
@@ -187,6 +194,7 @@ CmpInitializeHive(OUT PCMHIVE *CmHive,
     if (!NT_SUCCESS(Status))
     {
         /* Cleanup allocations and fail */
+        CmpDestroyHiveViewList(Hive);
         ExDeleteResourceLite(Hive->FlusherLock);
         ExFreePoolWithTag(Hive->FlusherLock, TAG_CMHIVE);
         ExFreePoolWithTag(Hive->ViewLock, TAG_CMHIVE);
@@ -205,6 +213,7 @@ CmpInitializeHive(OUT PCMHIVE *CmHive,
         if (CheckStatus != 0)
         {
             /* Cleanup allocations and fail */
+            CmpDestroyHiveViewList(Hive);
             ExDeleteResourceLite(Hive->FlusherLock);
             ExFreePoolWithTag(Hive->FlusherLock, TAG_CMHIVE);
             ExFreePoolWithTag(Hive->ViewLock, TAG_CMHIVE);
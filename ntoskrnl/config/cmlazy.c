@@ -75,12 +75,19 @@ CmpDoFlushNextHive(_In_  BOOLEAN ForceFlush,
                 CmHive->FlushCount = CmpLazyFlushCount;
                 DPRINT("Hive %wZ is clean.\n", &CmHive->FileFullPath);
             }
+            else if (!ForceFlush && HvHiveWillShrink(&CmHive->Hive))
+            {
+                /* Shrinking needs the registry locked down, leave it to a forced flush */
+                DPRINT("Hive %wZ will shrink, deferring it.\n", &CmHive->FileFullPath);
+                *DirtyCount += CmHive->Hive.DirtyCount;
+                CmpForceForceFlush = TRUE;
+            }
             else
             {
                 /* Do the sync */
                 DPRINT("Flushing: %wZ\n", &CmHive->FileFullPath);
                 DPRINT("Handle: %p\n", CmHive->FileHandles[HFILE_TYPE_PRIMARY]);
-                Status = HvSyncHive(&CmHive->Hive);
+                Status = HvSyncHive(&CmHive->Hive, ForceFlush);
                 if(!NT_SUCCESS(Status))
                 {
                     /* Let them know we failed */
@@ -194,6 +201,7 @@ CmpLazyFlushWorker(IN PVOID Parameter)
         DPRINT("Forcing flush.\n");
         /* Lock the registry exclusively */
         CmpLockRegistryExclusive();
+        CmpForceForceFlush = FALSE;
     }
     else
     {
@@ -16,6 +16,24 @@
 
 /* FUNCTIONS *****************************************************************/
 
+static
+VOID
+CmpUnmapCmView(IN PCM_VIEW_OF_FILE CmView)
+{
+    /* Unmap the view, if any, and release its section */
+    if (CmView->ViewAddress)
+    {
+        MmUnmapViewInSystemSpace(CmView->ViewAddress);
+        CmView->ViewAddress = NULL;
+    }
+
+    if (CmView->Bcb)
+    {
+        ObDereferenceObject(CmView->Bcb);
+        CmView->Bcb = NULL;
+    }
+}
+
 VOID
 NTAPI
 CmpInitHiveViewList(IN PCMHIVE Hive)
@@ -47,7 +65,8 @@ CmpDestroyHiveViewList(IN PCMHIVE Hive)
 
         CmView = CONTAINING_RECORD(EntryList, CM_VIEW_OF_FILE, PinViewList);
 
-        /* FIXME: Unmap the view if it is mapped */
+        /* Unmap the view if it is mapped */
+        CmpUnmapCmView(CmView);
 
         ExFreePool(CmView);
 
@@ -65,7 +84,8 @@ CmpDestroyHiveViewList(IN PCMHIVE Hive)
 
         CmView = CONTAINING_RECORD(EntryList, CM_VIEW_OF_FILE, LRUViewList);
 
-        /* FIXME: Unmap the view if it is mapped */
+        /* Unmap the view if it is mapped */
+        CmpUnmapCmView(CmView);
 
         ExFreePool(CmView);
 
@@ -75,6 +95,130 @@ CmpDestroyHiveViewList(IN PCMHIVE Hive)
     /* The LRU View List should be empty */
     ASSERT(IsListEmpty(&Hive->LRUViewListHead) == TRUE);
     ASSERT(Hive->MappedViews == 0);
+
+    /* Drop the reference the views held on the primary file */
+    if (Hive->FileObject)
+    {
+        ObDereferenceObject(Hive->FileObject);
+        Hive->FileObject = NULL;
+    }
+}
+
+NTSTATUS
+NTAPI
+CmpMapHiveFile(IN PCMHIVE Hive,
+               OUT PVOID *HiveImage)
+{
+    HANDLE FileHandle = Hive->FileHandles[HFILE_TYPE_PRIMARY];
+    FILE_STANDARD_INFORMATION FileInformation;
+    IO_STATUS_BLOCK IoStatusBlock;
+    PFILE_OBJECT FileObject;
+    PVOID SectionObject;
+    PVOID ViewBase = NULL;
+    SIZE_T ViewSize = 0;
+    PCM_VIEW_OF_FILE CmView;
+    NTSTATUS Status;
+    PAGED_CODE();
+
+    /* Assume failure */
+    *HiveImage = NULL;
+    ASSERT(FileHandle != NULL);
+    ASSERT(Hive->FileObject == NULL);
+
+    /* Get the size of the primary file */
+    Status = ZwQueryInformationFile(FileHandle,
+                                    &IoStatusBlock,
+                                    &FileInformation,
+                                    sizeof(FileInformation),
+                                    FileStandardInformation);
+    if (!NT_SUCCESS(Status)) return Status;
+
+    /* It must at least hold the base block and one bin, and fit in a view */
+    if ((FileInformation.EndOfFile.HighPart != 0) ||
+        (FileInformation.EndOfFile.LowPart < 2 * HBLOCK_SIZE))
+    {
+        return STATUS_REGISTRY_CORRUPT;
+    }
+
+    /* Get the file object, the handle is a kernel one */
+    Status = ObReferenceObjectByHandle(FileHandle,
+                                       FILE_READ_DATA,
+                                       IoFileObjectType,
+                                       KernelMode,
+                                       (PVOID*)&FileObject,
+                                       NULL);
+    if (!NT_SUCCESS(Status)) return Status;
+
+    /*
+     * Create a copy-on-write section over the whole file: pages we only
+     * read stay shared with the cache and can be discarded at will, the
+     * ones we modify become private until HvSyncHive writes the dirty
+     * blocks back through the regular file write path.
+     */
+    Status = MmCreateSection(&SectionObject,
+                             SECTION_MAP_READ,
+                             NULL,
+                             &FileInformation.EndOfFile,
+                             PAGE_WRITECOPY,
+                             SEC_COMMIT,
+                             NULL,
+                             FileObject);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT("Failed to create the hive section: 0x%lx\n", Status);
+        ObDereferenceObject(FileObject);
+        return Status;
+    }
+
+    /* Map it in system space, pages will be brought in on demand */
+    Status = MmMapViewInSystemSpace(SectionObject, &ViewBase, &ViewSize);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT("Failed to map the hive view: 0x%lx\n", Status);
+        ObDereferenceObject(SectionObject);
+        ObDereferenceObject(FileObject);
+        return Status;
+    }
+
+    /* Make sure the bins described by the base block are inside the file */
+    if (((PHBASE_BLOCK)ViewBase)->Length >
+        FileInformation.EndOfFile.LowPart - HBLOCK_SIZE)
+    {
+        MmUnmapViewInSystemSpace(ViewBase);
+        ObDereferenceObject(SectionObject);
+        ObDereferenceObject(FileObject);
+        return STATUS_REGISTRY_CORRUPT;
+    }
+
+    /* Allocate the view descriptor */
+    CmView = ExAllocatePoolWithTag(PagedPool, sizeof(CM_VIEW_OF_FILE), TAG_CM);
+    if (!CmView)
+    {
+        MmUnmapViewInSystemSpace(ViewBase);
+        ObDereferenceObject(SectionObject);
+        ObDereferenceObject(FileObject);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    /* Setup it, the section object stands for the BCB */
+    CmView->FileOffset = 0;
+    CmView->Size = FileInformation.EndOfFile.LowPart;
+    CmView->ViewAddress = ViewBase;
+    CmView->Bcb = SectionObject;
+    CmView->UseCount = 1;
+    InitializeListHead(&CmView->PinViewList);
+
+    /* The view stays mapped for the whole hive lifetime */
+    InsertTailList(&Hive->LRUViewListHead, &CmView->LRUViewList);
+    Hive->MappedViews++;
+    Hive->FileObject = FileObject;
+
+    DPRINT("Mapped hive %wZ at %p (0x%lx bytes)\n",
+           &FileObject->FileName, ViewBase, CmView->Size);
+
+    /* Return the hive image */
+    *HiveImage = ViewBase;
+    return STATUS_SUCCESS;
 }
 
 /* EOF */
@@ -2,7 +2,7 @@
  * PROJECT:         ReactOS Kernel
  * LICENSE:         GPL - See COPYING in the top level directory
  * FILE:            ntoskrnl/config/cmnotify.c
- * PURPOSE:         Configuration Manager - Wrappers for Hive Operations
+ * PURPOSE:         Configuration Manager - Change Notification Engine
  * PROGRAMMERS:     Alex Ionescu (alex.ionescu@reactos.org)
  */
 
@@ -12,8 +12,206 @@
 #define NDEBUG
 #include "debug.h"
 
+/* GLOBALS *******************************************************************/
+
+/*
+ * Protects the notify lists of all hives, the post lists of all notify
+ * blocks, the post block lists of all threads, and the NotifyBlock field
+ * of all key bodies.
+ */
+KGUARDED_MUTEX CmpPostLock;
+
 /* FUNCTIONS *****************************************************************/
 
+VOID
+NTAPI
+CmpFreePostBlock(IN PCM_POST_BLOCK PostBlock)
+{
+    /* Drop the references the post block was holding */
+    if (PostBlock->UserEvent) ObDereferenceObject(PostBlock->UserEvent);
+    if (PostBlock->Thread) ObDereferenceObject(PostBlock->Thread);
+
+    /* And free it */
+    ExFreePoolWithTag(PostBlock, TAG_CMPB);
+}
+
+VOID
+NTAPI
+CmpPostApcRundownRoutine(IN PKAPC Apc)
+{
+    /* The thread died before the APC could run, just free the block */
+    CmpFreePostBlock(CONTAINING_RECORD(Apc, CM_POST_BLOCK, Apc));
+}
+
+VOID
+NTAPI
+CmpPostUserApcKernelRoutine(IN PKAPC Apc,
+                            IN PKNORMAL_ROUTINE* NormalRoutine,
+                            IN PVOID* NormalContext,
+                            IN PVOID* SystemArgument1,
+                            IN PVOID* SystemArgument2)
+{
+    /* The caller's APC routine is about to run, we don't need the block */
+    CmpFreePostBlock(CONTAINING_RECORD(Apc, CM_POST_BLOCK, Apc));
+}
+
+VOID
+NTAPI
+CmpPostApcKernelRoutine(IN PKAPC Apc,
+                        IN PKNORMAL_ROUTINE* NormalRoutine,
+                        IN PVOID* NormalContext,
+                        IN PVOID* SystemArgument1,
+                        IN PVOID* SystemArgument2)
+{
+    PCM_POST_BLOCK PostBlock = CONTAINING_RECORD(Apc, CM_POST_BLOCK, Apc);
+
+    /* We're now in the context of the caller, so write the I/O status */
+    _SEH2_TRY
+    {
+        PostBlock->IoStatusBlock->Status = PostBlock->Status;
+        PostBlock->IoStatusBlock->Information = 0;
+    }
+    _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+    {
+        /* Ignore, there's nobody to report this to */
+    }
+    _SEH2_END;
+
+    /* Signal the caller's event, if any */
+    if (PostBlock->UserEvent)
+    {
+        KeSetEvent(PostBlock->UserEvent, IO_NO_INCREMENT, FALSE);
+    }
+
+    /* Check if the caller also wanted an APC */
+    if (PostBlock->ApcRoutine)
+    {
+        /* Re-use our APC to deliver it, same as I/O completion does */
+        KeInitializeApc(&PostBlock->Apc,
+                        &PostBlock->Thread->Tcb,
+                        OriginalApcEnvironment,
+                        CmpPostUserApcKernelRoutine,
+                        CmpPostApcRundownRoutine,
+                        (PKNORMAL_ROUTINE)PostBlock->ApcRoutine,
+                        PostBlock->PreviousMode,
+                        PostBlock->ApcContext);
+        if (KeInsertQueueApc(&PostBlock->Apc,
+                             PostBlock->IoStatusBlock,
+                             NULL,
+                             IO_NO_INCREMENT))
+        {
+            /* The block will be freed once the APC is delivered */
+            return;
+        }
+    }
+
+    /* We're done with this post block */
+    CmpFreePostBlock(PostBlock);
+}
+
+static
+VOID
+CmpCompletePost(IN PCM_POST_BLOCK PostBlock,
+                IN NTSTATUS Status)
+{
+    /* Unlink it from its notify block and from its thread */
+    RemoveEntryList(&PostBlock->NotifyList);
+    RemoveEntryList(&PostBlock->ThreadList);
+    InitializeListHead(&PostBlock->NotifyList);
+    InitializeListHead(&PostBlock->ThreadList);
+    PostBlock->Status = Status;
+
+    /* Synchronous callers are waiting on the block itself, just wake them */
+    if (PostBlock->Synchronous)
+    {
+        KeSetEvent(&PostBlock->WaitEvent, IO_NO_INCREMENT, FALSE);
+        return;
+    }
+
+    /* Otherwise complete the request in the context of the caller */
+    KeInitializeApc(&PostBlock->Apc,
+                    &PostBlock->Thread->Tcb,
+                    OriginalApcEnvironment,
+                    CmpPostApcKernelRoutine,
+                    CmpPostApcRundownRoutine,
+                    NULL,
+                    KernelMode,
+                    NULL);
+    if (!KeInsertQueueApc(&PostBlock->Apc, NULL, NULL, IO_NO_INCREMENT))
+    {
+        /* The thread is going away, nobody can get the result */
+        CmpFreePostBlock(PostBlock);
+    }
+}
+
+static
+BOOLEAN
+CmpIsKcbInNotifyScope(IN PCM_NOTIFY_BLOCK NotifyBlock,
+                      IN PCM_KEY_CONTROL_BLOCK Kcb)
+{
+    PCM_KEY_CONTROL_BLOCK WatchedKcb = NotifyBlock->KeyControlBlock;
+    ULONG Levels;
+
+    /* An exact match is always in scope */
+    if (WatchedKcb == Kcb) return TRUE;
+
+    /* Otherwise, we need to be watching the whole tree below the key */
+    if (!NotifyBlock->WatchTree) return FALSE;
+
+    /* The changed key must be deeper than the one being watched */
+    if (Kcb->TotalLevels <= WatchedKcb->TotalLevels) return FALSE;
+
+    /* Climb up to the depth of the watched key and compare */
+    for (Levels = Kcb->TotalLevels - WatchedKcb->TotalLevels; Levels; Levels--)
+    {
+        Kcb = Kcb->ParentKcb;
+        if (!Kcb) return FALSE;
+    }
+    return (Kcb == WatchedKcb);
+}
+
+static
+VOID
+CmpReportNotifyHelper(IN PCM_KEY_CONTROL_BLOCK Kcb,
+                      IN PCMHIVE CmHive,
+                      IN ULONG Filter)
+{
+    PLIST_ENTRY NextEntry;
+    PCM_NOTIFY_BLOCK NotifyBlock;
+    PCM_POST_BLOCK PostBlock;
+
+    /* Loop every notify block registered on this hive */
+    for (NextEntry = CmHive->NotifyList.Flink;
+         NextEntry != &CmHive->NotifyList;
+         NextEntry = NextEntry->Flink)
+    {
+        /* Skip it if it doesn't care about this change */
+        NotifyBlock = CONTAINING_RECORD(NextEntry, CM_NOTIFY_BLOCK, HiveList);
+        if (!(NotifyBlock->Filter & Filter)) continue;
+        if (!CmpIsKcbInNotifyScope(NotifyBlock, Kcb)) continue;
+
+        /*
+         * If nobody is waiting, remember that something changed, so that the
+         * next request completes at once. Further changes until then are all
+         * folded into this one, which is what keeps write storms cheap.
+         */
+        if (IsListEmpty(&NotifyBlock->PostList))
+        {
+            NotifyBlock->NotifyPending = TRUE;
+            continue;
+        }
+
+        /* Complete every waiter */
+        while (!IsListEmpty(&NotifyBlock->PostList))
+        {
+            PostBlock = CONTAINING_RECORD(NotifyBlock->PostList.Flink,
+                                          CM_POST_BLOCK,
+                                          NotifyList);
+            CmpCompletePost(PostBlock, STATUS_NOTIFY_ENUM_DIR);
+        }
+    }
+}
+
 VOID
 NTAPI
 CmpReportNotify(IN PCM_KEY_CONTROL_BLOCK Kcb,
@@ -21,8 +219,124 @@ CmpReportNotify(IN PCM_KEY_CONTROL_BLOCK Kcb,
                 IN HCELL_INDEX Cell,
                 IN ULONG Filter)
 {
-    /* FIXME: TODO */
-    return;
+    PCMHIVE CmHive;
+    DBG_UNREFERENCED_PARAMETER(Hive);
+    DBG_UNREFERENCED_PARAMETER(Cell);
+
+    /*
+     * Creating or deleting a key changes the subkey list of its parent, so
+     * that's who we report the change on.
+     */
+    if (Filter == REG_NOTIFY_CHANGE_NAME)
+    {
+        Kcb = Kcb->ParentKcb;
+        if (!Kcb) return;
+    }
+
+    /* Don't bother with the lock if nobody can be listening */
+    CmHive = (PCMHIVE)Kcb->KeyHive;
+    if ((IsListEmpty(&CmHive->NotifyList)) &&
+        (IsListEmpty(&CmiVolatileHive->NotifyList)))
+    {
+        return;
+    }
+
+    /* Report to the key's own hive */
+    KeAcquireGuardedMutex(&CmpPostLock);
+    CmpReportNotifyHelper(Kcb, CmHive, Filter);
+
+    /*
+     * Every hive hangs off the master hive, so also report to anyone watching
+     * the tree from there.
+     */
+    if (CmHive != CmiVolatileHive)
+    {
+        CmpReportNotifyHelper(Kcb, CmiVolatileHive, Filter);
+    }
+    KeReleaseGuardedMutex(&CmpPostLock);
+}
+
+NTSTATUS
+NTAPI
+CmpInsertNotifyPost(IN PCM_KEY_BODY KeyBody,
+                    IN ULONG Filter,
+                    IN BOOLEAN WatchTree,
+                    IN PCM_POST_BLOCK PostBlock)
+{
+    PCM_KEY_CONTROL_BLOCK Kcb = KeyBody->KeyControlBlock;
+    PCM_NOTIFY_BLOCK NotifyBlock, NewNotifyBlock = NULL;
+    NTSTATUS Status = STATUS_PENDING;
+
+    /* Lock the registry and the KCB */
+    CmpLockRegistry();
+    CmpAcquireKcbLockShared(Kcb);
+
+    /* Don't touch deleted keys */
+    if (Kcb->Delete)
+    {
+        Status = STATUS_KEY_DELETED;
+        goto Quickie;
+    }
+
+    /* Allocate a notify block up front if this key body doesn't have one */
+    if (!KeyBody->NotifyBlock)
+    {
+        NewNotifyBlock = ExAllocatePoolWithTag(PagedPool,
+                                               sizeof(CM_NOTIFY_BLOCK),
+                                               TAG_CMNB);
+        if (!NewNotifyBlock)
+        {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto Quickie;
+        }
+    }
+
+    /* Lock the notify lists */
+    KeAcquireGuardedMutex(&CmpPostLock);
+
+    /* Check if we lost the race to another caller */
+    NotifyBlock = KeyBody->NotifyBlock;
+    if (!NotifyBlock)
+    {
+        /*
+         * Set up the notify block. Like Windows, only the filter of the first
+         * request on a handle is used, later requests just queue more posts.
+         */
+        NotifyBlock = NewNotifyBlock;
+        NewNotifyBlock = NULL;
+        InitializeListHead(&NotifyBlock->PostList);
+        NotifyBlock->KeyControlBlock = Kcb;
+        NotifyBlock->KeyBody = KeyBody;
+        NotifyBlock->Filter = Filter;
+        NotifyBlock->WatchTree = WatchTree;
+        NotifyBlock->NotifyPending = FALSE;
+        InsertTailList(&((PCMHIVE)Kcb->KeyHive)->NotifyList,
+                       &NotifyBlock->HiveList);
+        KeyBody->NotifyBlock = NotifyBlock;
+    }
+
+    /* Queue the post on the notify block and on the thread */
+    InsertTailList(&NotifyBlock->PostList, &PostBlock->NotifyList);
+    InsertTailList(&PostBlock->Thread->PostBlockList, &PostBlock->ThreadList);
+
+    /* If changes came in since the last request, complete it right away */
+    if (NotifyBlock->NotifyPending)
+    {
+        NotifyBlock->NotifyPending = FALSE;
+        CmpCompletePost(PostBlock, STATUS_NOTIFY_ENUM_DIR);
+    }
+
+    /* Release the notify lock */
+    KeReleaseGuardedMutex(&CmpPostLock);
+
+Quickie:
+    /* Release the locks */
+    CmpReleaseKcbLock(Kcb);
+    CmpUnlockRegistry();
+
+    /* Free the notify block if we didn't end up needing it */
+    if (NewNotifyBlock) ExFreePoolWithTag(NewNotifyBlock, TAG_CMNB);
+    return Status;
 }
 
 VOID
@@ -30,7 +344,68 @@ NTAPI
 CmpFlushNotify(IN PCM_KEY_BODY KeyBody,
                IN BOOLEAN LockHeld)
 {
-    /* FIXME: TODO */
-    return;
+    PCM_NOTIFY_BLOCK NotifyBlock;
+    PCM_POST_BLOCK PostBlock;
+    DBG_UNREFERENCED_PARAMETER(LockHeld);
+
+    /* Lock the notify lists and grab the notify block */
+    KeAcquireGuardedMutex(&CmpPostLock);
+    NotifyBlock = KeyBody->NotifyBlock;
+    if (!NotifyBlock)
+    {
+        /* Someone else flushed it already */
+        KeReleaseGuardedMutex(&CmpPostLock);
+        return;
+    }
+
+    /* Complete every waiter, the key is going away */
+    while (!IsListEmpty(&NotifyBlock->PostList))
+    {
+        PostBlock = CONTAINING_RECORD(NotifyBlock->PostList.Flink,
+                                      CM_POST_BLOCK,
+                                      NotifyList);
+        CmpCompletePost(PostBlock, STATUS_NOTIFY_CLEANUP);
+    }
+
+    /* Unlink the notify block from the hive and the key body */
+    RemoveEntryList(&NotifyBlock->HiveList);
+    KeyBody->NotifyBlock = NULL;
+    KeReleaseGuardedMutex(&CmpPostLock);
+
+    /* Free it */
+    ExFreePoolWithTag(NotifyBlock, TAG_CMNB);
 }
 
+VOID
+NTAPI
+CmNotifyRunDown(IN PETHREAD Thread)
+{
+    LIST_ENTRY FreeList;
+    PCM_POST_BLOCK PostBlock;
+    PAGED_CODE();
+
+    /* Nothing to do if the thread doesn't have any pending requests */
+    if (IsListEmpty(&Thread->PostBlockList)) return;
+
+    /* Unlink every request this thread still has pending */
+    InitializeListHead(&FreeList);
+    KeAcquireGuardedMutex(&CmpPostLock);
+    while (!IsListEmpty(&Thread->PostBlockList))
+    {
+        PostBlock = CONTAINING_RECORD(RemoveHeadList(&Thread->PostBlockList),
+                                      CM_POST_BLOCK,
+                                      ThreadList);
+        RemoveEntryList(&PostBlock->NotifyList);
+        InsertTailList(&FreeList, &PostBlock->NotifyList);
+    }
+    KeReleaseGuardedMutex(&CmpPostLock);
+
+    /* Now free them outside of the lock */
+    while (!IsListEmpty(&FreeList))
+    {
+        PostBlock = CONTAINING_RECORD(RemoveHeadList(&FreeList),
+                                      CM_POST_BLOCK,
+                                      NotifyList);
+        CmpFreePostBlock(PostBlock);
+    }
+}
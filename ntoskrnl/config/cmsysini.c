@@ -138,6 +138,9 @@ CmpDeleteKeyObject(PVOID DeletedObject)
         Kcb = KeyBody->KeyControlBlock;
         if (Kcb)
         {
+            /* Get rid of any notify block that's still around */
+            if (KeyBody->NotifyBlock) CmpFlushNotify(KeyBody, FALSE);
+
             /* Delist the key */
             DelistKeyBodyFromKCB(KeyBody, FALSE);
 
@@ -174,8 +177,10 @@ CmpCloseKeyObject(IN PEPROCESS Process OPTIONAL,
         /* Don't do anything if we don't have a notify block */
         if (!KeyBody->NotifyBlock) return;
 
-        /* This shouldn't happen yet */
-        ASSERT(FALSE);
+        /* Complete any pending requests and get rid of the notify block */
+        CmpLockRegistry();
+        CmpFlushNotify(KeyBody, FALSE);
+        CmpUnlockRegistry();
     }
 }
 
@@ -1534,6 +1539,9 @@ CmInitSystem1(VOID)
     /* Initialize registry lock */
     ExInitializeResourceLite(&CmpRegistryLock);
 
+    /* Initialize the change notification lock */
+    KeInitializeGuardedMutex(&CmpPostLock);
+
     /* Initialize the cache */
     CmpInitializeCache();
 
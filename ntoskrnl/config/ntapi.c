@@ -1467,8 +1467,139 @@ NtNotifyChangeMultipleKeys(IN HANDLE MasterKeyHandle,
                            IN ULONG Length,
                            IN BOOLEAN Asynchronous)
 {
-    UNIMPLEMENTED_ONCE;
-    return STATUS_NOT_IMPLEMENTED;
+    KPROCESSOR_MODE PreviousMode = ExGetPreviousMode();
+    PCM_KEY_BODY KeyBody;
+    PKEVENT UserEvent = NULL;
+    PCM_POST_BLOCK PostBlock;
+    NTSTATUS Status, WaitStatus;
+    PAGED_CODE();
+
+    /* Watching slave keys isn't supported yet */
+    if (Count)
+    {
+        DPRINT1("NtNotifyChangeMultipleKeys: slave keys are not supported\n");
+        return STATUS_NOT_IMPLEMENTED;
+    }
+
+    /* Validate the filter */
+    if (CompletionFilter & ~REG_LEGAL_CHANGE_FILTER)
+        return STATUS_INVALID_PARAMETER;
+
+    /* Probe the I/O status block for user-mode callers */
+    if (PreviousMode != KernelMode)
+    {
+        _SEH2_TRY
+        {
+            ProbeForWriteIoStatusBlock(IoStatusBlock);
+        }
+        _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+        {
+            /* Return the exception code */
+            _SEH2_YIELD(return _SEH2_GetExceptionCode());
+        }
+        _SEH2_END;
+    }
+
+    /* Verify that the handle is valid and is a registry key */
+    Status = ObReferenceObjectByHandle(MasterKeyHandle,
+                                       KEY_NOTIFY,
+                                       CmpKeyObjectType,
+                                       PreviousMode,
+                                       (PVOID*)&KeyBody,
+                                       NULL);
+    if (!NT_SUCCESS(Status)) return Status;
+
+    /* Reference the event, if one was given, and reset it */
+    if (Event)
+    {
+        Status = ObReferenceObjectByHandle(Event,
+                                           EVENT_MODIFY_STATE,
+                                           ExEventObjectType,
+                                           PreviousMode,
+                                           (PVOID*)&UserEvent,
+                                           NULL);
+        if (!NT_SUCCESS(Status))
+        {
+            ObDereferenceObject(KeyBody);
+            return Status;
+        }
+        KeClearEvent(UserEvent);
+    }
+
+    /* Allocate the post block that will track this request */
+    PostBlock = ExAllocatePoolWithTag(NonPagedPool,
+                                      sizeof(CM_POST_BLOCK),
+                                      TAG_CMPB);
+    if (!PostBlock)
+    {
+        if (UserEvent) ObDereferenceObject(UserEvent);
+        ObDereferenceObject(KeyBody);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    /* Set it up */
+    PostBlock->Thread = PsGetCurrentThread();
+    ObReferenceObject(PostBlock->Thread);
+    PostBlock->UserEvent = UserEvent;
+    PostBlock->IoStatusBlock = IoStatusBlock;
+    PostBlock->ApcRoutine = ApcRoutine;
+    PostBlock->ApcContext = ApcContext;
+    PostBlock->PreviousMode = PreviousMode;
+    PostBlock->Synchronous = !Asynchronous;
+    PostBlock->Status = STATUS_PENDING;
+    KeInitializeEvent(&PostBlock->WaitEvent, NotificationEvent, FALSE);
+
+    /* Queue it on the key */
+    Status = CmpInsertNotifyPost(KeyBody,
+                                 CompletionFilter,
+                                 WatchTree,
+                                 PostBlock);
+    ObDereferenceObject(KeyBody);
+    if (Status != STATUS_PENDING)
+    {
+        /* It never got queued */
+        CmpFreePostBlock(PostBlock);
+        return Status;
+    }
+
+    /* For asynchronous requests, the post block now belongs to the engine */
+    if (Asynchronous) return STATUS_PENDING;
+
+    /* Otherwise wait for a change, the key to go away, or an alert */
+    WaitStatus = KeWaitForSingleObject(&PostBlock->WaitEvent,
+                                       Executive,
+                                       PreviousMode,
+                                       TRUE,
+                                       NULL);
+
+    /* Check if the request is still queued, meaning we were interrupted */
+    KeAcquireGuardedMutex(&CmpPostLock);
+    if (!IsListEmpty(&PostBlock->NotifyList))
+    {
+        /* Dequeue it ourselves */
+        RemoveEntryList(&PostBlock->NotifyList);
+        RemoveEntryList(&PostBlock->ThreadList);
+        PostBlock->Status = WaitStatus;
+    }
+    KeReleaseGuardedMutex(&CmpPostLock);
+    Status = PostBlock->Status;
+
+    /* Return the result to the caller */
+    _SEH2_TRY
+    {
+        IoStatusBlock->Status = Status;
+        IoStatusBlock->Information = 0;
+    }
+    _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+    {
+        /* Ignore, the wait itself succeeded */
+    }
+    _SEH2_END;
+    if (UserEvent) KeSetEvent(UserEvent, IO_NO_INCREMENT, FALSE);
+
+    /* Free the post block and return */
+    CmpFreePostBlock(PostBlock);
+    return Status;
 }
 
 NTSTATUS
@@ -2816,6 +2816,14 @@ QSI_DEF(SystemFirmwareTableInformation)
     return Status;
 }
 
+/* Class 0x40000000 - Work Queue Information (ReactOS specific) */
+QSI_DEF(SystemWorkQueueInformation)
+{
+    return ExpQueryWorkQueueInformation((PSYSTEM_WORK_QUEUE_INFORMATION)Buffer,
+                                        Size,
+                                        ReqSize);
+}
+
 /* Query/Set Calls Table */
 typedef
 struct _QSSI_CALLS
@@ -2921,6 +2929,36 @@ C_ASSERT(SystemBasicInformation == 0);
 #define MIN_SYSTEM_INFO_CLASS (SystemBasicInformation)
 #define MAX_SYSTEM_INFO_CLASS RTL_NUMBER_OF(CallQS)
 
+/* ReactOS specific classes, kept out of the range Windows uses */
+static
+QSSI_CALLS
+CallQSPrivate[] =
+{
+    SI_QX(SystemWorkQueueInformation),
+};
+
+#define MIN_PRIVATE_SYSTEM_INFO_CLASS (SystemWorkQueueInformation)
+#define MAX_PRIVATE_SYSTEM_INFO_CLASS (MIN_PRIVATE_SYSTEM_INFO_CLASS + RTL_NUMBER_OF(CallQSPrivate))
+
+static
+const QSSI_CALLS *
+ExpGetSystemInformationCalls(
+    _In_ SYSTEM_INFORMATION_CLASS SystemInformationClass)
+{
+    ULONG Class = (ULONG)SystemInformationClass;
+
+    if (Class < MAX_SYSTEM_INFO_CLASS)
+        return &CallQS[Class];
+
+    if ((Class >= MIN_PRIVATE_SYSTEM_INFO_CLASS) &&
+        (Class < MAX_PRIVATE_SYSTEM_INFO_CLASS))
+    {
+        return &CallQSPrivate[Class - MIN_PRIVATE_SYSTEM_INFO_CLASS];
+    }
+
+    return NULL;
+}
+
 /*
  * @implemented
  */
@@ -2936,6 +2974,7 @@ NtQuerySystemInformation(
     NTSTATUS Status = STATUS_NOT_IMPLEMENTED;
     ULONG CapturedResultLength = 0;
     ULONG Alignment = TYPE_ALIGNMENT(ULONG);
+    const QSSI_CALLS *Calls;
     KPROCESSOR_MODE PreviousMode;
 
     PAGED_CODE();
@@ -2948,8 +2987,8 @@ NtQuerySystemInformation(
         /*
          * Check whether the request is valid.
          */
-        if (SystemInformationClass < MIN_SYSTEM_INFO_CLASS ||
-            SystemInformationClass >= MAX_SYSTEM_INFO_CLASS)
+        Calls = ExpGetSystemInformationCalls(SystemInformationClass);
+        if (!Calls)
         {
             _SEH2_YIELD(return STATUS_INVALID_INFO_CLASS);
         }
@@ -2973,19 +3012,19 @@ NtQuerySystemInformation(
         /*
          * Check whether the request is valid.
          */
-        if (SystemInformationClass < MIN_SYSTEM_INFO_CLASS ||
-            SystemInformationClass >= MAX_SYSTEM_INFO_CLASS)
+        Calls = ExpGetSystemInformationCalls(SystemInformationClass);
+        if (!Calls)
         {
             _SEH2_YIELD(return STATUS_INVALID_INFO_CLASS);
         }
 #endif
 
-        if (CallQS[SystemInformationClass].Query != NULL)
+        if (Calls->Query != NULL)
         {
             /* Hand the request to a subhandler */
-            Status = CallQS[SystemInformationClass].Query(SystemInformation,
-                                                          SystemInformationLength,
-                                                          &CapturedResultLength);
+            Status = Calls->Query(SystemInformation,
+                                  SystemInformationLength,
+                                  &CapturedResultLength);
 
             /* Save the result length to the caller */
             if (ReturnLength)
@@ -3010,6 +3049,7 @@ NtSetSystemInformation(
     _In_ ULONG SystemInformationLength)
 {
     NTSTATUS Status = STATUS_INVALID_INFO_CLASS;
+    const QSSI_CALLS *Calls;
     KPROCESSOR_MODE PreviousMode;
 
     PAGED_CODE();
@@ -3029,15 +3069,12 @@ NtSetSystemInformation(
         /*
          * Check whether the request is valid.
          */
-        if ((SystemInformationClass >= MIN_SYSTEM_INFO_CLASS) &&
-            (SystemInformationClass < MAX_SYSTEM_INFO_CLASS))
+        Calls = ExpGetSystemInformationCalls(SystemInformationClass);
+        if ((Calls) && (Calls->Set != NULL))
         {
-            if (CallQS[SystemInformationClass].Set != NULL)
-            {
-                /* Hand the request to a subhandler */
-                Status = CallQS[SystemInformationClass].Set(SystemInformation,
-                                                            SystemInformationLength);
-            }
+            /* Hand the request to a subhandler */
+            Status = Calls->Set(SystemInformation,
+                                SystemInformationLength);
         }
     }
     _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
@@ -19,17 +19,36 @@
 #define EX_DELAYED_WORK_THREADS                     3
 #define EX_CRITICAL_WORK_THREADS                    5
 
+/* Number of worker threads for the queues of additional processors */
+#define EX_PROCESSOR_DELAYED_WORK_THREADS           1
+#define EX_PROCESSOR_CRITICAL_WORK_THREADS          2
+
+/* Maximum number of dynamic worker threads for each Queue */
+#define EX_MAXIMUM_DYNAMIC_WORK_THREADS             16
+
 /* Magic flag for dynamic worker threads */
 #define EX_DYNAMIC_WORK_THREAD                      0x80000000
 
+/* Worker thread context layout: queue type, then processor number */
+#define EX_WORK_THREAD_TYPE_MASK                    0xFF
+#define EX_WORK_THREAD_PROCESSOR_SHIFT              8
+
+/* Only time every n-th work item, to keep queueing cheap */
+#define EX_WORK_QUEUE_SAMPLE_RATE                   16
+#define EX_WORK_QUEUE_SAMPLE_BUSY                   ((PVOID)1)
+
 /* Worker thread priority increments (added to base priority) */
 #define EX_HYPERCRITICAL_QUEUE_PRIORITY_INCREMENT   7
 #define EX_CRITICAL_QUEUE_PRIORITY_INCREMENT        5
 #define EX_DELAYED_QUEUE_PRIORITY_INCREMENT         4
 
-/* The actual worker queue array */
+/* The actual worker queue array, used by the boot processor */
 EX_WORK_QUEUE ExWorkerQueue[MaximumWorkQueue];
 
+/* The per-processor worker queues. The hypercritical queue only exists once */
+EX_PROCESSOR_WORK_QUEUE ExpBootProcessorWorkQueue[MaximumWorkQueue];
+PEX_PROCESSOR_WORK_QUEUE ExpProcessorWorkQueue[MAXIMUM_PROCESSORS];
+
 /* Accounting of the total threads and registry hacked threads */
 ULONG ExCriticalWorkerThreads;
 ULONG ExDelayedWorkerThreads;
@@ -51,6 +70,283 @@ PETHREAD ExpLastWorkerThread;
 
 /* PRIVATE FUNCTIONS *********************************************************/
 
+FORCEINLINE
+PEX_PROCESSOR_WORK_QUEUE
+ExpGetProcessorWorkQueue(IN ULONG Processor,
+                         IN WORK_QUEUE_TYPE WorkQueueType)
+{
+    /* There's only one hypercritical queue, on the boot processor */
+    if (WorkQueueType == HyperCriticalWorkQueue) Processor = 0;
+    return &ExpProcessorWorkQueue[Processor][WorkQueueType];
+}
+
+FORCEINLINE
+BOOLEAN
+ExpIsProcessorWorkQueue(IN PEX_PROCESSOR_WORK_QUEUE ProcessorQueue)
+{
+    /* Only queues that have siblings on other processors take part in stealing */
+    return ((KeNumberProcessors > 1) &&
+            (ProcessorQueue->QueueType != HyperCriticalWorkQueue));
+}
+
+/*++
+ * @name ExpRequestWorkSteal
+ *
+ *     The ExpRequestWorkSteal routine wakes up an idle worker thread of
+ *     another processor, so that it steals work from a backed up queue.
+ *
+ * @param ProcessorQueue
+ *        The queue which has more work than its threads can currently handle.
+ *
+ * @return None.
+ *
+ * @remarks The idle worker is woken up by queueing the steal request entry
+ *          of its own queue, which is never queued more than once.
+ *
+ *--*/
+VOID
+NTAPI
+ExpRequestWorkSteal(IN PEX_PROCESSOR_WORK_QUEUE ProcessorQueue)
+{
+    PEX_PROCESSOR_WORK_QUEUE Sibling;
+    PKQUEUE Queue;
+    ULONG i;
+
+    /* Start with the next processor, so requests are spread around */
+    for (i = 1; i < (ULONG)KeNumberProcessors; i++)
+    {
+        Sibling = ExpGetProcessorWorkQueue((ProcessorQueue->Processor + i) %
+                                           KeNumberProcessors,
+                                           ProcessorQueue->QueueType);
+        Queue = &Sibling->WorkQueue->WorkerQueue;
+
+        /* Look for a worker that is waiting, and a queue without a backlog */
+        if (IsListEmpty(&Queue->Header.WaitListHead)) continue;
+        if (KeReadStateQueue(Queue) != 0) continue;
+
+        /* If a request is already on the way, that worker will come anyway */
+        if (!InterlockedExchange(&Sibling->StealPending, TRUE))
+        {
+            KeInsertQueue(Queue, &Sibling->StealRequest);
+        }
+        return;
+    }
+}
+
+/*++
+ * @name ExpStealWorkItem
+ *
+ *     The ExpStealWorkItem routine removes a pending work item from the queue
+ *     of another processor, without waiting.
+ *
+ * @param ProcessorQueue
+ *        The queue of the idle worker thread.
+ *
+ * @param SourceQueue
+ *        Receives the queue the work item was taken from.
+ *
+ * @return The list entry of the stolen work item, or NULL if all other
+ *         queues are keeping up with their work.
+ *
+ * @remarks While processing the work item, the thread is accounted to the
+ *          queue it was taken from. It goes back to its own queue on its
+ *          next wait.
+ *
+ *--*/
+PLIST_ENTRY
+NTAPI
+ExpStealWorkItem(IN PEX_PROCESSOR_WORK_QUEUE ProcessorQueue,
+                 OUT PEX_PROCESSOR_WORK_QUEUE *SourceQueue)
+{
+    PEX_PROCESSOR_WORK_QUEUE Sibling;
+    PLIST_ENTRY QueueEntry;
+    LARGE_INTEGER Timeout;
+    ULONG i;
+
+    /* Don't wait at all */
+    Timeout.QuadPart = 0;
+
+    for (i = 1; i < (ULONG)KeNumberProcessors; i++)
+    {
+        Sibling = ExpGetProcessorWorkQueue((ProcessorQueue->Processor + i) %
+                                           KeNumberProcessors,
+                                           ProcessorQueue->QueueType);
+
+        /* Only take from queues whose own threads are all busy */
+        while (KeReadStateQueue(&Sibling->WorkQueue->WorkerQueue) > 0)
+        {
+            QueueEntry = KeRemoveQueue(&Sibling->WorkQueue->WorkerQueue,
+                                       KernelMode,
+                                       &Timeout);
+            if ((NTSTATUS)(ULONG_PTR)QueueEntry == STATUS_TIMEOUT) break;
+
+            /* We already do what the steal request of that queue asks for */
+            if (QueueEntry == &Sibling->StealRequest)
+            {
+                InterlockedExchange(&Sibling->StealPending, FALSE);
+                continue;
+            }
+
+            /* Got one */
+            InterlockedIncrement((PLONG)&ProcessorQueue->WorkItemsStolen);
+            *SourceQueue = Sibling;
+            return QueueEntry;
+        }
+    }
+
+    /* Everybody is keeping up */
+    return NULL;
+}
+
+/*++
+ * @name ExpRemoveWorkItem
+ *
+ *     The ExpRemoveWorkItem routine waits for the next work item a worker
+ *     thread should process.
+ *
+ * @param ProcessorQueue
+ *        The queue of the worker thread.
+ *
+ * @param WaitMode
+ *        The wait mode of the worker thread.
+ *
+ * @param Timeout
+ *        Optional timeout for dynamic worker threads.
+ *
+ * @param SourceQueue
+ *        Receives the queue the work item was taken from.
+ *
+ * @return The list entry of the work item, or STATUS_TIMEOUT.
+ *
+ * @remarks Work items of the own queue always come first. When there are none
+ *          left, pending items of other processors are stolen before going
+ *          idle.
+ *
+ *--*/
+PLIST_ENTRY
+NTAPI
+ExpRemoveWorkItem(IN PEX_PROCESSOR_WORK_QUEUE ProcessorQueue,
+                  IN KPROCESSOR_MODE WaitMode,
+                  IN PLARGE_INTEGER Timeout OPTIONAL,
+                  OUT PEX_PROCESSOR_WORK_QUEUE *SourceQueue)
+{
+    PKQUEUE Queue = &ProcessorQueue->WorkQueue->WorkerQueue;
+    PLIST_ENTRY QueueEntry;
+    LARGE_INTEGER NoWait;
+
+    /* Assume this is our own */
+    *SourceQueue = ProcessorQueue;
+
+    /* Without other processors, there's nobody to steal from */
+    if (!ExpIsProcessorWorkQueue(ProcessorQueue))
+    {
+        return KeRemoveQueue(Queue, WaitMode, Timeout);
+    }
+
+    NoWait.QuadPart = 0;
+    for (;;)
+    {
+        /* Check our own queue first */
+        QueueEntry = KeRemoveQueue(Queue, WaitMode, &NoWait);
+        if ((NTSTATUS)(ULONG_PTR)QueueEntry == STATUS_TIMEOUT)
+        {
+            /* It's empty, help out another processor */
+            QueueEntry = ExpStealWorkItem(ProcessorQueue, SourceQueue);
+            if (QueueEntry) return QueueEntry;
+
+            /* Nothing to do anywhere, go idle */
+            QueueEntry = KeRemoveQueue(Queue, WaitMode, Timeout);
+        }
+
+        /* Anything but a steal request gets handled by the caller */
+        if (QueueEntry != &ProcessorQueue->StealRequest) return QueueEntry;
+
+        /* Another queue asked for help, go look for it */
+        InterlockedExchange(&ProcessorQueue->StealPending, FALSE);
+    }
+}
+
+/*++
+ * @name ExpSampleWorkItem
+ *
+ *     The ExpSampleWorkItem routine starts timing a work item that is about
+ *     to be queued, for the queue latency statistics.
+ *
+ * @param ProcessorQueue
+ *        The queue the work item is being inserted into.
+ *
+ * @param WorkItem
+ *        The work item.
+ *
+ * @return None.
+ *
+ * @remarks Only one work item per queue is timed at a time, so the timing
+ *          data needs no lock.
+ *
+ *--*/
+VOID
+NTAPI
+ExpSampleWorkItem(IN PEX_PROCESSOR_WORK_QUEUE ProcessorQueue,
+                  IN PWORK_QUEUE_ITEM WorkItem)
+{
+    /* Don't bother if an earlier item is still being timed */
+    if (ProcessorQueue->SampleItem) return;
+
+    /* Claim the slot, set the time and only then publish the item */
+    if (InterlockedCompareExchangePointer(&ProcessorQueue->SampleItem,
+                                          EX_WORK_QUEUE_SAMPLE_BUSY,
+                                          NULL) == NULL)
+    {
+        ProcessorQueue->SampleTime = KeQueryPerformanceCounter(NULL);
+        InterlockedExchangePointer(&ProcessorQueue->SampleItem, WorkItem);
+    }
+}
+
+/*++
+ * @name ExpCompleteWorkItemSample
+ *
+ *     The ExpCompleteWorkItemSample routine accounts for the time a timed
+ *     work item has spent on its queue.
+ *
+ * @param ProcessorQueue
+ *        The queue the work item was removed from.
+ *
+ * @param WorkItem
+ *        The work item, which is about to be processed.
+ *
+ * @return None.
+ *
+ * @remarks Must be called before the worker routine runs, since the work
+ *          item may be freed or queued again by it.
+ *
+ *--*/
+VOID
+NTAPI
+ExpCompleteWorkItemSample(IN PEX_PROCESSOR_WORK_QUEUE ProcessorQueue,
+                          IN PWORK_QUEUE_ITEM WorkItem)
+{
+    LARGE_INTEGER Now, Frequency;
+    ULONG Latency;
+
+    /* Check if this is the item being timed */
+    if (ProcessorQueue->SampleItem != WorkItem) return;
+
+    /* Calculate how long it has been waiting, in microseconds */
+    Now = KeQueryPerformanceCounter(&Frequency);
+    Latency = (ULONG)min((Now.QuadPart - ProcessorQueue->SampleTime.QuadPart) *
+                         1000000 / Frequency.QuadPart,
+                         MAXULONG);
+
+    /* Update the statistics and let the next item be timed */
+    ProcessorQueue->LatencySamples++;
+    ProcessorQueue->TotalLatency += Latency;
+    if (Latency > ProcessorQueue->MaximumLatency)
+    {
+        ProcessorQueue->MaximumLatency = Latency;
+    }
+    InterlockedExchangePointer(&ProcessorQueue->SampleItem, NULL);
+}
+
 /*++
  * @name ExpWorkerThreadEntryPoint
  *
@@ -58,8 +354,8 @@ PETHREAD ExpLastWorkerThread;
  *     worker thread created by teh system.
  *
  * @param Context
- *        Contains the work queue type masked with a flag specifing whether the
- *        thread is dynamic or not.
+ *        Contains the work queue type and processor number, masked with a flag
+ *        specifing whether the thread is dynamic or not.
  *
  * @return None.
  *
@@ -81,6 +377,8 @@ ExpWorkerThreadEntryPoint(IN PVOID Context)
     PLIST_ENTRY QueueEntry;
     WORK_QUEUE_TYPE WorkQueueType;
     PEX_WORK_QUEUE WorkQueue;
+    PEX_PROCESSOR_WORK_QUEUE ProcessorQueue, SourceQueue;
+    ULONG Processor;
     LARGE_INTEGER Timeout;
     PLARGE_INTEGER TimeoutPointer = NULL;
     PETHREAD Thread = PsGetCurrentThread();
@@ -95,10 +393,13 @@ ExpWorkerThreadEntryPoint(IN PVOID Context)
         TimeoutPointer = &Timeout;
     }
 
-    /* Get Queue Type and Worker Queue */
+    /* Get Queue Type, Processor and Worker Queue */
     WorkQueueType = (WORK_QUEUE_TYPE)((ULONG_PTR)Context &
-                                      ~EX_DYNAMIC_WORK_THREAD);
-    WorkQueue = &ExWorkerQueue[WorkQueueType];
+                                      EX_WORK_THREAD_TYPE_MASK);
+    Processor = (ULONG)(((ULONG_PTR)Context & ~EX_DYNAMIC_WORK_THREAD) >>
+                        EX_WORK_THREAD_PROCESSOR_SHIFT);
+    ProcessorQueue = ExpGetProcessorWorkQueue(Processor, WorkQueueType);
+    WorkQueue = ProcessorQueue->WorkQueue;
 
     /* Select the wait mode */
     WaitMode = (UCHAR)WorkQueue->Info.WaitMode;
@@ -137,16 +438,17 @@ ExpWorkerThreadEntryPoint(IN PVOID Context)
 ProcessLoop:
     for (;;)
     {
-        /* Wait for something to happen on the queue */
-        QueueEntry = KeRemoveQueue(&WorkQueue->WorkerQueue,
-                                   WaitMode,
-                                   TimeoutPointer);
+        /* Wait for something to happen on the queue, or steal some work */
+        QueueEntry = ExpRemoveWorkItem(ProcessorQueue,
+                                       WaitMode,
+                                       TimeoutPointer,
+                                       &SourceQueue);
 
         /* Check if we timed out and quit this loop in that case */
         if ((NTSTATUS)(ULONG_PTR)QueueEntry == STATUS_TIMEOUT) break;
 
-        /* Increment Processed Work Items */
-        InterlockedIncrement((PLONG)&WorkQueue->WorkItemsProcessed);
+        /* Increment Processed Work Items of the queue it came from */
+        InterlockedIncrement((PLONG)&SourceQueue->WorkQueue->WorkItemsProcessed);
 
         /* Get the Work Item */
         WorkItem = CONTAINING_RECORD(QueueEntry, WORK_QUEUE_ITEM, List);
@@ -154,6 +456,9 @@ ProcessLoop:
         /* Make sure nobody is trying to play smart with us */
         ASSERT((ULONG_PTR)WorkItem->WorkerRoutine > MmUserProbeAddress);
 
+        /* Account for its time on the queue, if it was being timed */
+        ExpCompleteWorkItemSample(SourceQueue, WorkItem);
+
         /* Call the Worker Routine */
         WorkItem->WorkerRoutine(WorkItem->Parameter);
 
@@ -234,6 +539,10 @@ ProcessLoop:
  *          - CriticalWorkQueue
  *          - HyperCriticalWorkQueue
  *
+ * @param Processor
+ *        Processor whose queue the thread serves. Ignored for the
+ *        hypercritical queue.
+ *
  * @param Dynamic
  *        Specifies whether or not this thread is a dynamic thread.
  *
@@ -244,20 +553,29 @@ ProcessLoop:
  *
  *          This, worker threads cannot pre-empty a normal user-mode thread.
  *
+ *          Threads of per-processor queues prefer to run on their processor,
+ *          but are not bound to it.
+ *
  *--*/
 VOID
 NTAPI
 ExpCreateWorkerThread(WORK_QUEUE_TYPE WorkQueueType,
+                      IN ULONG Processor,
                       IN BOOLEAN Dynamic)
 {
+    PEX_PROCESSOR_WORK_QUEUE ProcessorQueue;
     PETHREAD Thread;
     HANDLE hThread;
     ULONG Context;
     KPRIORITY Priority;
     NTSTATUS Status;
 
+    /* Get the queue, which also validates the processor */
+    ProcessorQueue = ExpGetProcessorWorkQueue(Processor, WorkQueueType);
+
     /* Check if this is going to be a dynamic thread */
-    Context = WorkQueueType;
+    Context = WorkQueueType |
+              (ProcessorQueue->Processor << EX_WORK_THREAD_PROCESSOR_SHIFT);
 
     /* Add the dynamic mask */
     if (Dynamic) Context |= EX_DYNAMIC_WORK_THREAD;
@@ -281,7 +599,7 @@ ExpCreateWorkerThread(WORK_QUEUE_TYPE WorkQueueType,
     if (Dynamic)
     {
         /* Increase the count */
-        InterlockedIncrement(&ExWorkerQueue[WorkQueueType].DynamicThreadCount);
+        InterlockedIncrement(&ProcessorQueue->WorkQueue->DynamicThreadCount);
     }
 
     /* Set the priority */
@@ -312,6 +630,12 @@ ExpCreateWorkerThread(WORK_QUEUE_TYPE WorkQueueType,
     /* Set the Priority */
     KeSetBasePriorityThread(&Thread->Tcb, Priority);
 
+    /* Keep the thread close to the processor that queues its work */
+    if (ExpIsProcessorWorkQueue(ProcessorQueue))
+    {
+        KeSetIdealProcessorThread(&Thread->Tcb, (UCHAR)ProcessorQueue->Processor);
+    }
+
     /* Dereference and close handle */
     ObDereferenceObject(Thread);
     ObCloseHandle(hThread, KernelMode);
@@ -336,30 +660,36 @@ VOID
 NTAPI
 ExpDetectWorkerThreadDeadlock(VOID)
 {
-    ULONG i;
+    ULONG i, Processor;
     PEX_WORK_QUEUE Queue;
 
-    /* Loop the 3 queues */
-    for (i = 0; i < MaximumWorkQueue; i++)
+    /* Loop the queues of every processor */
+    for (Processor = 0; Processor < (ULONG)KeNumberProcessors; Processor++)
     {
-        /* Get the queue */
-        Queue = &ExWorkerQueue[i];
-        ASSERT(Queue->DynamicThreadCount <= 16);
-
-        /* Check if stuff is on the queue that still is unprocessed */
-        if ((Queue->QueueDepthLastPass) &&
-            (Queue->WorkItemsProcessed == Queue->WorkItemsProcessedLastPass) &&
-            (Queue->DynamicThreadCount < 16))
+        /* Loop the 3 queues, only the boot processor has a hypercritical one */
+        for (i = 0; i < MaximumWorkQueue; i++)
         {
-            /* Stuff is still on the queue and nobody did anything about it */
-            DPRINT1("EX: Work Queue Deadlock detected: %lu\n", i);
-            ExpCreateWorkerThread(i, TRUE);
-            DPRINT1("Dynamic threads queued %d\n", Queue->DynamicThreadCount);
-        }
+            if ((i == HyperCriticalWorkQueue) && (Processor != 0)) continue;
+
+            /* Get the queue */
+            Queue = ExpGetProcessorWorkQueue(Processor, i)->WorkQueue;
+            ASSERT(Queue->DynamicThreadCount <= EX_MAXIMUM_DYNAMIC_WORK_THREADS);
 
-        /* Update our data */
-        Queue->WorkItemsProcessedLastPass = Queue->WorkItemsProcessed;
-        Queue->QueueDepthLastPass = KeReadStateQueue(&Queue->WorkerQueue);
+            /* Check if stuff is on the queue that still is unprocessed */
+            if ((Queue->QueueDepthLastPass) &&
+                (Queue->WorkItemsProcessed == Queue->WorkItemsProcessedLastPass) &&
+                (Queue->DynamicThreadCount < EX_MAXIMUM_DYNAMIC_WORK_THREADS))
+            {
+                /* Stuff is still on the queue and nobody did anything about it */
+                DPRINT1("EX: Work Queue Deadlock detected: %lu/%lu\n", Processor, i);
+                ExpCreateWorkerThread(i, Processor, TRUE);
+                DPRINT1("Dynamic threads queued %d\n", Queue->DynamicThreadCount);
+            }
+
+            /* Update our data */
+            Queue->WorkItemsProcessedLastPass = Queue->WorkItemsProcessed;
+            Queue->QueueDepthLastPass = KeReadStateQueue(&Queue->WorkerQueue);
+        }
     }
 }
 
@@ -374,32 +704,45 @@ ExpDetectWorkerThreadDeadlock(VOID)
  * @return None.
  *
  * @remarks The algorithm for deciding if a new thread must be created is
- *          documented in the ExQueueWorkItem routine.
+ *          documented in the ExQueueWorkItem routine. As many threads are
+ *          created as there are work items that could run right away, so
+ *          that a burst of blocking work items is not served one thread at
+ *          a time.
  *
  *--*/
 VOID
 NTAPI
 ExpCheckDynamicThreadCount(VOID)
 {
-    ULONG i;
+    ULONG i, Processor;
+    LONG Needed;
     PEX_WORK_QUEUE Queue;
 
-    /* Loop the 3 queues */
-    for (i = 0; i < MaximumWorkQueue; i++)
+    /* Loop the queues of every processor */
+    for (Processor = 0; Processor < (ULONG)KeNumberProcessors; Processor++)
     {
-        /* Get the queue */
-        Queue = &ExWorkerQueue[i];
-
-        /* Check if still need a new thread. See ExQueueWorkItem */
-        if ((Queue->Info.MakeThreadsAsNecessary) &&
-            (!IsListEmpty(&Queue->WorkerQueue.EntryListHead)) &&
-            (Queue->WorkerQueue.CurrentCount <
-             Queue->WorkerQueue.MaximumCount) &&
-            (Queue->DynamicThreadCount < 16))
+        /* Loop the 3 queues, only the boot processor has a hypercritical one */
+        for (i = 0; i < MaximumWorkQueue; i++)
         {
-            /* Create a new thread */
-            DPRINT1("EX: Creating new dynamic thread as requested\n");
-            ExpCreateWorkerThread(i, TRUE);
+            if ((i == HyperCriticalWorkQueue) && (Processor != 0)) continue;
+
+            /* Get the queue */
+            Queue = ExpGetProcessorWorkQueue(Processor, i)->WorkQueue;
+            if (!Queue->Info.MakeThreadsAsNecessary) continue;
+
+            /* Check how many threads could run if we had them. See ExQueueWorkItem */
+            Needed = min(KeReadStateQueue(&Queue->WorkerQueue),
+                         (LONG)(Queue->WorkerQueue.MaximumCount -
+                                Queue->WorkerQueue.CurrentCount));
+            Needed = min(Needed,
+                         EX_MAXIMUM_DYNAMIC_WORK_THREADS - Queue->DynamicThreadCount);
+
+            /* Create new threads */
+            while (Needed-- > 0)
+            {
+                DPRINT("EX: Creating new dynamic thread as requested\n");
+                ExpCreateWorkerThread(i, Processor, TRUE);
+            }
         }
     }
 }
@@ -523,9 +866,10 @@ ExpInitializeWorkerThreads(VOID)
 {
     ULONG WorkQueueType;
     ULONG CriticalThreads, DelayedThreads;
+    PEX_PROCESSOR_WORK_QUEUE ProcessorQueue;
     HANDLE ThreadHandle;
     PETHREAD Thread;
-    ULONG i;
+    ULONG i, Processor;
     NTSTATUS Status;
 
     /* Setup the stack swap support */
@@ -555,8 +899,57 @@ ExpInitializeWorkerThreads(VOID)
         KeInitializeQueue(&ExWorkerQueue[WorkQueueType].WorkerQueue, 0);
     }
 
-    /* Dynamic threads are only used for the critical queue */
-    ExWorkerQueue[CriticalWorkQueue].Info.MakeThreadsAsNecessary = TRUE;
+    /* The boot processor uses the global queues */
+    ExpProcessorWorkQueue[0] = ExpBootProcessorWorkQueue;
+    for (Processor = 1; Processor < (ULONG)KeNumberProcessors; Processor++)
+    {
+        /* Every other processor gets its own delayed and critical queues */
+        ExpProcessorWorkQueue[Processor] =
+            ExAllocatePoolWithTag(NonPagedPool,
+                                  MaximumWorkQueue * sizeof(EX_PROCESSOR_WORK_QUEUE),
+                                  TAG_WORK_QUEUE);
+        if (!ExpProcessorWorkQueue[Processor])
+        {
+            KeBugCheckEx(PHASE1_INITIALIZATION_FAILED,
+                         STATUS_INSUFFICIENT_RESOURCES,
+                         0,
+                         0,
+                         0);
+        }
+    }
+
+    /* Initialize the per-processor queues */
+    for (Processor = 0; Processor < (ULONG)KeNumberProcessors; Processor++)
+    {
+        for (WorkQueueType = 0; WorkQueueType < MaximumWorkQueue; WorkQueueType++)
+        {
+            ProcessorQueue = &ExpProcessorWorkQueue[Processor][WorkQueueType];
+            RtlZeroMemory(ProcessorQueue, sizeof(EX_PROCESSOR_WORK_QUEUE));
+            ProcessorQueue->QueueType = WorkQueueType;
+            ProcessorQueue->Processor = Processor;
+
+            /* The boot processor's queues are the global ones */
+            if (Processor == 0)
+            {
+                ProcessorQueue->WorkQueue = &ExWorkerQueue[WorkQueueType];
+            }
+            else
+            {
+                ProcessorQueue->WorkQueue = &ProcessorQueue->LocalQueue;
+                KeInitializeQueue(&ProcessorQueue->WorkQueue->WorkerQueue, 0);
+            }
+
+            /*
+             * Dynamic threads are used for the critical and delayed queues.
+             * Bursts of file system and network completions often block
+             * in their delayed work items, too.
+             */
+            if (WorkQueueType != HyperCriticalWorkQueue)
+            {
+                ProcessorQueue->WorkQueue->Info.MakeThreadsAsNecessary = TRUE;
+            }
+        }
+    }
 
     /* Initialize the balance set manager events */
     KeInitializeEvent(&ExpThreadSetManagerEvent, SynchronizationEvent, FALSE);
@@ -564,24 +957,31 @@ ExpInitializeWorkerThreads(VOID)
                       NotificationEvent,
                       FALSE);
 
-    /* Create the built-in worker threads for the critical queue */
-    for (i = 0; i < CriticalThreads; i++)
+    for (Processor = 0; Processor < (ULONG)KeNumberProcessors; Processor++)
     {
-        /* Create the thread */
-        ExpCreateWorkerThread(CriticalWorkQueue, FALSE);
-        ExCriticalWorkerThreads++;
-    }
+        /* Create the built-in worker threads for the critical queue */
+        for (i = 0; i < CriticalThreads; i++)
+        {
+            /* Create the thread */
+            ExpCreateWorkerThread(CriticalWorkQueue, Processor, FALSE);
+            ExCriticalWorkerThreads++;
+        }
 
-    /* Create the built-in worker threads for the delayed queue */
-    for (i = 0; i < DelayedThreads; i++)
-    {
-        /* Create the thread */
-        ExpCreateWorkerThread(DelayedWorkQueue, FALSE);
-        ExDelayedWorkerThreads++;
+        /* Create the built-in worker threads for the delayed queue */
+        for (i = 0; i < DelayedThreads; i++)
+        {
+            /* Create the thread */
+            ExpCreateWorkerThread(DelayedWorkQueue, Processor, FALSE);
+            ExDelayedWorkerThreads++;
+        }
+
+        /* The other processors' queues can steal, so they need fewer threads */
+        DelayedThreads = EX_PROCESSOR_DELAYED_WORK_THREADS;
+        CriticalThreads = EX_PROCESSOR_CRITICAL_WORK_THREADS;
     }
 
     /* Create the built-in worker thread for the hypercritical queue */
-    ExpCreateWorkerThread(HyperCriticalWorkQueue, FALSE);
+    ExpCreateWorkerThread(HyperCriticalWorkQueue, 0, FALSE);
 
     /* Create the balance set manager thread */
     Status = PsCreateSystemThread(&ThreadHandle,
@@ -723,10 +1123,16 @@ NTAPI
 ExQueueWorkItem(IN PWORK_QUEUE_ITEM WorkItem,
                 IN WORK_QUEUE_TYPE QueueType)
 {
-    PEX_WORK_QUEUE WorkQueue = &ExWorkerQueue[QueueType];
+    PEX_PROCESSOR_WORK_QUEUE ProcessorQueue;
+    PEX_WORK_QUEUE WorkQueue;
     ASSERT(QueueType < MaximumWorkQueue);
     ASSERT(WorkItem->List.Flink == NULL);
 
+    /* Use the queue of the current processor */
+    ProcessorQueue = ExpGetProcessorWorkQueue(KeGetCurrentProcessorNumber(),
+                                              QueueType);
+    WorkQueue = ProcessorQueue->WorkQueue;
+
     /* Don't try to trick us */
     if ((ULONG_PTR)WorkItem->WorkerRoutine < MmUserProbeAddress)
     {
@@ -738,10 +1144,27 @@ ExQueueWorkItem(IN PWORK_QUEUE_ITEM WorkItem,
                      0);
     }
 
+    /* Time this one for the statistics, every now and then */
+    if ((InterlockedIncrement((PLONG)&ProcessorQueue->WorkItemsQueued) %
+         EX_WORK_QUEUE_SAMPLE_RATE) == 0)
+    {
+        ExpSampleWorkItem(ProcessorQueue, WorkItem);
+    }
+
     /* Insert the Queue */
     KeInsertQueue(&WorkQueue->WorkerQueue, &WorkItem->List);
     ASSERT(!WorkQueue->Info.QueueDisabled);
 
+    /*
+     * If it's still there, all of this processor's workers are busy.
+     * Have an idle one from another processor take care of it.
+     */
+    if ((ExpIsProcessorWorkQueue(ProcessorQueue)) &&
+        (KeReadStateQueue(&WorkQueue->WorkerQueue) > 0))
+    {
+        ExpRequestWorkSteal(ProcessorQueue);
+    }
+
     /*
      * Check if we need a new thread. Our decision is as follows:
      *  - This queue type must support Dynamic Threads (duh!)
@@ -753,14 +1176,82 @@ ExQueueWorkItem(IN PWORK_QUEUE_ITEM WorkItem,
         (!IsListEmpty(&WorkQueue->WorkerQueue.EntryListHead)) &&
         (WorkQueue->WorkerQueue.CurrentCount <
          WorkQueue->WorkerQueue.MaximumCount) &&
-        (WorkQueue->DynamicThreadCount < 16))
+        (WorkQueue->DynamicThreadCount < EX_MAXIMUM_DYNAMIC_WORK_THREADS))
     {
         /* Let the balance manager know about it */
-        DPRINT1("Requesting a new thread. CurrentCount: %lu. MaxCount: %lu\n",
+        DPRINT("Requesting a new thread. CurrentCount: %lu. MaxCount: %lu\n",
                 WorkQueue->WorkerQueue.CurrentCount,
                 WorkQueue->WorkerQueue.MaximumCount);
         KeSetEvent(&ExpThreadSetManagerEvent, 0, FALSE);
     }
 }
 
+/*++
+ * @name ExpQueryWorkQueueInformation
+ *
+ *     The ExpQueryWorkQueueInformation routine returns the statistics of
+ *     every work queue in the system.
+ *
+ * @param Information
+ *        Buffer receiving one entry for each queue.
+ *
+ * @param Length
+ *        Size of the buffer, in bytes.
+ *
+ * @param ReturnLength
+ *        Receives the size needed for all entries.
+ *
+ * @return STATUS_SUCCESS, or STATUS_INFO_LENGTH_MISMATCH if the buffer is
+ *         too small.
+ *
+ * @remarks Latencies are in microseconds, measured from queueing a work item
+ *          until a worker picks it up, over a sample of the work items.
+ *
+ *          The buffer may be a user-mode buffer, so the caller must be
+ *          prepared to handle exceptions.
+ *
+ *--*/
+NTSTATUS
+NTAPI
+ExpQueryWorkQueueInformation(OUT PSYSTEM_WORK_QUEUE_INFORMATION Information,
+                             IN ULONG Length,
+                             OUT PULONG ReturnLength)
+{
+    PEX_PROCESSOR_WORK_QUEUE ProcessorQueue;
+    PEX_WORK_QUEUE WorkQueue;
+    ULONG Processor, QueueType, Count;
+
+    /* Every processor has a delayed and critical queue, plus the hypercritical one */
+    Count = KeNumberProcessors * HyperCriticalWorkQueue + 1;
+    *ReturnLength = Count * sizeof(SYSTEM_WORK_QUEUE_INFORMATION);
+    if (Length < *ReturnLength) return STATUS_INFO_LENGTH_MISMATCH;
+
+    for (Processor = 0; Processor < (ULONG)KeNumberProcessors; Processor++)
+    {
+        for (QueueType = 0; QueueType < MaximumWorkQueue; QueueType++)
+        {
+            if ((QueueType == HyperCriticalWorkQueue) && (Processor != 0)) continue;
+
+            ProcessorQueue = ExpGetProcessorWorkQueue(Processor, QueueType);
+            WorkQueue = ProcessorQueue->WorkQueue;
+
+            Information->Processor = Processor;
+            Information->QueueType = QueueType;
+            Information->WorkerCount = WorkQueue->Info.WorkerCount;
+            Information->DynamicThreadCount = WorkQueue->DynamicThreadCount;
+            Information->QueueDepth = KeReadStateQueue(&WorkQueue->WorkerQueue);
+            Information->WorkItemsQueued = ProcessorQueue->WorkItemsQueued;
+            Information->WorkItemsProcessed = WorkQueue->WorkItemsProcessed;
+            Information->WorkItemsStolen = ProcessorQueue->WorkItemsStolen;
+            Information->LatencySamples = ProcessorQueue->LatencySamples;
+            Information->AverageLatency = ProcessorQueue->LatencySamples ?
+                (ULONG)(ProcessorQueue->TotalLatency / ProcessorQueue->LatencySamples) : 0;
+            Information->MaximumLatency = ProcessorQueue->MaximumLatency;
+            Information++;
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
 /* EOF */
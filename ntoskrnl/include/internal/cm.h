@@ -320,10 +320,29 @@ typedef struct _CM_NOTIFY_BLOCK
     PCM_KEY_CONTROL_BLOCK KeyControlBlock;
     PCM_KEY_BODY KeyBody;
     ULONG Filter:29;
-    ULONG WatchTree:30;
-    ULONG NotifyPending:31;
+    ULONG WatchTree:1;
+    ULONG NotifyPending:1;
 } CM_NOTIFY_BLOCK, *PCM_NOTIFY_BLOCK;
 
+//
+// Post Block
+//
+typedef struct _CM_POST_BLOCK
+{
+    LIST_ENTRY NotifyList;
+    LIST_ENTRY ThreadList;
+    PETHREAD Thread;
+    PKEVENT UserEvent;
+    PIO_STATUS_BLOCK IoStatusBlock;
+    PIO_APC_ROUTINE ApcRoutine;
+    PVOID ApcContext;
+    KPROCESSOR_MODE PreviousMode;
+    BOOLEAN Synchronous;
+    NTSTATUS Status;
+    KEVENT WaitEvent;
+    KAPC Apc;
+} CM_POST_BLOCK, *PCM_POST_BLOCK;
+
 //
 // Re-map Block
 //
@@ -559,6 +578,13 @@ CmpDestroyHiveViewList(
     IN PCMHIVE Hive
 );
 
+NTSTATUS
+NTAPI
+CmpMapHiveFile(
+    IN PCMHIVE Hive,
+    OUT PVOID *HiveImage
+);
+
 //
 // Security Cache Functions
 //
@@ -695,6 +721,27 @@ CmpFlushNotify(
     IN BOOLEAN LockHeld
 );
 
+NTSTATUS
+NTAPI
+CmpInsertNotifyPost(
+    IN PCM_KEY_BODY KeyBody,
+    IN ULONG Filter,
+    IN BOOLEAN WatchTree,
+    IN PCM_POST_BLOCK PostBlock
+);
+
+VOID
+NTAPI
+CmpFreePostBlock(
+    IN PCM_POST_BLOCK PostBlock
+);
+
+VOID
+NTAPI
+CmNotifyRunDown(
+    IN PETHREAD Thread
+);
+
 CODE_SEG("INIT")
 VOID
 NTAPI
@@ -1380,25 +1427,6 @@ CmpEnumerateOpenSubKeys(
     IN BOOLEAN DereferenceOpenedEntries
 );
 
-HCELL_INDEX
-NTAPI
-CmpCopyCell(
-    IN PHHIVE SourceHive,
-    IN HCELL_INDEX SourceCell,
-    IN PHHIVE DestinationHive,
-    IN HSTORAGE_TYPE StorageType
-);
-
-NTSTATUS
-NTAPI
-CmpDeepCopyKey(
-    IN PHHIVE SourceHive,
-    IN HCELL_INDEX SrcKeyCell,
-    IN PHHIVE DestinationHive,
-    IN HSTORAGE_TYPE StorageType,
-    OUT PHCELL_INDEX DestKeyCell OPTIONAL
-);
-
 NTSTATUS
 NTAPI
 CmSaveKey(
@@ -1504,6 +1532,7 @@ extern ERESOURCE CmpRegistryLock;
 extern PCM_KEY_HASH_TABLE_ENTRY CmpCacheTable;
 extern PCM_NAME_HASH_TABLE_ENTRY CmpNameCacheTable;
 extern KGUARDED_MUTEX CmpDelayedCloseTableLock;
+extern KGUARDED_MUTEX CmpPostLock;
 extern CMHIVE CmControlHive;
 extern WCHAR CmDefaultLanguageId[];
 extern ULONG CmDefaultLanguageIdLength;
@@ -62,6 +62,26 @@ typedef enum _WINKD_WORKER_STATE
     WinKdWorkerInitialized
 } WINKD_WORKER_STATE;
 
+/*
+ * Per-processor Executive Work Queue
+ */
+typedef struct _EX_PROCESSOR_WORK_QUEUE
+{
+    PEX_WORK_QUEUE WorkQueue;
+    WORK_QUEUE_TYPE QueueType;
+    ULONG Processor;
+    LONG StealPending;
+    LIST_ENTRY StealRequest;
+    ULONG WorkItemsQueued;
+    ULONG WorkItemsStolen;
+    PVOID SampleItem;
+    LARGE_INTEGER SampleTime;
+    ULONG LatencySamples;
+    ULONG MaximumLatency;
+    ULONGLONG TotalLatency;
+    EX_WORK_QUEUE LocalQueue;
+} EX_PROCESSOR_WORK_QUEUE, *PEX_PROCESSOR_WORK_QUEUE;
+
 extern WORK_QUEUE_ITEM ExpDebuggerWorkItem;
 extern WINKD_WORKER_STATE ExpDebuggerWork;
 extern PEPROCESS ExpDebuggerProcessAttach;
@@ -225,6 +245,14 @@ VOID
 NTAPI
 ExSwapinWorkerThreads(IN BOOLEAN AllowSwap);
 
+NTSTATUS
+NTAPI
+ExpQueryWorkQueueInformation(
+    OUT PSYSTEM_WORK_QUEUE_INFORMATION Information,
+    IN ULONG Length,
+    OUT PULONG ReturnLength
+);
+
 CODE_SEG("INIT")
 VOID
 NTAPI
@@ -90,6 +90,12 @@
 //
 #define IOP_MAX_REPARSE_TRAVERSAL 0x20
 
+//
+// Maximum number of packets removed from a completion port by a single call
+// to NtRemoveIoCompletionEx
+//
+#define IOP_MAX_REMOVE_COMPLETION_ENTRIES 32
+
 //
 // Private flags for IoCreateFile / IoParseDevice
 //
@@ -123,6 +129,15 @@ typedef struct _FILE_OBJECT_EXTENSION
         FALSE :                                         \
         FileObject->Flags & FO_SYNCHRONOUS_IO))         \
 
+//
+// Determines if the completion of an IRP skips the I/O completion port:
+// the file asked for it and the request succeeded without pending
+//
+#define IopSkipCompletionPort(Irp, FileObject)          \
+    (!(Irp)->PendingReturned &&                         \
+     NT_SUCCESS((Irp)->IoStatus.Status) &&              \
+     ((FileObject)->Flags & FO_SKIP_COMPLETION_PORT))
+
 //
 // Returns the internal Device Object Extension
 //
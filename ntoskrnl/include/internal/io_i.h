@@ -52,8 +52,8 @@ UCHAR IopQueryOperationLength[] =
     0,
     0,
     0,
+    0,
 #if 0 // VISTA
-    sizeof(FILE_IO_COMPLETION_NOTIFICATION_INFORMATION),
     sizeof(FILE_IOSTATUSBLOCK_RANGE_INFORMATION),
     sizeof(FILE_IO_PRIORITY_HINT_INFORMATION),
     sizeof(FILE_SFIO_RESERVE_INFORMATION),
@@ -109,9 +109,17 @@ UCHAR IopSetOperationLength[] =
     0,
     sizeof(FILE_VALID_DATA_LENGTH_INFORMATION),
     sizeof(UNICODE_STRING),
+    sizeof(FILE_IO_COMPLETION_NOTIFICATION_INFORMATION),
     0xFF
 };
 
+//
+// FileIoCompletionNotificationInformation is past FileMaximumInformation
+// in pre-Vista headers, so the set classes have their own upper bound
+//
+#define IopMaximumSetInformationClass   (FileIoCompletionNotificationInformation + 1)
+C_ASSERT(RTL_NUMBER_OF(IopSetOperationLength) == IopMaximumSetInformationClass + 1);
+
 ACCESS_MASK IopQueryOperationAccess[] =
 {
     0,
@@ -155,6 +163,7 @@ ACCESS_MASK IopQueryOperationAccess[] =
     0,
     0,
     0,
+    0,
     0xFFFFFFFF
 };
 
@@ -201,6 +210,7 @@ ACCESS_MASK IopSetOperationAccess[] =
     0,
     FILE_WRITE_DATA,
     DELETE,
+    0,
     0xFFFFFFFF
 };
 
@@ -54,7 +54,7 @@ extern KSPIN_LOCK MmPfnLock;
 struct _KTRAP_FRAME;
 struct _EPROCESS;
 struct _MM_RMAP_ENTRY;
-typedef ULONG_PTR SWAPENTRY;
+typedef ULONG_PTR SWAPENTRY, *PSWAPENTRY;
 
 //
 // Pool Quota values
@@ -507,11 +507,40 @@ typedef struct _MMPAGING_FILE
     UNICODE_STRING PageFileName;
     PRTL_BITMAP Bitmap;
     HANDLE FileHandle;
+    ULONG AllocationHint;
 }
 MMPAGING_FILE, *PMMPAGING_FILE;
 
 extern PMMPAGING_FILE MmPagingFile[MAX_PAGING_FILES];
 
+/* Largest number of pages the balancer writes to the page file at once */
+#define MM_PAGEOUT_CLUSTER_SIZE 16
+
+/* Largest number of swapped out pages brought back in by a single fault */
+#define MM_PAGEIN_CLUSTER_SIZE 16
+
+/* How far ahead faults on files opened for sequential access read */
+#define MM_SEQUENTIAL_READ_AHEAD (256 * 1024)
+
+/* A page waiting to be written to the page file */
+typedef struct _MM_PAGEOUT_ENTRY
+{
+    struct _EPROCESS *Process;
+    PVOID Address;
+    PFN_NUMBER Page;
+    SWAPENTRY SwapEntry;
+} MM_PAGEOUT_ENTRY, *PMM_PAGEOUT_ENTRY;
+
+/* Pages gathered by the balancer, and the page file space reserved for them */
+typedef struct _MM_PAGEOUT_CLUSTER
+{
+    ULONG Count;
+    ULONG ReservedCount;
+    ULONG ReservedNext;
+    MM_PAGEOUT_ENTRY Entries[MM_PAGEOUT_CLUSTER_SIZE];
+    SWAPENTRY Reserved[MM_PAGEOUT_CLUSTER_SIZE];
+} MM_PAGEOUT_CLUSTER, *PMM_PAGEOUT_CLUSTER;
+
 typedef VOID
 (*PMM_ALTER_REGION_FUNC)(
     PMMSUPPORT AddressSpace,
@@ -704,6 +733,13 @@ SWAPENTRY
 NTAPI
 MmAllocSwapPage(VOID);
 
+ULONG
+NTAPI
+MmAllocSwapPages(
+    _In_ ULONG PageCount,
+    _Out_writes_to_(PageCount, return) PSWAPENTRY SwapEntries
+);
+
 VOID
 NTAPI
 MmFreeSwapPage(SWAPENTRY Entry);
@@ -724,6 +760,18 @@ MmReadFromSwapPage(
     PFN_NUMBER Page
 );
 
+NTSTATUS
+NTAPI
+MmReadFromSwapPages(
+    _In_ SWAPENTRY SwapEntry,
+    _In_reads_(PageCount) PPFN_NUMBER Pages,
+    _In_ ULONG PageCount
+);
+
+SWAPENTRY
+NTAPI
+MmGetNextSwapEntry(SWAPENTRY SwapEntry);
+
 NTSTATUS
 NTAPI
 MmWriteToSwapPage(
@@ -731,6 +779,15 @@ MmWriteToSwapPage(
     PFN_NUMBER Page
 );
 
+NTSTATUS
+NTAPI
+MmWriteToSwapPages(
+    _In_reads_(PageCount) PSWAPENTRY SwapEntries,
+    _In_reads_(PageCount) PPFN_NUMBER Pages,
+    _In_ ULONG PageCount,
+    _Out_writes_(PageCount) PNTSTATUS Statuses
+);
+
 VOID
 NTAPI
 MmShowOutOfSpaceMessagePagingFile(VOID);
@@ -954,7 +1011,14 @@ MmInitializeRmapList(VOID);
 
 NTSTATUS
 NTAPI
-MmPageOutPhysicalAddress(PFN_NUMBER Page);
+MmPageOutPhysicalAddress(
+    PFN_NUMBER Page,
+    PMM_PAGEOUT_CLUSTER Cluster
+);
+
+ULONG
+NTAPI
+MmFlushPageOutCluster(PMM_PAGEOUT_CLUSTER Cluster);
 
 PMM_SECTION_SEGMENT
 NTAPI
@@ -166,6 +166,28 @@ typedef struct _OB_TEMP_BUFFER
     AUX_ACCESS_DATA AuxData;
 } OB_TEMP_BUFFER, *POB_TEMP_BUFFER;
 
+//
+// Directory Object as allocated by the kernel. The buckets of the
+// OBJECT_DIRECTORY are used until the directory holds enough entries
+// to need a larger hash table. Recent lookups are cached by hash value
+// so that hot names skip the chain walk.
+//
+#define OBP_DIRECTORY_MAX_BUCKETS                       37907
+#define OBP_DIRECTORY_LOAD_FACTOR                       4
+#define OBP_DIRECTORY_CACHE_SIZE                        16
+
+typedef struct _OBP_DIRECTORY
+{
+    OBJECT_DIRECTORY Directory;
+    POBJECT_DIRECTORY_ENTRY *Buckets;
+    ULONG BucketCount;
+    ULONG EntryCount;
+    POBJECT_DIRECTORY_ENTRY LookupCache[OBP_DIRECTORY_CACHE_SIZE];
+} OBP_DIRECTORY, *POBP_DIRECTORY;
+
+#define ObpGetDirectory(x) \
+    CONTAINING_RECORD((x), OBP_DIRECTORY, Directory)
+
 //
 // Startup and Shutdown Functions
 //
@@ -209,6 +231,12 @@ ObpLookupEntryDirectory(
     IN POBP_LOOKUP_CONTEXT Context
 );
 
+VOID
+NTAPI
+ObpDeleteDirectory(
+    IN PVOID ObjectBody
+);
+
 //
 // Symbolic Link Functions
 //
@@ -29,6 +29,7 @@
 #define TAG_ATOM                   'motA'
 #define TAG_PROFILE                'forP'
 #define TAG_ERR                    ' rrE'
+#define TAG_WORK_QUEUE             'uQkW'
 
 /* User Mode Debugging Manager Tag */
 #define TAG_DEBUG_EVENT 'EgbD'
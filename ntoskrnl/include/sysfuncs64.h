@@ -488,8 +488,8 @@ SVC_(ReleaseCMFViewOwnership, 0)
 SVC_(ReleaseKeyedEvent, 4)
 #if (NTDDI_VERSION >= NTDDI_VISTA)
 SVC_(ReleaseWorkerFactoryWorker, 1)
-SVC_(RemoveIoCompletionEx, 6)
 #endif
+SVC_(RemoveIoCompletionEx, 6)
 SVC_(RemoveProcessDebug, 2)
 SVC_(RenameKey, 2)
 #if (NTDDI_VERSION >= NTDDI_VISTASP1)
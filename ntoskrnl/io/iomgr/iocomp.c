@@ -95,6 +95,48 @@ IopFreeMiniPacket(PIOP_MINI_COMPLETION_PACKET Packet)
     InterlockedPushEntrySList(&List->L.ListHead, (PSLIST_ENTRY)Packet);
 }
 
+VOID
+NTAPI
+IopUnpackCompletionPacket(IN PLIST_ENTRY ListEntry,
+                          OUT PFILE_IO_COMPLETION_INFORMATION Information)
+{
+    PIOP_MINI_COMPLETION_PACKET Packet;
+    PIRP Irp;
+
+    /* Get the Packet Data */
+    Packet = CONTAINING_RECORD(ListEntry,
+                               IOP_MINI_COMPLETION_PACKET,
+                               ListEntry);
+
+    /* Check if this is piggybacked on an IRP */
+    if (Packet->PacketType == IopCompletionPacketIrp)
+    {
+        /* Get the IRP */
+        Irp = CONTAINING_RECORD(ListEntry,
+                                IRP,
+                                Tail.Overlay.ListEntry);
+
+        /* Save values */
+        Information->KeyContext = Irp->Tail.CompletionKey;
+        Information->ApcContext = Irp->Overlay.AsynchronousParameters.UserApcContext;
+        Information->IoStatusBlock = Irp->IoStatus;
+
+        /* Free the IRP */
+        IoFreeIrp(Irp);
+    }
+    else
+    {
+        /* Save values */
+        Information->KeyContext = Packet->KeyContext;
+        Information->ApcContext = Packet->ApcContext;
+        Information->IoStatusBlock.Status = Packet->IoStatus;
+        Information->IoStatusBlock.Information = Packet->IoStatusInformation;
+
+        /* Free the packet */
+        IopFreeMiniPacket(Packet);
+    }
+}
+
 VOID
 NTAPI
 IopDeleteIoCompletion(PVOID ObjectBody)
@@ -450,13 +492,10 @@ NtRemoveIoCompletion(IN HANDLE IoCompletionHandle,
 {
     LARGE_INTEGER SafeTimeout;
     PKQUEUE Queue;
-    PIOP_MINI_COMPLETION_PACKET Packet;
     PLIST_ENTRY ListEntry;
     KPROCESSOR_MODE PreviousMode = ExGetPreviousMode();
     NTSTATUS Status;
-    PIRP Irp;
-    PVOID Apc, Key;
-    IO_STATUS_BLOCK IoStatus;
+    FILE_IO_COMPLETION_INFORMATION Information;
     PAGED_CODE();
 
     /* Check if the call was from user mode */
@@ -507,46 +546,16 @@ NtRemoveIoCompletion(IN HANDLE IoCompletionHandle,
         }
         else
         {
-            /* Get the Packet Data */
-            Packet = CONTAINING_RECORD(ListEntry,
-                                       IOP_MINI_COMPLETION_PACKET,
-                                       ListEntry);
-
-            /* Check if this is piggybacked on an IRP */
-            if (Packet->PacketType == IopCompletionPacketIrp)
-            {
-                /* Get the IRP */
-                Irp = CONTAINING_RECORD(ListEntry,
-                                        IRP,
-                                        Tail.Overlay.ListEntry);
-
-                /* Save values */
-                Key = Irp->Tail.CompletionKey;
-                Apc = Irp->Overlay.AsynchronousParameters.UserApcContext;
-                IoStatus = Irp->IoStatus;
-
-                /* Free the IRP */
-                IoFreeIrp(Irp);
-            }
-            else
-            {
-                /* Save values */
-                Key = Packet->KeyContext;
-                Apc = Packet->ApcContext;
-                IoStatus.Status = Packet->IoStatus;
-                IoStatus.Information = Packet->IoStatusInformation;
-
-                /* Free the packet */
-                IopFreeMiniPacket(Packet);
-            }
+            /* Get the packet data and free it */
+            IopUnpackCompletionPacket(ListEntry, &Information);
 
             /* Enter SEH to write back the values */
             _SEH2_TRY
             {
                 /* Write the values to caller */
-                *ApcContext = Apc;
-                *KeyContext = Key;
-                *IoStatusBlock = IoStatus;
+                *ApcContext = Information.ApcContext;
+                *KeyContext = Information.KeyContext;
+                *IoStatusBlock = Information.IoStatusBlock;
             }
             _SEH2_EXCEPT(ExSystemExceptionFilter())
             {
@@ -564,6 +573,119 @@ NtRemoveIoCompletion(IN HANDLE IoCompletionHandle,
     return Status;
 }
 
+NTSTATUS
+NTAPI
+NtRemoveIoCompletionEx(IN HANDLE IoCompletionHandle,
+                       OUT PFILE_IO_COMPLETION_INFORMATION IoCompletionInformation,
+                       IN ULONG Count,
+                       OUT PULONG NumEntriesRemoved,
+                       IN PLARGE_INTEGER Timeout OPTIONAL,
+                       IN BOOLEAN Alertable)
+{
+    LARGE_INTEGER SafeTimeout;
+    PKQUEUE Queue;
+    PLIST_ENTRY ListEntries[IOP_MAX_REMOVE_COMPLETION_ENTRIES];
+    KPROCESSOR_MODE PreviousMode = ExGetPreviousMode();
+    NTSTATUS Status;
+    FILE_IO_COMPLETION_INFORMATION Information[IOP_MAX_REMOVE_COMPLETION_ENTRIES];
+    ULONG EntryCount, i;
+    PAGED_CODE();
+
+    /* There must be room for at least one entry */
+    if (Count == 0) return STATUS_INVALID_PARAMETER;
+
+    /* Check if the call was from user mode */
+    if (PreviousMode != KernelMode)
+    {
+        /* Protect probes in SEH */
+        _SEH2_TRY
+        {
+            /* Probe the entry array, checking for an overflow */
+            if (Count > MAXULONG / sizeof(FILE_IO_COMPLETION_INFORMATION))
+            {
+                ExRaiseStatus(STATUS_INVALID_PARAMETER);
+            }
+            ProbeForWrite(IoCompletionInformation,
+                          Count * sizeof(FILE_IO_COMPLETION_INFORMATION),
+                          sizeof(PVOID));
+
+            /* Probe the count of removed entries */
+            ProbeForWriteUlong(NumEntriesRemoved);
+            if (Timeout)
+            {
+                /* Probe and capture the timeout */
+                SafeTimeout = ProbeForReadLargeInteger(Timeout);
+                Timeout = &SafeTimeout;
+            }
+        }
+        _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+        {
+            /* Return the exception code */
+            _SEH2_YIELD(return _SEH2_GetExceptionCode());
+        }
+        _SEH2_END;
+    }
+
+    /* Don't remove more entries than we can hold at once */
+    Count = min(Count, IOP_MAX_REMOVE_COMPLETION_ENTRIES);
+
+    /* Open the Object */
+    Status = ObReferenceObjectByHandle(IoCompletionHandle,
+                                       IO_COMPLETION_MODIFY_STATE,
+                                       IoCompletionType,
+                                       PreviousMode,
+                                       (PVOID*)&Queue,
+                                       NULL);
+    if (NT_SUCCESS(Status))
+    {
+        /* Remove as many entries as are queued, waiting for the first one */
+        EntryCount = KeRemoveQueueEx(Queue,
+                                     PreviousMode,
+                                     Alertable,
+                                     Timeout,
+                                     ListEntries,
+                                     Count);
+
+        /* If the wait failed, return the status */
+        if (((NTSTATUS)(ULONG_PTR)ListEntries[0] == STATUS_TIMEOUT) ||
+            ((NTSTATUS)(ULONG_PTR)ListEntries[0] == STATUS_USER_APC) ||
+            ((NTSTATUS)(ULONG_PTR)ListEntries[0] == STATUS_ALERTED))
+        {
+            /* Set this as the status, nothing was removed */
+            Status = (NTSTATUS)(ULONG_PTR)ListEntries[0];
+            EntryCount = 0;
+        }
+
+        /* Get the data of every packet and free it */
+        for (i = 0; i < EntryCount; i++)
+        {
+            IopUnpackCompletionPacket(ListEntries[i], &Information[i]);
+        }
+
+        /* Enter SEH to write back the values */
+        _SEH2_TRY
+        {
+            /* Write the values to caller */
+            RtlCopyMemory(IoCompletionInformation,
+                          Information,
+                          EntryCount * sizeof(FILE_IO_COMPLETION_INFORMATION));
+            *NumEntriesRemoved = EntryCount;
+        }
+        _SEH2_EXCEPT(ExSystemExceptionFilter())
+        {
+            /* Get the exception code */
+            Status = _SEH2_GetExceptionCode();
+        }
+        _SEH2_END;
+
+        /* Dereference the Object */
+        ObDereferenceObject(Queue);
+    }
+
+    /* Return status */
+    return Status;
+}
+
 NTSTATUS
 NTAPI
 NtSetIoCompletion(IN HANDLE IoCompletionPortHandle,
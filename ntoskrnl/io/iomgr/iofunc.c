@@ -433,10 +433,11 @@ IopDeviceFsIoControl(IN HANDLE DeviceHandle,
                     CompletionInfo = *(FileObject->CompletionContext);
                 }
 
-                /* If we had an event, signal it */
+                /* If we had an event, signal it unless the caller opted out */
                 if (Event)
                 {
-                    KeSetEvent(EventObject, IO_NO_INCREMENT, FALSE);
+                    if (!(FileObject->Flags & FO_SKIP_SET_FAST_IO))
+                        KeSetEvent(EventObject, IO_NO_INCREMENT, FALSE);
                     ObDereferenceObject(EventObject);
                 }
 
@@ -1136,6 +1137,257 @@ IopGetDriverPathInformation(IN PFILE_OBJECT FileObject,
     return STATUS_SUCCESS;
 }
 
+static
+NTSTATUS
+IopScatterGatherFile(IN HANDLE FileHandle,
+                     IN HANDLE Event OPTIONAL,
+                     IN PIO_APC_ROUTINE ApcRoutine OPTIONAL,
+                     IN PVOID ApcContext OPTIONAL,
+                     OUT PIO_STATUS_BLOCK IoStatusBlock,
+                     IN FILE_SEGMENT_ELEMENT SegmentArray[],
+                     IN ULONG Length,
+                     IN PLARGE_INTEGER ByteOffset OPTIONAL,
+                     IN PULONG Key OPTIONAL,
+                     IN BOOLEAN Write)
+{
+    NTSTATUS Status;
+    PFILE_OBJECT FileObject;
+    PIRP Irp;
+    PDEVICE_OBJECT DeviceObject;
+    PIO_STACK_LOCATION StackPtr;
+    KPROCESSOR_MODE PreviousMode = KeGetPreviousMode();
+    PKEVENT EventObject = NULL;
+    LARGE_INTEGER CapturedByteOffset;
+    ULONG CapturedKey = 0;
+    ULONG PageCount, i;
+    BOOLEAN Synchronous = FALSE;
+    PMDL Mdl;
+
+    PAGED_CODE();
+    CapturedByteOffset.QuadPart = 0;
+    IOTRACE(IO_API_DEBUG, "FileHandle: %p\n", FileHandle);
+
+    /* Get File Object */
+    Status = ObReferenceObjectByHandle(FileHandle,
+                                       Write ? FILE_WRITE_DATA : FILE_READ_DATA,
+                                       IoFileObjectType,
+                                       PreviousMode,
+                                       (PVOID*)&FileObject,
+                                       NULL);
+    if (!NT_SUCCESS(Status)) return Status;
+
+    /* Get the device object */
+    DeviceObject = IoGetRelatedDeviceObject(FileObject);
+
+    /*
+     * The pages are handed to the driver as they are, so the file must be
+     * opened for non-cached access and the driver must accept an MDL
+     */
+    if (!(FileObject->Flags & FO_NO_INTERMEDIATE_BUFFERING) ||
+        (DeviceObject->Flags & DO_BUFFERED_IO))
+    {
+        ObDereferenceObject(FileObject);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    /* Can't use an I/O completion port and an APC at the same time */
+    if ((FileObject->CompletionContext) && (ApcRoutine))
+    {
+        ObDereferenceObject(FileObject);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    /* Fail if Length is not sector size aligned */
+    if ((DeviceObject->SectorSize != 0) &&
+        (Length % DeviceObject->SectorSize != 0))
+    {
+        ObDereferenceObject(FileObject);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    /* Every page of the transfer has its own segment */
+    PageCount = BYTES_TO_PAGES(Length);
+
+    _SEH2_TRY
+    {
+        /* Validate User-Mode Buffers */
+        if (PreviousMode != KernelMode)
+        {
+            /* Probe the status block */
+            ProbeForWriteIoStatusBlock(IoStatusBlock);
+
+            /* Probe the segment array */
+            ProbeForRead(SegmentArray,
+                         PageCount * sizeof(FILE_SEGMENT_ELEMENT),
+                         sizeof(FILE_SEGMENT_ELEMENT));
+
+            /* Capture and probe the byte offset and the key */
+            if (ByteOffset) CapturedByteOffset = ProbeForReadLargeInteger(ByteOffset);
+            if (Key) CapturedKey = ProbeForReadUlong(Key);
+        }
+        else
+        {
+            /* Kernel mode: capture directly */
+            if (ByteOffset) CapturedByteOffset = *ByteOffset;
+            if (Key) CapturedKey = *Key;
+        }
+
+        /* Fail if a segment doesn't start on a page */
+        for (i = 0; i < PageCount; i++)
+        {
+            if (SegmentArray[i].Alignment & (PAGE_SIZE - 1))
+            {
+                ObDereferenceObject(FileObject);
+                _SEH2_YIELD(return STATUS_INVALID_PARAMETER);
+            }
+        }
+    }
+    _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+    {
+        /* Release the file object and return the exception code */
+        ObDereferenceObject(FileObject);
+        _SEH2_YIELD(return _SEH2_GetExceptionCode());
+    }
+    _SEH2_END;
+
+    /* Check for invalid offset, -1 is FILE_WRITE_TO_END_OF_FILE */
+    if ((CapturedByteOffset.QuadPart < -2) ||
+        ((CapturedByteOffset.QuadPart == -1) && !Write))
+    {
+        ObDereferenceObject(FileObject);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    /* Fail if ByteOffset is not sector size aligned */
+    if ((CapturedByteOffset.QuadPart >= 0) &&
+        (DeviceObject->SectorSize != 0) &&
+        (CapturedByteOffset.QuadPart % DeviceObject->SectorSize != 0))
+    {
+        ObDereferenceObject(FileObject);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    /* Check for event */
+    if (Event)
+    {
+        /* Reference it */
+        Status = ObReferenceObjectByHandle(Event,
+                                           EVENT_MODIFY_STATE,
+                                           ExEventObjectType,
+                                           PreviousMode,
+                                           (PVOID*)&EventObject,
+                                           NULL);
+        if (!NT_SUCCESS(Status))
+        {
+            /* Fail */
+            ObDereferenceObject(FileObject);
+            return Status;
+        }
+
+        /* Otherwise reset the event */
+        KeClearEvent(EventObject);
+    }
+
+    /* Check if we should use Sync IO or not */
+    if (FileObject->Flags & FO_SYNCHRONOUS_IO)
+    {
+        /* Lock the file object */
+        Status = IopLockFileObject(FileObject, PreviousMode);
+        if (Status != STATUS_SUCCESS)
+        {
+            if (EventObject) ObDereferenceObject(EventObject);
+            ObDereferenceObject(FileObject);
+            return Status;
+        }
+
+        /* Check if we don't have a byte offset available */
+        if (!(ByteOffset) ||
+            ((CapturedByteOffset.u.LowPart == FILE_USE_FILE_POINTER_POSITION) &&
+             (CapturedByteOffset.u.HighPart == -1)))
+        {
+            /* Use the Current Byte Offset instead */
+            CapturedByteOffset = FileObject->CurrentByteOffset;
+        }
+
+        /* Remember we are sync */
+        Synchronous = TRUE;
+    }
+    else if (!(ByteOffset) ||
+             (CapturedByteOffset.QuadPart == -2))
+    {
+        /* Otherwise, this was async I/O without a byte offset, so fail */
+        if (EventObject) ObDereferenceObject(EventObject);
+        ObDereferenceObject(FileObject);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    /* Clear the File Object's event */
+    KeClearEvent(&FileObject->Event);
+
+    /* Allocate the IRP */
+    Irp = IoAllocateIrp(DeviceObject->StackSize, FALSE);
+    if (!Irp) return IopCleanupFailedIrp(FileObject, EventObject, NULL);
+
+    /* Set the IRP */
+    Irp->Tail.Overlay.OriginalFileObject = FileObject;
+    Irp->Tail.Overlay.Thread = PsGetCurrentThread();
+    Irp->RequestorMode = PreviousMode;
+    Irp->Overlay.AsynchronousParameters.UserApcRoutine = ApcRoutine;
+    Irp->Overlay.AsynchronousParameters.UserApcContext = ApcContext;
+    Irp->UserIosb = IoStatusBlock;
+    Irp->UserEvent = EventObject;
+    Irp->PendingReturned = FALSE;
+    Irp->Cancel = FALSE;
+    Irp->CancelRoutine = NULL;
+    Irp->AssociatedIrp.SystemBuffer = NULL;
+    Irp->MdlAddress = NULL;
+    Irp->UserBuffer = NULL;
+
+    /* Set the Stack Data, the read and write parameters are the same */
+    StackPtr = IoGetNextIrpStackLocation(Irp);
+    StackPtr->MajorFunction = Write ? IRP_MJ_WRITE : IRP_MJ_READ;
+    StackPtr->FileObject = FileObject;
+    StackPtr->Parameters.Read.Key = CapturedKey;
+    StackPtr->Parameters.Read.Length = Length;
+    StackPtr->Parameters.Read.ByteOffset = CapturedByteOffset;
+
+    /* Describe all the segments with a single MDL */
+    if (Length)
+    {
+        _SEH2_TRY
+        {
+            /* The MDL has no virtual address, only the pages */
+            Mdl = IoAllocateMdl(NULL, Length, FALSE, TRUE, Irp);
+            if (!Mdl)
+                ExRaiseStatus(STATUS_INSUFFICIENT_RESOURCES);
+            MmProbeAndLockSelectedPages(Mdl,
+                                        SegmentArray,
+                                        PreviousMode,
+                                        Write ? IoReadAccess : IoWriteAccess);
+        }
+        _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+        {
+            /* Locking failed, clean up and return the exception code */
+            IopCleanupAfterException(FileObject, Irp, EventObject, NULL);
+            _SEH2_YIELD(return _SEH2_GetExceptionCode());
+        }
+        _SEH2_END;
+    }
+
+    /* Now set the deferred I/O flags */
+    Irp->Flags = (Write ? IRP_WRITE_OPERATION : IRP_READ_OPERATION) |
+                 IRP_DEFER_IO_COMPLETION | IRP_NOCACHE;
+
+    /* Perform the call */
+    return IopPerformSynchronousRequest(DeviceObject,
+                                        Irp,
+                                        FileObject,
+                                        TRUE,
+                                        PreviousMode,
+                                        Synchronous,
+                                        Write ? IopWriteTransfer : IopReadTransfer);
+}
+
 /* PUBLIC FUNCTIONS **********************************************************/
 
 /*
@@ -2917,10 +3169,11 @@ NtReadFile(IN HANDLE FileHandle,
                 }
                 _SEH2_END;
 
-                /* Signal the completion event */
+                /* Signal the completion event, unless the caller opted out */
                 if (EventObject)
                 {
-                    KeSetEvent(EventObject, 0, FALSE);
+                    if (!(FileObject->Flags & FO_SKIP_SET_FAST_IO))
+                        KeSetEvent(EventObject, 0, FALSE);
                     ObDereferenceObject(EventObject);
                 }
 
@@ -3056,7 +3309,7 @@ NtReadFile(IN HANDLE FileHandle,
 }
 
 /*
- * @unimplemented
+ * @implemented
  */
 NTSTATUS
 NTAPI
@@ -3070,8 +3323,16 @@ NtReadFileScatter(IN HANDLE FileHandle,
                   IN PLARGE_INTEGER  ByteOffset,
                   IN PULONG Key OPTIONAL)
 {
-    UNIMPLEMENTED;
-    return STATUS_NOT_IMPLEMENTED;
+    return IopScatterGatherFile(FileHandle,
+                                Event,
+                                UserApcRoutine,
+                                UserApcContext,
+                                UserIoStatusBlock,
+                                BufferDescription,
+                                BufferLength,
+                                ByteOffset,
+                                Key,
+                                FALSE);
 }
 
 /*
@@ -3113,6 +3374,7 @@ NtSetInformationFile(IN HANDLE FileHandle,
     IO_STATUS_BLOCK KernelIosb;
     PVOID Queue;
     PFILE_COMPLETION_INFORMATION CompletionInfo = FileInformation;
+    PFILE_IO_COMPLETION_NOTIFICATION_INFORMATION NotificationInfo;
     PIO_COMPLETION_CONTEXT Context;
     PFILE_RENAME_INFORMATION RenameInfo;
     HANDLE TargetHandle = NULL;
@@ -3124,7 +3386,7 @@ NtSetInformationFile(IN HANDLE FileHandle,
     {
         /* Validate the information class */
         if ((FileInformationClass < 0) ||
-            (FileInformationClass >= FileMaximumInformation) ||
+            (FileInformationClass >= IopMaximumSetInformationClass) ||
             !(IopSetOperationLength[FileInformationClass]))
         {
             /* Invalid class */
@@ -3161,7 +3423,7 @@ NtSetInformationFile(IN HANDLE FileHandle,
     {
         /* Validate the information class */
         if ((FileInformationClass < 0) ||
-            (FileInformationClass >= FileMaximumInformation) ||
+            (FileInformationClass >= IopMaximumSetInformationClass) ||
             !(IopSetOperationLength[FileInformationClass]))
         {
             /* Invalid class */
@@ -3377,6 +3639,31 @@ NtSetInformationFile(IN HANDLE FileHandle,
         Irp->IoStatus.Status = Status;
         Irp->IoStatus.Information = 0;
     }
+    else if (FileInformationClass == FileIoCompletionNotificationInformation)
+    {
+        /* The modes can only be turned on, never off again */
+        NotificationInfo = Irp->AssociatedIrp.SystemBuffer;
+        if (NotificationInfo->Flags & ~(FILE_SKIP_COMPLETION_PORT_ON_SUCCESS |
+                                        FILE_SKIP_SET_EVENT_ON_HANDLE |
+                                        FILE_SKIP_SET_USER_EVENT_ON_FAST_IO))
+        {
+            Status = STATUS_INVALID_PARAMETER;
+        }
+        else
+        {
+            if (NotificationInfo->Flags & FILE_SKIP_COMPLETION_PORT_ON_SUCCESS)
+                InterlockedOr((PLONG)&FileObject->Flags, FO_SKIP_COMPLETION_PORT);
+            if (NotificationInfo->Flags & FILE_SKIP_SET_EVENT_ON_HANDLE)
+                InterlockedOr((PLONG)&FileObject->Flags, FO_SKIP_SET_EVENT);
+            if (NotificationInfo->Flags & FILE_SKIP_SET_USER_EVENT_ON_FAST_IO)
+                InterlockedOr((PLONG)&FileObject->Flags, FO_SKIP_SET_FAST_IO);
+            Status = STATUS_SUCCESS;
+        }
+
+        /* Set the IRP Status */
+        Irp->IoStatus.Status = Status;
+        Irp->IoStatus.Information = 0;
+    }
     else if (FileInformationClass == FileRenameInformation ||
              FileInformationClass == FileLinkInformation ||
              FileInformationClass == FileMoveClusterInformation)
@@ -3992,10 +4279,11 @@ NtWriteFile(IN HANDLE FileHandle,
                 }
                 _SEH2_END;
 
-                /* Signal the completion event */
+                /* Signal the completion event, unless the caller opted out */
                 if (EventObject)
                 {
-                    KeSetEvent(EventObject, 0, FALSE);
+                    if (!(FileObject->Flags & FO_SKIP_SET_FAST_IO))
+                        KeSetEvent(EventObject, 0, FALSE);
                     ObDereferenceObject(EventObject);
                 }
 
@@ -4131,6 +4419,9 @@ NtWriteFile(IN HANDLE FileHandle,
                                         IopWriteTransfer);
 }
 
+/*
+ * @implemented
+ */
 NTSTATUS
 NTAPI
 NtWriteFileGather(IN HANDLE FileHandle,
@@ -4143,8 +4434,16 @@ NtWriteFileGather(IN HANDLE FileHandle,
                   IN PLARGE_INTEGER ByteOffset,
                   IN PULONG Key OPTIONAL)
 {
-    UNIMPLEMENTED;
-    return STATUS_NOT_IMPLEMENTED;
+    return IopScatterGatherFile(FileHandle,
+                                Event,
+                                UserApcRoutine,
+                                UserApcContext,
+                                UserIoStatusBlock,
+                                BufferDescription,
+                                BufferLength,
+                                ByteOffset,
+                                Key,
+                                TRUE);
 }
 
 /*
@@ -138,6 +138,51 @@ KiInsertQueue(IN PKQUEUE Queue,
     return InitialState;
 }
 
+/*
+ * Removes up to Count entries from the head of the queue and returns how many
+ * were removed. The caller holds the dispatcher lock and accounts for itself
+ * in the number of active threads.
+ */
+static
+ULONG
+KiRemoveQueueEntries(IN PKQUEUE Queue,
+                     IN PLIST_ENTRY *EntryArray,
+                     IN ULONG Count)
+{
+    PLIST_ENTRY QueueEntry;
+    ULONG EntryCount = 0;
+
+    /* Loop while the caller has room and the queue isn't empty */
+    QueueEntry = Queue->EntryListHead.Flink;
+    while ((EntryCount < Count) && (QueueEntry != &Queue->EntryListHead))
+    {
+        /* Decrease the number of entries */
+        Queue->Header.SignalState--;
+
+        /* Check if the entry is valid. If not, bugcheck */
+        if (!(QueueEntry->Flink) || !(QueueEntry->Blink))
+        {
+            /* Invalid item */
+            KeBugCheckEx(INVALID_WORK_QUEUE_ITEM,
+                         (ULONG_PTR)QueueEntry,
+                         (ULONG_PTR)Queue,
+                         (ULONG_PTR)NULL,
+                         (ULONG_PTR)((PWORK_QUEUE_ITEM)QueueEntry)->
+                                     WorkerRoutine);
+        }
+
+        /* Remove the Entry */
+        RemoveEntryList(QueueEntry);
+        QueueEntry->Flink = NULL;
+
+        /* Return it and move to the next one */
+        EntryArray[EntryCount++] = QueueEntry;
+        QueueEntry = Queue->EntryListHead.Flink;
+    }
+
+    return EntryCount;
+}
+
 /* PUBLIC FUNCTIONS **********************************************************/
 
 /*
@@ -240,7 +285,30 @@ KeRemoveQueue(IN PKQUEUE Queue,
               IN PLARGE_INTEGER Timeout OPTIONAL)
 {
     PLIST_ENTRY QueueEntry;
+
+    /* Remove a single entry, or get the status of the wait */
+    KeRemoveQueueEx(Queue, WaitMode, FALSE, Timeout, &QueueEntry, 1);
+    return QueueEntry;
+}
+
+/*
+ * Removes up to Count entries from the queue, waiting for the first one.
+ * Returns the number of entries written to EntryArray. If the wait failed,
+ * it returns 1 and the status of the wait is in the first entry instead.
+ */
+ULONG
+NTAPI
+KeRemoveQueueEx(IN PKQUEUE Queue,
+                IN KPROCESSOR_MODE WaitMode,
+                IN BOOLEAN Alertable,
+                IN PLARGE_INTEGER Timeout OPTIONAL,
+                OUT PLIST_ENTRY *EntryArray,
+                IN ULONG Count)
+{
+    PLIST_ENTRY QueueEntry;
     LONG_PTR Status;
+    ULONG EntryCount;
+    KIRQL OldIrql;
     PKTHREAD Thread = KeGetCurrentThread();
     PKQUEUE PreviousQueue;
     PKWAIT_BLOCK WaitBlock = &Thread->WaitBlock[0];
@@ -252,6 +320,7 @@ KeRemoveQueue(IN PKQUEUE Queue,
     ULONG Hand = 0;
     ASSERT_QUEUE(Queue);
     ASSERT_IRQL_LESS_OR_EQUAL(DISPATCH_LEVEL);
+    ASSERT(Count != 0);
 
     /* Check if the Lock is already held */
     if (Thread->WaitNext)
@@ -306,27 +375,11 @@ KeRemoveQueue(IN PKQUEUE Queue,
         if ((Queue->CurrentCount < Queue->MaximumCount) &&
             (QueueEntry != &Queue->EntryListHead))
         {
-            /* Decrease the number of entries */
-            Queue->Header.SignalState--;
-
             /* Increase numbef of running threads */
             Queue->CurrentCount++;
 
-            /* Check if the entry is valid. If not, bugcheck */
-            if (!(QueueEntry->Flink) || !(QueueEntry->Blink))
-            {
-                /* Invalid item */
-                KeBugCheckEx(INVALID_WORK_QUEUE_ITEM,
-                             (ULONG_PTR)QueueEntry,
-                             (ULONG_PTR)Queue,
-                             (ULONG_PTR)NULL,
-                             (ULONG_PTR)((PWORK_QUEUE_ITEM)QueueEntry)->
-                                         WorkerRoutine);
-            }
-
-            /* Remove the Entry */
-            RemoveEntryList(QueueEntry);
-            QueueEntry->Flink = NULL;
+            /* Remove as many entries as the caller wants */
+            EntryCount = KiRemoveQueueEntries(Queue, EntryArray, Count);
 
             /* Nothing to wait on */
             break;
@@ -344,12 +397,13 @@ KeRemoveQueue(IN PKQUEUE Queue,
             }
             else
             {
-                /* Fail if there's a User APC Pending */
-                if ((WaitMode != KernelMode) &&
-                    (Thread->ApcState.UserApcPending))
+                /* Fail if we were alerted or there's a User APC Pending */
+                Status = KiCheckAlertability(Thread, Alertable, WaitMode);
+                if (Status != STATUS_WAIT_0)
                 {
                     /* Return the status and increase the pending threads */
-                    QueueEntry = (PLIST_ENTRY)STATUS_USER_APC;
+                    EntryArray[0] = (PLIST_ENTRY)Status;
+                    EntryCount = 1;
                     Queue->CurrentCount++;
                     break;
                 }
@@ -362,7 +416,8 @@ KeRemoveQueue(IN PKQUEUE Queue,
                     if ((ULONG64)InterruptTime.QuadPart >= Timer->DueTime.QuadPart)
                     {
                         /* It did, so we don't need to wait */
-                        QueueEntry = (PLIST_ENTRY)STATUS_TIMEOUT;
+                        EntryArray[0] = (PLIST_ENTRY)STATUS_TIMEOUT;
+                        EntryCount = 1;
                         Queue->CurrentCount++;
                         break;
                     }
@@ -404,7 +459,29 @@ KeRemoveQueue(IN PKQUEUE Queue,
                 Thread->WaitReason = 0;
 
                 /* Check if we were executing an APC */
-                if (Status != STATUS_KERNEL_APC) return (PLIST_ENTRY)Status;
+                if (Status != STATUS_KERNEL_APC)
+                {
+                    /* We weren't, so this is either an entry or a wait status */
+                    EntryArray[0] = (PLIST_ENTRY)Status;
+                    if ((Count == 1) ||
+                        (Status == STATUS_TIMEOUT) ||
+                        (Status == STATUS_USER_APC) ||
+                        (Status == STATUS_ALERTED))
+                    {
+                        return 1;
+                    }
+
+                    /*
+                     * We got an entry and are already counted as active, so
+                     * take whatever was queued behind it without waiting.
+                     */
+                    OldIrql = KiAcquireDispatcherLock();
+                    EntryCount = 1 + KiRemoveQueueEntries(Queue,
+                                                          &EntryArray[1],
+                                                          Count - 1);
+                    KiReleaseDispatcherLock(OldIrql);
+                    return EntryCount;
+                }
 
                 /* Check if we had a timeout */
                 if (Timeout)
@@ -427,7 +504,7 @@ KeRemoveQueue(IN PKQUEUE Queue,
     /* Unlock Database and return */
     KiReleaseDispatcherLockFromSynchLevel();
     KiExitDispatcher(Thread->WaitIrql);
-    return QueueEntry;
+    return EntryCount;
 }
 
 /*
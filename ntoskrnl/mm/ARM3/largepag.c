@@ -25,6 +25,7 @@ WCHAR MmLargePageDriverBuffer[512] = {0};
 ULONG MmLargePageDriverBufferLength = -1;
 LIST_ENTRY MiLargePageDriverList;
 BOOLEAN MiLargePageAllDrivers;
+SIZE_T MmLargePageMinimum;
 
 /* FUNCTIONS ******************************************************************/
 
@@ -34,8 +35,8 @@ NTAPI
 MiInitializeLargePageSupport(VOID)
 {
 #if _MI_PAGING_LEVELS > 2
-    DPRINT1("MiInitializeLargePageSupport: PAE/x64 Not Implemented\n");
-    //ASSERT(FALSE);
+    /* PAE and x64 PDEs can always map a large page */
+    MmLargePageMinimum = PDE_MAPPED_VA;
 #else
     /* Initialize the large-page hyperspace PTE used for initial mapping */
     MiLargePageHyperPte = MiReserveSystemPtes(1, SystemPteSpace);
@@ -45,9 +46,251 @@ MiInitializeLargePageSupport(VOID)
     /* Initialize the process tracking list, and insert the system process */
     InitializeListHead(&MmProcessList);
     InsertTailList(&MmProcessList, &PsGetCurrentProcess()->MmProcessLinks);
+
+    /* 4MB pages need PSE, which KiInitMachineDependent enabled if present */
+    if (KeFeatureBits & KF_LARGE_PAGE) MmLargePageMinimum = PDE_MAPPED_VA;
 #endif
 }
 
+static
+PFN_NUMBER
+MiAllocateLargePage(VOID)
+{
+    PFN_NUMBER PageFrameIndex, i;
+
+    /* Large pages are never paged out, make sure we can afford to lock one */
+    if (MI_LARGE_PAGE_PFNS >
+        (MmResidentAvailablePages - MmSystemLockPagesCount - 256))
+    {
+        DPRINT1("Not enough resident pages for a large page\n");
+        return 0;
+    }
+
+    /* Find free pages aligned on the large page size */
+    PageFrameIndex = MiFindContiguousPages(0,
+                                           MmHighestPhysicalPage,
+                                           MI_LARGE_PAGE_PFNS,
+                                           MI_LARGE_PAGE_PFNS,
+                                           MmCached);
+    if (!PageFrameIndex) return 0;
+
+    /* Charge them */
+    InterlockedExchangeAddSizeT(&MmResidentAvailablePages, -(SSIZE_T)MI_LARGE_PAGE_PFNS);
+
+    /* They could have come from the free list, so wipe them */
+    for (i = 0; i < MI_LARGE_PAGE_PFNS; i++)
+    {
+        MiZeroPhysicalPage(PageFrameIndex + i);
+    }
+
+    return PageFrameIndex;
+}
+
+static
+VOID
+MiFreeLargePage(IN PFN_NUMBER PageFrameIndex)
+{
+    PMMPFN Pfn1;
+    PFN_NUMBER LastPage;
+
+    /* PFN lock must be held */
+    MI_ASSERT_PFN_LOCK_HELD();
+
+    /* This must be the start of a large page from MiAllocateLargePage */
+    Pfn1 = MI_PFN_ELEMENT(PageFrameIndex);
+    ASSERT(Pfn1->u3.e1.StartOfAllocation == 1);
+    ASSERT((Pfn1 + MI_LARGE_PAGE_PFNS - 1)->u3.e1.EndOfAllocation == 1);
+    Pfn1->u3.e1.StartOfAllocation = 0;
+    (Pfn1 + MI_LARGE_PAGE_PFNS - 1)->u3.e1.EndOfAllocation = 0;
+
+    /* Drop the last reference on each page, which puts it back on the free list */
+    LastPage = PageFrameIndex + MI_LARGE_PAGE_PFNS;
+    do
+    {
+        ASSERT(Pfn1->u3.e2.ReferenceCount == 1);
+        ASSERT(Pfn1->u2.ShareCount == 1);
+        MI_SET_PFN_DELETED(Pfn1);
+        MiDecrementShareCount(Pfn1++, PageFrameIndex++);
+    } while (PageFrameIndex < LastPage);
+
+    /* Give back the charge */
+    InterlockedExchangeAddSizeT(&MmResidentAvailablePages, MI_LARGE_PAGE_PFNS);
+}
+
+VOID
+NTAPI
+MiDeleteLargePde(IN PMMPDE PointerPde,
+                 IN PEPROCESS CurrentProcess)
+{
+    PFN_NUMBER PageFrameIndex, PageDirectoryIndex;
+
+    /* PFN lock must be held */
+    MI_ASSERT_PFN_LOCK_HELD();
+
+    /* Only for user-mode ones */
+    ASSERT(MiIsUserPde(PointerPde));
+    ASSERT(MI_IS_PAGE_LARGE(PointerPde));
+
+    /* Unmap the large page */
+    PageFrameIndex = PFN_FROM_PTE(PointerPde);
+    PageDirectoryIndex = MI_PFN_ELEMENT(PageFrameIndex)->u4.PteFrame;
+    MI_ERASE_PTE((PMMPTE)PointerPde);
+    KeFlushCurrentTb();
+
+    /* Release the pages and the reference on the page directory */
+    MiFreeLargePage(PageFrameIndex);
+    MiDecrementShareCount(MI_PFN_ELEMENT(PageDirectoryIndex), PageDirectoryIndex);
+
+#if _MI_PAGING_LEVELS >= 3
+    /* Cascade down, as MiDeletePde does */
+    if (MiDecrementPageTableReferences(MiPdeToPte(PointerPde)) == 0)
+    {
+        MiDeletePte(MiPdeToPpe(PointerPde), PointerPde, CurrentProcess, NULL);
+#if _MI_PAGING_LEVELS == 4
+        if (MiDecrementPageTableReferences(PointerPde) == 0)
+        {
+            MiDeletePte(MiPdeToPxe(PointerPde), MiPdeToPpe(PointerPde), CurrentProcess, NULL);
+        }
+#endif
+    }
+#endif
+}
+
+NTSTATUS
+NTAPI
+MiMapLargePageVad(IN PEPROCESS Process,
+                  IN PMMVAD Vad)
+{
+    PETHREAD CurrentThread = PsGetCurrentThread();
+    PFN_NUMBER PageCount, i, j, PageFrameIndex, PageDirectoryIndex;
+    PPFN_NUMBER Pages;
+    ULONG_PTR Address;
+    PMMPDE PointerPde;
+#if _MI_PAGING_LEVELS >= 3
+    PMMPPE PointerPpe;
+#endif
+#if _MI_PAGING_LEVELS == 4
+    PMMPXE PointerPxe;
+#endif
+    MMPDE TempPde;
+    PMMPFN Pfn1;
+    KIRQL OldIrql;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    /* The VAD must be made of whole large pages */
+    ASSERT(Vad->u.VadFlags.VadType == VadLargePages);
+    ASSERT((Vad->StartingVpn % MI_LARGE_PAGE_PFNS) == 0);
+    ASSERT(((Vad->EndingVpn + 1) % MI_LARGE_PAGE_PFNS) == 0);
+    ASSERT(Process == PsGetCurrentProcess());
+    PageCount = (Vad->EndingVpn + 1 - Vad->StartingVpn) / MI_LARGE_PAGE_PFNS;
+
+    Pages = ExAllocatePoolWithTag(PagedPool, PageCount * sizeof(PFN_NUMBER), 'pLmM');
+    if (!Pages) return STATUS_INSUFFICIENT_RESOURCES;
+
+    /* Get all the physical memory first, so we don't zero it under the locks */
+    for (i = 0; i < PageCount; i++)
+    {
+        Pages[i] = MiAllocateLargePage();
+        if (!Pages[i])
+        {
+            DPRINT1("Out of large pages after %Iu of %Iu\n", i, PageCount);
+            OldIrql = MiAcquirePfnLock();
+            while (i--) MiFreeLargePage(Pages[i]);
+            MiReleasePfnLock(OldIrql);
+            ExFreePoolWithTag(Pages, 'pLmM');
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+    }
+
+    /* Now map them, one PDE each */
+    MmLockAddressSpace(&Process->Vm);
+    MiLockProcessWorkingSetUnsafe(Process, CurrentThread);
+    Address = Vad->StartingVpn << PAGE_SHIFT;
+    for (i = 0; i < PageCount; i++, Address += PDE_MAPPED_VA)
+    {
+        PointerPde = MiAddressToPde((PVOID)Address);
+#if _MI_PAGING_LEVELS >= 3
+        PointerPpe = MiAddressToPpe((PVOID)Address);
+#endif
+#if _MI_PAGING_LEVELS == 4
+        /* Make sure the upper levels exist, but not the page table */
+        PointerPxe = MiAddressToPxe((PVOID)Address);
+        if (!PointerPxe->u.Hard.Valid)
+        {
+            MiMakeSystemAddressValid(PointerPpe, Process);
+        }
+#endif
+#if _MI_PAGING_LEVELS >= 3
+        if (!PointerPpe->u.Hard.Valid)
+        {
+            MiMakeSystemAddressValid(PointerPde, Process);
+        }
+#endif
+
+        /* Someone touched the range before we got here and built a page table */
+        if (PointerPde->u.Long != 0)
+        {
+            DPRINT1("PDE %p for large page is already in use\n", PointerPde);
+            Status = STATUS_CONFLICTING_ADDRESSES;
+            break;
+        }
+
+        /* Build the large PDE */
+        PageFrameIndex = Pages[i];
+        TempPde.u.Long = 0;
+        TempPde.u.Hard.Valid = 1;
+        TempPde.u.Hard.Owner = 1;
+        TempPde.u.Hard.PageFrameNumber = PageFrameIndex;
+        TempPde.u.Long |= MmProtectToPteMask[Vad->u.VadFlags.Protection];
+        TempPde.u.Hard.LargePage = 1;
+        MI_MAKE_ACCESSED_PAGE(&TempPde);
+        MI_MAKE_DIRTY_PAGE(&TempPde);
+
+        OldIrql = MiAcquirePfnLock();
+
+        /* The pages are owned by the PDE, and reference the page directory */
+        PageDirectoryIndex = PFN_FROM_PTE(MiAddressToPte(PointerPde));
+        Pfn1 = MI_PFN_ELEMENT(PageFrameIndex);
+        for (j = 0; j < MI_LARGE_PAGE_PFNS; j++, Pfn1++)
+        {
+            Pfn1->PteAddress = (PMMPTE)PointerPde;
+            MI_MAKE_SOFTWARE_PTE(&Pfn1->OriginalPte, Vad->u.VadFlags.Protection);
+            Pfn1->u4.PteFrame = PageDirectoryIndex;
+            Pfn1->u3.e1.Modified = 1;
+        }
+        MI_PFN_ELEMENT(PageDirectoryIndex)->u2.ShareCount++;
+
+        MI_WRITE_VALID_PDE(PointerPde, TempPde);
+        MiReleasePfnLock(OldIrql);
+#if _MI_PAGING_LEVELS >= 3
+        MiIncrementPageTableReferences(MiPdeToPte(PointerPde));
+#endif
+
+        /* The mapping owns it now */
+        Pages[i] = 0;
+    }
+
+    if (!NT_SUCCESS(Status))
+    {
+        /* Undo what we mapped, then release what we didn't */
+        OldIrql = MiAcquirePfnLock();
+        for (j = 0, Address = Vad->StartingVpn << PAGE_SHIFT; j < i; j++, Address += PDE_MAPPED_VA)
+        {
+            MiDeleteLargePde(MiAddressToPde((PVOID)Address), Process);
+        }
+        for (j = i; j < PageCount; j++)
+        {
+            MiFreeLargePage(Pages[j]);
+        }
+        MiReleasePfnLock(OldIrql);
+    }
+
+    MiUnlockProcessWorkingSetUnsafe(Process, CurrentThread);
+    MmUnlockAddressSpace(&Process->Vm);
+    ExFreePoolWithTag(Pages, 'pLmM');
+    return Status;
+}
+
 CODE_SEG("INIT")
 VOID
 NTAPI
@@ -1187,7 +1187,7 @@ MmProbeAndLockPages(IN PMDL Mdl,
                (PointerPpe->u.Hard.Valid == 0) ||
 #endif
                (PointerPde->u.Hard.Valid == 0) ||
-               (PointerPte->u.Hard.Valid == 0))
+               (!MI_IS_PAGE_LARGE(PointerPde) && (PointerPte->u.Hard.Valid == 0)))
         {
             //
             // What kind of lock were we using?
@@ -1239,12 +1239,20 @@ MmProbeAndLockPages(IN PMDL Mdl,
         }
 
         //
-        // Check if this was a write or modify
+        // Large pages are always resident, and have no page table to look at
         //
-        if (Operation != IoReadAccess)
+        if (MI_IS_PAGE_LARGE(PointerPde))
+        {
+            if ((Operation != IoReadAccess) && (MI_IS_PAGE_WRITEABLE(PointerPde) == FALSE))
+            {
+                Status = STATUS_ACCESS_VIOLATION;
+                goto CleanupWithLock;
+            }
+        }
+        else if (Operation != IoReadAccess)
         {
             //
-            // Check if the PTE is not writable
+            // This was a write or modify, check if the PTE is not writable
             //
             if (MI_IS_PAGE_WRITEABLE(PointerPte) == FALSE)
             {
@@ -1324,7 +1332,15 @@ MmProbeAndLockPages(IN PMDL Mdl,
         //
         // Grab the PFN
         //
-        PageFrameIndex = PFN_FROM_PTE(PointerPte);
+        if (MI_IS_PAGE_LARGE(PointerPde))
+        {
+            PageFrameIndex = PFN_FROM_PTE(PointerPde) +
+                             MiAddressToPteOffset(MiPteToAddress(PointerPte));
+        }
+        else
+        {
+            PageFrameIndex = PFN_FROM_PTE(PointerPte);
+        }
         Pfn1 = MiGetPfnEntry(PageFrameIndex);
         if (Pfn1)
         {
@@ -1677,16 +1693,93 @@ MmProbeAndLockProcessPages(IN OUT PMDL MemoryDescriptorList,
 
 
 /*
- * @unimplemented
+ * @implemented
  */
 VOID
 NTAPI
 MmProbeAndLockSelectedPages(IN OUT PMDL MemoryDescriptorList,
-                            IN LARGE_INTEGER PageList[],
+                            IN PFILE_SEGMENT_ELEMENT SegmentArray,
                             IN KPROCESSOR_MODE AccessMode,
                             IN LOCK_OPERATION Operation)
 {
-    UNIMPLEMENTED;
+    PMDL Mdl = MemoryDescriptorList;
+    PPFN_NUMBER MdlPages;
+    ULONG PageCount, ByteCount, i;
+    NTSTATUS Status = STATUS_SUCCESS;
+    struct
+    {
+        MDL Mdl;
+        PFN_NUMBER Page;
+    } PageMdl;
+    DPRINT("Probing selected pages of MDL: %p\n", Mdl);
+
+    //
+    // Sanity checks
+    //
+    ASSERT(Mdl->ByteCount != 0);
+    ASSERT(Mdl->ByteOffset == 0);
+    ASSERT((Mdl->MdlFlags & (MDL_PAGES_LOCKED |
+                             MDL_MAPPED_TO_SYSTEM_VA |
+                             MDL_SOURCE_IS_NONPAGED_POOL |
+                             MDL_PARTIAL |
+                             MDL_IO_SPACE)) == 0);
+
+    //
+    // Every segment describes one page of the MDL
+    //
+    MdlPages = (PPFN_NUMBER)(Mdl + 1);
+    PageCount = BYTES_TO_PAGES(Mdl->ByteCount);
+    Mdl->Process = NULL;
+
+    for (i = 0; i < PageCount; i++)
+    {
+        //
+        // Lock the page with a single page MDL, the page stays locked when
+        // this MDL goes away and is unlocked with the whole one later
+        //
+        MmInitializeMdl(&PageMdl.Mdl,
+                        PAGE_ALIGN((ULONG_PTR)SegmentArray[i].Alignment),
+                        PAGE_SIZE);
+        _SEH2_TRY
+        {
+            MmProbeAndLockPages(&PageMdl.Mdl, AccessMode, Operation);
+        }
+        _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+        {
+            Status = _SEH2_GetExceptionCode();
+        }
+        _SEH2_END;
+        if (!NT_SUCCESS(Status)) break;
+
+        //
+        // All the pages must belong to the same address space
+        //
+        ASSERT((i == 0) || (Mdl->Process == PageMdl.Mdl.Process));
+        Mdl->Process = PageMdl.Mdl.Process;
+        Mdl->MdlFlags |= PageMdl.Mdl.MdlFlags & (MDL_WRITE_OPERATION | MDL_IO_SPACE);
+        MdlPages[i] = PageMdl.Page;
+    }
+
+    if (!NT_SUCCESS(Status))
+    {
+        //
+        // Unlock the pages locked so far by shrinking the MDL to them
+        //
+        if (i != 0)
+        {
+            ByteCount = Mdl->ByteCount;
+            Mdl->ByteCount = i * PAGE_SIZE;
+            Mdl->MdlFlags |= MDL_PAGES_LOCKED;
+            MmUnlockPages(Mdl);
+            Mdl->ByteCount = ByteCount;
+        }
+
+        Mdl->MdlFlags &= ~(MDL_WRITE_OPERATION | MDL_IO_SPACE);
+        Mdl->Process = NULL;
+        ExRaiseStatus(Status);
+    }
+
+    Mdl->MdlFlags |= MDL_PAGES_LOCKED;
 }
 
 /*
@@ -30,6 +30,9 @@ extern "C" {
 
 /* Size of all page directories for a process */
 #define SYSTEM_PD_SIZE (PPE_PER_PAGE * PD_SIZE)
+
+/* Number of pages mapped by a large page PDE */
+#define MI_LARGE_PAGE_PFNS (PDE_MAPPED_VA >> PAGE_SHIFT)
 #ifdef _M_IX86
 C_ASSERT(SYSTEM_PD_SIZE == PAGE_SIZE);
 #endif
@@ -548,6 +551,7 @@ extern WCHAR MmVerifyDriverBuffer[512];
 extern WCHAR MmLargePageDriverBuffer[512];
 extern LIST_ENTRY MiLargePageDriverList;
 extern BOOLEAN MiLargePageAllDrivers;
+extern SIZE_T MmLargePageMinimum;
 extern ULONG MmVerifyDriverBufferLength;
 extern ULONG MmLargePageDriverBufferLength;
 extern SIZE_T MmSizeOfNonPagedPoolInBytes;
@@ -2164,6 +2168,20 @@ MiSyncCachedRanges(
     VOID
 );
 
+NTSTATUS
+NTAPI
+MiMapLargePageVad(
+    IN PEPROCESS Process,
+    IN PMMVAD Vad
+);
+
+VOID
+NTAPI
+MiDeleteLargePde(
+    IN PMMPDE PointerPde,
+    IN PEPROCESS CurrentProcess
+);
+
 BOOLEAN
 NTAPI
 MiIsPfnInUse(
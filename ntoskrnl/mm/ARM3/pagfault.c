@@ -2224,10 +2224,22 @@ UserFault:
         ASSERT(KeAreAllApcsDisabled() == TRUE);
         ASSERT(PointerPde->u.Hard.Valid == 1);
     }
-    else
+    else if (MI_IS_PAGE_LARGE(PointerPde))
     {
-        /* Not yet implemented in ReactOS */
-        ASSERT(MI_IS_PAGE_LARGE(PointerPde) == FALSE);
+        /* Large pages are always resident, so this can only be an access violation */
+        if ((MI_IS_WRITE_ACCESS(FaultCode) && !MI_IS_PAGE_WRITEABLE(PointerPde)) ||
+            (MI_IS_INSTRUCTION_FETCH(FaultCode) && !MI_IS_PAGE_EXECUTABLE(PointerPde)))
+        {
+            Status = STATUS_ACCESS_VIOLATION;
+        }
+        else
+        {
+            /* Someone just mapped it, and the fault was stale */
+            Status = STATUS_SUCCESS;
+        }
+
+        MiUnlockProcessWorkingSet(CurrentProcess, CurrentThread);
+        return Status;
     }
 
     /* Now capture the PTE. */
@@ -622,6 +622,16 @@ MiDeleteVirtualAddresses(IN ULONG_PTR Va,
             continue;
         }
 
+        /* Large pages have no page table, they go away with their PDE */
+        if ((PointerPde->u.Hard.Valid) && MI_IS_PAGE_LARGE(PointerPde))
+        {
+            OldIrql = MiAcquirePfnLock();
+            MiDeleteLargePde(PointerPde, CurrentProcess);
+            MiReleasePfnLock(OldIrql);
+            Va = (ULONG_PTR)MiPdeToAddress(PointerPde + 1);
+            continue;
+        }
+
         /* Now check if the PDE is mapped in */
         if (!PointerPde->u.Hard.Valid)
         {
@@ -1481,6 +1491,14 @@ MiQueryAddressState(IN PVOID Va,
     ASSERT((Vad->StartingVpn <= ((ULONG_PTR)Va >> PAGE_SHIFT)) &&
            (Vad->EndingVpn >= ((ULONG_PTR)Va >> PAGE_SHIFT)));
 
+    /* Large pages are committed and resident for as long as the VAD exists */
+    if (Vad->u.VadFlags.VadType == VadLargePages)
+    {
+        *NextVa = (PVOID)(ALIGN_DOWN_BY(Va, PDE_MAPPED_VA) + PDE_MAPPED_VA);
+        *ReturnedProtect = MmProtectToValue[Vad->u.VadFlags.Protection];
+        return MEM_COMMIT;
+    }
+
     /* Only normal VADs supported */
     ASSERT(Vad->u.VadFlags.VadType == VadNone);
 
@@ -4537,10 +4555,10 @@ NtAllocateVirtualMemory(IN HANDLE ProcessHandle,
     /* Check if large pages are being used */
     if (AllocationType & MEM_LARGE_PAGES)
     {
-        /* Large page allocations MUST be committed */
-        if (!(AllocationType & MEM_COMMIT))
+        /* Large page allocations MUST be reserved and committed at once */
+        if ((AllocationType & (MEM_COMMIT | MEM_RESERVE)) != (MEM_COMMIT | MEM_RESERVE))
         {
-            DPRINT1("Must supply MEM_COMMIT with MEM_LARGE_PAGES\n");
+            DPRINT1("Must supply MEM_RESERVE and MEM_COMMIT with MEM_LARGE_PAGES\n");
             return STATUS_INVALID_PARAMETER_5;
         }
 
@@ -4681,14 +4699,32 @@ NtAllocateVirtualMemory(IN HANDLE ProcessHandle,
     }
 
     //
-    // Fail on the things we don't yet support
+    // Large pages must be supported by the processor, and the allocation must
+    // be made of whole, resident, cached large pages
     //
     if ((AllocationType & MEM_LARGE_PAGES) == MEM_LARGE_PAGES)
     {
-        DPRINT1("MEM_LARGE_PAGES not supported\n");
-        Status = STATUS_INVALID_PARAMETER;
-        goto FailPathNoLock;
+        if (!(MmLargePageMinimum) ||
+            !(PRegionSize) ||
+            (PRegionSize & (MmLargePageMinimum - 1)) ||
+            ((ULONG_PTR)PBaseAddress & (MmLargePageMinimum - 1)))
+        {
+            DPRINT1("Invalid large page allocation: %p, %Ix\n", PBaseAddress, PRegionSize);
+            Status = STATUS_INVALID_PARAMETER;
+            goto FailPathNoLock;
+        }
+
+        if ((Protect & (PAGE_NOACCESS | PAGE_GUARD | PAGE_NOCACHE | PAGE_WRITECOMBINE)))
+        {
+            DPRINT1("Invalid protection for large pages: %lx\n", Protect);
+            Status = STATUS_INVALID_PAGE_PROTECTION;
+            goto FailPathNoLock;
+        }
     }
+
+    //
+    // Fail on the things we don't yet support
+    //
     if ((AllocationType & MEM_PHYSICAL) == MEM_PHYSICAL)
     {
         DPRINT1("MEM_PHYSICAL not supported\n");
@@ -4773,6 +4809,7 @@ NtAllocateVirtualMemory(IN HANDLE ProcessHandle,
         if (AllocationType & MEM_COMMIT) Vad->u.VadFlags.MemCommit = 1;
         Vad->u.VadFlags.Protection = ProtectionMask;
         Vad->u.VadFlags.PrivateMemory = 1;
+        if (AllocationType & MEM_LARGE_PAGES) Vad->u.VadFlags.VadType = VadLargePages;
         Vad->ControlArea = NULL; // For Memory-Area hack
 
         //
@@ -4782,7 +4819,8 @@ NtAllocateVirtualMemory(IN HANDLE ProcessHandle,
                                &StartingAddress,
                                PRegionSize,
                                HighestAddress,
-                               MM_VIRTMEM_GRANULARITY,
+                               (AllocationType & MEM_LARGE_PAGES) ?
+                               MmLargePageMinimum : MM_VIRTMEM_GRANULARITY,
                                AllocationType);
         if (!NT_SUCCESS(Status))
         {
@@ -4790,6 +4828,29 @@ NtAllocateVirtualMemory(IN HANDLE ProcessHandle,
             goto FailPathNoLock;
         }
 
+        //
+        // Large pages are never demand-faulted, so back the whole range now
+        //
+        if (AllocationType & MEM_LARGE_PAGES)
+        {
+            Status = MiMapLargePageVad(Process, Vad);
+            if (!NT_SUCCESS(Status))
+            {
+                //
+                // Nothing is mapped anymore, just get rid of the VAD
+                //
+                AddressSpace = MmGetCurrentAddressSpace();
+                MmLockAddressSpace(AddressSpace);
+                MiLockProcessWorkingSetUnsafe(Process, CurrentThread);
+                MiRemoveNode((PMMADDRESS_NODE)Vad, &Process->VadRoot);
+                MiUnlockProcessWorkingSetUnsafe(Process, CurrentThread);
+                Process->VirtualSize -= PRegionSize;
+                MmUnlockAddressSpace(AddressSpace);
+                ExFreePoolWithTag(Vad, 'SdaV');
+                goto FailPathNoLock;
+            }
+        }
+
         //
         // Detach and dereference the target process if
         // it was different from the current process
@@ -5382,9 +5443,23 @@ NtFreeVirtualMemory(IN HANDLE ProcessHandle,
     if (FreeType & MEM_RELEASE)
     {
         //
-        // ARM3 only supports this VAD in this path
+        // ARM3 only supports these VADs in this path
+        //
+        ASSERT((Vad->u.VadFlags.VadType == VadNone) ||
+               (Vad->u.VadFlags.VadType == VadLargePages));
+
+        //
+        // Large page allocations can only be released as a whole
         //
-        ASSERT(Vad->u.VadFlags.VadType == VadNone);
+        if ((Vad->u.VadFlags.VadType == VadLargePages) &&
+            (PRegionSize) &&
+            (((StartingAddress >> PAGE_SHIFT) != Vad->StartingVpn) ||
+             ((EndingAddress >> PAGE_SHIFT) != Vad->EndingVpn)))
+        {
+            DPRINT1("Trying to release part of a large page allocation\n");
+            Status = STATUS_UNABLE_TO_FREE_VM;
+            goto FailPath;
+        }
 
         //
         // Is the caller trying to remove the whole VAD, or remove only a portion
@@ -139,8 +139,12 @@ MmTrimUserMemory(ULONG Target, ULONG Priority, PULONG NrFreedPages)
 {
     PFN_NUMBER CurrentPage;
     NTSTATUS Status;
+    MM_PAGEOUT_CLUSTER Cluster;
 
     (*NrFreedPages) = 0;
+    Cluster.Count = 0;
+    Cluster.ReservedCount = 0;
+    Cluster.ReservedNext = 0;
 
     DPRINT1("MM BALANCER: %s\n", Priority ? "Paging out!" : "Removing access bit!");
 
@@ -149,8 +153,13 @@ MmTrimUserMemory(ULONG Target, ULONG Priority, PULONG NrFreedPages)
     {
         if (Priority)
         {
-            Status = MmPageOutPhysicalAddress(CurrentPage);
-            if (NT_SUCCESS(Status))
+            Status = MmPageOutPhysicalAddress(CurrentPage, &Cluster);
+            if (Status == STATUS_PENDING)
+            {
+                /* It will be written with the rest of the cluster */
+                Target--;
+            }
+            else if (NT_SUCCESS(Status))
             {
                 DPRINT("Succeeded\n");
                 Target--;
@@ -243,7 +252,7 @@ MmTrimUserMemory(ULONG Target, ULONG Priority, PULONG NrFreedPages)
             {
                 /* Nobody accessed this page since the last time we check. Time to clean up */
 
-                Status = MmPageOutPhysicalAddress(CurrentPage);
+                Status = MmPageOutPhysicalAddress(CurrentPage, &Cluster);
                 // DPRINT1("Paged-out one page: %s\n", NT_SUCCESS(Status) ? "Yes" : "No");
                 (void)Status;
             }
@@ -252,9 +261,18 @@ MmTrimUserMemory(ULONG Target, ULONG Priority, PULONG NrFreedPages)
             Target--;
         }
 
+        /* Write the gathered pages once we have a full cluster */
+        if (Cluster.Count == MM_PAGEOUT_CLUSTER_SIZE)
+        {
+            (*NrFreedPages) += MmFlushPageOutCluster(&Cluster);
+        }
+
         CurrentPage = MmGetLRUNextUserPage(CurrentPage, TRUE);
     }
 
+    /* Write whatever is left */
+    (*NrFreedPages) += MmFlushPageOutCluster(&Cluster);
+
     if (CurrentPage)
     {
         KIRQL OldIrql = MiAcquirePfnLock();
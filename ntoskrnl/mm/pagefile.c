@@ -125,6 +125,126 @@ MmShowOutOfSpaceMessagePagingFile(VOID)
     }
 }
 
+/*
+ * A run of consecutive page file pages written with a single paging I/O
+ */
+typedef struct _MM_SWAP_WRITE_RUN
+{
+    ULONG FirstPage;
+    ULONG PageCount;
+    NTSTATUS Status;
+    KEVENT Event;
+    IO_STATUS_BLOCK Iosb;
+    MDL Mdl;
+    PFN_NUMBER Page[MM_PAGEOUT_CLUSTER_SIZE];
+} MM_SWAP_WRITE_RUN, *PMM_SWAP_WRITE_RUN;
+
+NTSTATUS
+NTAPI
+MmWriteToSwapPages(
+    _In_reads_(PageCount) PSWAPENTRY SwapEntries,
+    _In_reads_(PageCount) PPFN_NUMBER Pages,
+    _In_ ULONG PageCount,
+    _Out_writes_(PageCount) PNTSTATUS Statuses)
+{
+    PMM_SWAP_WRITE_RUN Runs, Run;
+    ULONG RunCount, i, j, File;
+    LARGE_INTEGER FileOffset;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    DPRINT("MmWriteToSwapPages(%lu)\n", PageCount);
+
+    ASSERT(PageCount != 0 && PageCount <= MM_PAGEOUT_CLUSTER_SIZE);
+
+    Runs = ExAllocatePoolWithTag(NonPagedPool, PageCount * sizeof(*Runs), TAG_MM);
+    if (Runs == NULL)
+    {
+        /* Fall back to writing the pages one at a time */
+        for (i = 0; i < PageCount; i++)
+        {
+            Statuses[i] = MmWriteToSwapPage(SwapEntries[i], Pages[i]);
+            if (!NT_SUCCESS(Statuses[i])) Status = Statuses[i];
+        }
+        return Status;
+    }
+
+    /* Split the pages into runs that are contiguous in the same paging file */
+    RunCount = 0;
+    for (i = 0; i < PageCount; i = j)
+    {
+        if (SwapEntries[i] == 0)
+        {
+            KeBugCheck(MEMORY_MANAGEMENT);
+        }
+
+        File = FILE_FROM_ENTRY(SwapEntries[i]);
+        for (j = i + 1; j < PageCount; j++)
+        {
+            if (FILE_FROM_ENTRY(SwapEntries[j]) != File ||
+                OFFSET_FROM_ENTRY(SwapEntries[j]) != OFFSET_FROM_ENTRY(SwapEntries[i]) + (j - i))
+            {
+                break;
+            }
+        }
+
+        Run = &Runs[RunCount++];
+        Run->FirstPage = i;
+        Run->PageCount = j - i;
+    }
+
+    /* Start all the writes before waiting for any of them */
+    for (i = 0; i < RunCount; i++)
+    {
+        Run = &Runs[i];
+        File = FILE_FROM_ENTRY(SwapEntries[Run->FirstPage]);
+
+        if (MmPagingFile[File]->FileObject == NULL ||
+                MmPagingFile[File]->FileObject->DeviceObject == NULL)
+        {
+            DPRINT1("Bad paging file 0x%.8X\n", SwapEntries[Run->FirstPage]);
+            KeBugCheck(MEMORY_MANAGEMENT);
+        }
+
+        MmInitializeMdl(&Run->Mdl, NULL, Run->PageCount * PAGE_SIZE);
+        MmBuildMdlFromPages(&Run->Mdl, &Pages[Run->FirstPage]);
+        Run->Mdl.MdlFlags |= MDL_PAGES_LOCKED;
+
+        FileOffset.QuadPart = (OFFSET_FROM_ENTRY(SwapEntries[Run->FirstPage]) - 1) * PAGE_SIZE;
+
+        KeInitializeEvent(&Run->Event, NotificationEvent, FALSE);
+        Run->Status = IoSynchronousPageWrite(MmPagingFile[File]->FileObject,
+                                             &Run->Mdl,
+                                             &FileOffset,
+                                             &Run->Event,
+                                             &Run->Iosb);
+    }
+
+    /* Now collect the results */
+    for (i = 0; i < RunCount; i++)
+    {
+        Run = &Runs[i];
+        if (Run->Status == STATUS_PENDING)
+        {
+            KeWaitForSingleObject(&Run->Event, Executive, KernelMode, FALSE, NULL);
+            Run->Status = Run->Iosb.Status;
+        }
+
+        if (Run->Mdl.MdlFlags & MDL_MAPPED_TO_SYSTEM_VA)
+        {
+            MmUnmapLockedPages(Run->Mdl.MappedSystemVa, &Run->Mdl);
+        }
+
+        for (j = 0; j < Run->PageCount; j++)
+        {
+            Statuses[Run->FirstPage + j] = Run->Status;
+        }
+        if (!NT_SUCCESS(Run->Status)) Status = Run->Status;
+    }
+
+    ExFreePoolWithTag(Runs, TAG_MM);
+    return Status;
+}
+
 NTSTATUS
 NTAPI
 MmWriteToSwapPage(SWAPENTRY SwapEntry, PFN_NUMBER Page)
@@ -135,7 +255,7 @@ MmWriteToSwapPage(SWAPENTRY SwapEntry, PFN_NUMBER Page)
     IO_STATUS_BLOCK Iosb;
     NTSTATUS Status;
     KEVENT Event;
-    UCHAR MdlBase[sizeof(MDL) + sizeof(ULONG)];
+    UCHAR MdlBase[sizeof(MDL) + sizeof(PFN_NUMBER)];
     PMDL Mdl = (PMDL)MdlBase;
 
     DPRINT("MmWriteToSwapPage\n");
@@ -182,6 +302,13 @@ MmWriteToSwapPage(SWAPENTRY SwapEntry, PFN_NUMBER Page)
 }
 
 
+SWAPENTRY
+NTAPI
+MmGetNextSwapEntry(SWAPENTRY SwapEntry)
+{
+    return ENTRY_FROM_FILE_OFFSET(FILE_FROM_ENTRY(SwapEntry), OFFSET_FROM_ENTRY(SwapEntry) + 1);
+}
+
 NTSTATUS
 NTAPI
 MmReadFromSwapPage(SWAPENTRY SwapEntry, PFN_NUMBER Page)
@@ -189,10 +316,11 @@ MmReadFromSwapPage(SWAPENTRY SwapEntry, PFN_NUMBER Page)
     return MiReadPageFile(Page, FILE_FROM_ENTRY(SwapEntry), OFFSET_FROM_ENTRY(SwapEntry));
 }
 
+static
 NTSTATUS
-NTAPI
-MiReadPageFile(
-    _In_ PFN_NUMBER Page,
+MiReadPageFileRun(
+    _In_reads_(PageCount) PPFN_NUMBER Pages,
+    _In_ ULONG PageCount,
     _In_ ULONG PageFileIndex,
     _In_ ULONG_PTR PageFileOffset)
 {
@@ -200,12 +328,18 @@ MiReadPageFile(
     IO_STATUS_BLOCK Iosb;
     NTSTATUS Status;
     KEVENT Event;
-    UCHAR MdlBase[sizeof(MDL) + sizeof(ULONG)];
-    PMDL Mdl = (PMDL)MdlBase;
+    struct
+    {
+        MDL Mdl;
+        PFN_NUMBER Page[MM_PAGEIN_CLUSTER_SIZE];
+    } MdlBase;
+    PMDL Mdl = &MdlBase.Mdl;
     PMMPAGING_FILE PagingFile;
 
     DPRINT("MiReadSwapFile\n");
 
+    ASSERT(PageCount != 0 && PageCount <= MM_PAGEIN_CLUSTER_SIZE);
+
     if (PageFileOffset == 0)
     {
         KeBugCheck(MEMORY_MANAGEMENT);
@@ -225,8 +359,8 @@ MiReadPageFile(
         KeBugCheck(MEMORY_MANAGEMENT);
     }
 
-    MmInitializeMdl(Mdl, NULL, PAGE_SIZE);
-    MmBuildMdlFromPages(Mdl, &Page);
+    MmInitializeMdl(Mdl, NULL, PageCount * PAGE_SIZE);
+    MmBuildMdlFromPages(Mdl, Pages);
     Mdl->MdlFlags |= MDL_PAGES_LOCKED | MDL_IO_PAGE_READ;
 
     file_offset.QuadPart = PageFileOffset * PAGE_SIZE;
@@ -249,6 +383,27 @@ MiReadPageFile(
     return(Status);
 }
 
+NTSTATUS
+NTAPI
+MmReadFromSwapPages(
+    _In_ SWAPENTRY SwapEntry,
+    _In_reads_(PageCount) PPFN_NUMBER Pages,
+    _In_ ULONG PageCount)
+{
+    /* The pages must be consecutive in the page file, see MmGetNextSwapEntry */
+    return MiReadPageFileRun(Pages, PageCount, FILE_FROM_ENTRY(SwapEntry), OFFSET_FROM_ENTRY(SwapEntry));
+}
+
+NTSTATUS
+NTAPI
+MiReadPageFile(
+    _In_ PFN_NUMBER Page,
+    _In_ ULONG PageFileIndex,
+    _In_ ULONG_PTR PageFileOffset)
+{
+    return MiReadPageFileRun(&Page, 1, PageFileIndex, PageFileOffset);
+}
+
 CODE_SEG("INIT")
 VOID
 NTAPI
@@ -288,7 +443,7 @@ MmFreeSwapPage(SWAPENTRY Entry)
         KeBugCheck(MEMORY_MANAGEMENT);
     }
 
-    RtlClearBit(PagingFile->Bitmap, off >> 5);
+    RtlClearBit(PagingFile->Bitmap, (ULONG)off);
 
     PagingFile->FreeSpace++;
     PagingFile->CurrentUsage--;
@@ -299,46 +454,91 @@ MmFreeSwapPage(SWAPENTRY Entry)
     KeReleaseGuardedMutex(&MmPageFileCreationLock);
 }
 
-SWAPENTRY
+ULONG
 NTAPI
-MmAllocSwapPage(VOID)
+MmAllocSwapPages(
+    _In_ ULONG PageCount,
+    _Out_writes_to_(PageCount, return) PSWAPENTRY SwapEntries)
 {
-    ULONG i;
+    ULONG i, j;
     ULONG off;
-    SWAPENTRY entry;
+    ULONG RunLength;
+    PMMPAGING_FILE PagingFile;
+
+    ASSERT(PageCount != 0);
 
     KeAcquireGuardedMutex(&MmPageFileCreationLock);
 
     if (MiFreeSwapPages == 0)
     {
         KeReleaseGuardedMutex(&MmPageFileCreationLock);
-        return(0);
+        return 0;
     }
 
-    for (i = 0; i < MAX_PAGING_FILES; i++)
+    /*
+     * Look for a contiguous run, so that the pages can be written with a
+     * single I/O, and settle for shorter ones if the paging files are too
+     * fragmented. Searches start where the last one ended, which keeps
+     * consecutive allocations next to each other.
+     */
+    RunLength = min(PageCount, MiFreeSwapPages);
+    while (TRUE)
     {
-        if (MmPagingFile[i] != NULL &&
-                MmPagingFile[i]->FreeSpace >= 1)
+        for (i = 0; i < MAX_PAGING_FILES; i++)
         {
-            off = RtlFindClearBitsAndSet(MmPagingFile[i]->Bitmap, 1, 0);
+            PagingFile = MmPagingFile[i];
+            if (PagingFile == NULL || PagingFile->FreeSpace < RunLength)
+            {
+                continue;
+            }
+
+            off = RtlFindClearBitsAndSet(PagingFile->Bitmap,
+                                         RunLength,
+                                         PagingFile->AllocationHint);
             if (off == 0xFFFFFFFF)
             {
-                KeBugCheck(MEMORY_MANAGEMENT);
-                KeReleaseGuardedMutex(&MmPageFileCreationLock);
-                return(STATUS_UNSUCCESSFUL);
+                continue;
             }
-            MiUsedSwapPages++;
-            MiFreeSwapPages--;
+
+            PagingFile->AllocationHint = off + RunLength;
+            PagingFile->FreeSpace -= RunLength;
+            PagingFile->CurrentUsage += RunLength;
+
+            MiUsedSwapPages += RunLength;
+            MiFreeSwapPages -= RunLength;
             KeReleaseGuardedMutex(&MmPageFileCreationLock);
 
-            entry = ENTRY_FROM_FILE_OFFSET(i, off + 1);
-            return(entry);
+            for (j = 0; j < RunLength; j++)
+            {
+                SwapEntries[j] = ENTRY_FROM_FILE_OFFSET(i, off + j + 1);
+            }
+            return RunLength;
         }
+
+        if (RunLength == 1)
+        {
+            break;
+        }
+        RunLength /= 2;
     }
 
     KeReleaseGuardedMutex(&MmPageFileCreationLock);
     KeBugCheck(MEMORY_MANAGEMENT);
-    return(0);
+    return 0;
+}
+
+SWAPENTRY
+NTAPI
+MmAllocSwapPage(VOID)
+{
+    SWAPENTRY entry;
+
+    if (MmAllocSwapPages(1, &entry) == 0)
+    {
+        return 0;
+    }
+
+    return entry;
 }
 
 NTSTATUS NTAPI
@@ -779,9 +979,10 @@ NtCreatePagingFile(IN PUNICODE_STRING FileName,
         return STATUS_INSUFFICIENT_RESOURCES;
     }
 
+    /* Only track the pages that actually are in the file for now */
     RtlInitializeBitMap(PagingFile->Bitmap,
                         (PULONG)(PagingFile->Bitmap + 1),
-                        (ULONG)(PagingFile->MaximumSize));
+                        (ULONG)(PagingFile->FreeSpace));
     RtlClearAllBits(PagingFile->Bitmap);
 
     /* FIXME: should be calling unsafe instead,
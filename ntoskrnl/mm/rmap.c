@@ -46,9 +46,138 @@ MmInitializeRmapList(VOID)
                                      50);
 }
 
+static
+SWAPENTRY
+MiGetClusterSwapEntry(PMM_PAGEOUT_CLUSTER Cluster)
+{
+    /* Reserve more page file space if we used everything we had */
+    if (Cluster->ReservedNext == Cluster->ReservedCount)
+    {
+        Cluster->ReservedNext = 0;
+        Cluster->ReservedCount = MmAllocSwapPages(MM_PAGEOUT_CLUSTER_SIZE - Cluster->Count,
+                                                  Cluster->Reserved);
+        if (Cluster->ReservedCount == 0)
+            return 0;
+    }
+
+    return Cluster->Reserved[Cluster->ReservedNext++];
+}
+
+/*
+ * Called with the process attached once the page has been written. Replaces
+ * the wait entry by the swap entry and frees the page, or puts the page back
+ * if the write failed.
+ */
+static
+NTSTATUS
+MiCompletePageOut(PEPROCESS Process,
+                  PVOID Address,
+                  PFN_NUMBER Page,
+                  SWAPENTRY SwapEntry,
+                  NTSTATUS WriteStatus)
+{
+    PMMSUPPORT AddressSpace = &Process->Vm;
+    SWAPENTRY Dummy;
+
+    MmLockAddressSpace(AddressSpace);
+    MmDeletePageFileMapping(Process, Address, &Dummy);
+    ASSERT(Dummy == MM_WAIT_ENTRY);
+
+    if (!NT_SUCCESS(WriteStatus))
+    {
+        /* We failed at saving the content of this page. Keep it in */
+        PMEMORY_AREA MemoryArea = MmLocateMemoryAreaByAddress(AddressSpace, Address);
+        PMM_REGION Region = MmFindRegion((PVOID)MA_GetStartingAddress(MemoryArea),
+                &MemoryArea->SectionData.RegionListHead,
+                Address, NULL);
+
+        /* This Swap Entry is useless to us */
+        MmSetSavedSwapEntryPage(Page, 0);
+        MmFreeSwapPage(SwapEntry);
+
+        /* We can't, so let this page in the Process VM */
+        MmCreateVirtualMapping(Process, Address, Region->Protect, Page);
+        MmInsertRmap(Page, Process, Address);
+        MmSetDirtyPage(Process, Address);
+
+        MmUnlockAddressSpace(AddressSpace);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    /* Keep this in the process VM */
+    MmCreatePageFileMapping(Process, Address, SwapEntry);
+    MmSetSavedSwapEntryPage(Page, 0);
+
+    /* We can finally let this page go */
+    MmUnlockAddressSpace(AddressSpace);
+#if DBG
+    {
+        KIRQL OldIrql = MiAcquirePfnLock();
+        ASSERT(MmGetRmapListHeadPage(Page) == NULL);
+        MiReleasePfnLock(OldIrql);
+    }
+#endif
+    MmReleasePageMemoryConsumer(MC_USER, Page);
+
+    return STATUS_SUCCESS;
+}
+
+ULONG
+NTAPI
+MmFlushPageOutCluster(PMM_PAGEOUT_CLUSTER Cluster)
+{
+    SWAPENTRY SwapEntries[MM_PAGEOUT_CLUSTER_SIZE];
+    PFN_NUMBER Pages[MM_PAGEOUT_CLUSTER_SIZE];
+    NTSTATUS Statuses[MM_PAGEOUT_CLUSTER_SIZE];
+    PMM_PAGEOUT_ENTRY Entry;
+    ULONG i, NrFreed = 0;
+
+    /* Give back the page file space we didn't use */
+    while (Cluster->ReservedNext < Cluster->ReservedCount)
+        MmFreeSwapPage(Cluster->Reserved[Cluster->ReservedNext++]);
+    Cluster->ReservedNext = Cluster->ReservedCount = 0;
+
+    if (Cluster->Count == 0)
+        return 0;
+
+    /* Write all the pages at once */
+    for (i = 0; i < Cluster->Count; i++)
+    {
+        SwapEntries[i] = Cluster->Entries[i].SwapEntry;
+        Pages[i] = Cluster->Entries[i].Page;
+    }
+    MmWriteToSwapPages(SwapEntries, Pages, Cluster->Count, Statuses);
+
+    /* And put every page where it belongs */
+    for (i = 0; i < Cluster->Count; i++)
+    {
+        Entry = &Cluster->Entries[i];
+
+        if (Entry->Process != PsInitialSystemProcess)
+            KeAttachProcess(&Entry->Process->Pcb);
+
+        if (NT_SUCCESS(MiCompletePageOut(Entry->Process,
+                                         Entry->Address,
+                                         Entry->Page,
+                                         Entry->SwapEntry,
+                                         Statuses[i])))
+        {
+            NrFreed++;
+        }
+
+        if (Entry->Process != PsInitialSystemProcess)
+            KeDetachProcess();
+        ExReleaseRundownProtection(&Entry->Process->RundownProtect);
+        ObDereferenceObject(Entry->Process);
+    }
+
+    Cluster->Count = 0;
+    return NrFreed;
+}
+
 NTSTATUS
 NTAPI
-MmPageOutPhysicalAddress(PFN_NUMBER Page)
+MmPageOutPhysicalAddress(PFN_NUMBER Page, PMM_PAGEOUT_CLUSTER Cluster)
 {
     PMM_RMAP_ENTRY entry;
     PMEMORY_AREA MemoryArea;
@@ -176,7 +305,7 @@ GetEntry:
             if ((SwapEntry == 0) && Dirty)
             {
                 /* We don't have a Swap entry, yet the page is dirty. Get one */
-                SwapEntry = MmAllocSwapPage();
+                SwapEntry = Cluster ? MiGetClusterSwapEntry(Cluster) : MmAllocSwapPage();
                 if (!SwapEntry)
                 {
                     PMM_REGION Region = MmFindRegion((PVOID)MA_GetStartingAddress(MemoryArea),
@@ -200,42 +329,37 @@ GetEntry:
 
             if (Dirty)
             {
-                SWAPENTRY Dummy;
-
                 /* Put a wait entry into the process and unlock */
                 MmCreatePageFileMapping(Process, Address, MM_WAIT_ENTRY);
                 MmUnlockAddressSpace(AddressSpace);
 
-                Status = MmWriteToSwapPage(SwapEntry, Page);
-
-                MmLockAddressSpace(AddressSpace);
-                MmDeletePageFileMapping(Process, Address, &Dummy);
-                ASSERT(Dummy == MM_WAIT_ENTRY);
-
-                if (!NT_SUCCESS(Status))
+                if (Cluster)
                 {
-                    /* We failed at saving the content of this page. Keep it in */
-                    PMM_REGION Region = MmFindRegion((PVOID)MA_GetStartingAddress(MemoryArea),
-                            &MemoryArea->SectionData.RegionListHead,
-                            Address, NULL);
+                    PMM_PAGEOUT_ENTRY ClusterEntry = &Cluster->Entries[Cluster->Count++];
 
-                    /* This Swap Entry is useless to us */
-                    MmSetSavedSwapEntryPage(Page, 0);
-                    MmFreeSwapPage(SwapEntry);
+                    /*
+                     * Let the caller write it along with its neighbours. It now
+                     * owns our process reference and rundown protection.
+                     */
+                    ClusterEntry->Process = Process;
+                    ClusterEntry->Address = Address;
+                    ClusterEntry->Page = Page;
+                    ClusterEntry->SwapEntry = SwapEntry;
 
-                    /* We can't, so let this page in the Process VM */
-                    MmCreateVirtualMapping(Process, Address, Region->Protect, Page);
-                    MmInsertRmap(Page, Process, Address);
-                    MmSetDirtyPage(Process, Address);
-
-                    MmUnlockAddressSpace(AddressSpace);
                     if (Process != PsInitialSystemProcess)
                         KeDetachProcess();
-                    ExReleaseRundownProtection(&Process->RundownProtect);
-                    ObDereferenceObject(Process);
-
-                    return STATUS_UNSUCCESSFUL;
+                    return STATUS_PENDING;
                 }
+
+                Status = MmWriteToSwapPage(SwapEntry, Page);
+                Status = MiCompletePageOut(Process, Address, Page, SwapEntry, Status);
+
+                if (Process != PsInitialSystemProcess)
+                    KeDetachProcess();
+                ExReleaseRundownProtection(&Process->RundownProtect);
+                ObDereferenceObject(Process);
+
+                return Status;
             }
 
             if (SwapEntry)
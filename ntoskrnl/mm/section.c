@@ -1604,6 +1604,8 @@ MmNotPresentFaultSectionView(PMMSUPPORT AddressSpace,
     if (HasSwapEntry)
     {
         SWAPENTRY DummyEntry;
+        PFN_NUMBER Pages[MM_PAGEIN_CLUSTER_SIZE];
+        ULONG PageCount, i;
 
         MmGetPageFileMapping(Process, Address, &SwapEntry);
         if (SwapEntry == MM_WAIT_ENTRY)
@@ -1627,47 +1629,98 @@ MmNotPresentFaultSectionView(PMMSUPPORT AddressSpace,
         /* Tell everyone else we are serving the fault. */
         MmCreatePageFileMapping(Process, Address, MM_WAIT_ENTRY);
 
+        /*
+         * The balancer writes neighbouring pages next to each other in the
+         * page file, so bring in the ones that follow this page on disk with
+         * the same read, unless memory is already tight.
+         */
+        PageCount = 1;
+        if (MmAvailablePages > MmMinimumFreePages + MM_PAGEIN_CLUSTER_SIZE)
+        {
+            SWAPENTRY NextSwapEntry = SwapEntry;
+            SWAPENTRY NeighbourEntry;
+            PVOID NeighbourAddress;
+
+            while (PageCount < MM_PAGEIN_CLUSTER_SIZE)
+            {
+                NeighbourAddress = (PVOID)((ULONG_PTR)PAddress + PageCount * PAGE_SIZE);
+                if ((ULONG_PTR)NeighbourAddress >= MA_GetEndingAddress(MemoryArea))
+                    break;
+
+                NextSwapEntry = MmGetNextSwapEntry(NextSwapEntry);
+                MmGetPageFileMapping(Process, NeighbourAddress, &NeighbourEntry);
+                if (NeighbourEntry != NextSwapEntry || NeighbourEntry == MM_WAIT_ENTRY)
+                    break;
+
+                /* We're serving this one too */
+                MmDeletePageFileMapping(Process, NeighbourAddress, &DummyEntry);
+                MmCreatePageFileMapping(Process, NeighbourAddress, MM_WAIT_ENTRY);
+                PageCount++;
+            }
+        }
+
         MmUnlockAddressSpace(AddressSpace);
         MI_SET_USAGE(MI_USAGE_SECTION);
         if (Process) MI_SET_PROCESS2(Process->ImageFileName);
         if (!Process) MI_SET_PROCESS2("Kernel Section");
-        Status = MmRequestPageMemoryConsumer(MC_USER, TRUE, &Page);
-        if (!NT_SUCCESS(Status))
+        for (i = 0; i < PageCount; i++)
         {
-            KeBugCheck(MEMORY_MANAGEMENT);
+            Status = MmRequestPageMemoryConsumer(MC_USER, TRUE, &Pages[i]);
+            if (!NT_SUCCESS(Status))
+            {
+                KeBugCheck(MEMORY_MANAGEMENT);
+            }
         }
 
-        Status = MmReadFromSwapPage(SwapEntry, Page);
+        Status = MmReadFromSwapPages(SwapEntry, Pages, PageCount);
         if (!NT_SUCCESS(Status))
         {
-            DPRINT1("MmReadFromSwapPage failed, status = %x\n", Status);
+            DPRINT1("MmReadFromSwapPages failed, status = %x\n", Status);
             KeBugCheck(MEMORY_MANAGEMENT);
         }
 
         MmLockAddressSpace(AddressSpace);
-        MmDeletePageFileMapping(Process, PAddress, &DummyEntry);
-        ASSERT(DummyEntry == MM_WAIT_ENTRY);
-
-        Status = MmCreateVirtualMapping(Process,
-                                        PAddress,
-                                        Region->Protect,
-                                        Page);
-        if (!NT_SUCCESS(Status))
+        for (i = 0; i < PageCount; i++)
         {
-            DPRINT("MmCreateVirtualMapping failed, not out of memory\n");
-            KeBugCheck(MEMORY_MANAGEMENT);
-            return Status;
-        }
+            PVOID PageAddress = (PVOID)((ULONG_PTR)PAddress + i * PAGE_SIZE);
+            PMM_REGION PageRegion = Region;
 
-        /*
-         * Store the swap entry for later use.
-         */
-        MmSetSavedSwapEntryPage(Page, SwapEntry);
+            MmDeletePageFileMapping(Process, PageAddress, &DummyEntry);
+            ASSERT(DummyEntry == MM_WAIT_ENTRY);
+
+            /* The neighbours may live in another region of the view */
+            if (i != 0)
+            {
+                PageRegion = MmFindRegion((PVOID)MA_GetStartingAddress(MemoryArea),
+                                          &MemoryArea->SectionData.RegionListHead,
+                                          PageAddress, NULL);
+            }
+
+            Status = MmCreateVirtualMapping(Process,
+                                            PageAddress,
+                                            PageRegion->Protect,
+                                            Pages[i]);
+            if (!NT_SUCCESS(Status))
+            {
+                DPRINT("MmCreateVirtualMapping failed, not out of memory\n");
+                KeBugCheck(MEMORY_MANAGEMENT);
+                return Status;
+            }
+
+            /*
+             * Store the swap entry for later use. Pages that aren't written to
+             * can then be dropped again without another write.
+             */
+            MmSetSavedSwapEntryPage(Pages[i], SwapEntry);
+
+            /*
+             * Add the page to the process's working set
+             */
+            if (Process) MmInsertRmap(Pages[i], Process, PageAddress);
+
+            SwapEntry = MmGetNextSwapEntry(SwapEntry);
+        }
 
-        /*
-         * Add the page to the process's working set
-         */
-        if (Process) MmInsertRmap(Page, Process, Address);
         /*
          * Finish the operation
          */
@@ -1762,8 +1815,27 @@ MmNotPresentFaultSectionView(PMMSUPPORT AddressSpace,
         FsRtlAcquireFileExclusive(Segment->FileObject);
 
         PFSRTL_COMMON_FCB_HEADER FcbHeader = Segment->FileObject->FsContext;
+        ULONG ReadLength = PAGE_SIZE;
+
+        /*
+         * If the file was opened for sequential access, whoever touched this
+         * page is going to touch the next ones too: read further ahead than
+         * the usual 64K, within the view and the valid data.
+         */
+        if (FlagOn(*Segment->Flags, MM_DATAFILE_SEGMENT) &&
+            FlagOn(Segment->FileObject->Flags, FO_SEQUENTIAL_ONLY) &&
+            Offset.QuadPart < FcbHeader->ValidDataLength.QuadPart)
+        {
+            ReadLength = MM_SEQUENTIAL_READ_AHEAD;
+            if ((ULONG_PTR)PAddress + ReadLength > MA_GetEndingAddress(MemoryArea))
+                ReadLength = MA_GetEndingAddress(MemoryArea) - (ULONG_PTR)PAddress;
+            if (Offset.QuadPart + ReadLength > FcbHeader->ValidDataLength.QuadPart)
+                ReadLength = (ULONG)(FcbHeader->ValidDataLength.QuadPart - Offset.QuadPart);
+            if (ReadLength < PAGE_SIZE)
+                ReadLength = PAGE_SIZE;
+        }
 
-        Status = MmMakeSegmentResident(Segment, Offset.QuadPart, PAGE_SIZE, &FcbHeader->ValidDataLength, FALSE);
+        Status = MmMakeSegmentResident(Segment, Offset.QuadPart, ReadLength, &FcbHeader->ValidDataLength, FALSE);
 
         FsRtlReleaseFile(Segment->FileObject);
 
@@ -4426,12 +4498,14 @@ MmMapViewInSystemSpaceEx (
 
     MmLockSectionSegment(Segment);
 
+    /* Honour write-copy sections, so that writes stay private to the view */
     Status = MmMapViewOfSegment(AddressSpace,
                                 Section->u.Flags.Image,
                                 Segment,
                                 MappedBase,
                                 *ViewSize,
-                                PAGE_READWRITE,
+                                (Section->InitialPageProtection & PAGE_IS_WRITECOPY) ?
+                                    PAGE_WRITECOPY : PAGE_READWRITE,
                                 SectionOffset->QuadPart,
                                 SEC_RESERVE);
 
@@ -19,8 +19,78 @@
 
 POBJECT_TYPE ObpDirectoryObjectType = NULL;
 
+/* Hash table sizes a directory goes through as it grows */
+static const ULONG ObpDirectoryBucketCounts[] =
+{
+    NUMBER_HASH_BUCKETS, 149, 593, 2371, 9479, OBP_DIRECTORY_MAX_BUCKETS
+};
+
 /* PRIVATE FUNCTIONS ******************************************************/
 
+/*++
+* @name ObpGrowDirectory
+*
+*     The ObpGrowDirectory routine moves the entries of a directory to a
+*     larger hash table.
+*
+* @param Directory
+*        Directory to grow. Must be locked exclusively.
+*
+* @return None.
+*
+* @remarks If the new table can't be allocated, the directory keeps the
+*          one it has, which only makes the chains longer.
+*
+*--*/
+static
+VOID
+ObpGrowDirectory(IN POBP_DIRECTORY Directory)
+{
+    POBJECT_DIRECTORY_ENTRY *NewBuckets;
+    POBJECT_DIRECTORY_ENTRY Entry;
+    ULONG NewCount = 0;
+    ULONG i, Index;
+
+    /* Find the next size */
+    for (i = 0; i < RTL_NUMBER_OF(ObpDirectoryBucketCounts); i++)
+    {
+        if (ObpDirectoryBucketCounts[i] > Directory->BucketCount)
+        {
+            NewCount = ObpDirectoryBucketCounts[i];
+            break;
+        }
+    }
+    if (!NewCount) return;
+
+    NewBuckets = ExAllocatePoolWithTag(PagedPool,
+                                       NewCount * sizeof(POBJECT_DIRECTORY_ENTRY),
+                                       OB_DIR_TAG);
+    if (!NewBuckets) return;
+    RtlZeroMemory(NewBuckets, NewCount * sizeof(POBJECT_DIRECTORY_ENTRY));
+
+    /* Move the entries, they keep their hash so nothing is recomputed */
+    for (i = 0; i < Directory->BucketCount; i++)
+    {
+        while ((Entry = Directory->Buckets[i]))
+        {
+            Directory->Buckets[i] = Entry->ChainLink;
+
+            Index = Entry->HashValue % NewCount;
+            Entry->ChainLink = NewBuckets[Index];
+            NewBuckets[Index] = Entry;
+        }
+    }
+
+    /* The first table is part of the directory itself */
+    if (Directory->Buckets != Directory->Directory.HashBuckets)
+    {
+        ExFreePoolWithTag(Directory->Buckets, OB_DIR_TAG);
+    }
+
+    Directory->Buckets = NewBuckets;
+    Directory->BucketCount = NewCount;
+}
+
 /*++
 * @name ObpInsertEntryDirectory
 *
@@ -46,6 +116,7 @@ ObpInsertEntryDirectory(IN POBJECT_DIRECTORY Parent,
                         IN POBP_LOOKUP_CONTEXT Context,
                         IN POBJECT_HEADER ObjectHeader)
 {
+    POBP_DIRECTORY Directory = ObpGetDirectory(Parent);
     POBJECT_DIRECTORY_ENTRY *AllocatedEntry;
     POBJECT_DIRECTORY_ENTRY NewEntry;
     POBJECT_HEADER_NAME_INFO HeaderNameInfo;
@@ -77,12 +148,20 @@ ObpInsertEntryDirectory(IN POBJECT_DIRECTORY Parent,
     /* Get the Object Name Information */
     HeaderNameInfo = OBJECT_HEADER_TO_NAME_INFO(ObjectHeader);
 
+    /* Grow the hash table first if the chains got too long */
+    if (Directory->EntryCount >= Directory->BucketCount * OBP_DIRECTORY_LOAD_FACTOR)
+    {
+        ObpGrowDirectory(Directory);
+    }
+
     /* Get the Allocated entry */
-    AllocatedEntry = &Parent->HashBuckets[Context->HashIndex];
+    Context->HashIndex = (USHORT)(Context->HashValue % Directory->BucketCount);
+    AllocatedEntry = &Directory->Buckets[Context->HashIndex];
 
     /* Set it */
     NewEntry->ChainLink = *AllocatedEntry;
     *AllocatedEntry = NewEntry;
+    Directory->EntryCount++;
 
     /* Associate the Object */
     NewEntry->Object = &ObjectHeader->Body;
@@ -164,6 +243,8 @@ ObpLookupEntryDirectory(IN POBJECT_DIRECTORY Directory,
     BOOLEAN CaseInsensitive = FALSE;
     POBJECT_HEADER_NAME_INFO HeaderNameInfo;
     POBJECT_HEADER ObjectHeader;
+    POBP_DIRECTORY DirectoryEx;
+    POBJECT_DIRECTORY_ENTRY *CacheEntry;
     ULONG HashValue;
     ULONG HashIndex;
     LONG TotalChars;
@@ -208,18 +289,10 @@ ObpLookupEntryDirectory(IN POBJECT_DIRECTORY Directory,
         else HashValue += (CurrentChar - ('a'-'A'));
     }
 
-    /* Merge it with our number of hash buckets */
-    HashIndex = HashValue % 37;
-
     /* Save the result */
     Context->HashValue = HashValue;
-    Context->HashIndex = (USHORT)HashIndex;
 
 DoItAgain:
-    /* Get the root entry and set it as our lookup bucket */
-    AllocatedEntry = &Directory->HashBuckets[HashIndex];
-    LookupBucket = AllocatedEntry;
-
     /* Check if the directory is already locked */
     if (!Context->DirectoryLocked)
     {
@@ -227,6 +300,32 @@ DoItAgain:
         ObpAcquireDirectoryLockShared(Directory, Context);
     }
 
+    /* Merge it with the number of hash buckets, which can change when unlocked */
+    DirectoryEx = ObpGetDirectory(Directory);
+    HashIndex = HashValue % DirectoryEx->BucketCount;
+    Context->HashIndex = (USHORT)HashIndex;
+
+    /* Check the entry we found last time for this hash */
+    CacheEntry = &DirectoryEx->LookupCache[HashValue % OBP_DIRECTORY_CACHE_SIZE];
+    CurrentEntry = *CacheEntry;
+    if ((CurrentEntry) && (CurrentEntry->HashValue == HashValue))
+    {
+        ObjectHeader = OBJECT_TO_OBJECT_HEADER(CurrentEntry->Object);
+        HeaderNameInfo = OBJECT_HEADER_TO_NAME_INFO(ObjectHeader);
+
+        if ((Name->Length == HeaderNameInfo->Name.Length) &&
+            (RtlEqualUnicodeString(Name, &HeaderNameInfo->Name, CaseInsensitive)))
+        {
+            /* No need to move it to the front of its chain */
+            FoundObject = CurrentEntry->Object;
+            goto Quickie;
+        }
+    }
+
+    /* Get the root entry and set it as our lookup bucket */
+    AllocatedEntry = &DirectoryEx->Buckets[HashIndex];
+    LookupBucket = AllocatedEntry;
+
     /* Start looping */
     while ((CurrentEntry = *AllocatedEntry))
     {
@@ -273,6 +372,13 @@ DoItAgain:
             }
         }
 
+        /*
+         * Cache it for the next lookup. This can happen with the lock held
+         * shared, but the entry can only be deleted with it held exclusive,
+         * and deletion clears the cache.
+         */
+        *CacheEntry = CurrentEntry;
+
         /* Save the found object */
         FoundObject = CurrentEntry->Object;
         goto Quickie;
@@ -343,21 +449,33 @@ BOOLEAN
 NTAPI
 ObpDeleteEntryDirectory(POBP_LOOKUP_CONTEXT Context)
 {
-    POBJECT_DIRECTORY Directory;
+    POBP_DIRECTORY Directory;
     POBJECT_DIRECTORY_ENTRY *AllocatedEntry;
     POBJECT_DIRECTORY_ENTRY CurrentEntry;
+    POBJECT_DIRECTORY_ENTRY *CacheEntry;
 
     /* Get the Directory */
-    Directory = Context->Directory;
-    if (!Directory) return FALSE;
+    if (!Context->Directory) return FALSE;
+    Directory = ObpGetDirectory(Context->Directory);
 
-    /* Get the Entry */
-    AllocatedEntry = &Directory->HashBuckets[Context->HashIndex];
-    CurrentEntry = *AllocatedEntry;
+    /* Find the Entry of the object that was looked up. Lookups served by
+     * the cache don't move it to the front of its chain. */
+    AllocatedEntry = &Directory->Buckets[Context->HashValue % Directory->BucketCount];
+    while ((CurrentEntry = *AllocatedEntry) && (CurrentEntry->Object != Context->Object))
+    {
+        AllocatedEntry = &CurrentEntry->ChainLink;
+    }
+    ASSERT(CurrentEntry);
+    if (!CurrentEntry) return FALSE;
+
+    /* Forget it */
+    CacheEntry = &Directory->LookupCache[Context->HashValue % OBP_DIRECTORY_CACHE_SIZE];
+    if (*CacheEntry == CurrentEntry) *CacheEntry = NULL;
 
     /* Unlink the Entry */
     *AllocatedEntry = CurrentEntry->ChainLink;
     CurrentEntry->ChainLink = NULL;
+    Directory->EntryCount--;
 
     /* Free it */
     ExFreePoolWithTag(CurrentEntry, OB_DIR_TAG);
@@ -366,6 +484,34 @@ ObpDeleteEntryDirectory(POBP_LOOKUP_CONTEXT Context)
     return TRUE;
 }
 
+/*++
+* @name ObpDeleteDirectory
+*
+*     The ObpDeleteDirectory routine frees the hash table of a directory
+*     object that is being deleted.
+*
+* @param ObjectBody
+*        Pointer to the directory object.
+*
+* @return None.
+*
+* @remarks None.
+*
+*--*/
+VOID
+NTAPI
+ObpDeleteDirectory(IN PVOID ObjectBody)
+{
+    POBP_DIRECTORY Directory = ObpGetDirectory((POBJECT_DIRECTORY)ObjectBody);
+
+    /* Free the table if it grew out of the directory */
+    if ((Directory->Buckets) &&
+        (Directory->Buckets != Directory->Directory.HashBuckets))
+    {
+        ExFreePoolWithTag(Directory->Buckets, OB_DIR_TAG);
+    }
+}
+
 /* FUNCTIONS **************************************************************/
 
 /*++
@@ -578,10 +724,10 @@ NtQueryDirectoryObject(IN HANDLE DirectoryHandle,
 
     /* Set default status and start looping */
     Status = STATUS_NO_MORE_ENTRIES;
-    for (Hash = 0; Hash < 37; Hash++)
+    for (Hash = 0; Hash < ObpGetDirectory(Directory)->BucketCount; Hash++)
     {
         /* Get this entry and loop all of them */
-        Entry = Directory->HashBuckets[Hash];
+        Entry = ObpGetDirectory(Directory)->Buckets[Hash];
         while (Entry)
         {
             /* Check if we should process this entry */
@@ -794,17 +940,21 @@ NtCreateDirectoryObject(OUT PHANDLE DirectoryHandle,
                             ObjectAttributes,
                             PreviousMode,
                             NULL,
-                            sizeof(OBJECT_DIRECTORY),
+                            sizeof(OBP_DIRECTORY),
                             0,
                             0,
                             (PVOID*)&Directory);
     if (!NT_SUCCESS(Status)) return Status;
 
     /* Setup the object */
-    RtlZeroMemory(Directory, sizeof(OBJECT_DIRECTORY));
+    RtlZeroMemory(Directory, sizeof(OBP_DIRECTORY));
     ExInitializePushLock(&Directory->Lock);
     Directory->SessionId = -1;
 
+    /* Start with the buckets of the directory itself */
+    ObpGetDirectory(Directory)->Buckets = Directory->HashBuckets;
+    ObpGetDirectory(Directory)->BucketCount = NUMBER_HASH_BUCKETS;
+
     /* Insert it into the handle table */
     Status = ObInsertObject((PVOID)Directory,
                             NULL,
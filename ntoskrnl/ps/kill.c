@@ -767,8 +767,8 @@ PspExitThread(IN NTSTATUS ExitStatus)
     /* Rundown Timers */
     ExTimerRundown();
 
-    /* FIXME: Rundown Registry Notifications (NtChangeNotify)
-    CmNotifyRunDown(Thread); */
+    /* Rundown Registry Notifications (NtChangeNotify) */
+    CmNotifyRunDown(Thread);
 
     /* Rundown Mutexes */
     KeRundownThread();
@@ -262,6 +262,7 @@ typedef const UNICODE_STRING *PCUNICODE_STRING;
 #define RtlZeroMemory(Destination, Length)            memset(Destination, 0, Length)
 #define RtlCopyMemory(Destination, Source, Length)    memcpy(Destination, Source, Length)
 #define RtlMoveMemory(Destination, Source, Length)    memmove(Destination, Source, Length)
+#define RtlEqualMemory(Destination, Source, Length)   (!memcmp(Destination, Source, Length))
 
 #define MAKELANGID(p,s)         ((((WORD)(s))<<10)|(WORD)(p))
 #define PRIMARYLANGID(l)        ((WORD)(l)&0x3ff)
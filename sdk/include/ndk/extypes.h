@@ -313,6 +313,11 @@ typedef enum _SYSTEM_INFORMATION_CLASS
     SystemPrefetchPathInformation,
     SystemVerifierFaultsInformation,
     MaxSystemInfoClass,
+
+    //
+    // ReactOS specific, kept out of the range Windows uses
+    //
+    SystemWorkQueueInformation = 0x40000000,
 } SYSTEM_INFORMATION_CLASS;
 
 //
@@ -1532,6 +1537,24 @@ typedef struct _SYSTEM_MEMORY_LIST_INFORMATION
     SIZE_T ModifiedPageCountPageFile;
 } SYSTEM_MEMORY_LIST_INFORMATION, *PSYSTEM_MEMORY_LIST_INFORMATION;
 
+//
+// Class 0x40000000 (ReactOS specific)
+//
+typedef struct _SYSTEM_WORK_QUEUE_INFORMATION
+{
+    ULONG Processor;
+    ULONG QueueType;
+    ULONG WorkerCount;
+    ULONG DynamicThreadCount;
+    ULONG QueueDepth;
+    ULONG WorkItemsQueued;
+    ULONG WorkItemsProcessed;
+    ULONG WorkItemsStolen;
+    ULONG LatencySamples;
+    ULONG AverageLatency;
+    ULONG MaximumLatency;
+} SYSTEM_WORK_QUEUE_INFORMATION, *PSYSTEM_WORK_QUEUE_INFORMATION;
+
 #ifdef __cplusplus
 }; // extern "C"
 #endif
@@ -653,13 +653,6 @@ typedef struct _FILE_DIRECTORY_INFORMATION
     WCHAR FileName[1];
 } FILE_DIRECTORY_INFORMATION, *PFILE_DIRECTORY_INFORMATION;
 
-typedef struct _FILE_IO_COMPLETION_INFORMATION
-{
-    PVOID KeyContext;
-    PVOID ApcContext;
-    IO_STATUS_BLOCK IoStatusBlock;
-} FILE_IO_COMPLETION_INFORMATION, *PFILE_IO_COMPLETION_INFORMATION;
-
 typedef struct _FILE_ATTRIBUTE_TAG_INFORMATION
 {
     ULONG FileAttributes;
@@ -782,6 +775,13 @@ typedef struct _IO_COMPLETION_BASIC_INFORMATION
     LONG Depth;
 } IO_COMPLETION_BASIC_INFORMATION, *PIO_COMPLETION_BASIC_INFORMATION;
 
+typedef struct _FILE_IO_COMPLETION_INFORMATION
+{
+    PVOID KeyContext;
+    PVOID ApcContext;
+    IO_STATUS_BLOCK IoStatusBlock;
+} FILE_IO_COMPLETION_INFORMATION, *PFILE_IO_COMPLETION_INFORMATION;
+
 //
 // Parameters for NtCreateMailslotFile/NtCreateNamedPipeFile
 //
@@ -807,6 +807,15 @@ typedef struct _NAMED_PIPE_CREATE_PARAMETERS
 
 #ifndef NTOS_MODE_USER
 
+//
+// The DDK only has this class from Vista on, but NT 5.2 builds of the
+// kernel implement it too. Keep it out of FILE_INFORMATION_CLASS, so that
+// FileMaximumInformation stays the same for drivers.
+//
+#if (NTDDI_VERSION < NTDDI_VISTA)
+#define FileIoCompletionNotificationInformation ((FILE_INFORMATION_CLASS)(FileShortNameInformation + 1))
+#endif
+
 //
 // I/O Timer Object
 //
@@ -127,6 +127,27 @@ typedef struct _USB_INTERFACE_ASSOCIATION_DESCRIPTOR {
   UCHAR iFunction;
 } USB_INTERFACE_ASSOCIATION_DESCRIPTOR, *PUSB_INTERFACE_ASSOCIATION_DESCRIPTOR;
 
+#define USB_SUPERSPEED_ENDPOINT_COMPANION_DESCRIPTOR_TYPE 0x30
+
+typedef struct _USB_SUPERSPEED_ENDPOINT_COMPANION_DESCRIPTOR {
+  UCHAR bLength;
+  UCHAR bDescriptorType;
+  UCHAR bMaxBurst;
+  union {
+    UCHAR AsUchar;
+    struct {
+      UCHAR MaxStreams:5;
+      UCHAR Reserved1:3;
+    } Bulk;
+    struct {
+      UCHAR Mult:2;
+      UCHAR Reserved2:5;
+      UCHAR SspCompanion:1;
+    } Isochronous;
+  } bmAttributes;
+  USHORT wBytesPerInterval;
+} USB_SUPERSPEED_ENDPOINT_COMPANION_DESCRIPTOR, *PUSB_SUPERSPEED_ENDPOINT_COMPANION_DESCRIPTOR;
+
 typedef union _USB_20_PORT_STATUS {
   USHORT AsUshort16;
   struct {
@@ -2370,6 +2370,9 @@ GetProfileStringW(
   _In_ DWORD nSize);
 
 BOOL WINAPI GetQueuedCompletionStatus(HANDLE,PDWORD,PULONG_PTR,LPOVERLAPPED*,DWORD);
+#if (_WIN32_WINNT >= 0x0600)
+BOOL WINAPI GetQueuedCompletionStatusEx(_In_ HANDLE, _Out_writes_to_(ulCount, *ulNumEntriesRemoved) LPOVERLAPPED_ENTRY, _In_ ULONG, _Out_ PULONG, _In_ DWORD, _In_ BOOL);
+#endif
 BOOL WINAPI GetSecurityDescriptorControl(PSECURITY_DESCRIPTOR,PSECURITY_DESCRIPTOR_CONTROL,PDWORD);
 BOOL WINAPI GetSecurityDescriptorDacl(PSECURITY_DESCRIPTOR,LPBOOL,PACL*,LPBOOL);
 BOOL WINAPI GetSecurityDescriptorGroup(PSECURITY_DESCRIPTOR,PSID*,LPBOOL);
@@ -3286,6 +3289,11 @@ DWORD WINAPI WaitForSingleObject(_In_ HANDLE hHandle, _In_ DWORD dwMilliseconds)
 DWORD WINAPI WaitForSingleObjectEx(HANDLE,DWORD,BOOL);
 BOOL WINAPI WaitNamedPipeA(_In_ LPCSTR, _In_ DWORD);
 BOOL WINAPI WaitNamedPipeW(_In_ LPCWSTR, _In_ DWORD);
+#if (_WIN32_WINNT >= 0x0602)
+BOOL WINAPI WaitOnAddress(_In_reads_bytes_(AddressSize) volatile VOID*, _In_reads_bytes_(AddressSize) PVOID, _In_ SIZE_T AddressSize, _In_opt_ DWORD);
+VOID WINAPI WakeByAddressAll(_In_ PVOID);
+VOID WINAPI WakeByAddressSingle(_In_ PVOID);
+#endif
 #if (_WIN32_WINNT >= 0x0600)
 VOID WINAPI WakeConditionVariable(PCONDITION_VARIABLE);
 VOID WINAPI WakeAllConditionVariable(PCONDITION_VARIABLE);
@@ -3930,6 +3938,323 @@ InitOnceExecuteOnce(
   _Inout_opt_ PVOID Parameter,
   _Outptr_opt_result_maybenull_ LPVOID *Context);
 
+#if (_WIN32_WINNT >= 0x0600)
+
+typedef VOID
+(WINAPI *PTP_WIN32_IO_CALLBACK)(
+  _Inout_ PTP_CALLBACK_INSTANCE Instance,
+  _Inout_opt_ PVOID Context,
+  _Inout_opt_ PVOID Overlapped,
+  _In_ ULONG IoResult,
+  _In_ ULONG_PTR NumberOfBytesTransferred,
+  _Inout_ PTP_IO Io);
+
+FORCEINLINE
+VOID
+InitializeThreadpoolEnvironment(
+  _Out_ PTP_CALLBACK_ENVIRON pcbe)
+{
+  TpInitializeCallbackEnviron(pcbe);
+}
+
+FORCEINLINE
+VOID
+SetThreadpoolCallbackPool(
+  _Inout_ PTP_CALLBACK_ENVIRON pcbe,
+  _In_ PTP_POOL ptpp)
+{
+  TpSetCallbackThreadpool(pcbe, ptpp);
+}
+
+FORCEINLINE
+VOID
+SetThreadpoolCallbackCleanupGroup(
+  _Inout_ PTP_CALLBACK_ENVIRON pcbe,
+  _In_ PTP_CLEANUP_GROUP ptpcg,
+  _In_opt_ PTP_CLEANUP_GROUP_CANCEL_CALLBACK pfng)
+{
+  TpSetCallbackCleanupGroup(pcbe, ptpcg, pfng);
+}
+
+FORCEINLINE
+VOID
+SetThreadpoolCallbackRunsLong(
+  _Inout_ PTP_CALLBACK_ENVIRON pcbe)
+{
+  TpSetCallbackLongFunction(pcbe);
+}
+
+FORCEINLINE
+VOID
+SetThreadpoolCallbackLibrary(
+  _Inout_ PTP_CALLBACK_ENVIRON pcbe,
+  _In_ PVOID mod)
+{
+  TpSetCallbackRaceWithDll(pcbe, mod);
+}
+
+#if (_WIN32_WINNT >= 0x0601)
+FORCEINLINE
+VOID
+SetThreadpoolCallbackPriority(
+  _Inout_ PTP_CALLBACK_ENVIRON pcbe,
+  _In_ TP_CALLBACK_PRIORITY Priority)
+{
+  TpSetCallbackPriority(pcbe, Priority);
+}
+#endif
+
+FORCEINLINE
+VOID
+SetThreadpoolCallbackPersistent(
+  _Inout_ PTP_CALLBACK_ENVIRON pcbe)
+{
+  TpSetCallbackPersistent(pcbe);
+}
+
+FORCEINLINE
+VOID
+DestroyThreadpoolEnvironment(
+  _Inout_ PTP_CALLBACK_ENVIRON pcbe)
+{
+  TpDestroyCallbackEnviron(pcbe);
+}
+
+WINBASEAPI
+_Must_inspect_result_
+PTP_POOL
+WINAPI
+CreateThreadpool(
+  _Reserved_ PVOID reserved);
+
+WINBASEAPI
+VOID
+WINAPI
+SetThreadpoolThreadMaximum(
+  _Inout_ PTP_POOL ptpp,
+  _In_ DWORD cthrdMost);
+
+WINBASEAPI
+BOOL
+WINAPI
+SetThreadpoolThreadMinimum(
+  _Inout_ PTP_POOL ptpp,
+  _In_ DWORD cthrdMic);
+
+WINBASEAPI
+VOID
+WINAPI
+CloseThreadpool(
+  _Inout_ PTP_POOL ptpp);
+
+WINBASEAPI
+_Must_inspect_result_
+PTP_CLEANUP_GROUP
+WINAPI
+CreateThreadpoolCleanupGroup(VOID);
+
+WINBASEAPI
+VOID
+WINAPI
+CloseThreadpoolCleanupGroupMembers(
+  _Inout_ PTP_CLEANUP_GROUP ptpcg,
+  _In_ BOOL fCancelPendingCallbacks,
+  _Inout_opt_ PVOID pvCleanupContext);
+
+WINBASEAPI
+VOID
+WINAPI
+CloseThreadpoolCleanupGroup(
+  _Inout_ PTP_CLEANUP_GROUP ptpcg);
+
+WINBASEAPI
+VOID
+WINAPI
+SetEventWhenCallbackReturns(
+  _Inout_ PTP_CALLBACK_INSTANCE pci,
+  _In_ HANDLE evt);
+
+WINBASEAPI
+VOID
+WINAPI
+ReleaseSemaphoreWhenCallbackReturns(
+  _Inout_ PTP_CALLBACK_INSTANCE pci,
+  _In_ HANDLE sem,
+  _In_ DWORD crel);
+
+WINBASEAPI
+VOID
+WINAPI
+ReleaseMutexWhenCallbackReturns(
+  _Inout_ PTP_CALLBACK_INSTANCE pci,
+  _In_ HANDLE mut);
+
+WINBASEAPI
+VOID
+WINAPI
+LeaveCriticalSectionWhenCallbackReturns(
+  _Inout_ PTP_CALLBACK_INSTANCE pci,
+  _Inout_ PCRITICAL_SECTION pcs);
+
+WINBASEAPI
+VOID
+WINAPI
+FreeLibraryWhenCallbackReturns(
+  _Inout_ PTP_CALLBACK_INSTANCE pci,
+  _In_ HMODULE mod);
+
+WINBASEAPI
+BOOL
+WINAPI
+CallbackMayRunLong(
+  _Inout_ PTP_CALLBACK_INSTANCE pci);
+
+WINBASEAPI
+VOID
+WINAPI
+DisassociateCurrentThreadFromCallback(
+  _Inout_ PTP_CALLBACK_INSTANCE pci);
+
+WINBASEAPI
+_Must_inspect_result_
+BOOL
+WINAPI
+TrySubmitThreadpoolCallback(
+  _In_ PTP_SIMPLE_CALLBACK pfns,
+  _Inout_opt_ PVOID pv,
+  _In_opt_ PTP_CALLBACK_ENVIRON pcbe);
+
+WINBASEAPI
+_Must_inspect_result_
+PTP_WORK
+WINAPI
+CreateThreadpoolWork(
+  _In_ PTP_WORK_CALLBACK pfnwk,
+  _Inout_opt_ PVOID pv,
+  _In_opt_ PTP_CALLBACK_ENVIRON pcbe);
+
+WINBASEAPI
+VOID
+WINAPI
+SubmitThreadpoolWork(
+  _Inout_ PTP_WORK pwk);
+
+WINBASEAPI
+VOID
+WINAPI
+WaitForThreadpoolWorkCallbacks(
+  _Inout_ PTP_WORK pwk,
+  _In_ BOOL fCancelPendingCallbacks);
+
+WINBASEAPI
+VOID
+WINAPI
+CloseThreadpoolWork(
+  _Inout_ PTP_WORK pwk);
+
+WINBASEAPI
+_Must_inspect_result_
+PTP_TIMER
+WINAPI
+CreateThreadpoolTimer(
+  _In_ PTP_TIMER_CALLBACK pfnti,
+  _Inout_opt_ PVOID pv,
+  _In_opt_ PTP_CALLBACK_ENVIRON pcbe);
+
+WINBASEAPI
+VOID
+WINAPI
+SetThreadpoolTimer(
+  _Inout_ PTP_TIMER pti,
+  _In_opt_ PFILETIME pftDueTime,
+  _In_ DWORD msPeriod,
+  _In_opt_ DWORD msWindowLength);
+
+WINBASEAPI
+BOOL
+WINAPI
+IsThreadpoolTimerSet(
+  _Inout_ PTP_TIMER pti);
+
+WINBASEAPI
+VOID
+WINAPI
+WaitForThreadpoolTimerCallbacks(
+  _Inout_ PTP_TIMER pti,
+  _In_ BOOL fCancelPendingCallbacks);
+
+WINBASEAPI
+VOID
+WINAPI
+CloseThreadpoolTimer(
+  _Inout_ PTP_TIMER pti);
+
+WINBASEAPI
+_Must_inspect_result_
+PTP_WAIT
+WINAPI
+CreateThreadpoolWait(
+  _In_ PTP_WAIT_CALLBACK pfnwa,
+  _Inout_opt_ PVOID pv,
+  _In_opt_ PTP_CALLBACK_ENVIRON pcbe);
+
+WINBASEAPI
+VOID
+WINAPI
+SetThreadpoolWait(
+  _Inout_ PTP_WAIT pwa,
+  _In_opt_ HANDLE h,
+  _In_opt_ PFILETIME pftTimeout);
+
+WINBASEAPI
+VOID
+WINAPI
+WaitForThreadpoolWaitCallbacks(
+  _Inout_ PTP_WAIT pwa,
+  _In_ BOOL fCancelPendingCallbacks);
+
+WINBASEAPI
+VOID
+WINAPI
+CloseThreadpoolWait(
+  _Inout_ PTP_WAIT pwa);
+
+WINBASEAPI
+_Must_inspect_result_
+PTP_IO
+WINAPI
+CreateThreadpoolIo(
+  _In_ HANDLE fl,
+  _In_ PTP_WIN32_IO_CALLBACK pfnio,
+  _Inout_opt_ PVOID pv,
+  _In_opt_ PTP_CALLBACK_ENVIRON pcbe);
+
+WINBASEAPI
+VOID
+WINAPI
+StartThreadpoolIo(
+  _Inout_ PTP_IO pio);
+
+WINBASEAPI
+VOID
+WINAPI
+CancelThreadpoolIo(
+  _Inout_ PTP_IO pio);
+
+WINBASEAPI
+VOID
+WINAPI
+WaitForThreadpoolIoCallbacks(
+  _Inout_ PTP_IO pio,
+  _In_ BOOL fCancelPendingCallbacks);
+
+WINBASEAPI
+VOID
+WINAPI
+CloseThreadpoolIo(
+  _Inout_ PTP_IO pio);
+
+#endif /* _WIN32_WINNT >= 0x0600 */
 
 #if defined(_SLIST_HEADER_) && !defined(_NTOS_) && !defined(_NTOSP_)
 
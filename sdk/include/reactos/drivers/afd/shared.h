@@ -149,6 +149,63 @@ typedef struct _AFD_TDI_HANDLE_DATA
     HANDLE TdiConnectionHandle;
 } AFD_TDI_HANDLE_DATA, *PAFD_TDI_HANDLE_DATA;
 
+typedef struct _AFD_TRANSMIT_FILE_INFO {
+    LARGE_INTEGER		Offset;
+    ULONG			WriteLength;
+    ULONG			SendPacketLength;
+    HANDLE			FileHandle;
+    AFD_WSABUF			Head;
+    AFD_WSABUF			Tail;
+    ULONG			Flags;
+    ULONG			AfdFlags;
+} AFD_TRANSMIT_FILE_INFO, *PAFD_TRANSMIT_FILE_INFO;
+
+/* Same layout as TRANSMIT_PACKETS_ELEMENT */
+typedef struct _AFD_TRANSMIT_PACKETS_ELEMENT {
+    ULONG			Flags;
+    ULONG			Length;
+    union {
+        struct {
+            LARGE_INTEGER	FileOffset;
+            HANDLE		FileHandle;
+        } DUMMYSTRUCTNAME;
+        PVOID			Buffer;
+    } DUMMYUNIONNAME;
+} AFD_TRANSMIT_PACKETS_ELEMENT, *PAFD_TRANSMIT_PACKETS_ELEMENT;
+
+typedef struct _AFD_TRANSMIT_PACKETS_INFO {
+    PAFD_TRANSMIT_PACKETS_ELEMENT	ElementArray;
+    ULONG			ElementCount;
+    ULONG			SendSize;
+    ULONG			Flags;
+    ULONG			AfdFlags;
+} AFD_TRANSMIT_PACKETS_INFO, *PAFD_TRANSMIT_PACKETS_INFO;
+
+typedef struct _AFD_POLL_SET_ENTRY {
+    SOCKET			Handle;
+    ULONG			Operation;
+    ULONG			Events;
+    ULONG_PTR			Context;
+    NTSTATUS			Status;
+} AFD_POLL_SET_ENTRY, *PAFD_POLL_SET_ENTRY;
+
+typedef struct _AFD_POLL_SET_UPDATE_INFO {
+    ULONG			EntryCount;
+    AFD_POLL_SET_ENTRY		Entries[1];
+} AFD_POLL_SET_UPDATE_INFO, *PAFD_POLL_SET_UPDATE_INFO;
+
+typedef struct _AFD_POLL_SET_EVENT {
+    SOCKET			Handle;
+    ULONG			Events;
+    ULONG_PTR			Context;
+} AFD_POLL_SET_EVENT, *PAFD_POLL_SET_EVENT;
+
+typedef struct _AFD_POLL_SET_WAIT_INFO {
+    LARGE_INTEGER		Timeout;
+    ULONG			EventCount;
+    AFD_POLL_SET_EVENT		Events[1];
+} AFD_POLL_SET_WAIT_INFO, *PAFD_POLL_SET_WAIT_INFO;
+
 /* AFD Packet Endpoint Flags */
 #define AFD_ENDPOINT_CONNECTIONLESS	0x1
 #define AFD_ENDPOINT_MESSAGE_ORIENTED	0x10
@@ -199,6 +256,20 @@ typedef struct _AFD_TDI_HANDLE_DATA
 #define AFD_DISCONNECT_ABORT		0x04L
 #define AFD_DISCONNECT_DATAGRAM		0x08L
 
+/* Transmit Flags, same values as TF_* */
+#define AFD_TF_DISCONNECT		0x01L
+#define AFD_TF_REUSE_SOCKET		0x02L
+
+/* Transmit Element Flags, same values as TP_ELEMENT_* */
+#define AFD_TP_ELEMENT_MEMORY		0x01L
+#define AFD_TP_ELEMENT_FILE		0x02L
+#define AFD_TP_ELEMENT_EOP		0x04L
+
+/* Poll Set Operations */
+#define AFD_POLL_SET_ADD		1
+#define AFD_POLL_SET_MODIFY		2
+#define AFD_POLL_SET_REMOVE		3
+
 /* AFD Event Flags */
 #define AFD_EVENT_RECEIVE                   (1 << AFD_EVENT_RECEIVE_BIT)
 #define AFD_EVENT_OOB_RECEIVE               (1 << AFD_EVENT_OOB_RECEIVE_BIT)
@@ -261,6 +332,10 @@ typedef struct _AFD_TDI_HANDLE_DATA
 #define AFD_DEFER_ACCEPT		35
 #define AFD_GET_PENDING_CONNECT_DATA	41
 #define AFD_VALIDATE_GROUP		42
+#define AFD_TRANSMIT_FILE		43
+#define AFD_TRANSMIT_PACKETS		44
+#define AFD_POLL_SET_UPDATE		45
+#define AFD_POLL_SET_WAIT		46
 
 /* AFD IOCTLs */
 
@@ -336,6 +411,14 @@ typedef struct _AFD_TDI_HANDLE_DATA
   _AFD_CONTROL_CODE(AFD_ENUM_NETWORK_EVENTS, METHOD_NEITHER)
 #define IOCTL_AFD_VALIDATE_GROUP \
   _AFD_CONTROL_CODE(AFD_VALIDATE_GROUP, METHOD_NEITHER)
+#define IOCTL_AFD_TRANSMIT_FILE \
+  _AFD_CONTROL_CODE(AFD_TRANSMIT_FILE, METHOD_NEITHER)
+#define IOCTL_AFD_TRANSMIT_PACKETS \
+  _AFD_CONTROL_CODE(AFD_TRANSMIT_PACKETS, METHOD_NEITHER)
+#define IOCTL_AFD_POLL_SET_UPDATE \
+  _AFD_CONTROL_CODE(AFD_POLL_SET_UPDATE, METHOD_BUFFERED )
+#define IOCTL_AFD_POLL_SET_WAIT \
+  _AFD_CONTROL_CODE(AFD_POLL_SET_WAIT, METHOD_BUFFERED )
 
 typedef struct _AFD_SOCKET_INFORMATION {
     BOOL CommandChannel;
@@ -69,7 +69,7 @@ typedef struct _USBPORT_ENDPOINT_PROPERTIES {
   USHORT EndpointAddress;
   USHORT TotalMaxPacketSize; // TransactionPerMicroframe * MaxPacketSize
   UCHAR Period;
-  UCHAR Reserved1;
+  UCHAR RootPortNumber; // xHCI only
   USB_DEVICE_SPEED DeviceSpeed;
   ULONG UsbBandwidth;
   ULONG ScheduleOffset;
@@ -78,14 +78,16 @@ typedef struct _USBPORT_ENDPOINT_PROPERTIES {
   ULONG_PTR BufferVA;
   ULONG BufferPA;
   ULONG BufferLength;
-  ULONG Reserved3;
+  ULONG RouteString : 20; // xHCI only. Hub ports below the root port, 4 bits per tier
+  ULONG MaxBurst : 4; // xHCI only. Additional packets per SuperSpeed burst
+  ULONG Reserved3 : 8;
   ULONG MaxTransferSize;
   USHORT HubAddr;
   USHORT PortNumber;
   UCHAR InterruptScheduleMask;
   UCHAR SplitCompletionMask;
   UCHAR TransactionPerMicroframe; // 1 + additional transactions. Total: from 1 to 3)
-  UCHAR Reserved4;
+  UCHAR TtPortNumber; // xHCI only. Port of the TT hub the device is behind
   ULONG MaxPacketSize;
   ULONG Reserved6;
 } USBPORT_ENDPOINT_PROPERTIES, *PUSBPORT_ENDPOINT_PROPERTIES;
@@ -0,0 +1,381 @@
+/*
+ * PROJECT:         ReactOS Kernel
+ * LICENSE:         GPL - See COPYING in the top level directory
+ * FILE:            lib/cmlib/cmcopy.c
+ * PURPOSE:         Configuration Manager Library - Key Tree Copy
+ * PROGRAMMERS:     Aleksandar Andrejevic <theflash AT sdf DOT lonestar DOT org>
+ */
+
+/* INCLUDES ******************************************************************/
+
+#include "cmlib.h"
+#define NDEBUG
+#include <debug.h>
+
+/* FUNCTIONS *****************************************************************/
+
+static
+NTSTATUS
+CmpCopySecurity(IN PHHIVE SourceHive,
+                IN HCELL_INDEX SrcSecurityCell,
+                IN PHHIVE DestinationHive,
+                IN HSTORAGE_TYPE StorageType,
+                IN OUT PHCELL_INDEX SecurityListHead,
+                OUT PHCELL_INDEX DestSecurityCell)
+{
+    PCM_KEY_SECURITY SrcSecurity, Security, ListHead, ListTail;
+    HCELL_INDEX Cell, NextCell;
+
+    PAGED_CODE();
+
+    SrcSecurity = HvGetCell(SourceHive, SrcSecurityCell);
+    ASSERT(SrcSecurity->Signature == CM_KEY_SECURITY_SIGNATURE);
+
+    /*
+     * Look for an identical descriptor among the ones already copied, so that
+     * keys keep sharing their descriptor cells in the destination hive.
+     */
+    Cell = *SecurityListHead;
+    if (Cell != HCELL_NIL)
+    {
+        do
+        {
+            Security = HvGetCell(DestinationHive, Cell);
+            if ((Security->DescriptorLength == SrcSecurity->DescriptorLength) &&
+                RtlEqualMemory(&Security->Descriptor,
+                               &SrcSecurity->Descriptor,
+                               SrcSecurity->DescriptorLength))
+            {
+                /* Found it, reference it */
+                HvMarkCellDirty(DestinationHive, Cell, FALSE);
+                Security->ReferenceCount++;
+                HvReleaseCell(DestinationHive, Cell);
+                HvReleaseCell(SourceHive, SrcSecurityCell);
+
+                *DestSecurityCell = Cell;
+                return STATUS_SUCCESS;
+            }
+
+            NextCell = Security->Flink;
+            HvReleaseCell(DestinationHive, Cell);
+            Cell = NextCell;
+        } while (Cell != *SecurityListHead);
+    }
+
+    HvReleaseCell(SourceHive, SrcSecurityCell);
+
+    /* This is a new descriptor, copy it */
+    Cell = CmpCopyCell(SourceHive,
+                       SrcSecurityCell,
+                       DestinationHive,
+                       StorageType);
+    if (Cell == HCELL_NIL)
+    {
+        /* Not enough storage space */
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    Security = HvGetCell(DestinationHive, Cell);
+    Security->ReferenceCount = 1;
+
+    /* Link it at the end of the security list of the destination hive */
+    if (*SecurityListHead == HCELL_NIL)
+    {
+        Security->Flink = Security->Blink = Cell;
+        *SecurityListHead = Cell;
+    }
+    else
+    {
+        ListHead = HvGetCell(DestinationHive, *SecurityListHead);
+        ListTail = HvGetCell(DestinationHive, ListHead->Blink);
+        HvMarkCellDirty(DestinationHive, *SecurityListHead, FALSE);
+        HvMarkCellDirty(DestinationHive, ListHead->Blink, FALSE);
+
+        Security->Flink = *SecurityListHead;
+        Security->Blink = ListHead->Blink;
+        ListTail->Flink = Cell;
+        ListHead->Blink = Cell;
+
+        HvReleaseCell(DestinationHive, Security->Blink);
+        HvReleaseCell(DestinationHive, *SecurityListHead);
+    }
+
+    HvReleaseCell(DestinationHive, Cell);
+
+    *DestSecurityCell = Cell;
+    return STATUS_SUCCESS;
+}
+
+static
+VOID
+CmpTrimIndexCell(IN PHHIVE Hive,
+                 IN HCELL_INDEX IndexCell)
+{
+    PCM_KEY_INDEX Index;
+    ULONG Size, i;
+
+    Index = HvGetCell(Hive, IndexCell);
+
+    if ((Index->Signature == CM_KEY_FAST_LEAF) ||
+        (Index->Signature == CM_KEY_HASH_LEAF))
+    {
+        Size = FIELD_OFFSET(CM_KEY_FAST_INDEX, List) + Index->Count * sizeof(CM_INDEX);
+    }
+    else
+    {
+        /* Index leaves and roots both hold plain cell indexes */
+        Size = FIELD_OFFSET(CM_KEY_INDEX, List) + Index->Count * sizeof(HCELL_INDEX);
+
+        if (Index->Signature == CM_KEY_INDEX_ROOT)
+        {
+            for (i = 0; i < Index->Count; i++)
+                CmpTrimIndexCell(Hive, Index->List[i]);
+        }
+    }
+
+    HvReleaseCell(Hive, IndexCell);
+
+    /* Leaves grow by half their size when full; give the slack back. Shrinking never moves the cell */
+    HvReallocateCell(Hive, IndexCell, Size);
+}
+
+static
+NTSTATUS
+CmpDeepCopyKeyInternal(IN PHHIVE SourceHive,
+                       IN HCELL_INDEX SrcKeyCell,
+                       IN PHHIVE DestinationHive,
+                       IN HCELL_INDEX Parent,
+                       IN HSTORAGE_TYPE StorageType,
+                       IN OUT PHCELL_INDEX SecurityListHead,
+                       OUT PHCELL_INDEX DestKeyCell OPTIONAL)
+{
+    NTSTATUS Status;
+    PCM_KEY_NODE SrcNode;
+    PCM_KEY_NODE DestNode = NULL;
+    HCELL_INDEX NewKeyCell = HCELL_NIL;
+    HCELL_INDEX NewClassCell = HCELL_NIL, NewSecCell = HCELL_NIL;
+    HCELL_INDEX SubKey, NewSubKey;
+    ULONG Index, SubKeyCount;
+
+    PAGED_CODE();
+
+    DPRINT("CmpDeepCopyKeyInternal(0x%08X, 0x%08X, 0x%08X, 0x%08X, 0x%08X, 0x%08X)\n",
+           SourceHive,
+           SrcKeyCell,
+           DestinationHive,
+           Parent,
+           StorageType,
+           DestKeyCell);
+
+    /* Get the source cell node */
+    SrcNode = HvGetCell(SourceHive, SrcKeyCell);
+    ASSERT(SrcNode);
+
+    /* Sanity check */
+    ASSERT(SrcNode->Signature == CM_KEY_NODE_SIGNATURE);
+
+    /* Create a simple copy of the source key, leaving out any slack the source cell has */
+    NewKeyCell = CmpCopyCellEx(SourceHive,
+                               SrcKeyCell,
+                               DestinationHive,
+                               StorageType,
+                               FIELD_OFFSET(CM_KEY_NODE, Name) + SrcNode->NameLength);
+    if (NewKeyCell == HCELL_NIL)
+    {
+        /* Not enough storage space */
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto Cleanup;
+    }
+
+    /* Get the destination cell node */
+    DestNode = HvGetCell(DestinationHive, NewKeyCell);
+    ASSERT(DestNode);
+
+    /* Set the parent and copy the permanent flags */
+    DestNode->Parent = Parent;
+    DestNode->Flags  = (SrcNode->Flags & (KEY_COMP_NAME | KEY_SYM_LINK));
+    if (Parent == HCELL_NIL)
+    {
+        /* This is the new root node */
+        DestNode->Flags |= KEY_HIVE_ENTRY | KEY_NO_DELETE;
+    }
+
+    /* Copy the class cell */
+    if (SrcNode->ClassLength > 0)
+    {
+        NewClassCell = CmpCopyCell(SourceHive,
+                                   SrcNode->Class,
+                                   DestinationHive,
+                                   StorageType);
+        if (NewClassCell == HCELL_NIL)
+        {
+            /* Not enough storage space */
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto Cleanup;
+        }
+
+        DestNode->Class = NewClassCell;
+        DestNode->ClassLength = SrcNode->ClassLength;
+    }
+    else
+    {
+        DestNode->Class = HCELL_NIL;
+        DestNode->ClassLength = 0;
+    }
+
+    /* Copy the security cell, or share an identical one already copied */
+    if (SrcNode->Security != HCELL_NIL)
+    {
+        Status = CmpCopySecurity(SourceHive,
+                                 SrcNode->Security,
+                                 DestinationHive,
+                                 StorageType,
+                                 SecurityListHead,
+                                 &NewSecCell);
+        if (!NT_SUCCESS(Status))
+            goto Cleanup;
+    }
+    DestNode->Security = NewSecCell;
+
+    /* Copy the value list */
+    Status = CmpCopyKeyValueList(SourceHive,
+                                 &SrcNode->ValueList,
+                                 DestinationHive,
+                                 &DestNode->ValueList,
+                                 StorageType);
+    if (!NT_SUCCESS(Status))
+        goto Cleanup;
+
+    /* Clear the invalid subkey index */
+    DestNode->SubKeyCounts[Stable] = DestNode->SubKeyCounts[Volatile] = 0;
+    DestNode->SubKeyLists[Stable] = DestNode->SubKeyLists[Volatile] = HCELL_NIL;
+
+    /* Volatile subkeys are not part of the copy, like they are not saved */
+    SubKeyCount = SrcNode->SubKeyCounts[Stable];
+
+    /* Loop through all the subkeys */
+    for (Index = 0; Index < SubKeyCount; Index++)
+    {
+        /* Get the subkey */
+        SubKey = CmpFindSubKeyByNumber(SourceHive, SrcNode, Index);
+        ASSERT(SubKey != HCELL_NIL);
+
+        /* Call the function recursively for the subkey */
+        //
+        // FIXME: Danger!! Kernel stack exhaustion!!
+        //
+        Status = CmpDeepCopyKeyInternal(SourceHive,
+                                        SubKey,
+                                        DestinationHive,
+                                        NewKeyCell,
+                                        StorageType,
+                                        SecurityListHead,
+                                        &NewSubKey);
+        if (!NT_SUCCESS(Status))
+            goto Cleanup;
+
+        /* Add the copy of the subkey to the new key */
+        if (!CmpAddSubKey(DestinationHive,
+                          NewKeyCell,
+                          NewSubKey))
+        {
+            /* Cleanup allocated cell */
+            HvFreeCell(DestinationHive, NewSubKey);
+
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto Cleanup;
+        }
+    }
+
+    /* The index is complete now, trim it to its final size */
+    if (DestNode->SubKeyLists[Stable] != HCELL_NIL)
+        CmpTrimIndexCell(DestinationHive, DestNode->SubKeyLists[Stable]);
+
+    /* Set success */
+    Status = STATUS_SUCCESS;
+
+Cleanup:
+
+    /* Release the cells */
+    if (DestNode) HvReleaseCell(DestinationHive, NewKeyCell);
+    if (SrcNode) HvReleaseCell(SourceHive, SrcKeyCell);
+
+    /* Cleanup allocated cells in case of failure */
+    if (!NT_SUCCESS(Status))
+    {
+        if (NewSecCell != HCELL_NIL)
+            CmpFreeSecurityDescriptor(DestinationHive, NewKeyCell);
+
+        if (NewClassCell != HCELL_NIL)
+            HvFreeCell(DestinationHive, NewClassCell);
+
+        if (NewKeyCell != HCELL_NIL)
+            HvFreeCell(DestinationHive, NewKeyCell);
+
+        NewKeyCell = HCELL_NIL;
+    }
+
+    /* Set the cell index if requested and return status */
+    if (DestKeyCell) *DestKeyCell = NewKeyCell;
+    return Status;
+}
+
+NTSTATUS
+NTAPI
+CmpDeepCopyKey(IN PHHIVE SourceHive,
+               IN HCELL_INDEX SrcKeyCell,
+               IN PHHIVE DestinationHive,
+               IN HSTORAGE_TYPE StorageType,
+               OUT PHCELL_INDEX DestKeyCell OPTIONAL)
+{
+    HCELL_INDEX SecurityListHead = HCELL_NIL;
+    PCM_KEY_NODE RootNode;
+
+    /* Share the security list of the destination hive if it already has one */
+    if (DestinationHive->BaseBlock->RootCell != HCELL_NIL)
+    {
+        RootNode = HvGetCell(DestinationHive, DestinationHive->BaseBlock->RootCell);
+        SecurityListHead = RootNode->Security;
+        HvReleaseCell(DestinationHive, DestinationHive->BaseBlock->RootCell);
+    }
+
+    /* Call the internal function */
+    return CmpDeepCopyKeyInternal(SourceHive,
+                                  SrcKeyCell,
+                                  DestinationHive,
+                                  HCELL_NIL,
+                                  StorageType,
+                                  &SecurityListHead,
+                                  DestKeyCell);
+}
+
+/**
+ * @name CmCompactHive
+ *
+ * Copies the key tree of a hive into a freshly created one. The keys are
+ * laid out depth-first, each one followed by its class, values and subkeys,
+ * and the copy has no free space left by deleted or reallocated cells.
+ *
+ * @param SourceHive
+ *        Hive to compact.
+ *
+ * @param DestinationHive
+ *        Empty hive, as created by HvInitialize with HINIT_CREATE, receiving
+ *        the compacted copy.
+ *
+ * @return STATUS_SUCCESS, or an error status if the destination hive could
+ *         not be grown.
+ */
+NTSTATUS
+NTAPI
+CmCompactHive(IN PHHIVE SourceHive,
+              IN PHHIVE DestinationHive)
+{
+    ASSERT(DestinationHive->BaseBlock->RootCell == HCELL_NIL);
+
+    return CmpDeepCopyKey(SourceHive,
+                          SourceHive->BaseBlock->RootCell,
+                          DestinationHive,
+                          Stable,
+                          &DestinationHive->BaseBlock->RootCell);
+}
@@ -50,7 +50,9 @@ CmCreateRootNode(
     KeyCell->LastWriteTime.QuadPart = 0ULL;
     KeyCell->Parent = HCELL_NIL;
     KeyCell->SubKeyCounts[Stable] = 0;
-    KeyCell->SubKeyCounts[Volatile] = 0;
+    /* Only touch the cell when needed, it may live in a copy-on-write view */
+    if (KeyCell->SubKeyCounts[Volatile] != 0)
+        KeyCell->SubKeyCounts[Volatile] = 0;
     KeyCell->SubKeyLists[Stable] = HCELL_NIL;
     KeyCell->SubKeyLists[Volatile] = HCELL_NIL;
     KeyCell->ValueList.Count = 0;
@@ -120,7 +122,9 @@ CmpPrepareKey(
 
     ASSERT(KeyCell->Signature == CM_KEY_NODE_SIGNATURE);
 
-    KeyCell->SubKeyCounts[Volatile] = 0;
+    /* Only touch the cell when needed, it may live in a copy-on-write view */
+    if (KeyCell->SubKeyCounts[Volatile] != 0)
+        KeyCell->SubKeyCounts[Volatile] = 0;
     // KeyCell->SubKeyLists[Volatile] = HCELL_NIL; // FIXME! Done only on Windows < XP.
 
     /* Enumerate and add subkeys */
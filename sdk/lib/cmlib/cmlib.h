@@ -117,6 +117,12 @@
         IN ULONG StartingIndex,
         IN ULONG NumberToSet);
 
+    VOID NTAPI
+    RtlClearBits(
+        IN PRTL_BITMAP BitMapHeader,
+        IN ULONG StartingIndex,
+        IN ULONG NumberToClear);
+
     VOID NTAPI
     RtlClearAllBits(
         IN PRTL_BITMAP BitMapHeader);
@@ -206,6 +212,8 @@
 #define TAG_KCB    'bkMC'
 #define TAG_CMHIVE 'vHMC'
 #define TAG_CMSD   'DSMC'
+#define TAG_CMNB   'bNMC'
+#define TAG_CMPB   'bpMC'
 
 #define CMAPI NTAPI
 
@@ -444,7 +452,8 @@ HvHiveWillShrink(
 
 BOOLEAN CMAPI
 HvSyncHive(
-   PHHIVE RegistryHive);
+   PHHIVE RegistryHive,
+   BOOLEAN Shrink);
 
 BOOLEAN CMAPI
 HvWriteHive(
@@ -474,10 +483,36 @@ HvpAddBin(
    ULONG Size,
    HSTORAGE_TYPE Storage);
 
+ULONG CMAPI
+HvpGetShrunkLength(
+   PHHIVE RegistryHive);
+
+VOID CMAPI
+HvpShrinkHive(
+   PHHIVE RegistryHive,
+   ULONG NewLength);
+
+BOOLEAN CMAPI
+HvpGrowHive(
+   PHHIVE RegistryHive,
+   ULONG NewLength);
+
 NTSTATUS CMAPI
 HvpCreateHiveFreeCellList(
    PHHIVE Hive);
 
+NTSTATUS CMAPI
+HvpAddFree(
+   PHHIVE RegistryHive,
+   PHCELL FreeBlock,
+   HCELL_INDEX FreeIndex);
+
+VOID CMAPI
+HvpRemoveFree(
+   PHHIVE RegistryHive,
+   PHCELL CellBlock,
+   HCELL_INDEX CellIndex);
+
 ULONG CMAPI
 HvpHiveHeaderChecksum(
    PHBASE_BLOCK HiveHeader);
@@ -683,6 +718,25 @@ CmpGetValueData(
     OUT PHCELL_INDEX CellToRelease
 );
 
+HCELL_INDEX
+NTAPI
+CmpCopyCell(
+    IN PHHIVE SourceHive,
+    IN HCELL_INDEX SourceCell,
+    IN PHHIVE DestinationHive,
+    IN HSTORAGE_TYPE StorageType
+);
+
+HCELL_INDEX
+NTAPI
+CmpCopyCellEx(
+    IN PHHIVE SourceHive,
+    IN HCELL_INDEX SourceCell,
+    IN PHHIVE DestinationHive,
+    IN HSTORAGE_TYPE StorageType,
+    IN ULONG DataSize
+);
+
 NTSTATUS
 NTAPI
 CmpCopyKeyValueList(
@@ -715,6 +769,26 @@ CmpFreeSecurityDescriptor(
     IN HCELL_INDEX Cell
 );
 
+//
+// Key Tree Copy Routines
+//
+NTSTATUS
+NTAPI
+CmpDeepCopyKey(
+    IN PHHIVE SourceHive,
+    IN HCELL_INDEX SrcKeyCell,
+    IN PHHIVE DestinationHive,
+    IN HSTORAGE_TYPE StorageType,
+    OUT PHCELL_INDEX DestKeyCell OPTIONAL
+);
+
+NTSTATUS
+NTAPI
+CmCompactHive(
+    IN PHHIVE SourceHive,
+    IN PHHIVE DestinationHive
+);
+
 /******************************************************************************/
 
 /* To be implemented by the user of this library */
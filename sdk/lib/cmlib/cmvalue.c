@@ -373,21 +373,21 @@ CmpRemoveValueFromList(IN PHHIVE Hive,
 
 HCELL_INDEX
 NTAPI
-CmpCopyCell(IN PHHIVE SourceHive,
-            IN HCELL_INDEX SourceCell,
-            IN PHHIVE DestinationHive,
-            IN HSTORAGE_TYPE StorageType)
+CmpCopyCellEx(IN PHHIVE SourceHive,
+              IN HCELL_INDEX SourceCell,
+              IN PHHIVE DestinationHive,
+              IN HSTORAGE_TYPE StorageType,
+              IN ULONG DataSize)
 {
     PCELL_DATA SourceData;
     PCELL_DATA DestinationData = NULL;
     HCELL_INDEX DestinationCell = HCELL_NIL;
-    LONG DataSize;
 
     PAGED_CODE();
 
-    /* Get the data and the size of the source cell */
+    /* Get the data of the source cell */
     SourceData = HvGetCell(SourceHive, SourceCell);
-    DataSize = HvGetCellSize(SourceHive, SourceData);
+    ASSERT(DataSize <= (ULONG)HvGetCellSize(SourceHive, SourceData));
 
     /* Allocate a new cell in the destination hive */
     DestinationCell = HvAllocateCell(DestinationHive,
@@ -412,6 +412,31 @@ Cleanup:
     return DestinationCell;
 }
 
+HCELL_INDEX
+NTAPI
+CmpCopyCell(IN PHHIVE SourceHive,
+            IN HCELL_INDEX SourceCell,
+            IN PHHIVE DestinationHive,
+            IN HSTORAGE_TYPE StorageType)
+{
+    PCELL_DATA SourceData;
+    LONG DataSize;
+
+    PAGED_CODE();
+
+    /* Get the size of the source cell */
+    SourceData = HvGetCell(SourceHive, SourceCell);
+    DataSize = HvGetCellSize(SourceHive, SourceData);
+    HvReleaseCell(SourceHive, SourceCell);
+
+    /* Copy the whole cell */
+    return CmpCopyCellEx(SourceHive,
+                         SourceCell,
+                         DestinationHive,
+                         StorageType,
+                         DataSize);
+}
+
 HCELL_INDEX
 NTAPI
 CmpCopyValue(IN PHHIVE SourceHive,
@@ -432,11 +457,12 @@ CmpCopyValue(IN PHHIVE SourceHive,
     Value = (PCM_KEY_VALUE)HvGetCell(SourceHive, SourceValueCell);
     if (!Value) ASSERT(FALSE);
 
-    /* Copy the value cell body */
-    NewValueCell = CmpCopyCell(SourceHive,
-                               SourceValueCell,
-                               DestinationHive,
-                               StorageType);
+    /* Copy the value cell body, leaving out any slack the source cell has */
+    NewValueCell = CmpCopyCellEx(SourceHive,
+                                 SourceValueCell,
+                                 DestinationHive,
+                                 StorageType,
+                                 FIELD_OFFSET(CM_KEY_VALUE, Name) + Value->NameLength);
     if (NewValueCell == HCELL_NIL)
     {
         /* Not enough storage space */
@@ -490,10 +516,11 @@ CmpCopyValue(IN PHHIVE SourceHive,
         /* Regular value */
 
         /* Copy the data cell */
-        NewDataCell = CmpCopyCell(SourceHive,
-                                  Value->Data,
-                                  DestinationHive,
-                                  StorageType);
+        NewDataCell = CmpCopyCellEx(SourceHive,
+                                    Value->Data,
+                                    DestinationHive,
+                                    StorageType,
+                                    DataSize);
         if (NewDataCell == HCELL_NIL)
         {
             /* Not enough storage space */
@@ -63,8 +63,13 @@ HvpAddBin(
         RegistryHive->Storage[Storage].BlockList[OldBlockListSize + i].BlockAddress =
             ((ULONG_PTR)Bin + (i * HBLOCK_SIZE));
         RegistryHive->Storage[Storage].BlockList[OldBlockListSize + i].BinAddress = (ULONG_PTR)Bin;
+        RegistryHive->Storage[Storage].BlockList[OldBlockListSize + i].CmView = NULL;
+        RegistryHive->Storage[Storage].BlockList[OldBlockListSize + i].MemAlloc = 0;
     }
 
+    /* The first block of the bin records the allocation backing it */
+    RegistryHive->Storage[Storage].BlockList[OldBlockListSize].MemAlloc = BinSize;
+
     /* Initialize a free block in this heap. */
     Block = (PHCELL)(Bin + 1);
     Block->Size = (LONG)(BinSize - sizeof(HBIN));
@@ -105,3 +110,86 @@ HvpAddBin(
 
     return Bin;
 }
+
+ULONG CMAPI
+HvpGetShrunkLength(
+    PHHIVE RegistryHive)
+{
+    PDUAL Storage = &RegistryHive->Storage[Stable];
+    ULONG Length = Storage->Length;
+    PHBIN Bin;
+    PHCELL Cell;
+
+    /* Walk back over the bins at the end that hold nothing but one free cell */
+    while (Length > 0)
+    {
+        Bin = (PHBIN)Storage->BlockList[Length - 1].BinAddress;
+        Cell = (PHCELL)(Bin + 1);
+        if (Cell->Size != (LONG)(Bin->Size - sizeof(HBIN)))
+            break;
+
+        Length = Bin->FileOffset / HBLOCK_SIZE;
+    }
+
+    return Length;
+}
+
+VOID CMAPI
+HvpShrinkHive(
+    PHHIVE RegistryHive,
+    ULONG NewLength)
+{
+    PDUAL Storage = &RegistryHive->Storage[Stable];
+    PHBIN Bin;
+    ULONG BinBlock;
+    ULONG MemAlloc;
+
+    ASSERT(RegistryHive->ReadOnly == FALSE);
+    ASSERT(NewLength > 0);
+
+    while (Storage->Length > NewLength)
+    {
+        Bin = (PHBIN)Storage->BlockList[Storage->Length - 1].BinAddress;
+        BinBlock = Bin->FileOffset / HBLOCK_SIZE;
+        ASSERT(BinBlock >= NewLength);
+
+        /* Take the free cell spanning the bin off the free lists */
+        HvpRemoveFree(RegistryHive, (PHCELL)(Bin + 1), Bin->FileOffset + sizeof(HBIN));
+
+        /* Only bins we allocated ourselves are freed, mapped ones belong to the view */
+        MemAlloc = Storage->BlockList[BinBlock].MemAlloc;
+        RtlZeroMemory(&Storage->BlockList[BinBlock],
+                      (Storage->Length - BinBlock) * sizeof(HMAP_ENTRY));
+        RtlClearBits(&RegistryHive->DirtyVector, BinBlock,
+                     Storage->Length - BinBlock);
+        Storage->Length = BinBlock;
+
+        if (MemAlloc != 0)
+            RegistryHive->Free(Bin, 0);
+    }
+
+    /* Update size in the base block, and make sure the next sync writes it out */
+    RegistryHive->BaseBlock->Length = NewLength * HBLOCK_SIZE;
+    RtlSetBits(&RegistryHive->DirtyVector, NewLength - 1, 1);
+}
+
+BOOLEAN CMAPI
+HvpGrowHive(
+    PHHIVE RegistryHive,
+    ULONG NewLength)
+{
+    PDUAL Storage = &RegistryHive->Storage[Stable];
+    PHBIN Bin;
+
+    ASSERT(NewLength > Storage->Length);
+
+    /* Give the hive back its length as a single free bin */
+    Bin = HvpAddBin(RegistryHive,
+                    (NewLength - Storage->Length) * HBLOCK_SIZE - sizeof(HBIN),
+                    Stable);
+    if (Bin == NULL)
+        return FALSE;
+
+    HvpAddFree(RegistryHive, (PHCELL)(Bin + 1), Bin->FileOffset + sizeof(HBIN));
+    return TRUE;
+}
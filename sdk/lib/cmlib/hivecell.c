@@ -9,6 +9,24 @@
 #define NDEBUG
 #include <debug.h>
 
+/*
+ * Free cells are kept on doubly-linked lists, one per size class, so that
+ * they can be unlinked in constant time when they get merged. The links are
+ * stored right after the cell header; fragments too small to hold them
+ * (hives written by other implementations use an 8-byte granularity) are
+ * kept off the lists until a neighbouring cell is freed and merged with them.
+ */
+typedef struct _HV_FREE_CELL_LINKS
+{
+    HCELL_INDEX Next;
+    HCELL_INDEX Prev;
+} HV_FREE_CELL_LINKS, *PHV_FREE_CELL_LINKS;
+
+#define HV_MIN_LISTED_FREE_CELL     (sizeof(HCELL) + sizeof(HV_FREE_CELL_LINKS))
+
+/* Maximum number of fitting cells looked at to find the best fit */
+#define HV_FREE_CELL_SCAN_LIMIT     16
+
 static __inline PHCELL CMAPI
 HvpGetCellHeader(
     PHHIVE RegistryHive,
@@ -104,6 +122,7 @@ HvMarkCellDirty(
 {
     ULONG CellBlock;
     ULONG CellLastBlock;
+    LONG CellSize;
 
     ASSERT(RegistryHive->ReadOnly == FALSE);
 
@@ -113,11 +132,16 @@ HvMarkCellDirty(
     if (HvGetCellType(CellIndex) != Stable)
         return TRUE;
 
+    /* The cell may be free or allocated, and may span several blocks */
+    CellSize = HvpGetCellHeader(RegistryHive, CellIndex)->Size;
+    if (CellSize < 0)
+        CellSize = -CellSize;
+
     CellBlock     = HvGetCellBlock(CellIndex);
-    CellLastBlock = HvGetCellBlock(CellIndex + HBLOCK_SIZE - 1);
+    CellLastBlock = HvGetCellBlock(CellIndex + CellSize - 1);
 
     RtlSetBits(&RegistryHive->DirtyVector,
-               CellBlock, CellLastBlock - CellBlock);
+               CellBlock, CellLastBlock - CellBlock + 1);
     RegistryHive->DirtyCount++;
     return TRUE;
 }
@@ -171,78 +195,84 @@ HvpComputeFreeListIndex(
     return Index;
 }
 
-static NTSTATUS CMAPI
+static __inline PHV_FREE_CELL_LINKS CMAPI
+HvpGetFreeCellLinks(
+    PHHIVE RegistryHive,
+    HCELL_INDEX CellIndex)
+{
+    return (PHV_FREE_CELL_LINKS)(HvpGetCellHeader(RegistryHive, CellIndex) + 1);
+}
+
+NTSTATUS CMAPI
 HvpAddFree(
     PHHIVE RegistryHive,
     PHCELL FreeBlock,
     HCELL_INDEX FreeIndex)
 {
-    PHCELL_INDEX FreeBlockData;
-    HSTORAGE_TYPE Storage;
+    PHV_FREE_CELL_LINKS FreeLinks;
+    PDUAL Storage;
     ULONG Index;
 
     ASSERT(RegistryHive != NULL);
     ASSERT(FreeBlock != NULL);
+    ASSERT(FreeBlock->Size > 0);
 
-    Storage = HvGetCellType(FreeIndex);
+    /* Fragments too small to hold the list links are never handed out */
+    if ((ULONG)FreeBlock->Size < HV_MIN_LISTED_FREE_CELL)
+        return STATUS_SUCCESS;
+
+    Storage = &RegistryHive->Storage[HvGetCellType(FreeIndex)];
     Index = HvpComputeFreeListIndex((ULONG)FreeBlock->Size);
 
-    FreeBlockData = (PHCELL_INDEX)(FreeBlock + 1);
-    *FreeBlockData = RegistryHive->Storage[Storage].FreeDisplay[Index];
-    RegistryHive->Storage[Storage].FreeDisplay[Index] = FreeIndex;
+    /* Insert the cell at the head of its list */
+    FreeLinks = (PHV_FREE_CELL_LINKS)(FreeBlock + 1);
+    FreeLinks->Next = Storage->FreeDisplay[Index];
+    FreeLinks->Prev = HCELL_NIL;
+    if (FreeLinks->Next != HCELL_NIL)
+        HvpGetFreeCellLinks(RegistryHive, FreeLinks->Next)->Prev = FreeIndex;
 
-    /* FIXME: Eventually get rid of free bins. */
+    Storage->FreeDisplay[Index] = FreeIndex;
+    Storage->FreeSummary |= (1 << Index);
 
     return STATUS_SUCCESS;
 }
 
-static VOID CMAPI
+VOID CMAPI
 HvpRemoveFree(
     PHHIVE RegistryHive,
     PHCELL CellBlock,
     HCELL_INDEX CellIndex)
 {
-    PHCELL_INDEX FreeCellData;
-    PHCELL_INDEX pFreeCellOffset;
-    HSTORAGE_TYPE Storage;
-    ULONG Index, FreeListIndex;
+    PHV_FREE_CELL_LINKS FreeLinks;
+    PDUAL Storage;
+    ULONG Index;
 
     ASSERT(RegistryHive->ReadOnly == FALSE);
+    ASSERT(CellBlock->Size > 0);
 
-    Storage = HvGetCellType(CellIndex);
+    /* Small fragments are not on any list, see HvpAddFree */
+    if ((ULONG)CellBlock->Size < HV_MIN_LISTED_FREE_CELL)
+        return;
+
+    Storage = &RegistryHive->Storage[HvGetCellType(CellIndex)];
     Index = HvpComputeFreeListIndex((ULONG)CellBlock->Size);
 
-    pFreeCellOffset = &RegistryHive->Storage[Storage].FreeDisplay[Index];
-    while (*pFreeCellOffset != HCELL_NIL)
+    /* Unlink the cell from its neighbours on the list */
+    FreeLinks = (PHV_FREE_CELL_LINKS)(CellBlock + 1);
+    if (FreeLinks->Prev != HCELL_NIL)
     {
-        FreeCellData = (PHCELL_INDEX)HvGetCell(RegistryHive, *pFreeCellOffset);
-        if (*pFreeCellOffset == CellIndex)
-        {
-            *pFreeCellOffset = *FreeCellData;
-            return;
-        }
-        pFreeCellOffset = FreeCellData;
+        HvpGetFreeCellLinks(RegistryHive, FreeLinks->Prev)->Next = FreeLinks->Next;
     }
-
-    /* Something bad happened, print a useful trace info and bugcheck */
-    CMLTRACE(CMLIB_HCELL_DEBUG, "-- beginning of HvpRemoveFree trace --\n");
-    CMLTRACE(CMLIB_HCELL_DEBUG, "block we are about to free: %08x\n", CellIndex);
-    CMLTRACE(CMLIB_HCELL_DEBUG, "chosen free list index: %u\n", Index);
-    for (FreeListIndex = 0; FreeListIndex < 24; FreeListIndex++)
+    else
     {
-        CMLTRACE(CMLIB_HCELL_DEBUG, "free list [%u]: ", FreeListIndex);
-        pFreeCellOffset = &RegistryHive->Storage[Storage].FreeDisplay[FreeListIndex];
-        while (*pFreeCellOffset != HCELL_NIL)
-        {
-            CMLTRACE(CMLIB_HCELL_DEBUG, "%08x ", *pFreeCellOffset);
-            FreeCellData = (PHCELL_INDEX)HvGetCell(RegistryHive, *pFreeCellOffset);
-            pFreeCellOffset = FreeCellData;
-        }
-        CMLTRACE(CMLIB_HCELL_DEBUG, "\n");
+        ASSERT(Storage->FreeDisplay[Index] == CellIndex);
+        Storage->FreeDisplay[Index] = FreeLinks->Next;
+        if (FreeLinks->Next == HCELL_NIL)
+            Storage->FreeSummary &= ~(1 << Index);
     }
-    CMLTRACE(CMLIB_HCELL_DEBUG, "-- end of HvpRemoveFree trace --\n");
 
-    ASSERT(FALSE);
+    if (FreeLinks->Next != HCELL_NIL)
+        HvpGetFreeCellLinks(RegistryHive, FreeLinks->Next)->Prev = FreeLinks->Prev;
 }
 
 static HCELL_INDEX CMAPI
@@ -251,24 +281,72 @@ HvpFindFree(
     ULONG Size,
     HSTORAGE_TYPE Storage)
 {
-    PHCELL_INDEX FreeCellData;
+    PHCELL FreeCell;
     HCELL_INDEX FreeCellOffset;
-    PHCELL_INDEX pFreeCellOffset;
+    HCELL_INDEX BestCellOffset;
+    ULONG BestCellSize;
+    ULONG Scanned;
     ULONG Index;
+    PDUAL Dual = &RegistryHive->Storage[Storage];
+
+    Index = HvpComputeFreeListIndex(Size);
 
-    for (Index = HvpComputeFreeListIndex(Size); Index < 24; Index++)
+    /*
+     * The lists below 16 each hold cells of a single size, and every cell on
+     * a list above the one the request falls in is big enough. Only the
+     * request's own list of the ranged ones has to be searched; pick the
+     * best fitting cell there, giving up after a few candidates so that long
+     * lists stay cheap.
+     */
+    if ((Index >= 16) && (Dual->FreeSummary & (1 << Index)))
     {
-        pFreeCellOffset = &RegistryHive->Storage[Storage].FreeDisplay[Index];
-        while (*pFreeCellOffset != HCELL_NIL)
+        BestCellOffset = HCELL_NIL;
+        BestCellSize = MAXULONG;
+        Scanned = 0;
+
+        FreeCellOffset = Dual->FreeDisplay[Index];
+        while (FreeCellOffset != HCELL_NIL)
         {
-            FreeCellData = (PHCELL_INDEX)HvGetCell(RegistryHive, *pFreeCellOffset);
-            if ((ULONG)HvpGetCellFullSize(RegistryHive, FreeCellData) >= Size)
+            FreeCell = HvpGetCellHeader(RegistryHive, FreeCellOffset);
+            if ((ULONG)FreeCell->Size >= Size &&
+                (ULONG)FreeCell->Size < BestCellSize)
             {
-                FreeCellOffset = *pFreeCellOffset;
-                *pFreeCellOffset = *FreeCellData;
-                return FreeCellOffset;
+                BestCellOffset = FreeCellOffset;
+                BestCellSize = (ULONG)FreeCell->Size;
+                if (BestCellSize == Size)
+                    break;
             }
-            pFreeCellOffset = FreeCellData;
+
+            if (BestCellOffset != HCELL_NIL &&
+                ++Scanned >= HV_FREE_CELL_SCAN_LIMIT)
+            {
+                break;
+            }
+
+            FreeCellOffset = ((PHV_FREE_CELL_LINKS)(FreeCell + 1))->Next;
+        }
+
+        if (BestCellOffset != HCELL_NIL)
+        {
+            HvpRemoveFree(RegistryHive,
+                          HvpGetCellHeader(RegistryHive, BestCellOffset),
+                          BestCellOffset);
+            return BestCellOffset;
+        }
+
+        Index++;
+    }
+
+    /* Take the first cell of the smallest non-empty list that fits */
+    for (; Index < 24; Index++)
+    {
+        if (Dual->FreeSummary & (1 << Index))
+        {
+            FreeCellOffset = Dual->FreeDisplay[Index];
+            HvpRemoveFree(RegistryHive,
+                          HvpGetCellHeader(RegistryHive, FreeCellOffset),
+                          FreeCellOffset);
+            return FreeCellOffset;
         }
     }
 
@@ -281,6 +359,7 @@ HvpCreateHiveFreeCellList(
 {
     HCELL_INDEX BlockOffset;
     PHCELL FreeBlock;
+    PHCELL Neighbor;
     ULONG BlockIndex;
     ULONG FreeOffset;
     PHBIN Bin;
@@ -293,6 +372,8 @@ HvpCreateHiveFreeCellList(
         Hive->Storage[Stable].FreeDisplay[Index] = HCELL_NIL;
         Hive->Storage[Volatile].FreeDisplay[Index] = HCELL_NIL;
     }
+    Hive->Storage[Stable].FreeSummary = 0;
+    Hive->Storage[Volatile].FreeSummary = 0;
 
     BlockOffset = 0;
     BlockIndex = 0;
@@ -307,6 +388,15 @@ HvpCreateHiveFreeCellList(
             FreeBlock = (PHCELL)((ULONG_PTR)Bin + FreeOffset);
             if (FreeBlock->Size > 0)
             {
+                /* Merge runs of free cells, hives written by older versions have them */
+                while (FreeOffset + FreeBlock->Size < Bin->Size)
+                {
+                    Neighbor = (PHCELL)((ULONG_PTR)FreeBlock + FreeBlock->Size);
+                    if (Neighbor->Size <= 0)
+                        break;
+                    FreeBlock->Size += Neighbor->Size;
+                }
+
                 Status = HvpAddFree(Hive, FreeBlock, Bin->FileOffset + FreeOffset);
                 if (!NT_SUCCESS(Status))
                     return Status;
@@ -364,8 +454,8 @@ HvAllocateCell(
     /* Split the block in two parts */
 
     /* The free block that is created has to be at least
-       sizeof(HCELL) + sizeof(HCELL_INDEX) big, so that free
-       cell list code can work. Moreover we round cell sizes
+       sizeof(HCELL) + sizeof(HV_FREE_CELL_LINKS) big, so that
+       free cell list code can work. Moreover we round cell sizes
        to 16 bytes, so creating a smaller block would result in
        a cell that would never be allocated. */
     if ((ULONG)FreeCell->Size > Size + 16)
@@ -401,6 +491,12 @@ HvReallocateCell(
     LONG OldCellSize;
     HCELL_INDEX NewCellIndex;
     HSTORAGE_TYPE Storage;
+    PHCELL CellHeader;
+    PHCELL Neighbor;
+    PHBIN Bin;
+    ULONG FullSize;
+    ULONG OldFullSize;
+    ULONG NeighborSize;
 
     ASSERT(CellIndex != HCELL_NIL);
 
@@ -409,32 +505,84 @@ HvReallocateCell(
 
     Storage = HvGetCellType(CellIndex);
 
-    OldCell = HvGetCell(RegistryHive, CellIndex);
+    CellHeader = HvpGetCellHeader(RegistryHive, CellIndex);
+    OldCell = CellHeader + 1;
     OldCellSize = HvGetCellSize(RegistryHive, OldCell);
     ASSERT(OldCellSize > 0);
 
+    OldFullSize = (ULONG)OldCellSize + sizeof(HCELL);
+    FullSize = ROUND_UP(Size + sizeof(HCELL), 16);
+
     /*
-     * If new data size is larger than the current, destroy current
-     * data block and allocate a new one.
-     *
-     * FIXME: Merge with adjacent free cell if possible.
-     * FIXME: Implement shrinking.
+     * If the cell shrinks, give its tail back when it is big enough to make
+     * a useful free cell. HvFreeCell merges it with a free cell that follows.
      */
-    if (Size > (ULONG)OldCellSize)
+    if (FullSize <= OldFullSize)
     {
-        NewCellIndex = HvAllocateCell(RegistryHive, Size, Storage, HCELL_NIL);
-        if (NewCellIndex == HCELL_NIL)
-            return HCELL_NIL;
+        if (OldFullSize > FullSize + 16)
+        {
+            if (Storage == Stable)
+                HvMarkCellDirty(RegistryHive, CellIndex, FALSE);
 
-        NewCell = HvGetCell(RegistryHive, NewCellIndex);
-        RtlCopyMemory(NewCell, OldCell, (SIZE_T)OldCellSize);
+            CellHeader->Size = -(LONG)FullSize;
+            Neighbor = (PHCELL)((ULONG_PTR)CellHeader + FullSize);
+            Neighbor->Size = -(LONG)(OldFullSize - FullSize);
+            HvFreeCell(RegistryHive, CellIndex + FullSize);
+        }
+
+        return CellIndex;
+    }
 
-        HvFreeCell(RegistryHive, CellIndex);
+    /*
+     * The cell grows. If it is followed by a free cell large enough to cover
+     * the difference, grow it in place instead of moving the data around.
+     */
+    Bin = (PHBIN)RegistryHive->Storage[Storage].BlockList[HvGetCellBlock(CellIndex)].BinAddress;
+    if ((CellIndex & ~HCELL_TYPE_MASK) + OldFullSize < Bin->FileOffset + Bin->Size)
+    {
+        Neighbor = (PHCELL)((ULONG_PTR)CellHeader + OldFullSize);
+        if (Neighbor->Size > 0 &&
+            OldFullSize + (ULONG)Neighbor->Size >= FullSize)
+        {
+            NeighborSize = (ULONG)Neighbor->Size;
+            HvpRemoveFree(RegistryHive, Neighbor, CellIndex + OldFullSize);
 
-        return NewCellIndex;
+            /* Split off what is left of the free cell, as HvAllocateCell does */
+            if (OldFullSize + NeighborSize > FullSize + 16)
+            {
+                Neighbor = (PHCELL)((ULONG_PTR)CellHeader + FullSize);
+                Neighbor->Size = OldFullSize + NeighborSize - FullSize;
+                HvpAddFree(RegistryHive, Neighbor, CellIndex + FullSize);
+                if (Storage == Stable)
+                    HvMarkCellDirty(RegistryHive, CellIndex + FullSize, FALSE);
+            }
+            else
+            {
+                FullSize = OldFullSize + NeighborSize;
+            }
+
+            CellHeader->Size = -(LONG)FullSize;
+            if (Storage == Stable)
+                HvMarkCellDirty(RegistryHive, CellIndex, FALSE);
+
+            RtlZeroMemory((PVOID)((ULONG_PTR)CellHeader + OldFullSize),
+                          FullSize - OldFullSize);
+
+            return CellIndex;
+        }
     }
 
-    return CellIndex;
+    /* No luck, allocate a new cell and move the data there */
+    NewCellIndex = HvAllocateCell(RegistryHive, Size, Storage, HCELL_NIL);
+    if (NewCellIndex == HCELL_NIL)
+        return HCELL_NIL;
+
+    NewCell = HvGetCell(RegistryHive, NewCellIndex);
+    RtlCopyMemory(NewCell, OldCell, (SIZE_T)OldCellSize);
+
+    HvFreeCell(RegistryHive, CellIndex);
+
+    return NewCellIndex;
 }
 
 VOID CMAPI
@@ -447,6 +595,7 @@ HvFreeCell(
     PHBIN Bin;
     ULONG CellType;
     ULONG CellBlock;
+    LONG NeighborSize;
 
     ASSERT(RegistryHive->ReadOnly == FALSE);
 
@@ -462,54 +611,37 @@ HvFreeCell(
     CellType = HvGetCellType(CellIndex);
     CellBlock = HvGetCellBlock(CellIndex);
 
-    /* FIXME: Merge free blocks */
     Bin = (PHBIN)RegistryHive->Storage[CellType].BlockList[CellBlock].BinAddress;
 
+    /* Merge with the next cell if it is free */
     if ((CellIndex & ~HCELL_TYPE_MASK) + Free->Size <
         Bin->FileOffset + Bin->Size)
     {
         Neighbor = (PHCELL)((ULONG_PTR)Free + Free->Size);
         if (Neighbor->Size > 0)
         {
-            HvpRemoveFree(RegistryHive, Neighbor,
-                          ((HCELL_INDEX)((ULONG_PTR)Neighbor - (ULONG_PTR)Bin +
-                            Bin->FileOffset)) | (CellIndex & HCELL_TYPE_MASK));
+            HvpRemoveFree(RegistryHive, Neighbor, CellIndex + Free->Size);
             Free->Size += Neighbor->Size;
         }
     }
 
+    /* Merge with the previous cell if it is free, walking the bin to find it */
     Neighbor = (PHCELL)(Bin + 1);
     while (Neighbor < Free)
     {
-        if (Neighbor->Size > 0)
+        NeighborSize = (Neighbor->Size > 0) ? Neighbor->Size : -Neighbor->Size;
+        if ((ULONG_PTR)Neighbor + NeighborSize == (ULONG_PTR)Free)
         {
-            if ((ULONG_PTR)Neighbor + Neighbor->Size == (ULONG_PTR)Free)
+            if (Neighbor->Size > 0)
             {
-                HCELL_INDEX NeighborCellIndex =
-                    ((HCELL_INDEX)((ULONG_PTR)Neighbor - (ULONG_PTR)Bin +
-                     Bin->FileOffset)) | (CellIndex & HCELL_TYPE_MASK);
-
-                if (HvpComputeFreeListIndex(Neighbor->Size) !=
-                    HvpComputeFreeListIndex(Neighbor->Size + Free->Size))
-                {
-                   HvpRemoveFree(RegistryHive, Neighbor, NeighborCellIndex);
-                   Neighbor->Size += Free->Size;
-                   HvpAddFree(RegistryHive, Neighbor, NeighborCellIndex);
-                }
-                else
-                    Neighbor->Size += Free->Size;
-
-                if (CellType == Stable)
-                    HvMarkCellDirty(RegistryHive, NeighborCellIndex, FALSE);
-
-                return;
+                HvpRemoveFree(RegistryHive, Neighbor, CellIndex - NeighborSize);
+                Neighbor->Size += Free->Size;
+                Free = Neighbor;
+                CellIndex -= NeighborSize;
             }
-            Neighbor = (PHCELL)((ULONG_PTR)Neighbor + Neighbor->Size);
-        }
-        else
-        {
-            Neighbor = (PHCELL)((ULONG_PTR)Neighbor - Neighbor->Size);
+            break;
         }
+        Neighbor = (PHCELL)((ULONG_PTR)Neighbor + NeighborSize);
     }
 
     /* Add block to the list of free blocks */
@@ -26,6 +26,7 @@
 #define HIVE_HAS_BEEN_FREED             8
 #define HIVE_UNKNOWN                    0x10
 #define HIVE_IS_UNLOADING               0x20
+#define HIVE_NO_SHRINK                  0x40
 
 //
 // Hive types
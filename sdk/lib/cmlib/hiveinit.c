@@ -67,7 +67,10 @@ HvpFreeHiveBins(
             if (Hive->Storage[Storage].BlockList[i].BinAddress != (ULONG_PTR)Bin)
             {
                 Bin = (PHBIN)Hive->Storage[Storage].BlockList[i].BinAddress;
-                Hive->Free((PHBIN)Hive->Storage[Storage].BlockList[i].BinAddress, 0);
+
+                /* Bins living in a mapped view of the hive file are not ours to free */
+                if (Hive->Storage[Storage].BlockList[i].MemAlloc != 0)
+                    Hive->Free(Bin, 0);
             }
             Hive->Storage[Storage].BlockList[i].BinAddress = (ULONG_PTR)NULL;
             Hive->Storage[Storage].BlockList[i].BlockAddress = (ULONG_PTR)NULL;
@@ -209,19 +212,25 @@ HvpCreateHive(
 }
 
 /**
- * @name HvpInitializeMemoryHive
+ * @name HvpInitializeHiveImage
  *
- * Internal helper function to initialize hive descriptor structure for
- * an existing hive stored in memory. The data of the hive is copied
- * and it is prepared for read/write access.
+ * Internal helper function to build the bin map of a hive descriptor from
+ * a flat hive image (base block followed by the hive bins) and prepare it
+ * for read/write access.
  *
- * @see HvInitialize
+ * When CopyBins is TRUE every bin is copied into memory allocated with the
+ * hive allocator, and the image can be released once this routine returns.
+ * Otherwise the bin map points straight into the image, which must then
+ * stay valid until HvFree is called; this is used for hives backed by a
+ * copy-on-write view of their primary file, so that only the bins that
+ * get modified end up consuming private memory.
  */
-NTSTATUS CMAPI
-HvpInitializeMemoryHive(
+static NTSTATUS CMAPI
+HvpInitializeHiveImage(
     PHHIVE Hive,
     PHBASE_BLOCK ChunkBase,
-    IN PCUNICODE_STRING FileName OPTIONAL)
+    IN PCUNICODE_STRING FileName OPTIONAL,
+    IN BOOLEAN CopyBins)
 {
     SIZE_T BlockIndex;
     PHBIN Bin, NewBin;
@@ -253,7 +262,7 @@ HvpInitializeMemoryHive(
 
     /*
      * Build a block list from the in-memory chunk and copy the data as
-     * we go.
+     * we go, unless the bins can be used in place.
      */
 
     Hive->Storage[Stable].Length = (ULONG)(ChunkSize / HBLOCK_SIZE);
@@ -266,43 +275,52 @@ HvpInitializeMemoryHive(
         Hive->Free(Hive->BaseBlock, Hive->BaseBlockAlloc);
         return STATUS_NO_MEMORY;
     }
+    RtlZeroMemory(Hive->Storage[Stable].BlockList,
+                  Hive->Storage[Stable].Length * sizeof(HMAP_ENTRY));
 
     for (BlockIndex = 0; BlockIndex < Hive->Storage[Stable].Length; )
     {
         Bin = (PHBIN)((ULONG_PTR)ChunkBase + (BlockIndex + 1) * HBLOCK_SIZE);
         if (Bin->Signature != HV_HBIN_SIGNATURE ||
-           (Bin->Size % HBLOCK_SIZE) != 0)
+           (Bin->Size % HBLOCK_SIZE) != 0 ||
+           (Bin->Size == 0) ||
+           (Bin->Size / HBLOCK_SIZE > Hive->Storage[Stable].Length - BlockIndex))
         {
             DPRINT1("Invalid bin at BlockIndex %lu, Signature 0x%x, Size 0x%x\n",
                     (unsigned long)BlockIndex, (unsigned)Bin->Signature, (unsigned)Bin->Size);
-            Hive->Free(Hive->Storage[Stable].BlockList, 0);
+            HvpFreeHiveBins(Hive);
             Hive->Free(Hive->BaseBlock, Hive->BaseBlockAlloc);
             return STATUS_REGISTRY_CORRUPT;
         }
 
-        NewBin = Hive->Allocate(Bin->Size, TRUE, TAG_CM);
-        if (NewBin == NULL)
+        if (CopyBins)
         {
-            Hive->Free(Hive->Storage[Stable].BlockList, 0);
-            Hive->Free(Hive->BaseBlock, Hive->BaseBlockAlloc);
-            return STATUS_NO_MEMORY;
-        }
-
-        Hive->Storage[Stable].BlockList[BlockIndex].BinAddress = (ULONG_PTR)NewBin;
-        Hive->Storage[Stable].BlockList[BlockIndex].BlockAddress = (ULONG_PTR)NewBin;
+            NewBin = Hive->Allocate(Bin->Size, TRUE, TAG_CM);
+            if (NewBin == NULL)
+            {
+                HvpFreeHiveBins(Hive);
+                Hive->Free(Hive->BaseBlock, Hive->BaseBlockAlloc);
+                return STATUS_NO_MEMORY;
+            }
 
-        RtlCopyMemory(NewBin, Bin, Bin->Size);
+            RtlCopyMemory(NewBin, Bin, Bin->Size);
+        }
+        else
+        {
+            NewBin = Bin;
+        }
 
-        if (Bin->Size > HBLOCK_SIZE)
+        for (i = 0; i < Bin->Size / HBLOCK_SIZE; i++)
         {
-            for (i = 1; i < Bin->Size / HBLOCK_SIZE; i++)
-            {
-                Hive->Storage[Stable].BlockList[BlockIndex + i].BinAddress = (ULONG_PTR)NewBin;
-                Hive->Storage[Stable].BlockList[BlockIndex + i].BlockAddress =
-                    ((ULONG_PTR)NewBin + (i * HBLOCK_SIZE));
-            }
+            Hive->Storage[Stable].BlockList[BlockIndex + i].BinAddress = (ULONG_PTR)NewBin;
+            Hive->Storage[Stable].BlockList[BlockIndex + i].BlockAddress =
+                ((ULONG_PTR)NewBin + (i * HBLOCK_SIZE));
         }
 
+        /* Only the first block of a bin records the allocation backing it */
+        if (CopyBins)
+            Hive->Storage[Stable].BlockList[BlockIndex].MemAlloc = Bin->Size;
+
         BlockIndex += Bin->Size / HBLOCK_SIZE;
     }
 
@@ -331,6 +349,53 @@ HvpInitializeMemoryHive(
     return STATUS_SUCCESS;
 }
 
+/**
+ * @name HvpInitializeMemoryHive
+ *
+ * Internal helper function to initialize hive descriptor structure for
+ * an existing hive stored in memory. The data of the hive is copied
+ * and it is prepared for read/write access.
+ *
+ * @see HvInitialize
+ */
+NTSTATUS CMAPI
+HvpInitializeMemoryHive(
+    PHHIVE Hive,
+    PHBASE_BLOCK ChunkBase,
+    IN PCUNICODE_STRING FileName OPTIONAL)
+{
+    return HvpInitializeHiveImage(Hive, ChunkBase, FileName, TRUE);
+}
+
+/**
+ * @name HvpInitializeMappedHive
+ *
+ * Internal helper function to initialize hive descriptor structure for
+ * a hive whose primary file has been mapped copy-on-write by the caller.
+ * The bins are used in place and paged in on demand; modified blocks are
+ * written back to the primary file by HvSyncHive like any other dirty
+ * block. The view MUSTN'T be unmapped until HvFree is called.
+ *
+ * @see HvInitialize
+ */
+NTSTATUS CMAPI
+HvpInitializeMappedHive(
+    PHHIVE Hive,
+    PHBASE_BLOCK ChunkBase,
+    IN PCUNICODE_STRING FileName OPTIONAL)
+{
+    NTSTATUS Status;
+
+    Status = HvpInitializeHiveImage(Hive, ChunkBase, FileName, FALSE);
+    if (!NT_SUCCESS(Status))
+        return Status;
+
+    /* Set default boot type */
+    Hive->BaseBlock->BootType = 0;
+
+    return STATUS_SUCCESS;
+}
+
 /**
  * @name HvpInitializeFlatHive
  *
@@ -506,6 +571,11 @@ HvLoadHive(IN PHHIVE Hive,
  *          Load an in-memory hive for read-only access. The pointer
  *          to data passed to this routine MUSTN'T be freed until
  *          HvFree is called.
+ *        - HINIT_MAPFILE
+ *          Load a hive from a copy-on-write view of its primary file
+ *          for read/write access. The bins are used in place, so the
+ *          view passed to this routine MUSTN'T be unmapped until
+ *          HvFree is called.
  * @param ChunkBase
  *        Pointer to hive data.
  * @param ChunkSize
@@ -591,12 +661,14 @@ HvInitialize(
             break;
         }
 
+        case HINIT_MAPFILE:
+            Status = HvpInitializeMappedHive(Hive, HiveData, FileName);
+            break;
+
         case HINIT_MEMORY_INPLACE:
             // Status = HvpInitializeMemoryInplaceHive(Hive, HiveData);
             // break;
 
-        case HINIT_MAPFILE:
-
         default:
         /* FIXME: A better return status value is needed */
         Status = STATUS_NOT_IMPLEMENTED;
@@ -241,11 +241,27 @@ HvpWriteHive(
 
 BOOLEAN CMAPI
 HvSyncHive(
-    PHHIVE RegistryHive)
+    PHHIVE RegistryHive,
+    BOOLEAN Shrink)
 {
+    ULONG OldLength;
+    ULONG NewLength;
+
     ASSERT(RegistryHive->ReadOnly == FALSE);
 
-    if (RtlFindSetBits(&RegistryHive->DirtyVector, 1, 0) == ~0U)
+    /* Drop the free bins at the end of the hive before writing it out */
+    OldLength = RegistryHive->Storage[Stable].Length;
+    NewLength = OldLength;
+    if (Shrink && !(RegistryHive->HiveFlags & HIVE_NO_SHRINK))
+    {
+        NewLength = HvpGetShrunkLength(RegistryHive);
+    }
+
+    if (NewLength < OldLength)
+    {
+        HvpShrinkHive(RegistryHive, NewLength);
+    }
+    else if (RtlFindSetBits(&RegistryHive->DirtyVector, 1, 0) == ~0U)
     {
         return TRUE;
     }
@@ -269,6 +285,36 @@ HvSyncHive(
     RtlClearAllBits(&RegistryHive->DirtyVector);
     RegistryHive->DirtyCount = 0;
 
+    /* Give the dropped bins back to the file system */
+    if ((NewLength < OldLength) &&
+        !RegistryHive->FileSetSize(RegistryHive, HFILE_TYPE_PRIMARY,
+                                   (NewLength + 1) * HBLOCK_SIZE,
+                                   (OldLength + 1) * HBLOCK_SIZE))
+    {
+        /*
+         * The file can't be truncated, e.g. because it is mapped. What
+         * was written is consistent, the file is just longer than the
+         * hive, but keep the hive at the length of the file and don't
+         * try again.
+         */
+        DPRINT1("Failed to truncate the hive, keeping its length\n");
+        RegistryHive->HiveFlags |= HIVE_NO_SHRINK;
+
+        if (!HvpGrowHive(RegistryHive, OldLength))
+        {
+            return TRUE;
+        }
+
+        if (!HvpWriteLog(RegistryHive) ||
+            !HvpWriteHive(RegistryHive, TRUE))
+        {
+            return FALSE;
+        }
+
+        RtlClearAllBits(&RegistryHive->DirtyVector);
+        RegistryHive->DirtyCount = 0;
+    }
+
     return TRUE;
 }
 
@@ -276,9 +322,11 @@ BOOLEAN
 CMAPI
 HvHiveWillShrink(IN PHHIVE RegistryHive)
 {
-    /* No shrinking yet */
-    UNIMPLEMENTED_ONCE;
-    return FALSE;
+    /* The hive shrinks when free bins are left at its end */
+    if (RegistryHive->HiveFlags & HIVE_NO_SHRINK)
+        return FALSE;
+
+    return (HvpGetShrunkLength(RegistryHive) < RegistryHive->Storage[Stable].Length);
 }
 
 BOOLEAN CMAPI
@@ -141,7 +141,11 @@ RtlpWaitForCriticalSection(PRTL_CRITICAL_SECTION CriticalSection)
 
     for (;;)
     {
-        /* Increase the number of times we've had contention */
+        /*
+         * Increase the number of times we've had contention. Acquisitions
+         * resolved by spinning are counted in RtlpSpinOnCriticalSection,
+         * while EntryCount above only counts the ones that had to sleep.
+         */
         if (CriticalSection->DebugInfo)
             CriticalSection->DebugInfo->ContentionCount++;
 
@@ -191,6 +195,79 @@ RtlpWaitForCriticalSection(PRTL_CRITICAL_SECTION CriticalSection)
     }
 }
 
+/*++
+ * RtlpSpinOnCriticalSection
+ *
+ *     Spins for a while on a critical section owned by another thread,
+ *     hoping that the owner releases it before we have to go to sleep.
+ *
+ * Params:
+ *     CriticalSection - Critical section to acquire.
+ *
+ * Returns:
+ *     TRUE if the critical section was acquired, FALSE otherwise.
+ *
+ * Remarks:
+ *     The number of iterations is bounded by the spin count of the critical
+ *     section, and adapted to how long acquiring it took in the past, which
+ *     is tracked in the spare field of the debug data. Spinning stops as
+ *     soon as other threads are already waiting on the event, since the
+ *     lock will then be handed over to one of them instead.
+ *
+ *--*/
+BOOLEAN
+NTAPI
+RtlpSpinOnCriticalSection(PRTL_CRITICAL_SECTION CriticalSection)
+{
+    PRTL_CRITICAL_SECTION_DEBUG DebugInfo = CriticalSection->DebugInfo;
+    ULONG SpinLimit, Spins;
+    LONG LockCount;
+    BOOLEAN Acquired = FALSE;
+
+    /* Don't spin longer than twice what it took recently, nor than allowed */
+    SpinLimit = (ULONG)CriticalSection->SpinCount;
+    if (DebugInfo)
+    {
+        SpinLimit = min(SpinLimit, DebugInfo->SpareWORD * 2UL + 10);
+    }
+
+    for (Spins = 0; Spins < SpinLimit; Spins++)
+    {
+        LockCount = *(volatile LONG *)&CriticalSection->LockCount;
+        if (LockCount == -1)
+        {
+            /* It looks free, try to grab it */
+            if (InterlockedCompareExchange(&CriticalSection->LockCount, 0, -1) == -1)
+            {
+                Acquired = TRUE;
+                break;
+            }
+        }
+        else if (LockCount > 0)
+        {
+            /* Someone is already waiting, we would only be burning cycles */
+            break;
+        }
+
+        YieldProcessor();
+    }
+
+    if (DebugInfo)
+    {
+        /*
+         * Update the running average of the spins needed. This isn't done
+         * atomically, a lost update only makes the next spin a bit off.
+         */
+        Spins = min(Spins, MAXUSHORT);
+        DebugInfo->SpareWORD += ((LONG)Spins - (LONG)DebugInfo->SpareWORD) / 8;
+
+        /* Contention resolved without waiting, see RtlpWaitForCriticalSection */
+        if (Acquired) DebugInfo->ContentionCount++;
+    }
+
+    return Acquired;
+}
+
 /*++
  * RtlpUnWaitCriticalSection
  *
@@ -473,7 +550,8 @@ RtlSetCriticalSectionSpinCount(PRTL_CRITICAL_SECTION CriticalSection,
  *     STATUS_SUCCESS.
  *
  * Remarks:
- *     Uses a fast-path unless contention happens.
+ *     Uses a fast-path unless contention happens. On contention, critical
+ *     sections with a spin count spin for a while before waiting.
  *
  *--*/
 NTSTATUS
@@ -482,6 +560,31 @@ RtlEnterCriticalSection(PRTL_CRITICAL_SECTION CriticalSection)
 {
     HANDLE Thread = (HANDLE)NtCurrentTeb()->ClientId.UniqueThread;
 
+    /* Check if we are allowed to spin before waiting */
+    if (CriticalSection->SpinCount)
+    {
+        /* Try to lock it without registering as a waiter */
+        if (InterlockedCompareExchange(&CriticalSection->LockCount, 0, -1) != -1)
+        {
+            /* Only the owner can have set OwningThread to its own id */
+            if (Thread == CriticalSection->OwningThread)
+            {
+                InterlockedIncrement(&CriticalSection->LockCount);
+                CriticalSection->RecursionCount++;
+                return STATUS_SUCCESS;
+            }
+
+            /* Somebody else owns it, wait for it to be released for a bit */
+            if (!RtlpSpinOnCriticalSection(CriticalSection)) goto Wait;
+        }
+
+        /* Lock successful */
+        CriticalSection->OwningThread = Thread;
+        CriticalSection->RecursionCount = 1;
+        return STATUS_SUCCESS;
+    }
+
+Wait:
     /* Try to lock it */
     if (InterlockedIncrement(&CriticalSection->LockCount) != 0)
     {
@@ -8,7 +8,18 @@
  *                    may be different from Vista's implementation.
  *                    Since applications should treat the RTL_SRWLOCK
  *                    structure as opaque data, it should not matter.
- *                    The algorithms are probably not as optimized.
+ *
+ *                    The lock word only holds the owner state, the
+ *                    shared count and one bit for each kind of waiter.
+ *                    Waiters don't chain themselves into the lock, they
+ *                    set their bit and block on the lock word through the
+ *                    wait on address code, which keeps track of them.
+ *                    Exclusive and shared waiters are queued under
+ *                    different keys, so the releaser that frees the lock
+ *                    wakes a single exclusive waiter, or all shared
+ *                    waiters if no exclusive one is left. Woken waiters
+ *                    race for the lock again, after spinning for a bit on
+ *                    MP systems.
  */
 
 /* INCLUDES *****************************************************************/
@@ -18,295 +29,167 @@
 #define NDEBUG
 #include <debug.h>
 
+BOOLEAN
+RtlpWakeAddress(IN const volatile VOID *Key,
+                IN BOOLEAN WakeAll);
+
+NTSTATUS
+RtlpWaitOnAddress(IN const volatile VOID *Key,
+                  IN const volatile VOID *Address,
+                  IN PVOID CompareAddress,
+                  IN SIZE_T AddressSize,
+                  IN const LARGE_INTEGER *Timeout OPTIONAL);
+
 /* FUNCTIONS *****************************************************************/
 
 #ifdef _WIN64
-#define InterlockedBitTestAndSetPointer(ptr,val) InterlockedBitTestAndSet64((PLONGLONG)ptr,(LONGLONG)val)
-#define InterlockedAddPointer(ptr,val) InterlockedAdd64((PLONGLONG)ptr,(LONGLONG)val)
-#define InterlockedAndPointer(ptr,val) InterlockedAnd64((PLONGLONG)ptr,(LONGLONG)val)
-#define InterlockedOrPointer(ptr,val) InterlockedOr64((PLONGLONG)ptr,(LONGLONG)val)
 #define _ONE 1LL
 #else
-#define InterlockedBitTestAndSetPointer(ptr,val) InterlockedBitTestAndSet((PLONG)ptr,(LONG)val)
-#define InterlockedAddPointer(ptr,val) InterlockedAdd((PLONG)ptr,(LONG)val)
-#define InterlockedAndPointer(ptr,val) InterlockedAnd((PLONG)ptr,(LONG)val)
-#define InterlockedOrPointer(ptr,val) InterlockedOr((PLONG)ptr,(LONG)val)
 #define _ONE 1L
 #endif
 
 #define RTL_SRWLOCK_OWNED_BIT   0
 #define RTL_SRWLOCK_CONTENDED_BIT   1
 #define RTL_SRWLOCK_SHARED_BIT  2
-#define RTL_SRWLOCK_CONTENTION_LOCK_BIT 3
+#define RTL_SRWLOCK_SHARED_WAITERS_BIT  3
 #define RTL_SRWLOCK_OWNED   (_ONE << RTL_SRWLOCK_OWNED_BIT)
 #define RTL_SRWLOCK_CONTENDED   (_ONE << RTL_SRWLOCK_CONTENDED_BIT)
 #define RTL_SRWLOCK_SHARED  (_ONE << RTL_SRWLOCK_SHARED_BIT)
-#define RTL_SRWLOCK_CONTENTION_LOCK (_ONE << RTL_SRWLOCK_CONTENTION_LOCK_BIT)
-#define RTL_SRWLOCK_MASK    (RTL_SRWLOCK_OWNED | RTL_SRWLOCK_CONTENDED | \
-                             RTL_SRWLOCK_SHARED | RTL_SRWLOCK_CONTENTION_LOCK)
+#define RTL_SRWLOCK_SHARED_WAITERS  (_ONE << RTL_SRWLOCK_SHARED_WAITERS_BIT)
 #define RTL_SRWLOCK_BITS    4
+#define RTL_SRWLOCK_SHARED_ONE  (_ONE << RTL_SRWLOCK_BITS)
 
-typedef struct _RTLP_SRWLOCK_SHARED_WAKE
-{
-    LONG Wake;
-    volatile struct _RTLP_SRWLOCK_SHARED_WAKE *Next;
-} volatile RTLP_SRWLOCK_SHARED_WAKE, *PRTLP_SRWLOCK_SHARED_WAKE;
-
-typedef struct _RTLP_SRWLOCK_WAITBLOCK
-{
-    /* SharedCount is the number of shared acquirers. */
-    LONG SharedCount;
-
-    /* Last points to the last wait block in the chain. The value
-       is only valid when read from the first wait block. */
-    volatile struct _RTLP_SRWLOCK_WAITBLOCK *Last;
-
-    /* Next points to the next wait block in the chain. */
-    volatile struct _RTLP_SRWLOCK_WAITBLOCK *Next;
-
-    union
-    {
-        /* Wake is only valid for exclusive wait blocks */
-        LONG Wake;
-        /* The wake chain is only valid for shared wait blocks */
-        struct
-        {
-            PRTLP_SRWLOCK_SHARED_WAKE SharedWakeChain;
-            PRTLP_SRWLOCK_SHARED_WAKE LastSharedWake;
-        };
-    };
-
-    BOOLEAN Exclusive;
-} volatile RTLP_SRWLOCK_WAITBLOCK, *PRTLP_SRWLOCK_WAITBLOCK;
+/* Exclusive waiters are queued on the lock word itself, shared ones on
+   the byte behind it, so that they can be woken up separately */
+#define RTL_SRWLOCK_EXCLUSIVE_KEY(l)    ((PVOID)&(l)->Ptr)
+#define RTL_SRWLOCK_SHARED_KEY(l)   ((PVOID)((PUCHAR)&(l)->Ptr + 1))
 
+/* How often to look at the lock before going to sleep on it */
+#define RTL_SRWLOCK_SPIN_COUNT  1024
 
-static VOID
-NTAPI
-RtlpReleaseWaitBlockLockExclusive(IN OUT PRTL_SRWLOCK SRWLock,
-                                  IN PRTLP_SRWLOCK_WAITBLOCK FirstWaitBlock)
+static
+ULONG
+RtlpGetSRWLockSpinCount(VOID)
 {
-    PRTLP_SRWLOCK_WAITBLOCK Next;
-    LONG_PTR NewValue;
-
-    /* NOTE: We're currently in an exclusive lock in contended mode. */
-
-    Next = FirstWaitBlock->Next;
-    if (Next != NULL)
-    {
-        /* There's more blocks chained, we need to update the pointers
-           in the next wait block and update the wait block pointer. */
-        NewValue = (LONG_PTR)Next | RTL_SRWLOCK_OWNED | RTL_SRWLOCK_CONTENDED;
-        if (!FirstWaitBlock->Exclusive)
-        {
-            /* The next wait block has to be an exclusive lock! */
-            ASSERT(Next->Exclusive);
-
-            /* Save the shared count */
-            Next->SharedCount = FirstWaitBlock->SharedCount;
+    /* Spinning is useless if the owner can't run meanwhile */
+    return (NtCurrentPeb()->NumberOfProcessors > 1) ? RTL_SRWLOCK_SPIN_COUNT : 0;
+}
 
-            NewValue |= RTL_SRWLOCK_SHARED;
-        }
+static
+BOOLEAN
+RtlpWaitForSRWLock(IN OUT PRTL_SRWLOCK SRWLock,
+                   IN LONG_PTR CurrentValue,
+                   IN BOOLEAN Shared,
+                   IN OUT PULONG SpinCount)
+{
+    LONG_PTR NewValue, WaiterBit;
 
-        Next->Last = FirstWaitBlock->Last;
-    }
-    else
+    if (*SpinCount != 0)
     {
-        /* Convert the lock to a simple lock. */
-        if (FirstWaitBlock->Exclusive)
-            NewValue = RTL_SRWLOCK_OWNED;
-        else
-        {
-            ASSERT(FirstWaitBlock->SharedCount > 0);
-
-            NewValue = ((LONG_PTR)FirstWaitBlock->SharedCount << RTL_SRWLOCK_BITS) |
-                       RTL_SRWLOCK_SHARED | RTL_SRWLOCK_OWNED;
-        }
+        /* The owner may be about to release it, so try again soon */
+        (*SpinCount)--;
+        YieldProcessor();
+        return FALSE;
     }
 
-    (void)InterlockedExchangePointer(&SRWLock->Ptr, (PVOID)NewValue);
-
-    if (FirstWaitBlock->Exclusive)
+    WaiterBit = Shared ? RTL_SRWLOCK_SHARED_WAITERS : RTL_SRWLOCK_CONTENDED;
+    if (!(CurrentValue & WaiterBit))
     {
-        (void)InterlockedOr(&FirstWaitBlock->Wake,
-                            TRUE);
-    }
-    else
-    {
-        PRTLP_SRWLOCK_SHARED_WAKE WakeChain, NextWake;
-
-        /* If we were the first one to acquire the shared
-           lock, we now need to wake all others... */
-        WakeChain = FirstWaitBlock->SharedWakeChain;
-        do
+        /* Tell the owner that it has to wake us up when it releases the lock */
+        NewValue = CurrentValue | WaiterBit;
+        if ((LONG_PTR)InterlockedCompareExchangePointer(&SRWLock->Ptr,
+                                                        (PVOID)NewValue,
+                                                        (PVOID)CurrentValue) != CurrentValue)
         {
-            NextWake = WakeChain->Next;
-
-            (void)InterlockedOr((PLONG)&WakeChain->Wake,
-                                TRUE);
-
-            WakeChain = NextWake;
-        } while (WakeChain != NULL);
-    }
-}
-
-
-static VOID
-NTAPI
-RtlpReleaseWaitBlockLockLastShared(IN OUT PRTL_SRWLOCK SRWLock,
-                                   IN PRTLP_SRWLOCK_WAITBLOCK FirstWaitBlock)
-{
-    PRTLP_SRWLOCK_WAITBLOCK Next;
-    LONG_PTR NewValue;
-
-    /* NOTE: We're currently in a shared lock in contended mode. */
-
-    /* The next acquirer to be unwaited *must* be an exclusive lock! */
-    ASSERT(FirstWaitBlock->Exclusive);
-
-    Next = FirstWaitBlock->Next;
-    if (Next != NULL)
-    {
-        /* There's more blocks chained, we need to update the pointers
-           in the next wait block and update the wait block pointer. */
-        NewValue = (LONG_PTR)Next | RTL_SRWLOCK_OWNED | RTL_SRWLOCK_CONTENDED;
+            /* The lock changed, have another look at it */
+            return FALSE;
+        }
 
-        Next->Last = FirstWaitBlock->Last;
-    }
-    else
-    {
-        /* Convert the lock to a simple exclusive lock. */
-        NewValue = RTL_SRWLOCK_OWNED;
+        CurrentValue = NewValue;
     }
 
-    (void)InterlockedExchangePointer(&SRWLock->Ptr, (PVOID)NewValue);
-
-    (void)InterlockedOr(&FirstWaitBlock->Wake,
-                        TRUE);
+    /* This returns right away if the lock changed since we looked at it */
+    RtlpWaitOnAddress(Shared ? RTL_SRWLOCK_SHARED_KEY(SRWLock) : RTL_SRWLOCK_EXCLUSIVE_KEY(SRWLock),
+                      &SRWLock->Ptr,
+                      &CurrentValue,
+                      sizeof(CurrentValue),
+                      NULL);
+    return TRUE;
 }
 
-
-static VOID
-NTAPI
-RtlpReleaseWaitBlockLock(IN OUT PRTL_SRWLOCK SRWLock)
+static
+LONG_PTR
+RtlpGetFreeSRWLockValue(IN LONG_PTR CurrentValue)
 {
-    InterlockedAndPointer(&SRWLock->Ptr,
-                          ~RTL_SRWLOCK_CONTENTION_LOCK);
+    /* If an exclusive waiter gets woken up, the shared ones keep waiting
+       for it, so they must still be marked in the lock */
+    return (CurrentValue & RTL_SRWLOCK_CONTENDED) ?
+           (CurrentValue & RTL_SRWLOCK_SHARED_WAITERS) : 0;
 }
 
-
-static PRTLP_SRWLOCK_WAITBLOCK
-NTAPI
-RtlpAcquireWaitBlockLock(IN OUT PRTL_SRWLOCK SRWLock)
+static
+VOID
+RtlpReleaseSRWLock(IN OUT PRTL_SRWLOCK SRWLock,
+                   IN LONG_PTR CurrentValue)
 {
-    LONG_PTR PrevValue;
-    PRTLP_SRWLOCK_WAITBLOCK WaitBlock;
-
-    while (1)
+    /* Exclusive waiters go first, but only one of them can get the lock */
+    if ((CurrentValue & RTL_SRWLOCK_CONTENDED) &&
+        RtlpWakeAddress(RTL_SRWLOCK_EXCLUSIVE_KEY(SRWLock), FALSE))
     {
-        PrevValue = InterlockedOrPointer(&SRWLock->Ptr,
-                                         RTL_SRWLOCK_CONTENTION_LOCK);
-
-        if (!(PrevValue & RTL_SRWLOCK_CONTENTION_LOCK))
-            break;
-
-        YieldProcessor();
+        return;
     }
 
-    if (!(PrevValue & RTL_SRWLOCK_CONTENDED) ||
-        (PrevValue & ~RTL_SRWLOCK_MASK) == 0)
+    /* Otherwise all the shared waiters can have it at once */
+    if (CurrentValue & RTL_SRWLOCK_SHARED_WAITERS)
     {
-        /* Too bad, looks like the wait block was removed in the
-           meanwhile, unlock again */
-        RtlpReleaseWaitBlockLock(SRWLock);
-        return NULL;
+        RtlpWakeAddress(RTL_SRWLOCK_SHARED_KEY(SRWLock), TRUE);
     }
+}
 
-    WaitBlock = (PRTLP_SRWLOCK_WAITBLOCK)(PrevValue & ~RTL_SRWLOCK_MASK);
 
-    return WaitBlock;
+VOID
+NTAPI
+RtlInitializeSRWLock(OUT PRTL_SRWLOCK SRWLock)
+{
+    SRWLock->Ptr = NULL;
 }
 
 
-static VOID
+VOID
 NTAPI
-RtlpAcquireSRWLockExclusiveWait(IN OUT PRTL_SRWLOCK SRWLock,
-                                IN PRTLP_SRWLOCK_WAITBLOCK WaitBlock)
+RtlAcquireSRWLockShared(IN OUT PRTL_SRWLOCK SRWLock)
 {
-    LONG_PTR CurrentValue;
+    LONG_PTR CurrentValue, NewValue;
+    ULONG SpinCount = RtlpGetSRWLockSpinCount();
 
     while (1)
     {
         CurrentValue = *(volatile LONG_PTR *)&SRWLock->Ptr;
-        if (!(CurrentValue & RTL_SRWLOCK_SHARED))
+
+        if (!(CurrentValue & RTL_SRWLOCK_OWNED))
         {
-            if (CurrentValue & RTL_SRWLOCK_CONTENDED)
-            {
-                if (WaitBlock->Wake != 0)
-                {
-                    /* Our wait block became the first one
-                       in the chain, we own the lock now! */
-                    break;
-                }
-            }
-            else
-            {
-                /* The last wait block was removed and/or we're
-                   finally a simple exclusive lock. This means we
-                   don't need to wait anymore, we acquired the lock! */
-                break;
-            }
+            /* The lock is free, we're the first shared owner */
+            NewValue = CurrentValue | RTL_SRWLOCK_SHARED_ONE | RTL_SRWLOCK_SHARED | RTL_SRWLOCK_OWNED;
         }
-
-        YieldProcessor();
-    }
-}
-
-
-static VOID
-NTAPI
-RtlpAcquireSRWLockSharedWait(IN OUT PRTL_SRWLOCK SRWLock,
-                             IN OUT PRTLP_SRWLOCK_WAITBLOCK FirstWait  OPTIONAL,
-                             IN OUT PRTLP_SRWLOCK_SHARED_WAKE WakeChain)
-{
-    if (FirstWait != NULL)
-    {
-        while (WakeChain->Wake == 0)
+        else if ((CurrentValue & (RTL_SRWLOCK_SHARED | RTL_SRWLOCK_CONTENDED)) == RTL_SRWLOCK_SHARED)
         {
-            YieldProcessor();
+            /* The lock is held shared and noone is waiting for it, join in.
+               If somebody is waiting, it's an exclusive acquirer, and we
+               don't want to starve it. */
+            NewValue = CurrentValue + RTL_SRWLOCK_SHARED_ONE;
         }
-    }
-    else
-    {
-        LONG_PTR CurrentValue;
-
-        while (1)
+        else
         {
-            CurrentValue = *(volatile LONG_PTR *)&SRWLock->Ptr;
-            if (CurrentValue & RTL_SRWLOCK_SHARED)
-            {
-                /* The RTL_SRWLOCK_OWNED bit always needs to be set when
-                   RTL_SRWLOCK_SHARED is set! */
-                ASSERT(CurrentValue & RTL_SRWLOCK_OWNED);
-
-                if (CurrentValue & RTL_SRWLOCK_CONTENDED)
-                {
-                    if (WakeChain->Wake != 0)
-                    {
-                        /* Our wait block became the first one
-                           in the chain, we own the lock now! */
-                        break;
-                    }
-                }
-                else
-                {
-                    /* The last wait block was removed and/or we're
-                       finally a simple shared lock. This means we
-                       don't need to wait anymore, we acquired the lock! */
-                    break;
-                }
-            }
+            RtlpWaitForSRWLock(SRWLock, CurrentValue, TRUE, &SpinCount);
+            continue;
+        }
 
-            YieldProcessor();
+        if ((LONG_PTR)InterlockedCompareExchangePointer(&SRWLock->Ptr,
+                                                        (PVOID)NewValue,
+                                                        (PVOID)CurrentValue) == CurrentValue)
+        {
+            /* We acquired the lock */
+            break;
         }
     }
 }
@@ -314,403 +197,114 @@ RtlpAcquireSRWLockSharedWait(IN OUT PRTL_SRWLOCK SRWLock,
 
 VOID
 NTAPI
-RtlInitializeSRWLock(OUT PRTL_SRWLOCK SRWLock)
-{
-    SRWLock->Ptr = NULL;
-}
-
-
-VOID
-NTAPI
-RtlAcquireSRWLockShared(IN OUT PRTL_SRWLOCK SRWLock)
+RtlReleaseSRWLockShared(IN OUT PRTL_SRWLOCK SRWLock)
 {
-    __ALIGNED(16) RTLP_SRWLOCK_WAITBLOCK StackWaitBlock;
-    RTLP_SRWLOCK_SHARED_WAKE SharedWake;
     LONG_PTR CurrentValue, NewValue;
-    PRTLP_SRWLOCK_WAITBLOCK First, Shared, FirstWait;
 
     while (1)
     {
         CurrentValue = *(volatile LONG_PTR *)&SRWLock->Ptr;
 
-        if (CurrentValue & RTL_SRWLOCK_SHARED)
+        if (!(CurrentValue & RTL_SRWLOCK_SHARED))
         {
-            /* NOTE: It is possible that the RTL_SRWLOCK_OWNED bit is set! */
-
-            if (CurrentValue & RTL_SRWLOCK_CONTENDED)
-            {
-                /* There's other waiters already, lock the wait blocks and
-                   increment the shared count */
-                First = RtlpAcquireWaitBlockLock(SRWLock);
-                if (First != NULL)
-                {
-                    FirstWait = NULL;
-
-                    if (First->Exclusive)
-                    {
-                        /* We need to setup a new wait block! Although
-                           we're currently in a shared lock and we're acquiring
-                           a shared lock, there are exclusive locks queued. We need
-                           to wait until those are released. */
-                        Shared = First->Last;
-
-                        if (Shared->Exclusive)
-                        {
-                            StackWaitBlock.Exclusive = FALSE;
-                            StackWaitBlock.SharedCount = 1;
-                            StackWaitBlock.Next = NULL;
-                            StackWaitBlock.Last = &StackWaitBlock;
-                            StackWaitBlock.SharedWakeChain = &SharedWake;
-
-                            Shared->Next = &StackWaitBlock;
-                            First->Last = &StackWaitBlock;
-
-                            Shared = &StackWaitBlock;
-                            FirstWait = &StackWaitBlock;
-                        }
-                        else
-                        {
-                            Shared->LastSharedWake->Next = &SharedWake;
-                            Shared->SharedCount++;
-                        }
-                    }
-                    else
-                    {
-                        Shared = First;
-                        Shared->LastSharedWake->Next = &SharedWake;
-                        Shared->SharedCount++;
-                    }
-
-                    SharedWake.Next = NULL;
-                    SharedWake.Wake = 0;
-
-                    Shared->LastSharedWake = &SharedWake;
-
-                    RtlpReleaseWaitBlockLock(SRWLock);
-
-                    RtlpAcquireSRWLockSharedWait(SRWLock,
-                                                 FirstWait,
-                                                 &SharedWake);
-
-                    /* Successfully incremented the shared count, we acquired the lock */
-                    break;
-                }
-            }
-            else
-            {
-                /* This is a fastest path, just increment the number of
-                   current shared locks */
-
-                /* Since the RTL_SRWLOCK_SHARED bit is set, the RTL_SRWLOCK_OWNED bit also has
-                   to be set! */
-
-                ASSERT(CurrentValue & RTL_SRWLOCK_OWNED);
-
-                NewValue = (CurrentValue >> RTL_SRWLOCK_BITS) + 1;
-                NewValue = (NewValue << RTL_SRWLOCK_BITS) | (CurrentValue & RTL_SRWLOCK_MASK);
+            /* The RTL_SRWLOCK_SHARED bit has to be present now,
+               even in the contended case! */
+            RtlRaiseStatus(STATUS_RESOURCE_NOT_OWNED);
+        }
 
-                if ((LONG_PTR)InterlockedCompareExchangePointer(&SRWLock->Ptr,
-                                                                (PVOID)NewValue,
-                                                                (PVOID)CurrentValue) == CurrentValue)
-                {
-                    /* Successfully incremented the shared count, we acquired the lock */
-                    break;
-                }
-            }
+        if ((CurrentValue >> RTL_SRWLOCK_BITS) > 1)
+        {
+            /* Other shared owners remain, so nobody can be woken up yet */
+            NewValue = CurrentValue - RTL_SRWLOCK_SHARED_ONE;
         }
         else
         {
-            if (CurrentValue & RTL_SRWLOCK_OWNED)
-            {
-                /* The resource is currently acquired exclusively */
-                if (CurrentValue & RTL_SRWLOCK_CONTENDED)
-                {
-                    SharedWake.Next = NULL;
-                    SharedWake.Wake = 0;
-
-                    /* There's other waiters already, lock the wait blocks and
-                       increment the shared count. If the last block in the chain
-                       is an exclusive lock, add another block. */
-
-                    StackWaitBlock.Exclusive = FALSE;
-                    StackWaitBlock.SharedCount = 0;
-                    StackWaitBlock.Next = NULL;
-                    StackWaitBlock.Last = &StackWaitBlock;
-                    StackWaitBlock.SharedWakeChain = &SharedWake;
-
-                    First = RtlpAcquireWaitBlockLock(SRWLock);
-                    if (First != NULL)
-                    {
-                        Shared = First->Last;
-                        if (Shared->Exclusive)
-                        {
-                            Shared->Next = &StackWaitBlock;
-                            First->Last = &StackWaitBlock;
-
-                            Shared = &StackWaitBlock;
-                            FirstWait = &StackWaitBlock;
-                        }
-                        else
-                        {
-                            FirstWait = NULL;
-                            Shared->LastSharedWake->Next = &SharedWake;
-                        }
-
-                        Shared->SharedCount++;
-                        Shared->LastSharedWake = &SharedWake;
-
-                        RtlpReleaseWaitBlockLock(SRWLock);
-
-                        RtlpAcquireSRWLockSharedWait(SRWLock,
-                                                     FirstWait,
-                                                     &SharedWake);
-
-                        /* Successfully incremented the shared count, we acquired the lock */
-                        break;
-                    }
-                }
-                else
-                {
-                    SharedWake.Next = NULL;
-                    SharedWake.Wake = 0;
-
-                    /* We need to setup the first wait block. Currently an exclusive lock is
-                       held, change the lock to contended mode. */
-                    StackWaitBlock.Exclusive = FALSE;
-                    StackWaitBlock.SharedCount = 1;
-                    StackWaitBlock.Next = NULL;
-                    StackWaitBlock.Last = &StackWaitBlock;
-                    StackWaitBlock.SharedWakeChain = &SharedWake;
-                    StackWaitBlock.LastSharedWake = &SharedWake;
-
-                    NewValue = (ULONG_PTR)&StackWaitBlock | RTL_SRWLOCK_OWNED | RTL_SRWLOCK_CONTENDED;
-                    if ((LONG_PTR)InterlockedCompareExchangePointer(&SRWLock->Ptr,
-                                                                    (PVOID)NewValue,
-                                                                    (PVOID)CurrentValue) == CurrentValue)
-                    {
-                        RtlpAcquireSRWLockSharedWait(SRWLock,
-                                                     &StackWaitBlock,
-                                                     &SharedWake);
-
-                        /* Successfully set the shared count, we acquired the lock */
-                        break;
-                    }
-                }
-            }
-            else
-            {
-                /* This is a fast path, we can simply try to set the shared count to 1 */
-                NewValue = (1 << RTL_SRWLOCK_BITS) | RTL_SRWLOCK_SHARED | RTL_SRWLOCK_OWNED;
-
-                /* The RTL_SRWLOCK_CONTENDED bit should never be set if neither the
-                   RTL_SRWLOCK_SHARED nor the RTL_SRWLOCK_OWNED bit is set */
-                ASSERT(!(CurrentValue & RTL_SRWLOCK_CONTENDED));
-
-                if ((LONG_PTR)InterlockedCompareExchangePointer(&SRWLock->Ptr,
-                                                                (PVOID)NewValue,
-                                                                (PVOID)CurrentValue) == CurrentValue)
-                {
-                    /* Successfully set the shared count, we acquired the lock */
-                    break;
-                }
-            }
+            /* We're the last shared owner, free the lock */
+            NewValue = RtlpGetFreeSRWLockValue(CurrentValue);
         }
 
-        YieldProcessor();
+        if ((LONG_PTR)InterlockedCompareExchangePointer(&SRWLock->Ptr,
+                                                        (PVOID)NewValue,
+                                                        (PVOID)CurrentValue) == CurrentValue)
+        {
+            if (!(NewValue & RTL_SRWLOCK_OWNED)) RtlpReleaseSRWLock(SRWLock, CurrentValue);
+
+            /* We released the lock */
+            break;
+        }
     }
 }
 
 
 VOID
 NTAPI
-RtlReleaseSRWLockShared(IN OUT PRTL_SRWLOCK SRWLock)
+RtlAcquireSRWLockExclusive(IN OUT PRTL_SRWLOCK SRWLock)
 {
     LONG_PTR CurrentValue, NewValue;
-    PRTLP_SRWLOCK_WAITBLOCK WaitBlock;
-    BOOLEAN LastShared;
+    ULONG SpinCount = RtlpGetSRWLockSpinCount();
+    BOOLEAN Waited = FALSE;
 
     while (1)
     {
         CurrentValue = *(volatile LONG_PTR *)&SRWLock->Ptr;
 
-        if (CurrentValue & RTL_SRWLOCK_SHARED)
+        if (!(CurrentValue & RTL_SRWLOCK_OWNED))
         {
-            if (CurrentValue & RTL_SRWLOCK_CONTENDED)
-            {
-                /* There's a wait block, we need to wake a pending
-                   exclusive acquirer if this is the last shared release */
-                WaitBlock = RtlpAcquireWaitBlockLock(SRWLock);
-                if (WaitBlock != NULL)
-                {
-                    LastShared = (--WaitBlock->SharedCount == 0);
-
-                    if (LastShared)
-                        RtlpReleaseWaitBlockLockLastShared(SRWLock,
-                                                           WaitBlock);
-                    else
-                        RtlpReleaseWaitBlockLock(SRWLock);
-
-                    /* We released the lock */
-                    break;
-                }
-            }
-            else
+            /* The lock is free, grab it. If we had to wait for it, other
+               exclusive waiters may still be sleeping, and the release
+               only woke us, so keep them marked in the lock. */
+            NewValue = CurrentValue | RTL_SRWLOCK_OWNED;
+            if (Waited) NewValue |= RTL_SRWLOCK_CONTENDED;
+
+            if ((LONG_PTR)InterlockedCompareExchangePointer(&SRWLock->Ptr,
+                                                            (PVOID)NewValue,
+                                                            (PVOID)CurrentValue) == CurrentValue)
             {
-                /* This is a fast path, we can simply decrement the shared
-                   count and store the pointer */
-                NewValue = CurrentValue >> RTL_SRWLOCK_BITS;
-
-                if (--NewValue != 0)
-                {
-                    NewValue = (NewValue << RTL_SRWLOCK_BITS) | RTL_SRWLOCK_SHARED | RTL_SRWLOCK_OWNED;
-                }
-
-                if ((LONG_PTR)InterlockedCompareExchangePointer(&SRWLock->Ptr,
-                                                                (PVOID)NewValue,
-                                                                (PVOID)CurrentValue) == CurrentValue)
-                {
-                    /* Successfully released the lock */
-                    break;
-                }
+                /* We acquired the lock */
+                break;
             }
         }
-        else
+        else if (RtlpWaitForSRWLock(SRWLock, CurrentValue, FALSE, &SpinCount))
         {
-            /* The RTL_SRWLOCK_SHARED bit has to be present now,
-               even in the contended case! */
-            RtlRaiseStatus(STATUS_RESOURCE_NOT_OWNED);
+            Waited = TRUE;
         }
-
-        YieldProcessor();
     }
 }
 
 
 VOID
 NTAPI
-RtlAcquireSRWLockExclusive(IN OUT PRTL_SRWLOCK SRWLock)
+RtlReleaseSRWLockExclusive(IN OUT PRTL_SRWLOCK SRWLock)
 {
-    __ALIGNED(16) RTLP_SRWLOCK_WAITBLOCK StackWaitBlock;
-    PRTLP_SRWLOCK_WAITBLOCK First, Last;
+    LONG_PTR CurrentValue;
 
-    if (InterlockedBitTestAndSetPointer(&SRWLock->Ptr,
-                                        RTL_SRWLOCK_OWNED_BIT))
+    while (1)
     {
-        LONG_PTR CurrentValue, NewValue;
+        CurrentValue = *(volatile LONG_PTR *)&SRWLock->Ptr;
 
-        while (1)
+        /* The RTL_SRWLOCK_SHARED bit must not be present now,
+           not even in the contended case! */
+        if ((CurrentValue & (RTL_SRWLOCK_OWNED | RTL_SRWLOCK_SHARED)) != RTL_SRWLOCK_OWNED)
         {
-            CurrentValue = *(volatile LONG_PTR *)&SRWLock->Ptr;
-
-            if (CurrentValue & RTL_SRWLOCK_SHARED)
-            {
-                /* A shared lock is being held right now. We need to add a wait block! */
-
-                if (CurrentValue & RTL_SRWLOCK_CONTENDED)
-                {
-                    goto AddWaitBlock;
-                }
-                else
-                {
-                    /* There are no wait blocks so far, we need to add ourselves as the first
-                       wait block. We need to keep the shared count! */
-                    StackWaitBlock.Exclusive = TRUE;
-                    StackWaitBlock.SharedCount = (LONG)(CurrentValue >> RTL_SRWLOCK_BITS);
-                    StackWaitBlock.Next = NULL;
-                    StackWaitBlock.Last = &StackWaitBlock;
-                    StackWaitBlock.Wake = 0;
-
-                    NewValue = (ULONG_PTR)&StackWaitBlock | RTL_SRWLOCK_SHARED | RTL_SRWLOCK_CONTENDED | RTL_SRWLOCK_OWNED;
-
-                    if ((LONG_PTR)InterlockedCompareExchangePointer(&SRWLock->Ptr,
-                                                                    (PVOID)NewValue,
-                                                                    (PVOID)CurrentValue) == CurrentValue)
-                    {
-                        RtlpAcquireSRWLockExclusiveWait(SRWLock,
-                                                        &StackWaitBlock);
-
-                        /* Successfully acquired the exclusive lock */
-                        break;
-                    }
-                }
-            }
-            else
-            {
-                if (CurrentValue & RTL_SRWLOCK_OWNED)
-                {
-                    /* An exclusive lock is being held right now. We need to add a wait block! */
-
-                    if (CurrentValue & RTL_SRWLOCK_CONTENDED)
-                    {
-AddWaitBlock:
-                        StackWaitBlock.Exclusive = TRUE;
-                        StackWaitBlock.SharedCount = 0;
-                        StackWaitBlock.Next = NULL;
-                        StackWaitBlock.Last = &StackWaitBlock;
-                        StackWaitBlock.Wake = 0;
-
-                        First = RtlpAcquireWaitBlockLock(SRWLock);
-                        if (First != NULL)
-                        {
-                            Last = First->Last;
-                            Last->Next = &StackWaitBlock;
-                            First->Last = &StackWaitBlock;
-
-                            RtlpReleaseWaitBlockLock(SRWLock);
-
-                            RtlpAcquireSRWLockExclusiveWait(SRWLock,
-                                                            &StackWaitBlock);
-
-                            /* Successfully acquired the exclusive lock */
-                            break;
-                        }
-                    }
-                    else
-                    {
-                        /* There are no wait blocks so far, we need to add ourselves as the first
-                           wait block. We need to keep the shared count! */
-                        StackWaitBlock.Exclusive = TRUE;
-                        StackWaitBlock.SharedCount = 0;
-                        StackWaitBlock.Next = NULL;
-                        StackWaitBlock.Last = &StackWaitBlock;
-                        StackWaitBlock.Wake = 0;
-
-                        NewValue = (ULONG_PTR)&StackWaitBlock | RTL_SRWLOCK_OWNED | RTL_SRWLOCK_CONTENDED;
-                        if ((LONG_PTR)InterlockedCompareExchangePointer(&SRWLock->Ptr,
-                                                                        (PVOID)NewValue,
-                                                                        (PVOID)CurrentValue) == CurrentValue)
-                        {
-                            RtlpAcquireSRWLockExclusiveWait(SRWLock,
-                                                            &StackWaitBlock);
-
-                            /* Successfully acquired the exclusive lock */
-                            break;
-                        }
-                    }
-                }
-                else
-                {
-                    if (!InterlockedBitTestAndSetPointer(&SRWLock->Ptr,
-                                                         RTL_SRWLOCK_OWNED_BIT))
-                    {
-                        /* We managed to get hold of a simple exclusive lock! */
-                        break;
-                    }
-                }
-            }
+            RtlRaiseStatus(STATUS_RESOURCE_NOT_OWNED);
+        }
 
-            YieldProcessor();
+        /* Waiters may still set their bits, so this needs a compare */
+        if ((LONG_PTR)InterlockedCompareExchangePointer(&SRWLock->Ptr,
+                                                        (PVOID)RtlpGetFreeSRWLockValue(CurrentValue),
+                                                        (PVOID)CurrentValue) == CurrentValue)
+        {
+            RtlpReleaseSRWLock(SRWLock, CurrentValue);
+            break;
         }
     }
 }
 
-
-VOID
+BOOLEAN
 NTAPI
-RtlReleaseSRWLockExclusive(IN OUT PRTL_SRWLOCK SRWLock)
+RtlTryAcquireSRWLockShared(PRTL_SRWLOCK SRWLock)
 {
     LONG_PTR CurrentValue, NewValue;
-    PRTLP_SRWLOCK_WAITBLOCK WaitBlock;
 
     while (1)
     {
@@ -718,78 +312,49 @@ RtlReleaseSRWLockExclusive(IN OUT PRTL_SRWLOCK SRWLock)
 
         if (!(CurrentValue & RTL_SRWLOCK_OWNED))
         {
-            RtlRaiseStatus(STATUS_RESOURCE_NOT_OWNED);
+            NewValue = CurrentValue | RTL_SRWLOCK_SHARED_ONE | RTL_SRWLOCK_SHARED | RTL_SRWLOCK_OWNED;
         }
-
-        if (!(CurrentValue & RTL_SRWLOCK_SHARED))
+        else if ((CurrentValue & (RTL_SRWLOCK_OWNED | RTL_SRWLOCK_CONTENDED | RTL_SRWLOCK_SHARED)) ==
+                 (RTL_SRWLOCK_SHARED | RTL_SRWLOCK_OWNED))
         {
-            if (CurrentValue & RTL_SRWLOCK_CONTENDED)
-            {
-                /* There's a wait block, we need to wake the next pending
-                   acquirer (exclusive or shared) */
-                WaitBlock = RtlpAcquireWaitBlockLock(SRWLock);
-                if (WaitBlock != NULL)
-                {
-                    RtlpReleaseWaitBlockLockExclusive(SRWLock,
-                                                      WaitBlock);
-
-                    /* We released the lock */
-                    break;
-                }
-            }
-            else
-            {
-                /* This is a fast path, we can simply clear the RTL_SRWLOCK_OWNED
-                   bit. All other bits should be 0 now because this is a simple
-                   exclusive lock and no one is waiting. */
-
-                ASSERT(!(CurrentValue & ~RTL_SRWLOCK_OWNED));
-
-                NewValue = 0;
-                if ((LONG_PTR)InterlockedCompareExchangePointer(&SRWLock->Ptr,
-                                                                (PVOID)NewValue,
-                                                                (PVOID)CurrentValue) == CurrentValue)
-                {
-                    /* We released the lock */
-                    break;
-                }
-            }
+            /* Only increment shared count if there is no waiter */
+            NewValue = CurrentValue + RTL_SRWLOCK_SHARED_ONE;
         }
         else
         {
-            /* The RTL_SRWLOCK_SHARED bit must not be present now,
-               not even in the contended case! */
-            RtlRaiseStatus(STATUS_RESOURCE_NOT_OWNED);
+            return FALSE;
         }
 
-        YieldProcessor();
+        if ((LONG_PTR)InterlockedCompareExchangePointer(&SRWLock->Ptr,
+                                                        (PVOID)NewValue,
+                                                        (PVOID)CurrentValue) == CurrentValue)
+        {
+            return TRUE;
+        }
     }
 }
 
 BOOLEAN
 NTAPI
-RtlTryAcquireSRWLockShared(PRTL_SRWLOCK SRWLock)
+RtlTryAcquireSRWLockExclusive(PRTL_SRWLOCK SRWLock)
 {
+    LONG_PTR CurrentValue;
 
-    LONG_PTR CompareValue, NewValue, GotValue;
-
-    do
+    while (1)
     {
-        CompareValue = *(volatile LONG_PTR *)&SRWLock->Ptr;
-        NewValue = ((CompareValue >> RTL_SRWLOCK_BITS) + 1) | RTL_SRWLOCK_SHARED | RTL_SRWLOCK_OWNED;
-
-        /* Only increment shared count if there is no waiter */
-        CompareValue &= ~RTL_SRWLOCK_MASK | RTL_SRWLOCK_SHARED | RTL_SRWLOCK_OWNED;
-    } while (
-        ((GotValue = (LONG_PTR)InterlockedCompareExchangePointer(&SRWLock->Ptr, (LONG_PTR*)NewValue, (LONG_PTR*)CompareValue)) != CompareValue)
-        && (((GotValue & RTL_SRWLOCK_MASK) == (RTL_SRWLOCK_SHARED | RTL_SRWLOCK_OWNED)) || (GotValue == 0)));
+        CurrentValue = *(volatile LONG_PTR *)&SRWLock->Ptr;
 
-    return ((GotValue & RTL_SRWLOCK_MASK) == (RTL_SRWLOCK_SHARED | RTL_SRWLOCK_OWNED)) || (GotValue == 0);
-}
+        /* A free lock may still have shared waiters marked */
+        if (CurrentValue & RTL_SRWLOCK_OWNED)
+        {
+            return FALSE;
+        }
 
-BOOLEAN
-NTAPI
-RtlTryAcquireSRWLockExclusive(PRTL_SRWLOCK SRWLock)
-{
-    return InterlockedCompareExchangePointer(&SRWLock->Ptr, (ULONG_PTR*)RTL_SRWLOCK_OWNED, 0) == 0;
+        if ((LONG_PTR)InterlockedCompareExchangePointer(&SRWLock->Ptr,
+                                                        (PVOID)(CurrentValue | RTL_SRWLOCK_OWNED),
+                                                        (PVOID)CurrentValue) == CurrentValue)
+        {
+            return TRUE;
+        }
+    }
 }
@@ -0,0 +1,1983 @@
+/*
+ * COPYRIGHT:         See COPYING in the top level directory
+ * PROJECT:           ReactOS system libraries
+ * PURPOSE:           Thread Pool (Tp*) Routines
+ * FILE:              lib/rtl/threadpool.c
+ * PROGRAMMER:
+ *
+ * NOTES:             Every pool owns its worker threads and its callback
+ *                    queues. The timers of all pools are kept on a single
+ *                    sorted list serviced by one thread waiting on one NT
+ *                    timer, waits are batched on waiter threads of up to
+ *                    MAXIMUM_WAIT_OBJECTS - 1 handles each, and I/O
+ *                    completions are picked up from one completion port and
+ *                    queued to the pool of their I/O object like any other
+ *                    callback.
+ */
+
+/* INCLUDES *****************************************************************/
+
+#include <rtl_vista.h>
+
+#define NDEBUG
+#include <debug.h>
+
+VOID
+NTAPI
+RtlInitializeConditionVariable(OUT PRTL_CONDITION_VARIABLE ConditionVariable);
+
+VOID
+NTAPI
+RtlWakeConditionVariable(IN OUT PRTL_CONDITION_VARIABLE ConditionVariable);
+
+VOID
+NTAPI
+RtlWakeAllConditionVariable(IN OUT PRTL_CONDITION_VARIABLE ConditionVariable);
+
+NTSTATUS
+NTAPI
+RtlSleepConditionVariableCS(IN OUT PRTL_CONDITION_VARIABLE ConditionVariable,
+                            IN OUT PRTL_CRITICAL_SECTION CriticalSection,
+                            IN const LARGE_INTEGER * TimeOut OPTIONAL);
+
+/* INTERNAL TYPES ************************************************************/
+
+#define TPP_DEFAULT_MAX_THREADS         500
+#define TPP_MAX_WAITS_PER_BUCKET        (MAXIMUM_WAIT_OBJECTS - 1)
+
+/* Idle workers and waiter threads go away after 10 seconds */
+#define TPP_IDLE_TIMEOUT                (-10 * 1000 * 10000LL)
+
+/* How often a pool whose workers are all busy is checked for progress */
+#define TPP_STARVATION_INTERVAL         (100 * 10000LL)
+
+#define TPP_NO_ACTIVATION_CONTEXT       ((PVOID)(LONG_PTR)-1)
+
+typedef enum _TPP_OBJECT_TYPE
+{
+    TppSimpleObject,
+    TppWorkObject,
+    TppTimerObject,
+    TppWaitObject,
+    TppIoObject
+} TPP_OBJECT_TYPE;
+
+/* The Windows 7 environment adds the callback priority to the Vista one */
+typedef struct _TPP_CALLBACK_ENVIRON_V3
+{
+    TP_CALLBACK_ENVIRON Environ;
+    TP_CALLBACK_PRIORITY CallbackPriority;
+    ULONG Size;
+} TPP_CALLBACK_ENVIRON_V3, *PTPP_CALLBACK_ENVIRON_V3;
+
+typedef struct _TPP_TIMER_ENTRY
+{
+    LIST_ENTRY ListEntry;
+    ULONGLONG DueTime;
+    ULONG Period;
+    ULONG WindowLength;
+    BOOLEAN Armed;
+    BOOLEAN Monitor;
+} TPP_TIMER_ENTRY, *PTPP_TIMER_ENTRY;
+
+typedef struct _TPP_WAIT_BUCKET
+{
+    LIST_ENTRY BucketEntry;
+    LIST_ENTRY WaitList;
+    ULONG WaitCount;
+    HANDLE UpdateEvent;
+} TPP_WAIT_BUCKET, *PTPP_WAIT_BUCKET;
+
+typedef struct _TPP_IO_COMPLETION
+{
+    LIST_ENTRY ListEntry;
+    PVOID ApcContext;
+    IO_STATUS_BLOCK IoStatusBlock;
+} TPP_IO_COMPLETION, *PTPP_IO_COMPLETION;
+
+typedef struct _TP_POOL
+{
+    LONG ReferenceCount;
+    BOOLEAN Shutdown;
+    RTL_CRITICAL_SECTION Lock;
+    LIST_ENTRY Queue[TP_CALLBACK_PRIORITY_COUNT];
+    RTL_CONDITION_VARIABLE WorkAvailable;
+    RTL_CONDITION_VARIABLE CallbacksDone;
+    LONG MaxThreads;
+    LONG MinThreads;
+    LONG Threads;
+    LONG IdleThreads;
+    LONG PendingWakes;
+    LONG LongCallbacks;
+    LONG QueuedCallbacks;
+    ULONG CallbacksStarted;
+    ULONG MonitorSnapshot;
+    TPP_TIMER_ENTRY Monitor;
+} TP_POOL;
+
+typedef struct _TP_CLEANUP_GROUP
+{
+    LONG ReferenceCount;
+    RTL_CRITICAL_SECTION Lock;
+    LIST_ENTRY MemberList;
+} TP_CLEANUP_GROUP;
+
+typedef struct _TPP_OBJECT
+{
+    /* Kernel32 keeps the Win32 I/O callback here, it must stay first */
+    PVOID Win32Callback;
+    LONG ReferenceCount;
+    LONG Released;
+    TPP_OBJECT_TYPE Type;
+    PTP_POOL Pool;
+    PTP_CLEANUP_GROUP CleanupGroup;
+    PTP_CLEANUP_GROUP_CANCEL_CALLBACK CleanupGroupCancelCallback;
+    PTP_SIMPLE_CALLBACK FinalizationCallback;
+    PVOID RaceDll;
+    PVOID ActivationContext;
+    PVOID Callback;
+    PVOID Context;
+    TP_CALLBACK_PRIORITY Priority;
+    BOOLEAN LongFunction;
+
+    /* Protected by the lock of the cleanup group */
+    BOOLEAN GroupMember;
+    LIST_ENTRY GroupEntry;
+
+    /* Protected by the lock of the pool */
+    LIST_ENTRY QueueEntry;
+    LONG PendingCallbacks;
+    LONG RunningCallbacks;
+
+    union
+    {
+        struct
+        {
+            /* Protected by the timer lock */
+            TPP_TIMER_ENTRY Entry;
+            BOOLEAN Set;
+        } Timer;
+        struct
+        {
+            /* Protected by the wait lock */
+            LIST_ENTRY WaitEntry;
+            PTPP_WAIT_BUCKET Bucket;
+            HANDLE Handle;
+            ULONGLONG Timeout;
+            ULONG Sequence;
+
+            /* Protected by the lock of the pool */
+            LONG Signaled;
+            LONG TimedOut;
+        } Wait;
+        struct
+        {
+            /* Protected by the lock of the pool */
+            LIST_ENTRY CompletionList;
+            LONG PendingIo;
+        } Io;
+    } u;
+} TPP_OBJECT, *PTPP_OBJECT;
+
+typedef struct _TP_CALLBACK_INSTANCE
+{
+    PTPP_OBJECT Object;
+    BOOLEAN Associated;
+    BOOLEAN MayRunLong;
+    TP_WAIT_RESULT WaitResult;
+    PTPP_IO_COMPLETION Completion;
+    PRTL_CRITICAL_SECTION CriticalSection;
+    HANDLE Mutex;
+    HANDLE Semaphore;
+    LONG SemaphoreReleaseCount;
+    HANDLE Event;
+    PVOID Dll;
+} TP_CALLBACK_INSTANCE;
+
+/* GLOBALS *******************************************************************/
+
+static PTP_POOL TppDefaultPool;
+
+static RTL_CRITICAL_SECTION TppTimerLock;
+static LIST_ENTRY TppTimerList;
+static HANDLE TppTimerHandle;
+static ULONGLONG TppTimerDeadline;
+
+static RTL_CRITICAL_SECTION TppWaitLock;
+static LIST_ENTRY TppWaitBucketList;
+static ULONG TppWaitSequence;
+
+static RTL_CRITICAL_SECTION TppIoLock;
+static HANDLE TppIoCompletionPort;
+
+/* PRIVATE FUNCTIONS *********************************************************/
+
+VOID
+NTAPI
+RtlpTpInitialize(VOID)
+{
+    RtlInitializeCriticalSection(&TppTimerLock);
+    InitializeListHead(&TppTimerList);
+    TppTimerDeadline = MAXULONGLONG;
+
+    RtlInitializeCriticalSection(&TppWaitLock);
+    InitializeListHead(&TppWaitBucketList);
+
+    RtlInitializeCriticalSection(&TppIoLock);
+}
+
+static
+NTSTATUS
+TppCreateThread(IN PTHREAD_START_ROUTINE StartRoutine,
+                IN PVOID Parameter)
+{
+    HANDLE ThreadHandle;
+    NTSTATUS Status;
+
+    Status = RtlCreateUserThread(NtCurrentProcess(),
+                                 NULL,
+                                 FALSE,
+                                 0,
+                                 0,
+                                 0,
+                                 StartRoutine,
+                                 Parameter,
+                                 &ThreadHandle,
+                                 NULL);
+    if (NT_SUCCESS(Status)) NtClose(ThreadHandle);
+    return Status;
+}
+
+static
+ULONGLONG
+TppGetAbsoluteTime(IN PLARGE_INTEGER Time)
+{
+    LARGE_INTEGER Now;
+
+    /* Positive times are absolute, negative ones relative to now */
+    if (Time->QuadPart >= 0) return Time->QuadPart;
+    NtQuerySystemTime(&Now);
+    return Now.QuadPart - Time->QuadPart;
+}
+
+static
+VOID
+TppReferencePool(IN PTP_POOL Pool)
+{
+    InterlockedIncrement(&Pool->ReferenceCount);
+}
+
+static
+VOID
+TppDereferencePool(IN PTP_POOL Pool)
+{
+    if (InterlockedDecrement(&Pool->ReferenceCount)) return;
+
+    /* The last worker is gone and no object uses the pool anymore */
+    ASSERT(Pool->Threads == 0);
+    ASSERT(Pool->QueuedCallbacks == 0);
+    ASSERT(Pool->Monitor.Armed == FALSE);
+    RtlDeleteCriticalSection(&Pool->Lock);
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Pool);
+}
+
+static
+ULONG
+NTAPI
+TppTimerThread(IN PVOID Parameter);
+
+static
+NTSTATUS
+TppEnsureTimerThreadLocked(VOID)
+{
+    NTSTATUS Status;
+
+    if (TppTimerHandle) return STATUS_SUCCESS;
+
+    /* All the timers of the process are multiplexed onto this one */
+    Status = NtCreateTimer(&TppTimerHandle,
+                           TIMER_ALL_ACCESS,
+                           NULL,
+                           SynchronizationTimer);
+    if (!NT_SUCCESS(Status)) return Status;
+
+    Status = TppCreateThread((PTHREAD_START_ROUTINE)TppTimerThread, NULL);
+    if (!NT_SUCCESS(Status))
+    {
+        NtClose(TppTimerHandle);
+        TppTimerHandle = NULL;
+    }
+    return Status;
+}
+
+static
+VOID
+TppUpdateTimerLocked(VOID)
+{
+    PLIST_ENTRY NextEntry;
+    PTPP_TIMER_ENTRY Entry;
+    ULONGLONG Deadline = MAXULONGLONG;
+    LARGE_INTEGER DueTime;
+
+    /*
+     * Fire at the earliest point where some timer would be late, so that
+     * timers with a tolerance window get coalesced with earlier ones.
+     */
+    for (NextEntry = TppTimerList.Flink;
+         NextEntry != &TppTimerList;
+         NextEntry = NextEntry->Flink)
+    {
+        Entry = CONTAINING_RECORD(NextEntry, TPP_TIMER_ENTRY, ListEntry);
+        if (Entry->DueTime >= Deadline) break;
+        if (Entry->DueTime + Entry->WindowLength * 10000ULL < Deadline)
+        {
+            Deadline = Entry->DueTime + Entry->WindowLength * 10000ULL;
+        }
+    }
+
+    /* A stale expiration only causes a spurious pass of the timer thread */
+    if ((Deadline == MAXULONGLONG) || (Deadline == TppTimerDeadline)) return;
+    TppTimerDeadline = Deadline;
+    DueTime.QuadPart = Deadline;
+    NtSetTimer(TppTimerHandle, &DueTime, NULL, NULL, FALSE, 0, NULL);
+}
+
+static
+VOID
+TppInsertTimerLocked(IN PTPP_TIMER_ENTRY Entry)
+{
+    PLIST_ENTRY NextEntry;
+    PTPP_TIMER_ENTRY Current;
+
+    /* Keep the list sorted by due time */
+    for (NextEntry = TppTimerList.Flink;
+         NextEntry != &TppTimerList;
+         NextEntry = NextEntry->Flink)
+    {
+        Current = CONTAINING_RECORD(NextEntry, TPP_TIMER_ENTRY, ListEntry);
+        if (Current->DueTime > Entry->DueTime) break;
+    }
+    InsertTailList(NextEntry, &Entry->ListEntry);
+    Entry->Armed = TRUE;
+}
+
+static
+VOID
+TppRemoveTimerLocked(IN PTPP_TIMER_ENTRY Entry)
+{
+    if (!Entry->Armed) return;
+    RemoveEntryList(&Entry->ListEntry);
+    Entry->Armed = FALSE;
+}
+
+static
+VOID
+TppArmMonitorLocked(IN PTP_POOL Pool)
+{
+    LARGE_INTEGER Now;
+
+    if (Pool->Monitor.Armed) return;
+
+    /* The armed monitor keeps the pool alive */
+    TppReferencePool(Pool);
+    Pool->MonitorSnapshot = *(volatile ULONG *)&Pool->CallbacksStarted;
+    NtQuerySystemTime(&Now);
+    Pool->Monitor.DueTime = Now.QuadPart + TPP_STARVATION_INTERVAL;
+    TppInsertTimerLocked(&Pool->Monitor);
+    TppUpdateTimerLocked();
+}
+
+static
+VOID
+TppArmMonitor(IN PTP_POOL Pool)
+{
+    RtlEnterCriticalSection(&TppTimerLock);
+    TppArmMonitorLocked(Pool);
+    RtlLeaveCriticalSection(&TppTimerLock);
+}
+
+static
+ULONG
+NTAPI
+TppWorkerThread(IN PVOID Parameter);
+
+static
+BOOLEAN
+TppCreateWorkerLocked(IN PTP_POOL Pool)
+{
+    NTSTATUS Status;
+
+    /* The worker owns a reference on the pool until it exits */
+    Pool->Threads++;
+    TppReferencePool(Pool);
+    Status = TppCreateThread((PTHREAD_START_ROUTINE)TppWorkerThread, Pool);
+    if (NT_SUCCESS(Status)) return TRUE;
+
+    DPRINT1("Failed to create a thread pool worker: 0x%lx\n", Status);
+    Pool->Threads--;
+    InterlockedDecrement(&Pool->ReferenceCount);
+    return FALSE;
+}
+
+static
+BOOLEAN
+TppShouldCreateWorkerLocked(IN PTP_POOL Pool)
+{
+    if (Pool->Threads >= Pool->MaxThreads) return FALSE;
+    if (Pool->Threads < Pool->MinThreads) return TRUE;
+
+    /*
+     * Keep one worker per processor busy, not counting the ones that have
+     * declared their callback as long running. Anything beyond that is
+     * only added by the starvation monitor if the pool stops making
+     * progress, so that a burst of short items doesn't spawn a thread each.
+     */
+    return (Pool->Threads - Pool->LongCallbacks) < (LONG)NtCurrentPeb()->NumberOfProcessors;
+}
+
+/* Returns TRUE when the starvation monitor of the pool has to be armed */
+static
+BOOLEAN
+TppQueueCallbackLocked(IN PTPP_OBJECT Object)
+{
+    PTP_POOL Pool = Object->Pool;
+
+    /* Every pending callback holds a reference on its object */
+    InterlockedIncrement(&Object->ReferenceCount);
+    if (!Object->PendingCallbacks++)
+    {
+        InsertTailList(&Pool->Queue[Object->Priority], &Object->QueueEntry);
+    }
+    Pool->QueuedCallbacks++;
+
+    /* Hand it to an idle worker if one isn't already being woken up */
+    if (Pool->IdleThreads > Pool->PendingWakes)
+    {
+        Pool->PendingWakes++;
+        RtlWakeConditionVariable(&Pool->WorkAvailable);
+        return FALSE;
+    }
+
+    if (TppShouldCreateWorkerLocked(Pool) && TppCreateWorkerLocked(Pool)) return FALSE;
+    return (Pool->Threads < Pool->MaxThreads) && !Pool->Monitor.Armed;
+}
+
+static
+VOID
+TppQueueCallback(IN PTPP_OBJECT Object)
+{
+    PTP_POOL Pool = Object->Pool;
+    BOOLEAN ArmMonitor;
+
+    RtlEnterCriticalSection(&Pool->Lock);
+    ArmMonitor = TppQueueCallbackLocked(Object);
+    RtlLeaveCriticalSection(&Pool->Lock);
+    if (ArmMonitor) TppArmMonitor(Pool);
+}
+
+static
+BOOLEAN
+TppDequeueCallbackLocked(IN PTP_POOL Pool,
+                         OUT PTP_CALLBACK_INSTANCE Instance)
+{
+    PTPP_OBJECT Object;
+    PLIST_ENTRY ListEntry;
+    ULONG Priority;
+
+    for (Priority = TP_CALLBACK_PRIORITY_HIGH;
+         Priority < TP_CALLBACK_PRIORITY_COUNT;
+         Priority++)
+    {
+        if (!IsListEmpty(&Pool->Queue[Priority])) break;
+    }
+    if (Priority == TP_CALLBACK_PRIORITY_COUNT) return FALSE;
+
+    /* Objects with more callbacks pending go back to the end of the queue */
+    ListEntry = RemoveHeadList(&Pool->Queue[Priority]);
+    Object = CONTAINING_RECORD(ListEntry, TPP_OBJECT, QueueEntry);
+    if (--Object->PendingCallbacks)
+    {
+        InsertTailList(&Pool->Queue[Priority], &Object->QueueEntry);
+    }
+    Object->RunningCallbacks++;
+    Pool->QueuedCallbacks--;
+    Pool->CallbacksStarted++;
+
+    RtlZeroMemory(Instance, sizeof(*Instance));
+    Instance->Object = Object;
+    Instance->Associated = TRUE;
+    if (Object->LongFunction)
+    {
+        Instance->MayRunLong = TRUE;
+        Pool->LongCallbacks++;
+    }
+
+    /* Pick up what this particular callback is about */
+    if (Object->Type == TppWaitObject)
+    {
+        if (Object->u.Wait.Signaled)
+        {
+            Object->u.Wait.Signaled--;
+            Instance->WaitResult = WAIT_OBJECT_0;
+        }
+        else
+        {
+            ASSERT(Object->u.Wait.TimedOut);
+            Object->u.Wait.TimedOut--;
+            Instance->WaitResult = WAIT_TIMEOUT;
+        }
+    }
+    else if (Object->Type == TppIoObject)
+    {
+        ASSERT(!IsListEmpty(&Object->u.Io.CompletionList));
+        ListEntry = RemoveHeadList(&Object->u.Io.CompletionList);
+        Instance->Completion = CONTAINING_RECORD(ListEntry, TPP_IO_COMPLETION, ListEntry);
+    }
+
+    return TRUE;
+}
+
+static
+VOID
+TppCallbackDoneLocked(IN PTPP_OBJECT Object)
+{
+    PTP_POOL Pool = Object->Pool;
+
+    /* Let TpWaitFor* callers know once the object has gone quiet */
+    if (!Object->PendingCallbacks && !Object->RunningCallbacks)
+    {
+        RtlWakeAllConditionVariable(&Pool->CallbacksDone);
+    }
+}
+
+static
+VOID
+TppDestroyObject(IN PTPP_OBJECT Object)
+{
+    PTP_CLEANUP_GROUP CleanupGroup = Object->CleanupGroup;
+    PTPP_IO_COMPLETION Completion;
+
+    ASSERT(Object->PendingCallbacks == 0);
+    ASSERT(Object->RunningCallbacks == 0);
+
+    if (CleanupGroup)
+    {
+        RtlEnterCriticalSection(&CleanupGroup->Lock);
+        if (Object->GroupMember) RemoveEntryList(&Object->GroupEntry);
+        RtlLeaveCriticalSection(&CleanupGroup->Lock);
+        TpReleaseCleanupGroup(CleanupGroup);
+    }
+
+    if (Object->Type == TppIoObject)
+    {
+        while (!IsListEmpty(&Object->u.Io.CompletionList))
+        {
+            Completion = CONTAINING_RECORD(RemoveHeadList(&Object->u.Io.CompletionList),
+                                           TPP_IO_COMPLETION,
+                                           ListEntry);
+            RtlFreeHeap(RtlGetProcessHeap(), 0, Completion);
+        }
+    }
+
+    if (Object->ActivationContext) RtlReleaseActivationContext(Object->ActivationContext);
+    if (Object->RaceDll) LdrUnloadDll(Object->RaceDll);
+
+    TppDereferencePool(Object->Pool);
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Object);
+}
+
+static
+VOID
+TppDereferenceObject(IN PTPP_OBJECT Object)
+{
+    if (!InterlockedDecrement(&Object->ReferenceCount)) TppDestroyObject(Object);
+}
+
+static
+BOOLEAN
+TppReferenceObjectIfAlive(IN PTPP_OBJECT Object)
+{
+    LONG Count, NewCount;
+
+    for (Count = Object->ReferenceCount; Count; Count = NewCount)
+    {
+        NewCount = InterlockedCompareExchange(&Object->ReferenceCount, Count + 1, Count);
+        if (NewCount == Count) return TRUE;
+    }
+    return FALSE;
+}
+
+static
+VOID
+TppExecuteCallback(IN PTP_POOL Pool,
+                   IN PTP_CALLBACK_INSTANCE Instance)
+{
+    PTPP_OBJECT Object = Instance->Object;
+    PTPP_IO_COMPLETION Completion = Instance->Completion;
+    ULONG_PTR Cookie = 0;
+
+    if (Object->ActivationContext)
+    {
+        RtlActivateActivationContextEx(0, NtCurrentTeb(), Object->ActivationContext, &Cookie);
+    }
+
+    switch (Object->Type)
+    {
+        case TppSimpleObject:
+            ((PTP_SIMPLE_CALLBACK)Object->Callback)(Instance, Object->Context);
+            break;
+
+        case TppWorkObject:
+            ((PTP_WORK_CALLBACK)Object->Callback)(Instance,
+                                                  Object->Context,
+                                                  (PTP_WORK)Object);
+            break;
+
+        case TppTimerObject:
+            ((PTP_TIMER_CALLBACK)Object->Callback)(Instance,
+                                                   Object->Context,
+                                                   (PTP_TIMER)Object);
+            break;
+
+        case TppWaitObject:
+            ((PTP_WAIT_CALLBACK)Object->Callback)(Instance,
+                                                  Object->Context,
+                                                  (PTP_WAIT)Object,
+                                                  Instance->WaitResult);
+            break;
+
+        case TppIoObject:
+            ((PTP_IO_CALLBACK)Object->Callback)(Instance,
+                                                Object->Context,
+                                                Completion->ApcContext,
+                                                &Completion->IoStatusBlock,
+                                                (PTP_IO)Object);
+            RtlFreeHeap(RtlGetProcessHeap(), 0, Completion);
+            break;
+    }
+
+    if (Object->FinalizationCallback)
+    {
+        Object->FinalizationCallback(Instance, Object->Context);
+    }
+
+    if (Cookie) RtlDeactivateActivationContext(0, Cookie);
+
+    /* Run the completion actions the callback asked for */
+    if (Instance->CriticalSection) RtlLeaveCriticalSection(Instance->CriticalSection);
+    if (Instance->Mutex) NtReleaseMutant(Instance->Mutex, NULL);
+    if (Instance->Semaphore)
+    {
+        NtReleaseSemaphore(Instance->Semaphore, Instance->SemaphoreReleaseCount, NULL);
+    }
+    if (Instance->Event) NtSetEvent(Instance->Event, NULL);
+    if (Instance->Dll) LdrUnloadDll(Instance->Dll);
+
+    RtlEnterCriticalSection(&Pool->Lock);
+    if (Instance->MayRunLong) Pool->LongCallbacks--;
+    if (Instance->Associated)
+    {
+        Object->RunningCallbacks--;
+        TppCallbackDoneLocked(Object);
+    }
+    RtlLeaveCriticalSection(&Pool->Lock);
+
+    TppDereferenceObject(Object);
+}
+
+static
+ULONG
+NTAPI
+TppWorkerThread(IN PVOID Parameter)
+{
+    PTP_POOL Pool = Parameter;
+    TP_CALLBACK_INSTANCE Instance;
+    LARGE_INTEGER Timeout;
+    NTSTATUS Status;
+
+    RtlEnterCriticalSection(&Pool->Lock);
+    for (;;)
+    {
+        if (TppDequeueCallbackLocked(Pool, &Instance))
+        {
+            RtlLeaveCriticalSection(&Pool->Lock);
+            TppExecuteCallback(Pool, &Instance);
+            RtlEnterCriticalSection(&Pool->Lock);
+            continue;
+        }
+
+        if (Pool->Shutdown) break;
+
+        /* Wait for work, and retire if there is none for a while */
+        Pool->IdleThreads++;
+        Timeout.QuadPart = TPP_IDLE_TIMEOUT;
+        Status = RtlSleepConditionVariableCS(&Pool->WorkAvailable,
+                                             &Pool->Lock,
+                                             (Pool->Threads > Pool->MinThreads) ?
+                                             &Timeout : NULL);
+        Pool->IdleThreads--;
+        if (Pool->PendingWakes) Pool->PendingWakes--;
+
+        if ((Status == STATUS_TIMEOUT) &&
+            !Pool->QueuedCallbacks &&
+            (Pool->Threads > Pool->MinThreads))
+        {
+            break;
+        }
+    }
+    Pool->Threads--;
+    RtlLeaveCriticalSection(&Pool->Lock);
+
+    TppDereferencePool(Pool);
+    RtlExitUserThread(STATUS_SUCCESS);
+    return 0;
+}
+
+static
+VOID
+TppCheckStarvationLocked(IN PTP_POOL Pool)
+{
+    BOOLEAN Rearm = FALSE;
+
+    RtlEnterCriticalSection(&Pool->Lock);
+    if (Pool->QueuedCallbacks)
+    {
+        /* Nobody picked up anything since the last check, add a worker */
+        if ((Pool->IdleThreads <= Pool->PendingWakes) &&
+            (Pool->CallbacksStarted == Pool->MonitorSnapshot) &&
+            (Pool->Threads < Pool->MaxThreads))
+        {
+            TppCreateWorkerLocked(Pool);
+        }
+        Rearm = TRUE;
+    }
+    RtlLeaveCriticalSection(&Pool->Lock);
+
+    if (Rearm) TppArmMonitorLocked(Pool);
+    TppDereferencePool(Pool);
+}
+
+static
+ULONG
+NTAPI
+TppTimerThread(IN PVOID Parameter)
+{
+    PTPP_TIMER_ENTRY Entry;
+    PTPP_OBJECT Object;
+    LARGE_INTEGER Now;
+    BOOLEAN ArmMonitor;
+
+    for (;;)
+    {
+        NtWaitForSingleObject(TppTimerHandle, FALSE, NULL);
+
+        RtlEnterCriticalSection(&TppTimerLock);
+        TppTimerDeadline = MAXULONGLONG;
+        NtQuerySystemTime(&Now);
+
+        while (!IsListEmpty(&TppTimerList))
+        {
+            Entry = CONTAINING_RECORD(TppTimerList.Flink, TPP_TIMER_ENTRY, ListEntry);
+            if (Entry->DueTime > (ULONGLONG)Now.QuadPart) break;
+            TppRemoveTimerLocked(Entry);
+
+            if (Entry->Monitor)
+            {
+                TppCheckStarvationLocked(CONTAINING_RECORD(Entry, TP_POOL, Monitor));
+                continue;
+            }
+
+            /* Periodic timers are put back, one-shot ones are done */
+            Object = CONTAINING_RECORD(Entry, TPP_OBJECT, u.Timer.Entry);
+            if (Entry->Period)
+            {
+                Entry->DueTime += Entry->Period * 10000ULL;
+                if (Entry->DueTime <= (ULONGLONG)Now.QuadPart)
+                {
+                    Entry->DueTime = Now.QuadPart + Entry->Period * 10000ULL;
+                }
+                TppInsertTimerLocked(Entry);
+            }
+            else
+            {
+                Object->u.Timer.Set = FALSE;
+            }
+
+            RtlEnterCriticalSection(&Object->Pool->Lock);
+            ArmMonitor = TppQueueCallbackLocked(Object);
+            RtlLeaveCriticalSection(&Object->Pool->Lock);
+            if (ArmMonitor) TppArmMonitorLocked(Object->Pool);
+        }
+
+        TppUpdateTimerLocked();
+        RtlLeaveCriticalSection(&TppTimerLock);
+    }
+
+    return 0;
+}
+
+static
+VOID
+TppCompleteWaitLocked(IN PTPP_OBJECT Object,
+                      IN TP_WAIT_RESULT WaitResult)
+{
+    PTP_POOL Pool = Object->Pool;
+    BOOLEAN ArmMonitor;
+
+    /* Waits are one-shot, the owner has to set them again */
+    if (Object->u.Wait.Bucket)
+    {
+        RemoveEntryList(&Object->u.Wait.WaitEntry);
+        Object->u.Wait.Bucket->WaitCount--;
+        Object->u.Wait.Bucket = NULL;
+    }
+    Object->u.Wait.Handle = NULL;
+
+    RtlEnterCriticalSection(&Pool->Lock);
+    if (WaitResult == WAIT_OBJECT_0)
+    {
+        Object->u.Wait.Signaled++;
+    }
+    else
+    {
+        Object->u.Wait.TimedOut++;
+    }
+    ArmMonitor = TppQueueCallbackLocked(Object);
+    RtlLeaveCriticalSection(&Pool->Lock);
+    if (ArmMonitor) TppArmMonitor(Pool);
+}
+
+static
+PTPP_OBJECT
+TppFindWaitLocked(IN PTPP_WAIT_BUCKET Bucket,
+                  IN PTPP_OBJECT Object,
+                  IN ULONG Sequence)
+{
+    PLIST_ENTRY NextEntry;
+
+    /* The object may have been released since the handles were collected */
+    for (NextEntry = Bucket->WaitList.Flink;
+         NextEntry != &Bucket->WaitList;
+         NextEntry = NextEntry->Flink)
+    {
+        if ((CONTAINING_RECORD(NextEntry, TPP_OBJECT, u.Wait.WaitEntry) == Object) &&
+            (Object->u.Wait.Sequence == Sequence))
+        {
+            return Object;
+        }
+    }
+    return NULL;
+}
+
+static
+ULONG
+NTAPI
+TppWaitThread(IN PVOID Parameter)
+{
+    PTPP_WAIT_BUCKET Bucket = Parameter;
+    HANDLE Handles[MAXIMUM_WAIT_OBJECTS];
+    PTPP_OBJECT Objects[MAXIMUM_WAIT_OBJECTS];
+    ULONG Sequences[MAXIMUM_WAIT_OBJECTS];
+    LARGE_INTEGER Now, Timeout, Zero;
+    PLIST_ENTRY NextEntry;
+    PTPP_OBJECT Object;
+    ULONGLONG Deadline;
+    ULONG Count, i;
+    NTSTATUS Status;
+
+    RtlEnterCriticalSection(&TppWaitLock);
+    for (;;)
+    {
+        /* Collect the handles, timing out the waits that are due */
+        NtQuerySystemTime(&Now);
+        Deadline = MAXULONGLONG;
+        Handles[0] = Bucket->UpdateEvent;
+        Count = 1;
+        NextEntry = Bucket->WaitList.Flink;
+        while (NextEntry != &Bucket->WaitList)
+        {
+            Object = CONTAINING_RECORD(NextEntry, TPP_OBJECT, u.Wait.WaitEntry);
+            NextEntry = NextEntry->Flink;
+
+            if (Object->u.Wait.Timeout <= (ULONGLONG)Now.QuadPart)
+            {
+                TppCompleteWaitLocked(Object, WAIT_TIMEOUT);
+                continue;
+            }
+
+            if (Object->u.Wait.Timeout < Deadline) Deadline = Object->u.Wait.Timeout;
+            Handles[Count] = Object->u.Wait.Handle;
+            Objects[Count] = Object;
+            Sequences[Count] = Object->u.Wait.Sequence;
+            Count++;
+        }
+
+        /* An empty bucket lingers for a while before it goes away */
+        if (Count == 1)
+        {
+            Timeout.QuadPart = TPP_IDLE_TIMEOUT;
+            RtlLeaveCriticalSection(&TppWaitLock);
+            Status = NtWaitForSingleObject(Bucket->UpdateEvent, FALSE, &Timeout);
+            RtlEnterCriticalSection(&TppWaitLock);
+            if ((Status == STATUS_TIMEOUT) && !Bucket->WaitCount) break;
+            continue;
+        }
+
+        Timeout.QuadPart = Deadline;
+        RtlLeaveCriticalSection(&TppWaitLock);
+        Status = NtWaitForMultipleObjects(Count,
+                                          Handles,
+                                          WaitAny,
+                                          FALSE,
+                                          (Deadline == MAXULONGLONG) ? NULL : &Timeout);
+        RtlEnterCriticalSection(&TppWaitLock);
+
+        if ((Status > STATUS_WAIT_0) && (Status < STATUS_WAIT_0 + Count))
+        {
+            i = Status - STATUS_WAIT_0;
+        }
+        else if ((Status > STATUS_ABANDONED_WAIT_0) && (Status < STATUS_ABANDONED_WAIT_0 + Count))
+        {
+            i = Status - STATUS_ABANDONED_WAIT_0;
+        }
+        else
+        {
+            if (!NT_SUCCESS(Status))
+            {
+                /* Somebody closed a handle under us, drop the bad waits */
+                Zero.QuadPart = 0;
+                for (i = 1; i < Count; i++)
+                {
+                    Object = TppFindWaitLocked(Bucket, Objects[i], Sequences[i]);
+                    if (!Object) continue;
+                    if (!NT_SUCCESS(NtWaitForSingleObject(Handles[i], FALSE, &Zero)))
+                    {
+                        DPRINT1("Dropping wait on invalid handle %p\n", Handles[i]);
+                        RemoveEntryList(&Object->u.Wait.WaitEntry);
+                        Bucket->WaitCount--;
+                        Object->u.Wait.Bucket = NULL;
+                        Object->u.Wait.Handle = NULL;
+                    }
+                }
+            }
+            continue;
+        }
+
+        Object = TppFindWaitLocked(Bucket, Objects[i], Sequences[i]);
+        if (Object) TppCompleteWaitLocked(Object, WAIT_OBJECT_0);
+    }
+
+    RemoveEntryList(&Bucket->BucketEntry);
+    RtlLeaveCriticalSection(&TppWaitLock);
+
+    NtClose(Bucket->UpdateEvent);
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Bucket);
+    RtlExitUserThread(STATUS_SUCCESS);
+    return 0;
+}
+
+static
+NTSTATUS
+TppGetWaitBucketLocked(OUT PTPP_WAIT_BUCKET *BucketReturn)
+{
+    PTPP_WAIT_BUCKET Bucket;
+    PLIST_ENTRY NextEntry;
+    NTSTATUS Status;
+
+    for (NextEntry = TppWaitBucketList.Flink;
+         NextEntry != &TppWaitBucketList;
+         NextEntry = NextEntry->Flink)
+    {
+        Bucket = CONTAINING_RECORD(NextEntry, TPP_WAIT_BUCKET, BucketEntry);
+        if (Bucket->WaitCount < TPP_MAX_WAITS_PER_BUCKET)
+        {
+            *BucketReturn = Bucket;
+            return STATUS_SUCCESS;
+        }
+    }
+
+    /* All the waiter threads are full, start a new one */
+    Bucket = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*Bucket));
+    if (!Bucket) return STATUS_NO_MEMORY;
+    InitializeListHead(&Bucket->WaitList);
+
+    Status = NtCreateEvent(&Bucket->UpdateEvent,
+                           EVENT_ALL_ACCESS,
+                           NULL,
+                           SynchronizationEvent,
+                           FALSE);
+    if (NT_SUCCESS(Status))
+    {
+        Status = TppCreateThread((PTHREAD_START_ROUTINE)TppWaitThread, Bucket);
+        if (NT_SUCCESS(Status))
+        {
+            InsertTailList(&TppWaitBucketList, &Bucket->BucketEntry);
+            *BucketReturn = Bucket;
+            return STATUS_SUCCESS;
+        }
+        NtClose(Bucket->UpdateEvent);
+    }
+
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Bucket);
+    return Status;
+}
+
+static
+VOID
+TppCancelWaitLocked(IN PTPP_OBJECT Object)
+{
+    PTPP_WAIT_BUCKET Bucket = Object->u.Wait.Bucket;
+
+    if (!Bucket) return;
+
+    RemoveEntryList(&Object->u.Wait.WaitEntry);
+    Bucket->WaitCount--;
+    Object->u.Wait.Bucket = NULL;
+    Object->u.Wait.Handle = NULL;
+
+    /* Make the waiter thread stop waiting on the handle */
+    NtSetEvent(Bucket->UpdateEvent, NULL);
+}
+
+static
+ULONG
+NTAPI
+TppIoThread(IN PVOID Parameter)
+{
+    PTPP_IO_COMPLETION Completion;
+    IO_STATUS_BLOCK IoStatusBlock;
+    PVOID Key, ApcContext;
+    PTPP_OBJECT Object;
+    NTSTATUS Status;
+
+    for (;;)
+    {
+        Status = NtRemoveIoCompletion(TppIoCompletionPort,
+                                      &Key,
+                                      &ApcContext,
+                                      &IoStatusBlock,
+                                      NULL);
+        if (Status != STATUS_SUCCESS) continue;
+
+        Object = Key;
+        ASSERT(Object->Type == TppIoObject);
+
+        Completion = RtlAllocateHeap(RtlGetProcessHeap(), 0, sizeof(*Completion));
+        if (!Completion)
+        {
+            DPRINT1("Dropping I/O completion for %p\n", Object);
+        }
+        else
+        {
+            Completion->ApcContext = ApcContext;
+            Completion->IoStatusBlock = IoStatusBlock;
+
+            RtlEnterCriticalSection(&Object->Pool->Lock);
+            InsertTailList(&Object->u.Io.CompletionList, &Completion->ListEntry);
+            Object->u.Io.PendingIo--;
+            if (TppQueueCallbackLocked(Object))
+            {
+                RtlLeaveCriticalSection(&Object->Pool->Lock);
+                TppArmMonitor(Object->Pool);
+            }
+            else
+            {
+                RtlLeaveCriticalSection(&Object->Pool->Lock);
+            }
+        }
+
+        /* Drop the reference taken by TpStartAsyncIoOperation */
+        TppDereferenceObject(Object);
+    }
+
+    return 0;
+}
+
+static
+NTSTATUS
+TppEnsureIoCompletionPort(VOID)
+{
+    HANDLE Port;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    RtlEnterCriticalSection(&TppIoLock);
+    if (!TppIoCompletionPort)
+    {
+        Status = NtCreateIoCompletion(&Port, IO_COMPLETION_ALL_ACCESS, NULL, 0);
+        if (NT_SUCCESS(Status))
+        {
+            TppIoCompletionPort = Port;
+            Status = TppCreateThread((PTHREAD_START_ROUTINE)TppIoThread, NULL);
+            if (!NT_SUCCESS(Status))
+            {
+                TppIoCompletionPort = NULL;
+                NtClose(Port);
+            }
+        }
+    }
+    RtlLeaveCriticalSection(&TppIoLock);
+
+    return Status;
+}
+
+static
+NTSTATUS
+TppCreatePool(OUT PTP_POOL *PoolReturn)
+{
+    PTP_POOL Pool;
+    NTSTATUS Status;
+    ULONG i;
+
+    /* The starvation monitor of the pool needs the timer thread */
+    RtlEnterCriticalSection(&TppTimerLock);
+    Status = TppEnsureTimerThreadLocked();
+    RtlLeaveCriticalSection(&TppTimerLock);
+    if (!NT_SUCCESS(Status)) return Status;
+
+    Pool = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*Pool));
+    if (!Pool) return STATUS_NO_MEMORY;
+
+    Status = RtlInitializeCriticalSection(&Pool->Lock);
+    if (!NT_SUCCESS(Status))
+    {
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Pool);
+        return Status;
+    }
+
+    Pool->ReferenceCount = 1;
+    for (i = 0; i < TP_CALLBACK_PRIORITY_COUNT; i++) InitializeListHead(&Pool->Queue[i]);
+    RtlInitializeConditionVariable(&Pool->WorkAvailable);
+    RtlInitializeConditionVariable(&Pool->CallbacksDone);
+    Pool->MaxThreads = TPP_DEFAULT_MAX_THREADS;
+    Pool->Monitor.Monitor = TRUE;
+
+    *PoolReturn = Pool;
+    return STATUS_SUCCESS;
+}
+
+static
+NTSTATUS
+TppGetPool(IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL,
+           OUT PTP_POOL *PoolReturn)
+{
+    PTP_POOL Pool;
+    NTSTATUS Status;
+
+    if ((CallbackEnviron) && (CallbackEnviron->Pool))
+    {
+        *PoolReturn = CallbackEnviron->Pool;
+        return STATUS_SUCCESS;
+    }
+
+    /* The default pool is created on first use and never goes away */
+    if (!TppDefaultPool)
+    {
+        Status = TppCreatePool(&Pool);
+        if (!NT_SUCCESS(Status)) return Status;
+
+        if (InterlockedCompareExchangePointer((PVOID *)&TppDefaultPool, Pool, NULL))
+        {
+            TppDereferencePool(Pool);
+        }
+    }
+
+    *PoolReturn = TppDefaultPool;
+    return STATUS_SUCCESS;
+}
+
+static
+NTSTATUS
+TppAllocObject(OUT PTPP_OBJECT *ObjectReturn,
+               IN TPP_OBJECT_TYPE Type,
+               IN PVOID Callback,
+               IN PVOID Context OPTIONAL,
+               IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    PTPP_OBJECT Object;
+    PTP_POOL Pool;
+    NTSTATUS Status;
+
+    if (!Callback) return STATUS_INVALID_PARAMETER;
+    if ((CallbackEnviron) &&
+        (CallbackEnviron->Version >= 3) &&
+        (((PTPP_CALLBACK_ENVIRON_V3)CallbackEnviron)->CallbackPriority >= TP_CALLBACK_PRIORITY_COUNT))
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    Status = TppGetPool(CallbackEnviron, &Pool);
+    if (!NT_SUCCESS(Status)) return Status;
+
+    Object = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*Object));
+    if (!Object) return STATUS_NO_MEMORY;
+
+    Object->ReferenceCount = 1;
+    Object->Type = Type;
+    Object->Pool = Pool;
+    Object->Callback = Callback;
+    Object->Context = Context;
+    Object->Priority = TP_CALLBACK_PRIORITY_NORMAL;
+
+    if (CallbackEnviron)
+    {
+        if (CallbackEnviron->RaceDll)
+        {
+            /* Keep the DLL loaded for as long as the object exists */
+            Status = LdrAddRefDll(0, CallbackEnviron->RaceDll);
+            if (!NT_SUCCESS(Status))
+            {
+                RtlFreeHeap(RtlGetProcessHeap(), 0, Object);
+                return Status;
+            }
+            Object->RaceDll = CallbackEnviron->RaceDll;
+        }
+
+        if ((CallbackEnviron->ActivationContext) &&
+            (CallbackEnviron->ActivationContext != TPP_NO_ACTIVATION_CONTEXT))
+        {
+            RtlAddRefActivationContext(CallbackEnviron->ActivationContext);
+            Object->ActivationContext = CallbackEnviron->ActivationContext;
+        }
+
+        Object->CleanupGroup = CallbackEnviron->CleanupGroup;
+        Object->CleanupGroupCancelCallback = CallbackEnviron->CleanupGroupCancelCallback;
+        Object->FinalizationCallback = CallbackEnviron->FinalizationCallback;
+        Object->LongFunction = CallbackEnviron->u.s.LongFunction;
+        if (CallbackEnviron->Version >= 3)
+        {
+            Object->Priority = ((PTPP_CALLBACK_ENVIRON_V3)CallbackEnviron)->CallbackPriority;
+        }
+    }
+
+    switch (Type)
+    {
+        case TppTimerObject:
+            InitializeListHead(&Object->u.Timer.Entry.ListEntry);
+            break;
+
+        case TppWaitObject:
+            InitializeListHead(&Object->u.Wait.WaitEntry);
+            break;
+
+        case TppIoObject:
+            InitializeListHead(&Object->u.Io.CompletionList);
+            break;
+
+        default:
+            break;
+    }
+
+    TppReferencePool(Pool);
+
+    if (Object->CleanupGroup)
+    {
+        InterlockedIncrement(&Object->CleanupGroup->ReferenceCount);
+        RtlEnterCriticalSection(&Object->CleanupGroup->Lock);
+        InsertTailList(&Object->CleanupGroup->MemberList, &Object->GroupEntry);
+        Object->GroupMember = TRUE;
+        RtlLeaveCriticalSection(&Object->CleanupGroup->Lock);
+    }
+
+    *ObjectReturn = Object;
+    return STATUS_SUCCESS;
+}
+
+static
+LONG
+TppCancelCallbacksLocked(IN PTPP_OBJECT Object)
+{
+    PTPP_IO_COMPLETION Completion;
+    LONG Cancelled = Object->PendingCallbacks;
+
+    if (!Cancelled) return 0;
+
+    RemoveEntryList(&Object->QueueEntry);
+    Object->PendingCallbacks = 0;
+    Object->Pool->QueuedCallbacks -= Cancelled;
+
+    if (Object->Type == TppWaitObject)
+    {
+        Object->u.Wait.Signaled = 0;
+        Object->u.Wait.TimedOut = 0;
+    }
+    else if (Object->Type == TppIoObject)
+    {
+        while (!IsListEmpty(&Object->u.Io.CompletionList))
+        {
+            Completion = CONTAINING_RECORD(RemoveHeadList(&Object->u.Io.CompletionList),
+                                           TPP_IO_COMPLETION,
+                                           ListEntry);
+            RtlFreeHeap(RtlGetProcessHeap(), 0, Completion);
+        }
+    }
+
+    TppCallbackDoneLocked(Object);
+    return Cancelled;
+}
+
+static
+VOID
+TppWaitForCallbacks(IN PTPP_OBJECT Object,
+                    IN BOOLEAN CancelPendingCallbacks)
+{
+    PTP_POOL Pool = Object->Pool;
+    LONG Cancelled = 0;
+
+    RtlEnterCriticalSection(&Pool->Lock);
+    if (CancelPendingCallbacks) Cancelled = TppCancelCallbacksLocked(Object);
+    while ((Object->PendingCallbacks) || (Object->RunningCallbacks))
+    {
+        RtlSleepConditionVariableCS(&Pool->CallbacksDone, &Pool->Lock, NULL);
+    }
+    RtlLeaveCriticalSection(&Pool->Lock);
+
+    /* Drop the references the cancelled callbacks were holding */
+    while (Cancelled--) TppDereferenceObject(Object);
+}
+
+static
+VOID
+TppShutdownObject(IN PTPP_OBJECT Object)
+{
+    /* Make sure no new callback gets queued behind the owner's back */
+    if (Object->Type == TppTimerObject)
+    {
+        RtlEnterCriticalSection(&TppTimerLock);
+        TppRemoveTimerLocked(&Object->u.Timer.Entry);
+        Object->u.Timer.Set = FALSE;
+        RtlLeaveCriticalSection(&TppTimerLock);
+    }
+    else if (Object->Type == TppWaitObject)
+    {
+        RtlEnterCriticalSection(&TppWaitLock);
+        TppCancelWaitLocked(Object);
+        RtlLeaveCriticalSection(&TppWaitLock);
+    }
+}
+
+static
+VOID
+TppReleaseObject(IN PTPP_OBJECT Object)
+{
+    /* Cleanup group members may already have been released by the group */
+    if (InterlockedExchange(&Object->Released, TRUE)) return;
+    TppShutdownObject(Object);
+    TppDereferenceObject(Object);
+}
+
+/* PUBLIC FUNCTIONS **********************************************************/
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpAllocPool(OUT PTP_POOL *PoolReturn,
+            IN PVOID Reserved)
+{
+    return TppCreatePool(PoolReturn);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleasePool(IN OUT PTP_POOL Pool)
+{
+    if (Pool == TppDefaultPool) return;
+
+    /* Idle workers exit now, busy ones once the queues have drained */
+    RtlEnterCriticalSection(&Pool->Lock);
+    Pool->Shutdown = TRUE;
+    RtlWakeAllConditionVariable(&Pool->WorkAvailable);
+    RtlLeaveCriticalSection(&Pool->Lock);
+
+    TppDereferencePool(Pool);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpSetPoolMaxThreads(IN OUT PTP_POOL Pool,
+                    IN LONG MaxThreads)
+{
+    RtlEnterCriticalSection(&Pool->Lock);
+    Pool->MaxThreads = max(MaxThreads, 1);
+    if (Pool->MinThreads > Pool->MaxThreads) Pool->MinThreads = Pool->MaxThreads;
+    RtlLeaveCriticalSection(&Pool->Lock);
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpSetPoolMinThreads(IN OUT PTP_POOL Pool,
+                    IN LONG MinThreads)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    RtlEnterCriticalSection(&Pool->Lock);
+
+    /* The minimum is kept alive for good, so start it right away */
+    while (Pool->Threads < MinThreads)
+    {
+        if (!TppCreateWorkerLocked(Pool))
+        {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            break;
+        }
+    }
+
+    if (NT_SUCCESS(Status))
+    {
+        Pool->MinThreads = MinThreads;
+        if (Pool->MaxThreads < MinThreads) Pool->MaxThreads = MinThreads;
+    }
+
+    RtlLeaveCriticalSection(&Pool->Lock);
+    return Status;
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpAllocCleanupGroup(OUT PTP_CLEANUP_GROUP *CleanupGroupReturn)
+{
+    PTP_CLEANUP_GROUP CleanupGroup;
+    NTSTATUS Status;
+
+    CleanupGroup = RtlAllocateHeap(RtlGetProcessHeap(), 0, sizeof(*CleanupGroup));
+    if (!CleanupGroup) return STATUS_NO_MEMORY;
+
+    Status = RtlInitializeCriticalSection(&CleanupGroup->Lock);
+    if (!NT_SUCCESS(Status))
+    {
+        RtlFreeHeap(RtlGetProcessHeap(), 0, CleanupGroup);
+        return Status;
+    }
+
+    CleanupGroup->ReferenceCount = 1;
+    InitializeListHead(&CleanupGroup->MemberList);
+
+    *CleanupGroupReturn = CleanupGroup;
+    return STATUS_SUCCESS;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleaseCleanupGroup(IN OUT PTP_CLEANUP_GROUP CleanupGroup)
+{
+    /* Members that are still around keep the group alive */
+    if (InterlockedDecrement(&CleanupGroup->ReferenceCount)) return;
+
+    RtlDeleteCriticalSection(&CleanupGroup->Lock);
+    RtlFreeHeap(RtlGetProcessHeap(), 0, CleanupGroup);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleaseCleanupGroupMembers(IN OUT PTP_CLEANUP_GROUP CleanupGroup,
+                             IN LOGICAL CancelPendingCallbacks,
+                             IN OUT PVOID CleanupParameter OPTIONAL)
+{
+    LIST_ENTRY MemberList;
+    PLIST_ENTRY NextEntry;
+    PTPP_OBJECT Object;
+
+    /* Take over the members, skipping those already being destroyed */
+    InitializeListHead(&MemberList);
+    RtlEnterCriticalSection(&CleanupGroup->Lock);
+    NextEntry = CleanupGroup->MemberList.Flink;
+    while (NextEntry != &CleanupGroup->MemberList)
+    {
+        Object = CONTAINING_RECORD(NextEntry, TPP_OBJECT, GroupEntry);
+        NextEntry = NextEntry->Flink;
+        if (!TppReferenceObjectIfAlive(Object)) continue;
+
+        RemoveEntryList(&Object->GroupEntry);
+        Object->GroupMember = FALSE;
+        InsertTailList(&MemberList, &Object->GroupEntry);
+    }
+    RtlLeaveCriticalSection(&CleanupGroup->Lock);
+
+    while (!IsListEmpty(&MemberList))
+    {
+        Object = CONTAINING_RECORD(RemoveHeadList(&MemberList), TPP_OBJECT, GroupEntry);
+
+        TppShutdownObject(Object);
+        TppWaitForCallbacks(Object, CancelPendingCallbacks ? TRUE : FALSE);
+
+        if ((CancelPendingCallbacks) && (Object->CleanupGroupCancelCallback))
+        {
+            Object->CleanupGroupCancelCallback(Object->Context, CleanupParameter);
+        }
+
+        /* The group releases the object on behalf of its owner */
+        if (!InterlockedExchange(&Object->Released, TRUE)) TppDereferenceObject(Object);
+        TppDereferenceObject(Object);
+    }
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpCallbackSetEventOnCompletion(IN OUT PTP_CALLBACK_INSTANCE Instance,
+                               IN HANDLE Event)
+{
+    Instance->Event = Event;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpCallbackReleaseSemaphoreOnCompletion(IN OUT PTP_CALLBACK_INSTANCE Instance,
+                                       IN HANDLE Semaphore,
+                                       IN LONG ReleaseCount)
+{
+    Instance->Semaphore = Semaphore;
+    Instance->SemaphoreReleaseCount = ReleaseCount;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpCallbackReleaseMutexOnCompletion(IN OUT PTP_CALLBACK_INSTANCE Instance,
+                                   IN HANDLE Mutex)
+{
+    Instance->Mutex = Mutex;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpCallbackLeaveCriticalSectionOnCompletion(IN OUT PTP_CALLBACK_INSTANCE Instance,
+                                           IN OUT PRTL_CRITICAL_SECTION CriticalSection)
+{
+    Instance->CriticalSection = CriticalSection;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpCallbackUnloadDllOnCompletion(IN OUT PTP_CALLBACK_INSTANCE Instance,
+                                IN PVOID DllHandle)
+{
+    Instance->Dll = DllHandle;
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpCallbackMayRunLong(IN OUT PTP_CALLBACK_INSTANCE Instance)
+{
+    PTP_POOL Pool = Instance->Object->Pool;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    if (Instance->MayRunLong) return STATUS_SUCCESS;
+
+    /* The callback stops counting against the processor-bound workers */
+    RtlEnterCriticalSection(&Pool->Lock);
+    Instance->MayRunLong = TRUE;
+    Pool->LongCallbacks++;
+
+    /* Tell the caller whether someone else can pick up queued work */
+    if ((Pool->QueuedCallbacks) && (Pool->IdleThreads <= Pool->PendingWakes))
+    {
+        if ((Pool->Threads >= Pool->MaxThreads) || !TppCreateWorkerLocked(Pool))
+        {
+            Status = STATUS_TOO_MANY_THREADS;
+        }
+    }
+    RtlLeaveCriticalSection(&Pool->Lock);
+
+    return Status;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpDisassociateCallback(IN OUT PTP_CALLBACK_INSTANCE Instance)
+{
+    PTPP_OBJECT Object = Instance->Object;
+
+    if (!Instance->Associated) return;
+
+    /* TpWaitFor* no longer waits for this callback to return */
+    RtlEnterCriticalSection(&Object->Pool->Lock);
+    Instance->Associated = FALSE;
+    Object->RunningCallbacks--;
+    TppCallbackDoneLocked(Object);
+    RtlLeaveCriticalSection(&Object->Pool->Lock);
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpSimpleTryPost(IN PTP_SIMPLE_CALLBACK Callback,
+                IN OUT PVOID Context OPTIONAL,
+                IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    PTPP_OBJECT Object;
+    NTSTATUS Status;
+
+    Status = TppAllocObject(&Object, TppSimpleObject, Callback, Context, CallbackEnviron);
+    if (!NT_SUCCESS(Status)) return Status;
+
+    /* Nobody owns a simple callback, it goes away once it has run */
+    Object->Released = TRUE;
+    TppQueueCallback(Object);
+    TppDereferenceObject(Object);
+
+    return STATUS_SUCCESS;
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpAllocWork(OUT PTP_WORK *WorkReturn,
+            IN PTP_WORK_CALLBACK Callback,
+            IN OUT PVOID Context OPTIONAL,
+            IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    return TppAllocObject((PTPP_OBJECT *)WorkReturn,
+                          TppWorkObject,
+                          Callback,
+                          Context,
+                          CallbackEnviron);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleaseWork(IN OUT PTP_WORK Work)
+{
+    TppReleaseObject((PTPP_OBJECT)Work);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpPostWork(IN OUT PTP_WORK Work)
+{
+    TppQueueCallback((PTPP_OBJECT)Work);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpWaitForWork(IN OUT PTP_WORK Work,
+              IN LOGICAL CancelPendingCallbacks)
+{
+    TppWaitForCallbacks((PTPP_OBJECT)Work, CancelPendingCallbacks ? TRUE : FALSE);
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpAllocTimer(OUT PTP_TIMER *TimerReturn,
+             IN PTP_TIMER_CALLBACK Callback,
+             IN OUT PVOID Context OPTIONAL,
+             IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    NTSTATUS Status;
+
+    /* Make sure TpSetTimer can't fail later on */
+    RtlEnterCriticalSection(&TppTimerLock);
+    Status = TppEnsureTimerThreadLocked();
+    RtlLeaveCriticalSection(&TppTimerLock);
+    if (!NT_SUCCESS(Status)) return Status;
+
+    return TppAllocObject((PTPP_OBJECT *)TimerReturn,
+                          TppTimerObject,
+                          Callback,
+                          Context,
+                          CallbackEnviron);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleaseTimer(IN OUT PTP_TIMER Timer)
+{
+    TppReleaseObject((PTPP_OBJECT)Timer);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpSetTimer(IN OUT PTP_TIMER Timer,
+           IN PLARGE_INTEGER DueTime OPTIONAL,
+           IN LONG Period,
+           IN LONG WindowLength OPTIONAL)
+{
+    PTPP_OBJECT Object = (PTPP_OBJECT)Timer;
+    PTPP_TIMER_ENTRY Entry = &Object->u.Timer.Entry;
+
+    RtlEnterCriticalSection(&TppTimerLock);
+
+    TppRemoveTimerLocked(Entry);
+    Object->u.Timer.Set = FALSE;
+
+    /* A missing due time cancels the timer, a zero one fires it now */
+    if (DueTime)
+    {
+        Entry->DueTime = TppGetAbsoluteTime(DueTime);
+        Entry->Period = max(Period, 0);
+        Entry->WindowLength = max(WindowLength, 0);
+        TppInsertTimerLocked(Entry);
+        Object->u.Timer.Set = TRUE;
+        TppUpdateTimerLocked();
+    }
+
+    RtlLeaveCriticalSection(&TppTimerLock);
+}
+
+/*
+ * @implemented
+ */
+LOGICAL
+NTAPI
+TpIsTimerSet(IN PTP_TIMER Timer)
+{
+    return ((PTPP_OBJECT)Timer)->u.Timer.Set;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpWaitForTimer(IN OUT PTP_TIMER Timer,
+               IN LOGICAL CancelPendingCallbacks)
+{
+    TppWaitForCallbacks((PTPP_OBJECT)Timer, CancelPendingCallbacks ? TRUE : FALSE);
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpAllocWait(OUT PTP_WAIT *WaitReturn,
+            IN PTP_WAIT_CALLBACK Callback,
+            IN OUT PVOID Context OPTIONAL,
+            IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    return TppAllocObject((PTPP_OBJECT *)WaitReturn,
+                          TppWaitObject,
+                          Callback,
+                          Context,
+                          CallbackEnviron);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleaseWait(IN OUT PTP_WAIT Wait)
+{
+    TppReleaseObject((PTPP_OBJECT)Wait);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpSetWait(IN OUT PTP_WAIT Wait,
+          IN HANDLE Handle OPTIONAL,
+          IN PLARGE_INTEGER Timeout OPTIONAL)
+{
+    PTPP_OBJECT Object = (PTPP_OBJECT)Wait;
+    PTPP_WAIT_BUCKET Bucket;
+    LARGE_INTEGER Zero;
+    NTSTATUS Status;
+
+    RtlEnterCriticalSection(&TppWaitLock);
+
+    TppCancelWaitLocked(Object);
+    if (!Handle)
+    {
+        RtlLeaveCriticalSection(&TppWaitLock);
+        return;
+    }
+
+    /* A zero timeout only checks the current state of the handle */
+    if ((Timeout) && (Timeout->QuadPart == 0))
+    {
+        Zero.QuadPart = 0;
+        Status = NtWaitForSingleObject(Handle, FALSE, &Zero);
+        TppCompleteWaitLocked(Object, (Status == STATUS_TIMEOUT) ? WAIT_TIMEOUT : WAIT_OBJECT_0);
+        RtlLeaveCriticalSection(&TppWaitLock);
+        return;
+    }
+
+    Status = TppGetWaitBucketLocked(&Bucket);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("Failed to get a waiter thread: 0x%lx\n", Status);
+        RtlLeaveCriticalSection(&TppWaitLock);
+        return;
+    }
+
+    Object->u.Wait.Handle = Handle;
+    Object->u.Wait.Timeout = Timeout ? TppGetAbsoluteTime(Timeout) : MAXULONGLONG;
+    Object->u.Wait.Sequence = ++TppWaitSequence;
+    Object->u.Wait.Bucket = Bucket;
+    InsertTailList(&Bucket->WaitList, &Object->u.Wait.WaitEntry);
+    Bucket->WaitCount++;
+    NtSetEvent(Bucket->UpdateEvent, NULL);
+
+    RtlLeaveCriticalSection(&TppWaitLock);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpWaitForWait(IN OUT PTP_WAIT Wait,
+              IN LOGICAL CancelPendingCallbacks)
+{
+    TppWaitForCallbacks((PTPP_OBJECT)Wait, CancelPendingCallbacks ? TRUE : FALSE);
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpAllocIoCompletion(OUT PTP_IO *IoReturn,
+                    IN HANDLE File,
+                    IN PTP_IO_CALLBACK Callback,
+                    IN OUT PVOID Context OPTIONAL,
+                    IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    FILE_COMPLETION_INFORMATION CompletionInformation;
+    IO_STATUS_BLOCK IoStatusBlock;
+    PTPP_OBJECT Object;
+    NTSTATUS Status;
+
+    Status = TppEnsureIoCompletionPort();
+    if (!NT_SUCCESS(Status)) return Status;
+
+    Status = TppAllocObject(&Object, TppIoObject, Callback, Context, CallbackEnviron);
+    if (!NT_SUCCESS(Status)) return Status;
+
+    /* Completions of the file come back with the object as their key */
+    CompletionInformation.Port = TppIoCompletionPort;
+    CompletionInformation.Key = Object;
+    Status = NtSetInformationFile(File,
+                                  &IoStatusBlock,
+                                  &CompletionInformation,
+                                  sizeof(CompletionInformation),
+                                  FileCompletionInformation);
+    if (!NT_SUCCESS(Status))
+    {
+        Object->Released = TRUE;
+        TppDereferenceObject(Object);
+        return Status;
+    }
+
+    *IoReturn = (PTP_IO)Object;
+    return STATUS_SUCCESS;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleaseIoCompletion(IN OUT PTP_IO Io)
+{
+    TppReleaseObject((PTPP_OBJECT)Io);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpStartAsyncIoOperation(IN OUT PTP_IO Io)
+{
+    PTPP_OBJECT Object = (PTPP_OBJECT)Io;
+
+    /* The object has to outlive the operation, whatever its owner does */
+    InterlockedIncrement(&Object->ReferenceCount);
+    RtlEnterCriticalSection(&Object->Pool->Lock);
+    Object->u.Io.PendingIo++;
+    RtlLeaveCriticalSection(&Object->Pool->Lock);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpCancelAsyncIoOperation(IN OUT PTP_IO Io)
+{
+    PTPP_OBJECT Object = (PTPP_OBJECT)Io;
+
+    /* The operation failed synchronously and will never complete */
+    RtlEnterCriticalSection(&Object->Pool->Lock);
+    ASSERT(Object->u.Io.PendingIo > 0);
+    Object->u.Io.PendingIo--;
+    RtlLeaveCriticalSection(&Object->Pool->Lock);
+    TppDereferenceObject(Object);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpWaitForIoCompletion(IN OUT PTP_IO Io,
+                      IN LOGICAL CancelPendingCallbacks)
+{
+    TppWaitForCallbacks((PTPP_OBJECT)Io, CancelPendingCallbacks ? TRUE : FALSE);
+}
+
+/* EOF */
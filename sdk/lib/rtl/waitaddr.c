@@ -0,0 +1,274 @@
+/*
+ * COPYRIGHT:         See COPYING in the top level directory
+ * PROJECT:           ReactOS system libraries
+ * PURPOSE:           Wait On Address Routines
+ * FILE:              lib/rtl/waitaddr.c
+ * PROGRAMMER:
+ *
+ * NOTES:             Waiters are kept in a process-wide table hashed by
+ *                    address, and block on a keyed event with the address
+ *                    of their on-stack wait block as the key. This way no
+ *                    synchronization object needs any storage beyond the
+ *                    value being waited on, which is what the condition
+ *                    variable and SRW lock code is built upon.
+ */
+
+/* INCLUDES *****************************************************************/
+
+#include <rtl_vista.h>
+
+#define NDEBUG
+#include <debug.h>
+
+/* INTERNAL TYPES ************************************************************/
+
+#define RTLP_WAIT_TABLE_SIZE        128
+#define RTLP_WAIT_LOCK_SPINS        100
+
+typedef struct _RTLP_ADDRESS_WAIT_BLOCK
+{
+    LIST_ENTRY ListEntry;
+    const volatile VOID *Key;
+    BOOLEAN Woken;
+} RTLP_ADDRESS_WAIT_BLOCK, *PRTLP_ADDRESS_WAIT_BLOCK;
+
+typedef struct _RTLP_ADDRESS_WAIT_BUCKET
+{
+    LONG Lock;
+    LIST_ENTRY WaitList;
+} RTLP_ADDRESS_WAIT_BUCKET, *PRTLP_ADDRESS_WAIT_BUCKET;
+
+/* GLOBALS *******************************************************************/
+
+static HANDLE RtlpWaitOnAddressKeyedEvent;
+static RTLP_ADDRESS_WAIT_BUCKET RtlpWaitOnAddressTable[RTLP_WAIT_TABLE_SIZE];
+
+/* INTERNAL FUNCTIONS ********************************************************/
+
+VOID
+RtlpInitializeKeyedEvent(VOID)
+{
+    ULONG i;
+
+    ASSERT(RtlpWaitOnAddressKeyedEvent == NULL);
+    NtCreateKeyedEvent(&RtlpWaitOnAddressKeyedEvent, EVENT_ALL_ACCESS, NULL, 0);
+
+    for (i = 0; i < RTLP_WAIT_TABLE_SIZE; i++)
+    {
+        InitializeListHead(&RtlpWaitOnAddressTable[i].WaitList);
+    }
+}
+
+VOID
+RtlpCloseKeyedEvent(VOID)
+{
+    ASSERT(RtlpWaitOnAddressKeyedEvent != NULL);
+    NtClose(RtlpWaitOnAddressKeyedEvent);
+    RtlpWaitOnAddressKeyedEvent = NULL;
+}
+
+static
+PRTLP_ADDRESS_WAIT_BUCKET
+RtlpGetAddressWaitBucket(IN const volatile VOID *Key)
+{
+    ULONG_PTR Hash = (ULONG_PTR)Key;
+
+    /* Values are at least a few bytes apart, mix in the upper bits too */
+    Hash = (Hash >> 3) ^ (Hash >> 11);
+    return &RtlpWaitOnAddressTable[Hash % RTLP_WAIT_TABLE_SIZE];
+}
+
+static
+VOID
+RtlpAcquireAddressWaitBucket(IN PRTLP_ADDRESS_WAIT_BUCKET Bucket)
+{
+    ULONG Spins = 0;
+
+    /* The lock is only held for a few list operations */
+    while (InterlockedExchange(&Bucket->Lock, 1))
+    {
+        /* Give a preempted owner a chance to run if it takes too long */
+        if (++Spins == RTLP_WAIT_LOCK_SPINS)
+        {
+            NtYieldExecution();
+            Spins = 0;
+        }
+        else
+        {
+            YieldProcessor();
+        }
+    }
+}
+
+static
+VOID
+RtlpReleaseAddressWaitBucket(IN PRTLP_ADDRESS_WAIT_BUCKET Bucket)
+{
+    InterlockedExchange(&Bucket->Lock, 0);
+}
+
+static
+BOOLEAN
+RtlpCompareAddress(IN const volatile VOID *Address,
+                   IN const VOID *CompareAddress,
+                   IN SIZE_T AddressSize)
+{
+    switch (AddressSize)
+    {
+        case 1:
+            return *(const volatile UCHAR *)Address == *(const UCHAR *)CompareAddress;
+        case 2:
+            return *(const volatile USHORT *)Address == *(const USHORT *)CompareAddress;
+        case 4:
+            return *(const volatile ULONG *)Address == *(const ULONG *)CompareAddress;
+        default:
+            return *(const volatile ULONGLONG *)Address == *(const ULONGLONG *)CompareAddress;
+    }
+}
+
+/*
+ * Waiters are queued under a key, which is normally the address they wait
+ * on. The SRW lock code uses a second key for the same lock word, so that
+ * shared and exclusive waiters can be woken separately.
+ */
+BOOLEAN
+RtlpWakeAddress(IN const volatile VOID *Key,
+                IN BOOLEAN WakeAll)
+{
+    PRTLP_ADDRESS_WAIT_BUCKET Bucket = RtlpGetAddressWaitBucket(Key);
+    PRTLP_ADDRESS_WAIT_BLOCK WaitBlock;
+    PLIST_ENTRY NextEntry;
+    LIST_ENTRY WakeList;
+
+    /*
+     * Always take the lock, even if the list looks empty. A waiter could
+     * have read the old value and be about to queue itself.
+     */
+    InitializeListHead(&WakeList);
+    RtlpAcquireAddressWaitBucket(Bucket);
+
+    /* Collect the waiters in FIFO order */
+    NextEntry = Bucket->WaitList.Flink;
+    while (NextEntry != &Bucket->WaitList)
+    {
+        WaitBlock = CONTAINING_RECORD(NextEntry, RTLP_ADDRESS_WAIT_BLOCK, ListEntry);
+        NextEntry = NextEntry->Flink;
+        if (WaitBlock->Key != Key) continue;
+
+        RemoveEntryList(&WaitBlock->ListEntry);
+        InsertTailList(&WakeList, &WaitBlock->ListEntry);
+        WaitBlock->Woken = TRUE;
+        if (!WakeAll) break;
+    }
+    RtlpReleaseAddressWaitBucket(Bucket);
+
+    /*
+     * The waiters can't go away before they have been released, since they
+     * wait for the release when they find out they've been dequeued. So we
+     * can still walk the list, as long as we do it before releasing them.
+     */
+    NextEntry = WakeList.Flink;
+    while (NextEntry != &WakeList)
+    {
+        WaitBlock = CONTAINING_RECORD(NextEntry, RTLP_ADDRESS_WAIT_BLOCK, ListEntry);
+        NextEntry = NextEntry->Flink;
+        NtReleaseKeyedEvent(RtlpWaitOnAddressKeyedEvent, WaitBlock, FALSE, NULL);
+    }
+
+    return !IsListEmpty(&WakeList);
+}
+
+NTSTATUS
+RtlpWaitOnAddress(IN const volatile VOID *Key,
+                  IN const volatile VOID *Address,
+                  IN PVOID CompareAddress,
+                  IN SIZE_T AddressSize,
+                  IN const LARGE_INTEGER *Timeout OPTIONAL)
+{
+    PRTLP_ADDRESS_WAIT_BUCKET Bucket;
+    RTLP_ADDRESS_WAIT_BLOCK WaitBlock;
+    NTSTATUS Status;
+    BOOLEAN Equal;
+
+    ASSERT(RtlpWaitOnAddressKeyedEvent != NULL);
+
+    /* Compare under the bucket lock, so a wake can't slip in between */
+    Bucket = RtlpGetAddressWaitBucket(Key);
+    RtlpAcquireAddressWaitBucket(Bucket);
+    _SEH2_TRY
+    {
+        Equal = RtlpCompareAddress(Address, CompareAddress, AddressSize);
+    }
+    _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+    {
+        /* Don't leave the bucket locked for everyone else */
+        RtlpReleaseAddressWaitBucket(Bucket);
+        _SEH2_YIELD(return _SEH2_GetExceptionCode());
+    }
+    _SEH2_END;
+
+    if (!Equal)
+    {
+        RtlpReleaseAddressWaitBucket(Bucket);
+        return STATUS_SUCCESS;
+    }
+
+    WaitBlock.Key = Key;
+    WaitBlock.Woken = FALSE;
+    InsertTailList(&Bucket->WaitList, &WaitBlock.ListEntry);
+    RtlpReleaseAddressWaitBucket(Bucket);
+
+    Status = NtWaitForKeyedEvent(RtlpWaitOnAddressKeyedEvent,
+                                 &WaitBlock,
+                                 FALSE,
+                                 (PLARGE_INTEGER)Timeout);
+    if (Status == STATUS_SUCCESS) return STATUS_SUCCESS;
+
+    /* We timed out, but a waker may have dequeued us in the meantime */
+    RtlpAcquireAddressWaitBucket(Bucket);
+    if (!WaitBlock.Woken)
+    {
+        RemoveEntryList(&WaitBlock.ListEntry);
+        RtlpReleaseAddressWaitBucket(Bucket);
+        return Status;
+    }
+    RtlpReleaseAddressWaitBucket(Bucket);
+
+    /* It did, so it's going to release us. Consume that release. */
+    NtWaitForKeyedEvent(RtlpWaitOnAddressKeyedEvent, &WaitBlock, FALSE, NULL);
+    return STATUS_SUCCESS;
+}
+
+/* EXPORTED FUNCTIONS ********************************************************/
+
+NTSTATUS
+NTAPI
+RtlWaitOnAddress(IN const volatile VOID *Address,
+                 IN PVOID CompareAddress,
+                 IN SIZE_T AddressSize,
+                 IN const LARGE_INTEGER *Timeout OPTIONAL)
+{
+    if ((AddressSize != 1) && (AddressSize != 2) &&
+        (AddressSize != 4) && (AddressSize != 8))
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    return RtlpWaitOnAddress(Address, Address, CompareAddress, AddressSize, Timeout);
+}
+
+VOID
+NTAPI
+RtlWakeAddressAll(IN const volatile VOID *Address)
+{
+    RtlpWakeAddress(Address, TRUE);
+}
+
+VOID
+NTAPI
+RtlWakeAddressSingle(IN const volatile VOID *Address)
+{
+    RtlpWakeAddress(Address, FALSE);
+}
+
+/* EOF */
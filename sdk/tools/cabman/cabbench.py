@@ -0,0 +1,113 @@
+'''
+PROJECT:     ReactOS cabinet manager
+LICENSE:     MIT (https://spdx.org/licenses/MIT)
+PURPOSE:     Measure cabman compression time and ratio on the bootcd file set
+'''
+
+from __future__ import print_function, absolute_import, division
+
+USAGE = """
+This script builds reactos.cab from the reactos.dff of a configured build with
+every compression mode and several thread counts, and prints the time taken and
+the size of each cabinet. Every cabinet is extracted again and compared to the
+files of the uncompressed one.
+
+Specify the build output dir and the source dir as commandline arguments:
+`python cabbench.py C:\\reactos\\output-MinGW-i386 C:\\reactos`
+
+Build the `bootcd` target first, so the dff and all the files it lists exist.
+"""
+
+import filecmp
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+MODES = ['raw', 'mszip', 'lzx:15', 'lzx:18', 'lzx:21']
+
+
+def find_cabman(build_dir):
+    for name in ('cabman', 'cabman.exe'):
+        path = os.path.join(build_dir, 'host-tools', 'bin', name)
+        if os.path.isfile(path):
+            return path
+    return None
+
+
+def build_cab(cabman, dff, source_dir, out_dir, mode, threads):
+    os.mkdir(out_dir)
+    args = [cabman, '-M', mode, '-T', str(threads), '-C', dff,
+            '-L', out_dir, '-N', '-P', source_dir]
+    start = time.time()
+    subprocess.check_call(args, stdout=subprocess.DEVNULL)
+    elapsed = time.time() - start
+    return os.path.join(out_dir, 'reactos.cab'), elapsed
+
+
+def extract_cab(cabman, cab, out_dir):
+    os.mkdir(out_dir)
+    subprocess.check_call([cabman, '-E', '-L', out_dir + os.sep, cab],
+                          stdout=subprocess.DEVNULL)
+
+
+def same_files(left, right):
+    cmp = filecmp.dircmp(left, right)
+    if cmp.left_only or cmp.right_only or cmp.funny_files:
+        return False
+    _, mismatch, errors = filecmp.cmpfiles(left, right, cmp.common_files, shallow=False)
+    return not mismatch and not errors
+
+
+def main(build_dir, source_dir):
+    cabman = find_cabman(build_dir)
+    if not cabman:
+        print('# cabman not found in', build_dir)
+        return 1
+    dff = os.path.join(build_dir, 'boot', 'bootdata', 'packages', 'reactos.dff')
+    if not os.path.isfile(dff):
+        print('# reactos.dff not found, build the bootcd target first')
+        return 1
+
+    thread_counts = sorted(set([1, 2, 4, os.cpu_count() or 1]))
+    work = tempfile.mkdtemp(prefix='cabbench')
+    failed = False
+    try:
+        reference, _ = build_cab(cabman, dff, source_dir, os.path.join(work, 'ref'), 'raw', 1)
+        extract_cab(cabman, reference, os.path.join(work, 'ref_files'))
+        raw_size = os.path.getsize(reference)
+
+        print('%-8s %7s %10s %12s %7s %s' % ('mode', 'threads', 'seconds', 'bytes', 'ratio', 'check'))
+        for mode in MODES:
+            first = None
+            for threads in thread_counts:
+                run = os.path.join(work, '%s_%d' % (mode.replace(':', '_'), threads))
+                cab, elapsed = build_cab(cabman, dff, source_dir, run, mode, threads)
+                size = os.path.getsize(cab)
+
+                # The output must not depend on the number of threads
+                if first is None:
+                    first = cab
+                    extract_cab(cabman, cab, run + '_files')
+                    ok = same_files(os.path.join(work, 'ref_files'), run + '_files')
+                else:
+                    ok = filecmp.cmp(first, cab, shallow=False)
+
+                failed = failed or not ok
+                print('%-8s %7d %10.2f %12d %6.1f%% %s' % (mode, threads, elapsed, size,
+                                                          size * 100.0 / raw_size,
+                                                          'ok' if ok else 'MISMATCH'))
+                sys.stdout.flush()
+    finally:
+        shutil.rmtree(work, ignore_errors=True)
+
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    if len(sys.argv) != 3:
+        print(USAGE)
+        sys.exit(1)
+    sys.exit(main(sys.argv[1], sys.argv[2]))
@@ -27,6 +27,9 @@
 #include "CCFDATAStorage.h"
 #include "raw.h"
 #include "mszip.h"
+#include "lzx.h"
+#include <atomic>
+#include <thread>
 
 #ifndef CAB_READ_ONLY
 
@@ -63,6 +66,63 @@ void DumpBuffer(void* Buffer, ULONG Size)
 #endif /* DBG */
 #endif
 
+
+void CabParallelFor(ULONG Count, ULONG ThreadCount, const std::function<void(ULONG)>& Function)
+/*
+ * FUNCTION: Calls a function for each index on a pool of threads
+ * ARGUMENTS:
+ *     Count       = Number of indices
+ *     ThreadCount = Maximum number of threads to use
+ *     Function    = Function to call for 0 to Count - 1
+ */
+{
+    std::vector<std::thread> Threads;
+    std::atomic<ULONG> Next(0);
+    ULONG i;
+
+    auto Worker = [&]()
+    {
+        ULONG Index;
+
+        while ((Index = Next++) < Count)
+            Function(Index);
+    };
+
+    ThreadCount = std::min(ThreadCount, Count);
+    for (i = 1; i < ThreadCount; i++)
+        Threads.emplace_back(Worker);
+
+    Worker();
+
+    for (std::thread& Thread : Threads)
+        Thread.join();
+}
+
+
+/* CCABCodec */
+
+void CCABCodec::CompressBlocks(PCAB_CODEC_BLOCK Blocks,
+                               ULONG Count,
+                               ULONG ThreadCount)
+/*
+ * FUNCTION: Compresses a sequence of data blocks
+ * ARGUMENTS:
+ *     Blocks      = Pointer to blocks to compress
+ *     Count       = Number of blocks
+ *     ThreadCount = Number of threads to use
+ * NOTES:
+ *     Codecs that compress each block on its own need nothing more
+ */
+{
+    CabParallelFor(Count, ThreadCount, [=](ULONG Index)
+    {
+        Blocks[Index].Status = Compress(Blocks[Index].Output,
+                                        Blocks[Index].Input,
+                                        Blocks[Index].InputLength,
+                                        &Blocks[Index].OutputLength);
+    });
+}
+
 #endif /* CAB_READ_ONLY */
 
 
@@ -83,9 +143,13 @@ CCabinet::CCabinet()
     CabinetReservedFileBuffer = NULL;
     CabinetReservedFileSize = 0;
 
-    Codec          = NULL;
-    CodecId        = -1;
-    CodecSelected  = false;
+    Codec           = NULL;
+    CodecId         = -1;
+    CodecWindowBits = 0;
+    CodecSelected   = false;
+    CodecFolderNode = NULL;
+    DecodedBlockOffset = (ULONG)-1;
+    NextBlockOffset    = (ULONG)-1;
 
     OutputBuffer = NULL;
     InputBuffer  = NULL;
@@ -97,6 +161,11 @@ CCabinet::CCabinet()
     BytesLeftInBlock = 0;
     ReuseBlock       = false;
     CurrentDataNode  = NULL;
+
+#ifndef CAB_READ_ONLY
+    ThreadCount = std::max(std::thread::hardware_concurrency(), 1U);
+    PendingBlockCount = 0;
+#endif
 }
 
 
@@ -292,10 +361,19 @@ bool CCabinet::SetCompressionCodec(const char* CodecName)
  *    CodecName = Pointer to a string with the name of the codec
  */
 {
+    char* End;
+    ULONG WindowBits;
+
     if( !strcasecmp(CodecName, "raw") )
         SelectCodec(CAB_CODEC_RAW);
     else if( !strcasecmp(CodecName, "mszip") )
         SelectCodec(CAB_CODEC_MSZIP);
+    else if( !strcasecmp(CodecName, "lzx") )
+        SelectCodec(CAB_CODEC_LZX);
+    else if( !strncasecmp(CodecName, "lzx:", 4) &&
+             (WindowBits = strtoul(CodecName + 4, &End, 10)) >= LZX_MIN_WINDOW_BITS &&
+             WindowBits <= LZX_MAX_WINDOW_BITS && *End == '\0' )
+        SelectCodec(CAB_CODEC_LZX, WindowBits);
     else
     {
         printf("ERROR: Invalid codec specified!\n");
@@ -545,6 +623,9 @@ void CCabinet::Close()
         fclose(FileHandle);
         FileOpen = false;
     }
+
+    /* Folder nodes go away with the file */
+    CodecFolderNode = NULL;
 }
 
 
@@ -663,6 +744,8 @@ ULONG CCabinet::ExtractFile(const char* FileName)
     ULONG BytesToWrite;
     ULONG TotalBytesRead;
     ULONG CurrentOffset;
+    ULONG BlockOffset = 0;
+    ULONG WindowBits;
     PUCHAR Buffer;
     PUCHAR CurrentBuffer;
     FILE* DestFile;
@@ -695,6 +778,13 @@ ULONG CCabinet::ExtractFile(const char* FileName)
             SelectCodec(CAB_CODEC_MSZIP);
             break;
 
+        case CAB_COMP_LZX:
+            WindowBits = (CurrentFolderNode->Folder.CompressionType >> 8) & 0x1F;
+            if (WindowBits < LZX_MIN_WINDOW_BITS || WindowBits > LZX_MAX_WINDOW_BITS)
+                return CAB_STATUS_UNSUPPCOMP;
+            SelectCodec(CAB_CODEC_LZX, WindowBits);
+            break;
+
         default:
             return CAB_STATUS_UNSUPPCOMP;
     }
@@ -745,7 +835,7 @@ ULONG CCabinet::ExtractFile(const char* FileName)
 
     SetAttributesOnFile(DestName, File->File.Attributes);
 
-    Buffer = (PUCHAR)malloc(CAB_BLOCKSIZE + 12); // This should be enough
+    Buffer = (PUCHAR)malloc(CAB_MAX_COMPBLOCKSIZE);
     if (!Buffer)
     {
         fclose(DestFile);
@@ -756,6 +846,18 @@ ULONG CCabinet::ExtractFile(const char* FileName)
     /* Call OnExtract event handler */
     OnExtract(&File->File, FileName);
 
+    if (CodecId == CAB_CODEC_LZX)
+    {
+        /* LZX blocks depend on the blocks in front of them */
+        Status = SeekDataBlock(File->DataBlock, Buffer);
+        if (Status != CAB_STATUS_SUCCESS)
+        {
+            fclose(DestFile);
+            free(Buffer);
+            return Status;
+        }
+    }
+
     /* Search to start of file */
     if (fseek(FileHandle, (off_t)File->DataBlock->AbsoluteOffset, SEEK_SET) != 0)
     {
@@ -771,7 +873,19 @@ ULONG CCabinet::ExtractFile(const char* FileName)
 
     Skip = true;
 
-    ReuseBlock = (CurrentDataNode == File->DataBlock);
+    if (CodecId == CAB_CODEC_LZX)
+    {
+        /* The previous file may have ended in the same block */
+        ReuseBlock = (File->DataBlock->AbsoluteOffset == DecodedBlockOffset);
+        if (ReuseBlock)
+        {
+            CurrentDataNode  = File->DataBlock;
+            BytesLeftInBlock = DecodedBlockSize;
+        }
+    }
+    else
+        ReuseBlock = (CurrentDataNode == File->DataBlock);
+
     if (Size > 0)
     {
         do
@@ -790,6 +904,7 @@ ULONG CCabinet::ExtractFile(const char* FileName)
                 {
                     DPRINT(MAX_TRACE, ("Size (%u bytes).\n", (UINT)Size));
 
+                    BlockOffset = (ULONG)ftell(FileHandle);
                     if (((Status = ReadBlock(&CFData, sizeof(CFDATA), &BytesRead)) !=
                         CAB_STATUS_SUCCESS) || (BytesRead != sizeof(CFDATA)))
                     {
@@ -804,7 +919,7 @@ ULONG CCabinet::ExtractFile(const char* FileName)
                         CFData.CompSize,
                         CFData.UncompSize));
 
-                    ASSERT(CFData.CompSize <= CAB_BLOCKSIZE + 12);
+                    ASSERT(CFData.CompSize <= CAB_MAX_COMPBLOCKSIZE);
 
                     BytesToRead = CFData.CompSize;
 
@@ -899,12 +1014,16 @@ ULONG CCabinet::ExtractFile(const char* FileName)
                         CurrentDataNode = File->DataBlock;
                         ReuseBlock = true;
 
+                        /* The folder continues in this cabinet */
+                        CodecFolderNode = CurrentFolderNode;
+
                         RestartSearch = true;
                     }
                 } while (CFData.UncompSize == 0);
 
                 DPRINT(MAX_TRACE, ("TotalBytesRead (%u).\n", (UINT)TotalBytesRead));
 
+                BytesToWrite = CFData.UncompSize;
                 Status = Codec->Uncompress(OutputBuffer, Buffer, TotalBytesRead, &BytesToWrite);
                 if (Status != CS_SUCCESS)
                 {
@@ -925,7 +1044,10 @@ ULONG CCabinet::ExtractFile(const char* FileName)
                     return CAB_STATUS_INVALID_CAB;
                 }
 
-                BytesLeftInBlock = BytesToWrite;
+                BytesLeftInBlock   = BytesToWrite;
+                DecodedBlockOffset = BlockOffset;
+                DecodedBlockSize   = BytesToWrite;
+                NextBlockOffset    = (ULONG)ftell(FileHandle);
             }
             else
             {
@@ -1005,6 +1127,78 @@ ULONG CCabinet::ExtractFile(const char* FileName)
     return CAB_STATUS_SUCCESS;
 }
 
+ULONG CCabinet::SeekDataBlock(PCFDATA_NODE DataNode, PUCHAR Buffer)
+/*
+ * FUNCTION: Brings the codec up to a data block of the current folder
+ * ARGUMENTS:
+ *     DataNode = Pointer to data block to be decoded next
+ *     Buffer   = Pointer to buffer for compressed data
+ * RETURNS:
+ *     Status of operation
+ * NOTES:
+ *     For codecs that carry state from block to block. The blocks in
+ *     front of DataNode are decoded unless the codec is already there.
+ */
+{
+    ULONG BytesRead;
+    ULONG Size;
+    ULONG Status;
+    CFDATA CFData;
+
+    if ((CodecFolderNode == CurrentFolderNode) &&
+        ((DataNode->AbsoluteOffset == DecodedBlockOffset) || (DataNode->AbsoluteOffset == NextBlockOffset)))
+        return CAB_STATUS_SUCCESS;
+
+    DPRINT(MAX_TRACE, ("Decoding folder up to block at (0x%X).\n", (UINT)DataNode->AbsoluteOffset));
+
+    Codec->Reset();
+    CodecFolderNode    = CurrentFolderNode;
+    DecodedBlockOffset = (ULONG)-1;
+
+    for (PCFDATA_NODE Node : CurrentFolderNode->DataList)
+    {
+        if (Node == DataNode)
+            break;
+
+        if (fseek(FileHandle, (off_t)Node->AbsoluteOffset, SEEK_SET) != 0)
+        {
+            DPRINT(MIN_TRACE, ("fseek() failed.\n"));
+            return CAB_STATUS_INVALID_CAB;
+        }
+
+        if (((Status = ReadBlock(&CFData, sizeof(CFDATA), &BytesRead)) != CAB_STATUS_SUCCESS) ||
+            (BytesRead != sizeof(CFDATA)) || (CFData.CompSize > CAB_MAX_COMPBLOCKSIZE))
+        {
+            DPRINT(MIN_TRACE, ("Cannot read from file (%u).\n", (UINT)Status));
+            return CAB_STATUS_INVALID_CAB;
+        }
+
+        if (((Status = ReadBlock(Buffer, CFData.CompSize, &BytesRead)) != CAB_STATUS_SUCCESS) ||
+            (BytesRead != CFData.CompSize))
+        {
+            DPRINT(MIN_TRACE, ("Cannot read from file (%u).\n", (UINT)Status));
+            return CAB_STATUS_INVALID_CAB;
+        }
+
+        Size = CFData.UncompSize;
+        Status = Codec->Uncompress(OutputBuffer, Buffer, CFData.CompSize, &Size);
+        if (Status != CS_SUCCESS)
+        {
+            DPRINT(MID_TRACE, ("Cannot uncompress block.\n"));
+            if (Status == CS_NOMEMORY)
+                return CAB_STATUS_NOMEMORY;
+            return CAB_STATUS_INVALID_CAB;
+        }
+
+        DecodedBlockOffset = Node->AbsoluteOffset;
+        DecodedBlockSize   = Size;
+    }
+
+    NextBlockOffset = DataNode->AbsoluteOffset;
+
+    return CAB_STATUS_SUCCESS;
+}
+
 bool CCabinet::IsCodecSelected()
 /*
  * FUNCTION: Returns the value of CodecSelected
@@ -1015,16 +1209,20 @@ bool CCabinet::IsCodecSelected()
     return CodecSelected;
 }
 
-void CCabinet::SelectCodec(LONG Id)
+void CCabinet::SelectCodec(LONG Id, ULONG WindowBits)
 /*
  * FUNCTION: Selects codec engine to use
  * ARGUMENTS:
- *     Id = Codec identifier
+ *     Id         = Codec identifier
+ *     WindowBits = Window size of LZX, 0 for the default
  */
 {
+    if (Id == CAB_CODEC_LZX && WindowBits == 0)
+        WindowBits = LZX_DEFAULT_WINDOW_BITS;
+
     if (CodecSelected)
     {
-        if (Id == CodecId)
+        if (Id == CodecId && WindowBits == CodecWindowBits)
             return;
 
         CodecSelected = false;
@@ -1041,12 +1239,18 @@ void CCabinet::SelectCodec(LONG Id)
             Codec = new CMSZipCodec();
             break;
 
+        case CAB_CODEC_LZX:
+            Codec = new CLZXCodec(WindowBits);
+            break;
+
         default:
             return;
     }
 
-    CodecId       = Id;
-    CodecSelected = true;
+    CodecId         = Id;
+    CodecWindowBits = WindowBits;
+    CodecSelected   = true;
+    CodecFolderNode = NULL;
 }
 
 
@@ -1065,8 +1269,8 @@ ULONG CCabinet::NewCabinet()
 
     CurrentDiskNumber = 0;
 
-    OutputBuffer = malloc(CAB_BLOCKSIZE + 12); // This should be enough
-    InputBuffer  = malloc(CAB_BLOCKSIZE + 12); // This should be enough
+    OutputBuffer = malloc(CAB_MAX_COMPBLOCKSIZE);
+    InputBuffer  = malloc(CAB_MAX_COMPBLOCKSIZE);
     if ((!OutputBuffer) || (!InputBuffer))
     {
         DPRINT(MIN_TRACE, ("Insufficient memory.\n"));
@@ -1074,6 +1278,14 @@ ULONG CCabinet::NewCabinet()
     }
     CurrentIBuffer     = InputBuffer;
     CurrentIBufferSize = 0;
+    CurrentOBufferSize = 0;
+
+    /* Enough blocks to keep every thread busy */
+    PendingBlocks.resize(ThreadCount * 8);
+    PendingInput.resize(PendingBlocks.size() * CAB_BLOCKSIZE);
+    PendingOutput.resize(PendingBlocks.size() * CAB_MAX_COMPBLOCKSIZE);
+    PendingBlockCount = 0;
+    CodecFolderNode   = NULL;
 
     CABHeader.Signature     = CAB_SIGNATURE;
     CABHeader.Reserved1     = 0;            // Not used
@@ -1174,6 +1386,10 @@ ULONG CCabinet::NewFolder()
             CurrentFolderNode->Folder.CompressionType = CAB_COMP_MSZIP;
             break;
 
+        case CAB_CODEC_LZX:
+            CurrentFolderNode->Folder.CompressionType = CAB_COMP_LZX | (USHORT)(CodecWindowBits << 8);
+            break;
+
         default:
             return CAB_STATUS_UNSUPPCOMP;
     }
@@ -1401,6 +1617,10 @@ ULONG CCabinet::CommitDisk(ULONG MoreDisks)
 {
     ULONG Status;
 
+    Status = FlushDataBlocks();
+    if (Status != CAB_STATUS_SUCCESS)
+        return Status;
+
     OnCabinetName(CurrentDiskNumber, CabinetName);
 
     /* Create file, fail if it already exists */
@@ -1499,6 +1719,11 @@ ULONG CCabinet::CloseCabinet()
         OutputBuffer = NULL;
     }
 
+    PendingBlocks.clear();
+    PendingInput.clear();
+    PendingOutput.clear();
+    PendingBlockCount = 0;
+
     Close();
 
     if (ScratchFile)
@@ -1717,6 +1942,20 @@ cleanup2:
     return bRet;
 }
 
+void CCabinet::SetThreadCount(ULONG Count)
+/*
+ * FUNCTION: Sets the number of threads used for compression
+ * ARGUMENTS:
+ *     Count = Number of threads, 0 for one per processor
+ */
+{
+    if (Count == 0)
+        Count = std::max(std::thread::hardware_concurrency(), 1U);
+
+    ThreadCount = Count;
+}
+
+
 void CCabinet::SetMaxDiskSize(ULONG Size)
 /*
  * FUNCTION: Sets the maximum size of the current disk
@@ -2758,13 +2997,33 @@ ULONG CCabinet::WriteDataBlock()
     ULONG Status;
     ULONG BytesWritten;
     PCFDATA_NODE DataNode;
+    CAB_CODEC_BLOCK Block;
+
+    /* Without a disk size limit nothing needs the compressed size of a
+       block before the disk is committed, so blocks are compressed in batches */
+    if ((MaxDiskSize == 0) && (!BlockIsSplit) && (!PendingBlocks.empty()))
+        return QueueDataBlock();
 
     if (!BlockIsSplit)
     {
-        Status = Codec->Compress(OutputBuffer,
-            InputBuffer,
-            CurrentIBufferSize,
-            &TotalCompSize);
+        Status = FlushDataBlocks();
+        if (Status != CAB_STATUS_SUCCESS)
+            return Status;
+
+        Block.Input       = InputBuffer;
+        Block.InputLength = CurrentIBufferSize;
+        Block.Output      = OutputBuffer;
+        Block.FolderStart = (CodecFolderNode != CurrentFolderNode);
+        Block.FolderNode  = CurrentFolderNode;
+        CodecFolderNode   = CurrentFolderNode;
+
+        Codec->CompressBlocks(&Block, 1, 1);
+        if (Block.Status != CS_SUCCESS)
+        {
+            DPRINT(MIN_TRACE, ("Cannot compress block (%u).\n", (UINT)Block.Status));
+            return (Block.Status == CS_NOMEMORY) ? CAB_STATUS_NOMEMORY : CAB_STATUS_FAILURE;
+        }
+        TotalCompSize = Block.OutputLength;
 
         DPRINT(MAX_TRACE, ("Block compressed. CurrentIBufferSize (%u)  TotalCompSize(%u).\n",
             (UINT)CurrentIBufferSize, (UINT)TotalCompSize));
@@ -2835,6 +3094,95 @@ ULONG CCabinet::WriteDataBlock()
     return CAB_STATUS_SUCCESS;
 }
 
+
+ULONG CCabinet::QueueDataBlock()
+/*
+ * FUNCTION: Queues the current data block for compression
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    PCAB_CODEC_BLOCK Block = &PendingBlocks[PendingBlockCount];
+
+    Block->Input       = &PendingInput[PendingBlockCount * CAB_BLOCKSIZE];
+    Block->InputLength = CurrentIBufferSize;
+    Block->Output      = &PendingOutput[PendingBlockCount * CAB_MAX_COMPBLOCKSIZE];
+    Block->FolderStart = (CodecFolderNode != CurrentFolderNode);
+    Block->FolderNode  = CurrentFolderNode;
+    CodecFolderNode    = CurrentFolderNode;
+
+    memcpy(Block->Input, InputBuffer, CurrentIBufferSize);
+    PendingBlockCount++;
+
+    CurrentIBufferSize = 0;
+    CurrentIBuffer     = InputBuffer;
+
+    if (PendingBlockCount == PendingBlocks.size())
+        return FlushDataBlocks();
+
+    return CAB_STATUS_SUCCESS;
+}
+
+
+ULONG CCabinet::FlushDataBlocks()
+/*
+ * FUNCTION: Compresses the queued data blocks and writes them to the scratch file
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    ULONG BytesWritten;
+    ULONG Status;
+    ULONG i;
+    PCAB_CODEC_BLOCK Block;
+    PCFDATA_NODE DataNode;
+
+    if (PendingBlockCount == 0)
+        return CAB_STATUS_SUCCESS;
+
+    Codec->CompressBlocks(&PendingBlocks[0], PendingBlockCount, ThreadCount);
+
+    /* Write them in order, so the output does not depend on the thread count */
+    for (i = 0; i < PendingBlockCount; i++)
+    {
+        Block = &PendingBlocks[i];
+        if (Block->Status != CS_SUCCESS)
+        {
+            DPRINT(MIN_TRACE, ("Cannot compress block (%u).\n", (UINT)Block->Status));
+            return (Block->Status == CS_NOMEMORY) ? CAB_STATUS_NOMEMORY : CAB_STATUS_FAILURE;
+        }
+
+        DataNode = NewDataNode(Block->FolderNode);
+        if (!DataNode)
+        {
+            DPRINT(MIN_TRACE, ("Insufficient memory.\n"));
+            return CAB_STATUS_NOMEMORY;
+        }
+
+        DataNode->Data.CompSize       = (USHORT)Block->OutputLength;
+        DataNode->Data.UncompSize     = (USHORT)Block->InputLength;
+        DataNode->Data.Checksum       = 0;
+        DataNode->ScratchFilePosition = ScratchFile->Position();
+
+        DPRINT(MAX_TRACE, ("Writing block. CompSize (%u)  UncompSize (%u).\n",
+            DataNode->Data.CompSize,
+            DataNode->Data.UncompSize));
+
+        Status = ScratchFile->WriteBlock(&DataNode->Data, Block->Output, &BytesWritten);
+        if (Status != CAB_STATUS_SUCCESS)
+            return Status;
+
+        DiskSize += sizeof(CFDATA) + BytesWritten;
+
+        Block->FolderNode->TotalFolderSize += (BytesWritten + sizeof(CFDATA));
+        Block->FolderNode->Folder.DataBlockCount++;
+    }
+
+    PendingBlockCount = 0;
+
+    return CAB_STATUS_SUCCESS;
+}
+
 #if !defined(_WIN32)
 
 void CCabinet::ConvertDateAndTime(time_t* Time,
@@ -27,6 +27,8 @@
 #include <limits.h>
 #include <string>
 #include <list>
+#include <vector>
+#include <functional>
 
 #ifndef PATH_MAX
 #define PATH_MAX MAX_PATH
@@ -41,6 +43,7 @@
 #define DIR_SEPARATOR_STRING "\\"
 
 #define strcasecmp _stricmp
+#define strncasecmp _strnicmp
 #define strdup _strdup
 #else
 #define DIR_SEPARATOR_CHAR '/'
@@ -108,6 +111,7 @@ extern ULONG DebugTraceLevel;
 #define CAB_SIGNATURE        0x4643534D // "MSCF"
 #define CAB_VERSION          0x0103
 #define CAB_BLOCKSIZE        32768
+#define CAB_MAX_COMPBLOCKSIZE (CAB_BLOCKSIZE + 6144)
 
 #define CAB_COMP_MASK        0x00FF
 #define CAB_COMP_NONE        0x0000
@@ -267,6 +271,21 @@ typedef struct _CAB_SEARCH
 
 /* Codecs */
 
+/* A data block to be compressed */
+typedef struct _CAB_CODEC_BLOCK
+{
+    void* Input;
+    ULONG InputLength;
+    void* Output;                       // CAB_MAX_COMPBLOCKSIZE bytes
+    ULONG OutputLength;
+    ULONG Status;
+    bool FolderStart;                   // true if the block is the first one of its folder
+    PCFFOLDER_NODE FolderNode;
+} CAB_CODEC_BLOCK, *PCAB_CODEC_BLOCK;
+
+/* Calls Function for 0 to Count - 1 on up to ThreadCount threads */
+void CabParallelFor(ULONG Count, ULONG ThreadCount, const std::function<void(ULONG)>& Function);
+
 class CCABCodec
 {
 public:
@@ -284,6 +303,12 @@ public:
                              void* InputBuffer,
                              ULONG InputLength,
                              PULONG OutputLength) = 0;
+    /* Compresses a sequence of data blocks */
+    virtual void CompressBlocks(PCAB_CODEC_BLOCK Blocks,
+                                ULONG Count,
+                                ULONG ThreadCount);
+    /* Starts a new folder, for codecs that carry state from block to block */
+    virtual void Reset() {};
 };
 
 
@@ -340,7 +365,7 @@ public:
     /* Extracts a file from the current cabinet file */
     ULONG ExtractFile(const char* FileName);
     /* Select codec engine to use */
-    void SelectCodec(LONG Id);
+    void SelectCodec(LONG Id, ULONG WindowBits = 0);
     /* Returns whether a codec engine is selected */
     bool IsCodecSelected();
     /* Adds a search criteria for adding files to a simple cabinet, displaying files in a cabinet or extracting them */
@@ -377,6 +402,8 @@ public:
     ULONG AddFile(const std::string& FileName, const std::string& TargetFolder);
     /* Sets the maximum size of the current disk */
     void SetMaxDiskSize(ULONG Size);
+    /* Sets the number of threads used for compression */
+    void SetThreadCount(ULONG Count);
 #endif /* CAB_READ_ONLY */
 
     /* Default event handlers */
@@ -415,6 +442,7 @@ private:
     ULONG ComputeChecksum(void* Buffer, ULONG Size, ULONG Seed);
     ULONG ReadBlock(void* Buffer, ULONG Size, PULONG BytesRead);
     bool MatchFileNamePattern(const char* FileName, const char* Pattern);
+    ULONG SeekDataBlock(PCFDATA_NODE DataNode, PUCHAR Buffer);
 #ifndef CAB_READ_ONLY
     ULONG InitCabinetHeader();
     ULONG WriteCabinetHeader(bool MoreDisks);
@@ -422,6 +450,8 @@ private:
     ULONG WriteFileEntries();
     ULONG CommitDataBlocks(PCFFOLDER_NODE FolderNode);
     ULONG WriteDataBlock();
+    ULONG QueueDataBlock();
+    ULONG FlushDataBlocks();
     ULONG GetAttributesOnFile(PCFFILE_NODE File);
     ULONG SetAttributesOnFile(char* FileName, USHORT FileAttributes);
     ULONG GetFileTimes(FILE* FileHandle, PCFFILE_NODE File);
@@ -459,7 +489,12 @@ private:
     std::list<PSEARCH_CRITERIA> CriteriaList;
     CCABCodec *Codec;
     LONG CodecId;
+    ULONG CodecWindowBits;
     bool CodecSelected;
+    PCFFOLDER_NODE CodecFolderNode;     // Folder the codec state belongs to
+    ULONG DecodedBlockOffset;           // Offset of the block in OutputBuffer
+    ULONG DecodedBlockSize;
+    ULONG NextBlockOffset;              // Offset of the block the codec expects next
     void* InputBuffer;
     void* CurrentIBuffer;               // Current offset in input buffer
     ULONG CurrentIBufferSize;   // Bytes left in input buffer
@@ -484,6 +519,11 @@ private:
     ULONG TotalBytesLeft;
     bool BlockIsSplit;                  // true if current data block is split
     ULONG NextFolderNumber;     // Zero based folder number
+    ULONG ThreadCount;
+    std::vector<CAB_CODEC_BLOCK> PendingBlocks; // Blocks waiting to be compressed
+    ULONG PendingBlockCount;
+    std::vector<UCHAR> PendingInput;
+    std::vector<UCHAR> PendingOutput;
 #endif /* CAB_READ_ONLY */
 };
 
@@ -192,8 +192,8 @@ void CCABManager::Usage()
 {
     printf("ReactOS Cabinet Manager\n\n");
     printf("CABMAN [-D | -E] [-A] [-L dir] cabinet [filename ...]\n");
-    printf("CABMAN [-M mode] -C dirfile [-I] [-RC file] [-P dir]\n");
-    printf("CABMAN [-M mode] -S cabinet filename [-F folder] [filename] [...]\n");
+    printf("CABMAN [-M mode] [-T threads] -C dirfile [-I] [-RC file] [-P dir]\n");
+    printf("CABMAN [-M mode] [-T threads] -S cabinet filename [-F folder] [filename] [...]\n");
     printf("  cabinet   Cabinet file.\n");
     printf("  filename  Name of the file to add to or extract from the cabinet.\n");
     printf("            Wild cards and multiple filenames\n");
@@ -213,10 +213,14 @@ void CCABManager::Usage()
     printf("  -M mode   Specify the compression method to use:\n");
     printf("               raw    - No compression\n");
     printf("               mszip  - MsZip compression (default)\n");
+    printf("               lzx[:n] - LZX compression with a 2^n byte window,\n");
+    printf("                        n is 15 to 21 (default 21)\n");
     printf("  -N        Don't create the .inf file, only the cabinet.\n");
     printf("  -RC       Specify file to put in cabinet reserved area\n");
     printf("            (size must be less than 64KB).\n");
     printf("  -S        Create simple cabinet.\n");
+    printf("  -T n      Number of threads used for compression\n");
+    printf("            (default is one per processor).\n");
     printf("  -P dir    Files in the .dff are relative to this directory.\n");
     printf("  -V        Verbose mode (prints more messages).\n");
 }
@@ -350,6 +354,18 @@ bool CCABManager::ParseCmdline(int argc, char* argv[])
                     Mode = CM_MODE_CREATE_SIMPLE;
                     break;
 
+                case 't':
+                case 'T':
+                    if (argv[i][2] == 0)
+                    {
+                        i++;
+                        SetThreadCount(strtoul(&argv[i][0], NULL, 10));
+                    }
+                    else
+                        SetThreadCount(strtoul(&argv[i][2], NULL, 10));
+
+                    break;
+
                 case 'P':
                     if (argv[i][2] == 0)
                     {
@@ -0,0 +1,1399 @@
+/*
+ * COPYRIGHT:   See COPYING in the top level directory
+ * PROJECT:     ReactOS cabinet manager
+ * FILE:        tools/cabman/lzx.cxx
+ * PURPOSE:     CAB codec for LZX compressed data
+ * NOTES:       Every CFDATA block is one 32K frame and the compressor
+ *              emits one LZX block per frame. The decoder also reads
+ *              blocks spanning frames as written by other compressors.
+ */
+#include <algorithm>
+#include "lzx.h"
+
+#define LZX_HASH_BITS           16
+#define LZX_CHAIN_DEPTH         48
+#define LZX_NICE_LENGTH         128
+#define LZX_FAR_MIN_MATCH       4096    // Offsets from here need 4 bytes to pay off
+#define LZX_NO_SYMBOL           0xFFFF
+
+/* Number of position slots for each window size */
+static const UCHAR PositionSlots[] = { 30, 32, 34, 36, 38, 42, 50 };
+
+/* A token translated to its Huffman symbols */
+typedef struct _LZX_SYMBOL
+{
+    USHORT Main;
+    USHORT Length;              // Length tree symbol or LZX_NO_SYMBOL
+    ULONG Footer;               // Position footer
+    ULONG FooterBits;
+} LZX_SYMBOL, *PLZX_SYMBOL;
+
+
+/* Position slots */
+
+static inline ULONG LzxExtraBits(ULONG Slot)
+{
+    if (Slot < 4)
+        return 0;
+    if (Slot < 36)
+        return (Slot - 2) >> 1;
+    return 17;
+}
+
+static inline ULONG LzxPositionBase(ULONG Slot)
+{
+    if (Slot < 4)
+        return Slot;
+    if (Slot < 36)
+        return (2 | (Slot & 1)) << ((Slot - 2) >> 1);
+    return 262144 + ((Slot - 36) << 17);
+}
+
+static inline ULONG LzxPositionSlot(ULONG FormattedOffset)
+{
+    ULONG Bit;
+
+    if (FormattedOffset < 4)
+        return FormattedOffset;
+    if (FormattedOffset >= 262144)
+        return 36 + ((FormattedOffset - 262144) >> 17);
+
+    for (Bit = 2; (FormattedOffset >> (Bit + 1)) != 0; Bit++);
+    return 2 * Bit + ((FormattedOffset >> (Bit - 1)) & 1);
+}
+
+
+/* Huffman codes */
+
+static void LzxBuildLengths(const ULONG* Frequencies, ULONG Count, ULONG MaxLength, PUCHAR Lengths)
+/*
+ * FUNCTION: Builds a complete Huffman code no longer than MaxLength bits
+ * ARGUMENTS:
+ *     Frequencies = Number of times each symbol is used
+ *     Count       = Number of symbols
+ *     MaxLength   = Longest code allowed
+ *     Lengths     = Address of buffer to place the code lengths
+ */
+{
+    std::vector<ULONG> Weights(Frequencies, Frequencies + Count);
+    std::vector<ULONG> Order, Nodes, Parents, Depths;
+    ULONG Used, Leaf, Inner, First, Second, MaxDepth, i;
+    LONG Node;
+
+    /* A complete code needs at least two symbols */
+    for (Used = 0, i = 0; i < Count; i++)
+        Used += (Weights[i] != 0);
+    for (i = 0; Used < 2 && i < Count; i++)
+    {
+        if (!Weights[i])
+        {
+            Weights[i] = 1;
+            Used++;
+        }
+    }
+
+    for (;;)
+    {
+        Order.clear();
+        for (i = 0; i < Count; i++)
+        {
+            if (Weights[i])
+                Order.push_back(i);
+        }
+        std::stable_sort(Order.begin(), Order.end(), [&](ULONG a, ULONG b) { return Weights[a] < Weights[b]; });
+
+        /* Leaves come sorted, inner nodes are created in order of weight */
+        Nodes.resize(2 * Used - 1);
+        Parents.resize(2 * Used - 1);
+        Depths.resize(2 * Used - 1);
+        for (i = 0; i < Used; i++)
+            Nodes[i] = Weights[Order[i]];
+
+        Leaf = 0;
+        Inner = Used;
+        for (i = Used; i < 2 * Used - 1; i++)
+        {
+            First = (Leaf < Used && (Inner >= i || Nodes[Leaf] <= Nodes[Inner])) ? Leaf++ : Inner++;
+            Second = (Leaf < Used && (Inner >= i || Nodes[Leaf] <= Nodes[Inner])) ? Leaf++ : Inner++;
+            Nodes[i] = Nodes[First] + Nodes[Second];
+            Parents[First] = Parents[Second] = i;
+        }
+
+        MaxDepth = 0;
+        Depths[2 * Used - 2] = 0;
+        for (Node = 2 * Used - 3; Node >= 0; Node--)
+        {
+            Depths[Node] = Depths[Parents[Node]] + 1;
+            MaxDepth = std::max(MaxDepth, Depths[Node]);
+        }
+
+        if (MaxDepth <= MaxLength)
+            break;
+
+        /* Flatten the distribution until the code is short enough */
+        for (i = 0; i < Count; i++)
+        {
+            if (Weights[i])
+                Weights[i] = (Weights[i] >> 1) | 1;
+        }
+    }
+
+    memset(Lengths, 0, Count);
+    for (i = 0; i < Used; i++)
+        Lengths[Order[i]] = (UCHAR)Depths[i];
+}
+
+
+static void LzxBuildCodes(const UCHAR* Lengths, ULONG Count, PUSHORT Codes)
+/*
+ * FUNCTION: Assigns canonical codes to the symbols of a Huffman code
+ * ARGUMENTS:
+ *     Lengths = Code length of each symbol
+ *     Count   = Number of symbols
+ *     Codes   = Address of buffer to place the codes
+ */
+{
+    ULONG LengthCount[LZX_MAX_CODE_LENGTH + 1] = { 0 };
+    ULONG NextCode[LZX_MAX_CODE_LENGTH + 1];
+    ULONG Code = 0, Bits, i;
+
+    for (i = 0; i < Count; i++)
+        LengthCount[Lengths[i]]++;
+    LengthCount[0] = 0;
+
+    for (Bits = 1; Bits <= LZX_MAX_CODE_LENGTH; Bits++)
+    {
+        Code = (Code + LengthCount[Bits - 1]) << 1;
+        NextCode[Bits] = Code;
+    }
+
+    for (i = 0; i < Count; i++)
+    {
+        if (Lengths[i])
+            Codes[i] = (USHORT)NextCode[Lengths[i]]++;
+    }
+}
+
+
+static bool LzxBuildTable(PLZX_DECODE_TABLE Table, const UCHAR* Lengths, ULONG Count)
+/*
+ * FUNCTION: Builds a decoding table from code lengths
+ * ARGUMENTS:
+ *     Table   = Pointer to table to fill
+ *     Lengths = Code length of each symbol
+ *     Count   = Number of symbols
+ * RETURNS:
+ *     false if the lengths do not describe a prefix code
+ */
+{
+    USHORT Offsets[LZX_MAX_CODE_LENGTH + 1];
+    LONG Left = 1;
+    ULONG Bits, i;
+
+    memset(Table->Count, 0, sizeof(Table->Count));
+    for (i = 0; i < Count; i++)
+        Table->Count[Lengths[i]]++;
+    Table->Count[0] = 0;
+
+    for (Bits = 1; Bits <= LZX_MAX_CODE_LENGTH; Bits++)
+    {
+        Left = (Left << 1) - Table->Count[Bits];
+        if (Left < 0)
+            return false;
+    }
+
+    Offsets[1] = 0;
+    for (Bits = 1; Bits < LZX_MAX_CODE_LENGTH; Bits++)
+        Offsets[Bits + 1] = Offsets[Bits] + Table->Count[Bits];
+
+    for (i = 0; i < Count; i++)
+    {
+        if (Lengths[i])
+            Table->Symbols[Offsets[Lengths[i]]++] = (USHORT)i;
+    }
+
+    return true;
+}
+
+
+/* CLZXBitWriter */
+
+/* Writes 16-bit little endian words, filled from the most significant bit */
+class CLZXBitWriter
+{
+public:
+    CLZXBitWriter(void* Buffer, ULONG Size)
+    {
+        Start = Current = (PUCHAR)Buffer;
+        End = Start + Size;
+        BitBuffer = 0;
+        BitCount = 0;
+        Overflow = false;
+    }
+
+    void PutByte(UCHAR Byte)
+    {
+        if (Current < End)
+            *Current++ = Byte;
+        else
+            Overflow = true;
+    }
+
+    void PutBits(ULONG Value, ULONG Count)
+    {
+        if (Count > 16)
+        {
+            PutBits(Value >> 16, Count - 16);
+            Count = 16;
+        }
+
+        BitBuffer = (BitBuffer << Count) | (Value & ((1 << Count) - 1));
+        BitCount += Count;
+        if (BitCount >= 16)
+        {
+            BitCount -= 16;
+            PutByte((UCHAR)(BitBuffer >> BitCount));
+            PutByte((UCHAR)(BitBuffer >> (BitCount + 8)));
+        }
+    }
+
+    void Align()
+    {
+        if (BitCount)
+            PutBits(0, 16 - BitCount);
+    }
+
+    bool IsAligned()
+    {
+        return (BitCount == 0);
+    }
+
+    ULONG GetLength()
+    {
+        return (ULONG)(Current - Start);
+    }
+
+    bool Overflow;
+private:
+    PUCHAR Start;
+    PUCHAR Current;
+    PUCHAR End;
+    ULONG BitBuffer;
+    ULONG BitCount;
+};
+
+
+static void LzxWriteBlockHeader(CLZXBitWriter& Writer, bool FolderHeader, ULONG Type, ULONG Length)
+/*
+ * FUNCTION: Writes the header of a block
+ * ARGUMENTS:
+ *     Writer       = Bit stream to write to
+ *     FolderHeader = true if this is the first block of the folder
+ *     Type         = Block type
+ *     Length       = Uncompressed size of the block
+ */
+{
+    if (FolderHeader)
+    {
+        /* Turn on the x86 call translation */
+        Writer.PutBits(1, 1);
+        Writer.PutBits(LZX_E8_FILE_SIZE >> 16, 16);
+        Writer.PutBits(LZX_E8_FILE_SIZE & 0xFFFF, 16);
+    }
+
+    Writer.PutBits(Type, 3);
+    Writer.PutBits(Length >> 8, 16);
+    Writer.PutBits(Length & 0xFF, 8);
+}
+
+
+static void LzxWriteLengths(CLZXBitWriter& Writer, const UCHAR* Lengths, PUCHAR Previous, ULONG First, ULONG Last)
+/*
+ * FUNCTION: Writes code lengths as differences to the previous block through the pretree
+ * ARGUMENTS:
+ *     Writer   = Bit stream to write to
+ *     Lengths  = New code lengths
+ *     Previous = Code lengths of the previous block, updated
+ *     First    = First symbol to write
+ *     Last     = Symbol after the last one to write
+ */
+{
+    ULONG Frequencies[LZX_PRETREE_NUM_ELEMENTS] = { 0 };
+    UCHAR PreLengths[LZX_PRETREE_NUM_ELEMENTS];
+    USHORT PreCodes[LZX_PRETREE_NUM_ELEMENTS];
+    ULONG Items[LZX_MAINTREE_MAXSYMBOLS];
+    ULONG ItemCount = 0, Run, Symbol, Extra, Delta, i;
+
+    /* Items are the pretree symbol, its extra bits and the delta of a run */
+    for (i = First; i < Last; i += Run)
+    {
+        for (Run = 1; i + Run < Last && Lengths[i + Run] == Lengths[i]; Run++);
+
+        Delta = (Previous[i] + 17 - Lengths[i]) % 17;
+        Extra = 0;
+        if (Lengths[i] == 0 && Run >= 20)
+        {
+            Run = std::min(Run, (ULONG)51);
+            Symbol = 18;
+            Extra = Run - 20;
+        }
+        else if (Lengths[i] == 0 && Run >= 4)
+        {
+            Run = std::min(Run, (ULONG)19);
+            Symbol = 17;
+            Extra = Run - 4;
+        }
+        else if (Run >= 4)
+        {
+            Run = std::min(Run, (ULONG)5);
+            Symbol = 19;
+            Extra = Run - 4;
+            Frequencies[Delta]++;
+        }
+        else
+        {
+            Run = 1;
+            Symbol = Delta;
+        }
+
+        Frequencies[Symbol]++;
+        Items[ItemCount++] = Symbol | (Extra << 8) | (Delta << 16);
+    }
+
+    LzxBuildLengths(Frequencies, LZX_PRETREE_NUM_ELEMENTS, 15, PreLengths);
+    LzxBuildCodes(PreLengths, LZX_PRETREE_NUM_ELEMENTS, PreCodes);
+
+    for (i = 0; i < LZX_PRETREE_NUM_ELEMENTS; i++)
+        Writer.PutBits(PreLengths[i], 4);
+
+    for (i = 0; i < ItemCount; i++)
+    {
+        Symbol = Items[i] & 0xFF;
+        Extra = (Items[i] >> 8) & 0xFF;
+        Delta = Items[i] >> 16;
+
+        Writer.PutBits(PreCodes[Symbol], PreLengths[Symbol]);
+        if (Symbol == 17)
+            Writer.PutBits(Extra, 4);
+        else if (Symbol == 18)
+            Writer.PutBits(Extra, 5);
+        else if (Symbol == 19)
+        {
+            Writer.PutBits(Extra, 1);
+            Writer.PutBits(PreCodes[Delta], PreLengths[Delta]);
+        }
+    }
+
+    memcpy(Previous + First, Lengths + First, Last - First);
+}
+
+
+/* CLZXCodec */
+
+CLZXCodec::CLZXCodec(ULONG WindowBits)
+/*
+ * FUNCTION: Constructor
+ * ARGUMENTS:
+ *     WindowBits = Base two logarithm of the window size
+ */
+{
+    ASSERT(WindowBits >= LZX_MIN_WINDOW_BITS && WindowBits <= LZX_MAX_WINDOW_BITS);
+
+    this->WindowBits = WindowBits;
+    WindowSize   = 1 << WindowBits;
+    MainElements = LZX_NUM_CHARS + PositionSlots[WindowBits - LZX_MIN_WINDOW_BITS] * 8;
+
+    Reset();
+}
+
+
+CLZXCodec::~CLZXCodec()
+/*
+ * FUNCTION: Default destructor
+ */
+{
+}
+
+
+void CLZXCodec::Reset()
+/*
+ * FUNCTION: Starts a new folder
+ */
+{
+    History.clear();
+    HeaderWritten = false;
+    FolderOffset  = 0;
+    FrameCount    = 0;
+    Repeated[0] = Repeated[1] = Repeated[2] = 1;
+    memset(MainLengths, 0, sizeof(MainLengths));
+    memset(LengthLengths, 0, sizeof(LengthLengths));
+
+    Window.assign(Window.empty() ? 0 : WindowSize, 0);
+    WindowPosition = 0;
+    FramePosition  = 0;
+    DecodedFrames  = 0;
+    IntelFileSize  = 0;
+    IntelPosition  = 0;
+    IntelStarted   = false;
+    HeaderRead     = false;
+    BlockType      = 0;
+    BlockLength    = 0;
+    BlockRemaining = 0;
+    DecodeRepeated[0] = DecodeRepeated[1] = DecodeRepeated[2] = 1;
+    memset(DecodeMainLengths, 0, sizeof(DecodeMainLengths));
+    memset(DecodeLengthLengths, 0, sizeof(DecodeLengthLengths));
+}
+
+
+ULONG CLZXCodec::Compress(void* OutputBuffer,
+                          void* InputBuffer,
+                          ULONG InputLength,
+                          PULONG OutputLength)
+/*
+ * FUNCTION: Compresses the next data block of the folder
+ * ARGUMENTS:
+ *     OutputBuffer   = Pointer to buffer to place compressed data
+ *     InputBuffer    = Pointer to buffer with data to be compressed
+ *     InputLength    = Length of input buffer
+ *     OutputLength   = Address of buffer to place size of compressed data
+ */
+{
+    CAB_CODEC_BLOCK Block;
+
+    Block.Input       = InputBuffer;
+    Block.InputLength = InputLength;
+    Block.Output      = OutputBuffer;
+    Block.FolderStart = false;
+    Block.FolderNode  = NULL;
+
+    CompressBlocks(&Block, 1, 1);
+
+    *OutputLength = Block.OutputLength;
+    return Block.Status;
+}
+
+
+void CLZXCodec::CompressBlocks(PCAB_CODEC_BLOCK Blocks,
+                               ULONG Count,
+                               ULONG ThreadCount)
+/*
+ * FUNCTION: Compresses the data blocks of one or more folders in order
+ * ARGUMENTS:
+ *     Blocks      = Pointer to blocks to compress
+ *     Count       = Number of blocks
+ *     ThreadCount = Number of threads to use
+ * NOTES:
+ *     Matches are searched for on all threads, each block is parsed on
+ *     its own from its start. Only the Huffman coding, which has to
+ *     follow the repeated offsets and code lengths from block to block,
+ *     is done in order. The output does not depend on how the blocks are
+ *     batched or on the number of threads.
+ */
+{
+    std::vector<ULONG> Starts(Count + 1), FolderStarts(Count);
+    std::vector<std::vector<LZX_TOKEN>> Tokens(Count);
+    ULONG Position, FolderStart, Keep, i;
+
+    /* Lay out the translated blocks after the history they can refer to */
+    Position = (ULONG)History.size();
+    for (i = 0; i < Count; i++)
+        Position += Blocks[i].InputLength;
+    Data.resize(Position);
+
+    if (!History.empty())
+        memcpy(&Data[0], &History[0], History.size());
+    Position = (ULONG)History.size();
+    FolderStart = 0;
+
+    for (i = 0; i < Count; i++)
+    {
+        if (Blocks[i].FolderStart)
+        {
+            FolderStart  = Position;
+            FolderOffset = 0;
+            FrameCount   = 0;
+        }
+
+        Starts[i] = Position;
+        FolderStarts[i] = FolderStart;
+        if (Blocks[i].InputLength)
+            memcpy(&Data[Position], Blocks[i].Input, Blocks[i].InputLength);
+        TranslateE8(&Data[Position], Blocks[i].InputLength);
+
+        Position += Blocks[i].InputLength;
+        FolderOffset += Blocks[i].InputLength;
+        FrameCount++;
+    }
+    Starts[Count] = Position;
+
+    BuildHashChains(Position);
+
+    CabParallelFor(Count, ThreadCount, [&](ULONG Index)
+    {
+        ParseBlock(FolderStarts[Index], Starts[Index], Starts[Index + 1], Tokens[Index]);
+    });
+
+    for (i = 0; i < Count; i++)
+    {
+        if (Blocks[i].FolderStart)
+        {
+            HeaderWritten = false;
+            Repeated[0] = Repeated[1] = Repeated[2] = 1;
+            memset(MainLengths, 0, sizeof(MainLengths));
+            memset(LengthLengths, 0, sizeof(LengthLengths));
+        }
+
+        Blocks[i].Status = EncodeBlock(&Blocks[i], &Data[Starts[i]], Tokens[i]);
+    }
+
+    /* Keep what the next blocks of the folder can refer to */
+    Keep = std::min(Position - FolderStart, WindowSize);
+    History.assign(Data.begin() + (Position - Keep), Data.begin() + Position);
+}
+
+
+void CLZXCodec::TranslateE8(PUCHAR Buffer, ULONG Length)
+/*
+ * FUNCTION: Turns the relative targets of x86 CALL instructions into absolute ones
+ * ARGUMENTS:
+ *     Buffer = Pointer to block to translate in place
+ *     Length = Size of block
+ */
+{
+    LONGLONG Current, Relative, Absolute;
+    ULONG i;
+
+    /* Mirrors the decoder, which stops after 32768 frames and skips the last 10 bytes */
+    if (FrameCount >= 32768 || Length <= 10)
+        return;
+
+    for (i = 0; i < Length - 10; i++)
+    {
+        if (Buffer[i] != 0xE8)
+            continue;
+
+        Current  = (LONGLONG)FolderOffset + i;
+        Relative = (LONG)(Buffer[i + 1] | (Buffer[i + 2] << 8) | (Buffer[i + 3] << 16) | ((ULONG)Buffer[i + 4] << 24));
+
+        if (Relative >= -Current && Relative < LZX_E8_FILE_SIZE - Current)
+            Absolute = Relative + Current;
+        else if (Relative >= LZX_E8_FILE_SIZE - Current && Relative < LZX_E8_FILE_SIZE)
+            Absolute = Relative - LZX_E8_FILE_SIZE;
+        else
+            Absolute = Relative;
+
+        Buffer[i + 1] = (UCHAR)Absolute;
+        Buffer[i + 2] = (UCHAR)(Absolute >> 8);
+        Buffer[i + 3] = (UCHAR)(Absolute >> 16);
+        Buffer[i + 4] = (UCHAR)(Absolute >> 24);
+        i += 4;
+    }
+}
+
+
+void CLZXCodec::BuildHashChains(ULONG Size)
+/*
+ * FUNCTION: Links every position to the previous one starting with the same three bytes
+ * ARGUMENTS:
+ *     Size = Number of bytes in the data buffer
+ */
+{
+    ULONG Hash, i;
+
+    Head.assign(1 << LZX_HASH_BITS, -1);
+    Chain.resize(Size);
+
+    for (i = 0; i + 2 < Size; i++)
+    {
+        Hash = ((Data[i] | (Data[i + 1] << 8) | (Data[i + 2] << 16)) * 2654435761U) >> (32 - LZX_HASH_BITS);
+        Chain[i] = Head[Hash];
+        Head[Hash] = (LONG)i;
+    }
+
+    for (; i < Size; i++)
+        Chain[i] = -1;
+}
+
+
+LONG CLZXCodec::FindMatch(ULONG FolderStart, ULONG Position, ULONG End,
+                          const ULONG* Repeated, PULONG Length, PULONG Offset)
+/*
+ * FUNCTION: Finds the most profitable match at a position
+ * ARGUMENTS:
+ *     FolderStart = Position of the first byte of the folder
+ *     Position    = Position to find a match for
+ *     End         = End of the block
+ *     Repeated    = Repeated offsets of the parser
+ *     Length      = Address of buffer to place the match length
+ *     Offset      = Address of buffer to place the match offset
+ * RETURNS:
+ *     Score of the match, 0 if there is none
+ */
+{
+    const UCHAR* Current = &Data[Position];
+    const UCHAR* Match;
+    ULONG MaxLength = std::min(End - Position, (ULONG)LZX_MAX_MATCH);
+    ULONG BestLength = 0, MatchLength, Distance, Depth, i;
+    LONG BestScore = 0, Score, Candidate;
+
+    if (MaxLength < LZX_MIN_MATCH)
+        return 0;
+
+    /* Repeated offsets do not need a footer, so they beat a slightly longer match */
+    for (i = 0; i < 3; i++)
+    {
+        if (Repeated[i] > Position - FolderStart)
+            continue;
+
+        Match = Current - Repeated[i];
+        for (MatchLength = 0;
+             MatchLength < MaxLength && Current[MatchLength] == Match[MatchLength];
+             MatchLength++);
+
+        Score = MatchLength * 8;
+        if (MatchLength >= LZX_MIN_MATCH && Score > BestScore)
+        {
+            BestScore  = Score;
+            BestLength = MatchLength;
+            *Length = MatchLength;
+            *Offset = Repeated[i];
+        }
+    }
+
+    if (MaxLength < 3 || BestLength == MaxLength)
+        return BestScore;
+
+    for (Candidate = Chain[Position], Depth = LZX_CHAIN_DEPTH;
+         Candidate >= (LONG)FolderStart && Depth > 0;
+         Candidate = Chain[Candidate], Depth--)
+    {
+        Distance = Position - Candidate;
+        if (Distance > WindowSize - 3)
+            break;
+
+        if (Data[Candidate + BestLength] != Current[BestLength])
+            continue;
+
+        for (MatchLength = 0;
+             MatchLength < MaxLength && Current[MatchLength] == Data[Candidate + MatchLength];
+             MatchLength++);
+
+        if (MatchLength < 3 || (MatchLength == 3 && Distance >= LZX_FAR_MIN_MATCH))
+            continue;
+
+        Score = MatchLength * 8 - LzxExtraBits(LzxPositionSlot(Distance + 2));
+        if (Score > BestScore)
+        {
+            BestScore  = Score;
+            BestLength = MatchLength;
+            *Length = MatchLength;
+            *Offset = Distance;
+
+            if (MatchLength >= LZX_NICE_LENGTH || MatchLength == MaxLength)
+                break;
+        }
+    }
+
+    return BestScore;
+}
+
+
+void CLZXCodec::ParseBlock(ULONG FolderStart, ULONG Start, ULONG End, std::vector<LZX_TOKEN>& Tokens)
+/*
+ * FUNCTION: Splits a block into literals and matches
+ * ARGUMENTS:
+ *     FolderStart = Position of the first byte of the folder
+ *     Start       = Position of the first byte of the block
+ *     End         = End of the block
+ *     Tokens      = Receives the literals and matches
+ * NOTES:
+ *     Uses lazy matching: a match is given up for a literal when the
+ *     next position has a better one. The repeated offsets are tracked
+ *     from the start of the block only, so blocks can be parsed in parallel.
+ */
+{
+    ULONG Repeated[3] = { 1, 1, 1 };
+    ULONG Position = Start, Length = 0, Offset = 0, NextLength, NextOffset;
+    LONG Score, NextScore;
+    LZX_TOKEN Token;
+
+    Tokens.clear();
+    if (Start == End)
+        return;
+
+    Score = FindMatch(FolderStart, Position, End, Repeated, &Length, &Offset);
+    while (Position < End)
+    {
+        if (Score > 0 && Length < LZX_NICE_LENGTH && Position + 1 < End)
+        {
+            NextScore = FindMatch(FolderStart, Position + 1, End, Repeated, &NextLength, &NextOffset);
+            if (NextScore > Score)
+            {
+                Token.Value  = Data[Position++];
+                Token.Length = 0;
+                Tokens.push_back(Token);
+
+                Score  = NextScore;
+                Length = NextLength;
+                Offset = NextOffset;
+                continue;
+            }
+        }
+
+        if (Score > 0)
+        {
+            Token.Value  = Offset;
+            Token.Length = Length;
+            Position += Length;
+
+            if (Offset == Repeated[1])
+                std::swap(Repeated[0], Repeated[1]);
+            else if (Offset == Repeated[2])
+                std::swap(Repeated[0], Repeated[2]);
+            else if (Offset != Repeated[0])
+            {
+                Repeated[2] = Repeated[1];
+                Repeated[1] = Repeated[0];
+                Repeated[0] = Offset;
+            }
+        }
+        else
+        {
+            Token.Value  = Data[Position++];
+            Token.Length = 0;
+        }
+        Tokens.push_back(Token);
+
+        if (Position < End)
+            Score = FindMatch(FolderStart, Position, End, Repeated, &Length, &Offset);
+    }
+}
+
+
+ULONG CLZXCodec::EncodeBlock(PCAB_CODEC_BLOCK Block, const UCHAR* Buffer, const std::vector<LZX_TOKEN>& Tokens)
+/*
+ * FUNCTION: Writes the Huffman coded block for a frame
+ * ARGUMENTS:
+ *     Block  = Pointer to block to write the output to
+ *     Buffer = Pointer to translated data of the block
+ *     Tokens = Literals and matches of the block
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    ULONG MainFrequencies[LZX_MAINTREE_MAXSYMBOLS] = { 0 };
+    ULONG LengthFrequencies[LZX_NUM_SECONDARY_LENGTHS] = { 0 };
+    ULONG AlignedFrequencies[LZX_ALIGNED_NUM_ELEMENTS] = { 0 };
+    UCHAR NewMainLengths[LZX_MAINTREE_MAXSYMBOLS];
+    UCHAR NewLengthLengths[LZX_NUM_SECONDARY_LENGTHS];
+    UCHAR NewAlignedLengths[LZX_ALIGNED_NUM_ELEMENTS];
+    USHORT MainCodes[LZX_MAINTREE_MAXSYMBOLS];
+    USHORT LengthCodes[LZX_NUM_SECONDARY_LENGTHS];
+    USHORT AlignedCodes[LZX_ALIGNED_NUM_ELEMENTS];
+    UCHAR SavedMainLengths[LZX_MAINTREE_MAXSYMBOLS];
+    UCHAR SavedLengthLengths[LZX_NUM_SECONDARY_LENGTHS];
+    ULONG SavedRepeated[3];
+    std::vector<LZX_SYMBOL> Symbols(Tokens.size());
+    ULONG Slot, Header, FormattedOffset, VerbatimCost, AlignedCost, Type, i;
+    CLZXBitWriter Writer(Block->Output, CAB_MAX_COMPBLOCKSIZE);
+
+    if (Block->InputLength == 0)
+    {
+        Block->OutputLength = 0;
+        return CS_SUCCESS;
+    }
+
+    memcpy(SavedMainLengths, MainLengths, sizeof(MainLengths));
+    memcpy(SavedLengthLengths, LengthLengths, sizeof(LengthLengths));
+    memcpy(SavedRepeated, Repeated, sizeof(Repeated));
+
+    /* Turn the tokens into symbols, following the real repeated offsets */
+    for (i = 0; i < Tokens.size(); i++)
+    {
+        PLZX_SYMBOL Symbol = &Symbols[i];
+
+        Symbol->Length     = LZX_NO_SYMBOL;
+        Symbol->Footer     = 0;
+        Symbol->FooterBits = 0;
+
+        if (Tokens[i].Length == 0)
+        {
+            Symbol->Main = (USHORT)Tokens[i].Value;
+            MainFrequencies[Symbol->Main]++;
+            continue;
+        }
+
+        if (Tokens[i].Value == Repeated[0])
+            Slot = 0;
+        else if (Tokens[i].Value == Repeated[1])
+        {
+            Slot = 1;
+            std::swap(Repeated[0], Repeated[1]);
+        }
+        else if (Tokens[i].Value == Repeated[2])
+        {
+            Slot = 2;
+            std::swap(Repeated[0], Repeated[2]);
+        }
+        else
+        {
+            FormattedOffset    = Tokens[i].Value + 2;
+            Slot               = LzxPositionSlot(FormattedOffset);
+            Symbol->Footer     = FormattedOffset - LzxPositionBase(Slot);
+            Symbol->FooterBits = LzxExtraBits(Slot);
+            if (Symbol->FooterBits >= 3)
+                AlignedFrequencies[Symbol->Footer & 7]++;
+
+            Repeated[2] = Repeated[1];
+            Repeated[1] = Repeated[0];
+            Repeated[0] = Tokens[i].Value;
+        }
+
+        Header = std::min(Tokens[i].Length - LZX_MIN_MATCH, (ULONG)LZX_NUM_PRIMARY_LENGTHS);
+        Symbol->Main = (USHORT)(LZX_NUM_CHARS + (Slot << 3) + Header);
+        MainFrequencies[Symbol->Main]++;
+
+        if (Header == LZX_NUM_PRIMARY_LENGTHS)
+        {
+            Symbol->Length = (USHORT)(Tokens[i].Length - LZX_MIN_MATCH - LZX_NUM_PRIMARY_LENGTHS);
+            LengthFrequencies[Symbol->Length]++;
+        }
+    }
+
+    /* The decoder only undoes the x86 call translation once it has seen 0xE8 in a tree */
+    if (MainFrequencies[0xE8] == 0)
+        MainFrequencies[0xE8] = 1;
+
+    LzxBuildLengths(MainFrequencies, MainElements, LZX_MAX_CODE_LENGTH, NewMainLengths);
+    LzxBuildLengths(LengthFrequencies, LZX_NUM_SECONDARY_LENGTHS, LZX_MAX_CODE_LENGTH, NewLengthLengths);
+    LzxBuildLengths(AlignedFrequencies, LZX_ALIGNED_NUM_ELEMENTS, 7, NewAlignedLengths);
+    LzxBuildCodes(NewMainLengths, MainElements, MainCodes);
+    LzxBuildCodes(NewLengthLengths, LZX_NUM_SECONDARY_LENGTHS, LengthCodes);
+    LzxBuildCodes(NewAlignedLengths, LZX_ALIGNED_NUM_ELEMENTS, AlignedCodes);
+
+    /* Aligned blocks pay off when the low footer bits are skewed */
+    VerbatimCost = 0;
+    AlignedCost  = LZX_ALIGNED_NUM_ELEMENTS * 3;
+    for (i = 0; i < LZX_ALIGNED_NUM_ELEMENTS; i++)
+    {
+        VerbatimCost += AlignedFrequencies[i] * 3;
+        AlignedCost  += AlignedFrequencies[i] * NewAlignedLengths[i];
+    }
+    Type = (AlignedCost < VerbatimCost) ? LZX_BLOCKTYPE_ALIGNED : LZX_BLOCKTYPE_VERBATIM;
+
+    LzxWriteBlockHeader(Writer, !HeaderWritten, Type, Block->InputLength);
+    if (Type == LZX_BLOCKTYPE_ALIGNED)
+    {
+        for (i = 0; i < LZX_ALIGNED_NUM_ELEMENTS; i++)
+            Writer.PutBits(NewAlignedLengths[i], 3);
+    }
+    LzxWriteLengths(Writer, NewMainLengths, MainLengths, 0, LZX_NUM_CHARS);
+    LzxWriteLengths(Writer, NewMainLengths, MainLengths, LZX_NUM_CHARS, MainElements);
+    LzxWriteLengths(Writer, NewLengthLengths, LengthLengths, 0, LZX_NUM_SECONDARY_LENGTHS);
+
+    for (i = 0; i < Symbols.size() && !Writer.Overflow; i++)
+    {
+        PLZX_SYMBOL Symbol = &Symbols[i];
+
+        Writer.PutBits(MainCodes[Symbol->Main], NewMainLengths[Symbol->Main]);
+        if (Symbol->Length != LZX_NO_SYMBOL)
+            Writer.PutBits(LengthCodes[Symbol->Length], NewLengthLengths[Symbol->Length]);
+
+        if (Type == LZX_BLOCKTYPE_ALIGNED && Symbol->FooterBits >= 3)
+        {
+            Writer.PutBits(Symbol->Footer >> 3, Symbol->FooterBits - 3);
+            Writer.PutBits(AlignedCodes[Symbol->Footer & 7], NewAlignedLengths[Symbol->Footer & 7]);
+        }
+        else
+            Writer.PutBits(Symbol->Footer, Symbol->FooterBits);
+    }
+
+    /* Frames end on a 16-bit boundary */
+    Writer.Align();
+
+    if (!Writer.Overflow && Writer.GetLength() <= Block->InputLength)
+    {
+        Block->OutputLength = Writer.GetLength();
+        HeaderWritten = true;
+        return CS_SUCCESS;
+    }
+
+    /* Incompressible, store the block instead */
+    memcpy(MainLengths, SavedMainLengths, sizeof(MainLengths));
+    memcpy(LengthLengths, SavedLengthLengths, sizeof(LengthLengths));
+    memcpy(Repeated, SavedRepeated, sizeof(Repeated));
+
+    return StoreBlock(Block, Buffer);
+}
+
+
+ULONG CLZXCodec::StoreBlock(PCAB_CODEC_BLOCK Block, const UCHAR* Buffer)
+/*
+ * FUNCTION: Writes an uncompressed block for a frame
+ * ARGUMENTS:
+ *     Block  = Pointer to block to write the output to
+ *     Buffer = Pointer to translated data of the block
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    CLZXBitWriter Writer(Block->Output, CAB_MAX_COMPBLOCKSIZE);
+    ULONG i;
+
+    LzxWriteBlockHeader(Writer, !HeaderWritten, LZX_BLOCKTYPE_UNCOMPRESSED, Block->InputLength);
+
+    /* The repeated offsets start at the next 16-bit boundary, a whole word later if already there */
+    if (Writer.IsAligned())
+        Writer.PutBits(0, 16);
+    else
+        Writer.Align();
+
+    for (i = 0; i < 12; i++)
+        Writer.PutByte((UCHAR)(Repeated[i / 4] >> ((i % 4) * 8)));
+
+    for (i = 0; i < Block->InputLength; i++)
+        Writer.PutByte(Buffer[i]);
+
+    if (Block->InputLength & 1)
+        Writer.PutByte(0);
+
+    if (Writer.Overflow)
+    {
+        DPRINT(MIN_TRACE, ("Block does not fit into output buffer (%u).\n", (UINT)Block->InputLength));
+        return CS_NOMEMORY;
+    }
+
+    Block->OutputLength = Writer.GetLength();
+    HeaderWritten = true;
+    return CS_SUCCESS;
+}
+
+
+void CLZXCodec::EnsureBits(ULONG Count)
+/*
+ * FUNCTION: Makes sure the bit buffer holds at least Count bits
+ * ARGUMENTS:
+ *     Count = Number of bits needed, at most 17
+ */
+{
+    ULONG Word;
+
+    while (BitCount < Count)
+    {
+        /* Past the end of the input the stream reads as zeroes */
+        Word = 0;
+        if (InputEnd - InputPosition >= 2)
+        {
+            Word = InputPosition[0] | (InputPosition[1] << 8);
+            InputPosition += 2;
+        }
+
+        BitBuffer |= Word << (16 - BitCount);
+        BitCount += 16;
+    }
+}
+
+
+ULONG CLZXCodec::ReadBits(ULONG Count)
+/*
+ * FUNCTION: Reads bits from the input
+ * ARGUMENTS:
+ *     Count = Number of bits to read, at most 17
+ * RETURNS:
+ *     Value of the bits
+ */
+{
+    ULONG Value;
+
+    if (Count == 0)
+        return 0;
+
+    EnsureBits(Count);
+    Value = BitBuffer >> (32 - Count);
+    BitBuffer <<= Count;
+    BitCount -= Count;
+
+    return Value;
+}
+
+
+ULONG CLZXCodec::DecodeSymbol(const LZX_DECODE_TABLE* Table)
+/*
+ * FUNCTION: Reads a Huffman coded symbol from the input
+ * ARGUMENTS:
+ *     Table = Decoding table of the tree
+ * RETURNS:
+ *     Decoded symbol, LZX_NO_SYMBOL if the code is not in the tree
+ */
+{
+    LONG Code = 0, First = 0, Index = 0, Count;
+    ULONG Bits, Length;
+
+    EnsureBits(LZX_MAX_CODE_LENGTH);
+    Bits = BitBuffer >> 16;
+
+    for (Length = 1; Length <= LZX_MAX_CODE_LENGTH; Length++)
+    {
+        Code |= (Bits >> (LZX_MAX_CODE_LENGTH - Length)) & 1;
+        Count = Table->Count[Length];
+        if (Code - First < Count)
+        {
+            BitBuffer <<= Length;
+            BitCount -= Length;
+            return Table->Symbols[Index + Code - First];
+        }
+
+        Index += Count;
+        First  = (First + Count) << 1;
+        Code <<= 1;
+    }
+
+    return LZX_NO_SYMBOL;
+}
+
+
+ULONG CLZXCodec::ReadLengths(PUCHAR Lengths, ULONG First, ULONG Last)
+/*
+ * FUNCTION: Reads pretree coded differences to the code lengths of the previous block
+ * ARGUMENTS:
+ *     Lengths = Code lengths to update
+ *     First   = First symbol to read
+ *     Last    = Symbol after the last one to read
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    UCHAR PreLengths[LZX_PRETREE_NUM_ELEMENTS];
+    LZX_DECODE_TABLE PreTable;
+    ULONG Symbol, Run, Value, i;
+
+    for (i = 0; i < LZX_PRETREE_NUM_ELEMENTS; i++)
+        PreLengths[i] = (UCHAR)ReadBits(4);
+
+    if (!LzxBuildTable(&PreTable, PreLengths, LZX_PRETREE_NUM_ELEMENTS))
+        return CS_BADSTREAM;
+
+    for (i = First; i < Last; )
+    {
+        Symbol = DecodeSymbol(&PreTable);
+        if (Symbol == 17)
+        {
+            Run = ReadBits(4) + 4;
+            Value = 0;
+        }
+        else if (Symbol == 18)
+        {
+            Run = ReadBits(5) + 20;
+            Value = 0;
+        }
+        else if (Symbol == 19)
+        {
+            Run = ReadBits(1) + 4;
+            Symbol = DecodeSymbol(&PreTable);
+            if (Symbol > 16)
+                return CS_BADSTREAM;
+            Value = (Lengths[i] + 17 - Symbol) % 17;
+        }
+        else if (Symbol <= 16)
+        {
+            Run = 1;
+            Value = (Lengths[i] + 17 - Symbol) % 17;
+        }
+        else
+            return CS_BADSTREAM;
+
+        for (Run = std::min(Run, Last - i); Run > 0; Run--)
+            Lengths[i++] = (UCHAR)Value;
+    }
+
+    return CS_SUCCESS;
+}
+
+
+ULONG CLZXCodec::ReadBlockHeader()
+/*
+ * FUNCTION: Reads the header and the trees of the next block
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    ULONG Status, i;
+
+    BlockType = ReadBits(3);
+    BlockLength = ReadBits(16) << 8;
+    BlockLength |= ReadBits(8);
+    BlockRemaining = BlockLength;
+
+    switch (BlockType)
+    {
+        case LZX_BLOCKTYPE_ALIGNED:
+            for (i = 0; i < LZX_ALIGNED_NUM_ELEMENTS; i++)
+                AlignedLengths[i] = (UCHAR)ReadBits(3);
+            if (!LzxBuildTable(&AlignedTable, AlignedLengths, LZX_ALIGNED_NUM_ELEMENTS))
+                return CS_BADSTREAM;
+            /* Fall through */
+
+        case LZX_BLOCKTYPE_VERBATIM:
+            Status = ReadLengths(DecodeMainLengths, 0, LZX_NUM_CHARS);
+            if (Status == CS_SUCCESS)
+                Status = ReadLengths(DecodeMainLengths, LZX_NUM_CHARS, MainElements);
+            if (Status == CS_SUCCESS)
+                Status = ReadLengths(DecodeLengthLengths, 0, LZX_NUM_SECONDARY_LENGTHS);
+            if (Status != CS_SUCCESS)
+                return Status;
+
+            /* An empty length tree is fine as long as no long match needs it */
+            if (!LzxBuildTable(&MainTable, DecodeMainLengths, MainElements) ||
+                !LzxBuildTable(&LengthTable, DecodeLengthLengths, LZX_NUM_SECONDARY_LENGTHS))
+                return CS_BADSTREAM;
+
+            if (DecodeMainLengths[0xE8] != 0)
+                IntelStarted = true;
+            break;
+
+        case LZX_BLOCKTYPE_UNCOMPRESSED:
+            IntelStarted = true;
+
+            /* Skip to the next 16-bit boundary, a whole word if already there */
+            if (BitCount == 0)
+                InputPosition += 2;
+            BitBuffer = 0;
+            BitCount = 0;
+
+            if (InputEnd - InputPosition < 12)
+                return CS_BADSTREAM;
+            for (i = 0; i < 3; i++)
+            {
+                DecodeRepeated[i] = InputPosition[0] | (InputPosition[1] << 8) |
+                                    (InputPosition[2] << 16) | ((ULONG)InputPosition[3] << 24);
+                InputPosition += 4;
+            }
+            break;
+
+        default:
+            DPRINT(MID_TRACE, ("Bad LZX block type (%u).\n", (UINT)BlockType));
+            return CS_BADSTREAM;
+    }
+
+    return CS_SUCCESS;
+}
+
+
+ULONG CLZXCodec::DecodeBlock(ULONG Length)
+/*
+ * FUNCTION: Decodes bytes of the current block into the window
+ * ARGUMENTS:
+ *     Length = Number of bytes to decode, a match may run past this
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    ULONG End = WindowPosition + Length;
+    ULONG Start = WindowPosition;
+    ULONG Symbol, MatchLength, Slot, Extra, Offset, Source, i;
+
+    if (BlockType == LZX_BLOCKTYPE_UNCOMPRESSED)
+    {
+        if ((ULONG)(InputEnd - InputPosition) < Length)
+            return CS_BADSTREAM;
+
+        memcpy(&Window[WindowPosition], InputPosition, Length);
+        InputPosition += Length;
+        WindowPosition += Length;
+        BlockRemaining -= Length;
+
+        /* Odd sized blocks are padded to 16 bits */
+        if (BlockRemaining == 0 && (BlockLength & 1))
+            InputPosition++;
+
+        return CS_SUCCESS;
+    }
+
+    while (WindowPosition < End)
+    {
+        Symbol = DecodeSymbol(&MainTable);
+        if (Symbol == LZX_NO_SYMBOL)
+            return CS_BADSTREAM;
+
+        if (Symbol < LZX_NUM_CHARS)
+        {
+            Window[WindowPosition++] = (UCHAR)Symbol;
+            continue;
+        }
+
+        Symbol -= LZX_NUM_CHARS;
+        MatchLength = Symbol & LZX_NUM_PRIMARY_LENGTHS;
+        if (MatchLength == LZX_NUM_PRIMARY_LENGTHS)
+        {
+            Extra = DecodeSymbol(&LengthTable);
+            if (Extra == LZX_NO_SYMBOL)
+                return CS_BADSTREAM;
+            MatchLength += Extra;
+        }
+        MatchLength += LZX_MIN_MATCH;
+
+        Slot = Symbol >> 3;
+        if (Slot == 0)
+            Offset = DecodeRepeated[0];
+        else if (Slot == 1)
+        {
+            Offset = DecodeRepeated[1];
+            DecodeRepeated[1] = DecodeRepeated[0];
+            DecodeRepeated[0] = Offset;
+        }
+        else if (Slot == 2)
+        {
+            Offset = DecodeRepeated[2];
+            DecodeRepeated[2] = DecodeRepeated[0];
+            DecodeRepeated[0] = Offset;
+        }
+        else
+        {
+            Extra = LzxExtraBits(Slot);
+            Offset = LzxPositionBase(Slot) - 2;
+            if (BlockType == LZX_BLOCKTYPE_ALIGNED && Extra >= 3)
+            {
+                Offset += ReadBits(Extra - 3) << 3;
+                Symbol = DecodeSymbol(&AlignedTable);
+                if (Symbol == LZX_NO_SYMBOL)
+                    return CS_BADSTREAM;
+                Offset += Symbol;
+            }
+            else
+                Offset += ReadBits(Extra);
+
+            DecodeRepeated[2] = DecodeRepeated[1];
+            DecodeRepeated[1] = DecodeRepeated[0];
+            DecodeRepeated[0] = Offset;
+        }
+
+        /* Matches never wrap around the end of the window */
+        if (WindowPosition + MatchLength > WindowSize || Offset == 0 || Offset >= WindowSize)
+            return CS_BADSTREAM;
+
+        Source = (WindowPosition - Offset) & (WindowSize - 1);
+        for (i = 0; i < MatchLength; i++)
+            Window[WindowPosition++] = Window[(Source + i) & (WindowSize - 1)];
+    }
+
+    if (WindowPosition - Start > BlockRemaining)
+        return CS_BADSTREAM;
+    BlockRemaining -= WindowPosition - Start;
+
+    return CS_SUCCESS;
+}
+
+
+void CLZXCodec::UntranslateE8(PUCHAR Buffer, ULONG Length)
+/*
+ * FUNCTION: Turns absolute targets of x86 CALL instructions back into relative ones
+ * ARGUMENTS:
+ *     Buffer = Pointer to frame to translate in place
+ *     Length = Size of frame
+ */
+{
+    LONG Current = (LONG)IntelPosition, Absolute, Relative;
+    PUCHAR End = Buffer + Length - 10;
+
+    while (Buffer < End)
+    {
+        if (*Buffer++ != 0xE8)
+        {
+            Current++;
+            continue;
+        }
+
+        Absolute = (LONG)(Buffer[0] | (Buffer[1] << 8) | (Buffer[2] << 16) | ((ULONG)Buffer[3] << 24));
+        if (Absolute >= -Current && Absolute < (LONG)IntelFileSize)
+        {
+            Relative = (Absolute >= 0) ? Absolute - Current : Absolute + (LONG)IntelFileSize;
+            Buffer[0] = (UCHAR)Relative;
+            Buffer[1] = (UCHAR)(Relative >> 8);
+            Buffer[2] = (UCHAR)(Relative >> 16);
+            Buffer[3] = (UCHAR)(Relative >> 24);
+        }
+
+        Buffer += 4;
+        Current += 5;
+    }
+}
+
+
+ULONG CLZXCodec::Uncompress(void* OutputBuffer,
+                            void* InputBuffer,
+                            ULONG InputLength,
+                            PULONG OutputLength)
+/*
+ * FUNCTION: Uncompresses the next data block of the folder
+ * ARGUMENTS:
+ *     OutputBuffer = Pointer to buffer to place uncompressed data
+ *     InputBuffer  = Pointer to buffer with data to be uncompressed
+ *     InputLength  = Length of input buffer
+ *     OutputLength = Uncompressed size of the block on input,
+ *                    address of buffer to place size of uncompressed data
+ * NOTES:
+ *     Blocks have to be passed in order, from the first one of the folder
+ */
+{
+    ULONG FrameSize = *OutputLength;
+    ULONG FrameEnd, Status;
+
+    DPRINT(MAX_TRACE, ("InputLength (%u)  FrameSize (%u).\n", (UINT)InputLength, (UINT)FrameSize));
+
+    if (FrameSize == 0 || FrameSize > CAB_BLOCKSIZE || FramePosition + FrameSize > WindowSize)
+        return CS_BADSTREAM;
+
+    if (Window.empty())
+        Window.assign(WindowSize, 0);
+
+    InputPosition = (PUCHAR)InputBuffer;
+    InputEnd      = InputPosition + InputLength;
+    BitBuffer     = 0;
+    BitCount      = 0;
+
+    if (!HeaderRead)
+    {
+        if (ReadBits(1))
+        {
+            IntelFileSize = ReadBits(16) << 16;
+            IntelFileSize |= ReadBits(16);
+        }
+        HeaderRead = true;
+    }
+
+    /* A match of the previous frame may have run into this one */
+    FrameEnd = FramePosition + FrameSize;
+    while (WindowPosition < FrameEnd)
+    {
+        if (BlockRemaining == 0)
+        {
+            Status = ReadBlockHeader();
+            if (Status != CS_SUCCESS)
+                return Status;
+            continue;
+        }
+
+        Status = DecodeBlock(std::min(BlockRemaining, FrameEnd - WindowPosition));
+        if (Status != CS_SUCCESS)
+            return Status;
+    }
+
+    memcpy(OutputBuffer, &Window[FramePosition], FrameSize);
+
+    if (IntelStarted && IntelFileSize != 0 && DecodedFrames < 32768 && FrameSize > 10)
+        UntranslateE8((PUCHAR)OutputBuffer, FrameSize);
+
+    IntelPosition += FrameSize;
+    DecodedFrames++;
+    FramePosition = FrameEnd;
+    if (FramePosition == WindowSize)
+    {
+        FramePosition  = 0;
+        WindowPosition = 0;
+    }
+
+    *OutputLength = FrameSize;
+    return CS_SUCCESS;
+}
+
+/* EOF */
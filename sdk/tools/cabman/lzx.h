@@ -0,0 +1,135 @@
+/*
+ * COPYRIGHT:   See COPYING in the top level directory
+ * PROJECT:     ReactOS cabinet manager
+ * FILE:        tools/cabman/lzx.h
+ * PURPOSE:     CAB codec for LZX compressed data
+ */
+
+#pragma once
+
+#include "cabinet.h"
+#include <vector>
+
+#define LZX_MIN_WINDOW_BITS         15
+#define LZX_MAX_WINDOW_BITS         21
+#define LZX_DEFAULT_WINDOW_BITS     21
+
+#define LZX_MIN_MATCH               2
+#define LZX_MAX_MATCH               257
+#define LZX_NUM_CHARS               256
+#define LZX_NUM_PRIMARY_LENGTHS     7
+#define LZX_NUM_SECONDARY_LENGTHS   249
+#define LZX_MAX_POSITION_SLOTS      50
+#define LZX_MAINTREE_MAXSYMBOLS     (LZX_NUM_CHARS + LZX_MAX_POSITION_SLOTS * 8)
+#define LZX_PRETREE_NUM_ELEMENTS    20
+#define LZX_ALIGNED_NUM_ELEMENTS    8
+#define LZX_MAX_CODE_LENGTH         16
+
+#define LZX_BLOCKTYPE_VERBATIM      1
+#define LZX_BLOCKTYPE_ALIGNED       2
+#define LZX_BLOCKTYPE_UNCOMPRESSED  3
+
+/* File size the compressor announces for the x86 call translation */
+#define LZX_E8_FILE_SIZE            12000000
+
+
+/* Types */
+
+/* A literal (Length is 0) or a match found by the parser */
+typedef struct _LZX_TOKEN
+{
+    ULONG Value;                                // Literal byte or match offset
+    ULONG Length;                               // Match length
+} LZX_TOKEN, *PLZX_TOKEN;
+
+/* Canonical Huffman decoding table */
+typedef struct _LZX_DECODE_TABLE
+{
+    USHORT Count[LZX_MAX_CODE_LENGTH + 1];      // Number of codes of each length
+    USHORT Symbols[LZX_MAINTREE_MAXSYMBOLS];    // Symbols in code order
+} LZX_DECODE_TABLE, *PLZX_DECODE_TABLE;
+
+
+/* Classes */
+
+class CLZXCodec : public CCABCodec
+{
+public:
+    /* Constructor */
+    CLZXCodec(ULONG WindowBits);
+    /* Default destructor */
+    virtual ~CLZXCodec();
+    /* Compresses a data block */
+    virtual ULONG Compress(void* OutputBuffer,
+                           void* InputBuffer,
+                           ULONG InputLength,
+                           PULONG OutputLength) override;
+    /* Uncompresses a data block */
+    virtual ULONG Uncompress(void* OutputBuffer,
+                             void* InputBuffer,
+                             ULONG InputLength,
+                             PULONG OutputLength) override;
+    /* Compresses the data blocks of one or more folders in order */
+    virtual void CompressBlocks(PCAB_CODEC_BLOCK Blocks,
+                                ULONG Count,
+                                ULONG ThreadCount) override;
+    /* Starts a new folder */
+    virtual void Reset() override;
+private:
+    void TranslateE8(PUCHAR Buffer, ULONG Length);
+    void BuildHashChains(ULONG Size);
+    LONG FindMatch(ULONG FolderStart, ULONG Position, ULONG End,
+                   const ULONG* Repeated, PULONG Length, PULONG Offset);
+    void ParseBlock(ULONG FolderStart, ULONG Start, ULONG End, std::vector<LZX_TOKEN>& Tokens);
+    ULONG EncodeBlock(PCAB_CODEC_BLOCK Block, const UCHAR* Buffer, const std::vector<LZX_TOKEN>& Tokens);
+    ULONG StoreBlock(PCAB_CODEC_BLOCK Block, const UCHAR* Buffer);
+    void EnsureBits(ULONG Count);
+    ULONG ReadBits(ULONG Count);
+    ULONG DecodeSymbol(const LZX_DECODE_TABLE* Table);
+    ULONG ReadLengths(PUCHAR Lengths, ULONG First, ULONG Last);
+    ULONG ReadBlockHeader();
+    ULONG DecodeBlock(ULONG Length);
+    void UntranslateE8(PUCHAR Buffer, ULONG Length);
+
+    ULONG WindowBits;
+    ULONG WindowSize;
+    ULONG MainElements;                         // Size of the main tree for this window
+
+    /* Compressor state */
+    std::vector<UCHAR> History;                 // Data of the folder in front of the next block
+    std::vector<UCHAR> Data;                    // History and the blocks being compressed
+    std::vector<LONG> Chain;                    // Previous position with the same hash
+    std::vector<LONG> Head;                     // Last position of each hash
+    bool HeaderWritten;
+    ULONG FolderOffset;                         // Bytes of the folder translated so far
+    ULONG FrameCount;                           // Blocks of the folder translated so far
+    ULONG Repeated[3];                          // R0, R1 and R2
+    UCHAR MainLengths[LZX_MAINTREE_MAXSYMBOLS];
+    UCHAR LengthLengths[LZX_NUM_SECONDARY_LENGTHS];
+
+    /* Decompressor state */
+    std::vector<UCHAR> Window;
+    ULONG WindowPosition;                       // Next byte to decode
+    ULONG FramePosition;                        // Start of the current frame in the window
+    ULONG DecodedFrames;
+    ULONG IntelFileSize;
+    ULONG IntelPosition;
+    bool IntelStarted;
+    bool HeaderRead;
+    ULONG BlockType;
+    ULONG BlockLength;
+    ULONG BlockRemaining;
+    ULONG DecodeRepeated[3];
+    UCHAR DecodeMainLengths[LZX_MAINTREE_MAXSYMBOLS];
+    UCHAR DecodeLengthLengths[LZX_NUM_SECONDARY_LENGTHS];
+    UCHAR AlignedLengths[LZX_ALIGNED_NUM_ELEMENTS];
+    LZX_DECODE_TABLE MainTable;
+    LZX_DECODE_TABLE LengthTable;
+    LZX_DECODE_TABLE AlignedTable;
+    PUCHAR InputPosition;
+    PUCHAR InputEnd;
+    ULONG BitBuffer;
+    ULONG BitCount;
+};
+
+/* EOF */
@@ -63,15 +63,22 @@ ULONG CMSZipCodec::Compress(void* OutputBuffer,
  *     InputBuffer    = Pointer to buffer with data to be compressed
  *     InputLength    = Length of input buffer
  *     OutputLength   = Address of buffer to place size of compressed data
+ * NOTES:
+ *     Uses its own stream, so blocks can be compressed on several threads
  */
 {
     PUSHORT Magic;
+    z_stream ZStream;
+    int Status;
 
     DPRINT(MAX_TRACE, ("InputLength (%u).\n", (UINT)InputLength));
 
     Magic  = (PUSHORT)OutputBuffer;
     *Magic = MSZIP_MAGIC;
 
+    ZStream.zalloc    = MSZipAlloc;
+    ZStream.zfree     = MSZipFree;
+    ZStream.opaque    = (voidpf)0;
     ZStream.next_in   = (unsigned char*)InputBuffer;
     ZStream.avail_in  = InputLength;
     ZStream.next_out  = ((unsigned char *)OutputBuffer + 2);
@@ -94,6 +101,7 @@ ULONG CMSZipCodec::Compress(void* OutputBuffer,
     if ((Status != Z_OK) && (Status != Z_STREAM_END))
     {
         DPRINT(MIN_TRACE, ("deflate() returned (%d) (%s).\n", Status, ZStream.msg));
+        deflateEnd(&ZStream);
         if (Status == Z_MEM_ERROR)
             return CS_NOMEMORY;
         return CS_BADSTREAM;
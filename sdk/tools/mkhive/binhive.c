@@ -37,22 +37,32 @@ ExportBinaryHive(
 {
     FILE *File;
     BOOL ret;
+    CMHIVE CompactHive;
 
     printf("  Creating binary hive: %s\n", FileName);
 
+    /* Write out a compacted copy of the hive, with its keys laid out depth-first */
+    if (!NT_SUCCESS(CmiCompactHive(CmHive, &CompactHive)))
+    {
+        printf("    Error compacting hive\n");
+        return FALSE;
+    }
+
     /* Create new hive file */
     File = fopen(FileName, "wb");
     if (File == NULL)
     {
         printf("    Error creating/opening file\n");
+        HvFree(&CompactHive.Hive);
         return FALSE;
     }
 
     fseek(File, 0, SEEK_SET);
 
-    CmHive->FileHandles[HFILE_TYPE_PRIMARY] = (HANDLE)File;
-    ret = HvWriteHive(&CmHive->Hive);
+    CompactHive.FileHandles[HFILE_TYPE_PRIMARY] = (HANDLE)File;
+    ret = HvWriteHive(&CompactHive.Hive);
     fclose(File);
+    HvFree(&CompactHive.Hive);
     return ret;
 }
 
@@ -153,6 +153,44 @@ CmiInitializeHive(
     return STATUS_SUCCESS;
 }
 
+NTSTATUS
+CmiCompactHive(
+    IN PCMHIVE Hive,
+    OUT PCMHIVE CompactHive)
+{
+    NTSTATUS Status;
+
+    RtlZeroMemory(CompactHive, sizeof(*CompactHive));
+
+    Status = HvInitialize(&CompactHive->Hive,
+                          HINIT_CREATE,
+                          HIVE_NOLAZYFLUSH,
+                          HFILE_TYPE_PRIMARY,
+                          0,
+                          CmpAllocate,
+                          CmpFree,
+                          CmpFileSetSize,
+                          CmpFileWrite,
+                          CmpFileRead,
+                          CmpFileFlush,
+                          1,
+                          NULL);
+    if (!NT_SUCCESS(Status))
+    {
+        return Status;
+    }
+
+    /* Copy the key tree, leaving behind the free space and volatile keys */
+    Status = CmCompactHive(&Hive->Hive, &CompactHive->Hive);
+    if (!NT_SUCCESS(Status))
+    {
+        HvFree(&CompactHive->Hive);
+        return Status;
+    }
+
+    return STATUS_SUCCESS;
+}
+
 NTSTATUS
 CmiCreateSecurityKey(
     IN PHHIVE Hive,
@@ -33,6 +33,11 @@ CmiInitializeHive(
     IN OUT PCMHIVE Hive,
     IN PCWSTR Name);
 
+NTSTATUS
+CmiCompactHive(
+    IN PCMHIVE Hive,
+    OUT PCMHIVE CompactHive);
+
 NTSTATUS
 CmiCreateSecurityKey(
     IN PHHIVE Hive,
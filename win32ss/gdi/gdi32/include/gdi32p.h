@@ -402,6 +402,10 @@ GdiAllocBatchCommand(
     else if (Cmd == GdiBCSelObj) cjSize = sizeof(GDIBSOBJECT);
     else if (Cmd == GdiBCDelRgn) cjSize = sizeof(GDIBSOBJECT);
     else if (Cmd == GdiBCDelObj) cjSize = sizeof(GDIBSOBJECT);
+    else if (Cmd == GdiBCLineTo) cjSize = sizeof(GDIBSLINETO);
+    else if (Cmd == GdiBCRectangle) cjSize = sizeof(GDIBSRECTANGLE);
+    else if (Cmd == GdiBCSetPixel) cjSize = sizeof(GDIBSSETPIXEL);
+    else if (Cmd == GdiBCBitBlt) cjSize = sizeof(GDIBSBITBLT);
     else cjSize = 0;
 
     /* Unsupported operation */
@@ -446,6 +450,91 @@ GdiAllocBatchCommand(
     return pHdr;
 }
 
+/* Returns the last entry of the batch if it is a Cmd entry for hdc */
+FORCEINLINE
+PVOID
+GdiGetLastBatchCommand(
+    HDC hdc,
+    USHORT Cmd)
+{
+    PTEB pTeb;
+    PGDIBATCHHDR pHdr;
+    ULONG i;
+
+    /* Get a pointer to the TEB */
+    pTeb = NtCurrentTeb();
+
+    /* A batch limit of 1 disables batching, don't merge entries either */
+    if (GDI_BatchLimit <= 1) return NULL;
+
+    /* The batch must be in use for this DC */
+    if ((pTeb->GdiBatchCount == 0) || (pTeb->GdiTebBatch.HDC != hdc)) return NULL;
+
+    /* Walk to the last entry */
+    pHdr = (PGDIBATCHHDR)pTeb->GdiTebBatch.Buffer;
+    for (i = 1; i < pTeb->GdiBatchCount; i++)
+    {
+        pHdr = (PGDIBATCHHDR)((PUCHAR)pHdr + pHdr->Size);
+    }
+
+    return (pHdr->Cmd == Cmd) ? pHdr : NULL;
+}
+
+/* Grows the last entry of the batch, returns NULL when the buffer is full.
+   Appended entries don't count against the batch limit. */
+FORCEINLINE
+PVOID
+GdiExtendBatchCommand(
+    PGDIBATCHHDR pHdr,
+    USHORT cjExtra)
+{
+    PTEB pTeb;
+    PVOID pvExtra;
+
+    /* Get a pointer to the TEB */
+    pTeb = NtCurrentTeb();
+
+    /* Check if the buffer is full */
+    if ((pTeb->GdiTebBatch.Offset + cjExtra) > GDIBATCHBUFSIZE) return NULL;
+
+    /* The new space follows the last entry */
+    pvExtra = (PVOID)((PUCHAR)pTeb->GdiTebBatch.Buffer + pTeb->GdiTebBatch.Offset);
+    pTeb->GdiTebBatch.Offset += cjExtra;
+    pHdr->Size += cjExtra;
+
+    return pvExtra;
+}
+
+FORCEINLINE
+VOID
+GdiSetDrawAttr(
+    PGDIBSDRAWATTR pAttr,
+    PDC_ATTR pdcattr)
+{
+    pAttr->hbrush          = pdcattr->hbrush;
+    pAttr->hpen            = pdcattr->hpen;
+    pAttr->crForegroundClr = pdcattr->crForegroundClr;
+    pAttr->crBackgroundClr = pdcattr->crBackgroundClr;
+    pAttr->crBrushClr      = pdcattr->crBrushClr;
+    pAttr->crPenClr        = pdcattr->crPenClr;
+    pAttr->ulForegroundClr = pdcattr->ulForegroundClr;
+    pAttr->ulBackgroundClr = pdcattr->ulBackgroundClr;
+    pAttr->ulBrushClr      = pdcattr->ulBrushClr;
+    pAttr->ulPenClr        = pdcattr->ulPenClr;
+}
+
+FORCEINLINE
+BOOL
+GdiIsSameDrawAttr(
+    PGDIBSDRAWATTR pAttr,
+    PDC_ATTR pdcattr)
+{
+    GDIBSDRAWATTR Attr;
+
+    GdiSetDrawAttr(&Attr, pdcattr);
+    return RtlEqualMemory(&Attr, pAttr, sizeof(Attr));
+}
+
 FORCEINLINE
 PDC_ATTR
 GdiGetDcAttr(HDC hdc)
@@ -11,10 +11,57 @@ LineTo(
     _In_ INT x,
     _In_ INT y )
 {
+    PDC_ATTR pdcattr;
+
     HANDLE_METADC(BOOL, LineTo, FALSE, hdc, x, y);
 
     if ( GdiConvertAndCheckDC(hdc) == NULL ) return FALSE;
 
+    /* Get the DC attribute, the current position must be valid in user mode */
+    pdcattr = GdiGetDcAttr(hdc);
+    if (pdcattr && !(pdcattr->ulDirty_ & (DC_DIBSECTION | DIRTY_PTLCURRENT)))
+    {
+        PGDIBSLINETO pgO;
+        PPOINTL pptl = NULL;
+
+        /* Append the point to the last LineTo, if this line continues it */
+        pgO = GdiGetLastBatchCommand(hdc, GdiBCLineTo);
+        if (pgO &&
+            (pgO->aptl[pgO->Count - 1].x == pdcattr->ptlCurrent.x) &&
+            (pgO->aptl[pgO->Count - 1].y == pdcattr->ptlCurrent.y) &&
+            GdiIsSameDrawAttr(&pgO->Attr, pdcattr))
+        {
+            pptl = GdiExtendBatchCommand(&pgO->gbHdr, sizeof(POINTL));
+            if (pptl) pgO->Count++;
+        }
+
+        if (!pptl)
+        {
+            pgO = GdiAllocBatchCommand(hdc, GdiBCLineTo);
+            if (pgO)
+            {
+                pdcattr->ulDirty_ |= DC_MODE_DIRTY;
+                /* Snapshot attributes */
+                GdiSetDrawAttr(&pgO->Attr, pdcattr);
+                pgO->Count = 2;
+                pgO->aptl[0] = pdcattr->ptlCurrent;
+                pptl = &pgO->aptl[1];
+            }
+        }
+
+        if (pptl)
+        {
+            pptl->x = x;
+            pptl->y = y;
+
+            /* Update the current position, like MoveToEx does */
+            pdcattr->ptlCurrent.x = x;
+            pdcattr->ptlCurrent.y = y;
+            pdcattr->ulDirty_ |= (DIRTY_PTFXCURRENT|DIRTY_STYLESTATE);
+            return TRUE;
+        }
+    }
+
     return NtGdiLineTo(hdc, x, y);
 }
 
@@ -95,10 +142,32 @@ Rectangle(
     _In_ INT right,
     _In_ INT bottom)
 {
+    PDC_ATTR pdcattr;
+
     HANDLE_METADC(BOOL, Rectangle, FALSE, hdc, left, top, right, bottom);
 
     if ( GdiConvertAndCheckDC(hdc) == NULL ) return FALSE;
 
+    /* Get the DC attribute */
+    pdcattr = GdiGetDcAttr(hdc);
+    if (pdcattr && !(pdcattr->ulDirty_ & DC_DIBSECTION))
+    {
+        PGDIBSRECTANGLE pgO;
+
+        pgO = GdiAllocBatchCommand(hdc, GdiBCRectangle);
+        if (pgO)
+        {
+            pdcattr->ulDirty_ |= DC_MODE_DIRTY;
+            pgO->rcl.left   = left;
+            pgO->rcl.top    = top;
+            pgO->rcl.right  = right;
+            pgO->rcl.bottom = bottom;
+            /* Snapshot attributes */
+            GdiSetDrawAttr(&pgO->Attr, pdcattr);
+            return TRUE;
+        }
+    }
+
     return NtGdiRectangle(hdc, left, top, right, bottom);
 }
 
@@ -171,6 +240,47 @@ SetPixelV(
     _In_ INT y,
     _In_ COLORREF crColor)
 {
+    PDC_ATTR pdcattr;
+
+    /* The color doesn't need to be returned, so the pixel can be batched */
+    if (GDI_HANDLE_GET_TYPE(hdc) == GDILoObjType_LO_DC_TYPE)
+    {
+        /* Get the DC attribute */
+        pdcattr = GdiGetDcAttr(hdc);
+        if (pdcattr && !(pdcattr->ulDirty_ & DC_DIBSECTION))
+        {
+            PGDIBSSETPIXEL pgO;
+            PGDIBSPIXEL pPixel = NULL;
+
+            /* Append the pixel to the last SetPixel */
+            pgO = GdiGetLastBatchCommand(hdc, GdiBCSetPixel);
+            if (pgO)
+            {
+                pPixel = GdiExtendBatchCommand(&pgO->gbHdr, sizeof(GDIBSPIXEL));
+                if (pPixel) pgO->Count++;
+            }
+
+            if (!pPixel)
+            {
+                pgO = GdiAllocBatchCommand(hdc, GdiBCSetPixel);
+                if (pgO)
+                {
+                    pdcattr->ulDirty_ |= DC_MODE_DIRTY;
+                    pgO->Count = 1;
+                    pPixel = &pgO->aPixel[0];
+                }
+            }
+
+            if (pPixel)
+            {
+                pPixel->ptl.x = x;
+                pPixel->ptl.y = y;
+                pPixel->crColor = crColor;
+                return TRUE;
+            }
+        }
+    }
+
     return SetPixel(hdc, x, y, crColor) != CLR_INVALID;
 }
 
@@ -455,6 +565,8 @@ BitBlt(
     _In_ INT ySrc,
     _In_ DWORD dwRop)
 {
+    PDC_ATTR pdcattr;
+
     /* Use PatBlt for no source blt, like windows does */
     if (!ROP_USES_SOURCE(dwRop))
     {
@@ -477,6 +589,34 @@ BitBlt(
 
     if ( GdiConvertAndCheckDC(hdcDest) == NULL ) return FALSE;
 
+    /* Only blits inside of one DC are batched, the batch is flushed with
+       the batch DC locked and can't lock a second one. */
+    if ((hdcSrc == hdcDest) && !(dwRop & CAPTUREBLT))
+    {
+        /* Get the DC attribute */
+        pdcattr = GdiGetDcAttr(hdcDest);
+        if (pdcattr && !(pdcattr->ulDirty_ & DC_DIBSECTION))
+        {
+            PGDIBSBITBLT pgO;
+
+            pgO = GdiAllocBatchCommand(hdcDest, GdiBCBitBlt);
+            if (pgO)
+            {
+                pdcattr->ulDirty_ |= DC_MODE_DIRTY;
+                pgO->xDest = xDest;
+                pgO->yDest = yDest;
+                pgO->cx    = cx;
+                pgO->cy    = cy;
+                pgO->xSrc  = xSrc;
+                pgO->ySrc  = ySrc;
+                pgO->dwRop = dwRop;
+                /* Snapshot attributes */
+                GdiSetDrawAttr(&pgO->Attr, pdcattr);
+                return TRUE;
+            }
+        }
+    }
+
     return NtGdiBitBlt(hdcDest, xDest, yDest, cx, cy, hdcSrc, xSrc, ySrc, dwRop, 0, 0);
 }
 
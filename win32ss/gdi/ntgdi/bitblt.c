@@ -310,103 +310,40 @@ done:
     return Ret;
 }
 
-BOOL APIENTRY
-NtGdiMaskBlt(
-    HDC hdcDest,
+BOOL
+FASTCALL
+IntGdiMaskBlt(
+    PDC DCDest,
     INT nXDest,
     INT nYDest,
     INT nWidth,
     INT nHeight,
-    HDC hdcSrc,
+    PDC DCSrc,
     INT nXSrc,
     INT nYSrc,
-    HBITMAP hbmMask,
+    PSURFACE psurfMask,
     INT xMask,
     INT yMask,
-    DWORD dwRop4,
-    IN DWORD crBackColor)
+    ROP4 rop4)
 {
-    PDC DCDest;
-    PDC DCSrc = NULL;
-    HDC ahDC[2];
-    PGDIOBJ apObj[2];
-    PDC_ATTR pdcattr = NULL;
-    SURFACE *BitmapDest, *BitmapSrc = NULL, *psurfMask = NULL;
+    PDC_ATTR pdcattr;
+    SURFACE *BitmapDest, *BitmapSrc = NULL;
     RECTL DestRect, SourceRect;
     POINTL SourcePoint, MaskPoint;
     BOOL Status = FALSE;
     EXLATEOBJ exlo;
     XLATEOBJ *XlateObj = NULL;
     BOOL UsesSource;
-    ROP4 rop4;
-
-    rop4 = WIN32_ROP4_TO_ENG_ROP4(dwRop4);
 
     UsesSource = ROP4_USES_SOURCE(rop4);
-    if (!hdcDest || (UsesSource && !hdcSrc))
-    {
-        EngSetLastError(ERROR_INVALID_PARAMETER);
-        return FALSE;
-    }
-
-    /* Check if we need a mask and have a mask bitmap */
-    if (ROP4_USES_MASK(rop4) && (hbmMask != NULL))
-    {
-        /* Reference the mask bitmap */
-        psurfMask = SURFACE_ShareLockSurface(hbmMask);
-        if (psurfMask == NULL)
-        {
-            EngSetLastError(ERROR_INVALID_HANDLE);
-            return FALSE;
-        }
-
-        /* Make sure the mask bitmap is 1 BPP */
-        if (gajBitsPerFormat[psurfMask->SurfObj.iBitmapFormat] != 1)
-        {
-            EngSetLastError(ERROR_INVALID_PARAMETER);
-            SURFACE_ShareUnlockSurface(psurfMask);
-            return FALSE;
-        }
-    }
-    else
+    if (!UsesSource)
     {
-        /* We use NULL, if we need a mask, the Eng function will take care of
-           that and use the brushobject to get a mask */
-        psurfMask = NULL;
-    }
-
-    MaskPoint.x = xMask;
-    MaskPoint.y = yMask;
-
-    /* Take care of source and destination bitmap */
-    TRACE("Locking DCs\n");
-    ahDC[0] = hdcDest;
-    ahDC[1] = UsesSource ? hdcSrc : NULL;
-    if (!GDIOBJ_bLockMultipleObjects(2, (HGDIOBJ*)ahDC, apObj, GDIObjType_DC_TYPE))
-    {
-        WARN("Invalid dc handle (dest=0x%p, src=0x%p) passed to NtGdiMaskBlt\n", hdcDest, hdcSrc);
-        if(psurfMask) SURFACE_ShareUnlockSurface(psurfMask);
-        EngSetLastError(ERROR_INVALID_HANDLE);
-        return FALSE;
-    }
-    DCDest = apObj[0];
-    DCSrc = apObj[1];
-
-    ASSERT(DCDest);
-    if (NULL == DCDest)
-    {
-        if(DCSrc) DC_UnlockDc(DCSrc);
-        WARN("Invalid destination dc handle (0x%p) passed to NtGdiMaskBlt\n", hdcDest);
-        if(psurfMask) SURFACE_ShareUnlockSurface(psurfMask);
-        return FALSE;
+        DCSrc = NULL;
     }
 
     if (DCDest->dctype == DC_TYPE_INFO)
     {
-        if(DCSrc) DC_UnlockDc(DCSrc);
-        DC_UnlockDc(DCDest);
         /* Yes, Windows really returns TRUE in this case */
-        if(psurfMask) SURFACE_ShareUnlockSurface(psurfMask);
         return TRUE;
     }
 
@@ -415,14 +352,14 @@ NtGdiMaskBlt(
         ASSERT(DCSrc);
         if (DCSrc->dctype == DC_TYPE_INFO)
         {
-            DC_UnlockDc(DCDest);
-            DC_UnlockDc(DCSrc);
             /* Yes, Windows really returns TRUE in this case */
-            if(psurfMask) SURFACE_ShareUnlockSurface(psurfMask);
             return TRUE;
         }
     }
 
+    MaskPoint.x = xMask;
+    MaskPoint.y = yMask;
+
     pdcattr = DCDest->pdcattr;
 
     DestRect.left   = nXDest;
@@ -526,7 +463,107 @@ NtGdiMaskBlt(
         EXLATEOBJ_vCleanup(&exlo);
 cleanup:
     DC_vFinishBlit(DCDest, DCSrc);
-    if (UsesSource)
+
+    return Status;
+}
+
+BOOL APIENTRY
+NtGdiMaskBlt(
+    HDC hdcDest,
+    INT nXDest,
+    INT nYDest,
+    INT nWidth,
+    INT nHeight,
+    HDC hdcSrc,
+    INT nXSrc,
+    INT nYSrc,
+    HBITMAP hbmMask,
+    INT xMask,
+    INT yMask,
+    DWORD dwRop4,
+    IN DWORD crBackColor)
+{
+    PDC DCDest;
+    PDC DCSrc = NULL;
+    HDC ahDC[2];
+    PGDIOBJ apObj[2];
+    SURFACE *psurfMask = NULL;
+    BOOL Status;
+    BOOL UsesSource;
+    ROP4 rop4;
+
+    rop4 = WIN32_ROP4_TO_ENG_ROP4(dwRop4);
+
+    UsesSource = ROP4_USES_SOURCE(rop4);
+    if (!hdcDest || (UsesSource && !hdcSrc))
+    {
+        EngSetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    /* Check if we need a mask and have a mask bitmap */
+    if (ROP4_USES_MASK(rop4) && (hbmMask != NULL))
+    {
+        /* Reference the mask bitmap */
+        psurfMask = SURFACE_ShareLockSurface(hbmMask);
+        if (psurfMask == NULL)
+        {
+            EngSetLastError(ERROR_INVALID_HANDLE);
+            return FALSE;
+        }
+
+        /* Make sure the mask bitmap is 1 BPP */
+        if (gajBitsPerFormat[psurfMask->SurfObj.iBitmapFormat] != 1)
+        {
+            EngSetLastError(ERROR_INVALID_PARAMETER);
+            SURFACE_ShareUnlockSurface(psurfMask);
+            return FALSE;
+        }
+    }
+    else
+    {
+        /* We use NULL, if we need a mask, the Eng function will take care of
+           that and use the brushobject to get a mask */
+        psurfMask = NULL;
+    }
+
+    /* Take care of source and destination bitmap */
+    TRACE("Locking DCs\n");
+    ahDC[0] = hdcDest;
+    ahDC[1] = UsesSource ? hdcSrc : NULL;
+    if (!GDIOBJ_bLockMultipleObjects(2, (HGDIOBJ*)ahDC, apObj, GDIObjType_DC_TYPE))
+    {
+        WARN("Invalid dc handle (dest=0x%p, src=0x%p) passed to NtGdiMaskBlt\n", hdcDest, hdcSrc);
+        if(psurfMask) SURFACE_ShareUnlockSurface(psurfMask);
+        EngSetLastError(ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
+    DCDest = apObj[0];
+    DCSrc = apObj[1];
+
+    ASSERT(DCDest);
+    if (NULL == DCDest)
+    {
+        if(DCSrc) DC_UnlockDc(DCSrc);
+        WARN("Invalid destination dc handle (0x%p) passed to NtGdiMaskBlt\n", hdcDest);
+        if(psurfMask) SURFACE_ShareUnlockSurface(psurfMask);
+        return FALSE;
+    }
+
+    Status = IntGdiMaskBlt(DCDest,
+                           nXDest,
+                           nYDest,
+                           nWidth,
+                           nHeight,
+                           DCSrc,
+                           nXSrc,
+                           nYSrc,
+                           psurfMask,
+                           xMask,
+                           yMask,
+                           rop4);
+
+    if (DCSrc)
     {
         DC_UnlockDc(DCSrc);
     }
@@ -1418,36 +1455,20 @@ NtGdiInvertRgn(
     return bResult;
 }
 
-COLORREF
-APIENTRY
-NtGdiSetPixel(
-    _In_ HDC hdc,
+BOOL
+FASTCALL
+IntGdiSetPixel(
+    _In_ PDC pdc,
     _In_ INT x,
     _In_ INT y,
-    _In_ COLORREF crColor)
+    _In_ ULONG iSolidColor)
 {
-    PDC pdc;
-    ULONG iOldColor, iSolidColor;
+    ULONG iOldColor;
     BOOL bResult;
     PEBRUSHOBJ pebo;
     ULONG ulDirty;
-    EXLATEOBJ exlo;
 
-    /* Lock the DC */
-    pdc = DC_LockDc(hdc);
-    if (!pdc)
-    {
-        EngSetLastError(ERROR_INVALID_HANDLE);
-        return -1;
-    }
-
-    /* Check if the DC has no surface (empty mem or info DC) */
-    if (pdc->dclevel.pSurface == NULL)
-    {
-        /* Fail! */
-        DC_UnlockDc(pdc);
-        return -1;
-    }
+    ASSERT(pdc->dclevel.pSurface != NULL);
 
     if (pdc->fs & (DC_ACCUM_APP|DC_ACCUM_WMGR))
     {
@@ -1465,9 +1486,6 @@ NtGdiSetPixel(
        IntUpdateBoundsRect(pdc, &rcDst);
     }
 
-    /* Translate the color to the target format */
-    iSolidColor = TranslateCOLORREF(pdc, crColor);
-
     /* Use the DC's text brush, which is always a solid brush */
     pebo = &pdc->eboText;
 
@@ -1485,6 +1503,44 @@ NtGdiSetPixel(
     EBRUSHOBJ_iSetSolidColor(pebo, iOldColor);
     pdc->pdcattr->ulDirty_ = ulDirty;
 
+    return bResult;
+}
+
+COLORREF
+APIENTRY
+NtGdiSetPixel(
+    _In_ HDC hdc,
+    _In_ INT x,
+    _In_ INT y,
+    _In_ COLORREF crColor)
+{
+    PDC pdc;
+    ULONG iSolidColor;
+    BOOL bResult;
+    EXLATEOBJ exlo;
+
+    /* Lock the DC */
+    pdc = DC_LockDc(hdc);
+    if (!pdc)
+    {
+        EngSetLastError(ERROR_INVALID_HANDLE);
+        return -1;
+    }
+
+    /* Check if the DC has no surface (empty mem or info DC) */
+    if (pdc->dclevel.pSurface == NULL)
+    {
+        /* Fail! */
+        DC_UnlockDc(pdc);
+        return -1;
+    }
+
+    /* Translate the color to the target format */
+    iSolidColor = TranslateCOLORREF(pdc, crColor);
+
+    /* Call the internal function */
+    bResult = IntGdiSetPixel(pdc, x, y, iSolidColor);
+
     /// FIXME: we shouldn't dereference pSurface while the PDEV is not locked!
     /* Initialize an XLATEOBJ from the target surface to RGB */
     EXLATEOBJ_vInitialize(&exlo,
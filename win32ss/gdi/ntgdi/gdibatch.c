@@ -62,6 +62,69 @@ SynchronizeDriver(FLONG Flags)
   return;
 }
 
+//
+// Exchange the pen, brush and colors of the DC with the snapshot of a drawing
+// command. Calling it a second time restores the DC attributes.
+//
+static
+ULONG
+FASTCALL
+GdiExchangeDrawAttr(PDC_ATTR pdcattr, PGDIBSDRAWATTR pAttr)
+{
+  GDIBSDRAWATTR Attr = *pAttr;
+  ULONG flags = 0;
+
+  if ( pdcattr->crForegroundClr != Attr.crForegroundClr ||
+       pdcattr->ulForegroundClr != Attr.ulForegroundClr )
+  {
+      flags |= (DIRTY_FILL|DIRTY_LINE|DIRTY_TEXT);
+  }
+  if ( pdcattr->crBackgroundClr != Attr.crBackgroundClr ||
+       pdcattr->ulBackgroundClr != Attr.ulBackgroundClr )
+  {
+      flags |= (DIRTY_FILL|DIRTY_LINE|DIRTY_TEXT|DIRTY_BACKGROUND);
+  }
+  if ( pdcattr->hbrush != Attr.hbrush ||
+       pdcattr->crBrushClr != Attr.crBrushClr ||
+       pdcattr->ulBrushClr != Attr.ulBrushClr )
+  {
+      flags |= DC_BRUSH_DIRTY;
+  }
+  if ( pdcattr->hpen != Attr.hpen ||
+       pdcattr->crPenClr != Attr.crPenClr ||
+       pdcattr->ulPenClr != Attr.ulPenClr )
+  {
+      flags |= DC_PEN_DIRTY;
+  }
+
+  pAttr->hbrush          = pdcattr->hbrush;
+  pAttr->hpen            = pdcattr->hpen;
+  pAttr->crForegroundClr = pdcattr->crForegroundClr;
+  pAttr->crBackgroundClr = pdcattr->crBackgroundClr;
+  pAttr->crBrushClr      = pdcattr->crBrushClr;
+  pAttr->crPenClr        = pdcattr->crPenClr;
+  pAttr->ulForegroundClr = pdcattr->ulForegroundClr;
+  pAttr->ulBackgroundClr = pdcattr->ulBackgroundClr;
+  pAttr->ulBrushClr      = pdcattr->ulBrushClr;
+  pAttr->ulPenClr        = pdcattr->ulPenClr;
+
+  pdcattr->hbrush          = Attr.hbrush;
+  pdcattr->hpen            = Attr.hpen;
+  pdcattr->crForegroundClr = Attr.crForegroundClr;
+  pdcattr->crBackgroundClr = Attr.crBackgroundClr;
+  pdcattr->crBrushClr      = Attr.crBrushClr;
+  pdcattr->crPenClr        = Attr.crPenClr;
+  pdcattr->ulForegroundClr = Attr.ulForegroundClr;
+  pdcattr->ulBackgroundClr = Attr.ulBackgroundClr;
+  pdcattr->ulBrushClr      = Attr.ulBrushClr;
+  pdcattr->ulPenClr        = Attr.ulPenClr;
+
+  // Return the dirty flags of the changed attributes.
+  return flags;
+}
+
+#define DIRTY_DRAWATTR (DIRTY_FILL|DIRTY_LINE|DIRTY_TEXT|DIRTY_BACKGROUND|DC_BRUSH_DIRTY|DC_PEN_DIRTY)
+
 //
 // Process the batch.
 //
@@ -443,6 +506,141 @@ GdiFlushUserBatch(PDC dc, PGDIBATCHHDR pHdr)
         break;
      }
 
+     case GdiBCLineTo:
+     {
+        PGDIBSLINETO pgO;
+        GDIBSDRAWATTR Attr;
+        POINTL ptlCurrent, ptfxCurrent, ptl;
+        RECTL rcLockRect;
+        DWORD flags, saveflags, savepos;
+        ULONG i, Count;
+        if (!dc) break;
+        pgO = (PGDIBSLINETO) pHdr;
+        Count = pgO->Count;
+        /* The points must be inside of the entry */
+        if (Size < sizeof(GDIBSLINETO) || Size > GDIBATCHBUFSIZE ||
+            Count < 2 || Count > (Size - FIELD_OFFSET(GDIBSLINETO, aptl)) / sizeof(POINTL))
+           break;
+        // Save the current position and the attributes, set the snapshot
+        ptlCurrent  = pdcattr->ptlCurrent;
+        ptfxCurrent = pdcattr->ptfxCurrent;
+        savepos = pdcattr->ulDirty_ & (DIRTY_PTLCURRENT|DIRTY_PTFXCURRENT|DIRTY_STYLESTATE);
+        saveflags = pdcattr->ulDirty_ & DIRTY_DRAWATTR;
+        Attr = pgO->Attr;
+        flags = GdiExchangeDrawAttr(pdcattr, &Attr);
+        pdcattr->ulDirty_ |= flags;
+        // Start at the position of the first call, like MoveToEx.
+        pdcattr->ptlCurrent = pgO->aptl[0];
+        pdcattr->ulDirty_ &= ~DIRTY_PTLCURRENT;
+        pdcattr->ulDirty_ |= (DIRTY_PTFXCURRENT|DIRTY_STYLESTATE);
+        // Lock the device once for the whole polyline
+        rcLockRect.left = rcLockRect.top = MAXLONG;
+        rcLockRect.right = rcLockRect.bottom = MINLONG;
+        for (i = 0; i < Count; i++)
+        {
+            ptl = pgO->aptl[i];
+            IntLPtoDP(dc, (LPPOINT)&ptl, 1);
+            rcLockRect.left   = min(rcLockRect.left, ptl.x);
+            rcLockRect.top    = min(rcLockRect.top, ptl.y);
+            rcLockRect.right  = max(rcLockRect.right, ptl.x);
+            rcLockRect.bottom = max(rcLockRect.bottom, ptl.y);
+        }
+        RECTL_vOffsetRect(&rcLockRect, dc->ptlDCOrig.x, dc->ptlDCOrig.y);
+        DC_vPrepareDCsForBlit(dc, &rcLockRect, NULL, NULL);
+        for (i = 1; i < Count; i++)
+        {
+            if (!IntGdiLineTo(dc, pgO->aptl[i].x, pgO->aptl[i].y)) break;
+        }
+        DC_vFinishBlit(dc, NULL);
+        // Restore the attributes, flags and the current position of user mode
+        GdiExchangeDrawAttr(pdcattr, &Attr);
+        pdcattr->ptlCurrent  = ptlCurrent;
+        pdcattr->ptfxCurrent = ptfxCurrent;
+        pdcattr->ulDirty_ &= ~(DIRTY_PTLCURRENT|DIRTY_PTFXCURRENT|DIRTY_STYLESTATE);
+        pdcattr->ulDirty_ |= savepos | saveflags | flags;
+        break;
+     }
+
+     case GdiBCRectangle:
+     {
+        PGDIBSRECTANGLE pgO;
+        GDIBSDRAWATTR Attr;
+        DWORD flags, saveflags;
+        if (!dc) break;
+        pgO = (PGDIBSRECTANGLE) pHdr;
+        saveflags = pdcattr->ulDirty_ & DIRTY_DRAWATTR;
+        Attr = pgO->Attr;
+        flags = GdiExchangeDrawAttr(pdcattr, &Attr);
+        pdcattr->ulDirty_ |= flags;
+        IntGdiRectangle(dc, pgO->rcl.left, pgO->rcl.top, pgO->rcl.right, pgO->rcl.bottom);
+        GdiExchangeDrawAttr(pdcattr, &Attr);
+        pdcattr->ulDirty_ |= saveflags | flags;
+        break;
+     }
+
+     case GdiBCSetPixel:
+     {
+        PGDIBSSETPIXEL pgO;
+        COLORREF crColor = CLR_INVALID;
+        ULONG i, Count, iSolidColor = 0;
+        if (!dc) break;
+        pgO = (PGDIBSSETPIXEL) pHdr;
+        Count = pgO->Count;
+        /* The pixels must be inside of the entry */
+        if (Size < sizeof(GDIBSSETPIXEL) || Size > GDIBATCHBUFSIZE ||
+            Count > (Size - FIELD_OFFSET(GDIBSSETPIXEL, aPixel)) / sizeof(GDIBSPIXEL))
+           break;
+        /* Check if the DC has no surface (empty mem or info DC) */
+        if (dc->dclevel.pSurface == NULL)
+        {
+           /* Nothing to do */
+           break;
+        }
+        for (i = 0; i < Count; i++)
+        {
+            /* Runs of pixels mostly use one color, translate it once */
+            if (pgO->aPixel[i].crColor != crColor)
+            {
+                crColor = pgO->aPixel[i].crColor;
+                iSolidColor = TranslateCOLORREF(dc, crColor);
+            }
+            IntGdiSetPixel(dc, pgO->aPixel[i].ptl.x, pgO->aPixel[i].ptl.y, iSolidColor);
+        }
+        break;
+     }
+
+     case GdiBCBitBlt:
+     {
+        PGDIBSBITBLT pgO;
+        GDIBSDRAWATTR Attr;
+        DWORD dwRop, flags, saveflags;
+        if (!dc) break;
+        pgO = (PGDIBSBITBLT) pHdr;
+        /* Convert the ROP3 to an ENG ROP4, like NtGdiBitBlt */
+        dwRop = pgO->dwRop & ~(NOMIRRORBITMAP|CAPTUREBLT);
+        dwRop = WIN32_ROP4_TO_ENG_ROP4(MAKEROP4(dwRop, dwRop));
+        saveflags = pdcattr->ulDirty_ & DIRTY_DRAWATTR;
+        Attr = pgO->Attr;
+        flags = GdiExchangeDrawAttr(pdcattr, &Attr);
+        pdcattr->ulDirty_ |= flags;
+        /* The source is the batch DC itself */
+        IntGdiMaskBlt(dc,
+                      pgO->xDest,
+                      pgO->yDest,
+                      pgO->cx,
+                      pgO->cy,
+                      dc,
+                      pgO->xSrc,
+                      pgO->ySrc,
+                      NULL,
+                      0,
+                      0,
+                      dwRop);
+        GdiExchangeDrawAttr(pdcattr, &Attr);
+        pdcattr->ulDirty_ |= saveflags | flags;
+        break;
+     }
+
      case GdiBCDelRgn:
         DPRINT("Delete Region Object!\n");
         /* Fall through */
@@ -61,6 +61,13 @@ GreMoveTo( HDC hdc,
 
 /* Shape functions */
 
+BOOL FASTCALL
+IntGdiRectangle(PDC dc,
+                int LeftRect,
+                int TopRect,
+                int RightRect,
+                int BottomRect);
+
 BOOL
 NTAPI
 GreGradientFill(
@@ -71,6 +78,28 @@ GreGradientFill(
     ULONG nMesh,
     ULONG ulMode);
 
+/* Blit functions */
+
+BOOL FASTCALL
+IntGdiMaskBlt(PDC DCDest,
+              INT nXDest,
+              INT nYDest,
+              INT nWidth,
+              INT nHeight,
+              PDC DCSrc,
+              INT nXSrc,
+              INT nYSrc,
+              PSURFACE psurfMask,
+              INT xMask,
+              INT yMask,
+              ROP4 rop4);
+
+BOOL FASTCALL
+IntGdiSetPixel(PDC pdc,
+               INT x,
+               INT y,
+               ULONG iSolidColor);
+
 /* DC functions */
 
 HDC FASTCALL
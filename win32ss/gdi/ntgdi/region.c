@@ -130,6 +130,14 @@ SOFTWARE.
 PREGION prgnDefault = NULL;
 HRGN    hrgnDefault = NULL;
 
+/* Rect buffers of up to RGN_POOL_RECTS rects come from a lookaside list.
+   Such buffers always have a nRgnSize of exactly RGN_POOL_SIZE, larger
+   ones are allocated from paged pool. */
+#define RGN_POOL_RECTS  16
+#define RGN_POOL_SIZE   (RGN_POOL_RECTS * sizeof(RECTL))
+
+static PPAGED_LOOKASIDE_LIST gpRegionBufferLookasideList;
+
 // Internal Functions
 
 #if 1
@@ -413,6 +421,45 @@ typedef struct _SCANLINE_LISTBLOCK
 #define LARGE_COORDINATE  INT_MAX
 #define SMALL_COORDINATE  INT_MIN
 
+/* Allocates a rect buffer of at least *pcjSize bytes and returns the
+   actual size of the buffer in *pcjSize */
+static
+PRECTL
+REGION_pAllocBuffer(
+    _Inout_ PULONG pcjSize)
+{
+    if (*pcjSize <= RGN_POOL_SIZE)
+    {
+        *pcjSize = RGN_POOL_SIZE;
+        return ExAllocateFromPagedLookasideList(gpRegionBufferLookasideList);
+    }
+
+    return ExAllocatePoolWithTag(PagedPool, *pcjSize, TAG_REGION);
+}
+
+/* Frees a rect buffer of the region, unless it is the embedded one */
+static
+VOID
+REGION_vFreeBuffer(
+    _In_ PREGION prgn,
+    _In_opt_ PRECTL prclBuffer,
+    _In_ ULONG cjSize)
+{
+    if ((prclBuffer == NULL) || (prclBuffer == &prgn->rdh.rcBound))
+    {
+        return;
+    }
+
+    if (cjSize == RGN_POOL_SIZE)
+    {
+        ExFreeToPagedLookasideList(gpRegionBufferLookasideList, prclBuffer);
+    }
+    else
+    {
+        ExFreePoolWithTag(prclBuffer, TAG_REGION);
+    }
+}
+
 static
 BOOL
 REGION_bGrowBufferSize(
@@ -441,7 +488,7 @@ REGION_bGrowBufferSize(
     }
 
     /* Allocate the new buffer */
-    pvBuffer = ExAllocatePoolWithTag(PagedPool, cjNewSize, TAG_REGION);
+    pvBuffer = REGION_pAllocBuffer(&cjNewSize);
     if (pvBuffer == NULL)
     {
         return FALSE;
@@ -451,10 +498,7 @@ REGION_bGrowBufferSize(
     COPY_RECTS(pvBuffer, prgn->Buffer, prgn->rdh.nCount);
 
     /* Free the old buffer */
-    if (prgn->Buffer != &prgn->rdh.rcBound)
-    {
-        ExFreePoolWithTag(prgn->Buffer, TAG_REGION);
-    }
+    REGION_vFreeBuffer(prgn, prgn->Buffer, prgn->rdh.nRgnSize);
 
     /* Set the new buffer */
     prgn->Buffer = pvBuffer;
@@ -595,21 +639,19 @@ REGION_CopyRegion(
         if (dst->rdh.nRgnSize < src->rdh.nCount * sizeof(RECT))
         {
             PRECTL temp;
+            ULONG cjSize = src->rdh.nCount * sizeof(RECT);
 
             /* Allocate a new buffer */
-            temp = ExAllocatePoolWithTag(PagedPool,
-                                         src->rdh.nCount * sizeof(RECT),
-                                         TAG_REGION);
+            temp = REGION_pAllocBuffer(&cjSize);
             if (temp == NULL)
                 return FALSE;
 
             /* Free the old buffer */
-            if ((dst->Buffer != NULL) && (dst->Buffer != &dst->rdh.rcBound))
-                ExFreePoolWithTag(dst->Buffer, TAG_REGION);
+            REGION_vFreeBuffer(dst, dst->Buffer, dst->rdh.nRgnSize);
 
             /* Set the new buffer and the size */
             dst->Buffer = temp;
-            dst->rdh.nRgnSize = src->rdh.nCount * sizeof(RECT);
+            dst->rdh.nRgnSize = cjSize;
         }
 
         dst->rdh.nCount = src->rdh.nCount;
@@ -670,6 +712,68 @@ REGION_SetExtents(
 }
 
 // FIXME: This function needs review and testing
+/*
+ * Regions are y-x banded, see above. The bottoms of the rects are ascending
+ * over the whole buffer and the rights are ascending within each band, so
+ * bands and rects can be looked up with binary searches.
+ */
+
+/* Returns the index of the first rect in [iStart, iEnd) with bottom > y */
+static
+ULONG
+REGION_FindBand(
+    _In_ PREGION prgn,
+    _In_ ULONG iStart,
+    _In_ ULONG iEnd,
+    _In_ LONG y)
+{
+    ULONG iMiddle;
+
+    while (iStart < iEnd)
+    {
+        iMiddle = iStart + (iEnd - iStart) / 2;
+        if (prgn->Buffer[iMiddle].bottom > y)
+            iEnd = iMiddle;
+        else
+            iStart = iMiddle + 1;
+    }
+
+    return iStart;
+}
+
+/* Returns the index of the first rect in the band [iStart, iEnd) with right > x */
+static
+ULONG
+REGION_FindRectInBand(
+    _In_ PREGION prgn,
+    _In_ ULONG iStart,
+    _In_ ULONG iEnd,
+    _In_ LONG x)
+{
+    ULONG iMiddle;
+
+    while (iStart < iEnd)
+    {
+        iMiddle = iStart + (iEnd - iStart) / 2;
+        if (prgn->Buffer[iMiddle].right > x)
+            iEnd = iMiddle;
+        else
+            iStart = iMiddle + 1;
+    }
+
+    return iStart;
+}
+
+/* Returns the index of the first rect after the band starting at iBand */
+static __inline
+ULONG
+REGION_FindBandEnd(
+    _In_ PREGION prgn,
+    _In_ ULONG iBand)
+{
+    return REGION_FindBand(prgn, iBand, prgn->rdh.nCount, prgn->Buffer[iBand].bottom);
+}
+
 /***********************************************************************
  *           REGION_CropRegion
  */
@@ -694,12 +798,9 @@ REGION_CropRegion(
         goto empty;
     }
 
-    /* Skip all rects that are completely above our intersect rect */
-    for (clipa = 0; clipa < rgnSrc->rdh.nCount; clipa++)
-    {
-        /* bottom is exclusive, so break when we go above it */
-        if (rgnSrc->Buffer[clipa].bottom > rect->top) break;
-    }
+    /* Skip all rects that are completely above our intersect rect
+       (bottom is exclusive) */
+    clipa = REGION_FindBand(rgnSrc, 0, rgnSrc->rdh.nCount, rect->top);
 
     /* Bail out, if there is nothing left */
     if (clipa == rgnSrc->rdh.nCount) goto empty;
@@ -723,13 +824,12 @@ REGION_CropRegion(
     if ((rgnDst != rgnSrc) && (rgnDst->rdh.nRgnSize < nRgnSize))
     {
         PRECTL temp;
-        temp = ExAllocatePoolWithTag(PagedPool, nRgnSize, TAG_REGION);
+        temp = REGION_pAllocBuffer(&nRgnSize);
         if (temp == NULL)
             return ERROR;
 
         /* Free the old buffer */
-        if (rgnDst->Buffer && (rgnDst->Buffer != &rgnDst->rdh.rcBound))
-            ExFreePoolWithTag(rgnDst->Buffer, TAG_REGION);
+        REGION_vFreeBuffer(rgnDst, rgnDst->Buffer, rgnDst->rdh.nRgnSize);
 
         rgnDst->Buffer = temp;
         rgnDst->rdh.nCount = 0;
@@ -972,6 +1072,7 @@ REGION_RegionOp(
     INT ybot;                          /* Bottom of intersection */
     INT ytop;                          /* Top of intersection */
     RECTL *oldRects;                   /* Old rects for newReg */
+    ULONG oldSize;                     /* Size of the old rects buffer */
     ULONG prevBand;                    /* Index of start of
                                         * Previous band in newReg */
     ULONG curBand;                     /* Index of start of current band in newReg */
@@ -994,18 +1095,19 @@ REGION_RegionOp(
      * note of its rects pointer (so that we can free them later), preserve its
      * extents and simply set numRects to zero. */
     oldRects = newReg->Buffer;
+    oldSize = newReg->rdh.nRgnSize;
     newReg->rdh.nCount = 0;
 
     /* Allocate a reasonable number of rectangles for the new region. The idea
      * is to allocate enough so the individual functions don't need to
      * reallocate and copy the array, which is time consuming, yet we don't
      * have to worry about using too much memory. I hope to be able to
-     * nuke the Xrealloc() at the end of this function eventually. */
+     * nuke the Xrealloc() at the end of this function eventually.
+     * Small buffers come from the lookaside list, so most operations on
+     * simple regions don't hit the pool at all. */
     newReg->rdh.nRgnSize = max(reg1->rdh.nCount + 1, reg2->rdh.nCount) * 2 * sizeof(RECT);
 
-    newReg->Buffer = ExAllocatePoolWithTag(PagedPool,
-                                           newReg->rdh.nRgnSize,
-                                           TAG_REGION);
+    newReg->Buffer = REGION_pAllocBuffer(&newReg->rdh.nRgnSize);
     if (newReg->Buffer == NULL)
     {
         newReg->rdh.nRgnSize = 0;
@@ -1184,48 +1286,31 @@ REGION_RegionOp(
      * rectangles in the region. This never goes to 0, however...
      *
      * Only do this stuff if the number of rectangles allocated is more than
-     * twice the number of rectangles in the region (a simple optimization...). */
+     * twice the number of rectangles in the region (a simple optimization...).
+     * Buffers from the lookaside list can't get any smaller. */
     if ((newReg->rdh.nRgnSize > (2 * newReg->rdh.nCount * sizeof(RECT))) &&
+        (newReg->rdh.nRgnSize > RGN_POOL_SIZE) &&
         (newReg->rdh.nCount > 2))
     {
-        if (REGION_NOT_EMPTY(newReg))
-        {
-            RECTL *prev_rects = newReg->Buffer;
-            newReg->Buffer = ExAllocatePoolWithTag(PagedPool,
-                                                   newReg->rdh.nCount * sizeof(RECT),
-                                                   TAG_REGION);
+        ULONG cjSize = newReg->rdh.nCount * sizeof(RECT);
+        RECTL *prev_rects = newReg->Buffer;
 
-            if (newReg->Buffer == NULL)
-            {
-                newReg->Buffer = prev_rects;
-            }
-            else
-            {
-                newReg->rdh.nRgnSize = newReg->rdh.nCount*sizeof(RECT);
-                COPY_RECTS(newReg->Buffer, prev_rects, newReg->rdh.nCount);
-                if (prev_rects != &newReg->rdh.rcBound)
-                    ExFreePoolWithTag(prev_rects, TAG_REGION);
-            }
+        newReg->Buffer = REGION_pAllocBuffer(&cjSize);
+        if (newReg->Buffer == NULL)
+        {
+            newReg->Buffer = prev_rects;
         }
         else
         {
-            /* No point in doing the extra work involved in an Xrealloc if
-             * the region is empty */
-            newReg->rdh.nRgnSize = sizeof(RECT);
-            if (newReg->Buffer != &newReg->rdh.rcBound)
-                ExFreePoolWithTag(newReg->Buffer, TAG_REGION);
-
-            newReg->Buffer = ExAllocatePoolWithTag(PagedPool,
-                                                   sizeof(RECT),
-                                                   TAG_REGION);
-            ASSERT(newReg->Buffer);
+            COPY_RECTS(newReg->Buffer, prev_rects, newReg->rdh.nCount);
+            REGION_vFreeBuffer(newReg, prev_rects, newReg->rdh.nRgnSize);
+            newReg->rdh.nRgnSize = cjSize;
         }
     }
 
     newReg->rdh.iType = RDH_RECTANGLES;
 
-    if (oldRects != &newReg->rdh.rcBound)
-        ExFreePoolWithTag(oldRects, TAG_REGION);
+    REGION_vFreeBuffer(newReg, oldRects, oldSize);
     return TRUE;
 }
 
@@ -1935,9 +2020,7 @@ REGION_bMakeSimpleFrameRgn(
         NT_ASSERT(prgn->rdh.nCount > 1);
         prgn->rdh.nRgnSize = prgn->rdh.nCount * sizeof(RECT);
         NT_ASSERT(prgn->Buffer == &prgn->rdh.rcBound);
-        prgn->Buffer = ExAllocatePoolWithTag(PagedPool,
-                                            prgn->rdh.nRgnSize,
-                                            TAG_REGION);
+        prgn->Buffer = REGION_pAllocBuffer(&prgn->rdh.nRgnSize);
         if (prgn->Buffer == NULL)
         {
             prgn->rdh.nRgnSize = 0;
@@ -2077,6 +2160,55 @@ GreCreateFrameRgn(
     return hrgnFrame;
 }
 
+static
+VOID
+REGION_vReverseRects(
+    _Inout_updates_(cRects) PRECTL prcl,
+    _In_ ULONG cRects)
+{
+    RECTL rcTemp;
+    ULONG i;
+
+    for (i = 0; i < cRects / 2; i++)
+    {
+        rcTemp = prcl[i];
+        prcl[i] = prcl[cRects - 1 - i];
+        prcl[cRects - 1 - i] = rcTemp;
+    }
+}
+
+/* A mirroring scale reverses the order of the bands and / or the order
+   of the rects within the bands. Restore the y-x banding. */
+static
+VOID
+REGION_vRestoreBanding(
+    _Inout_ PREGION prgn)
+{
+    ULONG iBand, iBandEnd;
+
+    if (prgn->rdh.nCount < 2)
+        return;
+
+    if (prgn->Buffer[0].top > prgn->Buffer[prgn->rdh.nCount - 1].top)
+    {
+        REGION_vReverseRects(prgn->Buffer, prgn->rdh.nCount);
+    }
+
+    for (iBand = 0; iBand < prgn->rdh.nCount; iBand = iBandEnd)
+    {
+        for (iBandEnd = iBand + 1; iBandEnd < prgn->rdh.nCount; iBandEnd++)
+        {
+            if (prgn->Buffer[iBandEnd].top != prgn->Buffer[iBand].top)
+                break;
+        }
+
+        if (prgn->Buffer[iBand].left > prgn->Buffer[iBandEnd - 1].left)
+        {
+            REGION_vReverseRects(&prgn->Buffer[iBand], iBandEnd - iBand);
+        }
+    }
+}
+
 BOOL
 FASTCALL
 REGION_bXformRgn(
@@ -2146,6 +2278,9 @@ REGION_bXformRgn(
                 }
             }
 
+            /* Negative scales mirror the region */
+            REGION_vRestoreBanding(prgn);
+
             /* Loop all rects in the region */
             for (i = 0; i < prgn->rdh.nCount - 1; i++)
             {
@@ -2221,6 +2356,7 @@ REGION_AllocRgnWithHandle(
 {
     //HRGN hReg;
     PREGION pReg;
+    ULONG cjSize;
 
     pReg = (PREGION)GDIOBJ_AllocateObject(GDIObjType_RGN_TYPE,
                                           sizeof(REGION),
@@ -2238,12 +2374,12 @@ REGION_AllocRgnWithHandle(
         /* Testing shows that > 95% of all regions have only 1 rect.
            Including that here saves us from having to do another allocation */
         pReg->Buffer = &pReg->rdh.rcBound;
+        cjSize = nReg * sizeof(RECT);
     }
     else
     {
-        pReg->Buffer = ExAllocatePoolWithTag(PagedPool,
-                                             nReg * sizeof(RECT),
-                                             TAG_REGION);
+        cjSize = nReg * sizeof(RECT);
+        pReg->Buffer = REGION_pAllocBuffer(&cjSize);
         if (pReg->Buffer == NULL)
         {
             DPRINT1("Could not allocate region buffer\n");
@@ -2255,7 +2391,7 @@ REGION_AllocRgnWithHandle(
     EMPTY_REGION(pReg);
     pReg->rdh.dwSize = sizeof(RGNDATAHEADER);
     pReg->rdh.nCount = nReg;
-    pReg->rdh.nRgnSize = nReg * sizeof(RECT);
+    pReg->rdh.nRgnSize = cjSize;
     pReg->prgnattr = &pReg->rgnattr;
 
     /* Initialize the region attribute */
@@ -2447,6 +2583,28 @@ IntSysCreateRectpRgn(
     return prgn;
 }
 
+CODE_SEG("INIT")
+NTSTATUS
+NTAPI
+InitRegionImpl(VOID)
+{
+    gpRegionBufferLookasideList = ExAllocatePoolWithTag(NonPagedPool,
+                                                        sizeof(PAGED_LOOKASIDE_LIST),
+                                                        TAG_REGION);
+    if (gpRegionBufferLookasideList == NULL)
+        return STATUS_NO_MEMORY;
+
+    ExInitializePagedLookasideList(gpRegionBufferLookasideList,
+                                   NULL,
+                                   NULL,
+                                   0,
+                                   RGN_POOL_SIZE,
+                                   TAG_REGION,
+                                   0);
+
+    return STATUS_SUCCESS;
+}
+
 VOID
 NTAPI
 REGION_vCleanup(PVOID ObjectBody)
@@ -2459,8 +2617,7 @@ REGION_vCleanup(PVOID ObjectBody)
     if (pRgn->prgnattr != &pRgn->rgnattr)
         GdiPoolFree(ppi->pPoolRgnAttr, pRgn->prgnattr);
 
-    if (pRgn->Buffer && pRgn->Buffer != &pRgn->rdh.rcBound)
-        ExFreePoolWithTag(pRgn->Buffer, TAG_REGION);
+    REGION_vFreeBuffer(pRgn, pRgn->Buffer, pRgn->rdh.nRgnSize);
 }
 
 VOID
@@ -2604,17 +2761,20 @@ REGION_PtInRegion(
     INT X,
     INT Y)
 {
-    ULONG i;
-    PRECT r;
+    ULONG iBand, iBandEnd, iRect;
 
     if (prgn->rdh.nCount > 0 && INRECT(prgn->rdh.rcBound, X, Y))
     {
-        r =  prgn->Buffer;
-        for (i = 0; i < prgn->rdh.nCount; i++)
-        {
-            if (INRECT(r[i], X, Y))
-                return TRUE;
-        }
+        /* Find the band that contains Y */
+        iBand = REGION_FindBand(prgn, 0, prgn->rdh.nCount, Y);
+        if ((iBand == prgn->rdh.nCount) || (prgn->Buffer[iBand].top > Y))
+            return FALSE;
+
+        /* Find the first rect of the band that ends right of X */
+        iBandEnd = REGION_FindBandEnd(prgn, iBand);
+        iRect = REGION_FindRectInBand(prgn, iBand, iBandEnd, X);
+
+        return (iRect < iBandEnd) && (prgn->Buffer[iRect].left <= X);
     }
 
     return FALSE;
@@ -2626,7 +2786,7 @@ REGION_RectInRegion(
     PREGION Rgn,
     const RECTL *rect)
 {
-    PRECTL pCurRect, pRectEnd;
+    ULONG iBand, iBandEnd, iRect;
     RECT rc;
 
     /* Swap the coordinates to make right >= left and bottom >= top */
@@ -2656,24 +2816,19 @@ REGION_RectInRegion(
     /* This is (just) a useful optimization */
     if ((Rgn->rdh.nCount > 0) && EXTENTCHECK(&Rgn->rdh.rcBound, &rc))
     {
-        for (pCurRect = Rgn->Buffer, pRectEnd = pCurRect +
-                                                Rgn->rdh.nCount; pCurRect < pRectEnd; pCurRect++)
-        {
-            if (pCurRect->bottom <= rc.top)
-                continue;             /* Not far enough down yet */
-
-            if (pCurRect->top >= rc.bottom)
-                break;                /* Too far down */
+        /* Skip the bands above the rect */
+        iBand = REGION_FindBand(Rgn, 0, Rgn->rdh.nCount, rc.top);
 
-            if (pCurRect->right <= rc.left)
-                continue;              /* Not far enough over yet */
-
-            if (pCurRect->left >= rc.right)
-            {
-                continue;
-            }
+        /* Check all bands until we are too far down */
+        while ((iBand < Rgn->rdh.nCount) && (Rgn->Buffer[iBand].top < rc.bottom))
+        {
+            /* Find the first rect of the band that is far enough over */
+            iBandEnd = REGION_FindBandEnd(Rgn, iBand);
+            iRect = REGION_FindRectInBand(Rgn, iBand, iBandEnd, rc.left);
+            if ((iRect < iBandEnd) && (Rgn->Buffer[iRect].left < rc.right))
+                return TRUE;
 
-            return TRUE;
+            iBand = iBandEnd;
         }
     }
 
@@ -3072,6 +3227,7 @@ REGION_PtsToRegion(
     INT i;
     RECTL *extents, *temp;
     INT numRects;
+    ULONG cjSize;
 
     extents = &reg->rdh.rcBound;
 
@@ -3083,7 +3239,8 @@ REGION_PtsToRegion(
         numRects = 1;
     }
 
-    temp = ExAllocatePoolWithTag(PagedPool, numRects * sizeof(RECT), TAG_REGION);
+    cjSize = numRects * sizeof(RECT);
+    temp = REGION_pAllocBuffer(&cjSize);
     if (temp == NULL)
     {
         return 0;
@@ -3092,10 +3249,10 @@ REGION_PtsToRegion(
     if (reg->Buffer != NULL)
     {
         COPY_RECTS(temp, reg->Buffer, reg->rdh.nCount);
-        if (reg->Buffer != &reg->rdh.rcBound)
-            ExFreePoolWithTag(reg->Buffer, TAG_REGION);
+        REGION_vFreeBuffer(reg, reg->Buffer, reg->rdh.nRgnSize);
     }
     reg->Buffer = temp;
+    reg->rdh.nRgnSize = cjSize;
 
     reg->rdh.nCount = numRects;
     CurPtBlock = FirstPtBlock;
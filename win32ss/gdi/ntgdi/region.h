@@ -32,6 +32,7 @@ BOOL FASTCALL REGION_RectInRegion(PREGION Rgn, const RECTL *rc);
 BOOL FASTCALL REGION_PtInRegion(PREGION, INT, INT);
 INT FASTCALL REGION_CropRegion(PREGION rgnDst, PREGION rgnSrc, const RECTL *rect);
 VOID FASTCALL REGION_SetRectRgn(PREGION pRgn, INT LeftRect, INT TopRect, INT RightRect, INT BottomRect);
+CODE_SEG("INIT") NTSTATUS NTAPI InitRegionImpl(VOID);
 VOID NTAPI REGION_vCleanup(PVOID ObjectBody);
 VOID FASTCALL REGION_Delete(PREGION);
 INT APIENTRY IntGdiGetRgnBox(HRGN, RECTL*);
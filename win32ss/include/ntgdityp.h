@@ -92,6 +92,10 @@ typedef enum _GDIBATCHCMD
     GdiBCSelObj,
     GdiBCDelObj,
     GdiBCDelRgn,
+    GdiBCLineTo,
+    GdiBCRectangle,
+    GdiBCSetPixel,
+    GdiBCBitBlt,
 } GDIBATCHCMD, *PGDIBATCHCMD;
 
 typedef enum _TRANSFORMTYPE
@@ -560,6 +564,71 @@ typedef struct _GDIBSOBJECT
   HGDIOBJ hgdiobj;
 } GDIBSOBJECT, *PGDIBSOBJECT;
 
+//
+// Pen, brush and color snapshot of the drawing commands. Mode and transform
+// changes flush the batch (DC_MODE_DIRTY), so they are not part of it.
+//
+typedef struct _GDIBSDRAWATTR
+{
+  HANDLE hbrush;
+  HANDLE hpen;
+  COLORREF crForegroundClr;
+  COLORREF crBackgroundClr;
+  COLORREF crBrushClr;
+  COLORREF crPenClr;
+  ULONG ulForegroundClr;
+  ULONG ulBackgroundClr;
+  ULONG ulBrushClr;
+  ULONG ulPenClr;
+} GDIBSDRAWATTR, *PGDIBSDRAWATTR;
+
+//
+// LineTo calls continuing the previous one are appended to it, aptl[0] is
+// the current position at the first call.
+//
+typedef struct _GDIBSLINETO
+{
+  GDIBATCHHDR gbHdr;
+  GDIBSDRAWATTR Attr;
+  ULONG Count;
+  POINTL aptl[2];
+} GDIBSLINETO, *PGDIBSLINETO;
+
+typedef struct _GDIBSRECTANGLE
+{
+  GDIBATCHHDR gbHdr;
+  GDIBSDRAWATTR Attr;
+  RECTL rcl;
+} GDIBSRECTANGLE, *PGDIBSRECTANGLE;
+
+typedef struct _GDIBSPIXEL
+{
+  POINTL ptl;
+  COLORREF crColor;
+} GDIBSPIXEL, *PGDIBSPIXEL;
+
+/* SetPixelV calls are appended to the previous one. */
+typedef struct _GDIBSSETPIXEL
+{
+  GDIBATCHHDR gbHdr;
+  ULONG Count;
+  GDIBSPIXEL aPixel[1];
+} GDIBSSETPIXEL, *PGDIBSSETPIXEL;
+
+/* Only blits inside of the batch DC are batched. */
+typedef struct _GDIBSBITBLT
+{
+  GDIBATCHHDR gbHdr;
+  GDIBSDRAWATTR Attr;
+  int xDest;
+  int yDest;
+  int cx;
+  int cy;
+  int xSrc;
+  int ySrc;
+  DWORD dwRop;
+} GDIBSBITBLT, *PGDIBSBITBLT;
+
 /* Declaration missing in ddk/winddi.h */
 typedef VOID (APIENTRY *PFN_DrvMovePanning)(LONG, LONG, FLONG);
 
@@ -734,6 +734,9 @@ typedef struct _WND
     LIST_ENTRY ThreadListEntry;
 
     PVOID DialogPointer;
+
+    /* Cached visible regions, see vis.c */
+    struct _VIS_CACHE *pVisCache;
 } WND, *PWND;
 
 #define PWND_BOTTOM ((PWND)1)
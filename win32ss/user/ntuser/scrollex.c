@@ -388,6 +388,7 @@ IntScrollWindowEx(
          /* Adjust window positions */
          RECTL_vOffsetRect(&Child->rcWindow, dx, dy);
          RECTL_vOffsetRect(&Child->rcClient, dx, dy);
+         VIS_InvalidateCache();
 
          if (!prcScroll || RECTL_bIntersectRect(&rcDummy, &rcChild, &rcScroll))
          {
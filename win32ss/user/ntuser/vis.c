@@ -9,8 +9,122 @@
 #include <win32k.h>
 DBG_DEFAULT_CHANNEL(UserWinpos);
 
+/*
+ * Visible regions are cached per window, one entry for every combination of
+ * the ClientArea, ClipChildren and ClipSiblings flags. An entry is valid as
+ * long as the layout generation did not change since it was computed. The
+ * generation is bumped whenever a window is moved, resized, shown, hidden,
+ * restyled, gets a new window region or changes its place in the z-order,
+ * so any such change invalidates the cache of all windows at once.
+ * The window's own style, rectangles and window region are kept in the
+ * entry too, so changes made to the window itself are always noticed.
+ */
+#define VIS_CACHE_CLIENTAREA    0x1
+#define VIS_CACHE_CLIPCHILDREN  0x2
+#define VIS_CACHE_CLIPSIBLINGS  0x4
+#define VIS_CACHE_ENTRIES       8
+
+/* Print the hit rate every so many lookups */
+#define VIS_CACHE_STATS_INTERVAL 4096
+
+typedef struct _VIS_CACHE_ENTRY
+{
+   ULONG Generation;
+   DWORD Style;
+   DWORD ExStyle;
+   RECT rcWindow;
+   RECT rcClient;
+   HRGN hrgnClip;
+   PREGION Region;
+} VIS_CACHE_ENTRY, *PVIS_CACHE_ENTRY;
+
+typedef struct _VIS_CACHE
+{
+   VIS_CACHE_ENTRY Entries[VIS_CACHE_ENTRIES];
+} VIS_CACHE, *PVIS_CACHE;
+
+/* Starts at 1, so zeroed entries are never valid */
+static ULONG gVisGeneration = 1;
+static ULONG gVisCacheHits = 0;
+static ULONG gVisCacheMisses = 0;
+
+VOID FASTCALL
+VIS_InvalidateCache(VOID)
+{
+   if (++gVisGeneration == 0)
+      gVisGeneration = 1;
+}
+
+VOID FASTCALL
+VIS_FreeCache(PWND Wnd)
+{
+   ULONG i;
+
+   if (!Wnd->pVisCache)
+      return;
+
+   for (i = 0; i < VIS_CACHE_ENTRIES; i++)
+   {
+      if (Wnd->pVisCache->Entries[i].Region)
+         REGION_Delete(Wnd->pVisCache->Entries[i].Region);
+   }
+
+   ExFreePoolWithTag(Wnd->pVisCache, USERTAG_VISRGN);
+   Wnd->pVisCache = NULL;
+}
+
+static
+BOOLEAN
+VIS_IsCacheEntryValid(PVIS_CACHE_ENTRY Entry, PWND Wnd)
+{
+   return Entry->Region != NULL &&
+          Entry->Generation == gVisGeneration &&
+          Entry->Style == Wnd->style &&
+          Entry->ExStyle == Wnd->ExStyle &&
+          Entry->hrgnClip == Wnd->hrgnClip &&
+          RtlEqualMemory(&Entry->rcWindow, &Wnd->rcWindow, sizeof(RECT)) &&
+          RtlEqualMemory(&Entry->rcClient, &Wnd->rcClient, sizeof(RECT));
+}
+
+static
+PREGION
+VIS_CopyRegion(PREGION Region)
+{
+   PREGION Copy;
+
+   Copy = IntSysCreateRectpRgn(0, 0, 0, 0);
+   if (!Copy)
+      return NULL;
+
+   if (IntGdiCombineRgn(Copy, Region, NULL, RGN_COPY) == ERROR)
+   {
+      REGION_Delete(Copy);
+      return NULL;
+   }
+
+   return Copy;
+}
+
+static
+VOID
+VIS_UpdateStatistics(BOOLEAN Hit)
+{
+   if (Hit)
+      gVisCacheHits++;
+   else
+      gVisCacheMisses++;
+
+   if (((gVisCacheHits + gVisCacheMisses) % VIS_CACHE_STATS_INTERVAL) == 0)
+   {
+      TRACE("Visible region cache: %lu hits, %lu misses, %lu%% hit rate\n",
+            gVisCacheHits, gVisCacheMisses,
+            (ULONG)((ULONGLONG)gVisCacheHits * 100 / (gVisCacheHits + gVisCacheMisses)));
+   }
+}
+
+static
 PREGION FASTCALL
-VIS_ComputeVisibleRegion(
+VIS_BuildVisibleRegion(
    PWND Wnd,
    BOOLEAN ClientArea,
    BOOLEAN ClipChildren,
@@ -141,6 +255,73 @@ VIS_ComputeVisibleRegion(
    return VisRgn;
 }
 
+PREGION FASTCALL
+VIS_ComputeVisibleRegion(
+   PWND Wnd,
+   BOOLEAN ClientArea,
+   BOOLEAN ClipChildren,
+   BOOLEAN ClipSiblings)
+{
+   PVIS_CACHE_ENTRY Entry;
+   PREGION VisRgn, Copy;
+   ULONG Index;
+
+   if (!Wnd || !(Wnd->style & WS_VISIBLE))
+   {
+      return NULL;
+   }
+
+   Index = (ClientArea ? VIS_CACHE_CLIENTAREA : 0) |
+           (ClipChildren ? VIS_CACHE_CLIPCHILDREN : 0) |
+           (ClipSiblings ? VIS_CACHE_CLIPSIBLINGS : 0);
+
+   if (Wnd->pVisCache)
+   {
+      Entry = &Wnd->pVisCache->Entries[Index];
+      if (VIS_IsCacheEntryValid(Entry, Wnd))
+      {
+         /* The caller owns the returned region, so hand out a copy */
+         Copy = VIS_CopyRegion(Entry->Region);
+         if (Copy)
+         {
+            VIS_UpdateStatistics(TRUE);
+            return Copy;
+         }
+      }
+   }
+
+   VIS_UpdateStatistics(FALSE);
+
+   VisRgn = VIS_BuildVisibleRegion(Wnd, ClientArea, ClipChildren, ClipSiblings);
+   if (!VisRgn)
+      return NULL;
+
+   if (!Wnd->pVisCache)
+   {
+      Wnd->pVisCache = ExAllocatePoolZero(PagedPool, sizeof(VIS_CACHE), USERTAG_VISRGN);
+      if (!Wnd->pVisCache)
+         return VisRgn;
+   }
+
+   Copy = VIS_CopyRegion(VisRgn);
+   if (Copy)
+   {
+      Entry = &Wnd->pVisCache->Entries[Index];
+      if (Entry->Region)
+         REGION_Delete(Entry->Region);
+
+      Entry->Generation = gVisGeneration;
+      Entry->Style = Wnd->style;
+      Entry->ExStyle = Wnd->ExStyle;
+      Entry->rcWindow = Wnd->rcWindow;
+      Entry->rcClient = Wnd->rcClient;
+      Entry->hrgnClip = Wnd->hrgnClip;
+      Entry->Region = Copy;
+   }
+
+   return VisRgn;
+}
+
 VOID FASTCALL
 co_VIS_WindowLayoutChanged(
    PWND Wnd,
@@ -151,6 +332,8 @@ co_VIS_WindowLayoutChanged(
 
    ASSERT_REFS_CO(Wnd);
 
+   VIS_InvalidateCache();
+
    Parent = Wnd->spwndParent;
    if(Parent)
    {
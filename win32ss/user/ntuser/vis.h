@@ -11,5 +11,7 @@
 
 PREGION FASTCALL VIS_ComputeVisibleRegion(PWND Window, BOOLEAN ClientArea, BOOLEAN ClipChildren, BOOLEAN ClipSiblings);
 VOID FASTCALL co_VIS_WindowLayoutChanged(PWND Window, PREGION UncoveredRgn);
+VOID FASTCALL VIS_InvalidateCache(VOID);
+VOID FASTCALL VIS_FreeCache(PWND Window);
 
 /* EOF */
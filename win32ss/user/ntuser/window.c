@@ -149,6 +149,7 @@ IntSetStyle( PWND pwnd, ULONG set_bits, ULONG clear_bits )
     styleNew = (pwnd->style | set_bits) & ~clear_bits;
     if (styleNew == styleOld) return styleNew;
     pwnd->style = styleNew;
+    VIS_InvalidateCache();
     if ((styleOld ^ styleNew) & WS_VISIBLE) // State Change.
     {
        if (styleOld & WS_VISIBLE) pwnd->head.pti->cVisWindows--;
@@ -585,6 +586,7 @@ LRESULT co_UserFreeWindow(PWND Window,
    Window->state2 |= WNDS2_INDESTROY;
    Window->style &= ~WS_VISIBLE;
    Window->head.pti->cVisWindows--;
+   VIS_InvalidateCache();
 
 
    /* remove the window already at this point from the thread window list so we
@@ -738,6 +740,7 @@ LRESULT co_UserFreeWindow(PWND Window,
       GreDeleteObject(Window->hrgnClip);
       Window->hrgnClip = NULL;
    }
+   VIS_FreeCache(Window);
    Window->head.pti->cWindows--;
 
 //   ASSERT(Window != NULL);
@@ -950,6 +953,8 @@ IntLinkWindow(
 
         Wnd->spwndParent->spwndChild = Wnd;
     }
+
+    VIS_InvalidateCache();
 }
 
 /*
@@ -1219,6 +1224,7 @@ co_IntSetParent(PWND Wnd, PWND WndNewParent)
        !(Wnd->style & WS_CLIPSIBLINGS) )
    {
       Wnd->style |= WS_CLIPSIBLINGS;
+      VIS_InvalidateCache();
       DceResetActiveDCEs(Wnd);
    }
 
@@ -1339,6 +1345,8 @@ IntUnlinkWindow(PWND Wnd)
         Wnd->spwndParent->spwndChild = Wnd->spwndNext;
 
     Wnd->spwndPrev = Wnd->spwndNext = NULL;
+
+    VIS_InvalidateCache();
 }
 
 BOOL FASTCALL IntGrowHwndList(PWINDOWLIST *ppwl)
@@ -3815,6 +3823,7 @@ co_IntSetWindowLongPtr(HWND hWnd, DWORD Index, LONG_PTR NewValue, BOOL Ansi, ULO
             }
 
             Window->ExStyle = (DWORD)Style.styleNew;
+            VIS_InvalidateCache();
 
             co_IntSendMessage(hWnd, WM_STYLECHANGED, GWL_EXSTYLE, (LPARAM) &Style);
             break;
@@ -3868,6 +3877,7 @@ co_IntSetWindowLongPtr(HWND hWnd, DWORD Index, LONG_PTR NewValue, BOOL Ansi, ULO
                DceResetActiveDCEs( Window );
             }
             Window->style = (DWORD)Style.styleNew;
+            VIS_InvalidateCache();
 
             if (!bAlter)
                 co_IntSendMessage(hWnd, WM_STYLECHANGED, GWL_STYLE, (LPARAM) &Style);
@@ -276,6 +276,8 @@ SelectWindowRgn(PWND Window, HRGN hRgnClip)
 
         Window->hrgnClip = hRgnClip;
     }
+
+    VIS_InvalidateCache();
 }
 
 //
@@ -1885,6 +1887,7 @@ co_WinPosSetWindowPos(
 
    Window->rcWindow = NewWindowRect;
    Window->rcClient = NewClientRect;
+   VIS_InvalidateCache();
 
    /* erase parent when hiding or resizing child */
    if (WinPos.flags & SWP_HIDEWINDOW)
@@ -1900,6 +1903,7 @@ co_WinPosSetWindowPos(
 
       Window->style &= ~WS_VISIBLE; //IntSetStyle( Window, 0, WS_VISIBLE );
       Window->head.pti->cVisWindows--;
+      VIS_InvalidateCache();
       IntNotifyWinEvent(EVENT_OBJECT_HIDE, Window, OBJID_WINDOW, CHILDID_SELF, WEF_SETBYWNDPTI);
    }
    else if (WinPos.flags & SWP_SHOWWINDOW)
@@ -1924,6 +1928,7 @@ co_WinPosSetWindowPos(
 
       Window->style |= WS_VISIBLE; //IntSetStyle( Window, WS_VISIBLE, 0 );
       Window->head.pti->cVisWindows++;
+      VIS_InvalidateCache();
       IntNotifyWinEvent(EVENT_OBJECT_SHOW, Window, OBJID_WINDOW, CHILDID_SELF, WEF_SETBYWNDPTI);
    }
    else